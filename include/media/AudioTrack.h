@@ -47,6 +47,14 @@ public:
         RIGHT  = 1
     };
 
+    /* Flags for the flags parameter, combined with audio_policy_output_flags_t.
+     */
+    enum track_flags {
+        FLAG_FAST = 0x8000          // Request a low latency track, mixed by the fast mixer of the
+                                    // output if the track is eligible (output sampling rate,
+                                    // 16 bit PCM, no shared buffer, no effect on its session).
+    };
+
     /* Events used by AudioTrack callback function (audio_track_cblk_t).
      */
     enum event_type {
@@ -132,7 +140,7 @@ public:
      * channelMask:        Channel mask: see audio_channels_t.
      * frameCount:         Total size of track PCM buffer in frames. This defines the
      *                     latency of the track.
-     * flags:              Reserved for future use.
+     * flags:              audio_policy_output_flags_t, optionally with FLAG_FAST.
      * cbf:                Callback function. If not null, this function is called periodically
      *                     to request new PCM data.
      * notificationFrames: The callback function is called each time notificationFrames PCM
@@ -279,6 +287,8 @@ public:
      *
      * For proper operation the following condition must be respected:
      *          (loopEnd-loopStart) <= framecount()
+     *
+     * Returns INVALID_OPERATION on a track created with FLAG_FAST and no shared buffer.
      */
             status_t    setLoop(uint32_t loopStart, uint32_t loopEnd, int loopCount);
             status_t    getLoop(uint32_t *loopStart, uint32_t *loopEnd, int *loopCount);
@@ -41,6 +41,11 @@ class IAudioFlinger : public IInterface
 public:
     DECLARE_META_INTERFACE(AudioFlinger);
 
+    // createTrack() flags. The client flags are passed in the upper 16 bits.
+    enum {
+        TRACK_FAST = 0x80000000,    // AudioTrack::FLAG_FAST
+    };
+
     /* create an audio track and registers it with AudioFlinger.
      * return null if the track cannot be created.
      */
@@ -22,17 +22,30 @@
 
 #include <stdint.h>
 #include <utils/Errors.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 #include <OMX_Video.h>
 
 namespace android {
 
+// Converts to OMX_COLOR_Format16bitRGB565, to OMX_COLOR_Format32bitARGB8888,
+// which is blue, green, red and alpha in memory, or to
+// OMX_COLOR_Format32BitRGBA8888.
 struct ColorConverter {
     ColorConverter(OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to);
     ~ColorConverter();
 
     bool isValid() const;
 
+    // Frames of at least 2 * kMinBandHeight rows are converted in up to
+    // numThreads bands of rows at the same time. The default is 1.
+    void setNumThreads(size_t numThreads);
+
+    // Only uses the plain C code, which the NEON and SSE2 code must match
+    // exactly. For testing.
+    void setScalarOnly(bool scalarOnly);
+
     status_t convert(
             const void *srcBits,
             size_t srcWidth, size_t srcHeight,
@@ -43,6 +56,10 @@ struct ColorConverter {
             size_t dstCropLeft, size_t dstCropTop,
             size_t dstCropRight, size_t dstCropBottom);
 
+    enum {
+        kMinBandHeight = 64,
+    };
+
 private:
     struct BitmapParams {
         BitmapParams(
@@ -59,11 +76,41 @@ private:
         size_t mCropLeft, mCropTop, mCropRight, mCropBottom;
     };
 
+    struct Layout;
+    struct Rows;
+    struct Worker;
+
     OMX_COLOR_FORMATTYPE mSrcFormat, mDstFormat;
     uint8_t *mClip;
+    bool mScalarOnly;
+    size_t mNumThreads;
+
+    // The rows of the frame being converted are handed out in bands to
+    // the workers and to the converting thread.
+    Mutex mLock;
+    Condition mWorkCondition;
+    Condition mDoneCondition;
+    Vector<Worker *> mWorkers;
+    Rows *mRows;
+    const Layout *mLayout;
+    size_t mBandHeight;
+    int32_t mNumBands;
+    volatile int32_t mNextBand;
+    int32_t mNumBusyWorkers;
+    int32_t mGeneration;
+    bool mExiting;
 
     uint8_t *initClip();
 
+    status_t convertFrame(const Layout &layout);
+    void convertBands(const Layout &layout, Rows *rows);
+    void convertRows(
+            const Layout &layout, size_t firstRow, size_t numRows,
+            Rows *rows);
+
+    static void *ThreadWrapper(void *me);
+    void threadFunc(Worker *worker);
+
     status_t convertCbYCrY(
             const BitmapParams &src, const BitmapParams &dst);
 
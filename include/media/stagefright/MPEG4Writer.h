@@ -64,8 +64,10 @@ protected:
 
 private:
     class Track;
+    class OutputQueue;
 
     int  mFd;
+    OutputQueue *mOutputQueue;
     status_t mInitCheck;
     bool mUse4ByteNalLength;
     bool mUse32BitOffset;
@@ -81,6 +83,7 @@ private:
     off64_t mFreeBoxOffset;
     bool mStreamableFile;
     off64_t mEstimatedMoovBoxSize;
+    bool mFastStart;
     uint32_t mInterleaveDurationUs;
     int32_t mTimeScale;
     int64_t mStartTimestampUs;
@@ -89,6 +92,13 @@ private:
     bool mAreGeoTagsAvailable;
     int32_t mStartTimeOffsetMs;
 
+    // Fragmented files
+    int64_t mFragmentDurationUs;
+    bool mFragmentedMoovBoxWritten;
+    uint32_t mFragmentSequenceNumber;
+    off64_t mMehdOffset;
+    int64_t mFragmentedDurationUs;
+
     Mutex mLock;
 
     List<Track *> mTracks;
@@ -101,16 +111,29 @@ private:
     size_t numTracks();
     int64_t estimateMoovBoxSize(int32_t bitRate);
 
+    // Sample description in a 'trun' box
+    struct FragmentSample {
+        uint32_t mSize;
+        uint32_t mDurationTicks;             // Track time scale based
+        int32_t  mCompositionOffsetTicks;    // Track time scale based
+        bool     mIsSync;
+    };
+
     struct Chunk {
         Track               *mTrack;        // Owner
         int64_t             mTimeStampUs;   // Timestamp of the 1st sample
         List<MediaBuffer *> mSamples;       // Sample data
 
+        // Only for fragmented files, a chunk is a track fragment
+        int64_t              mDecodingTimeTicks;  // Of the 1st sample
+        List<FragmentSample> mFragmentSamples;
+
         // Convenient constructor
-        Chunk(): mTrack(NULL), mTimeStampUs(0) {}
+        Chunk(): mTrack(NULL), mTimeStampUs(0), mDecodingTimeTicks(0) {}
 
         Chunk(Track *track, int64_t timeUs, List<MediaBuffer *> samples)
-            : mTrack(track), mTimeStampUs(timeUs), mSamples(samples) {
+            : mTrack(track), mTimeStampUs(timeUs), mSamples(samples),
+              mDecodingTimeTicks(0) {
         }
 
     };
@@ -151,6 +174,13 @@ private:
     // Actually write the given chunk to the file.
     void writeChunkToFile(Chunk* chunk);
 
+    // Write the given track fragment as a movie fragment, the
+    // movie box goes in front of the first one.
+    bool isReadyToWriteFragments();
+    void writeFragment(Chunk *chunk);
+    void updateFragmentedDuration(int64_t durationUs);
+    void writeMfraBox();
+
     // Adjust other track media clock (presumably wall clock)
     // based on audio track media clock with the drift time.
     int64_t mDriftTimeUs;
@@ -173,17 +203,22 @@ private:
     bool use32BitFileOffset() const;
     bool exceedsFileDurationLimit();
     bool isFileStreamable() const;
+    bool isFragmented() const { return mFragmentDurationUs > 0; }
+    int64_t fragmentDuration() const { return mFragmentDurationUs; }
+    status_t moveMediaData(off64_t end, off64_t distance);
+    status_t makeRoomForMoovBox(off64_t moovOffset, int64_t durationUs);
     void trackProgressStatus(size_t trackId, int64_t timeUs, status_t err = OK);
     void writeCompositionMatrix(int32_t degrees);
     void writeMvhdBox(int64_t durationUs);
     void writeMoovBox(int64_t durationUs);
+    void writeMvexBox();
     void writeFtypBox(MetaData *param);
     void writeUdtaBox();
     void writeGeoDataBox();
     void writeLatitude(int degreex10000);
     void writeLongitude(int degreex10000);
     void sendSessionSummary();
-    void release();
+    status_t release();
 
     MPEG4Writer(const MPEG4Writer &);
     MPEG4Writer &operator=(const MPEG4Writer &);
@@ -90,16 +90,16 @@ protected:
 
 private:
     friend class MediaBufferGroup;
-    friend class OMXDecoder;
-
-    // For use by OMXDecoder, reference count must be 1, drop reference
-    // count to 0 without signalling the observer.
-    void claim();
 
     MediaBufferObserver *mObserver;
-    MediaBuffer *mNextBuffer;
     int mRefCount;
 
+    // Where the buffer is in its MediaBufferGroup, whether it is on the
+    // free stack of the group, and the next free buffer while it is.
+    int32_t mGroupIndex;
+    volatile int32_t mIsFree;
+    volatile int32_t mNextFree;
+
     void *mData;
     size_t mSize, mRangeOffset, mRangeLength;
     sp<GraphicBuffer> mGraphicBuffer;
@@ -111,9 +111,6 @@ private:
 
     MediaBuffer *mOriginal;
 
-    void setNextBuffer(MediaBuffer *buffer);
-    MediaBuffer *nextBuffer();
-
     MediaBuffer(const MediaBuffer &);
     MediaBuffer &operator=(const MediaBuffer &);
 };
@@ -29,7 +29,10 @@ class MetaData;
 
 class MediaBufferGroup : public MediaBufferObserver {
 public:
-    MediaBufferGroup();
+    // If maxNumBuffers is larger than the number of buffers added, the
+    // group allocates more buffers the size of the largest one added
+    // instead of blocking, up to maxNumBuffers in all.
+    MediaBufferGroup(size_t maxNumBuffers = 0);
     ~MediaBufferGroup();
 
     void add_buffer(MediaBuffer *buffer);
@@ -38,16 +41,60 @@ public:
     // the returned buffer will have a reference count of 1.
     status_t acquire_buffer(MediaBuffer **buffer);
 
+    // Like acquire_buffer, but returns WOULD_BLOCK instead of blocking
+    // if all buffers are in use.
+    status_t try_acquire_buffer(MediaBuffer **buffer);
+
 protected:
     virtual void signalBufferReturned(MediaBuffer *buffer);
 
 private:
     friend class MediaBuffer;
 
-    Mutex mLock;
+    enum {
+        kNumBuffersPerChunk = 32,
+        kMaxNumChunks       = 32,
+    };
+
+    mutable Mutex mLock;
     Condition mCondition;
 
-    MediaBuffer *mFirstBuffer, *mLastBuffer;
+    // The buffers by index, in chunks that never move so that they can
+    // be looked up without the lock.
+    MediaBuffer **mChunks[kMaxNumChunks];
+    volatile int32_t mNumBuffers;
+    size_t mMaxNumBuffers;
+    size_t mMaxBufferSize;
+
+    // The free buffers are a lock free stack. The low 15 bits are the
+    // index of the top buffer plus 1, bit 15 is set while the stack is
+    // empty and somebody waits for it, and the high 16 bits count the
+    // updates so that a stale head is never mistaken for the current one.
+    volatile int32_t mFreeHead;
+    int32_t mNumWaiters;
+
+    // Logged when the group is destroyed.
+    volatile int32_t mNumInUse;
+    volatile int32_t mMaxNumInUse;
+    volatile int32_t mNumTryAcquireFailures;
+    int32_t mNumWaits;
+    int64_t mTotalWaitUs;
+    int64_t mMaxWaitUs;
+    int32_t mNumAllocated;
+
+    MediaBuffer *bufferAt(int32_t index) const;
+    void addBuffer_l(MediaBuffer *buffer);
+
+    void pushFreeBuffer(MediaBuffer *buffer);
+    bool popFreeBuffer(MediaBuffer **buffer);
+
+    // Marks the stack as waited for if it is empty, returns true if it
+    // is not.
+    bool markEmpty_l();
+
+    MediaBuffer *allocateBuffer_l();
+    void onAcquired(MediaBuffer *buffer);
+    void incNumInUse();
 
     MediaBufferGroup(const MediaBufferGroup &);
     MediaBufferGroup &operator=(const MediaBufferGroup &);
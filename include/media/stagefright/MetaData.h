@@ -96,6 +96,13 @@ enum {
     kKey64BitFileOffset   = 'fobt',  // int32_t (bool)
     kKey2ByteNalLength    = '2NAL',  // int32_t (bool)
 
+    // Set this key to author fragmented files, a movie fragment is
+    // written about every kKeyFragmentDurationUs. Set kKeyFastStart
+    // to always have the movie box in front of the media data, the
+    // file then has to be open for reading and writing.
+    kKeyFragmentDurationUs = 'frgd',  // int64_t
+    kKeyFastStart         = 'fsta',  // int32_t (bool)
+
     // Identify the file output format for authoring
     // Please see <media/mediarecorder.h> for the supported
     // file output formats.
@@ -32,6 +32,10 @@ struct ABuffer : public RefBase {
     ABuffer(size_t capacity);
     ABuffer(void *data, size_t capacity);
 
+    // A buffer referencing the bytes [offset, offset + size) of the
+    // capacity of parent, which it keeps alive.
+    ABuffer(const sp<ABuffer> &parent, size_t offset, size_t size);
+
     void setFarewellMessage(const sp<AMessage> msg);
 
     uint8_t *base() { return (uint8_t *)mData; }
@@ -53,6 +57,7 @@ protected:
 private:
     sp<AMessage> mFarewell;
     sp<AMessage> mMeta;
+    sp<ABuffer> mParent;
 
     void *mData;
     size_t mCapacity;
@@ -157,6 +157,10 @@ typedef enum OMX_COLOR_FORMATTYPE {
      * an acceptable range once that is done.
      * */
     OMX_COLOR_FormatAndroidOpaque = 0x7F000789,
+    /**<Android extension, 32 bit pixels with the red, green, blue and
+     * alpha bytes in this order in memory, like HAL_PIXEL_FORMAT_RGBA_8888.
+     * */
+    OMX_COLOR_Format32BitRGBA8888 = 0x7F00A000,
     OMX_TI_COLOR_FormatYUV420PackedSemiPlanar = 0x7F000100,
     OMX_QCOM_COLOR_FormatYVU420SemiPlanar = 0x7FA30C00,
     OMX_COLOR_FormatMax = 0x7FFFFFFF
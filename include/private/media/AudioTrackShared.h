@@ -54,6 +54,19 @@ namespace android {
 #define CBLK_RESTORED_ON        0x0040  // track has been restored after invalidation
 #define CBLK_RESTORED_OFF       0x0040  // by AudioFlinger
 
+// audio_track_cblk_t::futex: the upper 31 bits count the server steps, bit 0 is
+// set while the client waits for the next step
+#define CBLK_FUTEX_WAITING      0x0001
+#define CBLK_FUTEX_STEP         0x0002
+
+// The buffer is a single producer, single consumer FIFO: the client only writes
+// user and userBase, the server only writes server and serverBase, and each side
+// publishes its index with a release store after accessing the buffer.
+// The server never blocks on the client: stepServer(), framesReady() and
+// framesAvailable() only take the lock when a loop is set, and the fast track
+// variants never do. A client waiting for the server sleeps on the futex word
+// instead of cv, see prepareWait().
+// lock and cv are still used by the clients for loops and track restoration.
 struct audio_track_cblk_t
 {
 
@@ -90,6 +103,8 @@ struct audio_track_cblk_t
 
                 // Cache line boundary (32 bytes)
 
+    volatile    int32_t     futex;
+
                             audio_track_cblk_t();
                 uint32_t    stepUser(uint32_t frameCount);
                 bool        stepServer(uint32_t frameCount);
@@ -97,7 +112,22 @@ struct audio_track_cblk_t
                 uint32_t    framesAvailable();
                 uint32_t    framesAvailable_l();
                 uint32_t    framesReady();
+                // Fast tracks have no loops, see AudioTrack::setLoop(): these
+                // never take the lock and ignore the loop members.
+                void        stepServerFast(uint32_t frameCount);
+                uint32_t    framesReadyFast();
                 bool        tryLock();
+
+                // Client side wait for the server: prepareWait() must be called before
+                // reading the server index, and its result passed to waitServer(), which
+                // returns early if the server stepped in between. waitServer() returns
+                // TIMED_OUT if the server did not step within timeoutMs. A client that
+                // does not wait after prepareWait() calls cancelWait().
+                int32_t     prepareWait();
+                status_t    waitServer(int32_t sequence, uint32_t timeoutMs);
+                void        cancelWait();
+                // Wakes up a client blocked in waitServer().
+                void        wake();
 };
 
 
@@ -3,6 +3,7 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
 	android_media_SoundPool.cpp \
+	SampleCache.cpp \
 	SoundPool.cpp \
 	SoundPoolThread.cpp
 
@@ -17,3 +18,5 @@ LOCAL_SHARED_LIBRARIES := \
 LOCAL_MODULE:= libsoundpool
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
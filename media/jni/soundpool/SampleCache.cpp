@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SampleCache"
+#include "utils/Log.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include "SampleCache.h"
+
+namespace android {
+
+SampleCache::SampleCache()
+{
+}
+
+SampleCache::~SampleCache()
+{
+    mEntries.clear();
+    mArena.clear();
+}
+
+bool SampleCache::makeKey(const char* url, int fd, int64_t offset, int64_t length, Key* key)
+{
+    struct stat st;
+    if (url != NULL) {
+        // the whole file, urls that aren't local files are not shared
+        if (stat(url, &st) != 0) {
+            return false;
+        }
+        offset = 0;
+        length = st.st_size;
+    } else if (fd < 0 || fstat(fd, &st) != 0) {
+        return false;
+    }
+    if (!S_ISREG(st.st_mode) || length <= 0) {
+        return false;
+    }
+
+    key->mDevice = st.st_dev;
+    key->mInode = st.st_ino;
+    key->mSize = st.st_size;
+    key->mModified = st.st_mtime;
+    key->mOffset = offset;
+    key->mLength = length;
+    ALOGV("makeKey dev=%llu, ino=%llu, offset=%lld, length=%lld", key->mDevice, key->mInode,
+            offset, length);
+    return true;
+}
+
+ssize_t SampleCache::indexOf_l(const Key& key) const
+{
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        const Key& k = mEntries[i].mKey;
+        if (k.mDevice == key.mDevice && k.mInode == key.mInode && k.mSize == key.mSize &&
+                k.mModified == key.mModified && k.mOffset == key.mOffset &&
+                k.mLength == key.mLength) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool SampleCache::acquire(const Key& key, sp<IMemory>* data, Entry* entry)
+{
+    Mutex::Autolock lock(&mLock);
+
+    // drop the entries of unloaded samples
+    for (size_t i = mEntries.size(); i > 0; i--) {
+        const Entry& e = mEntries[i - 1];
+        if (!e.mDecoding && e.mData.promote() == 0) {
+            mEntries.removeAt(i - 1);
+        }
+    }
+
+    ssize_t index;
+    while ((index = indexOf_l(key)) >= 0 && mEntries[index].mDecoding) {
+        ALOGV("acquire: waiting for the decoding of an identical source");
+        mCondition.wait(mLock);
+    }
+    if (index >= 0) {
+        *entry = mEntries[index];
+        *data = entry->mData.promote();
+        if (*data != 0) {
+            ALOGV("acquire: found an identical source");
+            return true;
+        }
+        mEntries.removeAt(index);
+    }
+
+    // the caller decodes the source
+    Entry e;
+    e.mKey = key;
+    e.mDecoding = true;
+    e.mSampleRate = 0;
+    e.mNumChannels = 0;
+    e.mFormat = 0;
+    mEntries.add(e);
+    return false;
+}
+
+void SampleCache::add(const Key& key, const sp<IMemory>& data, uint32_t sampleRate,
+        int numChannels, int format)
+{
+    Mutex::Autolock lock(&mLock);
+    ssize_t index = indexOf_l(key);
+    if (index >= 0) {
+        if (data == 0) {
+            mEntries.removeAt(index);
+        } else {
+            Entry& e = mEntries.editItemAt(index);
+            e.mDecoding = false;
+            e.mData = data;
+            e.mSampleRate = sampleRate;
+            e.mNumChannels = numChannels;
+            e.mFormat = format;
+        }
+    }
+    mCondition.broadcast();
+}
+
+sp<IMemory> SampleCache::copy(const sp<IMemory>& data)
+{
+    size_t size = data->size();
+    sp<IMemory> mem;
+    {
+        Mutex::Autolock lock(&mLock);
+        if (mArena == 0) {
+            sp<MemoryDealer> arena = new MemoryDealer(kArenaSize, "SoundPool");
+            if (arena->getMemoryHeap()->getHeapID() >= 0) {
+                mArena = arena;
+            }
+        }
+        if (mArena != 0) {
+            mem = mArena->allocate(size);
+        }
+    }
+    if (mem == 0) {
+        ALOGW("Unable to allocate %u bytes for sample, keeping decode buffer", size);
+        return data;
+    }
+    memcpy(mem->pointer(), data->pointer(), size);
+    return mem;
+}
+
+} // end namespace android
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SAMPLECACHE_H_
+#define SAMPLECACHE_H_
+
+#include <utils/threads.h>
+#include <utils/Vector.h>
+#include <binder/IMemory.h>
+#include <binder/MemoryDealer.h>
+
+namespace android {
+
+/*
+ * Decoded PCM of the samples of a SoundPool.
+ *
+ * The PCM returned by the media server is copied into one arena shared by
+ * all the samples, instead of each sample keeping the heap it was decoded
+ * into. Samples loaded from the same part of the same file share the same
+ * PCM and are decoded only once. Files are told apart by their device,
+ * inode, size and modification time, nothing is read from them.
+ */
+class SampleCache {
+public:
+    struct Key {
+        uint64_t    mDevice;
+        uint64_t    mInode;
+        int64_t     mSize;
+        int64_t     mModified;
+        int64_t     mOffset;
+        int64_t     mLength;
+    };
+
+    struct Entry {
+        Key         mKey;
+        bool        mDecoding;
+        wp<IMemory> mData;
+        uint32_t    mSampleRate;
+        int         mNumChannels;
+        int         mFormat;
+    };
+
+    SampleCache();
+    ~SampleCache();
+
+    // Identifies the source of a sample. Returns false if it isn't a
+    // regular file.
+    static bool makeKey(const char* url, int fd, int64_t offset, int64_t length, Key* key);
+
+    // Returns true and the PCM and format of an identical source if there is
+    // one, waiting for it if it is being decoded. Otherwise returns false,
+    // and the caller decodes the source and then calls add().
+    bool acquire(const Key& key, sp<IMemory>* data, Entry* entry);
+    // Publishes the PCM of a source, or removes it from the cache if data is
+    // NULL, and wakes up the callers of acquire() waiting for it.
+    void add(const Key& key, const sp<IMemory>& data, uint32_t sampleRate, int numChannels,
+            int format);
+
+    // Copies decoded PCM into the arena. Returns data itself if the copy
+    // can't be allocated.
+    sp<IMemory> copy(const sp<IMemory>& data);
+
+private:
+    // Only the pages written to are backed by memory. A sample is at most
+    // the 1 MB the media server decodes into.
+    static const size_t kArenaSize = 8 * 1024 * 1024;
+
+    ssize_t indexOf_l(const Key& key) const;
+
+    mutable Mutex               mLock;
+    Condition                   mCondition;
+    Vector<Entry>               mEntries;
+    sp<MemoryDealer>            mArena;
+};
+
+} // end namespace android
+
+#endif /*SAMPLECACHE_H_*/
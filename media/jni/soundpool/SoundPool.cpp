@@ -28,6 +28,7 @@
 
 #include <system/audio.h>
 
+#include "SampleCache.h"
 #include "SoundPool.h"
 #include "SoundPoolThread.h"
 
@@ -56,6 +57,7 @@ SoundPool::SoundPool(int maxChannels, int streamType, int srcQuality)
 
     mQuit = false;
     mDecodeThread = 0;
+    mSampleCache = new SampleCache();
     mStreamType = streamType;
     mSrcQuality = srcQuality;
     mAllocated = 0;
@@ -92,6 +94,7 @@ SoundPool::~SoundPool()
 
     if (mDecodeThread)
         delete mDecodeThread;
+    delete mSampleCache;
 }
 
 void SoundPool::addToRestartList(SoundChannel* channel)
@@ -206,9 +209,13 @@ SoundChannel* SoundPool::findNextChannel(int channelID)
 int SoundPool::load(const char* path, int priority)
 {
     ALOGV("load: path=%s, priority=%d", path, priority);
-    Mutex::Autolock lock(&mLock);
-    sp<Sample> sample = new Sample(++mNextSampleID, path);
-    mSamples.add(sample->sampleID(), sample);
+    sp<Sample> sample;
+    {
+        Mutex::Autolock lock(&mLock);
+        sample = new Sample(++mNextSampleID, path);
+        mSamples.add(sample->sampleID(), sample);
+    }
+    // not holding the lock, which the decode threads need, when the queue is full
     doLoad(sample);
     return sample->sampleID();
 }
@@ -217,9 +224,12 @@ int SoundPool::load(int fd, int64_t offset, int64_t length, int priority)
 {
     ALOGV("load: fd=%d, offset=%lld, length=%lld, priority=%d",
             fd, offset, length, priority);
-    Mutex::Autolock lock(&mLock);
-    sp<Sample> sample = new Sample(++mNextSampleID, fd, offset, length);
-    mSamples.add(sample->sampleID(), sample);
+    sp<Sample> sample;
+    {
+        Mutex::Autolock lock(&mLock);
+        sample = new Sample(++mNextSampleID, fd, offset, length);
+        mSamples.add(sample->sampleID(), sample);
+    }
     doLoad(sample);
     return sample->sampleID();
 }
@@ -492,20 +502,47 @@ Sample::~Sample()
     delete mUrl;
 }
 
-status_t Sample::doLoad()
+status_t Sample::doLoad(SampleCache* cache)
 {
     uint32_t sampleRate;
     int numChannels;
     int format;
     sp<IMemory> p;
-    ALOGV("Start decode");
-    if (mUrl) {
-        p = MediaPlayer::decode(mUrl, &sampleRate, &numChannels, &format);
+    SampleCache::Key key;
+    SampleCache::Entry entry;
+
+    // samples loaded from the same part of the same file share the decoded data
+    bool cached = SampleCache::makeKey(mUrl, mFd, mOffset, mLength, &key);
+    if (cached && cache->acquire(key, &p, &entry)) {
+        ALOGV("Decoded data shared with an identical sample");
+        sampleRate = entry.mSampleRate;
+        numChannels = entry.mNumChannels;
+        format = entry.mFormat;
+        if (mFd >= 0) {
+            ::close(mFd);
+            mFd = -1;
+        }
     } else {
-        p = MediaPlayer::decode(mFd, mOffset, mLength, &sampleRate, &numChannels, &format);
-        ALOGV("close(%d)", mFd);
-        ::close(mFd);
-        mFd = -1;
+        ALOGV("Start decode");
+        if (mUrl) {
+            p = MediaPlayer::decode(mUrl, &sampleRate, &numChannels, &format);
+        } else {
+            p = MediaPlayer::decode(mFd, mOffset, mLength, &sampleRate, &numChannels, &format);
+            ALOGV("close(%d)", mFd);
+            ::close(mFd);
+            mFd = -1;
+        }
+        if (p != 0 && (sampleRate > kMaxSampleRate || numChannels < 1 || numChannels > 2)) {
+            ALOGE("Sample rate (%u) or channel count (%d) out of range", sampleRate, numChannels);
+            p.clear();
+        }
+        if (p != 0) {
+            // release the decode heap, which is much larger than most samples
+            p = cache->copy(p);
+        }
+        if (cached) {
+            cache->add(key, p, sampleRate, numChannels, format);
+        }
     }
     if (p == 0) {
         ALOGE("Unable to load sample: %s", mUrl);
@@ -514,20 +551,6 @@ status_t Sample::doLoad()
     ALOGV("pointer = %p, size = %u, sampleRate = %u, numChannels = %d",
             p->pointer(), p->size(), sampleRate, numChannels);
 
-    if (sampleRate > kMaxSampleRate) {
-       ALOGE("Sample rate (%u) out of range", sampleRate);
-       return - 1;
-    }
-
-    if ((numChannels < 1) || (numChannels > 2)) {
-        ALOGE("Sample channel count (%d) out of range", numChannels);
-        return - 1;
-    }
-
-    //_dumpBuffer(p->pointer(), p->size());
-    uint8_t* q = static_cast<uint8_t*>(p->pointer()) + p->size() - 10;
-    //_dumpBuffer(q, 10, 10, false);
-
     mData = p;
     mSize = p->size();
     mSampleRate = sampleRate;
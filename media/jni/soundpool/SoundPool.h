@@ -31,6 +31,7 @@ static const int IDLE_PRIORITY = -1;
 class SoundEvent;
 class SoundPoolThread;
 class SoundPool;
+class SampleCache;
 
 // for queued events
 class SoundPoolEvent {
@@ -60,7 +61,7 @@ public:
     size_t size() { return mSize; }
     int state() { return mState; }
     uint8_t* data() { return static_cast<uint8_t*>(mData->pointer()); }
-    status_t doLoad();
+    status_t doLoad(SampleCache* cache);
     void startLoad() { mState = LOADING; }
     sp<IMemory> getIMemory() { return mData; }
 
@@ -214,6 +215,7 @@ private:
     Mutex                   mRestartLock;
     Condition               mCondition;
     SoundPoolThread*        mDecodeThread;
+    SampleCache*            mSampleCache;
     SoundChannel*           mChannelPool;
     List<SoundChannel*>     mChannels;
     List<SoundChannel*>     mRestart;
@@ -18,6 +18,10 @@
 #define LOG_TAG "SoundPoolThread"
 #include "utils/Log.h"
 
+#include <stdlib.h>
+#include <unistd.h>
+#include <cutils/properties.h>
+
 #include "SoundPoolThread.h"
 
 namespace android {
@@ -31,7 +35,7 @@ void SoundPoolThread::write(SoundPoolMsg msg) {
     // if thread is quitting, don't add to queue
     if (mRunning) {
         mMsgQueue.push(msg);
-        mCondition.signal();
+        mCondition.broadcast();
     }
 }
 
@@ -41,8 +45,11 @@ const SoundPoolMsg SoundPoolThread::read() {
         mCondition.wait(mLock);
     }
     SoundPoolMsg msg = mMsgQueue[0];
-    mMsgQueue.removeAt(0);
-    mCondition.signal();
+    // leave the KILL message for the other threads
+    if (msg.mMessageType != SoundPoolMsg::KILL) {
+        mMsgQueue.removeAt(0);
+    }
+    mCondition.broadcast();
     return msg;
 }
 
@@ -52,19 +59,41 @@ void SoundPoolThread::quit() {
         mRunning = false;
         mMsgQueue.clear();
         mMsgQueue.push(SoundPoolMsg(SoundPoolMsg::KILL, 0));
-        mCondition.signal();
-        mCondition.wait(mLock);
+        mCondition.broadcast();
+        while (mNumThreads > 0) {
+            mCondition.wait(mLock);
+        }
     }
     ALOGV("return from quit");
 }
 
 SoundPoolThread::SoundPoolThread(SoundPool* soundPool) :
-    mSoundPool(soundPool)
+    mSoundPool(soundPool), mRunning(false), mNumThreads(0)
 {
     mMsgQueue.setCapacity(maxMessages);
-    if (createThreadEtc(beginThread, this, "SoundPoolThread")) {
-        mRunning = true;
+
+    // samples are decoded by the media server, which has a binder thread for
+    // each of our requests
+    int numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("debug.soundpool.threads", value, NULL) > 0) {
+        numThreads = atoi(value);
+    }
+    if (numThreads < 1) {
+        numThreads = 1;
+    } else if (numThreads > maxThreads) {
+        numThreads = maxThreads;
     }
+
+    Mutex::Autolock lock(&mLock);
+    for (int i = 0; i < numThreads; i++) {
+        if (!createThreadEtc(beginThread, this, "SoundPoolThread")) {
+            break;
+        }
+        mNumThreads++;
+    }
+    mRunning = mNumThreads > 0;
+    ALOGV("%d decode threads", mNumThreads);
 }
 
 SoundPoolThread::~SoundPoolThread()
@@ -84,9 +113,16 @@ int SoundPoolThread::run() {
         SoundPoolMsg msg = read();
         ALOGV("Got message m=%d, mData=%d", msg.mMessageType, msg.mData);
         switch (msg.mMessageType) {
-        case SoundPoolMsg::KILL:
+        case SoundPoolMsg::KILL: {
             ALOGV("goodbye");
+            Mutex::Autolock lock(&mLock);
+            // the last thread out removes the KILL message
+            if (--mNumThreads == 0) {
+                mMsgQueue.clear();
+            }
+            mCondition.broadcast();
             return NO_ERROR;
+        }
         case SoundPoolMsg::LOAD_SAMPLE:
             doLoadSample(msg.mData);
             break;
@@ -103,10 +139,14 @@ void SoundPoolThread::loadSample(int sampleID) {
 }
 
 void SoundPoolThread::doLoadSample(int sampleID) {
-    sp <Sample> sample = mSoundPool->findSample(sampleID);
+    sp <Sample> sample;
+    {
+        Mutex::Autolock lock(&mSoundPool->mLock);
+        sample = mSoundPool->findSample(sampleID);
+    }
     status_t status = -1;
     if (sample != 0) {
-        status = sample->doLoad();
+        status = sample->doLoad(mSoundPool->mSampleCache);
     }
     mSoundPool->notify(SoundPoolEvent(SoundPoolEvent::SAMPLE_LOADED, sampleID, status));
 }
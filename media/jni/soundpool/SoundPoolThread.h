@@ -36,7 +36,8 @@ public:
 };
 
 /*
- * This class handles background requests from the SoundPool
+ * This class handles background requests from the SoundPool, on a pool of
+ * threads so that several samples are decoded at the same time
  */
 class SoundPoolThread {
 public:
@@ -47,7 +48,8 @@ public:
     void write(SoundPoolMsg msg);
 
 private:
-    static const size_t maxMessages = 5;
+    static const size_t maxMessages = 16;
+    static const int maxThreads = 4;
 
     static int beginThread(void* arg);
     int run();
@@ -59,6 +61,7 @@ private:
     Vector<SoundPoolMsg>    mMsgQueue;
     SoundPool*              mSoundPool;
     bool                    mRunning;
+    int                     mNumThreads;
 };
 
 } // end namespace android
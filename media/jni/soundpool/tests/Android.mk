@@ -0,0 +1,21 @@
+LOCAL_PATH:= $(call my-dir)
+
+# SoundPool load time benchmark, run on the device.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	soundpool_load_test.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := \
+	libsoundpool \
+	libbinder \
+	libutils \
+	libmedia
+
+LOCAL_MODULE:= soundpool_load_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// SoundPool load time benchmark.
+//
+// Loads the given sound files round robin into a SoundPool until the
+// requested number of samples is reached, the way a game loads its effects
+// at startup, and reports the time until the last sample is loaded.
+// Each file is loaded through its own file descriptor, so with fewer files
+// than samples the same content is loaded several times.
+// The number of decode threads is set with the debug.soundpool.threads
+// property, 1 being the single decode thread SoundPool used to have.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <binder/ProcessState.h>
+#include <system/audio.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#include "SoundPool.h"
+
+using namespace android;
+
+static Mutex gLock;
+static Condition gCondition;
+static int gLoaded;
+static int gFailed;
+
+static void callback(SoundPoolEvent event, SoundPool* soundPool, void* user) {
+    if (event.mMsg != SoundPoolEvent::SAMPLE_LOADED) {
+        return;
+    }
+    Mutex::Autolock _l(gLock);
+    if (event.mArg2 != 0) {
+        gFailed++;
+    }
+    gLoaded++;
+    gCondition.signal();
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n samples] file...\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -n number of samples to load (default 50)\n");
+}
+
+int main(int argc, char **argv) {
+    int samples = 50;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:")) >= 0) {
+        switch (res) {
+            case 'n':
+                samples = atoi(optarg);
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    int files = argc - optind;
+    if (samples <= 0 || files <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    SoundPool* soundPool = new SoundPool(8, AUDIO_STREAM_MUSIC, 0);
+    soundPool->setCallback(callback, NULL);
+
+    nsecs_t start = systemTime();
+    for (int i = 0; i < samples; i++) {
+        const char* path = argv[optind + i % files];
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            fprintf(stderr, "can't open %s\n", path);
+            return 1;
+        }
+        soundPool->load(fd, 0, st.st_size, 1);
+        close(fd);
+    }
+    nsecs_t queued = systemTime();
+    {
+        Mutex::Autolock _l(gLock);
+        while (gLoaded < samples) {
+            gCondition.wait(gLock);
+        }
+    }
+    nsecs_t end = systemTime();
+
+    printf("%d samples from %d files: loaded in %.1f ms (load() calls %.1f ms), %d failed\n",
+            samples, files, (end - start) * 1e-6, (queued - start) * 1e-6, gFailed);
+
+    delete soundPool;
+    return gFailed != 0;
+}
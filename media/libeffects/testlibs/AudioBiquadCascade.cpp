@@ -0,0 +1,379 @@
+/*
+**
+** Copyright 2012, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <string.h>
+#include <assert.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#include "AudioBiquadCascade.h"
+
+#define LIKELY( exp )       (__builtin_expect( (exp) != 0, true  ))
+#define UNLIKELY( exp )     (__builtin_expect( (exp) != 0, false ))
+
+namespace android {
+
+const audio_coef_t AudioBiquadCascade::IDENTITY_COEFS[AudioBiquadCascade::NUM_COEFS] = { AUDIO_COEF_ONE, 0, 0, 0, 0 };
+
+AudioBiquadCascade::AudioBiquadCascade(int nStages, int nChannels, int sampleRate) {
+    assert(nStages > 0 && nStages <= MAX_STAGES);
+    mNumStages = nStages;
+    configure(nChannels, sampleRate);
+    for (int i = 0; i < mNumStages; ++i) {
+        memcpy(mStages[i].mTargetCoefs, IDENTITY_COEFS, sizeof(IDENTITY_COEFS));
+    }
+    reset();
+}
+
+void AudioBiquadCascade::configure(int nChannels, int sampleRate) {
+    assert(nChannels > 0 && nChannels <= MAX_CHANNELS);
+    assert(sampleRate > 0);
+    mNumChannels = nChannels;
+    mMaxDelta = static_cast<int64_t>(MAX_DELTA_PER_SEC)
+                * AUDIO_COEF_ONE
+                / sampleRate;
+    clear();
+}
+
+void AudioBiquadCascade::reset() {
+    for (int i = 0; i < mNumStages; ++i) {
+        Stage & stage = mStages[i];
+        memcpy(stage.mCoefs, IDENTITY_COEFS, sizeof(stage.mCoefs));
+        stage.mCoefDirtyBits = 0;
+        setState(stage, STATE_BYPASS);
+    }
+}
+
+void AudioBiquadCascade::clear() {
+    for (int i = 0; i < mNumStages; ++i) {
+        memset(mStages[i].mDelays, 0, sizeof(mStages[i].mDelays));
+    }
+}
+
+void AudioBiquadCascade::setCoefs(int stageIndex, const audio_coef_t coefs[NUM_COEFS],
+                                  bool immediate) {
+    assert(stageIndex >= 0 && stageIndex < mNumStages);
+    Stage & stage = mStages[stageIndex];
+    memcpy(stage.mTargetCoefs, coefs, sizeof(stage.mTargetCoefs));
+    if (stage.mState & STATE_ENABLED_MASK) {
+        if (UNLIKELY(immediate)) {
+            memcpy(stage.mCoefs, coefs, sizeof(stage.mCoefs));
+            setState(stage, STATE_NORMAL);
+        } else {
+            setState(stage, STATE_TRANSITION_TO_NORMAL);
+        }
+    }
+}
+
+void AudioBiquadCascade::enable(bool immediate) {
+    for (int i = 0; i < mNumStages; ++i) {
+        Stage & stage = mStages[i];
+        if (UNLIKELY(immediate)) {
+            memcpy(stage.mCoefs, stage.mTargetCoefs, sizeof(stage.mCoefs));
+            setState(stage, STATE_NORMAL);
+        } else {
+            setState(stage, STATE_TRANSITION_TO_NORMAL);
+        }
+    }
+}
+
+void AudioBiquadCascade::disable(bool immediate) {
+    for (int i = 0; i < mNumStages; ++i) {
+        Stage & stage = mStages[i];
+        if (UNLIKELY(immediate)) {
+            memcpy(stage.mCoefs, IDENTITY_COEFS, sizeof(stage.mCoefs));
+            setState(stage, STATE_BYPASS);
+        } else {
+            setState(stage, STATE_TRANSITION_TO_BYPASS);
+        }
+    }
+}
+
+void AudioBiquadCascade::setState(Stage & stage, state_t state) {
+    if (state == STATE_TRANSITION_TO_BYPASS || state == STATE_TRANSITION_TO_NORMAL) {
+        stage.mCoefDirtyBits = (1 << NUM_COEFS) - 1;
+    }
+    stage.mState = state;
+}
+
+bool AudioBiquadCascade::updateCoefs(Stage & stage, const audio_coef_t coefs[NUM_COEFS],
+                                     int frameCount) {
+    int64_t maxDelta = mMaxDelta * frameCount;
+    for (int i = 0; i < NUM_COEFS; ++i) {
+        if (stage.mCoefDirtyBits & (1<<i)) {
+            audio_coef_t diff = coefs[i] - stage.mCoefs[i];
+            if (diff > maxDelta) {
+                stage.mCoefs[i] += maxDelta;
+            } else if (diff < -maxDelta) {
+                stage.mCoefs[i] -= maxDelta;
+            } else {
+                stage.mCoefs[i] = coefs[i];
+                stage.mCoefDirtyBits ^= (1<<i);
+            }
+        }
+    }
+    return stage.mCoefDirtyBits == 0;
+}
+
+void AudioBiquadCascade::process(const audio_sample_t in[], audio_sample_t out[],
+                                 int frameCount) {
+    // Advance the transitions by one block, as each AudioBiquadFilter would,
+    // and only run the stages that are not bypassed.
+    Stage * active[MAX_STAGES];
+    int nActive = 0;
+    for (int i = 0; i < mNumStages; ++i) {
+        Stage & stage = mStages[i];
+        if (stage.mState == STATE_TRANSITION_TO_NORMAL) {
+            if (updateCoefs(stage, stage.mTargetCoefs, frameCount)) {
+                setState(stage, STATE_NORMAL);
+            }
+        } else if (stage.mState == STATE_TRANSITION_TO_BYPASS) {
+            // like AudioBiquadFilter, keeps running with identity coefficients
+            if (updateCoefs(stage, IDENTITY_COEFS, frameCount)) {
+                setState(stage, STATE_NORMAL);
+            }
+        }
+        if (stage.mState != STATE_BYPASS) {
+            active[nActive++] = &stage;
+        }
+    }
+
+    if (nActive == 0) {
+        if (UNLIKELY(in != out)) {
+            memcpy(out, in, frameCount * mNumChannels * sizeof(audio_sample_t));
+        }
+    } else if (mNumChannels == 1) {
+        process_mono(active, nActive, in, out, frameCount);
+    } else {
+        process_stereo(active, nActive, in, out, frameCount);
+    }
+}
+
+void AudioBiquadCascade::process_mono(Stage * const stages[], int nStages,
+                                      const audio_sample_t * in,
+                                      audio_sample_t * out,
+                                      int frameCount) {
+    // With a single channel there is no vector to fill, and a frame by frame
+    // pass through all stages would keep the delay lines in memory. Each
+    // stage is rather run over the whole buffer with its state in locals.
+    for (int s = 0; s < nStages; ++s) {
+        const audio_coef_t * c = stages[s]->mCoefs;
+        audio_sample_t * d = stages[s]->mDelays[0];
+        audio_coef_t b0 = c[0], b1 = c[1], b2 = c[2], a1 = c[3], a2 = c[4];
+        audio_sample_t x1 = d[0], x2 = d[1], y1 = d[2], y2 = d[3];
+        const audio_sample_t * pIn = (s == 0) ? in : out;
+        audio_sample_t * pOut = out;
+        for (int n = frameCount; n > 0; --n) {
+            audio_sample_t x0 = *(pIn++);
+            audio_coef_sample_acc_t acc;
+            acc = mul_coef_sample(b0, x0);
+            acc = mac_coef_sample(b1, x1, acc);
+            acc = mac_coef_sample(b2, x2, acc);
+            acc = mac_coef_sample(a1, y1, acc);
+            acc = mac_coef_sample(a2, y2, acc);
+            audio_sample_t y0 = coef_sample_acc_to_sample(acc);
+            *(pOut++) = y0;
+            x2 = x1;
+            x1 = x0;
+            y2 = y1;
+            y1 = y0;
+        }
+        d[0] = x1;
+        d[1] = x2;
+        d[2] = y1;
+        d[3] = y2;
+    }
+}
+
+#if defined(__ARM_NEON__)
+
+// Both channels in a 2 lane vector; 32x32->64 bit multiply-accumulate.
+void AudioBiquadCascade::process_stereo(Stage * const stages[], int nStages,
+                                        const audio_sample_t * in,
+                                        audio_sample_t * out,
+                                        int frameCount) {
+    int32x2_t x1[MAX_STAGES], x2[MAX_STAGES], y1[MAX_STAGES], y2[MAX_STAGES];
+    audio_coef_t coefs[MAX_STAGES][NUM_COEFS];
+    for (int s = 0; s < nStages; ++s) {
+        const audio_sample_t (*d)[4] = stages[s]->mDelays;
+        memcpy(coefs[s], stages[s]->mCoefs, sizeof(coefs[s]));
+        x1[s] = vset_lane_s32(d[1][0], vdup_n_s32(d[0][0]), 1);
+        x2[s] = vset_lane_s32(d[1][1], vdup_n_s32(d[0][1]), 1);
+        y1[s] = vset_lane_s32(d[1][2], vdup_n_s32(d[0][2]), 1);
+        y2[s] = vset_lane_s32(d[1][3], vdup_n_s32(d[0][3]), 1);
+    }
+    // coef_sample_acc_to_sample() rounds towards zero
+    const int64x2_t round = vdupq_n_s64(AUDIO_COEF_ONE - 1);
+    while (frameCount-- > 0) {
+        int32x2_t x0 = vld1_s32(in);
+        in += 2;
+        for (int s = 0; s < nStages; ++s) {
+            const audio_coef_t * c = coefs[s];
+            int64x2_t acc = vmull_n_s32(x0, c[0]);
+            acc = vmlal_n_s32(acc, x1[s], c[1]);
+            acc = vmlal_n_s32(acc, x2[s], c[2]);
+            acc = vmlal_n_s32(acc, y1[s], c[3]);
+            acc = vmlal_n_s32(acc, y2[s], c[4]);
+            acc = vaddq_s64(acc, vandq_s64(vshrq_n_s64(acc, 63), round));
+            int32x2_t y0 = vshrn_n_s64(acc, AUDIO_COEF_PRECISION);
+            x2[s] = x1[s];
+            x1[s] = x0;
+            y2[s] = y1[s];
+            y1[s] = y0;
+            x0 = y0;
+        }
+        vst1_s32(out, x0);
+        out += 2;
+    }
+    for (int s = 0; s < nStages; ++s) {
+        audio_sample_t (*d)[4] = stages[s]->mDelays;
+        d[0][0] = vget_lane_s32(x1[s], 0);
+        d[1][0] = vget_lane_s32(x1[s], 1);
+        d[0][1] = vget_lane_s32(x2[s], 0);
+        d[1][1] = vget_lane_s32(x2[s], 1);
+        d[0][2] = vget_lane_s32(y1[s], 0);
+        d[1][2] = vget_lane_s32(y1[s], 1);
+        d[0][3] = vget_lane_s32(y2[s], 0);
+        d[1][3] = vget_lane_s32(y2[s], 1);
+    }
+}
+
+#elif defined(__SSE4_1__)
+
+// Both channels in the even 32 bit lanes of a vector, as used by the signed
+// 32x32->64 bit multiply.
+static inline __m128i load_delays(const audio_sample_t (*d)[4], int i) {
+    return _mm_set_epi32(0, d[1][i], 0, d[0][i]);
+}
+
+static inline void store_delays(audio_sample_t (*d)[4], int i, __m128i v) {
+    d[0][i] = _mm_cvtsi128_si32(v);
+    d[1][i] = _mm_extract_epi32(v, 2);
+}
+
+void AudioBiquadCascade::process_stereo(Stage * const stages[], int nStages,
+                                        const audio_sample_t * in,
+                                        audio_sample_t * out,
+                                        int frameCount) {
+    __m128i x1[MAX_STAGES], x2[MAX_STAGES], y1[MAX_STAGES], y2[MAX_STAGES];
+    __m128i coefs[MAX_STAGES][NUM_COEFS];
+    for (int s = 0; s < nStages; ++s) {
+        const audio_sample_t (*d)[4] = stages[s]->mDelays;
+        for (int i = 0; i < NUM_COEFS; ++i) {
+            coefs[s][i] = _mm_set1_epi32(stages[s]->mCoefs[i]);
+        }
+        x1[s] = load_delays(d, 0);
+        x2[s] = load_delays(d, 1);
+        y1[s] = load_delays(d, 2);
+        y2[s] = load_delays(d, 3);
+    }
+    // coef_sample_acc_to_sample() rounds towards zero
+    const __m128i round = _mm_set_epi32(0, AUDIO_COEF_ONE - 1, 0, AUDIO_COEF_ONE - 1);
+    while (frameCount-- > 0) {
+        __m128i x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in));
+        x0 = _mm_shuffle_epi32(x0, _MM_SHUFFLE(1, 1, 0, 0));
+        in += 2;
+        for (int s = 0; s < nStages; ++s) {
+            const __m128i * c = coefs[s];
+            __m128i acc = _mm_mul_epi32(x0, c[0]);
+            acc = _mm_add_epi64(acc, _mm_mul_epi32(x1[s], c[1]));
+            acc = _mm_add_epi64(acc, _mm_mul_epi32(x2[s], c[2]));
+            acc = _mm_add_epi64(acc, _mm_mul_epi32(y1[s], c[3]));
+            acc = _mm_add_epi64(acc, _mm_mul_epi32(y2[s], c[4]));
+            // the sign of each 64 bit lane, in both of its halves
+            __m128i sign = _mm_shuffle_epi32(_mm_srai_epi32(acc, 31), _MM_SHUFFLE(3, 3, 1, 1));
+            acc = _mm_add_epi64(acc, _mm_and_si128(sign, round));
+            // the low halves hold the result; the high halves are ignored
+            // by the next multiply
+            __m128i y0 = _mm_srli_epi64(acc, AUDIO_COEF_PRECISION);
+            x2[s] = x1[s];
+            x1[s] = x0;
+            y2[s] = y1[s];
+            y1[s] = y0;
+            x0 = y0;
+        }
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out),
+                         _mm_shuffle_epi32(x0, _MM_SHUFFLE(2, 0, 2, 0)));
+        out += 2;
+    }
+    for (int s = 0; s < nStages; ++s) {
+        audio_sample_t (*d)[4] = stages[s]->mDelays;
+        store_delays(d, 0, x1[s]);
+        store_delays(d, 1, x2[s]);
+        store_delays(d, 2, y1[s]);
+        store_delays(d, 3, y2[s]);
+    }
+}
+
+#else
+
+void AudioBiquadCascade::process_stereo(Stage * const stages[], int nStages,
+                                        const audio_sample_t * in,
+                                        audio_sample_t * out,
+                                        int frameCount) {
+    audio_coef_t coefs[MAX_STAGES][NUM_COEFS];
+    audio_sample_t delays[MAX_STAGES][2][4];
+    for (int s = 0; s < nStages; ++s) {
+        memcpy(coefs[s], stages[s]->mCoefs, sizeof(coefs[s]));
+        memcpy(delays[s], stages[s]->mDelays, sizeof(delays[s]));
+    }
+    while (frameCount-- > 0) {
+        audio_sample_t l0 = *(in++);
+        audio_sample_t r0 = *(in++);
+        for (int s = 0; s < nStages; ++s) {
+            const audio_coef_t * c = coefs[s];
+            audio_sample_t * dl = delays[s][0];
+            audio_sample_t * dr = delays[s][1];
+            audio_coef_sample_acc_t accl, accr;
+            accl = mul_coef_sample(c[0], l0);
+            accr = mul_coef_sample(c[0], r0);
+            accl = mac_coef_sample(c[1], dl[0], accl);
+            accr = mac_coef_sample(c[1], dr[0], accr);
+            accl = mac_coef_sample(c[2], dl[1], accl);
+            accr = mac_coef_sample(c[2], dr[1], accr);
+            accl = mac_coef_sample(c[3], dl[2], accl);
+            accr = mac_coef_sample(c[3], dr[2], accr);
+            accl = mac_coef_sample(c[4], dl[3], accl);
+            accr = mac_coef_sample(c[4], dr[3], accr);
+            audio_sample_t l1 = coef_sample_acc_to_sample(accl);
+            audio_sample_t r1 = coef_sample_acc_to_sample(accr);
+            dl[1] = dl[0];
+            dl[0] = l0;
+            dl[3] = dl[2];
+            dl[2] = l1;
+            dr[1] = dr[0];
+            dr[0] = r0;
+            dr[3] = dr[2];
+            dr[2] = r1;
+            l0 = l1;
+            r0 = r1;
+        }
+        *(out++) = l0;
+        *(out++) = r0;
+    }
+    for (int s = 0; s < nStages; ++s) {
+        memcpy(stages[s]->mDelays, delays[s], sizeof(delays[s]));
+    }
+}
+
+#endif
+
+}
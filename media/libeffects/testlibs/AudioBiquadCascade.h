@@ -0,0 +1,131 @@
+/*
+**
+** Copyright 2012, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_AUDIO_BIQUAD_CASCADE_H
+#define ANDROID_AUDIO_BIQUAD_CASCADE_H
+
+#include "AudioCommon.h"
+#include "AudioBiquadFilter.h"
+
+namespace android {
+// A cascade of biquad filters, processed in a single pass over the buffer.
+// Each stage behaves exactly as an AudioBiquadFilter would, including the
+// smooth transitions on coefficient and state changes, so that the output is
+// bit exact with running the stages one after the other on the whole buffer.
+// Stereo input is processed a frame at a time through all the stages, with
+// both channels in a vector register on ARM NEON and x86 SSE4.1. Mono input
+// is processed a stage at a time, with the delay line held in registers.
+class AudioBiquadCascade {
+public:
+    // Max number of channels.
+    static const int MAX_CHANNELS = AudioBiquadFilter::MAX_CHANNELS;
+    // Max number of stages.
+    static const int MAX_STAGES = 16;
+    // Number of coefficients per stage.
+    static const int NUM_COEFS = AudioBiquadFilter::NUM_COEFS;
+
+    // Constructor.
+    // nStages      Number of stages, up to MAX_STAGES.
+    // nChannels    Number of input/output channels.
+    // sampleRate   Sample rate, in Hz.
+    AudioBiquadCascade(int nStages, int nChannels, int sampleRate);
+
+    // Reconfiguration of the filter. Implies clear().
+    // nChannels    Number of input/output channels.
+    // sampleRate   Sample rate, in Hz.
+    void configure(int nChannels, int sampleRate);
+
+    // Resets all stages to identity coefficients and disabled state, see
+    // AudioBiquadFilter::reset().
+    void reset();
+
+    // Clears the delay lines of all stages.
+    void clear();
+
+    // Sets the coefficients of a stage, see AudioBiquadFilter::setCoefs().
+    // stage        The stage index.
+    // coefs        The new coefficients.
+    // immediate    If true, transitions to new coefficients immediately.
+    void setCoefs(int stage, const audio_coef_t coefs[NUM_COEFS],
+                  bool immediate = false);
+
+    // Process a buffer of data through all the stages. Processing can be done
+    // in-place, by passing the same buffer as both arguments.
+    // in           The input buffer. Should be of size frameCount * nChannels.
+    // out          The output buffer. Should be of size frameCount * nChannels.
+    // frameCount   Number of multi-channel samples to process.
+    void process(const audio_sample_t in[], audio_sample_t out[],
+                 int frameCount);
+
+    // Enables (activates) all stages, see AudioBiquadFilter::enable().
+    void enable(bool immediate = false);
+
+    // Disables (bypasses) all stages, see AudioBiquadFilter::disable().
+    void disable(bool immediate = false);
+
+private:
+    // The maximum rate of coefficient change, measured in coefficient units per
+    // second.
+    static const audio_coef_t MAX_DELTA_PER_SEC = 2000;
+
+    // Coefficients of identity transformation.
+    static const audio_coef_t IDENTITY_COEFS[NUM_COEFS];
+
+    // Stage state, same as AudioBiquadFilter::state_t.
+    enum state_t {
+        STATE_BYPASS = 0x01,
+        STATE_TRANSITION_TO_BYPASS = 0x02,
+        STATE_TRANSITION_TO_NORMAL = 0x04,
+        STATE_NORMAL = 0x05,
+        STATE_ENABLED_MASK = 0x04
+    };
+
+    struct Stage {
+        state_t mState;
+        // Coefficients for which the current value is not yet the target.
+        uint32_t mCoefDirtyBits;
+        audio_coef_t mCoefs[NUM_COEFS];
+        audio_coef_t mTargetCoefs[NUM_COEFS];
+        // x[n-1], x[n-2], y[n-1], y[n-2] for each channel.
+        audio_sample_t mDelays[MAX_CHANNELS][4];
+    };
+
+    int mNumStages;
+    int mNumChannels;
+    // Maximum coefficient delta per sample.
+    audio_coef_t mMaxDelta;
+    Stage mStages[MAX_STAGES];
+
+    void setState(Stage & stage, state_t state);
+
+    // Moves the coefficients of a transitioning stage towards the passed
+    // coefficients, see AudioBiquadFilter::updateCoefs().
+    bool updateCoefs(Stage & stage, const audio_coef_t coefs[NUM_COEFS],
+                     int frameCount);
+
+    // Processes frameCount frames through the given stages, none of which is
+    // bypassed.
+    void process_mono(Stage * const stages[], int nStages,
+                      const audio_sample_t * in, audio_sample_t * out,
+                      int frameCount);
+    void process_stereo(Stage * const stages[], int nStages,
+                        const audio_sample_t * in, audio_sample_t * out,
+                        int frameCount);
+};
+}
+
+#endif // ANDROID_AUDIO_BIQUAD_CASCADE_H
@@ -29,7 +29,7 @@
 namespace android {
 
 size_t AudioEqualizer::GetInstanceSize(int nBands) {
-    assert(nBands >= 2);
+    assert(nBands >= 2 && nBands <= AudioBiquadCascade::MAX_STAGES);
     return sizeof(AudioEqualizer) +
            sizeof(AudioShelvingFilter) * 2 +
            sizeof(AudioPeakingFilter) * (nBands - 2);
@@ -58,20 +58,18 @@ AudioEqualizer * AudioEqualizer::CreateInstance(void * pMem, int nBands,
 void AudioEqualizer::configure(int nChannels, int sampleRate) {
     ALOGV("AudioEqualizer::configure(nChannels=%d, sampleRate=%d)", nChannels,
          sampleRate);
-    mpLowShelf->configure(nChannels, sampleRate);
+    mpLowShelf->configure(sampleRate);
     for (int i = 0; i < mNumPeaking; ++i) {
-        mpPeakingFilters[i].configure(nChannels, sampleRate);
+        mpPeakingFilters[i].configure(sampleRate);
     }
-    mpHighShelf->configure(nChannels, sampleRate);
+    mpHighShelf->configure(sampleRate);
+    mCascade.configure(nChannels, sampleRate);
+    commit(true);
 }
 
 void AudioEqualizer::clear() {
     ALOGV("AudioEqualizer::clear()");
-    mpLowShelf->clear();
-    for (int i = 0; i < mNumPeaking; ++i) {
-        mpPeakingFilters[i].clear();
-    }
-    mpHighShelf->clear();
+    mCascade.clear();
 }
 
 void AudioEqualizer::free() {
@@ -215,40 +213,32 @@ void AudioEqualizer::setPreset(int preset) {
 
 void AudioEqualizer::commit(bool immediate) {
     ALOGV("AudioEqualizer::commit(immediate=%d)", immediate);
-    mpLowShelf->commit(immediate);
+    audio_coef_t coefs[AudioBiquadFilter::NUM_COEFS];
+    mpLowShelf->getCoefs(coefs);
+    mCascade.setCoefs(0, coefs, immediate);
     for (int i = 0; i < mNumPeaking; ++i) {
-        mpPeakingFilters[i].commit(immediate);
+        mpPeakingFilters[i].getCoefs(coefs);
+        mCascade.setCoefs(i + 1, coefs, immediate);
     }
-    mpHighShelf->commit(immediate);
+    mpHighShelf->getCoefs(coefs);
+    mCascade.setCoefs(mNumPeaking + 1, coefs, immediate);
 }
 
 void AudioEqualizer::process(const audio_sample_t * pIn,
                              audio_sample_t * pOut,
                              int frameCount) {
 //    ALOGV("AudioEqualizer::process(frameCount=%d)", frameCount);
-    mpLowShelf->process(pIn, pOut, frameCount);
-    for (int i = 0; i < mNumPeaking; ++i) {
-        mpPeakingFilters[i].process(pIn, pOut, frameCount);
-    }
-    mpHighShelf->process(pIn, pOut, frameCount);
+    mCascade.process(pIn, pOut, frameCount);
 }
 
 void AudioEqualizer::enable(bool immediate) {
     ALOGV("AudioEqualizer::enable(immediate=%d)", immediate);
-    mpLowShelf->enable(immediate);
-    for (int i = 0; i < mNumPeaking; ++i) {
-        mpPeakingFilters[i].enable(immediate);
-    }
-    mpHighShelf->enable(immediate);
+    mCascade.enable(immediate);
 }
 
 void AudioEqualizer::disable(bool immediate) {
     ALOGV("AudioEqualizer::disable(immediate=%d)", immediate);
-    mpLowShelf->disable(immediate);
-    for (int i = 0; i < mNumPeaking; ++i) {
-        mpPeakingFilters[i].disable(immediate);
-    }
-    mpHighShelf->disable(immediate);
+    mCascade.disable(immediate);
 }
 
 int AudioEqualizer::getMostRelevantBand(uint32_t targetFreq) const {
@@ -289,24 +279,24 @@ AudioEqualizer::AudioEqualizer(void * pMem, int nBands, int nChannels,
                                const PresetConfig * presets, int nPresets)
                                : mSampleRate(sampleRate)
                                , mpPresets(presets)
-                               , mNumPresets(nPresets) {
+                               , mNumPresets(nPresets)
+                               , mCascade(nBands, nChannels, sampleRate) {
     assert(pMem != NULL);
     assert(nPresets == 0 || nPresets > 0 && presets != NULL);
     mpMem = ownMem ? pMem : NULL;
 
     pMem = (char *) pMem + sizeof(AudioEqualizer);
     mpLowShelf = new (pMem) AudioShelvingFilter(AudioShelvingFilter::kLowShelf,
-                                                nChannels, sampleRate);
+                                                sampleRate);
     pMem = (char *) pMem + sizeof(AudioShelvingFilter);
     mpHighShelf = new (pMem) AudioShelvingFilter(AudioShelvingFilter::kHighShelf,
-                                                 nChannels, sampleRate);
+                                                 sampleRate);
     pMem = (char *) pMem + sizeof(AudioShelvingFilter);
     mNumPeaking = nBands - 2;
     if (mNumPeaking > 0) {
         mpPeakingFilters = reinterpret_cast<AudioPeakingFilter *>(pMem);
         for (int i = 0; i < mNumPeaking; ++i) {
-            new (&mpPeakingFilters[i]) AudioPeakingFilter(nChannels,
-                                                          sampleRate);
+            new (&mpPeakingFilters[i]) AudioPeakingFilter(sampleRate);
         }
     }
     reset();
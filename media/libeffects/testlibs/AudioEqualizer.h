@@ -18,6 +18,7 @@
 #define AUDIOEQUALIZER_H_
 
 #include "AudioCommon.h"
+#include "AudioBiquadCascade.h"
 
 namespace android {
 
@@ -29,6 +30,8 @@ class AudioPeakingFilter;
 // The EQ is composed of a low-shelf, zero or more peaking filters and a high
 // shelf, where each band has frequency and gain controls, and the peaking
 // filters have an additional bandwidth control.
+// The band filters only compute the coefficients: all the bands are processed
+// in a single pass by an AudioBiquadCascade.
 class AudioEqualizer {
 public:
     // Configuration of a single band.
@@ -224,6 +227,8 @@ private:
     AudioShelvingFilter * mpHighShelf;
     // An array of size mNumPeaking of peaking filters.
     AudioPeakingFilter * mpPeakingFilters;
+    // The biquads of all the bands, low shelf first and high shelf last.
+    AudioBiquadCascade mCascade;
 
     // Constructor. Resets the filter (see reset()). Must call init() doing
     // anything else.
@@ -43,25 +43,22 @@ static const audio_coef_t kCoefTable[9*15*4*5] = {
 
 AudioCoefInterpolator AudioPeakingFilter::mCoefInterp(3, kInDims, 5, (const audio_coef_t*) kCoefTable);
 
-AudioPeakingFilter::AudioPeakingFilter(int nChannels, int sampleRate)
-        : mBiquad(nChannels, sampleRate) {
-    configure(nChannels, sampleRate);
+AudioPeakingFilter::AudioPeakingFilter(int sampleRate)
+        : mNominalFrequency(0) {
+    configure(sampleRate);
     reset();
 }
 
-void AudioPeakingFilter::configure(int nChannels, int sampleRate) {
+void AudioPeakingFilter::configure(int sampleRate) {
     mNiquistFreq = sampleRate * 500;
     mFrequencyFactor = ((1ull) << 42) / mNiquistFreq;
-    mBiquad.configure(nChannels, sampleRate);
     setFrequency(mNominalFrequency);
-    commit(true);
 }
 
 void AudioPeakingFilter::reset() {
     setGain(0);
     setFrequency(0);
     setBandwidth(2400);
-    commit(true);
 }
 
 void AudioPeakingFilter::setFrequency(uint32_t millihertz) {
@@ -86,8 +83,7 @@ void AudioPeakingFilter::setBandwidth(uint32_t cents) {
     mBandwidth = cents - 1;
 }
 
-void AudioPeakingFilter::commit(bool immediate) {
-    audio_coef_t coefs[5];
+void AudioPeakingFilter::getCoefs(audio_coef_t coefs[5]) const {
     int intCoord[3] = {
         mFrequency >> FREQ_PRECISION_BITS,
         mGain >> GAIN_PRECISION_BITS,
@@ -99,7 +95,6 @@ void AudioPeakingFilter::commit(bool immediate) {
         mBandwidth << (32 - BANDWIDTH_PRECISION_BITS)
     };
     mCoefInterp.getCoef(intCoord, fracCoord, coefs);
-    mBiquad.setCoefs(coefs, immediate);
 }
 
 void AudioPeakingFilter::getBandRange(uint32_t & low, uint32_t & high) const {
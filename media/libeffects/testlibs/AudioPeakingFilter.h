@@ -25,58 +25,48 @@ namespace android {
 
 // A peaking audio filter, with unity skirt gain, and controllable peak
 // frequency, gain and bandwidth.
-// This filter is able to suppress introduce discontinuities and other artifacts
-// in the output, even when changing parameters abruptly.
 // Parameters can be set to any value - this class will make sure to clip them
 // when they are out of supported range.
 //
 // Implementation notes:
-// This class uses an underlying biquad filter whose parameters are determined
-// using a linear interpolation from a coefficient table, using a
-// AudioCoefInterpolator.
+// This class only computes the coefficients of a biquad filter, using a
+// linear interpolation from a coefficient table, using a
+// AudioCoefInterpolator. The filtering is done by the user of the class, e.g.
+// in an AudioBiquadCascade with the other bands of an equalizer.
 // All is left for this class to do is mapping between high-level parameters to
 // fractional indices into the coefficient table.
 class AudioPeakingFilter {
 public:
     // Constructor. Resets the filter (see reset()).
-    // nChannels  Number of input/output channels (interlaced).
     // sampleRate The input/output sample rate, in Hz.
-    AudioPeakingFilter(int nChannels, int sampleRate);
+    AudioPeakingFilter(int sampleRate);
 
-    // Reconfiguration of the filter. Changes input/output format, but does not
-    // alter current parameter values. Clears delay lines.
-    // nChannels  Number of input/output channels (interlaced).
+    // Reconfiguration of the filter. Changes the sample rate, but does not
+    // alter current parameter values.
     // sampleRate The input/output sample rate, in Hz.
-    void configure(int nChannels, int sampleRate);
+    void configure(int sampleRate);
 
     // Resets the filter parameters to the following values:
     // frequency: 0
     // gain: 0
     // bandwidth: 1200 cents.
-    // It also disables the filter. Does not clear the delay lines.
     void reset();
 
-    // Clears delay lines. Does not alter parameter values.
-    void clear() { mBiquad.clear(); }
-
-    // Sets gain value. Actual change will only take place upon commit().
-    // This value will be remembered even if the filter is in disabled() state.
+    // Sets gain value, used by the next getCoefs().
     // millibel Gain value in millibel (1/100 of decibel).
     void setGain(int32_t millibel);
 
     // Gets the gain, in millibel, as set.
     int32_t getGain() const { return mGain - 9600; }
 
-    // Sets bandwidth value. Actual change will only take place upon commit().
-    // This value will be remembered even if the filter is in disabled() state.
+    // Sets bandwidth value, used by the next getCoefs().
     // cents Bandwidth value in cents (1/1200 octave).
     void setBandwidth(uint32_t cents);
 
     // Gets the gain, in cents, as set.
     uint32_t getBandwidth() const { return mBandwidth + 1; }
 
-    // Sets frequency value. Actual change will only take place upon commit().
-    // This value will be remembered even if the filter is in disabled() state.
+    // Sets frequency value, used by the next getCoefs().
     // millihertz Frequency value in mHz.
     void setFrequency(uint32_t millihertz);
 
@@ -88,31 +78,9 @@ public:
     // possibly rounded or truncated actual values.
     void getBandRange(uint32_t & low, uint32_t & high) const;
 
-    // Applies all parameter changes done to this point in time.
-    // If the filter is disabled, the new parameters will take place when it is
-    // enabled again. Does not introduce artifacts, unless immediate is set.
-    // immediate    Whether to apply change abruptly (ignored if filter is
-    // disabled).
-   void commit(bool immediate = false);
-
-    // Process a buffer of input data. The input and output should contain
-    // frameCount * nChannels interlaced samples. Processing can be done
-    // in-place, by passing the same buffer as both arguments.
-    // in           Input buffer.
-    // out          Output buffer.
-    // frameCount   Number of frames to produce.
-    void process(const audio_sample_t in[], audio_sample_t out[],
-                 int frameCount) { mBiquad.process(in, out, frameCount); }
-
-    // Enables the filter, so it would start processing input. Does not
-    // introduce artifacts, unless immediate is set.
-    // immediate    Whether to apply change abruptly.
-    void enable(bool immediate = false) { mBiquad.enable(immediate); }
-
-    // Disabled (bypasses) the filter. Does not introduce artifacts, unless
-    // immediate is set.
-    // immediate    Whether to apply change abruptly.
-    void disable(bool immediate = false) { mBiquad.disable(immediate); }
+    // Gets the biquad coefficients for the current parameter values.
+    // coefs        An array of AudioBiquadFilter::NUM_COEFS coefficients.
+    void getCoefs(audio_coef_t coefs[AudioBiquadFilter::NUM_COEFS]) const;
 
 private:
     // Precision for the mFrequency member.
@@ -139,8 +107,6 @@ private:
     // Used for scaling the frequency.
     uint32_t mFrequencyFactor;
 
-    // A biquad filter, used for the actual processing.
-    AudioBiquadFilter mBiquad;
     // A coefficient interpolator, used for mapping the high level parameters to
     // the low-level biquad coefficients.
     static AudioCoefInterpolator mCoefInterp;
@@ -48,25 +48,21 @@ static const audio_coef_t kLoCoefTable[5*15*5] = {
 AudioCoefInterpolator AudioShelvingFilter::mHiCoefInterp(2, kHiInDims, 5, (const audio_coef_t*) kHiCoefTable);
 AudioCoefInterpolator AudioShelvingFilter::mLoCoefInterp(2, kLoInDims, 5, (const audio_coef_t*) kLoCoefTable);
 
-AudioShelvingFilter::AudioShelvingFilter(ShelfType type, int nChannels,
-                                         int sampleRate)
+AudioShelvingFilter::AudioShelvingFilter(ShelfType type, int sampleRate)
         : mType(type),
-          mBiquad(nChannels, sampleRate)  {
-    configure(nChannels, sampleRate);
+          mNominalFrequency(0) {
+    configure(sampleRate);
 }
 
-void AudioShelvingFilter::configure(int nChannels, int sampleRate) {
+void AudioShelvingFilter::configure(int sampleRate) {
     mNiquistFreq = sampleRate * 500;
     mFrequencyFactor = ((1ull) << 42) / mNiquistFreq;
-    mBiquad.configure(nChannels, sampleRate);
     setFrequency(mNominalFrequency);
-    commit(true);
 }
 
 void AudioShelvingFilter::reset() {
     setGain(0);
     setFrequency(mType == kLowShelf ? 0 : mNiquistFreq);
-    commit(true);
 }
 
 void AudioShelvingFilter::setFrequency(uint32_t millihertz) {
@@ -88,8 +84,7 @@ void AudioShelvingFilter::setGain(int32_t millibel) {
     mGain = millibel + 9600;
 }
 
-void AudioShelvingFilter::commit(bool immediate) {
-    audio_coef_t coefs[5];
+void AudioShelvingFilter::getCoefs(audio_coef_t coefs[5]) const {
     int intCoord[2] = {
         mFrequency >> FREQ_PRECISION_BITS,
         mGain >> GAIN_PRECISION_BITS
@@ -103,7 +98,6 @@ void AudioShelvingFilter::commit(bool immediate) {
     } else {
         mLoCoefInterp.getCoef(intCoord, fracCoord, coefs);
     }
-    mBiquad.setCoefs(coefs, immediate);
 }
 
 }
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark and bit-exactness check of the equalizer, run on the host.
+//
+// Compares the AudioEqualizer, which runs all its bands in an
+// AudioBiquadCascade, with one AudioBiquadFilter per band processing the
+// buffer one after the other, as the equalizer used to. Both are driven
+// through the same sequence of gain changes and enable/disable transitions
+// and must produce identical output. Reports the CPU time per buffer of both.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "AudioBiquadFilter.h"
+#include "AudioEqualizer.h"
+#include "AudioPeakingFilter.h"
+#include "AudioShelvingFilter.h"
+
+using namespace android;
+
+// bands of the test equalizer library
+static const int kNumBands = 5;
+static const uint32_t kFreqs[kNumBands] = { 50000, 125000, 900000, 3200000, 6300000 };
+static const uint32_t kBandwidths[kNumBands] = { 0, 3600, 3600, 2400, 0 };
+
+// The equalizer as it used to be: each band filter had its own biquad, and
+// the biquads processed the buffer in place one after the other.
+class SerialEqualizer {
+public:
+    SerialEqualizer(int nChannels, int sampleRate)
+        : mLowShelf(AudioShelvingFilter::kLowShelf, sampleRate),
+          mHighShelf(AudioShelvingFilter::kHighShelf, sampleRate) {
+        for (int i = 0; i < kNumBands - 2; i++) {
+            mPeaking[i] = new AudioPeakingFilter(sampleRate);
+        }
+        for (int band = 0; band < kNumBands; band++) {
+            mBiquads[band] = new AudioBiquadFilter(nChannels, sampleRate);
+        }
+        commit(true);
+    }
+    ~SerialEqualizer() {
+        for (int i = 0; i < kNumBands - 2; i++) {
+            delete mPeaking[i];
+        }
+        for (int band = 0; band < kNumBands; band++) {
+            delete mBiquads[band];
+        }
+    }
+    void setBand(int band, int32_t gain, uint32_t freq, uint32_t bandwidth) {
+        if (band == 0) {
+            mLowShelf.setGain(gain);
+            mLowShelf.setFrequency(freq);
+        } else if (band == kNumBands - 1) {
+            mHighShelf.setGain(gain);
+            mHighShelf.setFrequency(freq);
+        } else {
+            mPeaking[band - 1]->setGain(gain);
+            mPeaking[band - 1]->setFrequency(freq);
+            mPeaking[band - 1]->setBandwidth(bandwidth);
+        }
+    }
+    void commit(bool immediate) {
+        audio_coef_t coefs[AudioBiquadFilter::NUM_COEFS];
+        mLowShelf.getCoefs(coefs);
+        mBiquads[0]->setCoefs(coefs, immediate);
+        for (int i = 0; i < kNumBands - 2; i++) {
+            mPeaking[i]->getCoefs(coefs);
+            mBiquads[i + 1]->setCoefs(coefs, immediate);
+        }
+        mHighShelf.getCoefs(coefs);
+        mBiquads[kNumBands - 1]->setCoefs(coefs, immediate);
+    }
+    void enable(bool immediate) {
+        for (int band = 0; band < kNumBands; band++) {
+            mBiquads[band]->enable(immediate);
+        }
+    }
+    void disable(bool immediate) {
+        for (int band = 0; band < kNumBands; band++) {
+            mBiquads[band]->disable(immediate);
+        }
+    }
+    void process(audio_sample_t* buffer, int frameCount) {
+        for (int band = 0; band < kNumBands; band++) {
+            mBiquads[band]->process(buffer, buffer, frameCount);
+        }
+    }
+private:
+    AudioShelvingFilter mLowShelf;
+    AudioShelvingFilter mHighShelf;
+    AudioPeakingFilter* mPeaking[kNumBands - 2];
+    AudioBiquadFilter* mBiquads[kNumBands];
+};
+
+static int64_t cpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -f frames per buffer (default 1024)\n");
+    fprintf(stderr, "       -i iterations (default 2000)\n");
+    fprintf(stderr, "       -m(ono)\n");
+}
+
+int main(int argc, char **argv) {
+    int frameCount = 1024;
+    int iterations = 2000;
+    int channelCount = 2;
+    const int sampleRate = 44100;
+
+    int res;
+    while ((res = getopt(argc, argv, "hf:i:m")) >= 0) {
+        switch (res) {
+            case 'f':
+                frameCount = atoi(optarg);
+                break;
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            case 'm':
+                channelCount = 1;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (frameCount <= 0 || iterations <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    AudioEqualizer* eq = AudioEqualizer::CreateInstance(NULL, kNumBands, channelCount,
+            sampleRate, NULL, 0);
+    SerialEqualizer serial(channelCount, sampleRate);
+    for (int band = 0; band < kNumBands; band++) {
+        eq->setFrequency(band, kFreqs[band]);
+        eq->setBandwidth(band, kBandwidths[band]);
+        serial.setBand(band, 0, kFreqs[band], kBandwidths[band]);
+    }
+    eq->commit(true);
+    serial.commit(true);
+    eq->enable(true);
+    serial.enable(true);
+
+    size_t samples = frameCount * channelCount;
+    audio_sample_t* input = new audio_sample_t[samples];
+    audio_sample_t* a = new audio_sample_t[samples];
+    audio_sample_t* b = new audio_sample_t[samples];
+    srand(42);
+
+    int64_t cascadeNs = 0;
+    int64_t serialNs = 0;
+    int mismatches = 0;
+    for (int n = 0; n < iterations; n++) {
+        // change the gains and toggle the equalizer now and then, so that
+        // the coefficient transitions are exercised
+        if (n % 50 == 0) {
+            for (int band = 0; band < kNumBands; band++) {
+                int32_t gain = (rand() % 3000) - 1500;
+                eq->setGain(band, gain);
+                serial.setBand(band, gain, kFreqs[band], kBandwidths[band]);
+            }
+            bool immediate = (n % 200) == 0;
+            eq->commit(immediate);
+            serial.commit(immediate);
+        }
+        if (n % 300 == 100) {
+            eq->disable(false);
+            serial.disable(false);
+        } else if (n % 300 == 200) {
+            eq->enable(false);
+            serial.enable(false);
+        }
+
+        for (size_t i = 0; i < samples; i++) {
+            // half scale noise, audio_sample_t has 24 fractional bits
+            input[i] = (rand() % (1 << 24)) - (1 << 23);
+        }
+        memcpy(a, input, samples * sizeof(audio_sample_t));
+        memcpy(b, input, samples * sizeof(audio_sample_t));
+
+        int64_t start = cpuTimeNs();
+        eq->process(a, a, frameCount);
+        cascadeNs += cpuTimeNs() - start;
+
+        start = cpuTimeNs();
+        serial.process(b, frameCount);
+        serialNs += cpuTimeNs() - start;
+
+        if (memcmp(a, b, samples * sizeof(audio_sample_t)) != 0) {
+            if (mismatches++ < 10) {
+                for (size_t i = 0; i < samples; i++) {
+                    if (a[i] != b[i]) {
+                        printf("buffer %d sample %d: cascade %d serial %d\n", n, (int)i, a[i], b[i]);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    eq->free();
+    delete[] input;
+    delete[] a;
+    delete[] b;
+
+    printf("%d bands, %d frames, %s, %d buffers\n", kNumBands, frameCount,
+            channelCount == 1 ? "mono" : "stereo", iterations);
+    printf("serial bands: %8.2f us/buffer\n", serialNs / 1000.0 / iterations);
+    printf("cascade:      %8.2f us/buffer (x%.2f)\n", cascadeNs / 1000.0 / iterations,
+            cascadeNs ? (double)serialNs / cascadeNs : 0.0);
+    if (mismatches != 0) {
+        printf("FAIL: %d buffers differ\n", mismatches);
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
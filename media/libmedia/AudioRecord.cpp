@@ -355,7 +355,7 @@ status_t AudioRecord::stop()
     AutoMutex lock(mLock);
     if (mActive == 1) {
         mActive = 0;
-        mCblk->cv.signal();
+        mCblk->wake();
         mAudioRecord->stop();
         // the record head position will reset to 0, so if a marker is set, we need
         // to activate it again
@@ -493,6 +493,7 @@ status_t AudioRecord::obtainBuffer(Buffer* audioBuffer, int32_t waitCount)
 {
     AutoMutex lock(mLock);
     int active;
+    int32_t sequence;
     status_t result = NO_ERROR;
     audio_track_cblk_t* cblk = mCblk;
     uint32_t framesReq = audioBuffer->frameCount;
@@ -509,17 +510,19 @@ status_t AudioRecord::obtainBuffer(Buffer* audioBuffer, int32_t waitCount)
         while (framesReady == 0) {
             active = mActive;
             if (UNLIKELY(!active)) {
+                cblk->cancelWait();
                 cblk->lock.unlock();
                 return NO_MORE_BUFFERS;
             }
             if (UNLIKELY(!waitCount)) {
+                cblk->cancelWait();
                 cblk->lock.unlock();
                 return WOULD_BLOCK;
             }
             if (!(cblk->flags & CBLK_INVALID_MSK)) {
                 mLock.unlock();
-                result = cblk->cv.waitRelative(cblk->lock, milliseconds(waitTimeMs));
                 cblk->lock.unlock();
+                result = cblk->waitServer(sequence, waitTimeMs);
                 mLock.lock();
                 if (mActive == 0) {
                     return status_t(STOPPED);
@@ -556,8 +559,11 @@ create_new_record:
             }
             // read the server count again
         start_loop_here:
+            sequence = cblk->prepareWait();
             framesReady = cblk->framesReady();
         }
+        // not waiting after all
+        cblk->cancelWait();
         cblk->lock.unlock();
     }
 
@@ -23,8 +23,11 @@
 #include <sys/types.h>
 #include <limits.h>
 
+#include <errno.h>
 #include <sched.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include <private/media/AudioTrackShared.h>
 
@@ -37,6 +40,7 @@
 #include <utils/Timers.h>
 #include <utils/Atomic.h>
 
+#include <cutils/atomic.h>
 #include <cutils/bitops.h>
 
 #include <system/audio.h>
@@ -205,7 +209,7 @@ status_t AudioTrack::set(
     audio_io_handle_t output = AudioSystem::getOutput(
                                     (audio_stream_type_t)streamType,
                                     sampleRate,format, channelMask,
-                                    (audio_policy_output_flags_t)flags);
+                                    (audio_policy_output_flags_t)(flags & ~FLAG_FAST));
 
     if (output == 0) {
         ALOGE("Could not get audio output for stream type %d", streamType);
@@ -392,7 +396,7 @@ void AudioTrack::stop()
     AutoMutex lock(mLock);
     if (mActive == 1) {
         mActive = 0;
-        mCblk->cv.signal();
+        mCblk->wake();
         mAudioTrack->stop();
         // Cancel loops (If we are in the middle of a loop, playback
         // would not stop until loopCount reaches 0).
@@ -443,7 +447,7 @@ void AudioTrack::flush_l()
         mAudioTrack->flush();
         // Release AudioTrack callback thread in case it was waiting for new buffers
         // in AudioTrack::obtainBuffer()
-        mCblk->cv.signal();
+        mCblk->wake();
     }
 }
 
@@ -548,12 +552,20 @@ status_t AudioTrack::setLoop_l(uint32_t loopStart, uint32_t loopEnd, int loopCou
 {
     audio_track_cblk_t* cblk = mCblk;
 
+    // the fast mixer reads fast tracks without the lock and ignores loops
+    if ((mFlags & FLAG_FAST) && mSharedBuffer == 0 && loopCount != 0) {
+        ALOGE("setLoop not supported on a fast track");
+        return INVALID_OPERATION;
+    }
+
     Mutex::Autolock _l(cblk->lock);
 
+    // loopEnd is stored last: stepServer() reads it without the lock to know
+    // whether there is a loop to lock for
     if (loopCount == 0) {
         cblk->loopStart = UINT_MAX;
-        cblk->loopEnd = UINT_MAX;
         cblk->loopCount = 0;
+        android_atomic_release_store((int32_t)UINT_MAX, (volatile int32_t *)&cblk->loopEnd);
         mLoopCount = 0;
         return NO_ERROR;
     }
@@ -572,8 +584,8 @@ status_t AudioTrack::setLoop_l(uint32_t loopStart, uint32_t loopEnd, int loopCou
     }
 
     cblk->loopStart = loopStart;
-    cblk->loopEnd = loopEnd;
     cblk->loopCount = loopCount;
+    android_atomic_release_store((int32_t)loopEnd, (volatile int32_t *)&cblk->loopEnd);
     mLoopCount = loopCount;
 
     return NO_ERROR;
@@ -749,6 +761,14 @@ status_t AudioTrack::createTrack_l(
         if (minBufCount < 2) minBufCount = 2;
 
         int minFrameCount = (afFrameCount*sampleRate*minBufCount)/afSampleRate;
+        // a fast track is not mixed by the normal mixer, AudioFlinger sets the
+        // minimum size of its buffer
+        if ((flags & FLAG_FAST) && sharedBuffer == 0) {
+            minFrameCount = 0;
+            if (frameCount == 0) {
+                frameCount = afFrameCount;
+            }
+        }
 
         if (sharedBuffer == 0) {
             if (frameCount == 0) {
@@ -821,6 +841,10 @@ status_t AudioTrack::createTrack_l(
     mAudioTrack->attachAuxEffect(mAuxEffectId);
     mCblk->bufferTimeoutMs = MAX_STARTUP_TIMEOUT_MS;
     mCblk->waitTimeMs = 0;
+    // AudioFlinger can change the buffer size of a fast track
+    if (mNotificationFramesAct > mCblk->frameCount/2) {
+        mNotificationFramesAct = mCblk->frameCount/2;
+    }
     mRemainingFrames = mNotificationFramesAct;
     mLatency = afLatency + (1000*mCblk->frameCount) / sampleRate;
     return NO_ERROR;
@@ -830,6 +854,7 @@ status_t AudioTrack::obtainBuffer(Buffer* audioBuffer, int32_t waitCount)
 {
     AutoMutex lock(mLock);
     int active;
+    int32_t sequence;
     status_t result = NO_ERROR;
     audio_track_cblk_t* cblk = mCblk;
     uint32_t framesReq = audioBuffer->frameCount;
@@ -853,17 +878,19 @@ status_t AudioTrack::obtainBuffer(Buffer* audioBuffer, int32_t waitCount)
             active = mActive;
             if (UNLIKELY(!active)) {
                 ALOGV("Not active and NO_MORE_BUFFERS");
+                cblk->cancelWait();
                 cblk->lock.unlock();
                 return NO_MORE_BUFFERS;
             }
             if (UNLIKELY(!waitCount)) {
+                cblk->cancelWait();
                 cblk->lock.unlock();
                 return WOULD_BLOCK;
             }
             if (!(cblk->flags & CBLK_INVALID_MSK)) {
                 mLock.unlock();
-                result = cblk->cv.waitRelative(cblk->lock, milliseconds(waitTimeMs));
                 cblk->lock.unlock();
+                result = cblk->waitServer(sequence, waitTimeMs);
                 mLock.lock();
                 if (mActive == 0) {
                     return status_t(STOPPED);
@@ -907,8 +934,11 @@ create_new_track:
             }
             // read the server count again
         start_loop_here:
+            sequence = cblk->prepareWait();
             framesAvail = cblk->framesAvailable_l();
         }
+        // not waiting after all
+        cblk->cancelWait();
         cblk->lock.unlock();
     }
 
@@ -1309,7 +1339,7 @@ audio_track_cblk_t::audio_track_cblk_t()
     : lock(Mutex::SHARED), cv(Condition::SHARED), user(0), server(0),
     userBase(0), serverBase(0), buffers(0), frameCount(0),
     loopStart(UINT_MAX), loopEnd(UINT_MAX), loopCount(0), volumeLR(0),
-    sendLevel(0), flags(0)
+    sendLevel(0), flags(0), futex(0)
 {
 }
 
@@ -1333,7 +1363,8 @@ uint32_t audio_track_cblk_t::stepUser(uint32_t frameCount)
         userBase += this->frameCount;
     }
 
-    this->user = u;
+    // publish the new index after the buffer has been written (or read)
+    android_atomic_release_store((int32_t)u, (volatile int32_t *)&this->user);
 
     // Clear flow control error condition as new data has been written/read to/from buffer.
     if (flags & CBLK_UNDERRUN_MSK) {
@@ -1345,9 +1376,18 @@ uint32_t audio_track_cblk_t::stepUser(uint32_t frameCount)
 
 bool audio_track_cblk_t::stepServer(uint32_t frameCount)
 {
-    if (!tryLock()) {
-        ALOGW("stepServer() could not lock cblk");
-        return false;
+    // the client sets the loop points and the loop count with the lock held,
+    // and stores loopEnd last. Without a loop the lock is not taken and the
+    // loop members are not touched; a loop set meanwhile starts at the next step.
+    uint32_t end = (uint32_t)android_atomic_acquire_load((volatile const int32_t *)&loopEnd);
+    bool locked = false;
+    if (end != UINT_MAX) {
+        if (!tryLock()) {
+            ALOGW("stepServer() could not lock cblk");
+            return false;
+        }
+        locked = true;
+        end = loopEnd;
     }
 
     uint32_t s = this->server;
@@ -1369,27 +1409,53 @@ bool audio_track_cblk_t::stepServer(uint32_t frameCount)
         }
     }
 
-    if (s >= loopEnd) {
-        ALOGW_IF(s > loopEnd, "stepServer: s %u > loopEnd %u", s, loopEnd);
+    if (s >= end) {
+        ALOGW_IF(s > end, "stepServer: s %u > loopEnd %u", s, end);
         s = loopStart;
         if (--loopCount == 0) {
-            loopEnd = UINT_MAX;
             loopStart = UINT_MAX;
+            android_atomic_release_store((int32_t)UINT_MAX, (volatile int32_t *)&loopEnd);
         }
     }
     if (s >= serverBase + this->frameCount) {
         serverBase += this->frameCount;
     }
 
-    this->server = s;
+    // publish the new index after the buffer has been read (or written)
+    android_atomic_release_store((int32_t)s, (volatile int32_t *)&this->server);
 
+    if (locked) {
+        lock.unlock();
+    }
     if (!(flags & CBLK_INVALID_MSK)) {
-        cv.signal();
+        wake();
     }
-    lock.unlock();
     return true;
 }
 
+void audio_track_cblk_t::stepServerFast(uint32_t frameCount)
+{
+    // a fast track cannot loop: the loop members are not read, whatever the
+    // client wrote in them
+    uint32_t s = this->server + frameCount;
+    if (bufferTimeoutMs == MAX_STARTUP_TIMEOUT_MS) {
+        bufferTimeoutMs = MAX_STARTUP_TIMEOUT_MS - 1;
+    }
+    if (s > this->user) {
+        ALOGW("stepServerFast occured after track reset");
+        s = this->user;
+    }
+    if (s >= serverBase + this->frameCount) {
+        serverBase += this->frameCount;
+    }
+
+    android_atomic_release_store((int32_t)s, (volatile int32_t *)&this->server);
+
+    if (!(flags & CBLK_INVALID_MSK)) {
+        wake();
+    }
+}
+
 void* audio_track_cblk_t::buffer(uint32_t offset) const
 {
     return (int8_t *)this->buffers + (offset - userBase) * this->frameSize;
@@ -1397,14 +1463,14 @@ void* audio_track_cblk_t::buffer(uint32_t offset) const
 
 uint32_t audio_track_cblk_t::framesAvailable()
 {
-    Mutex::Autolock _l(lock);
+    // only called by the producer, which also owns the loop points
     return framesAvailable_l();
 }
 
 uint32_t audio_track_cblk_t::framesAvailable_l()
 {
-    uint32_t u = this->user;
-    uint32_t s = this->server;
+    uint32_t u = (uint32_t)android_atomic_acquire_load((volatile const int32_t *)&this->user);
+    uint32_t s = (uint32_t)android_atomic_acquire_load((volatile const int32_t *)&this->server);
 
     if (flags & CBLK_DIRECTION_MSK) {
         uint32_t limit = (s < loopStart) ? s : loopStart;
@@ -1416,8 +1482,8 @@ uint32_t audio_track_cblk_t::framesAvailable_l()
 
 uint32_t audio_track_cblk_t::framesReady()
 {
-    uint32_t u = this->user;
-    uint32_t s = this->server;
+    uint32_t u = (uint32_t)android_atomic_acquire_load((volatile const int32_t *)&this->user);
+    uint32_t s = (uint32_t)android_atomic_acquire_load((volatile const int32_t *)&this->server);
 
     if (flags & CBLK_DIRECTION_MSK) {
         if (u < loopEnd) {
@@ -1440,6 +1506,13 @@ uint32_t audio_track_cblk_t::framesReady()
     }
 }
 
+uint32_t audio_track_cblk_t::framesReadyFast()
+{
+    uint32_t u = (uint32_t)android_atomic_acquire_load((volatile const int32_t *)&this->user);
+    uint32_t s = (uint32_t)android_atomic_acquire_load((volatile const int32_t *)&this->server);
+    return u - s;
+}
+
 bool audio_track_cblk_t::tryLock()
 {
     // the code below simulates lock-with-timeout
@@ -1459,6 +1532,44 @@ bool audio_track_cblk_t::tryLock()
     return true;
 }
 
+int32_t audio_track_cblk_t::prepareWait()
+{
+    // the waiting flag must be visible to the server before the client reads
+    // the server index: android_atomic_or() is a full barrier
+    return android_atomic_or(CBLK_FUTEX_WAITING, &futex) | CBLK_FUTEX_WAITING;
+}
+
+status_t audio_track_cblk_t::waitServer(int32_t sequence, uint32_t timeoutMs)
+{
+    struct timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = (timeoutMs % 1000) * 1000000;
+    // not FUTEX_WAIT_PRIVATE: the control block is shared with another process.
+    // Returns immediately with EWOULDBLOCK if wake() was called since prepareWait().
+    int ret = syscall(__NR_futex, &futex, FUTEX_WAIT, sequence, &ts, NULL, 0);
+    if (ret != 0 && errno == ETIMEDOUT) {
+        cancelWait();
+        return TIMED_OUT;
+    }
+    return NO_ERROR;
+}
+
+void audio_track_cblk_t::cancelWait()
+{
+    // otherwise every server step until the next wait would enter the kernel
+    android_atomic_and(~CBLK_FUTEX_WAITING, &futex);
+}
+
+void audio_track_cblk_t::wake()
+{
+    int32_t old = android_atomic_add(CBLK_FUTEX_STEP, &futex);
+    // only enter the kernel if the client is waiting
+    if (old & CBLK_FUTEX_WAITING) {
+        android_atomic_and(~CBLK_FUTEX_WAITING, &futex);
+        syscall(__NR_futex, &futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
 // -------------------------------------------------------------------------
 
 }; // namespace android
@@ -16,23 +16,51 @@
 
 /* A Fixed point implementation of Fast Fourier Transform (FFT). Complex numbers
  * are represented by 32-bit integers, where higher 16 bits are real part and
- * lower ones are imaginary part. Few compromises are made between efficiency,
- * accuracy, and maintainability. To make it fast, arithmetic shifts are used
- * instead of divisions, and bitwise inverses are used instead of negates. To
- * keep it small, only radix-2 Cooley-Tukey algorithm is implemented, and only
- * half of the twiddle factors are stored. Although there are still ways to make
- * it even faster or smaller, it costs too much on one of the aspects.
+ * lower ones are imaginary part. To keep the precision of 16-bit integers, each
+ * stage scales its input down, so that the transform of n points is divided by
+ * n. The complex transform is a radix-4 decimation in time of the input in bit
+ * reversed order, with a first radix-2 stage when n is not a power of 4. A
+ * radix-4 stage takes three complex multiplications for every four points
+ * where two radix-2 stages take four, and passes over the data half as many
+ * times. The scaling of a stage is folded into its multiplications, which
+ * keeps them clear of overflows. The twiddle factors of every stage are
+ * computed once, and laid out in the order the stage reads them.
+ *
+ * The stages are vectorized with NEON or SSE2, four complex numbers at a time,
+ * including the first ones where the butterflies are too small to fill a vector
+ * (those are transposed in registers). The vector code computes exactly the
+ * same values as the scalar code, which is used on other architectures and for
+ * the blocks left over.
+ *
+ * The transform of real input packs the even samples in the real parts and the
+ * odd samples in the imaginary parts, and untangles the two halves of the
+ * spectrum after the complex transform. Several windows of the same size can
+ * be transformed in one call, which runs each stage over all of them.
  */
 
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #ifdef __arm__
 #include <machine/cpu-features.h>
 #endif
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FFT_HAVE_SIMD 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FFT_HAVE_SIMD 1
+#else
+#define FFT_HAVE_SIMD 0
+#endif
+
 #define LOG_FFT_SIZE 10
 #define MAX_FFT_SIZE (1 << LOG_FFT_SIZE)
 
+/* Quarter of the twiddle factors of the largest FFT, used to untangle the
+ * transform of real input. */
 static const int32_t twiddle[MAX_FFT_SIZE / 4] = {
     0x00008000, 0xff378001, 0xfe6e8002, 0xfda58006, 0xfcdc800a, 0xfc13800f,
     0xfb4a8016, 0xfa81801e, 0xf9b88027, 0xf8ef8032, 0xf827803e, 0xf75e804b,
@@ -104,48 +132,475 @@ static inline int32_t half(int32_t a)
 #endif
 }
 
-void fixed_fft(int n, int32_t *v)
+/* Twiddle factors of the radix-4 stages. Butterfly j of the stage of length
+ * m = 4q (8 to MAX_FFT_SIZE) multiplies the transforms of the points congruent
+ * to k = 1, 2, 3 modulo 4 by exp(-2 * pi * i * j * k / m). Each factor w is stored as two pairs of 16-bit
+ * values, whose dot products with a complex number x give the real and the
+ * imaginary parts of w * x: {re(w), -im(w)} and {im(w), re(w)}. This is the
+ * operand of a multiply and pairwise add instruction. The six arrays of q
+ * factors of a stage start at 6 * (q - 2). */
+static int32_t stageTwiddles[6 * (MAX_FFT_SIZE / 2 - 2)];
+
+/* Pairs of indices swapped by the bit reversal of n = 1 << log points. */
+static uint16_t bitReversal[MAX_FFT_SIZE * 2];
+static int bitReversalStart[LOG_FFT_SIZE + 2];
+
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+static inline int32_t pack(int32_t re, int32_t im)
 {
-    int scale = LOG_FFT_SIZE, i, p, r;
+    return (re << 16) | (im & 0xFFFF);
+}
 
-    for (r = 0, i = 1; i < n; ++i) {
-        for (p = n; !(p & r); p >>= 1, r ^= p);
-        if (i < r) {
-            int32_t t = v[i];
-            v[i] = v[r];
-            v[r] = t;
+static int32_t q15(double x)
+{
+    long v = lrint(x * 32768.0);
+    return v > 32767 ? 32767 : (v < -32767 ? -32767 : v);
+}
+
+static void initTables()
+{
+    for (int q = 2; q <= MAX_FFT_SIZE / 4; q <<= 1) {
+        int32_t *w = stageTwiddles + 6 * (q - 2);
+        for (int k = 1; k <= 3; ++k) {
+            for (int j = 0; j < q; ++j) {
+                double a = -M_PI * j * k / (2 * q);
+                int32_t re = q15(cos(a));
+                int32_t im = q15(sin(a));
+                w[(2 * k - 2) * q + j] = pack(re, -im);
+                w[(2 * k - 1) * q + j] = pack(im, re);
+            }
         }
     }
 
-    for (p = 1; p < n; p <<= 1) {
-        --scale;
-
-        for (i = 0; i < n; i += p << 1) {
-            int32_t x = half(v[i]);
-            int32_t y = half(v[i + p]);
-            v[i] = x + y;
-            v[i + p] = x - y;
+    uint16_t *p = bitReversal;
+    for (int log = 0; log <= LOG_FFT_SIZE; ++log) {
+        int n = 1 << log;
+        bitReversalStart[log] = p - bitReversal;
+        for (int i = 0; i < n; ++i) {
+            int r = 0;
+            for (int b = 0; b < log; ++b) {
+                r |= ((i >> b) & 1) << (log - 1 - b);
+            }
+            if (i < r) {
+                *p++ = i;
+                *p++ = r;
+            }
         }
+    }
+    bitReversalStart[LOG_FFT_SIZE + 1] = p - bitReversal;
+}
+
+/* Operations on both halves of a complex number. The vector code below does
+ * the same operations on each 16-bit lane, so that both give the same
+ * results. */
+
+static inline int32_t sat16(int32_t a)
+{
+    if ((a >> 15) ^ (a >> 31)) {
+        a = 0x7FFF ^ (a >> 31);
+    }
+    return a;
+}
+
+static inline int32_t add(int32_t a, int32_t b)
+{
+#if __ARM_ARCH__ >= 6
+    __asm__("sadd16 %0, %0, %1" : "+r" (a) : "r" (b));
+    return a;
+#else
+    return pack((a >> 16) + (b >> 16), (int16_t)a + (int16_t)b);
+#endif
+}
+
+static inline int32_t sub(int32_t a, int32_t b)
+{
+#if __ARM_ARCH__ >= 6
+    __asm__("ssub16 %0, %0, %1" : "+r" (a) : "r" (b));
+    return a;
+#else
+    return pack((a >> 16) - (b >> 16), (int16_t)a - (int16_t)b);
+#endif
+}
+
+/* Saturated a + b and a - b. */
+static inline int32_t adds(int32_t a, int32_t b)
+{
+#if __ARM_ARCH__ >= 6
+    __asm__("qadd16 %0, %0, %1" : "+r" (a) : "r" (b));
+    return a;
+#else
+    return pack(sat16((a >> 16) + (b >> 16)), sat16((int16_t)a + (int16_t)b));
+#endif
+}
+
+static inline int32_t subs(int32_t a, int32_t b)
+{
+#if __ARM_ARCH__ >= 6
+    __asm__("qsub16 %0, %0, %1" : "+r" (a) : "r" (b));
+    return a;
+#else
+    return pack(sat16((a >> 16) - (b >> 16)), sat16((int16_t)a - (int16_t)b));
+#endif
+}
+
+/* Saturated a + (-i * b) and a - (-i * b). */
+static inline int32_t addNegI(int32_t a, int32_t b)
+{
+#if __ARM_ARCH__ >= 6
+    __asm__("qaddsubx %0, %0, %1" : "+r" (a) : "r" (b));
+    return a;
+#else
+    return pack(sat16((a >> 16) + (int16_t)b), sat16((int16_t)a - (b >> 16)));
+#endif
+}
+
+static inline int32_t subNegI(int32_t a, int32_t b)
+{
+#if __ARM_ARCH__ >= 6
+    __asm__("qsubaddx %0, %0, %1" : "+r" (a) : "r" (b));
+    return a;
+#else
+    return pack(sat16((a >> 16) - (int16_t)b), sat16((int16_t)a + (b >> 16)));
+#endif
+}
+
+/* (a + 2) >> 2 */
+static inline int32_t quarter(int32_t a)
+{
+#if __ARM_ARCH__ >= 6
+    __asm__("shadd16 %0, %0, %1" : "+r" (a) : "r" (0));
+    __asm__("shadd16 %0, %0, %1" : "+r" (a) : "r" (0x00010001));
+    return a;
+#else
+    return pack(((a >> 16) + 2) >> 2, ((int16_t)a + 2) >> 2);
+#endif
+}
+
+/* Sum of the products of the halves of a and b. */
+static inline int32_t dot(int32_t a, int32_t b)
+{
+#if __ARM_ARCH__ >= 6
+    __asm__("smuad %0, %0, %1" : "+r" (a) : "r" (b));
+    return a;
+#else
+    return (a >> 16) * (b >> 16) + (int16_t)a * (int16_t)b;
+#endif
+}
+
+/* Multiplication of x by the twiddle factor {wr, wi}, divided by 4 and
+ * rounded. */
+static inline int32_t twiddleMult(int32_t x, int32_t wr, int32_t wi)
+{
+    return pack((dot(x, wr) + 0x10000) >> 17, (dot(x, wi) + 0x10000) >> 17);
+}
+
+/* Radix-4 butterfly of a, b, c and d, the transforms of the points congruent
+ * to 0, 1, 2 and 3 modulo 4, already scaled down by 4 and multiplied by their
+ * twiddle factors. */
+static inline void butterfly4(int32_t a, int32_t b, int32_t c, int32_t d,
+        int32_t *y0, int32_t *y1, int32_t *y2, int32_t *y3)
+{
+    int32_t t0 = add(a, c);
+    int32_t t1 = sub(a, c);
+    int32_t t2 = add(b, d);
+    int32_t t3 = sub(b, d);
+    *y0 = adds(t0, t2);
+    *y1 = addNegI(t1, t3);
+    *y2 = subs(t0, t2);
+    *y3 = subNegI(t1, t3);
+}
 
-        for (r = 1; r < p; ++r) {
-            int32_t w = MAX_FFT_SIZE / 4 - (r << scale);
-            i = w >> 31;
-            w = twiddle[(w ^ i) - i] ^ (i << 16);
-            for (i = r; i < n; i += p << 1) {
-                int32_t x = half(v[i]);
-                int32_t y = mult(w, v[i + p]);
-                v[i] = x - y;
-                v[i + p] = x + y;
+#if FFT_HAVE_SIMD
+
+/* Vectors of four complex numbers, in the same layout as in memory: the
+ * imaginary part in the low 16 bits of each 32-bit lane. */
+
+#if defined(__ARM_NEON__)
+
+typedef int16x8_t vec;
+
+static inline vec load(const int32_t *p) { return vreinterpretq_s16_s32(vld1q_s32(p)); }
+static inline void store(int32_t *p, vec a) { vst1q_s32(p, vreinterpretq_s32_s16(a)); }
+static inline vec add(vec a, vec b) { return vaddq_s16(a, b); }
+static inline vec sub(vec a, vec b) { return vsubq_s16(a, b); }
+static inline vec adds(vec a, vec b) { return vqaddq_s16(a, b); }
+static inline vec subs(vec a, vec b) { return vqsubq_s16(a, b); }
+static inline vec half(vec a) { return vshrq_n_s16(a, 1); }
+static inline vec quarter(vec a) { return vrshrq_n_s16(a, 2); }
+
+/* -i * a */
+static inline vec mulNegI(vec a)
+{
+    static const int16_t sign[8] = { -1, 1, -1, 1, -1, 1, -1, 1 };
+    return vmulq_s16(vrev32q_s16(a), vld1q_s16(sign));
+}
+
+static inline int32x4_t dot(vec a, vec w)
+{
+    int32x4_t lo = vmull_s16(vget_low_s16(a), vget_low_s16(w));
+    int32x4_t hi = vmull_s16(vget_high_s16(a), vget_high_s16(w));
+    return vcombine_s32(vpadd_s32(vget_low_s32(lo), vget_high_s32(lo)),
+            vpadd_s32(vget_low_s32(hi), vget_high_s32(hi)));
+}
+
+static inline vec twiddleMult(vec a, const int32_t *wr, const int32_t *wi)
+{
+    int16x4_t re = vmovn_s32(vrshrq_n_s32(dot(a, load(wr)), 17));
+    int16x4_t im = vmovn_s32(vrshrq_n_s32(dot(a, load(wi)), 17));
+    int16x4x2_t z = vzip_s16(im, re);
+    return vcombine_s16(z.val[0], z.val[1]);
+}
+
+/* {a0, a1, b0, b1} and {a2, a3, b2, b3} */
+static inline vec lo64(vec a, vec b) { return vcombine_s16(vget_low_s16(a), vget_low_s16(b)); }
+static inline vec hi64(vec a, vec b) { return vcombine_s16(vget_high_s16(a), vget_high_s16(b)); }
+
+/* {a0, a2, b0, b2} and {a1, a3, b1, b3} */
+static inline void unzip(vec a, vec b, vec *even, vec *odd)
+{
+    int32x4x2_t t = vuzpq_s32(vreinterpretq_s32_s16(a), vreinterpretq_s32_s16(b));
+    *even = vreinterpretq_s16_s32(t.val[0]);
+    *odd = vreinterpretq_s16_s32(t.val[1]);
+}
+
+static inline void zip(vec a, vec b, vec *lo, vec *hi)
+{
+    int32x4x2_t t = vzipq_s32(vreinterpretq_s32_s16(a), vreinterpretq_s32_s16(b));
+    *lo = vreinterpretq_s16_s32(t.val[0]);
+    *hi = vreinterpretq_s16_s32(t.val[1]);
+}
+
+#else // __SSE2__
+
+typedef __m128i vec;
+
+static inline vec load(const int32_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline void store(int32_t *p, vec a) { _mm_storeu_si128((__m128i *)p, a); }
+static inline vec add(vec a, vec b) { return _mm_add_epi16(a, b); }
+static inline vec sub(vec a, vec b) { return _mm_sub_epi16(a, b); }
+static inline vec adds(vec a, vec b) { return _mm_adds_epi16(a, b); }
+static inline vec subs(vec a, vec b) { return _mm_subs_epi16(a, b); }
+static inline vec half(vec a) { return _mm_srai_epi16(a, 1); }
+static inline vec quarter(vec a)
+{
+    /* (a + 2) >> 2 without overflow */
+    return _mm_srai_epi16(_mm_sub_epi16(_mm_srai_epi16(a, 1), _mm_set1_epi16(-1)), 1);
+}
+
+/* -i * a */
+static inline vec mulNegI(vec a)
+{
+    const __m128i lo = _mm_set1_epi32(0xFFFF);
+    a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xB1), 0xB1);
+    return _mm_sub_epi16(_mm_xor_si128(a, lo), lo);
+}
+
+static inline vec twiddleMult(vec a, const int32_t *wr, const int32_t *wi)
+{
+    const __m128i round = _mm_set1_epi32(0x10000);
+    __m128i re = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(a, load(wr)), round), 17);
+    __m128i im = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(a, load(wi)), round), 17);
+    return _mm_unpacklo_epi16(_mm_packs_epi32(im, im), _mm_packs_epi32(re, re));
+}
+
+/* {a0, a1, b0, b1} and {a2, a3, b2, b3} */
+static inline vec lo64(vec a, vec b) { return _mm_unpacklo_epi64(a, b); }
+static inline vec hi64(vec a, vec b) { return _mm_unpackhi_epi64(a, b); }
+
+/* {a0, a2, b0, b2} and {a1, a3, b1, b3} */
+static inline void unzip(vec a, vec b, vec *even, vec *odd)
+{
+    a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+    b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+    *even = _mm_unpacklo_epi64(a, b);
+    *odd = _mm_unpackhi_epi64(a, b);
+}
+
+static inline void zip(vec a, vec b, vec *lo, vec *hi)
+{
+    *lo = _mm_unpacklo_epi32(a, b);
+    *hi = _mm_unpackhi_epi32(a, b);
+}
+
+#endif
+
+/* Four radix-4 butterflies, see butterfly4(). a, b, c and d are already
+ * scaled down and multiplied by their twiddle factors. */
+static inline void butterfly4(vec a, vec b, vec c, vec d,
+        vec *y0, vec *y1, vec *y2, vec *y3)
+{
+    vec t0 = add(a, c);
+    vec t1 = sub(a, c);
+    vec t2 = add(b, d);
+    vec t3 = mulNegI(sub(b, d));
+    *y0 = adds(t0, t2);
+    *y1 = adds(t1, t3);
+    *y2 = subs(t0, t2);
+    *y3 = subs(t1, t3);
+}
+
+static inline void transpose(vec *a, vec *b, vec *c, vec *d)
+{
+    vec ab0, ab1, cd0, cd1;
+    zip(*a, *b, &ab0, &ab1);
+    zip(*c, *d, &cd0, &cd1);
+    *a = lo64(ab0, cd0);
+    *b = hi64(ab0, cd0);
+    *c = lo64(ab1, cd1);
+    *d = hi64(ab1, cd1);
+}
+
+#endif // FFT_HAVE_SIMD
+
+/* Radix-4 stage over n points, in blocks of m = 4q. */
+static void radix4(int n, int32_t *v, int q)
+{
+    const int32_t *w = q >= 2 ? stageTwiddles + 6 * (q - 2) : NULL;
+    int m = q << 2;
+    int i = 0;
+
+#if FFT_HAVE_SIMD
+    if (q >= 4) {
+        for (; i < n; i += m) {
+            int32_t *p = v + i;
+            for (int j = 0; j < q; j += 4, p += 4) {
+                vec y0, y1, y2, y3;
+                butterfly4(quarter(load(p)),
+                        twiddleMult(load(p + 2 * q), w + j, w + q + j),
+                        twiddleMult(load(p + q), w + 2 * q + j, w + 3 * q + j),
+                        twiddleMult(load(p + 3 * q), w + 4 * q + j, w + 5 * q + j),
+                        &y0, &y1, &y2, &y3);
+                store(p, y0);
+                store(p + q, y1);
+                store(p + 2 * q, y2);
+                store(p + 3 * q, y3);
             }
         }
+    } else if (q == 2) {
+        /* Two blocks of 8 points at a time, {a0, a1, b0, b1}, {c0, c1, d0, d1}. */
+        int32_t tw[24];
+        for (int k = 0; k < 6; ++k) {
+            tw[4 * k] = tw[4 * k + 2] = w[2 * k];
+            tw[4 * k + 1] = tw[4 * k + 3] = w[2 * k + 1];
+        }
+        for (; i + 16 <= n; i += 16) {
+            int32_t *p = v + i;
+            vec r0 = load(p), r1 = load(p + 4), r2 = load(p + 8), r3 = load(p + 12);
+            vec y0, y1, y2, y3;
+            butterfly4(quarter(lo64(r0, r2)),
+                    twiddleMult(lo64(r1, r3), tw, tw + 4),
+                    twiddleMult(hi64(r0, r2), tw + 8, tw + 12),
+                    twiddleMult(hi64(r1, r3), tw + 16, tw + 20),
+                    &y0, &y1, &y2, &y3);
+            store(p, lo64(y0, y1));
+            store(p + 4, lo64(y2, y3));
+            store(p + 8, hi64(y0, y1));
+            store(p + 12, hi64(y2, y3));
+        }
+    } else {
+        /* Four blocks of 4 points at a time, transposed. */
+        for (; i + 16 <= n; i += 16) {
+            int32_t *p = v + i;
+            vec a = load(p), c = load(p + 4), b = load(p + 8), d = load(p + 12);
+            transpose(&a, &c, &b, &d);
+            vec y0, y1, y2, y3;
+            butterfly4(quarter(a), quarter(b), quarter(c), quarter(d), &y0, &y1, &y2, &y3);
+            transpose(&y0, &y1, &y2, &y3);
+            store(p, y0);
+            store(p + 4, y1);
+            store(p + 8, y2);
+            store(p + 12, y3);
+        }
+    }
+#endif
+
+    /* The input is in bit reversed order: the second and the third quarters
+     * of a block are the transforms of the points congruent to 2 and 1. */
+    if (q == 1) {
+        for (; i < n; i += 4) {
+            int32_t *p = v + i;
+            butterfly4(quarter(p[0]), quarter(p[2]), quarter(p[1]), quarter(p[3]),
+                    &p[0], &p[1], &p[2], &p[3]);
+        }
+    }
+    for (; i < n; i += m) {
+        int32_t *p = v + i;
+        for (int j = 0; j < q; ++j, ++p) {
+            butterfly4(quarter(p[0]),
+                    twiddleMult(p[2 * q], w[j], w[q + j]),
+                    twiddleMult(p[q], w[2 * q + j], w[3 * q + j]),
+                    twiddleMult(p[3 * q], w[4 * q + j], w[5 * q + j]),
+                    &p[0], &p[q], &p[2 * q], &p[3 * q]);
+        }
     }
 }
 
-void fixed_fft_real(int n, int32_t *v)
+/* First stage when n is not a power of 4. */
+static void radix2(int n, int32_t *v)
+{
+    int i = 0;
+#if FFT_HAVE_SIMD
+    for (; i + 8 <= n; i += 8) {
+        vec a, b;
+        unzip(load(v + i), load(v + i + 4), &a, &b);
+        a = half(a);
+        b = half(b);
+        vec lo, hi;
+        zip(add(a, b), sub(a, b), &lo, &hi);
+        store(v + i, lo);
+        store(v + i + 4, hi);
+    }
+#endif
+    for (; i < n; i += 2) {
+        int32_t a = half(v[i]);
+        int32_t b = half(v[i + 1]);
+        v[i] = add(a, b);
+        v[i + 1] = sub(a, b);
+    }
+}
+
+/* Transforms count consecutive windows of n points. */
+static void transform(int n, int count, int32_t *v)
+{
+    pthread_once(&tablesOnce, initTables);
+
+    int log = 0;
+    while ((1 << log) < n) {
+        ++log;
+    }
+    int total = n * count;
+
+    const uint16_t *swaps = bitReversal + bitReversalStart[log];
+    const uint16_t *end = bitReversal + bitReversalStart[log + 1];
+    for (int32_t *p = v; p < v + total; p += n) {
+        for (const uint16_t *s = swaps; s < end; s += 2) {
+            int32_t t = p[s[0]];
+            p[s[0]] = p[s[1]];
+            p[s[1]] = t;
+        }
+    }
+
+    int q = 1;
+    if (log & 1) {
+        radix2(total, v);
+        q = 2;
+    }
+    for (; q < n; q <<= 2) {
+        radix4(total, v, q);
+    }
+}
+
+void fixed_fft(int n, int32_t *v)
+{
+    transform(n, 1, v);
+}
+
+/* Untangles the transform of n points packing 2n real samples. */
+static void untangle(int n, int32_t *v)
 {
     int scale = LOG_FFT_SIZE, m = n >> 1, i;
 
-    fixed_fft(n, v);
     for (i = 1; i <= n; i <<= 1, --scale);
     v[0] = mult(~v[0], 0x80008000);
     v[m] = half(v[m]);
@@ -160,3 +615,19 @@ void fixed_fft_real(int n, int32_t *v)
         v[n - i] = (x + y) ^ 0xFFFF;
     }
 }
+
+void fixed_fft_real(int n, int32_t *v)
+{
+    transform(n, 1, v);
+    untangle(n, v);
+}
+
+/* Transforms count consecutive windows of 2n real samples, as
+ * fixed_fft_real() does for each of them. */
+void fixed_fft_real_windows(int n, int count, int32_t *v)
+{
+    transform(n, count, v);
+    for (int i = 0; i < count; ++i) {
+        untangle(n, v + i * n);
+    }
+}
@@ -0,0 +1,15 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Fixed point FFT accuracy test and benchmark, run on the host.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    fft_test.cpp \
+    ../fixedfft.cpp
+
+LOCAL_LDLIBS := -lpthread -lrt -lm
+
+LOCAL_MODULE:= libmedia_fft_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_EXECUTABLE)
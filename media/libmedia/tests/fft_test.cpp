@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fixed point FFT accuracy test and benchmark, run on the host.
+//
+// Compares fixed_fft() and fixed_fft_real() with a double precision DFT of
+// the same input, for the sizes used by the Visualizer: full scale noise
+// quantized to 8 bits like a waveform capture, and sine waves whose bin must
+// come out at the right level. Checks that transforming several windows in
+// one call gives the same result as one call per window, then reports the
+// time per transform.
+// Exits with a non zero status if the SNR of a transform is below kMinSnr,
+// or if a sine wave or a window is wrong.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern void fixed_fft(int n, int32_t *v);
+extern void fixed_fft_real(int n, int32_t *v);
+extern void fixed_fft_real_windows(int n, int count, int32_t *v);
+
+static const int kMaxSize = 1024;
+static const int kWindows = 8;
+static const int kTrials = 20;
+// the fixed point transforms lose about 3 dB per doubling of the size, from
+// 64 dB for the real transform of 64 points
+static const double kMinSnr = 50.0;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline int32_t pack(int re, int im) {
+    return (re << 16) | (im & 0xFFFF);
+}
+
+// 8 bit capture scaled to 16 bits, as in Visualizer::doFft()
+static int waveformSample() {
+    return ((rand() & 0xFF) - 0x80) << 8;
+}
+
+// DFT of n complex points, divided by n like the fixed point transform.
+static void dft(int n, const double *re, const double *im, double *outRe, double *outIm) {
+    for (int k = 0; k < n; k++) {
+        double sr = 0, si = 0;
+        for (int t = 0; t < n; t++) {
+            double a = -2 * M_PI * (double)k * t / n;
+            sr += re[t] * cos(a) - im[t] * sin(a);
+            si += re[t] * sin(a) + im[t] * cos(a);
+        }
+        outRe[k] = sr / n;
+        outIm[k] = si / n;
+    }
+}
+
+struct Error {
+    double signal;
+    double noise;
+    void add(double ref, int value) {
+        signal += ref * ref;
+        noise += (value - ref) * (value - ref);
+    }
+    double snr() const { return 10 * log10(signal / noise); }
+};
+
+// n points packing n complex numbers
+static void checkComplex(int n, const int32_t *in, Error *e) {
+    static double re[kMaxSize], im[kMaxSize], outRe[kMaxSize], outIm[kMaxSize];
+    int32_t v[kMaxSize];
+    for (int i = 0; i < n; i++) {
+        re[i] = in[i] >> 16;
+        im[i] = (int16_t)in[i];
+    }
+    memcpy(v, in, n * sizeof(int32_t));
+    fixed_fft(n, v);
+    dft(n, re, im, outRe, outIm);
+    for (int k = 0; k < n; k++) {
+        e->add(outRe[k], v[k] >> 16);
+        e->add(outIm[k], (int16_t)v[k]);
+    }
+}
+
+// n points packing 2n real samples: bins 0 to n - 1, with the real part of
+// bin n in place of the imaginary part of bin 0, and bin n / 2 conjugated.
+static void checkReal(int n, const int32_t *in, int32_t *out, Error *e) {
+    static double re[2 * kMaxSize], im[2 * kMaxSize], outRe[2 * kMaxSize], outIm[2 * kMaxSize];
+    for (int i = 0; i < n; i++) {
+        re[2 * i] = in[i] >> 16;
+        re[2 * i + 1] = (int16_t)in[i];
+        im[2 * i] = im[2 * i + 1] = 0;
+    }
+    memcpy(out, in, n * sizeof(int32_t));
+    fixed_fft_real(n, out);
+    dft(2 * n, re, im, outRe, outIm);
+    e->add(outRe[0], out[0] >> 16);
+    e->add(outRe[n], (int16_t)out[0]);
+    for (int k = 1; k < n; k++) {
+        e->add(outRe[k], out[k] >> 16);
+        e->add(k == n / 2 ? -outIm[k] : outIm[k], (int16_t)out[k]);
+    }
+}
+
+int main(int argc, char **argv) {
+    int result = 0;
+    int32_t in[kWindows * kMaxSize];
+    int32_t out[kWindows * kMaxSize];
+    srand(1);
+
+    printf("  size  complex dB  real dB\n");
+    for (int n = 64; n <= kMaxSize; n <<= 1) {
+        Error complexError = { 0, 0 };
+        Error realError = { 0, 0 };
+        for (int t = 0; t < kTrials; t++) {
+            for (int i = 0; i < n; i++) {
+                in[i] = pack(waveformSample(), waveformSample());
+            }
+            checkComplex(n, in, &complexError);
+            // the real transform of 2n samples is limited to 1024 samples
+            if (n < kMaxSize) {
+                checkReal(n, in, out, &realError);
+            }
+        }
+        if (n < kMaxSize) {
+            printf("  %4d  %10.1f  %7.1f\n", n, complexError.snr(), realError.snr());
+        } else {
+            printf("  %4d  %10.1f        -\n", n, complexError.snr());
+        }
+        if (complexError.snr() < kMinSnr || (n < kMaxSize && realError.snr() < kMinSnr)) {
+            printf("FAIL: SNR of %d points below %.0f dB\n", n, kMinSnr);
+            result = 1;
+        }
+    }
+
+    // a full scale sine wave in bin k comes out at half its amplitude
+    for (int n = 64; n < kMaxSize; n <<= 1) {
+        for (int k = 1; k < n; k += n / 8 + 1) {
+            for (int i = 0; i < n; i++) {
+                in[i] = pack(lrint(32767 * sin(2 * M_PI * k * 2 * i / (2 * n))),
+                        lrint(32767 * sin(2 * M_PI * k * (2 * i + 1) / (2 * n))));
+            }
+            memcpy(out, in, n * sizeof(int32_t));
+            fixed_fft_real(n, out);
+            int peak = 0;
+            int peakLevel = 0;
+            for (int b = 1; b < n; b++) {
+                int re = out[b] >> 16;
+                int im = (int16_t)out[b];
+                int level = re * re + im * im;
+                if (level > peakLevel) {
+                    peak = b;
+                    peakLevel = level;
+                }
+            }
+            double level = sqrt((double)peakLevel);
+            if (peak != k || fabs(level - 16384) > 16384 * 0.01) {
+                printf("FAIL: sine wave in bin %d of %d: peak %d level %.0f\n",
+                        k, n, peak, level);
+                result = 1;
+            }
+        }
+    }
+
+    // windows transformed together match the same windows one at a time
+    for (int n = 64; n < kMaxSize; n <<= 1) {
+        for (int i = 0; i < kWindows * n; i++) {
+            in[i] = pack(waveformSample(), waveformSample());
+        }
+        memcpy(out, in, kWindows * n * sizeof(int32_t));
+        fixed_fft_real_windows(n, kWindows, out);
+        for (int w = 0; w < kWindows; w++) {
+            fixed_fft_real(n, in + w * n);
+        }
+        if (memcmp(in, out, kWindows * n * sizeof(int32_t)) != 0) {
+            printf("FAIL: %d windows of %d points differ from single windows\n", kWindows, n);
+            result = 1;
+        }
+    }
+
+    printf("  size  real ns  real x%d ns per window\n", kWindows);
+    for (int n = 64; n < kMaxSize; n <<= 1) {
+        for (int i = 0; i < kWindows * n; i++) {
+            in[i] = pack(waveformSample(), waveformSample());
+        }
+        int loops = (1 << 22) / n;
+        int64_t start = nowNs();
+        for (int l = 0; l < loops; l++) {
+            memcpy(out, in, n * sizeof(int32_t));
+            fixed_fft_real(n, out);
+        }
+        int64_t single = nowNs() - start;
+        start = nowNs();
+        for (int l = 0; l < loops / kWindows; l++) {
+            memcpy(out, in, kWindows * n * sizeof(int32_t));
+            fixed_fft_real_windows(n, kWindows, out);
+        }
+        int64_t windows = nowNs() - start;
+        printf("  %4d  %7.0f  %7.0f\n", n, (double)single / loops,
+                (double)windows / (loops / kWindows * kWindows));
+    }
+
+    printf(result ? "FAILED\n" : "PASSED\n");
+    return result;
+}
@@ -566,6 +566,7 @@ void AwesomePlayer::reset_l() {
         mStats.mVideoHeight = -1;
         mStats.mFlags = 0;
         mStats.mTracks.clear();
+        mStats.mCachedSource.clear();
     }
 
     mWatchForAudioSeekComplete = false;
@@ -1993,6 +1994,11 @@ status_t AwesomePlayer::finishSetDataSource_l() {
                     disconnectAtHighwatermark);
 #endif
 
+            {
+                Mutex::Autolock autoLock(mStatsLock);
+                mStats.mCachedSource = mCachedSource;
+            }
+
             dataSource = mCachedSource;
         } else {
             dataSource = mConnectingDataSource;
@@ -2333,6 +2339,10 @@ status_t AwesomePlayer::dump(int fd, const Vector<String16> &args) const {
     fclose(out);
     out = NULL;
 
+    if (mStats.mCachedSource != NULL) {
+        mStats.mCachedSource->dump(fd, args);
+    }
+
     return OK;
 }
 
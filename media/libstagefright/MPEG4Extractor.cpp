@@ -42,13 +42,18 @@
 
 namespace android {
 
+struct MPEG4FragmentIndex;
+
 class MPEG4Source : public MediaSource {
 public:
     // Caller retains ownership of both "dataSource" and "sampleTable".
+    // The samples of tracks given a "fragmentIndex" are read from the
+    // movie fragments instead of the (empty) sample table.
     MPEG4Source(const sp<MetaData> &format,
                 const sp<DataSource> &dataSource,
                 int32_t timeScale,
-                const sp<SampleTable> &sampleTable);
+                const sp<SampleTable> &sampleTable,
+                const sp<MPEG4FragmentIndex> &fragmentIndex);
 
     virtual status_t start(MetaData *params = NULL);
     virtual status_t stop();
@@ -83,8 +88,44 @@ private:
 
     uint8_t *mSrcBuffer;
 
+    size_t mMaxInputSize;
+
+    // A sample of the movie fragment being played, in decoding order.
+    struct FragmentSample {
+        off64_t offset;
+        size_t size;
+        uint64_t time;  // Composition time.
+        bool isSync;
+    };
+
+    sp<MPEG4FragmentIndex> mFragmentIndex;
+    uint32_t mTrackID;
+
+    // mCurrentSampleIndex indexes these for fragmented files.
+    Vector<FragmentSample> mFragmentSamples;
+
+    // Where to look for the next movie fragment and the decoding time it
+    // starts at unless it says otherwise in 'tfdt'.
+    off64_t mNextFragmentOffset;
+    uint64_t mNextFragmentTime;
+
     size_t parseNALSize(const uint8_t *data) const;
 
+    status_t readNextFragment();
+    status_t parseFragment(off64_t offset, uint64_t size);
+    status_t parseTrackFragment(
+            const uint8_t *data, size_t size, off64_t fragmentOffset,
+            off64_t *dataEnd, size_t *numSamples,
+            Vector<FragmentSample> *samples, uint64_t *time);
+    status_t getFragmentSample(
+            off64_t *offset, size_t *size, int64_t *timeUs, bool *isSync);
+    status_t seekFragment(
+            int64_t seekTimeUs, ReadOptions::SeekMode mode,
+            int64_t *targetSampleTimeUs);
+    ssize_t findFragmentSyncSample(
+            uint64_t seekTime, ReadOptions::SeekMode mode,
+            int64_t *targetSampleTimeUs) const;
+
     MPEG4Source(const MPEG4Source &);
     MPEG4Source &operator=(const MPEG4Source &);
 };
@@ -195,6 +236,347 @@ status_t MPEG4DataSource::setCachedRange(off64_t offset, size_t size) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Reads the header of the box at "offset", a size of 0 means the box
+// extends to the end of the file. Returns ERROR_END_OF_STREAM if the
+// header can't be read (yet).
+static status_t readBoxHeader(
+        const sp<DataSource> &source, off64_t offset,
+        uint32_t *type, uint64_t *size, off64_t *data_offset) {
+    uint32_t hdr[2];
+    if (source->readAt(offset, hdr, 8) < 8) {
+        return ERROR_END_OF_STREAM;
+    }
+    *size = ntohl(hdr[0]);
+    *type = ntohl(hdr[1]);
+    *data_offset = offset + 8;
+
+    if (*size == 1) {
+        uint64_t size64;
+        if (source->readAt(offset + 8, &size64, 8) < 8) {
+            return ERROR_END_OF_STREAM;
+        }
+        *size = ntoh64(size64);
+        *data_offset += 8;
+
+        if (*size < 16) {
+            return ERROR_MALFORMED;
+        }
+    } else if (*size != 0 && *size < 8) {
+        return ERROR_MALFORMED;
+    }
+
+    return OK;
+}
+
+// Where the movie fragments of a fragmented file are, shared by the sources
+// of all its tracks. Random access points come from the segment index
+// ('sidx') preceding the first fragment or, failing that, from the movie
+// fragment random access box ('mfra') at the end of the file, which is only
+// read on the first seek.
+struct MPEG4FragmentIndex : public RefBase {
+    // The 'trex' defaults of a track.
+    struct TrackExtends {
+        uint32_t trackID;
+        uint32_t sampleDuration;
+        uint32_t sampleSize;
+        uint32_t sampleFlags;
+    };
+
+    MPEG4FragmentIndex(const sp<DataSource> &source);
+
+    void addTrackExtends(const TrackExtends &trex);
+    const TrackExtends *findTrackExtends(uint32_t trackID) const;
+
+    void setFirstFragmentOffset(off64_t offset);
+    off64_t firstFragmentOffset() const;
+
+    // Segments are only taken from the 'sidx' boxes of a single track, the
+    // fragments they point at hold the samples of all tracks.
+    bool acceptsSegmentsOf(uint32_t referenceID);
+    void addSegment(off64_t offset, int64_t timeUs);
+
+    // Finds the last fragment known to start at or before "timeUs" on the
+    // track, and an estimate of its decoding time in "timescale" units for
+    // fragments lacking 'tfdt'. Returns false if there is no index.
+    bool findFragment(
+            uint32_t trackID, uint32_t timescale, int64_t timeUs,
+            off64_t *offset, uint64_t *time);
+
+protected:
+    virtual ~MPEG4FragmentIndex();
+
+private:
+    struct Segment {
+        off64_t offset;
+        int64_t timeUs;
+    };
+
+    struct RandomAccessPoint {
+        uint64_t time;
+        off64_t offset;
+    };
+
+    // The 'tfra' entries of a track, in increasing time.
+    struct TrackRandomAccess {
+        uint32_t trackID;
+        Vector<RandomAccessPoint> points;
+    };
+
+    // The 'tfra' entries are read up to that size.
+    static const size_t kMaxRandomAccessSize = 4 * 1024 * 1024;
+
+    Mutex mLock;
+
+    sp<DataSource> mDataSource;
+    Vector<TrackExtends> mTrackExtends;
+    off64_t mFirstFragmentOffset;
+
+    bool mHasSegments;
+    uint32_t mSegmentsReferenceID;
+    Vector<Segment> mSegments;
+
+    bool mRandomAccessLoaded;
+    Vector<TrackRandomAccess> mRandomAccess;
+
+    status_t loadRandomAccess_l();
+    status_t parseTrackFragmentRandomAccess_l(
+            off64_t data_offset, uint64_t data_size);
+
+    MPEG4FragmentIndex(const MPEG4FragmentIndex &);
+    MPEG4FragmentIndex &operator=(const MPEG4FragmentIndex &);
+};
+
+MPEG4FragmentIndex::MPEG4FragmentIndex(const sp<DataSource> &source)
+    : mDataSource(source),
+      mFirstFragmentOffset(0),
+      mHasSegments(false),
+      mSegmentsReferenceID(0),
+      mRandomAccessLoaded(false) {
+}
+
+MPEG4FragmentIndex::~MPEG4FragmentIndex() {
+}
+
+void MPEG4FragmentIndex::addTrackExtends(const TrackExtends &trex) {
+    mTrackExtends.push(trex);
+}
+
+const MPEG4FragmentIndex::TrackExtends *MPEG4FragmentIndex::findTrackExtends(
+        uint32_t trackID) const {
+    for (size_t i = 0; i < mTrackExtends.size(); ++i) {
+        if (mTrackExtends[i].trackID == trackID) {
+            return &mTrackExtends[i];
+        }
+    }
+
+    return NULL;
+}
+
+void MPEG4FragmentIndex::setFirstFragmentOffset(off64_t offset) {
+    mFirstFragmentOffset = offset;
+}
+
+off64_t MPEG4FragmentIndex::firstFragmentOffset() const {
+    return mFirstFragmentOffset;
+}
+
+bool MPEG4FragmentIndex::acceptsSegmentsOf(uint32_t referenceID) {
+    if (!mHasSegments) {
+        mHasSegments = true;
+        mSegmentsReferenceID = referenceID;
+    }
+
+    return referenceID == mSegmentsReferenceID;
+}
+
+void MPEG4FragmentIndex::addSegment(off64_t offset, int64_t timeUs) {
+    Segment segment;
+    segment.offset = offset;
+    segment.timeUs = timeUs;
+    mSegments.push(segment);
+}
+
+bool MPEG4FragmentIndex::findFragment(
+        uint32_t trackID, uint32_t timescale, int64_t timeUs,
+        off64_t *offset, uint64_t *time) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (timeUs < 0) {
+        timeUs = 0;
+    }
+
+    if (!mSegments.isEmpty()) {
+        size_t left = 0;
+        size_t right = mSegments.size();
+        while (right - left > 1) {
+            size_t center = (left + right) / 2;
+            if (mSegments[center].timeUs <= timeUs) {
+                left = center;
+            } else {
+                right = center;
+            }
+        }
+
+        *offset = mSegments[left].offset;
+        *time = mSegments[left].timeUs * timescale / 1000000;
+        return true;
+    }
+
+    if (!mRandomAccessLoaded) {
+        mRandomAccessLoaded = true;
+
+        status_t err = loadRandomAccess_l();
+        if (err != OK) {
+            ALOGV("no usable movie fragment random access box (%d)", err);
+            mRandomAccess.clear();
+        }
+    }
+
+    for (size_t i = 0; i < mRandomAccess.size(); ++i) {
+        const Vector<RandomAccessPoint> &points = mRandomAccess[i].points;
+        if (mRandomAccess[i].trackID != trackID || points.isEmpty()) {
+            continue;
+        }
+
+        uint64_t t = (uint64_t)timeUs * timescale / 1000000;
+
+        size_t left = 0;
+        size_t right = points.size();
+        while (right - left > 1) {
+            size_t center = (left + right) / 2;
+            if (points[center].time <= t) {
+                left = center;
+            } else {
+                right = center;
+            }
+        }
+
+        *offset = points[left].offset;
+        *time = points[left].time;
+        return true;
+    }
+
+    return false;
+}
+
+status_t MPEG4FragmentIndex::loadRandomAccess_l() {
+    off64_t fileSize;
+    if (mDataSource->getSize(&fileSize) != OK || fileSize < 16) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    // The 'mfro' box closing the file tells where 'mfra' starts.
+    uint8_t mfro[16];
+    if (mDataSource->readAt(fileSize - 16, mfro, sizeof(mfro))
+            < (ssize_t)sizeof(mfro)) {
+        return ERROR_IO;
+    }
+
+    if (U32_AT(mfro) != 16
+            || U32_AT(&mfro[4]) != FOURCC('m', 'f', 'r', 'o')) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    uint32_t mfraSize = U32_AT(&mfro[12]);
+    if (mfraSize < 8 + 16 || mfraSize > fileSize) {
+        return ERROR_MALFORMED;
+    }
+
+    off64_t offset = fileSize - mfraSize;
+
+    uint32_t type;
+    uint64_t size;
+    off64_t data_offset;
+    status_t err = readBoxHeader(mDataSource, offset, &type, &size, &data_offset);
+    if (err != OK) {
+        return err;
+    }
+
+    if (type != FOURCC('m', 'f', 'r', 'a') || size != mfraSize) {
+        return ERROR_MALFORMED;
+    }
+
+    off64_t stop_offset = offset + size;
+    offset = data_offset;
+    while (offset < stop_offset) {
+        err = readBoxHeader(mDataSource, offset, &type, &size, &data_offset);
+        if (err != OK) {
+            return err;
+        }
+
+        if (size == 0 || offset + (off64_t)size > stop_offset) {
+            return ERROR_MALFORMED;
+        }
+
+        if (type == FOURCC('t', 'f', 'r', 'a')) {
+            err = parseTrackFragmentRandomAccess_l(
+                    data_offset, offset + size - data_offset);
+            if (err != OK) {
+                return err;
+            }
+        }
+
+        offset += size;
+    }
+
+    return OK;
+}
+
+status_t MPEG4FragmentIndex::parseTrackFragmentRandomAccess_l(
+        off64_t data_offset, uint64_t data_size) {
+    if (data_size < 16 || data_size > kMaxRandomAccessSize) {
+        return ERROR_MALFORMED;
+    }
+
+    uint8_t *data = new uint8_t[data_size];
+    if (mDataSource->readAt(data_offset, data, data_size)
+            < (ssize_t)data_size) {
+        delete[] data;
+        return ERROR_IO;
+    }
+
+    uint8_t version = data[0];
+    uint32_t lengthSizes = U32_AT(&data[8]);
+    uint32_t count = U32_AT(&data[12]);
+
+    // The time and offset, then the traf, trun and sample numbers.
+    size_t entrySize = (version == 1 ? 16 : 8)
+        + ((lengthSizes >> 4) & 3) + 1
+        + ((lengthSizes >> 2) & 3) + 1
+        + (lengthSizes & 3) + 1;
+
+    if ((uint64_t)count * entrySize > data_size - 16) {
+        delete[] data;
+        return ERROR_MALFORMED;
+    }
+
+    mRandomAccess.push();
+    TrackRandomAccess *track = &mRandomAccess.editItemAt(mRandomAccess.size() - 1);
+    track->trackID = U32_AT(&data[4]);
+    track->points.setCapacity(count);
+
+    const uint8_t *entry = &data[16];
+    for (uint32_t i = 0; i < count; ++i) {
+        RandomAccessPoint point;
+        if (version == 1) {
+            point.time = U64_AT(entry);
+            point.offset = U64_AT(&entry[8]);
+        } else {
+            point.time = U32_AT(entry);
+            point.offset = U32_AT(&entry[4]);
+        }
+        track->points.push(point);
+
+        entry += entrySize;
+    }
+
+    delete[] data;
+
+    return OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 static void hexdump(const void *_data, size_t size) {
     const uint8_t *data = (const uint8_t *)_data;
     size_t offset = 0;
@@ -269,6 +651,8 @@ MPEG4Extractor::MPEG4Extractor(const sp<DataSource> &source)
       mFirstTrack(NULL),
       mLastTrack(NULL),
       mFileMetaData(new MetaData),
+      mMovieTimescale(0),
+      mFragmentedDurationUs(0),
       mFirstSINF(NULL),
       mIsDrm(false) {
 }
@@ -682,6 +1066,18 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
         case FOURCC('u', 'd', 't', 'a'):
         case FOURCC('i', 'l', 's', 't'):
         {
+            if (chunk_type == FOURCC('m', 'o', 'o', 'f') && depth == 0
+                    && mFragmentIndex != NULL && !mIsDrm) {
+                // The sources parse the fragments as playback gets to them.
+                mFragmentIndex->setFirstFragmentOffset(*offset);
+                return UNKNOWN_ERROR;  // Return a dummy error.
+            }
+
+            if (chunk_type == FOURCC('m', 'v', 'e', 'x')
+                    && mFragmentIndex == NULL) {
+                mFragmentIndex = new MPEG4FragmentIndex(mDataSource);
+            }
+
             if (chunk_type == FOURCC('s', 't', 'b', 'l')) {
                 ALOGV("sampleTable chunk is %d bytes long.", (size_t)chunk_size);
 
@@ -759,6 +1155,15 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
             } else if (chunk_type == FOURCC('m', 'o', 'o', 'v')) {
                 mInitCheck = OK;
 
+                if (mFragmentIndex != NULL) {
+                    setupFragmentedTracks();
+
+                    // Go on to the segment index and the first fragment, if
+                    // they have been written yet.
+                    mFragmentIndex->setFirstFragmentOffset(*offset);
+                    return OK;
+                }
+
                 if (!mIsDrm) {
                     return UNKNOWN_ERROR;  // Return a dummy error.
                 } else {
@@ -1344,6 +1749,52 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
 
             mFileMetaData->setCString(kKeyDate, s.string());
 
+            uint32_t timescale;
+            off64_t timescale_offset = (header[0] == 1) ? 20 : 12;
+            if (chunk_data_size >= timescale_offset + 4
+                    && mDataSource->readAt(
+                        data_offset + timescale_offset, &timescale,
+                        sizeof(timescale)) == (ssize_t)sizeof(timescale)) {
+                mMovieTimescale = ntohl(timescale);
+            }
+
+            *offset += chunk_size;
+            break;
+        }
+
+        case FOURCC('m', 'e', 'h', 'd'):
+        {
+            status_t err;
+            if ((err = parseMovieExtendsHeader(
+                            data_offset, chunk_data_size)) != OK) {
+                return err;
+            }
+
+            *offset += chunk_size;
+            break;
+        }
+
+        case FOURCC('t', 'r', 'e', 'x'):
+        {
+            status_t err;
+            if ((err = parseTrackExtends(data_offset, chunk_data_size)) != OK) {
+                return err;
+            }
+
+            *offset += chunk_size;
+            break;
+        }
+
+        case FOURCC('s', 'i', 'd', 'x'):
+        {
+            if (depth == 0 && mFragmentIndex != NULL) {
+                status_t err;
+                if ((err = parseSegmentIndex(
+                                *offset, data_offset, chunk_data_size)) != OK) {
+                    return err;
+                }
+            }
+
             *offset += chunk_size;
             break;
         }
@@ -1536,46 +1987,223 @@ status_t MPEG4Extractor::parseTrackHeader(
     return OK;
 }
 
-status_t MPEG4Extractor::parseMetaData(off64_t offset, size_t size) {
-    if (size < 4) {
+status_t MPEG4Extractor::parseTrackExtends(
+        off64_t data_offset, off64_t data_size) {
+    if (mFragmentIndex == NULL || data_size < 24) {
         return ERROR_MALFORMED;
     }
 
-    uint8_t *buffer = new uint8_t[size + 1];
+    uint8_t buffer[24];
     if (mDataSource->readAt(
-                offset, buffer, size) != (ssize_t)size) {
-        delete[] buffer;
-        buffer = NULL;
-
+                data_offset, buffer, sizeof(buffer)) < (ssize_t)sizeof(buffer)) {
         return ERROR_IO;
     }
 
-    uint32_t flags = U32_AT(buffer);
+    MPEG4FragmentIndex::TrackExtends trex;
+    trex.trackID = U32_AT(&buffer[4]);
+    trex.sampleDuration = U32_AT(&buffer[12]);
+    trex.sampleSize = U32_AT(&buffer[16]);
+    trex.sampleFlags = U32_AT(&buffer[20]);
 
-    uint32_t metadataKey = 0;
-    switch (mPath[4]) {
-        case FOURCC(0xa9, 'a', 'l', 'b'):
-        {
-            metadataKey = kKeyAlbum;
-            break;
-        }
-        case FOURCC(0xa9, 'A', 'R', 'T'):
-        {
-            metadataKey = kKeyArtist;
-            break;
-        }
-        case FOURCC('a', 'A', 'R', 'T'):
-        {
-            metadataKey = kKeyAlbumArtist;
-            break;
+    mFragmentIndex->addTrackExtends(trex);
+
+    return OK;
+}
+
+status_t MPEG4Extractor::parseMovieExtendsHeader(
+        off64_t data_offset, off64_t data_size) {
+    if (data_size < 8) {
+        return ERROR_MALFORMED;
+    }
+
+    uint8_t buffer[12];
+    size_t size = data_size < 12 ? 8 : 12;
+    if (mDataSource->readAt(data_offset, buffer, size) < (ssize_t)size) {
+        return ERROR_IO;
+    }
+
+    uint64_t duration;
+    if (buffer[0] == 1) {
+        if (size < 12) {
+            return ERROR_MALFORMED;
         }
-        case FOURCC(0xa9, 'd', 'a', 'y'):
-        {
-            metadataKey = kKeyYear;
-            break;
+        duration = U64_AT(&buffer[4]);
+    } else {
+        duration = U32_AT(&buffer[4]);
+    }
+
+    if (mMovieTimescale > 0) {
+        mFragmentedDurationUs = duration * 1000000 / mMovieTimescale;
+    }
+
+    return OK;
+}
+
+status_t MPEG4Extractor::parseSegmentIndex(
+        off64_t offset, off64_t data_offset, off64_t data_size) {
+    if (data_size < 24) {
+        return ERROR_MALFORMED;
+    }
+
+    uint8_t header[32];
+    size_t headerSize = data_size < 32 ? 24 : 32;
+    if (mDataSource->readAt(data_offset, header, headerSize)
+            < (ssize_t)headerSize) {
+        return ERROR_IO;
+    }
+
+    uint32_t referenceID = U32_AT(&header[4]);
+    uint32_t timescale = U32_AT(&header[8]);
+
+    uint64_t earliestTime;
+    uint64_t firstOffset;
+    if (header[0] == 1) {
+        if (headerSize < 32) {
+            return ERROR_MALFORMED;
         }
-        case FOURCC(0xa9, 'n', 'a', 'm'):
-        {
+        earliestTime = U64_AT(&header[12]);
+        firstOffset = U64_AT(&header[20]);
+    } else {
+        headerSize = 24;
+        earliestTime = U32_AT(&header[12]);
+        firstOffset = U32_AT(&header[16]);
+    }
+
+    uint16_t count = U16_AT(&header[headerSize - 2]);
+
+    if (timescale == 0 || data_size < headerSize + count * 12) {
+        return ERROR_MALFORMED;
+    }
+
+    if (!mFragmentIndex->acceptsSegmentsOf(referenceID)) {
+        return OK;
+    }
+
+    uint8_t *references = new uint8_t[count * 12];
+    if (mDataSource->readAt(
+                data_offset + headerSize, references, count * 12)
+            < (ssize_t)count * 12) {
+        delete[] references;
+        return ERROR_IO;
+    }
+
+    // The references are to the segments following the 'sidx' box.
+    off64_t segmentOffset = data_offset + data_size + firstOffset;
+    uint64_t time = earliestTime;
+    for (uint16_t i = 0; i < count; ++i) {
+        uint32_t reference = U32_AT(&references[i * 12]);
+        uint32_t duration = U32_AT(&references[i * 12 + 4]);
+
+        // Only segments of movie fragments are indexed, references to
+        // further 'sidx' boxes are passed over.
+        if (!(reference & 0x80000000)) {
+            mFragmentIndex->addSegment(
+                    segmentOffset, time * 1000000 / timescale);
+        }
+
+        segmentOffset += reference & 0x7fffffff;
+        time += duration;
+    }
+
+    delete[] references;
+
+    // The fragmented tracks without a duration last as long as the index.
+    int64_t durationUs = time * 1000000 / timescale;
+    for (Track *track = mFirstTrack; track != NULL; track = track->next) {
+        int64_t trackDurationUs;
+        if (track->sampleTable->countSamples() == 0
+                && (!track->meta->findInt64(kKeyDuration, &trackDurationUs)
+                    || trackDurationUs < durationUs)) {
+            track->meta->setInt64(kKeyDuration, durationUs);
+        }
+    }
+
+    return OK;
+}
+
+void MPEG4Extractor::setupFragmentedTracks() {
+    for (Track *track = mFirstTrack; track != NULL; track = track->next) {
+        if (track->sampleTable->countSamples() > 0) {
+            continue;
+        }
+
+        int64_t durationUs;
+        if (mFragmentedDurationUs > 0
+                && (!track->meta->findInt64(kKeyDuration, &durationUs)
+                    || durationUs == 0)) {
+            track->meta->setInt64(kKeyDuration, mFragmentedDurationUs);
+        }
+
+        // There is no 'stsz' to find the largest sample in, assume video
+        // samples no larger than an uncompressed frame and audio or text
+        // samples no larger than 64KB.
+        int32_t maxSize = 64 * 1024;
+
+        const char *mime;
+        CHECK(track->meta->findCString(kKeyMIMEType, &mime));
+
+        int32_t width, height;
+        if (!strncasecmp("video/", mime, 6)
+                && track->meta->findInt32(kKeyWidth, &width)
+                && track->meta->findInt32(kKeyHeight, &height)) {
+            maxSize = width * height * 3 / 2;
+        }
+
+        int32_t trackID;
+        if (track->meta->findInt32(kKeyTrackID, &trackID)) {
+            const MPEG4FragmentIndex::TrackExtends *trex =
+                mFragmentIndex->findTrackExtends(trackID);
+            if (trex != NULL && trex->sampleSize > (uint32_t)maxSize
+                    && trex->sampleSize < 64 * 1024 * 1024) {
+                maxSize = trex->sampleSize;
+            }
+        }
+
+        // See the 'stsz' case in parseChunk().
+        track->meta->setInt32(kKeyMaxInputSize, maxSize + 10 * 2);
+    }
+}
+
+status_t MPEG4Extractor::parseMetaData(off64_t offset, size_t size) {
+    if (size < 4) {
+        return ERROR_MALFORMED;
+    }
+
+    uint8_t *buffer = new uint8_t[size + 1];
+    if (mDataSource->readAt(
+                offset, buffer, size) != (ssize_t)size) {
+        delete[] buffer;
+        buffer = NULL;
+
+        return ERROR_IO;
+    }
+
+    uint32_t flags = U32_AT(buffer);
+
+    uint32_t metadataKey = 0;
+    switch (mPath[4]) {
+        case FOURCC(0xa9, 'a', 'l', 'b'):
+        {
+            metadataKey = kKeyAlbum;
+            break;
+        }
+        case FOURCC(0xa9, 'A', 'R', 'T'):
+        {
+            metadataKey = kKeyArtist;
+            break;
+        }
+        case FOURCC('a', 'A', 'R', 'T'):
+        {
+            metadataKey = kKeyAlbumArtist;
+            break;
+        }
+        case FOURCC(0xa9, 'd', 'a', 'y'):
+        {
+            metadataKey = kKeyYear;
+            break;
+        }
+        case FOURCC(0xa9, 'n', 'a', 'm'):
+        {
             metadataKey = kKeyTitle;
             break;
         }
@@ -1698,8 +2326,17 @@ sp<MediaSource> MPEG4Extractor::getTrack(size_t index) {
         return NULL;
     }
 
+    // Tracks with samples in 'moov' don't look at the fragments.
+    sp<MPEG4FragmentIndex> fragmentIndex;
+    int32_t trackID;
+    if (mFragmentIndex != NULL && track->sampleTable->countSamples() == 0
+            && track->meta->findInt32(kKeyTrackID, &trackID)) {
+        fragmentIndex = mFragmentIndex;
+    }
+
     return new MPEG4Source(
-            track->meta, mDataSource, track->timescale, track->sampleTable);
+            track->meta, mDataSource, track->timescale, track->sampleTable,
+            fragmentIndex);
 }
 
 // static
@@ -1845,7 +2482,8 @@ MPEG4Source::MPEG4Source(
         const sp<MetaData> &format,
         const sp<DataSource> &dataSource,
         int32_t timeScale,
-        const sp<SampleTable> &sampleTable)
+        const sp<SampleTable> &sampleTable,
+        const sp<MPEG4FragmentIndex> &fragmentIndex)
     : mFormat(format),
       mDataSource(dataSource),
       mTimescale(timeScale),
@@ -1857,11 +2495,23 @@ MPEG4Source::MPEG4Source(
       mGroup(NULL),
       mBuffer(NULL),
       mWantsNALFragments(false),
-      mSrcBuffer(NULL) {
+      mSrcBuffer(NULL),
+      mMaxInputSize(0),
+      mFragmentIndex(fragmentIndex),
+      mTrackID(0),
+      mNextFragmentOffset(0),
+      mNextFragmentTime(0) {
     const char *mime;
     bool success = mFormat->findCString(kKeyMIMEType, &mime);
     CHECK(success);
 
+    if (mFragmentIndex != NULL) {
+        int32_t trackID;
+        CHECK(mFormat->findInt32(kKeyTrackID, &trackID));
+        mTrackID = trackID;
+        mNextFragmentOffset = mFragmentIndex->firstFragmentOffset();
+    }
+
     mIsAVC = !strcasecmp(mime, MEDIA_MIMETYPE_VIDEO_AVC);
 
     if (mIsAVC) {
@@ -1907,6 +2557,7 @@ status_t MPEG4Source::start(MetaData *params) {
     mGroup->add_buffer(new MediaBuffer(max_size));
 
     mSrcBuffer = new uint8_t[max_size];
+    mMaxInputSize = max_size;
 
     mStarted = true;
 
@@ -1932,6 +2583,12 @@ status_t MPEG4Source::stop() {
     mStarted = false;
     mCurrentSampleIndex = 0;
 
+    if (mFragmentIndex != NULL) {
+        mFragmentSamples.clear();
+        mNextFragmentOffset = mFragmentIndex->firstFragmentOffset();
+        mNextFragmentTime = 0;
+    }
+
     return OK;
 }
 
@@ -1972,7 +2629,18 @@ status_t MPEG4Source::read(
 
     int64_t seekTimeUs;
     ReadOptions::SeekMode mode;
-    if (options && options->getSeekTo(&seekTimeUs, &mode)) {
+    if (mFragmentIndex != NULL
+            && options && options->getSeekTo(&seekTimeUs, &mode)) {
+        status_t err = seekFragment(seekTimeUs, mode, &targetSampleTimeUs);
+        if (err != OK) {
+            return err;
+        }
+
+        if (mBuffer != NULL) {
+            mBuffer->release();
+            mBuffer = NULL;
+        }
+    } else if (options && options->getSeekTo(&seekTimeUs, &mode)) {
         uint32_t findFlags = 0;
         switch (mode) {
             case ReadOptions::SEEK_PREVIOUS_SYNC:
@@ -2054,14 +2722,21 @@ status_t MPEG4Source::read(
     off64_t offset;
     size_t size;
     uint32_t cts;
+    int64_t sampleTimeUs;
     bool isSyncSample;
     bool newBuffer = false;
     if (mBuffer == NULL) {
         newBuffer = true;
 
-        status_t err =
-            mSampleTable->getMetaDataForSample(
+        status_t err;
+        if (mFragmentIndex != NULL) {
+            err = getFragmentSample(
+                    &offset, &size, &sampleTimeUs, &isSyncSample);
+        } else {
+            err = mSampleTable->getMetaDataForSample(
                     mCurrentSampleIndex, &offset, &size, &cts, &isSyncSample);
+            sampleTimeUs = ((int64_t)cts * 1000000) / mTimescale;
+        }
 
         if (err != OK) {
             return err;
@@ -2091,7 +2766,7 @@ status_t MPEG4Source::read(
             mBuffer->set_range(0, size);
             mBuffer->meta_data()->clear();
             mBuffer->meta_data()->setInt64(
-                    kKeyTime, ((int64_t)cts * 1000000) / mTimescale);
+                    kKeyTime, sampleTimeUs);
 
             if (targetSampleTimeUs >= 0) {
                 mBuffer->meta_data()->setInt64(
@@ -2213,7 +2888,7 @@ status_t MPEG4Source::read(
 
         mBuffer->meta_data()->clear();
         mBuffer->meta_data()->setInt64(
-                kKeyTime, ((int64_t)cts * 1000000) / mTimescale);
+                kKeyTime, sampleTimeUs);
 
         if (targetSampleTimeUs >= 0) {
             mBuffer->meta_data()->setInt64(
@@ -2233,6 +2908,553 @@ status_t MPEG4Source::read(
     }
 }
 
+// Movie fragment headers ('moof') are read up to that size.
+static const size_t kMaxFragmentHeaderSize = 16 * 1024 * 1024;
+
+// Samples of all the tracks in a movie fragment. A 'trun' without per
+// sample fields takes no room in the header whatever its sample count, so
+// the header size alone does not bound it.
+static const size_t kMaxFragmentSamples = 256 * 1024;
+
+static uint64_t absDiff(uint64_t a, uint64_t b) {
+    return a > b ? a - b : b - a;
+}
+
+status_t MPEG4Source::readNextFragment() {
+    for (;;) {
+        uint32_t type;
+        uint64_t size;
+        off64_t data_offset;
+        status_t err = readBoxHeader(
+                mDataSource, mNextFragmentOffset, &type, &size, &data_offset);
+
+        if (err != OK) {
+            // Fragments still being written are picked up by a later call.
+            return err;
+        }
+
+        if (size == 0) {
+            // The last box of the file.
+            return ERROR_END_OF_STREAM;
+        }
+
+        if (type == FOURCC('m', 'o', 'o', 'f')) {
+            err = parseFragment(mNextFragmentOffset, size);
+            if (err != OK) {
+                return err;
+            }
+        }
+
+        mNextFragmentOffset += size;
+
+        if (type == FOURCC('m', 'o', 'o', 'f') && !mFragmentSamples.isEmpty()) {
+            return OK;
+        }
+    }
+}
+
+status_t MPEG4Source::parseFragment(off64_t offset, uint64_t size) {
+    if (size > kMaxFragmentHeaderSize) {
+        ALOGE("movie fragment header of %lld bytes is too large", size);
+        return ERROR_MALFORMED;
+    }
+
+    uint8_t *data = new uint8_t[size];
+    if (mDataSource->readAt(offset, data, size) < (ssize_t)size) {
+        delete[] data;
+        return ERROR_END_OF_STREAM;
+    }
+
+    Vector<FragmentSample> samples;
+    uint64_t time = mNextFragmentTime;
+
+    // Track fragments without an explicit base offset start where the
+    // data of the previous one ends, the first one at the 'moof' box.
+    off64_t dataEnd = offset;
+    size_t numSamples = 0;
+
+    status_t err = OK;
+    size_t pos = 8;
+    while (err == OK && pos + 8 <= size) {
+        uint32_t boxSize = U32_AT(&data[pos]);
+        uint32_t boxType = U32_AT(&data[pos + 4]);
+
+        if (boxSize < 8 || boxSize > size - pos) {
+            err = ERROR_MALFORMED;
+            break;
+        }
+
+        if (boxType == FOURCC('t', 'r', 'a', 'f')) {
+            err = parseTrackFragment(
+                    &data[pos + 8], boxSize - 8, offset,
+                    &dataEnd, &numSamples, &samples, &time);
+        }
+
+        pos += boxSize;
+    }
+
+    delete[] data;
+
+    if (err != OK) {
+        return err;
+    }
+
+    if (!samples.isEmpty()) {
+        // Don't play a fragment until all its samples are in.
+        off64_t samplesEnd = 0;
+        for (size_t i = 0; i < samples.size(); ++i) {
+            off64_t end = samples[i].offset + samples[i].size;
+            if (end > samplesEnd) {
+                samplesEnd = end;
+            }
+        }
+
+        uint8_t x;
+        if (samplesEnd > 0
+                && mDataSource->readAt(samplesEnd - 1, &x, 1) < 1) {
+            return ERROR_END_OF_STREAM;
+        }
+    }
+
+    mFragmentSamples = samples;
+    mNextFragmentTime = time;
+    mCurrentSampleIndex = 0;
+
+    return OK;
+}
+
+status_t MPEG4Source::parseTrackFragment(
+        const uint8_t *data, size_t size, off64_t fragmentOffset,
+        off64_t *dataEnd, size_t *numSamples,
+        Vector<FragmentSample> *samples, uint64_t *time) {
+    bool haveHeader = false;
+    bool isOurs = false;
+    off64_t baseOffset = 0;
+    off64_t nextOffset = 0;
+    uint32_t defaultDuration = 0;
+    uint32_t defaultSize = 0;
+    uint32_t defaultFlags = 0;
+
+    size_t pos = 0;
+    while (pos + 8 <= size) {
+        uint32_t boxSize = U32_AT(&data[pos]);
+        uint32_t boxType = U32_AT(&data[pos + 4]);
+
+        if (boxSize < 8 || boxSize > size - pos) {
+            return ERROR_MALFORMED;
+        }
+
+        const uint8_t *box = &data[pos + 8];
+        size_t boxDataSize = boxSize - 8;
+        pos += boxSize;
+
+        switch (boxType) {
+            case FOURCC('t', 'f', 'h', 'd'):
+            {
+                if (boxDataSize < 8) {
+                    return ERROR_MALFORMED;
+                }
+
+                uint32_t flags = U32_AT(box) & 0xffffff;
+                uint32_t trackID = U32_AT(&box[4]);
+
+                const MPEG4FragmentIndex::TrackExtends *trex =
+                    mFragmentIndex->findTrackExtends(trackID);
+                if (trex != NULL) {
+                    defaultDuration = trex->sampleDuration;
+                    defaultSize = trex->sampleSize;
+                    defaultFlags = trex->sampleFlags;
+                }
+
+                size_t needed = 8;
+                if (flags & 0x01) needed += 8;
+                if (flags & 0x02) needed += 4;
+                if (flags & 0x08) needed += 4;
+                if (flags & 0x10) needed += 4;
+                if (flags & 0x20) needed += 4;
+                if (boxDataSize < needed) {
+                    return ERROR_MALFORMED;
+                }
+
+                size_t offset = 8;
+                if (flags & 0x01) {
+                    baseOffset = U64_AT(&box[offset]);
+                    offset += 8;
+                } else if (flags & 0x20000) {
+                    // default-base-is-moof
+                    baseOffset = fragmentOffset;
+                } else {
+                    baseOffset = *dataEnd;
+                }
+
+                if (flags & 0x02) {
+                    // sample_description_index, a single one is supported.
+                    offset += 4;
+                }
+
+                if (flags & 0x08) {
+                    defaultDuration = U32_AT(&box[offset]);
+                    offset += 4;
+                }
+
+                if (flags & 0x10) {
+                    defaultSize = U32_AT(&box[offset]);
+                    offset += 4;
+                }
+
+                if (flags & 0x20) {
+                    defaultFlags = U32_AT(&box[offset]);
+                    offset += 4;
+                }
+
+                haveHeader = true;
+                isOurs = (trackID == mTrackID);
+                nextOffset = baseOffset;
+                break;
+            }
+
+            case FOURCC('t', 'f', 'd', 't'):
+            {
+                if (!haveHeader || boxDataSize < 8) {
+                    return ERROR_MALFORMED;
+                }
+
+                if (!isOurs) {
+                    break;
+                }
+
+                if (box[0] == 1) {
+                    if (boxDataSize < 12) {
+                        return ERROR_MALFORMED;
+                    }
+                    *time = U64_AT(&box[4]);
+                } else {
+                    *time = U32_AT(&box[4]);
+                }
+                break;
+            }
+
+            case FOURCC('t', 'r', 'u', 'n'):
+            {
+                if (!haveHeader || boxDataSize < 8) {
+                    return ERROR_MALFORMED;
+                }
+
+                uint32_t flags = U32_AT(box) & 0xffffff;
+                uint32_t count = U32_AT(&box[4]);
+
+                size_t offset = 8;
+                if (flags & 0x01) {
+                    if (boxDataSize < offset + 4) {
+                        return ERROR_MALFORMED;
+                    }
+                    nextOffset = baseOffset + (int32_t)U32_AT(&box[offset]);
+                    offset += 4;
+                }
+
+                bool hasFirstFlags = false;
+                uint32_t firstFlags = 0;
+                if (flags & 0x04) {
+                    if (boxDataSize < offset + 4) {
+                        return ERROR_MALFORMED;
+                    }
+                    hasFirstFlags = true;
+                    firstFlags = U32_AT(&box[offset]);
+                    offset += 4;
+                }
+
+                size_t entrySize = 0;
+                if (flags & 0x100) entrySize += 4;
+                if (flags & 0x200) entrySize += 4;
+                if (flags & 0x400) entrySize += 4;
+                if (flags & 0x800) entrySize += 4;
+
+                if ((uint64_t)count * entrySize > boxDataSize - offset) {
+                    return ERROR_MALFORMED;
+                }
+
+                if (count > kMaxFragmentSamples - *numSamples) {
+                    ALOGE("movie fragment has more than %d samples",
+                          kMaxFragmentSamples);
+                    return ERROR_MALFORMED;
+                }
+                *numSamples += count;
+
+                if (isOurs) {
+                    samples->setCapacity(samples->size() + count);
+                }
+
+                for (uint32_t i = 0; i < count; ++i) {
+                    uint32_t duration = defaultDuration;
+                    uint32_t sampleSize = defaultSize;
+                    uint32_t sampleFlags =
+                        (i == 0 && hasFirstFlags) ? firstFlags : defaultFlags;
+                    int32_t compositionOffset = 0;
+
+                    if (flags & 0x100) {
+                        duration = U32_AT(&box[offset]);
+                        offset += 4;
+                    }
+                    if (flags & 0x200) {
+                        sampleSize = U32_AT(&box[offset]);
+                        offset += 4;
+                    }
+                    if (flags & 0x400) {
+                        sampleFlags = U32_AT(&box[offset]);
+                        offset += 4;
+                    }
+                    if (flags & 0x800) {
+                        // Signed in version 1, and in practice in version 0.
+                        compositionOffset = (int32_t)U32_AT(&box[offset]);
+                        offset += 4;
+                    }
+
+                    if (isOurs) {
+                        FragmentSample sample;
+                        sample.offset = nextOffset;
+                        sample.size = sampleSize;
+                        sample.time = *time;
+                        if (compositionOffset >= 0
+                                || (uint64_t)-compositionOffset <= *time) {
+                            sample.time += compositionOffset;
+                        } else {
+                            sample.time = 0;
+                        }
+                        // sample_is_non_sync_sample
+                        sample.isSync = !(sampleFlags & 0x10000);
+                        samples->push(sample);
+
+                        *time += duration;
+                    }
+
+                    nextOffset += sampleSize;
+                }
+
+                if (nextOffset > *dataEnd) {
+                    *dataEnd = nextOffset;
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    return OK;
+}
+
+status_t MPEG4Source::getFragmentSample(
+        off64_t *offset, size_t *size, int64_t *timeUs, bool *isSync) {
+    if (mCurrentSampleIndex >= mFragmentSamples.size()) {
+        status_t err = readNextFragment();
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    const FragmentSample &sample = mFragmentSamples[mCurrentSampleIndex];
+
+    if (sample.size > mMaxInputSize) {
+        ALOGE("sample of %d bytes exceeds the buffer size of %d bytes",
+              sample.size, mMaxInputSize);
+        return ERROR_MALFORMED;
+    }
+
+    *offset = sample.offset;
+    *size = sample.size;
+    *timeUs = (int64_t)(sample.time * 1000000 / mTimescale);
+    *isSync = sample.isSync;
+
+    return OK;
+}
+
+status_t MPEG4Source::seekFragment(
+        int64_t seekTimeUs, ReadOptions::SeekMode mode,
+        int64_t *targetSampleTimeUs) {
+    if (seekTimeUs < 0) {
+        seekTimeUs = 0;
+    }
+
+    uint64_t seekTime = (uint64_t)seekTimeUs * mTimescale / 1000000;
+
+    // Seeks within the fragment being played need no parsing.
+    bool inCurrentFragment =
+        !mFragmentSamples.isEmpty()
+            && mFragmentSamples[0].time <= seekTime
+            && seekTime < mNextFragmentTime;
+
+    if (!inCurrentFragment) {
+        off64_t offset;
+        uint64_t time;
+        if (!mFragmentIndex->findFragment(
+                    mTrackID, mTimescale, seekTimeUs, &offset, &time)) {
+            // Without an index the fragments are walked from the first one.
+            offset = mFragmentIndex->firstFragmentOffset();
+            time = 0;
+        }
+
+        mFragmentSamples.clear();
+        mCurrentSampleIndex = 0;
+        mNextFragmentOffset = offset;
+        mNextFragmentTime = time;
+    }
+
+    for (;;) {
+        if (mFragmentSamples.isEmpty()) {
+            status_t err = readNextFragment();
+            if (err != OK) {
+                // Seeking past the end ends the stream, see read().
+                return err;
+            }
+        }
+
+        if (mode != ReadOptions::SEEK_NEXT_SYNC && seekTime >= mNextFragmentTime) {
+            // In a later fragment, unless this is the last one.
+            Vector<FragmentSample> samples = mFragmentSamples;
+
+            mFragmentSamples.clear();
+            status_t err = readNextFragment();
+            if (err == OK) {
+                continue;
+            } else if (err != ERROR_END_OF_STREAM) {
+                return err;
+            }
+
+            mFragmentSamples = samples;
+        }
+
+        ssize_t index = findFragmentSyncSample(seekTime, mode, targetSampleTimeUs);
+
+        if (mode == ReadOptions::SEEK_CLOSEST_SYNC && index >= 0
+                && mFragmentSamples[index].time < seekTime) {
+            // The first sync sample of the next fragment may be closer.
+            bool isLast = true;
+            for (size_t i = index + 1; i < mFragmentSamples.size(); ++i) {
+                if (mFragmentSamples[i].isSync) {
+                    isLast = false;
+                    break;
+                }
+            }
+
+            if (isLast) {
+                Vector<FragmentSample> samples = mFragmentSamples;
+                off64_t nextOffset = mNextFragmentOffset;
+                uint64_t nextTime = mNextFragmentTime;
+                uint64_t before = seekTime - samples[index].time;
+
+                mFragmentSamples.clear();
+                if (readNextFragment() == OK) {
+                    for (size_t i = 0; i < mFragmentSamples.size(); ++i) {
+                        if (mFragmentSamples[i].isSync) {
+                            if (absDiff(mFragmentSamples[i].time, seekTime)
+                                    < before) {
+                                mCurrentSampleIndex = i;
+                                return OK;
+                            }
+                            break;
+                        }
+                    }
+                }
+
+                mFragmentSamples = samples;
+                mNextFragmentOffset = nextOffset;
+                mNextFragmentTime = nextTime;
+            }
+        }
+
+        if (index >= 0) {
+            mCurrentSampleIndex = index;
+            return OK;
+        }
+
+        // No (suitable) sync sample in this fragment.
+        mFragmentSamples.clear();
+    }
+}
+
+ssize_t MPEG4Source::findFragmentSyncSample(
+        uint64_t seekTime, ReadOptions::SeekMode mode,
+        int64_t *targetSampleTimeUs) const {
+    ssize_t before = -1;
+    ssize_t after = -1;
+    ssize_t closest = -1;
+    for (size_t i = 0; i < mFragmentSamples.size(); ++i) {
+        const FragmentSample &sample = mFragmentSamples[i];
+
+        if (closest < 0
+                || absDiff(sample.time, seekTime)
+                    < absDiff(mFragmentSamples[closest].time, seekTime)) {
+            closest = i;
+        }
+
+        if (!sample.isSync) {
+            continue;
+        }
+
+        if (sample.time <= seekTime
+                && (before < 0 || sample.time > mFragmentSamples[before].time)) {
+            before = i;
+        }
+
+        if (sample.time >= seekTime
+                && (after < 0 || sample.time < mFragmentSamples[after].time)) {
+            after = i;
+        }
+    }
+
+    switch (mode) {
+        case ReadOptions::SEEK_PREVIOUS_SYNC:
+            return before >= 0 ? before : after;
+
+        case ReadOptions::SEEK_NEXT_SYNC:
+            return after;
+
+        case ReadOptions::SEEK_CLOSEST_SYNC:
+            if (before >= 0 && after >= 0) {
+                return absDiff(mFragmentSamples[before].time, seekTime)
+                        <= absDiff(mFragmentSamples[after].time, seekTime)
+                    ? before : after;
+            }
+            return before >= 0 ? before : after;
+
+        case ReadOptions::SEEK_CLOSEST:
+        {
+            if (closest < 0) {
+                return -1;
+            }
+
+            // The closest sample is decoded from the sync sample preceding
+            // it in decoding order.
+            ssize_t sync = -1;
+            for (ssize_t i = closest; i >= 0; --i) {
+                if (mFragmentSamples[i].isSync) {
+                    sync = i;
+                    break;
+                }
+            }
+
+            if (sync < 0) {
+                sync = after;
+            }
+
+            if (sync < 0) {
+                return -1;
+            }
+
+            *targetSampleTimeUs =
+                mFragmentSamples[closest].time * 1000000 / mTimescale;
+            return sync;
+        }
+
+        default:
+            CHECK(!"Should not be here.");
+            break;
+    }
+
+    return -1;
+}
+
 MPEG4Extractor::Track *MPEG4Extractor::findTrackByMimePrefix(
         const char *mimePrefix) {
     for (Track *track = mFirstTrack; track != NULL; track = track->next) {
@@ -35,7 +35,9 @@
 #include <cutils/properties.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include "include/ESDS.h"
@@ -66,9 +68,20 @@ public:
     bool isAudio() const { return mIsAudio; }
     bool isMPEG4() const { return mIsMPEG4; }
     void addChunkOffset(off64_t offset);
+    void shiftChunkOffsets(off64_t distance);
     int32_t getTrackId() const { return mTrackId; }
     status_t dump(int fd, const Vector<String16>& args) const;
 
+    // Upper bound of the 'trak' box size for a recording of the given
+    // duration.
+    int64_t estimateTrakBoxSizeBytes(int64_t durationUs) const;
+
+    // Fragmented files. Returns the time the fragment ends at.
+    int64_t writeMoofBox(
+            const Chunk &chunk, uint32_t sequenceNumber, off64_t moofOffset);
+    void writeTrexBox();
+    void writeTfraBox();
+
 private:
     MPEG4Writer *mOwner;
     sp<MetaData> mMeta;
@@ -101,6 +114,24 @@ private:
 
     List<MediaBuffer *> mChunkSamples;
 
+    // The track fragment being collected, for fragmented files
+    List<FragmentSample> mFragmentSamples;
+    int64_t             mFragmentStartTimeUs;
+    int64_t             mFragmentDecodingTimeTicks;
+    int64_t             mLastDecodingTimeTicks;
+    uint32_t            mLastSampleDurationTicks;
+
+    struct TfraTableEntry {
+
+        TfraTableEntry(int64_t time, off64_t offset)
+            : decodingTime(time), moofOffset(offset) {}
+
+        int64_t decodingTime;  // time scale based
+        off64_t moofOffset;
+    };
+    size_t              mNumTfraTableEntries;
+    List<TfraTableEntry> mTfraTableEntries;
+
     size_t              mNumStcoTableEntries;
     List<off64_t>         mChunkOffsets;
 
@@ -206,6 +237,11 @@ private:
     void addOneSttsTableEntry(size_t sampleCount, int32_t timescaledDur);
     void addOneCttsTableEntry(size_t sampleCount, int32_t timescaledDur);
 
+    void addFragmentSample(
+            MediaBuffer *buffer, size_t sampleSize, int64_t timestampUs,
+            int64_t cttsDeltaTimeUs, bool isSync);
+    void bufferFragment();
+
     bool isTrackMalFormed() const;
     void sendTrackSummary(bool hasMultipleTracks);
 
@@ -238,8 +274,83 @@ private:
     Track &operator=(const Track &);
 };
 
+// Gathers the data written to the file into large buffers that are written
+// out on a separate thread, so that slow writes to flash don't hold up the
+// writer and track threads. The buffers are aligned and, once the file is
+// written sequentially, so are their file offsets and sizes. Data is written
+// to the file in the order it is queued.
+class MPEG4Writer::OutputQueue {
+public:
+    OutputQueue(int fd);
+    ~OutputQueue();
+
+    // Writes the data at the given file offset. Data that continues the
+    // buffer being filled is appended to it, data for an earlier offset
+    // is written separately.
+    void write(off64_t offset, const void *data, size_t size);
+
+    // Queues the buffer being filled, without waiting for it to be written.
+    void queueFilling();
+
+    // Waits until all the data is in the file. Returns the first error.
+    status_t flush();
+
+    void dump(String8 *result) const;
+
+private:
+    enum {
+        kNumBuffers = 4,
+        kBufferSize = 256 * 1024,
+        kAlignment  = 4096,
+    };
+
+    struct Buffer {
+        uint8_t *mData;
+        off64_t mOffset;    // File offset of mData[0]
+        size_t mBegin;      // Valid data is in mData[mBegin, mEnd)
+        size_t mEnd;
+        bool mIsPooled;     // Or allocated for a single write
+    };
+
+    int mFd;
+    pthread_t mThread;
+    mutable Mutex mLock;
+    Condition mQueueChangedCondition;
+    Condition mBufferDoneCondition;
+    bool mDone;
+    status_t mError;
+    off64_t mFilePosition;  // Of the file descriptor, if known
+
+    Buffer mBuffers[kNumBuffers];
+    List<Buffer *> mFreeBuffers;
+    List<Buffer *> mQueuedBuffers;  // The first one is being written
+
+    // Only used by the thread that writes to the queue
+    Buffer *mFilling;
+
+    // Statistics
+    int64_t mNumBytes;
+    int32_t mNumWrites;
+    int32_t mNumSeeks;
+    int64_t mMaxWriteTimeUs;
+    int32_t mNumStalls;
+    int64_t mMaxStallTimeUs;
+    int64_t mStallTimeUs;
+
+    void queue_l(Buffer *buffer);
+    Buffer *acquireBuffer(off64_t offset);
+
+    static void *ThreadWrapper(void *me);
+    void threadFunc();
+    void writeBuffer(const Buffer *buffer);
+
+    OutputQueue(const OutputQueue &);
+    OutputQueue &operator=(const OutputQueue &);
+};
+
 MPEG4Writer::MPEG4Writer(const char *filename)
     : mFd(-1),
+      mOutputQueue(NULL),
       mInitCheck(NO_INIT),
       mUse4ByteNalLength(true),
       mUse32BitOffset(true),
@@ -250,11 +361,17 @@ MPEG4Writer::MPEG4Writer(const char *filename)
       mOffset(0),
       mMdatOffset(0),
       mEstimatedMoovBoxSize(0),
+      mFastStart(false),
       mInterleaveDurationUs(1000000),
       mLatitudex10000(0),
       mLongitudex10000(0),
       mAreGeoTagsAvailable(false),
-      mStartTimeOffsetMs(-1) {
+      mStartTimeOffsetMs(-1),
+      mFragmentDurationUs(0),
+      mFragmentedMoovBoxWritten(false),
+      mFragmentSequenceNumber(0),
+      mMehdOffset(0),
+      mFragmentedDurationUs(0) {
 
     mFd = open(filename, O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR);
     if (mFd >= 0) {
@@ -264,6 +381,7 @@ MPEG4Writer::MPEG4Writer(const char *filename)
 
 MPEG4Writer::MPEG4Writer(int fd)
     : mFd(dup(fd)),
+      mOutputQueue(NULL),
       mInitCheck(mFd < 0? NO_INIT: OK),
       mUse4ByteNalLength(true),
       mUse32BitOffset(true),
@@ -274,11 +392,17 @@ MPEG4Writer::MPEG4Writer(int fd)
       mOffset(0),
       mMdatOffset(0),
       mEstimatedMoovBoxSize(0),
+      mFastStart(false),
       mInterleaveDurationUs(1000000),
       mLatitudex10000(0),
       mLongitudex10000(0),
       mAreGeoTagsAvailable(false),
-      mStartTimeOffsetMs(-1) {
+      mStartTimeOffsetMs(-1),
+      mFragmentDurationUs(0),
+      mFragmentedMoovBoxWritten(false),
+      mFragmentSequenceNumber(0),
+      mMehdOffset(0),
+      mFragmentedDurationUs(0) {
 }
 
 MPEG4Writer::~MPEG4Writer() {
@@ -302,6 +426,9 @@ status_t MPEG4Writer::dump(
     result.append(buffer);
     snprintf(buffer, SIZE, "     mStarted: %s\n", mStarted? "true": "false");
     result.append(buffer);
+    if (mOutputQueue != NULL) {
+        mOutputQueue->dump(&result);
+    }
     ::write(fd, result.string(), result.size());
     for (List<Track *>::iterator it = mTracks.begin();
          it != mTracks.end(); ++it) {
@@ -354,6 +481,21 @@ status_t MPEG4Writer::startTracks(MetaData *params) {
 }
 
 int64_t MPEG4Writer::estimateMoovBoxSize(int32_t bitRate) {
+    if (mFastStart && mMaxFileDurationLimitUs != 0) {
+        // Reserve room for the sample tables of a recording reaching
+        // the duration limit. The movie header and the user data take
+        // less than 512 bytes.
+        int64_t size = 512;
+        for (List<Track *>::iterator it = mTracks.begin();
+             it != mTracks.end(); ++it) {
+            size += (*it)->estimateTrakBoxSizeBytes(mMaxFileDurationLimitUs);
+        }
+
+        ALOGI("duration limit: %lld us and the estimated moov size %lld bytes",
+             mMaxFileDurationLimitUs, size);
+        return size;
+    }
+
     // This implementation is highly experimental/heurisitic.
     //
     // Statistical analysis shows that metadata usually accounts
@@ -474,34 +616,66 @@ status_t MPEG4Writer::start(MetaData *param) {
     CHECK(mTimeScale > 0);
     ALOGV("movie time scale: %d", mTimeScale);
 
+    int64_t fragmentDurationUs;
+    if (param &&
+        param->findInt64(kKeyFragmentDurationUs, &fragmentDurationUs) &&
+        fragmentDurationUs > 0) {
+        mFragmentDurationUs = fragmentDurationUs;
+    }
+
+    int32_t fastStart;
+    if (param &&
+        param->findInt32(kKeyFastStart, &fastStart) &&
+        fastStart) {
+        // The media data is read back to move it behind the moov box.
+        int flags = fcntl(mFd, F_GETFL);
+        if (flags < 0 || (flags & O_ACCMODE) != O_RDWR) {
+            ALOGE("Fast start needs a file opened for reading and writing");
+            return ERROR_UNSUPPORTED;
+        }
+        mFastStart = true;
+    }
+
     mStreamableFile = true;
     mWriteMoovBoxToMemory = false;
     mMoovBoxBuffer = NULL;
     mMoovBoxBufferOffset = 0;
+    mOutputQueue = new OutputQueue(mFd);
 
     writeFtypBox(param);
 
-    mFreeBoxOffset = mOffset;
+    if (isFragmented()) {
+        // The movie box goes in front of the first movie fragment,
+        // when the codec specific data of all tracks is known. Only
+        // the fragment being collected and the random access entries
+        // of the fragments are kept in memory.
+        ALOGI("Fragmented file, a fragment about every %lld us",
+                mFragmentDurationUs);
+        mFragmentedMoovBoxWritten = false;
+        mFragmentSequenceNumber = 0;
+        mFragmentedDurationUs = 0;
+        mEstimatedMoovBoxSize = 0;
+    } else {
+        mFreeBoxOffset = mOffset;
 
-    if (mEstimatedMoovBoxSize == 0) {
-        int32_t bitRate = -1;
-        if (param) {
-            param->findInt32(kKeyBitRate, &bitRate);
+        if (mEstimatedMoovBoxSize == 0) {
+            int32_t bitRate = -1;
+            if (param) {
+                param->findInt32(kKeyBitRate, &bitRate);
+            }
+            mEstimatedMoovBoxSize = estimateMoovBoxSize(bitRate);
         }
-        mEstimatedMoovBoxSize = estimateMoovBoxSize(bitRate);
-    }
-    CHECK(mEstimatedMoovBoxSize >= 8);
-    lseek64(mFd, mFreeBoxOffset, SEEK_SET);
-    writeInt32(mEstimatedMoovBoxSize);
-    write("free", 4);
+        CHECK(mEstimatedMoovBoxSize >= 8);
+        writeInt32(mEstimatedMoovBoxSize);
+        write("free", 4);
 
-    mMdatOffset = mFreeBoxOffset + mEstimatedMoovBoxSize;
-    mOffset = mMdatOffset;
-    lseek64(mFd, mMdatOffset, SEEK_SET);
-    if (mUse32BitOffset) {
-        write("????mdat", 8);
-    } else {
-        write("\x00\x00\x00\x01mdat????????", 16);
+        mMdatOffset = mFreeBoxOffset + mEstimatedMoovBoxSize;
+        mOffset = mMdatOffset;
+        if (mUse32BitOffset) {
+            write("????mdat", 8);
+        } else {
+            write("\x00\x00\x00\x01mdat????????", 16);
+        }
     }
 
     status_t err = startWriterThread();
@@ -609,11 +783,18 @@ void MPEG4Writer::writeCompositionMatrix(int degrees) {
     writeInt32(0x40000000);  // w
 }
 
-void MPEG4Writer::release() {
+status_t MPEG4Writer::release() {
+    status_t err = OK;
+    if (mOutputQueue != NULL) {
+        err = mOutputQueue->flush();
+        delete mOutputQueue;
+        mOutputQueue = NULL;
+    }
     close(mFd);
     mFd = -1;
     mInitCheck = NO_INIT;
     mStarted = false;
+    return err;
 }
 
 status_t MPEG4Writer::stop() {
@@ -662,18 +843,26 @@ status_t MPEG4Writer::stop() {
         return err;
     }
 
+    if (isFragmented()) {
+        if (mFragmentedMoovBoxWritten) {
+            updateFragmentedDuration(maxDurationUs);
+            writeMfraBox();
+        }
+
+        CHECK(mBoxes.empty());
+        status_t ioErr = release();
+        return err == OK? ioErr: err;
+    }
+
     // Fix up the size of the 'mdat' chunk.
     if (mUse32BitOffset) {
-        lseek64(mFd, mMdatOffset, SEEK_SET);
         int32_t size = htonl(static_cast<int32_t>(mOffset - mMdatOffset));
-        ::write(mFd, &size, 4);
+        mOutputQueue->write(mMdatOffset, &size, 4);
     } else {
-        lseek64(mFd, mMdatOffset + 8, SEEK_SET);
         int64_t size = mOffset - mMdatOffset;
         size = hton64(size);
-        ::write(mFd, &size, 8);
+        mOutputQueue->write(mMdatOffset + 8, &size, 8);
     }
-    lseek64(mFd, mOffset, SEEK_SET);
 
     const off64_t moovOffset = mOffset;
     mWriteMoovBoxToMemory = true;
@@ -683,16 +872,26 @@ status_t MPEG4Writer::stop() {
     writeMoovBox(maxDurationUs);
 
     mWriteMoovBoxToMemory = false;
+    if (!mStreamableFile && mFastStart) {
+        status_t status = makeRoomForMoovBox(moovOffset, maxDurationUs);
+        if (status == ERROR_UNSUPPORTED) {
+            ALOGW("Fast start was requested, but the moov box stays at "
+                 "the end of the file");
+        } else if (status != OK) {
+            ALOGE("Failed to make room for the moov box (%d)", status);
+            release();
+            return status;
+        }
+    }
+
     if (mStreamableFile) {
         CHECK(mMoovBoxBufferOffset + 8 <= mEstimatedMoovBoxSize);
 
         // Moov box
-        lseek64(mFd, mFreeBoxOffset, SEEK_SET);
         mOffset = mFreeBoxOffset;
         write(mMoovBoxBuffer, 1, mMoovBoxBufferOffset);
 
         // Free box
-        lseek64(mFd, mOffset, SEEK_SET);
         writeInt32(mEstimatedMoovBoxSize - mMoovBoxBufferOffset);
         write("free", 4);
 
@@ -706,10 +905,87 @@ status_t MPEG4Writer::stop() {
 
     CHECK(mBoxes.empty());
 
-    release();
+    status_t ioErr = release();
+    return err == OK? ioErr: err;
+}
+
+status_t MPEG4Writer::moveMediaData(off64_t end, off64_t distance) {
+    static const size_t kBufferSize = 1024 * 1024;
+    uint8_t *buffer = (uint8_t *) malloc(kBufferSize);
+    CHECK(buffer != NULL);
+
+    // Start from the end, the data is moved towards it.
+    status_t err = OK;
+    while (end > mMdatOffset) {
+        size_t size = kBufferSize;
+        if (end - mMdatOffset < (off64_t) kBufferSize) {
+            size = end - mMdatOffset;
+        }
+        end -= size;
+
+        if (lseek64(mFd, end, SEEK_SET) < 0 ||
+            ::read(mFd, buffer, size) != (ssize_t) size) {
+            // start() checked that the file can be read back.
+            err = ERROR_IO;
+            break;
+        }
+
+        if (lseek64(mFd, end + distance, SEEK_SET) < 0 ||
+            ::write(mFd, buffer, size) != (ssize_t) size) {
+            err = ERROR_IO;
+            break;
+        }
+    }
+
+    free(buffer);
     return err;
 }
 
+status_t MPEG4Writer::makeRoomForMoovBox(off64_t moovOffset, int64_t durationUs) {
+    // The moov box did not fit in the reserved space and has been written
+    // at moovOffset. Move the media data in front of it by the missing
+    // bytes plus a free box header, and write the moov box again with the
+    // chunk offsets moved as well.
+    const off64_t distance = mOffset - moovOffset + 8 - mEstimatedMoovBoxSize;
+    if (mUse32BitOffset && moovOffset + distance > kMax32BitFileSize) {
+        ALOGW("Can not move the media data by %lld bytes", distance);
+        return ERROR_UNSUPPORTED;
+    }
+
+    ALOGI("Moving the media data by %lld bytes", distance);
+    status_t err = mOutputQueue->flush();
+    if (err != OK) {
+        return err;
+    }
+    err = moveMediaData(moovOffset, distance);
+    if (err != OK) {
+        return err;
+    }
+    if (ftruncate64(mFd, moovOffset + distance) != 0) {
+        return ERROR_IO;
+    }
+
+    for (List<Track *>::iterator it = mTracks.begin();
+         it != mTracks.end(); ++it) {
+        (*it)->shiftChunkOffsets(distance);
+    }
+    mMdatOffset += distance;
+    mEstimatedMoovBoxSize += distance;
+    mOffset = moovOffset + distance;
+
+    mWriteMoovBoxToMemory = true;
+    mMoovBoxBuffer = (uint8_t *) malloc(mEstimatedMoovBoxSize);
+    mMoovBoxBufferOffset = 0;
+    CHECK(mMoovBoxBuffer != NULL);
+    writeMoovBox(durationUs);
+
+    // Only the chunk offsets have changed, not the size.
+    CHECK(mWriteMoovBoxToMemory);
+    mWriteMoovBoxToMemory = false;
+    mStreamableFile = true;
+    return OK;
+}
+
 void MPEG4Writer::writeMvhdBox(int64_t durationUs) {
     time_t now = time(NULL);
     beginBox("mvhd");
@@ -746,9 +1022,30 @@ void MPEG4Writer::writeMoovBox(int64_t durationUs) {
         it != mTracks.end(); ++it, ++id) {
         (*it)->writeTrackHeader(mUse32BitOffset);
     }
+    if (isFragmented()) {
+        writeMvexBox();
+    }
     endBox();  // moov
 }
 
+void MPEG4Writer::writeMvexBox() {
+    beginBox("mvex");
+
+    // The duration is kept up to date as fragments are written,
+    // so that it is right for files cut short.
+    beginBox("mehd");
+    writeInt32(0x01000000);  // version=1, flags=0
+    mMehdOffset = mOffset;
+    writeInt64(0);           // fragment duration
+    endBox();  // mehd
+
+    for (List<Track *>::iterator it = mTracks.begin();
+        it != mTracks.end(); ++it) {
+        (*it)->writeTrexBox();
+    }
+    endBox();  // mvex
+}
+
 void MPEG4Writer::writeFtypBox(MetaData *param) {
     beginBox("ftyp");
 
@@ -812,7 +1109,7 @@ void MPEG4Writer::unlock() {
 off64_t MPEG4Writer::addSample_l(MediaBuffer *buffer) {
     off64_t old_offset = mOffset;
 
-    ::write(mFd,
+    mOutputQueue->write(mOffset,
           (const uint8_t *)buffer->data() + buffer->range_offset(),
           buffer->range_length());
 
@@ -840,32 +1137,28 @@ off64_t MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
 
     size_t length = buffer->range_length();
 
+    uint8_t prefix[4];
+    size_t prefixLength;
     if (mUse4ByteNalLength) {
-        uint8_t x = length >> 24;
-        ::write(mFd, &x, 1);
-        x = (length >> 16) & 0xff;
-        ::write(mFd, &x, 1);
-        x = (length >> 8) & 0xff;
-        ::write(mFd, &x, 1);
-        x = length & 0xff;
-        ::write(mFd, &x, 1);
-
-        ::write(mFd,
-              (const uint8_t *)buffer->data() + buffer->range_offset(),
-              length);
-
-        mOffset += length + 4;
+        prefix[0] = length >> 24;
+        prefix[1] = (length >> 16) & 0xff;
+        prefix[2] = (length >> 8) & 0xff;
+        prefix[3] = length & 0xff;
+        prefixLength = 4;
     } else {
         CHECK(length < 65536);
 
-        uint8_t x = length >> 8;
-        ::write(mFd, &x, 1);
-        x = length & 0xff;
-        ::write(mFd, &x, 1);
-        ::write(mFd, (const uint8_t *)buffer->data() + buffer->range_offset(), length);
-        mOffset += length + 2;
+        prefix[0] = length >> 8;
+        prefix[1] = length & 0xff;
+        prefixLength = 2;
     }
 
+    mOutputQueue->write(mOffset, prefix, prefixLength);
+    mOutputQueue->write(mOffset + prefixLength,
+          (const uint8_t *)buffer->data() + buffer->range_offset(),
+          length);
+    mOffset += length + prefixLength;
+
     return old_offset;
 }
 
@@ -882,9 +1175,9 @@ size_t MPEG4Writer::write(
                  it != mBoxes.end(); ++it) {
                 (*it) += mOffset;
             }
-            lseek64(mFd, mOffset, SEEK_SET);
-            ::write(mFd, mMoovBoxBuffer, mMoovBoxBufferOffset);
-            ::write(mFd, ptr, size * nmemb);
+            mOutputQueue->write(mOffset, mMoovBoxBuffer, mMoovBoxBufferOffset);
+            mOutputQueue->write(
+                    mOffset + mMoovBoxBufferOffset, ptr, size * nmemb);
             mOffset += (bytes + mMoovBoxBufferOffset);
             free(mMoovBoxBuffer);
             mMoovBoxBuffer = NULL;
@@ -896,7 +1189,7 @@ size_t MPEG4Writer::write(
             mMoovBoxBufferOffset += bytes;
         }
     } else {
-        ::write(mFd, ptr, size * nmemb);
+        mOutputQueue->write(mOffset, ptr, size * nmemb);
         mOffset += bytes;
     }
     return bytes;
@@ -922,10 +1215,8 @@ void MPEG4Writer::endBox() {
        int32_t x = htonl(mMoovBoxBufferOffset - offset);
        memcpy(mMoovBoxBuffer + offset, &x, 4);
     } else {
-        lseek64(mFd, offset, SEEK_SET);
-        writeInt32(mOffset - offset);
-        mOffset -= 4;
-        lseek64(mFd, mOffset, SEEK_SET);
+        int32_t x = htonl(mOffset - offset);
+        mOutputQueue->write(offset, &x, 4);
     }
 }
 
@@ -1105,6 +1396,270 @@ size_t MPEG4Writer::numTracks() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+MPEG4Writer::OutputQueue::OutputQueue(int fd)
+    : mFd(fd),
+      mDone(false),
+      mError(OK),
+      mFilePosition(-1),
+      mFilling(NULL),
+      mNumBytes(0),
+      mNumWrites(0),
+      mNumSeeks(0),
+      mMaxWriteTimeUs(0),
+      mNumStalls(0),
+      mMaxStallTimeUs(0),
+      mStallTimeUs(0) {
+    for (size_t i = 0; i < kNumBuffers; ++i) {
+        void *data;
+        CHECK_EQ(posix_memalign(&data, kAlignment, kBufferSize), 0);
+        mBuffers[i].mData = (uint8_t *) data;
+        mBuffers[i].mIsPooled = true;
+        mFreeBuffers.push_back(&mBuffers[i]);
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    pthread_create(&mThread, &attr, ThreadWrapper, this);
+    pthread_attr_destroy(&attr);
+}
+
+MPEG4Writer::OutputQueue::~OutputQueue() {
+    flush();
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        mDone = true;
+        mQueueChangedCondition.signal();
+    }
+
+    void *dummy;
+    pthread_join(mThread, &dummy);
+
+    for (size_t i = 0; i < kNumBuffers; ++i) {
+        free(mBuffers[i].mData);
+        mBuffers[i].mData = NULL;
+    }
+}
+
+void MPEG4Writer::OutputQueue::write(
+        off64_t offset, const void *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    if (mFilling != NULL) {
+        const off64_t begin = mFilling->mOffset + mFilling->mBegin;
+        const off64_t end = mFilling->mOffset + mFilling->mEnd;
+        if (offset >= begin && offset + (off64_t) size <= end) {
+            // Box sizes are filled in once the box is complete.
+            memcpy(mFilling->mData + (offset - mFilling->mOffset), data, size);
+            return;
+        }
+
+        if (offset + (off64_t) size <= begin) {
+            // Box sizes and the movie box written when the recording
+            // stops go before the buffer being filled, it is kept.
+            Buffer *buffer = new Buffer;
+            buffer->mData = (uint8_t *) malloc(size);
+            CHECK(buffer->mData != NULL);
+            memcpy(buffer->mData, data, size);
+            buffer->mOffset = offset;
+            buffer->mBegin = 0;
+            buffer->mEnd = size;
+            buffer->mIsPooled = false;
+
+            Mutex::Autolock autoLock(mLock);
+            queue_l(buffer);
+            return;
+        }
+
+        if (offset != end) {
+            queueFilling();
+        }
+    }
+
+    const uint8_t *ptr = (const uint8_t *) data;
+    while (size > 0) {
+        if (mFilling == NULL) {
+            mFilling = acquireBuffer(offset);
+        }
+
+        size_t copy = kBufferSize - mFilling->mEnd;
+        if (copy > size) {
+            copy = size;
+        }
+        memcpy(mFilling->mData + mFilling->mEnd, ptr, copy);
+        mFilling->mEnd += copy;
+        offset += copy;
+        ptr += copy;
+        size -= copy;
+
+        if (mFilling->mEnd == kBufferSize) {
+            queueFilling();
+        }
+    }
+}
+
+status_t MPEG4Writer::OutputQueue::flush() {
+    queueFilling();
+
+    Mutex::Autolock autoLock(mLock);
+    while (!mQueuedBuffers.empty()) {
+        mBufferDoneCondition.wait(mLock);
+    }
+
+    // The file may be read or written directly until more is queued.
+    mFilePosition = -1;
+    return mError;
+}
+
+MPEG4Writer::OutputQueue::Buffer *MPEG4Writer::OutputQueue::acquireBuffer(
+        off64_t offset) {
+    Mutex::Autolock autoLock(mLock);
+    if (mFreeBuffers.empty()) {
+        // All buffers are waiting to be written, the file can't keep up.
+        int64_t startTimeUs = systemTime() / 1000;
+        while (mFreeBuffers.empty()) {
+            mBufferDoneCondition.wait(mLock);
+        }
+        int64_t stallTimeUs = systemTime() / 1000 - startTimeUs;
+        ++mNumStalls;
+        mStallTimeUs += stallTimeUs;
+        if (stallTimeUs > mMaxStallTimeUs) {
+            mMaxStallTimeUs = stallTimeUs;
+        }
+    }
+
+    Buffer *buffer = *mFreeBuffers.begin();
+    mFreeBuffers.erase(mFreeBuffers.begin());
+
+    // Keep the buffer and file offsets the same modulo the alignment,
+    // so that the next buffer starts at an aligned file offset.
+    buffer->mBegin = offset % kAlignment;
+    buffer->mOffset = offset - buffer->mBegin;
+    buffer->mEnd = buffer->mBegin;
+    return buffer;
+}
+
+void MPEG4Writer::OutputQueue::queueFilling() {
+    if (mFilling == NULL) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    if (mFilling->mEnd == mFilling->mBegin) {
+        mFreeBuffers.push_back(mFilling);
+    } else {
+        queue_l(mFilling);
+    }
+    mFilling = NULL;
+}
+
+void MPEG4Writer::OutputQueue::queue_l(Buffer *buffer) {
+    mQueuedBuffers.push_back(buffer);
+    mQueueChangedCondition.signal();
+}
+
+// static
+void *MPEG4Writer::OutputQueue::ThreadWrapper(void *me) {
+    static_cast<OutputQueue *>(me)->threadFunc();
+    return NULL;
+}
+
+void MPEG4Writer::OutputQueue::threadFunc() {
+    prctl(PR_SET_NAME, (unsigned long)"MPEG4Output", 0, 0, 0);
+
+    Mutex::Autolock autoLock(mLock);
+    for (;;) {
+        while (!mDone && mQueuedBuffers.empty()) {
+            mQueueChangedCondition.wait(mLock);
+        }
+        if (mQueuedBuffers.empty()) {
+            break;
+        }
+
+        // The buffer stays queued while it is written, so that
+        // flush() waits for it.
+        Buffer *buffer = *mQueuedBuffers.begin();
+        mLock.unlock();
+        writeBuffer(buffer);
+        mLock.lock();
+
+        mQueuedBuffers.erase(mQueuedBuffers.begin());
+        if (buffer->mIsPooled) {
+            mFreeBuffers.push_back(buffer);
+        } else {
+            free(buffer->mData);
+            delete buffer;
+        }
+        mBufferDoneCondition.broadcast();
+    }
+}
+
+void MPEG4Writer::OutputQueue::writeBuffer(const Buffer *buffer) {
+    off64_t offset = buffer->mOffset + buffer->mBegin;
+    const uint8_t *data = buffer->mData + buffer->mBegin;
+    size_t size = buffer->mEnd - buffer->mBegin;
+
+    int64_t startTimeUs = systemTime() / 1000;
+    int32_t numWrites = 0;
+    int32_t numSeeks = 0;
+    status_t err = OK;
+    if (offset != mFilePosition) {
+        ++numSeeks;
+        if (lseek64(mFd, offset, SEEK_SET) != offset) {
+            err = ERROR_IO;
+        }
+    }
+    while (err == OK && size > 0) {
+        ssize_t n = ::write(mFd, data, size);
+        ++numWrites;
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = ERROR_IO;
+            break;
+        }
+        data += n;
+        offset += n;
+        size -= n;
+    }
+    int64_t writeTimeUs = systemTime() / 1000 - startTimeUs;
+
+    Mutex::Autolock autoLock(mLock);
+    mFilePosition = (err == OK)? offset: -1;
+    if (err != OK && mError == OK) {
+        ALOGE("Failed to write %d bytes at offset %lld (%s)",
+                size, offset, strerror(errno));
+        mError = err;
+    }
+    mNumBytes += buffer->mEnd - buffer->mBegin - size;
+    mNumWrites += numWrites;
+    mNumSeeks += numSeeks;
+    if (writeTimeUs > mMaxWriteTimeUs) {
+        mMaxWriteTimeUs = writeTimeUs;
+    }
+}
+
+void MPEG4Writer::OutputQueue::dump(String8 *result) const {
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    Mutex::Autolock autoLock(mLock);
+    snprintf(buffer, SIZE, "     output: %lld bytes, %d writes, %d seeks\n",
+            mNumBytes, mNumWrites, mNumSeeks);
+    result->append(buffer);
+    snprintf(buffer, SIZE, "     longest write: %lld us, buffers queued: %d\n",
+            mMaxWriteTimeUs, mQueuedBuffers.size());
+    result->append(buffer);
+    snprintf(buffer, SIZE, "     waited for the file %d times, %lld us total, "
+            "%lld us longest\n", mNumStalls, mStallTimeUs, mMaxStallTimeUs);
+    result->append(buffer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 MPEG4Writer::Track::Track(
         MPEG4Writer *owner, const sp<MediaSource> &source, size_t trackId)
     : mOwner(owner),
@@ -1144,7 +1699,10 @@ void MPEG4Writer::Track::updateTrackSizeEstimate() {
     int64_t stszBoxSizeBytes = mSamplesHaveSameSize? 4: (mNumSamples * 4);
 
     mEstimatedTrackSizeBytes = mMdatSizeBytes;  // media data size
-    if (!mOwner->isFileStreamable()) {
+    if (mOwner->isFragmented()) {
+        // Each sample is described in the 'trun' box of its fragment.
+        mEstimatedTrackSizeBytes += mNumSamples * 16;
+    } else if (!mOwner->isFileStreamable()) {
         // Reserved free space is not large enough to hold
         // all meta data and thus wasted.
         mEstimatedTrackSizeBytes += mNumStscTableEntries * 12 +  // stsc box size
@@ -1199,6 +1757,68 @@ void MPEG4Writer::Track::addChunkOffset(off64_t offset) {
     mChunkOffsets.push_back(offset);
 }
 
+void MPEG4Writer::Track::shiftChunkOffsets(off64_t distance) {
+    for (List<off64_t>::iterator it = mChunkOffsets.begin();
+         it != mChunkOffsets.end(); ++it) {
+        *it += distance;
+    }
+}
+
+int64_t MPEG4Writer::Track::estimateTrakBoxSizeBytes(int64_t durationUs) const {
+    int64_t numSamples;
+    int64_t numSyncSamples = 0;
+    if (mIsAudio) {
+        const char *mime;
+        int32_t sampleRate;
+        CHECK(mMeta->findCString(kKeyMIMEType, &mime));
+        CHECK(mMeta->findInt32(kKeySampleRate, &sampleRate));
+
+        // AAC frames have 1024 samples, AMR frames are 20 ms long.
+        int64_t samplesPerFrame = 1024;
+        if (!strcasecmp(MEDIA_MIMETYPE_AUDIO_AMR_NB, mime) ||
+            !strcasecmp(MEDIA_MIMETYPE_AUDIO_AMR_WB, mime)) {
+            samplesPerFrame = sampleRate / 50;
+        }
+        numSamples = durationUs * sampleRate / (samplesPerFrame * 1000000LL) + 1;
+    } else {
+        int32_t frameRate;
+        if (!mMeta->findInt32(kKeyFrameRate, &frameRate) || frameRate <= 0) {
+            frameRate = 30;
+        }
+        numSamples = durationUs * frameRate / 1000000LL + 1;
+
+        int32_t iFramesIntervalSec;
+        if (!mMeta->findInt32(kKeyIFramesInterval, &iFramesIntervalSec)) {
+            iFramesIntervalSec = 1;
+        }
+        numSyncSamples = (iFramesIntervalSec <= 0)
+                ? numSamples
+                : durationUs / (iFramesIntervalSec * 1000000LL) + 1;
+    }
+
+    int64_t numChunks = 1;
+    if (mOwner->numTracks() > 1) {
+        int64_t interleaveDurationUs = mOwner->interleaveDuration();
+        numChunks = (interleaveDurationUs == 0)
+                ? numSamples
+                : durationUs / interleaveDurationUs + 1;
+    }
+
+    // Audio frame durations only change when the recording is paused,
+    // video frame durations come from the capture time stamps and may
+    // need a stts entry for each frame.
+    int64_t numSttsTableEntries = mIsAudio? 64: numSamples;
+    int64_t stcoEntrySizeBytes = mOwner->use32BitFileOffset()? 4: 8;
+
+    // The fixed size boxes and the sample description take less than
+    // 1 KB besides the codec specific data.
+    return 1024 + mCodecSpecificDataSize +
+           numSamples * 4 +                       // stsz box size
+           numSttsTableEntries * 8 +              // stts box size
+           numSyncSamples * 4 +                   // stss box size
+           numChunks * (12 + stcoEntrySizeBytes); // stsc and stco box size
+}
+
 void MPEG4Writer::Track::setTimeScale() {
     ALOGV("setTimeScale");
     // Default time scale
@@ -1306,6 +1926,11 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
     ALOGV("writeChunkToFile: %lld from %s track",
         chunk->mTimeStampUs, chunk->mTrack->isAudio()? "audio": "video");
 
+    if (isFragmented()) {
+        writeFragment(chunk);
+        return;
+    }
+
     int32_t isFirstSample = true;
     while (!chunk->mSamples.empty()) {
         List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
@@ -1326,12 +1951,97 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
     chunk->mSamples.clear();
 }
 
+bool MPEG4Writer::isReadyToWriteFragments() {
+    if (mFragmentedMoovBoxWritten) {
+        return true;
+    }
+
+    // The moov box needs the codec specific data of all tracks, which
+    // is known once a track has a fragment to write.
+    for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+         it != mChunkInfos.end(); ++it) {
+        if (it->mChunks.empty() && !it->mTrack->reachedEOS()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MPEG4Writer::writeFragment(Chunk *chunk) {
+    if (!mFragmentedMoovBoxWritten) {
+        writeMoovBox(0);
+        mFragmentedMoovBoxWritten = true;
+    }
+
+    size_t dataSize = 0;
+    for (List<FragmentSample>::iterator it = chunk->mFragmentSamples.begin();
+         it != chunk->mFragmentSamples.end(); ++it) {
+        dataSize += it->mSize;
+    }
+
+    int64_t endTimeUs = chunk->mTrack->writeMoofBox(
+            *chunk, ++mFragmentSequenceNumber, mOffset);
+
+    writeInt32(8 + dataSize);
+    writeFourcc("mdat");
+    while (!chunk->mSamples.empty()) {
+        List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
+
+        if (chunk->mTrack->isAvc()) {
+            addLengthPrefixedSample_l(*it);
+        } else {
+            addSample_l(*it);
+        }
+
+        (*it)->release();
+        (*it) = NULL;
+        chunk->mSamples.erase(it);
+    }
+
+    updateFragmentedDuration(endTimeUs);
+
+    // Don't wait for the buffer to fill up, a crash should only lose
+    // the fragment being written.
+    mOutputQueue->queueFilling();
+}
+
+void MPEG4Writer::updateFragmentedDuration(int64_t durationUs) {
+    if (durationUs <= mFragmentedDurationUs) {
+        return;
+    }
+    mFragmentedDurationUs = durationUs;
+
+    int64_t duration = (durationUs * mTimeScale + 5E5) / 1E6;
+    duration = hton64(duration);
+    mOutputQueue->write(mMehdOffset, &duration, 8);
+}
+
+void MPEG4Writer::writeMfraBox() {
+    const off64_t mfraOffset = mOffset;
+    beginBox("mfra");
+    for (List<Track *>::iterator it = mTracks.begin();
+        it != mTracks.end(); ++it) {
+        (*it)->writeTfraBox();
+    }
+
+    // Lets the random access box be found from the end of the file.
+    beginBox("mfro");
+    writeInt32(0);                           // version=0, flags=0
+    writeInt32(mOffset + 4 - mfraOffset);    // mfra box size
+    endBox();  // mfro
+    endBox();  // mfra
+}
+
 void MPEG4Writer::writeAllChunks() {
     ALOGV("writeAllChunks");
     size_t outstandingChunks = 0;
     Chunk chunk;
     while (findChunkToWrite(&chunk)) {
+        // Called with the lock held, like in threadFunc() it is not
+        // held while writing: writing a fragment needs to take it.
+        mLock.unlock();
         writeChunkToFile(&chunk);
+        mLock.lock();
         ++outstandingChunks;
     }
 
@@ -1344,6 +2054,10 @@ void MPEG4Writer::writeAllChunks() {
 bool MPEG4Writer::findChunkToWrite(Chunk *chunk) {
     ALOGV("findChunkToWrite");
 
+    if (isFragmented() && !isReadyToWriteFragments()) {
+        return false;
+    }
+
     int64_t minTimestampUs = 0x7FFFFFFFFFFFFFFFLL;
     Track *track = NULL;
     for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
@@ -1506,6 +2220,8 @@ status_t MPEG4Writer::Track::start(MetaData *params) {
     mNumStscTableEntries = 0;
     mNumSttsTableEntries = 0;
     mNumCttsTableEntries = 0;
+    mNumTfraTableEntries = 0;
+    mLastSampleDurationTicks = 0;
     mMdatSizeBytes = 0;
 
     mMaxChunkDurationUs = 0;
@@ -2004,6 +2720,28 @@ status_t MPEG4Writer::Track::threadEntry() {
             mTrackDurationUs = timestampUs;
         }
 
+        if (mOwner->isFragmented()) {
+            // No sample tables, the samples are described in the
+            // movie fragments.
+            ++mNumSamples;
+            if (isSync != 0) {
+                ++mNumStssTableEntries;
+            }
+            lastDurationUs = timestampUs - lastTimestampUs;
+            lastTimestampUs = timestampUs;
+
+            if (mTrackingProgressStatus) {
+                if (mPreviousTrackTimeUs <= 0) {
+                    mPreviousTrackTimeUs = mStartTimestampUs;
+                }
+                trackProgressStatus(timestampUs);
+            }
+
+            addFragmentSample(
+                    copy, sampleSize, timestampUs, cttsDeltaTimeUs, isSync != 0);
+            continue;
+        }
+
         // We need to use the time scale based ticks, rather than the
         // timestamp itself to determine whether we have to use a new
         // stts entry, since we may have rounding errors.
@@ -2112,7 +2850,13 @@ status_t MPEG4Writer::Track::threadEntry() {
     mOwner->trackProgressStatus(mTrackId, -1, err);
 
     // Last chunk
-    if (!hasMultipleTracks) {
+    if (mOwner->isFragmented()) {
+        if (!mChunkSamples.empty()) {
+            // Repeat the previous sample duration for the last sample.
+            (--mFragmentSamples.end())->mDurationTicks = mLastSampleDurationTicks;
+            bufferFragment();
+        }
+    } else if (!hasMultipleTracks) {
         addOneStscTableEntry(1, mNumSamples);
     } else if (!mChunkSamples.empty()) {
         addOneStscTableEntry(++nChunks, mChunkSamples.size());
@@ -2131,7 +2875,9 @@ status_t MPEG4Writer::Track::threadEntry() {
         ++cttsSampleCount;
     }
 
-    if (mNumSamples <= 2) {
+    if (mOwner->isFragmented()) {
+        // The sample durations are in the fragments already.
+    } else if (mNumSamples <= 2) {
         addOneSttsTableEntry(1, lastDurationTicks);
         if (sampleCount - 1 > 0) {
             addOneSttsTableEntry(sampleCount - 1, lastDurationTicks);
@@ -2140,7 +2886,9 @@ status_t MPEG4Writer::Track::threadEntry() {
         addOneSttsTableEntry(sampleCount, lastDurationTicks);
     }
 
-    addOneCttsTableEntry(cttsSampleCount, lastCttsDurTicks);
+    if (!mOwner->isFragmented()) {
+        addOneCttsTableEntry(cttsSampleCount, lastCttsDurTicks);
+    }
     mTrackDurationUs += lastDurationUs;
     mReachedEOS = true;
 
@@ -2158,8 +2906,57 @@ status_t MPEG4Writer::Track::threadEntry() {
     return err;
 }
 
+void MPEG4Writer::Track::addFragmentSample(
+        MediaBuffer *buffer, size_t sampleSize, int64_t timestampUs,
+        int64_t cttsDeltaTimeUs, bool isSync) {
+
+    // Time scale based ticks, as for the stts table entries.
+    int64_t decodingTimeTicks = (timestampUs * mTimeScale + 500000LL) / 1000000LL;
+
+    if (!mChunkSamples.empty()) {
+        // The previous sample lasts until this one.
+        List<FragmentSample>::iterator last = --mFragmentSamples.end();
+        last->mDurationTicks = decodingTimeTicks - mLastDecodingTimeTicks;
+        mLastSampleDurationTicks = last->mDurationTicks;
+
+        // Video fragments start with a sync sample to be decodable
+        // on their own, they may last longer than the fragment duration.
+        if ((mIsAudio || isSync) &&
+            timestampUs - mFragmentStartTimeUs >= mOwner->fragmentDuration()) {
+            bufferFragment();
+        }
+    }
+
+    if (mChunkSamples.empty()) {
+        mFragmentStartTimeUs = timestampUs;
+        mFragmentDecodingTimeTicks = decodingTimeTicks;
+    }
+
+    FragmentSample sample;
+    sample.mSize = sampleSize;
+    sample.mDurationTicks = 0;
+    sample.mCompositionOffsetTicks =
+        ((timestampUs + cttsDeltaTimeUs) * mTimeScale + 500000LL) / 1000000LL -
+        decodingTimeTicks;
+    sample.mIsSync = mIsAudio || isSync;
+    mFragmentSamples.push_back(sample);
+    mChunkSamples.push_back(buffer);
+    mLastDecodingTimeTicks = decodingTimeTicks;
+}
+
+void MPEG4Writer::Track::bufferFragment() {
+    ALOGV("bufferFragment");
+
+    Chunk chunk(this, mFragmentStartTimeUs, mChunkSamples);
+    chunk.mDecodingTimeTicks = mFragmentDecodingTimeTicks;
+    chunk.mFragmentSamples = mFragmentSamples;
+    mOwner->bufferChunk(chunk);
+    mChunkSamples.clear();
+    mFragmentSamples.clear();
+}
+
 bool MPEG4Writer::Track::isTrackMalFormed() const {
-    if (mSampleSizes.empty()) {                      // no samples written
+    if (mNumSamples == 0) {                          // no samples written
         ALOGE("The number of recorded samples is 0");
         return true;
     }
@@ -2356,6 +3153,28 @@ void MPEG4Writer::Track::writeStblBox(bool use32BitOffset) {
         writeVideoFourCCBox();
     }
     mOwner->endBox();  // stsd
+    if (mOwner->isFragmented()) {
+        // The samples are all in the movie fragments.
+        mOwner->beginBox("stts");
+        mOwner->writeInt32(0);  // version=0, flags=0
+        mOwner->writeInt32(0);  // entry count
+        mOwner->endBox();  // stts
+        mOwner->beginBox("stsz");
+        mOwner->writeInt32(0);  // version=0, flags=0
+        mOwner->writeInt32(0);  // default sample size
+        mOwner->writeInt32(0);  // sample count
+        mOwner->endBox();  // stsz
+        mOwner->beginBox("stsc");
+        mOwner->writeInt32(0);  // version=0, flags=0
+        mOwner->writeInt32(0);  // entry count
+        mOwner->endBox();  // stsc
+        mOwner->beginBox(use32BitOffset? "stco": "co64");
+        mOwner->writeInt32(0);  // version=0, flags=0
+        mOwner->writeInt32(0);  // entry count
+        mOwner->endBox();  // stco or co64
+        mOwner->endBox();  // stbl
+        return;
+    }
     writeSttsBox();
     writeCttsBox();
     if (!mIsAudio) {
@@ -2548,7 +3367,8 @@ void MPEG4Writer::Track::writeTkhdBox(time_t now) {
     mOwner->writeInt32(now);           // modification time
     mOwner->writeInt32(mTrackId + 1);  // track id starts with 1
     mOwner->writeInt32(0);             // reserved
-    int64_t trakDurationUs = getDurationUs();
+    // Fragmented files have the duration in the 'mehd' box.
+    int64_t trakDurationUs = mOwner->isFragmented()? 0: getDurationUs();
     int32_t mvhdTimeScale = mOwner->getTimeScale();
     int32_t tkhdDuration =
         (trakDurationUs * mvhdTimeScale + 5E5) / 1E6;
@@ -2609,7 +3429,7 @@ void MPEG4Writer::Track::writeHdlrBox() {
 }
 
 void MPEG4Writer::Track::writeMdhdBox(time_t now) {
-    int64_t trakDurationUs = getDurationUs();
+    int64_t trakDurationUs = mOwner->isFragmented()? 0: getDurationUs();
     mOwner->beginBox("mdhd");
     mOwner->writeInt32(0);             // version=0, flags=0
     mOwner->writeInt32(now);           // creation time
@@ -2809,6 +3629,124 @@ void MPEG4Writer::Track::writeStcoBox(bool use32BitOffset) {
     mOwner->endBox();  // stco or co64
 }
 
+int64_t MPEG4Writer::Track::writeMoofBox(
+        const Chunk &chunk, uint32_t sequenceNumber, off64_t moofOffset) {
+
+    // Compensate for small start time difference from different media tracks
+    int64_t trackStartTimeOffsetUs = 0;
+    int64_t moovStartTimeUs = mOwner->getStartTimestampUs();
+    if (mStartTimestampUs > moovStartTimeUs) {
+        trackStartTimeOffsetUs = mStartTimestampUs - moovStartTimeUs;
+    }
+    int64_t decodingTimeTicks = chunk.mDecodingTimeTicks +
+        (trackStartTimeOffsetUs * mTimeScale + 500000LL) / 1000000LL;
+
+    size_t numSamples = 0;
+    int64_t durationTicks = 0;
+    bool hasCompositionOffsets = false;
+    bool hasNegativeCompositionOffsets = false;
+    for (List<FragmentSample>::const_iterator it = chunk.mFragmentSamples.begin();
+         it != chunk.mFragmentSamples.end(); ++it) {
+        ++numSamples;
+        durationTicks += it->mDurationTicks;
+        if (it->mCompositionOffsetTicks != 0) {
+            hasCompositionOffsets = true;
+        }
+        if (it->mCompositionOffsetTicks < 0) {
+            hasNegativeCompositionOffsets = true;
+        }
+    }
+    CHECK(numSamples > 0);
+
+    if (chunk.mFragmentSamples.begin()->mIsSync) {
+        TfraTableEntry tfraEntry(decodingTimeTicks, moofOffset);
+        mTfraTableEntries.push_back(tfraEntry);
+        ++mNumTfraTableEntries;
+    }
+
+    // The sample data follows right after, in the 'mdat' box.
+    size_t sampleEntrySize = hasCompositionOffsets? 16: 12;
+    int32_t moofBoxSize = 88 + numSamples * sampleEntrySize;
+
+    mOwner->beginBox("moof");
+    mOwner->beginBox("mfhd");
+    mOwner->writeInt32(0);               // version=0, flags=0
+    mOwner->writeInt32(sequenceNumber);
+    mOwner->endBox();  // mfhd
+
+    mOwner->beginBox("traf");
+    mOwner->beginBox("tfhd");
+    mOwner->writeInt32(0x020000);        // version=0, flags=default-base-is-moof
+    mOwner->writeInt32(mTrackId + 1);    // track id starts with 1
+    mOwner->endBox();  // tfhd
+
+    mOwner->beginBox("tfdt");
+    mOwner->writeInt32(0x01000000);      // version=1, flags=0
+    mOwner->writeInt64(decodingTimeTicks);
+    mOwner->endBox();  // tfdt
+
+    // Flags: data offset, sample duration, size, flags and optionally
+    // composition time offset present.
+    mOwner->beginBox("trun");
+    int32_t flags = 0x000701;
+    if (hasCompositionOffsets) {
+        flags |= 0x000800;
+    }
+    if (hasNegativeCompositionOffsets) {
+        mOwner->writeInt32(0x01000000 | flags);  // version=1
+    } else {
+        mOwner->writeInt32(flags);               // version=0
+    }
+    mOwner->writeInt32(numSamples);
+    mOwner->writeInt32(moofBoxSize + 8);         // data offset
+    for (List<FragmentSample>::const_iterator it = chunk.mFragmentSamples.begin();
+         it != chunk.mFragmentSamples.end(); ++it) {
+        mOwner->writeInt32(it->mDurationTicks);
+        mOwner->writeInt32(it->mSize);
+
+        // Sample depends on others and is a non sync sample, or
+        // sample does not depend on others.
+        mOwner->writeInt32(it->mIsSync? 0x02000000: 0x01010000);
+        if (hasCompositionOffsets) {
+            mOwner->writeInt32(it->mCompositionOffsetTicks);
+        }
+    }
+    mOwner->endBox();  // trun
+    mOwner->endBox();  // traf
+    mOwner->endBox();  // moof
+
+    return ((decodingTimeTicks + durationTicks) * 1000000LL + mTimeScale / 2) /
+            mTimeScale;
+}
+
+void MPEG4Writer::Track::writeTrexBox() {
+    mOwner->beginBox("trex");
+    mOwner->writeInt32(0);             // version=0, flags=0
+    mOwner->writeInt32(mTrackId + 1);  // track id starts with 1
+    mOwner->writeInt32(1);             // default sample description index
+    mOwner->writeInt32(0);             // default sample duration
+    mOwner->writeInt32(0);             // default sample size
+    mOwner->writeInt32(0);             // default sample flags
+    mOwner->endBox();  // trex
+}
+
+void MPEG4Writer::Track::writeTfraBox() {
+    mOwner->beginBox("tfra");
+    mOwner->writeInt32(0x01000000);    // version=1, flags=0
+    mOwner->writeInt32(mTrackId + 1);  // track id starts with 1
+    mOwner->writeInt32(0);             // 1 byte traf, trun and sample numbers
+    mOwner->writeInt32(mNumTfraTableEntries);
+    for (List<TfraTableEntry>::iterator it = mTfraTableEntries.begin();
+        it != mTfraTableEntries.end(); ++it) {
+        mOwner->writeInt64(it->decodingTime);
+        mOwner->writeInt64(it->moofOffset);
+        mOwner->writeInt8(1);          // traf number
+        mOwner->writeInt8(1);          // trun number
+        mOwner->writeInt8(1);          // sample number
+    }
+    mOwner->endBox();  // tfra
+}
+
 void MPEG4Writer::writeUdtaBox() {
     beginBox("udta");
     writeGeoDataBox();
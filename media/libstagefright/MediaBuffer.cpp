@@ -33,8 +33,10 @@ namespace android {
 
 MediaBuffer::MediaBuffer(void *data, size_t size)
     : mObserver(NULL),
-      mNextBuffer(NULL),
       mRefCount(0),
+      mGroupIndex(-1),
+      mIsFree(0),
+      mNextFree(0),
       mData(data),
       mSize(size),
       mRangeOffset(0),
@@ -46,8 +48,10 @@ MediaBuffer::MediaBuffer(void *data, size_t size)
 
 MediaBuffer::MediaBuffer(size_t size)
     : mObserver(NULL),
-      mNextBuffer(NULL),
       mRefCount(0),
+      mGroupIndex(-1),
+      mIsFree(0),
+      mNextFree(0),
       mData(malloc(size)),
       mSize(size),
       mRangeOffset(0),
@@ -59,8 +63,10 @@ MediaBuffer::MediaBuffer(size_t size)
 
 MediaBuffer::MediaBuffer(const sp<GraphicBuffer>& graphicBuffer)
     : mObserver(NULL),
-      mNextBuffer(NULL),
       mRefCount(0),
+      mGroupIndex(-1),
+      mIsFree(0),
+      mNextFree(0),
       mData(NULL),
       mSize(1),
       mRangeOffset(0),
@@ -73,8 +79,10 @@ MediaBuffer::MediaBuffer(const sp<GraphicBuffer>& graphicBuffer)
 
 MediaBuffer::MediaBuffer(const sp<ABuffer> &buffer)
     : mObserver(NULL),
-      mNextBuffer(NULL),
       mRefCount(0),
+      mGroupIndex(-1),
+      mIsFree(0),
+      mNextFree(0),
       mData(buffer->data()),
       mSize(buffer->size()),
       mRangeOffset(0),
@@ -104,13 +112,6 @@ void MediaBuffer::release() {
     CHECK(prevCount > 0);
 }
 
-void MediaBuffer::claim() {
-    CHECK(mObserver != NULL);
-    CHECK_EQ(mRefCount, 1);
-
-    mRefCount = 0;
-}
-
 void MediaBuffer::add_ref() {
     (void) __atomic_inc(&mRefCount);
 }
@@ -175,14 +176,6 @@ void MediaBuffer::setObserver(MediaBufferObserver *observer) {
     mObserver = observer;
 }
 
-void MediaBuffer::setNextBuffer(MediaBuffer *buffer) {
-    mNextBuffer = buffer;
-}
-
-MediaBuffer *MediaBuffer::nextBuffer() {
-    return mNextBuffer;
-}
-
 int MediaBuffer::refcount() const {
     return mRefCount;
 }
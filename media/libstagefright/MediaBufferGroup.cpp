@@ -17,70 +17,268 @@
 #define LOG_TAG "MediaBufferGroup"
 #include <utils/Log.h>
 
+#include <cutils/atomic.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaBufferGroup.h>
 #include <media/stagefright/MediaDebug.h>
+#include <utils/Timers.h>
 
 namespace android {
 
-MediaBufferGroup::MediaBufferGroup()
-    : mFirstBuffer(NULL),
-      mLastBuffer(NULL) {
+static const int32_t kIndexMask = 0x7fff;
+static const int32_t kWaiting = 0x8000;
+
+// The head with the update count advanced, no index and nobody waiting.
+static int32_t nextTag(int32_t head) {
+    return (int32_t)(((uint32_t)head + 0x10000) & 0xffff0000);
+}
+
+MediaBufferGroup::MediaBufferGroup(size_t maxNumBuffers)
+    : mNumBuffers(0),
+      mMaxNumBuffers(maxNumBuffers),
+      mMaxBufferSize(0),
+      mFreeHead(0),
+      mNumWaiters(0),
+      mNumInUse(0),
+      mMaxNumInUse(0),
+      mNumTryAcquireFailures(0),
+      mNumWaits(0),
+      mTotalWaitUs(0),
+      mMaxWaitUs(0),
+      mNumAllocated(0) {
+    CHECK(mMaxNumBuffers <= (size_t)kNumBuffersPerChunk * kMaxNumChunks);
+
+    for (size_t i = 0; i < kMaxNumChunks; ++i) {
+        mChunks[i] = NULL;
+    }
 }
 
 MediaBufferGroup::~MediaBufferGroup() {
-    MediaBuffer *next;
-    for (MediaBuffer *buffer = mFirstBuffer; buffer != NULL;
-         buffer = next) {
-        next = buffer->nextBuffer();
+    ALOGV("%p: %d buffers (%d allocated, max %d), max %d in use, "
+          "%d waits (%lld us total, %lld us max), %d failed tries",
+          this, mNumBuffers, mNumAllocated, (int)mMaxNumBuffers,
+          mMaxNumInUse, mNumWaits, mTotalWaitUs, mMaxWaitUs,
+          mNumTryAcquireFailures);
+
+    for (int32_t i = 0; i < mNumBuffers; ++i) {
+        MediaBuffer *buffer = bufferAt(i);
 
         CHECK_EQ(buffer->refcount(), 0);
 
         buffer->setObserver(NULL);
         buffer->release();
     }
+
+    for (size_t i = 0; i < kMaxNumChunks; ++i) {
+        delete[] mChunks[i];
+    }
+}
+
+MediaBuffer *MediaBufferGroup::bufferAt(int32_t index) const {
+    return mChunks[index / kNumBuffersPerChunk][index % kNumBuffersPerChunk];
 }
 
 void MediaBufferGroup::add_buffer(MediaBuffer *buffer) {
-    Mutex::Autolock autoLock(mLock);
+    // A buffer added in use comes back to the group when it is released.
+    bool inUse = buffer->refcount() != 0;
+    if (inUse) {
+        incNumInUse();
+    }
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        addBuffer_l(buffer);
+    }
+
+    if (!inUse) {
+        pushFreeBuffer(buffer);
+    }
+}
+
+void MediaBufferGroup::addBuffer_l(MediaBuffer *buffer) {
+    int32_t index = mNumBuffers;
+    CHECK(index < kNumBuffersPerChunk * kMaxNumChunks);
+
+    MediaBuffer **chunk = mChunks[index / kNumBuffersPerChunk];
+    if (chunk == NULL) {
+        chunk = new MediaBuffer *[kNumBuffersPerChunk];
+        mChunks[index / kNumBuffersPerChunk] = chunk;
+    }
 
     buffer->setObserver(this);
+    buffer->mGroupIndex = index;
+    chunk[index % kNumBuffersPerChunk] = buffer;
 
-    if (mLastBuffer) {
-        mLastBuffer->setNextBuffer(buffer);
-    } else {
-        mFirstBuffer = buffer;
+    if (buffer->size() > mMaxBufferSize) {
+        mMaxBufferSize = buffer->size();
     }
 
-    mLastBuffer = buffer;
+    android_atomic_release_store(index + 1, &mNumBuffers);
 }
 
-status_t MediaBufferGroup::acquire_buffer(MediaBuffer **out) {
-    Mutex::Autolock autoLock(mLock);
+void MediaBufferGroup::pushFreeBuffer(MediaBuffer *buffer) {
+    // Releasing a free buffer after add_ref() would put it on the stack
+    // twice.
+    CHECK(android_atomic_acquire_cas(0, 1, &buffer->mIsFree) == 0);
 
     for (;;) {
-        for (MediaBuffer *buffer = mFirstBuffer;
-             buffer != NULL; buffer = buffer->nextBuffer()) {
-            if (buffer->refcount() == 0) {
-                buffer->add_ref();
-                buffer->reset();
-
-                *out = buffer;
-                goto exit;
+        int32_t head = android_atomic_acquire_load(&mFreeHead);
+        buffer->mNextFree = head & kIndexMask;
+
+        // The release publishes the link and whatever was written to
+        // the buffer to the thread that pops it.
+        int32_t newHead = nextTag(head) | (buffer->mGroupIndex + 1);
+        if (android_atomic_release_cas(head, newHead, &mFreeHead) == 0) {
+            if (head & kWaiting) {
+                // The waiter marked the empty stack holding the lock, so
+                // it is waiting by the time we have it.
+                Mutex::Autolock autoLock(mLock);
+                mCondition.signal();
             }
+            return;
+        }
+    }
+}
+
+bool MediaBufferGroup::popFreeBuffer(MediaBuffer **out) {
+    for (;;) {
+        int32_t head = android_atomic_acquire_load(&mFreeHead);
+        int32_t index = head & kIndexMask;
+        if (index == 0) {
+            return false;
         }
 
-        // All buffers are in use. Block until one of them is returned to us.
-        mCondition.wait(mLock);
+        // If the buffer was popped in the meantime its link may be stale,
+        // but then the head has moved on and the swap fails.
+        MediaBuffer *buffer = bufferAt(index - 1);
+        int32_t newHead = nextTag(head) | buffer->mNextFree;
+        if (android_atomic_acquire_cas(head, newHead, &mFreeHead) == 0) {
+            android_atomic_release_store(0, &buffer->mIsFree);
+            *out = buffer;
+            return true;
+        }
+    }
+}
+
+bool MediaBufferGroup::markEmpty_l() {
+    for (;;) {
+        int32_t head = android_atomic_acquire_load(&mFreeHead);
+        if ((head & kIndexMask) != 0) {
+            return true;
+        }
+        if ((head & kWaiting)
+                || android_atomic_acquire_cas(
+                    head, head | kWaiting, &mFreeHead) == 0) {
+            return false;
+        }
+    }
+}
+
+MediaBuffer *MediaBufferGroup::allocateBuffer_l() {
+    if ((size_t)mNumBuffers >= mMaxNumBuffers || mMaxBufferSize == 0) {
+        return NULL;
     }
 
-exit:
+    MediaBuffer *buffer = new MediaBuffer(mMaxBufferSize);
+    addBuffer_l(buffer);
+    ++mNumAllocated;
+
+    ALOGV("%p grew to %d buffers", this, mNumBuffers);
+
+    return buffer;
+}
+
+void MediaBufferGroup::onAcquired(MediaBuffer *buffer) {
+    buffer->add_ref();
+    buffer->reset();
+
+    incNumInUse();
+}
+
+void MediaBufferGroup::incNumInUse() {
+    int32_t numInUse = android_atomic_inc(&mNumInUse) + 1;
+    for (;;) {
+        int32_t maxNumInUse = android_atomic_acquire_load(&mMaxNumInUse);
+        if (numInUse <= maxNumInUse
+                || android_atomic_release_cas(
+                    maxNumInUse, numInUse, &mMaxNumInUse) == 0) {
+            break;
+        }
+    }
+}
+
+status_t MediaBufferGroup::try_acquire_buffer(MediaBuffer **out) {
+    MediaBuffer *buffer;
+    if (!popFreeBuffer(&buffer)) {
+        if ((size_t)android_atomic_acquire_load(&mNumBuffers)
+                < mMaxNumBuffers) {
+            Mutex::Autolock autoLock(mLock);
+            buffer = allocateBuffer_l();
+        } else {
+            buffer = NULL;
+        }
+
+        if (buffer == NULL) {
+            android_atomic_inc(&mNumTryAcquireFailures);
+            return WOULD_BLOCK;
+        }
+    }
+
+    onAcquired(buffer);
+    *out = buffer;
+
     return OK;
 }
 
-void MediaBufferGroup::signalBufferReturned(MediaBuffer *) {
+status_t MediaBufferGroup::acquire_buffer(MediaBuffer **out) {
+    MediaBuffer *buffer;
+    if (popFreeBuffer(&buffer)) {
+        onAcquired(buffer);
+        *out = buffer;
+
+        return OK;
+    }
+
     Mutex::Autolock autoLock(mLock);
-    mCondition.signal();
+
+    buffer = allocateBuffer_l();
+    if (buffer == NULL) {
+        // All buffers are in use. Block until one of them is returned to us.
+        // Returning a buffer only takes the lock to wake us up if the stack
+        // it goes onto is marked, and we only wait once we have marked it.
+        nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        ++mNumWaiters;
+        while (!popFreeBuffer(&buffer)) {
+            if (!markEmpty_l()) {
+                mCondition.wait(mLock);
+            }
+        }
+        --mNumWaiters;
+
+        // Only one waiter is woken up per marking, pass it on to the next.
+        if (mNumWaiters > 0 && markEmpty_l()) {
+            mCondition.signal();
+        }
+
+        int64_t waitUs = ns2us(systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
+        ++mNumWaits;
+        mTotalWaitUs += waitUs;
+        if (waitUs > mMaxWaitUs) {
+            mMaxWaitUs = waitUs;
+        }
+    }
+
+    onAcquired(buffer);
+    *out = buffer;
+
+    return OK;
+}
+
+void MediaBufferGroup::signalBufferReturned(MediaBuffer *buffer) {
+    android_atomic_dec(&mNumInUse);
+
+    pushFreeBuffer(buffer);
 }
 
 }  // namespace android
@@ -177,6 +177,42 @@ void PageCache::copy(size_t from, void *data, size_t size) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+struct NuCachedSource2::Range {
+    Range(off64_t offset)
+        : mCache(kPageSize),
+          mOffset(offset),
+          mLastAccessPos(offset),
+          mLastAccessTimeUs(ALooper::GetNowUs()),
+          mFinalStatus(OK),
+          mNumHits(0),
+          mNumMisses(0),
+          mNumBytesFetched(0) {
+    }
+
+    PageCache mCache;
+    off64_t mOffset;            // Of the first cached byte
+    off64_t mLastAccessPos;
+    int64_t mLastAccessTimeUs;
+    status_t mFinalStatus;      // When it isn't being fetched into
+
+    // Reads that were served from the cache, and reads that had to wait
+    size_t mNumHits;
+    size_t mNumMisses;
+    int64_t mNumBytesFetched;
+
+    off64_t end() const {
+        return mOffset + mCache.totalSize();
+    }
+
+    // Number of cached bytes after the last access.
+    size_t runway() const {
+        return mLastAccessPos < end() ? end() - mLastAccessPos : 0;
+    }
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(Range);
+};
+
 NuCachedSource2::NuCachedSource2(
         const sp<DataSource> &source,
         const char *cacheConfig,
@@ -184,10 +220,9 @@ NuCachedSource2::NuCachedSource2(
     : mSource(source),
       mReflector(new AHandlerReflector<NuCachedSource2>(this)),
       mLooper(new ALooper),
-      mCache(new PageCache(kPageSize)),
-      mCacheOffset(0),
+      mCurrent(new Range(0)),
+      mNumEvictedRanges(0),
       mFinalStatus(OK),
-      mLastAccessPos(0),
       mFetching(true),
       mLastFetchTimeUs(-1),
       mNumRetriesLeft(kMaxNumRetries),
@@ -211,6 +246,8 @@ NuCachedSource2::NuCachedSource2(
         mKeepAliveIntervalUs = 0;
     }
 
+    mRanges.push_back(mCurrent);
+
     mLooper->setName("NuCachedSource2");
     mLooper->registerHandler(mReflector);
     mLooper->start();
@@ -223,8 +260,12 @@ NuCachedSource2::~NuCachedSource2() {
     mLooper->stop();
     mLooper->unregisterHandler(mReflector->id());
 
-    delete mCache;
-    mCache = NULL;
+    for (List<Range *>::iterator it = mRanges.begin();
+         it != mRanges.end(); ++it) {
+        delete *it;
+    }
+    mRanges.clear();
+    mCurrent = NULL;
 }
 
 status_t NuCachedSource2::getEstimatedBandwidthKbps(int32_t *kbps) {
@@ -243,6 +284,28 @@ status_t NuCachedSource2::setCacheStatCollectFreq(int32_t freqMs) {
     return ERROR_UNSUPPORTED;
 }
 
+status_t NuCachedSource2::dump(int fd, const Vector<String16> &args) {
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    String8 result;
+
+    Mutex::Autolock autoLock(mLock);
+    snprintf(buffer, SIZE, "  NuCachedSource2 %p, %d ranges evicted\n",
+            this, mNumEvictedRanges);
+    result.append(buffer);
+    for (List<Range *>::iterator it = mRanges.begin();
+         it != mRanges.end(); ++it) {
+        const Range *range = *it;
+        snprintf(buffer, SIZE, "   %c%lld-%lld: %d hits, %d misses, "
+                "%lld bytes fetched\n",
+                range == mCurrent? '*': ' ', range->mOffset, range->end(),
+                range->mNumHits, range->mNumMisses, range->mNumBytesFetched);
+        result.append(buffer);
+    }
+    ::write(fd, result.string(), result.size());
+    return OK;
+}
+
 status_t NuCachedSource2::initCheck() const {
     return mSource->initCheck();
 }
@@ -292,9 +355,12 @@ void NuCachedSource2::fetchInternal() {
         }
     }
 
+    // Only this thread changes the range being fetched into.
+    Range *range = mCurrent;
+
     if (reconnect) {
         status_t err =
-            mSource->reconnectAtOffset(mCacheOffset + mCache->totalSize());
+            mSource->reconnectAtOffset(range->end());
 
         Mutex::Autolock autoLock(mLock);
 
@@ -309,24 +375,27 @@ void NuCachedSource2::fetchInternal() {
         }
     }
 
-    PageCache::Page *page = mCache->acquirePage();
+    PageCache::Page *page;
+    {
+        Mutex::Autolock autoLock(mLock);
+        page = range->mCache.acquirePage();
+    }
 
-    ssize_t n = mSource->readAt(
-            mCacheOffset + mCache->totalSize(), page->mData, kPageSize);
+    ssize_t n = mSource->readAt(range->end(), page->mData, kPageSize);
 
     Mutex::Autolock autoLock(mLock);
 
     if (n < 0) {
         ALOGE("source returned error %ld, %d retries left", n, mNumRetriesLeft);
         mFinalStatus = n;
-        mCache->releasePage(page);
+        range->mCache.releasePage(page);
     } else if (n == 0) {
         ALOGI("ERROR_END_OF_STREAM");
 
         mNumRetriesLeft = 0;
         mFinalStatus = ERROR_END_OF_STREAM;
 
-        mCache->releasePage(page);
+        range->mCache.releasePage(page);
     } else {
         if (mFinalStatus != OK) {
             ALOGI("retrying a previously failed read succeeded.");
@@ -335,13 +404,19 @@ void NuCachedSource2::fetchInternal() {
         mFinalStatus = OK;
 
         page->mSize = n;
-        mCache->appendPage(page);
+        range->mCache.appendPage(page);
+        range->mNumBytesFetched += n;
     }
 }
 
 void NuCachedSource2::onFetch() {
     ALOGV("onFetch");
 
+    {
+        Mutex::Autolock autoLock(mLock);
+        updateFetchRange_l();
+    }
+
     if (mFinalStatus != OK && mNumRetriesLeft == 0) {
         ALOGV("EOS reached, done prefetching for now");
         mFetching = false;
@@ -362,7 +437,13 @@ void NuCachedSource2::onFetch() {
 
         mLastFetchTimeUs = ALooper::GetNowUs();
 
-        if (mFetching && mCache->totalSize() >= mHighwaterThresholdBytes) {
+        size_t totalSize;
+        {
+            Mutex::Autolock autoLock(mLock);
+            totalSize = totalCachedSize_l();
+        }
+
+        if (mFetching && totalSize >= mHighwaterThresholdBytes) {
             ALOGI("Cache full, done prefetching for now");
             mFetching = false;
 
@@ -430,12 +511,12 @@ void NuCachedSource2::restartPrefetcherIfNecessary_l(
     }
 
     if (!ignoreLowWaterThreshold && !force
-            && mCacheOffset + mCache->totalSize() - mLastAccessPos
+            && mCurrent->end() - mCurrent->mLastAccessPos
                 >= mLowwaterThresholdBytes) {
         return;
     }
 
-    size_t maxBytes = mLastAccessPos - mCacheOffset;
+    size_t maxBytes = mCurrent->mLastAccessPos - mCurrent->mOffset;
 
     if (!force) {
         if (maxBytes < kGrayArea) {
@@ -445,11 +526,140 @@ void NuCachedSource2::restartPrefetcherIfNecessary_l(
         maxBytes -= kGrayArea;
     }
 
-    size_t actualBytes = mCache->releaseFromStart(maxBytes);
-    mCacheOffset += actualBytes;
+    size_t actualBytes = mCurrent->mCache.releaseFromStart(maxBytes);
+    mCurrent->mOffset += actualBytes;
+
+    ALOGI("restarting prefetcher, totalSize = %d",
+         mCurrent->mCache.totalSize());
+    mFetching = true;
+}
+
+NuCachedSource2::Range *NuCachedSource2::findRange_l(
+        off64_t offset, size_t size) const {
+    if (offset >= mCurrent->mOffset
+            && offset + size <= mCurrent->end()) {
+        return mCurrent;
+    }
+
+    for (List<Range *>::const_iterator it = mRanges.begin();
+         it != mRanges.end(); ++it) {
+        Range *range = *it;
+        if (offset >= range->mOffset && offset + size <= range->end()) {
+            return range;
+        }
+    }
+    return NULL;
+}
 
-    ALOGI("restarting prefetcher, totalSize = %d", mCache->totalSize());
+size_t NuCachedSource2::totalCachedSize_l() const {
+    size_t totalSize = 0;
+    for (List<Range *>::const_iterator it = mRanges.begin();
+         it != mRanges.end(); ++it) {
+        totalSize += (*it)->mCache.totalSize();
+    }
+    return totalSize;
+}
+
+void NuCachedSource2::switchToRange_l(Range *range) {
+    ALOGV("fetching into the range at %lld", range->mOffset);
+
+    // Remember if a range has been fetched to the end of the stream, not
+    // the errors of a source that may be retried.
+    mCurrent->mFinalStatus =
+        (mFinalStatus != OK && mNumRetriesLeft == 0)? mFinalStatus: OK;
+
+    mCurrent = range;
+    mFinalStatus = range->mFinalStatus;
+    mNumRetriesLeft = (mFinalStatus == OK)? kMaxNumRetries: 0;
     mFetching = true;
+
+    trimRanges_l();
+}
+
+void NuCachedSource2::updateFetchRange_l() {
+    // Data is about to run out in a range that is read from but not
+    // fetched into, like the second one of two badly interleaved tracks.
+    // Switch fetching to it before the reads have to wait, unless the
+    // range being fetched into is about to run out as well.
+    const int64_t nowUs = ALooper::GetNowUs();
+    Range *target = NULL;
+    for (List<Range *>::iterator it = mRanges.begin();
+         it != mRanges.end(); ++it) {
+        Range *range = *it;
+        if (range == mCurrent
+                || range->mFinalStatus != OK
+                || nowUs - range->mLastAccessTimeUs > kRecentAccessUs
+                || range->runway() >= kMinRunwayBytes) {
+            continue;
+        }
+
+        if (target == NULL || range->runway() < target->runway()) {
+            target = range;
+        }
+    }
+
+    if (target == NULL) {
+        return;
+    }
+
+    const bool canFetch = mFinalStatus == OK || mNumRetriesLeft > 0;
+    if (canFetch
+            && nowUs - mCurrent->mLastAccessTimeUs <= kRecentAccessUs
+            && mCurrent->runway() < kMinRunwayBytes) {
+        return;
+    }
+
+    ALOGV("prefetching, %d bytes left to read at %lld",
+         target->runway(), target->mLastAccessPos);
+    switchToRange_l(target);
+}
+
+void NuCachedSource2::trimRanges_l() {
+    static const size_t kGrayArea = 1024 * 1024;
+
+    // The ranges not fetched into may use up to half of the cache,
+    // the data read from them a while ago goes first.
+    const size_t maxRetainedBytes = mHighwaterThresholdBytes / 2;
+    size_t retainedBytes =
+        totalCachedSize_l() - mCurrent->mCache.totalSize();
+
+    for (List<Range *>::iterator it = mRanges.begin();
+         it != mRanges.end() && retainedBytes > maxRetainedBytes; ++it) {
+        Range *range = *it;
+        if (range == mCurrent
+                || range->mLastAccessPos < range->mOffset + (off64_t)kGrayArea) {
+            continue;
+        }
+
+        size_t releasedBytes = range->mCache.releaseFromStart(
+                range->mLastAccessPos - range->mOffset - kGrayArea);
+        range->mOffset += releasedBytes;
+        retainedBytes -= releasedBytes;
+    }
+
+    // Then the least recently used ranges.
+    while (mRanges.size() > kMaxNumRanges
+            || retainedBytes > maxRetainedBytes) {
+        List<Range *>::iterator lru = mRanges.end();
+        for (List<Range *>::iterator it = mRanges.begin();
+             it != mRanges.end(); ++it) {
+            if (*it != mCurrent && (lru == mRanges.end()
+                    || (*it)->mLastAccessTimeUs < (*lru)->mLastAccessTimeUs)) {
+                lru = it;
+            }
+        }
+        CHECK(lru != mRanges.end());
+
+        Range *range = *lru;
+        ALOGI("evicting range %lld-%lld, %d hits, %d misses",
+             range->mOffset, range->end(),
+             range->mNumHits, range->mNumMisses);
+
+        retainedBytes -= range->mCache.totalSize();
+        mRanges.erase(lru);
+        delete range;
+        ++mNumEvictedRanges;
+    }
 }
 
 ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
@@ -461,12 +671,13 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
 
     // If the request can be completely satisfied from the cache, do so.
 
-    if (offset >= mCacheOffset
-            && offset + size <= mCacheOffset + mCache->totalSize()) {
-        size_t delta = offset - mCacheOffset;
-        mCache->copy(delta, data, size);
+    Range *range = findRange_l(offset, size);
+    if (range != NULL) {
+        range->mCache.copy(offset - range->mOffset, data, size);
 
-        mLastAccessPos = offset + size;
+        range->mLastAccessPos = offset + size;
+        range->mLastAccessTimeUs = ALooper::GetNowUs();
+        ++range->mNumHits;
 
         return size;
     }
@@ -489,7 +700,12 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
     mAsyncResult.clear();
 
     if (result > 0) {
-        mLastAccessPos = offset + result;
+        range = findRange_l(offset, result);
+        if (range != NULL) {
+            range->mLastAccessPos = offset + result;
+            range->mLastAccessTimeUs = ALooper::GetNowUs();
+            ++range->mNumMisses;
+        }
     }
 
     return (ssize_t)result;
@@ -497,7 +713,7 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
 
 size_t NuCachedSource2::cachedSize() {
     Mutex::Autolock autoLock(mLock);
-    return mCacheOffset + mCache->totalSize();
+    return mCurrent->end();
 }
 
 size_t NuCachedSource2::approxDataRemaining(status_t *finalStatus) {
@@ -513,11 +729,7 @@ size_t NuCachedSource2::approxDataRemaining_l(status_t *finalStatus) {
         *finalStatus = OK;
     }
 
-    off64_t lastBytePosCached = mCacheOffset + mCache->totalSize();
-    if (mLastAccessPos < lastBytePosCached) {
-        return lastBytePosCached - mLastAccessPos;
-    }
-    return 0;
+    return mCurrent->runway();
 }
 
 ssize_t NuCachedSource2::readInternal(off64_t offset, void *data, size_t size) {
@@ -527,46 +739,61 @@ ssize_t NuCachedSource2::readInternal(off64_t offset, void *data, size_t size) {
 
     Mutex::Autolock autoLock(mLock);
 
+    if (offset < mCurrent->mOffset || offset >= mCurrent->end()) {
+        static const off64_t kPadding = 256 * 1024;
+
+        // Keep fetching into a range that has the data, or ends shortly
+        // before it, rather than starting another one.
+        Range *range = NULL;
+        for (List<Range *>::iterator it = mRanges.begin();
+             it != mRanges.end(); ++it) {
+            if (offset >= (*it)->mOffset
+                    && offset < (*it)->end() + kPadding) {
+                range = *it;
+                break;
+            }
+        }
+
+        if (range == NULL) {
+            // In the presence of multiple decoded streams, once of them will
+            // trigger this seek request, the other one will request data "nearby"
+            // soon, adjust the seek position so that that subsequent request
+            // does not trigger another seek.
+            off64_t seekOffset = (offset > kPadding) ? offset - kPadding : 0;
+
+            seekInternal_l(seekOffset);
+        } else if (range != mCurrent) {
+            switchToRange_l(range);
+        }
+    }
+
     if (!mFetching) {
-        mLastAccessPos = offset;
+        mCurrent->mLastAccessPos = offset;
         restartPrefetcherIfNecessary_l(
                 false, // ignoreLowWaterThreshold
                 true); // force
     }
 
-    if (offset < mCacheOffset
-            || offset >= (off64_t)(mCacheOffset + mCache->totalSize())) {
-        static const off64_t kPadding = 256 * 1024;
-
-        // In the presence of multiple decoded streams, once of them will
-        // trigger this seek request, the other one will request data "nearby"
-        // soon, adjust the seek position so that that subsequent request
-        // does not trigger another seek.
-        off64_t seekOffset = (offset > kPadding) ? offset - kPadding : 0;
-
-        seekInternal_l(seekOffset);
-    }
-
-    size_t delta = offset - mCacheOffset;
+    size_t delta = offset - mCurrent->mOffset;
 
     if (mFinalStatus != OK) {
-        if (delta >= mCache->totalSize()) {
+        if (delta >= mCurrent->mCache.totalSize()) {
             return mFinalStatus;
         }
 
-        size_t avail = mCache->totalSize() - delta;
+        size_t avail = mCurrent->mCache.totalSize() - delta;
 
         if (avail > size) {
             avail = size;
         }
 
-        mCache->copy(delta, data, avail);
+        mCurrent->mCache.copy(delta, data, avail);
 
         return avail;
     }
 
-    if (offset + size <= mCacheOffset + mCache->totalSize()) {
-        mCache->copy(delta, data, size);
+    if (offset + size <= mCurrent->end()) {
+        mCurrent->mCache.copy(delta, data, size);
 
         return size;
     }
@@ -577,22 +804,11 @@ ssize_t NuCachedSource2::readInternal(off64_t offset, void *data, size_t size) {
 }
 
 status_t NuCachedSource2::seekInternal_l(off64_t offset) {
-    mLastAccessPos = offset;
-
-    if (offset >= mCacheOffset
-            && offset <= (off64_t)(mCacheOffset + mCache->totalSize())) {
-        return OK;
-    }
-
     ALOGI("new range: offset= %lld", offset);
 
-    mCacheOffset = offset;
-
-    size_t totalSize = mCache->totalSize();
-    CHECK_EQ(mCache->releaseFromStart(totalSize), totalSize);
-
-    mFinalStatus = OK;
-    mFetching = true;
+    Range *range = new Range(offset);
+    mRanges.push_back(range);
+    switchToRange_l(range);
 
     return OK;
 }
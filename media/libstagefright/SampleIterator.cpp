@@ -33,11 +33,7 @@ namespace android {
 SampleIterator::SampleIterator(SampleTable *table)
     : mTable(table),
       mInitialized(false),
-      mTimeToSampleIndex(0),
-      mTTSSampleIndex(0),
-      mTTSSampleTime(0),
-      mTTSCount(0),
-      mTTSDuration(0) {
+      mTimeToSampleIndex(0) {
     reset();
 }
 
@@ -124,13 +120,6 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
     }
 
     mCurrentSampleSize = mCurrentChunkSampleSizes[chunkRelativeSampleIndex];
-    if (sampleIndex < mTTSSampleIndex) {
-        mTimeToSampleIndex = 0;
-        mTTSSampleIndex = 0;
-        mTTSSampleTime = 0;
-        mTTSCount = 0;
-        mTTSDuration = 0;
-    }
 
     status_t err;
     if ((err = findSampleTime(sampleIndex, &mCurrentSampleTime)) != OK) {
@@ -148,34 +137,48 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
 status_t SampleIterator::findChunkRange(uint32_t sampleIndex) {
     CHECK(sampleIndex >= mFirstChunkSampleIndex);
 
-    while (sampleIndex >= mStopChunkSampleIndex) {
-        if (mSampleToChunkIndex == mTable->mNumSampleToChunkOffsets) {
-            return ERROR_OUT_OF_RANGE;
-        }
+    uint32_t numEntries = mTable->mNumSampleToChunkOffsets;
+    const SampleTable::SampleToChunkEntry *entries =
+        mTable->mSampleToChunkEntries;
 
-        mFirstChunkSampleIndex = mStopChunkSampleIndex;
+    if (numEntries == 0) {
+        return ERROR_OUT_OF_RANGE;
+    }
 
-        const SampleTable::SampleToChunkEntry *entry =
-            &mTable->mSampleToChunkEntries[mSampleToChunkIndex];
+    // Finds the last entry starting at or before the sample, the entries
+    // holding no samples start where the next one does.
+    uint32_t left = mSampleToChunkIndex > 0 ? mSampleToChunkIndex - 1 : 0;
+    uint32_t right = numEntries;
+    while (right - left > 1) {
+        uint32_t center = (left + right) / 2;
+        if (entries[center].firstSample <= sampleIndex) {
+            left = center;
+        } else {
+            right = center;
+        }
+    }
 
-        mFirstChunk = entry->startChunk;
-        mSamplesPerChunk = entry->samplesPerChunk;
-        mChunkDesc = entry->chunkDesc;
+    const SampleTable::SampleToChunkEntry *entry = &entries[left];
 
-        if (mSampleToChunkIndex + 1 < mTable->mNumSampleToChunkOffsets) {
-            mStopChunk = entry[1].startChunk;
+    mFirstChunk = entry->startChunk;
+    mFirstChunkSampleIndex = entry->firstSample;
+    mSamplesPerChunk = entry->samplesPerChunk;
+    mChunkDesc = entry->chunkDesc;
 
-            mStopChunkSampleIndex =
-                mFirstChunkSampleIndex
-                    + (mStopChunk - mFirstChunk) * mSamplesPerChunk;
-        } else {
-            mStopChunk = 0xffffffff;
-            mStopChunkSampleIndex = 0xffffffff;
+    if (left + 1 < numEntries) {
+        mStopChunk = entry[1].startChunk;
+        mStopChunkSampleIndex = entry[1].firstSample;
+    } else {
+        if (mSamplesPerChunk == 0) {
+            return ERROR_MALFORMED;
         }
 
-        ++mSampleToChunkIndex;
+        mStopChunk = 0xffffffff;
+        mStopChunkSampleIndex = 0xffffffff;
     }
 
+    mSampleToChunkIndex = left + 1;
+
     return OK;
 }
 
@@ -186,6 +189,16 @@ status_t SampleIterator::getChunkOffset(uint32_t chunk, off64_t *offset) {
         return ERROR_OUT_OF_RANGE;
     }
 
+    if (mTable->mChunkOffsets32 != NULL) {
+        *offset = mTable->mChunkOffsets32[chunk];
+        return OK;
+    }
+
+    if (mTable->mChunkOffsets64 != NULL) {
+        *offset = mTable->mChunkOffsets64[chunk];
+        return OK;
+    }
+
     if (mTable->mChunkOffsetType == SampleTable::kChunkOffsetType32) {
         uint32_t offset32;
 
@@ -227,6 +240,21 @@ status_t SampleIterator::getSampleSizeDirect(
         return OK;
     }
 
+    if (mTable->mSampleSizes != NULL) {
+        switch (mTable->mSampleSizeBytes) {
+            case 4:
+                *size = ((const uint32_t *)mTable->mSampleSizes)[sampleIndex];
+                break;
+            case 2:
+                *size = ((const uint16_t *)mTable->mSampleSizes)[sampleIndex];
+                break;
+            default:
+                *size = mTable->mSampleSizes[sampleIndex];
+                break;
+        }
+        return OK;
+    }
+
     switch (mTable->mSampleSizeFieldSize) {
         case 32:
         {
@@ -291,21 +319,22 @@ status_t SampleIterator::findSampleTime(
         return ERROR_OUT_OF_RANGE;
     }
 
-    while (sampleIndex >= mTTSSampleIndex + mTTSCount) {
+    const SampleTable::TimeToSampleEntry *entry =
+        &mTable->mTimeToSample[mTimeToSampleIndex];
+
+    if (mTimeToSampleIndex >= mTable->mTimeToSampleCount
+            || sampleIndex < entry->firstSample
+            || sampleIndex - entry->firstSample >= entry->sampleCount) {
+        mTimeToSampleIndex = mTable->findTimeToSampleEntry(sampleIndex);
         if (mTimeToSampleIndex == mTable->mTimeToSampleCount) {
             return ERROR_OUT_OF_RANGE;
         }
 
-        mTTSSampleIndex += mTTSCount;
-        mTTSSampleTime += mTTSCount * mTTSDuration;
-
-        mTTSCount = mTable->mTimeToSample[2 * mTimeToSampleIndex];
-        mTTSDuration = mTable->mTimeToSample[2 * mTimeToSampleIndex + 1];
-
-        ++mTimeToSampleIndex;
+        entry = &mTable->mTimeToSample[mTimeToSampleIndex];
     }
 
-    *time = mTTSSampleTime + mTTSDuration * (sampleIndex - mTTSSampleIndex);
+    *time = entry->firstTime
+        + entry->sampleDelta * (sampleIndex - entry->firstSample);
 
     *time += mTable->getCompositionTimeOffset(sampleIndex);
 
@@ -22,11 +22,18 @@
 #include "include/SampleIterator.h"
 
 #include <arpa/inet.h>
+#include <stdlib.h>
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/DataSource.h>
 #include <media/stagefright/Utils.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace android {
 
 // static
@@ -42,6 +49,7 @@ const uint32_t SampleTable::kSampleSizeTypeCompact = FOURCC('s', 't', 'z', '2');
 
 struct SampleTable::CompositionDeltaLookup {
     CompositionDeltaLookup();
+    ~CompositionDeltaLookup();
 
     void setEntries(
             const uint32_t *deltaEntries, size_t numDeltaEntries);
@@ -54,8 +62,10 @@ private:
     const uint32_t *mDeltaEntries;
     size_t mNumDeltaEntries;
 
+    // Index of the first sample of each entry.
+    uint32_t *mFirstSamples;
+
     size_t mCurrentDeltaEntry;
-    size_t mCurrentEntrySampleIndex;
 
     DISALLOW_EVIL_CONSTRUCTORS(CompositionDeltaLookup);
 };
@@ -63,8 +73,13 @@ private:
 SampleTable::CompositionDeltaLookup::CompositionDeltaLookup()
     : mDeltaEntries(NULL),
       mNumDeltaEntries(0),
-      mCurrentDeltaEntry(0),
-      mCurrentEntrySampleIndex(0) {
+      mFirstSamples(NULL),
+      mCurrentDeltaEntry(0) {
+}
+
+SampleTable::CompositionDeltaLookup::~CompositionDeltaLookup() {
+    delete[] mFirstSamples;
+    mFirstSamples = NULL;
 }
 
 void SampleTable::CompositionDeltaLookup::setEntries(
@@ -74,33 +89,51 @@ void SampleTable::CompositionDeltaLookup::setEntries(
     mDeltaEntries = deltaEntries;
     mNumDeltaEntries = numDeltaEntries;
     mCurrentDeltaEntry = 0;
-    mCurrentEntrySampleIndex = 0;
+
+    delete[] mFirstSamples;
+    mFirstSamples = new uint32_t[numDeltaEntries];
+
+    uint64_t firstSample = 0;
+    for (size_t i = 0; i < numDeltaEntries; ++i) {
+        mFirstSamples[i] =
+            firstSample < 0xffffffff ? (uint32_t)firstSample : 0xffffffff;
+        firstSample += deltaEntries[2 * i];
+    }
 }
 
 uint32_t SampleTable::CompositionDeltaLookup::getCompositionTimeOffset(
         uint32_t sampleIndex) {
     Mutex::Autolock autolock(mLock);
 
-    if (mDeltaEntries == NULL) {
+    if (mDeltaEntries == NULL || mNumDeltaEntries == 0) {
         return 0;
     }
 
-    if (sampleIndex < mCurrentEntrySampleIndex) {
-        mCurrentDeltaEntry = 0;
-        mCurrentEntrySampleIndex = 0;
-    }
+    size_t i = mCurrentDeltaEntry;
+    if (sampleIndex < mFirstSamples[i]
+            || sampleIndex - mFirstSamples[i] >= mDeltaEntries[2 * i]) {
+        // Not in the current entry, find the last one starting at or
+        // before the sample.
+        size_t left = 0;
+        size_t right = mNumDeltaEntries;
+        while (right - left > 1) {
+            size_t center = (left + right) / 2;
+            if (mFirstSamples[center] <= sampleIndex) {
+                left = center;
+            } else {
+                right = center;
+            }
+        }
 
-    while (mCurrentDeltaEntry < mNumDeltaEntries) {
-        uint32_t sampleCount = mDeltaEntries[2 * mCurrentDeltaEntry];
-        if (sampleIndex < mCurrentEntrySampleIndex + sampleCount) {
-            return mDeltaEntries[2 * mCurrentDeltaEntry + 1];
+        i = left;
+        if (sampleIndex - mFirstSamples[i] >= mDeltaEntries[2 * i]) {
+            return 0;
         }
 
-        mCurrentEntrySampleIndex += sampleCount;
-        ++mCurrentDeltaEntry;
+        mCurrentDeltaEntry = i;
     }
 
-    return 0;
+    return mDeltaEntries[2 * i + 1];
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -110,14 +143,22 @@ SampleTable::SampleTable(const sp<DataSource> &source)
       mChunkOffsetOffset(-1),
       mChunkOffsetType(0),
       mNumChunkOffsets(0),
+      mChunkOffsets32(NULL),
+      mChunkOffsets64(NULL),
       mSampleToChunkOffset(-1),
       mNumSampleToChunkOffsets(0),
       mSampleSizeOffset(-1),
       mSampleSizeFieldSize(0),
       mDefaultSampleSize(0),
       mNumSampleSizes(0),
+      mSampleSizes(NULL),
+      mSampleSizeBytes(0),
+      mMaxSampleSize(0),
       mTimeToSampleCount(0),
       mTimeToSample(NULL),
+      mTotalTimeToSampleCount(0),
+      mTotalDuration(0),
+      mSampleTimesInOrder(false),
       mSampleTimeEntries(NULL),
       mCompositionTimeDeltaEntries(NULL),
       mNumCompositionTimeDeltaEntries(0),
@@ -125,7 +166,6 @@ SampleTable::SampleTable(const sp<DataSource> &source)
       mSyncSampleOffset(-1),
       mNumSyncSamples(0),
       mSyncSamples(NULL),
-      mLastSyncSampleIndex(0),
       mSampleToChunkEntries(NULL) {
     mSampleIterator = new SampleIterator(this);
 }
@@ -149,6 +189,15 @@ SampleTable::~SampleTable() {
     delete[] mTimeToSample;
     mTimeToSample = NULL;
 
+    delete[] mSampleSizes;
+    mSampleSizes = NULL;
+
+    delete[] mChunkOffsets64;
+    mChunkOffsets64 = NULL;
+
+    delete[] mChunkOffsets32;
+    mChunkOffsets32 = NULL;
+
     delete mSampleIterator;
     mSampleIterator = NULL;
 }
@@ -188,13 +237,38 @@ status_t SampleTable::setChunkOffsetParams(
 
     mNumChunkOffsets = U32_AT(&header[4]);
 
+    uint64_t tableSize = (uint64_t)mNumChunkOffsets
+        * (mChunkOffsetType == kChunkOffsetType32 ? 4 : 8);
+
+    if (data_size < 8 + tableSize) {
+        return ERROR_MALFORMED;
+    }
+
+    if (tableSize > kMaxCachedTableSize) {
+        return OK;
+    }
+
     if (mChunkOffsetType == kChunkOffsetType32) {
-        if (data_size < 8 + mNumChunkOffsets * 4) {
-            return ERROR_MALFORMED;
+        mChunkOffsets32 = new uint32_t[mNumChunkOffsets];
+        if (mDataSource->readAt(
+                    data_offset + 8, mChunkOffsets32, tableSize)
+                < (ssize_t)tableSize) {
+            return ERROR_IO;
+        }
+
+        for (uint32_t i = 0; i < mNumChunkOffsets; ++i) {
+            mChunkOffsets32[i] = ntohl(mChunkOffsets32[i]);
         }
     } else {
-        if (data_size < 8 + mNumChunkOffsets * 8) {
-            return ERROR_MALFORMED;
+        mChunkOffsets64 = new uint64_t[mNumChunkOffsets];
+        if (mDataSource->readAt(
+                    data_offset + 8, mChunkOffsets64, tableSize)
+                < (ssize_t)tableSize) {
+            return ERROR_IO;
+        }
+
+        for (uint32_t i = 0; i < mNumChunkOffsets; ++i) {
+            mChunkOffsets64[i] = ntoh64(mChunkOffsets64[i]);
         }
     }
 
@@ -226,29 +300,51 @@ status_t SampleTable::setSampleToChunkParams(
 
     mNumSampleToChunkOffsets = U32_AT(&header[4]);
 
-    if (data_size < 8 + mNumSampleToChunkOffsets * 12) {
+    uint64_t tableSize = (uint64_t)mNumSampleToChunkOffsets * 12;
+    if (data_size < 8 + tableSize) {
         return ERROR_MALFORMED;
     }
 
+    uint8_t *buffer = new uint8_t[tableSize];
+    if (mDataSource->readAt(
+                mSampleToChunkOffset + 8, buffer, tableSize)
+            != (ssize_t)tableSize) {
+        delete[] buffer;
+        return ERROR_IO;
+    }
+
     mSampleToChunkEntries =
         new SampleToChunkEntry[mNumSampleToChunkOffsets];
 
+    uint64_t firstSample = 0;
     for (uint32_t i = 0; i < mNumSampleToChunkOffsets; ++i) {
-        uint8_t buffer[12];
-        if (mDataSource->readAt(
-                    mSampleToChunkOffset + 8 + i * 12, buffer, sizeof(buffer))
-                != (ssize_t)sizeof(buffer)) {
-            return ERROR_IO;
+        const uint8_t *entry = &buffer[i * 12];
+
+        // The chunk index is 1 based in the spec, and the entries must be
+        // in increasing chunk order for them to be searched.
+        uint32_t startChunk = U32_AT(entry);
+        if (startChunk < 1 || (i > 0
+                && startChunk - 1 < mSampleToChunkEntries[i - 1].startChunk)) {
+            delete[] buffer;
+            return ERROR_MALFORMED;
         }
 
-        CHECK(U32_AT(buffer) >= 1);  // chunk index is 1 based in the spec.
+        if (i > 0) {
+            const SampleToChunkEntry &prev = mSampleToChunkEntries[i - 1];
+            firstSample += (uint64_t)(startChunk - 1 - prev.startChunk)
+                * prev.samplesPerChunk;
+        }
 
         // We want the chunk index to be 0-based.
-        mSampleToChunkEntries[i].startChunk = U32_AT(buffer) - 1;
-        mSampleToChunkEntries[i].samplesPerChunk = U32_AT(&buffer[4]);
-        mSampleToChunkEntries[i].chunkDesc = U32_AT(&buffer[8]);
+        mSampleToChunkEntries[i].startChunk = startChunk - 1;
+        mSampleToChunkEntries[i].samplesPerChunk = U32_AT(&entry[4]);
+        mSampleToChunkEntries[i].chunkDesc = U32_AT(&entry[8]);
+        mSampleToChunkEntries[i].firstSample =
+            firstSample < 0xffffffff ? (uint32_t)firstSample : 0xffffffff;
     }
 
+    delete[] buffer;
+
     return OK;
 }
 
@@ -287,7 +383,7 @@ status_t SampleTable::setSampleSizeParams(
             return OK;
         }
 
-        if (data_size < 12 + mNumSampleSizes * 4) {
+        if (data_size < 12 + (uint64_t)mNumSampleSizes * 4) {
             return ERROR_MALFORMED;
         }
     } else {
@@ -304,11 +400,153 @@ status_t SampleTable::setSampleSizeParams(
             return ERROR_MALFORMED;
         }
 
-        if (data_size < 12 + (mNumSampleSizes * mSampleSizeFieldSize + 4) / 8) {
+        if (data_size < 12
+                + ((uint64_t)mNumSampleSizes * mSampleSizeFieldSize + 4) / 8) {
             return ERROR_MALFORMED;
         }
     }
 
+    if ((uint64_t)mNumSampleSizes * mSampleSizeFieldSize / 8
+            > kMaxCachedTableSize) {
+        return OK;
+    }
+
+    return readSampleSizes(data_offset);
+}
+
+// Converts big endian 32-bit sample sizes in place and returns the largest.
+static uint32_t convertSampleSizes(uint32_t *sizes, size_t count) {
+    size_t i = 0;
+    uint32_t maxSize = 0;
+
+#if defined(__ARM_NEON__)
+    uint32x4_t maxSizes = vdupq_n_u32(0);
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t x = vreinterpretq_u32_u8(
+                vrev32q_u8(vld1q_u8((const uint8_t *)&sizes[i])));
+        vst1q_u32(&sizes[i], x);
+        maxSizes = vmaxq_u32(maxSizes, x);
+    }
+    uint32x2_t m = vpmax_u32(vget_low_u32(maxSizes), vget_high_u32(maxSizes));
+    m = vpmax_u32(m, m);
+    maxSize = vget_lane_u32(m, 0);
+#elif defined(__SSE2__)
+    // SSE2 has no unsigned compare, the sizes are biased to compare them
+    // as signed.
+    const __m128i bias = _mm_set1_epi32(0x80000000);
+    __m128i maxSizes = bias;
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)&sizes[i]);
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i *)&sizes[i], x);
+
+        x = _mm_xor_si128(x, bias);
+        __m128i greater = _mm_cmpgt_epi32(x, maxSizes);
+        maxSizes = _mm_or_si128(
+                _mm_and_si128(greater, x), _mm_andnot_si128(greater, maxSizes));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, _mm_xor_si128(maxSizes, bias));
+    for (size_t j = 0; j < 4; ++j) {
+        if (lanes[j] > maxSize) {
+            maxSize = lanes[j];
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        sizes[i] = ntohl(sizes[i]);
+        if (sizes[i] > maxSize) {
+            maxSize = sizes[i];
+        }
+    }
+
+    return maxSize;
+}
+
+status_t SampleTable::readSampleSizes(off64_t data_offset) {
+    size_t count = mNumSampleSizes;
+    size_t size = ((uint64_t)count * mSampleSizeFieldSize + 4) / 8;
+
+    uint8_t *data = new uint8_t[size > 0 ? size : 1];
+    if (mDataSource->readAt(data_offset + 12, data, size) < (ssize_t)size) {
+        delete[] data;
+        return ERROR_IO;
+    }
+
+    mMaxSampleSize = 0;
+
+    switch (mSampleSizeFieldSize) {
+        case 32:
+        {
+            uint32_t *sizes = (uint32_t *)data;
+            mMaxSampleSize = convertSampleSizes(sizes, count);
+
+            if (mMaxSampleSize <= 0xffff) {
+                uint8_t *data16 = new uint8_t[count * 2 > 0 ? count * 2 : 1];
+                uint16_t *sizes16 = (uint16_t *)data16;
+                for (size_t i = 0; i < count; ++i) {
+                    sizes16[i] = sizes[i];
+                }
+
+                delete[] data;
+                data = data16;
+                mSampleSizeBytes = 2;
+            } else {
+                mSampleSizeBytes = 4;
+            }
+            break;
+        }
+
+        case 16:
+        {
+            uint16_t *sizes = (uint16_t *)data;
+            for (size_t i = 0; i < count; ++i) {
+                sizes[i] = ntohs(sizes[i]);
+                if (sizes[i] > mMaxSampleSize) {
+                    mMaxSampleSize = sizes[i];
+                }
+            }
+            mSampleSizeBytes = 2;
+            break;
+        }
+
+        case 8:
+        {
+            for (size_t i = 0; i < count; ++i) {
+                if (data[i] > mMaxSampleSize) {
+                    mMaxSampleSize = data[i];
+                }
+            }
+            mSampleSizeBytes = 1;
+            break;
+        }
+
+        default:
+        {
+            CHECK_EQ(mSampleSizeFieldSize, 4u);
+
+            // Unpack the nibbles to a byte each.
+            uint8_t *sizes = new uint8_t[count > 0 ? count : 1];
+            for (size_t i = 0; i < count; ++i) {
+                uint8_t x = data[i / 2];
+                sizes[i] = (i & 1) ? x & 0x0f : x >> 4;
+                if (sizes[i] > mMaxSampleSize) {
+                    mMaxSampleSize = sizes[i];
+                }
+            }
+
+            delete[] data;
+            data = sizes;
+            mSampleSizeBytes = 1;
+            break;
+        }
+    }
+
+    mSampleSizes = data;
+
     return OK;
 }
 
@@ -329,19 +567,41 @@ status_t SampleTable::setTimeToSampleParams(
         return ERROR_MALFORMED;
     }
 
-    mTimeToSampleCount = U32_AT(&header[4]);
-    mTimeToSample = new uint32_t[mTimeToSampleCount * 2];
+    uint32_t count = U32_AT(&header[4]);
+    if (data_size < 8 + (uint64_t)count * 8) {
+        return ERROR_MALFORMED;
+    }
+
+    uint32_t *entries = new uint32_t[count * 2];
 
-    size_t size = sizeof(uint32_t) * mTimeToSampleCount * 2;
+    size_t size = sizeof(uint32_t) * count * 2;
     if (mDataSource->readAt(
-                data_offset + 8, mTimeToSample, size) < (ssize_t)size) {
+                data_offset + 8, entries, size) < (ssize_t)size) {
+        delete[] entries;
         return ERROR_IO;
     }
 
-    for (uint32_t i = 0; i < mTimeToSampleCount * 2; ++i) {
-        mTimeToSample[i] = ntohl(mTimeToSample[i]);
+    mTimeToSampleCount = count;
+    mTimeToSample = new TimeToSampleEntry[count];
+
+    // The decoding time wraps around like it does when summed up sample by
+    // sample, the totals tell whether it did.
+    uint32_t firstTime = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        TimeToSampleEntry *entry = &mTimeToSample[i];
+        entry->sampleCount = ntohl(entries[2 * i]);
+        entry->sampleDelta = ntohl(entries[2 * i + 1]);
+        entry->firstSample = mTotalTimeToSampleCount < 0xffffffff
+            ? (uint32_t)mTotalTimeToSampleCount : 0xffffffff;
+        entry->firstTime = firstTime;
+
+        firstTime += entry->sampleCount * entry->sampleDelta;
+        mTotalTimeToSampleCount += entry->sampleCount;
+        mTotalDuration += (uint64_t)entry->sampleCount * entry->sampleDelta;
     }
 
+    delete[] entries;
+
     return OK;
 }
 
@@ -424,8 +684,19 @@ status_t SampleTable::setSyncSampleParams(off64_t data_offset, size_t data_size)
         return ERROR_IO;
     }
 
+    bool sorted = true;
     for (size_t i = 0; i < mNumSyncSamples; ++i) {
         mSyncSamples[i] = ntohl(mSyncSamples[i]) - 1;
+
+        if (i > 0 && mSyncSamples[i] < mSyncSamples[i - 1]) {
+            sorted = false;
+        }
+    }
+
+    if (!sorted) {
+        ALOGW("Sync sample table is not in increasing order.");
+        qsort(mSyncSamples, mNumSyncSamples, sizeof(uint32_t),
+              CompareIncreasingSampleIndex);
     }
 
     return OK;
@@ -442,8 +713,20 @@ uint32_t SampleTable::countSamples() const {
 status_t SampleTable::getMaxSampleSize(size_t *max_size) {
     Mutex::Autolock autoLock(mLock);
 
+    if (mSampleSizes != NULL) {
+        *max_size = mMaxSampleSize;
+        return OK;
+    }
+
     *max_size = 0;
 
+    if (mDefaultSampleSize > 0) {
+        if (mNumSampleSizes > 0) {
+            *max_size = mDefaultSampleSize;
+        }
+        return OK;
+    }
+
     for (uint32_t i = 0; i < mNumSampleSizes; ++i) {
         size_t sample_size;
         status_t err = getSampleSize_l(i, &sample_size);
@@ -478,10 +761,28 @@ int SampleTable::CompareIncreasingTime(const void *_a, const void *_b) {
     return 0;
 }
 
+// static
+int SampleTable::CompareIncreasingSampleIndex(const void *_a, const void *_b) {
+    uint32_t a = *(const uint32_t *)_a;
+    uint32_t b = *(const uint32_t *)_b;
+
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
 void SampleTable::buildSampleEntriesTable() {
     Mutex::Autolock autoLock(mLock);
 
-    if (mSampleTimeEntries != NULL) {
+    if (mSampleTimeEntries != NULL || mSampleTimesInOrder) {
+        return;
+    }
+
+    if (mCompositionTimeDeltaEntries == NULL
+            && mTotalTimeToSampleCount >= mNumSampleSizes
+            && mTotalDuration <= 0xffffffff) {
+        // Without composition offsets the sample times are the decoding
+        // times, already in increasing order, and are searched through the
+        // time to sample entries.
+        mSampleTimesInOrder = true;
         return;
     }
 
@@ -491,8 +792,8 @@ void SampleTable::buildSampleEntriesTable() {
     uint32_t sampleTime = 0;
 
     for (uint32_t i = 0; i < mTimeToSampleCount; ++i) {
-        uint32_t n = mTimeToSample[2 * i];
-        uint32_t delta = mTimeToSample[2 * i + 1];
+        uint32_t n = mTimeToSample[i].sampleCount;
+        uint32_t delta = mTimeToSample[i].sampleDelta;
 
         for (uint32_t j = 0; j < n; ++j) {
             if (sampleIndex < mNumSampleSizes) {
@@ -519,15 +820,32 @@ void SampleTable::buildSampleEntriesTable() {
           CompareIncreasingTime);
 }
 
+uint32_t SampleTable::getSortedSampleTime(uint32_t i) const {
+    if (mSampleTimeEntries != NULL) {
+        return mSampleTimeEntries[i].mCompositionTime;
+    }
+
+    const TimeToSampleEntry *entry = &mTimeToSample[findTimeToSampleEntry(i)];
+    return entry->firstTime + entry->sampleDelta * (i - entry->firstSample);
+}
+
+uint32_t SampleTable::getSortedSampleIndex(uint32_t i) const {
+    return mSampleTimeEntries != NULL ? mSampleTimeEntries[i].mSampleIndex : i;
+}
+
 status_t SampleTable::findSampleAtTime(
         uint32_t req_time, uint32_t *sample_index, uint32_t flags) {
     buildSampleEntriesTable();
 
+    if (mNumSampleSizes == 0) {
+        return ERROR_OUT_OF_RANGE;
+    }
+
     uint32_t left = 0;
     uint32_t right = mNumSampleSizes;
     while (left < right) {
         uint32_t center = (left + right) / 2;
-        uint32_t centerTime = mSampleTimeEntries[center].mCompositionTime;
+        uint32_t centerTime = getSortedSampleTime(center);
 
         if (req_time < centerTime) {
             right = center;
@@ -553,8 +871,7 @@ status_t SampleTable::findSampleAtTime(
         case kFlagBefore:
         {
             while (closestIndex > 0
-                    && mSampleTimeEntries[closestIndex].mCompositionTime
-                            > req_time) {
+                    && getSortedSampleTime(closestIndex) > req_time) {
                 --closestIndex;
             }
             break;
@@ -563,8 +880,7 @@ status_t SampleTable::findSampleAtTime(
         case kFlagAfter:
         {
             while (closestIndex + 1 < mNumSampleSizes
-                    && mSampleTimeEntries[closestIndex].mCompositionTime
-                            < req_time) {
+                    && getSortedSampleTime(closestIndex) < req_time) {
                 ++closestIndex;
             }
             break;
@@ -578,13 +894,11 @@ status_t SampleTable::findSampleAtTime(
                 // Check left neighbour and pick closest.
                 uint32_t absdiff1 =
                     abs_difference(
-                            mSampleTimeEntries[closestIndex].mCompositionTime,
-                            req_time);
+                            getSortedSampleTime(closestIndex), req_time);
 
                 uint32_t absdiff2 =
                     abs_difference(
-                            mSampleTimeEntries[closestIndex - 1].mCompositionTime,
-                            req_time);
+                            getSortedSampleTime(closestIndex - 1), req_time);
 
                 if (absdiff1 > absdiff2) {
                     closestIndex = closestIndex - 1;
@@ -595,7 +909,7 @@ status_t SampleTable::findSampleAtTime(
         }
     }
 
-    *sample_index = mSampleTimeEntries[closestIndex].mSampleIndex;
+    *sample_index = getSortedSampleIndex(closestIndex);
 
     return OK;
 }
@@ -617,16 +931,7 @@ status_t SampleTable::findSyncSampleNear(
         return OK;
     }
 
-    uint32_t left = 0;
-    while (left < mNumSyncSamples) {
-        uint32_t x = mSyncSamples[left];
-
-        if (x >= start_sample_index) {
-            break;
-        }
-
-        ++left;
-    }
+    uint32_t left = findSyncSampleIndex(start_sample_index);
 
     if (left == mNumSyncSamples) {
         if (flags == kFlagAfter) {
@@ -646,26 +951,24 @@ status_t SampleTable::findSyncSampleNear(
 
         // our sample lies between sync samples x and y.
 
-        status_t err = mSampleIterator->seekTo(start_sample_index);
+        uint32_t sample_time;
+        status_t err = getSampleTime_l(start_sample_index, &sample_time);
         if (err != OK) {
             return err;
         }
 
-        uint32_t sample_time = mSampleIterator->getSampleTime();
-
-        err = mSampleIterator->seekTo(x);
+        uint32_t x_time;
+        err = getSampleTime_l(x, &x_time);
         if (err != OK) {
             return err;
         }
-        uint32_t x_time = mSampleIterator->getSampleTime();
 
-        err = mSampleIterator->seekTo(y);
+        uint32_t y_time;
+        err = getSampleTime_l(y, &y_time);
         if (err != OK) {
             return err;
         }
 
-        uint32_t y_time = mSampleIterator->getSampleTime();
-
         if (abs_difference(x_time, sample_time)
                 > abs_difference(y_time, sample_time)) {
             // Pick the sync sample closest (timewise) to the start-sample.
@@ -760,6 +1063,67 @@ status_t SampleTable::getSampleSize_l(
             sampleIndex, sampleSize);
 }
 
+status_t SampleTable::getSampleTime_l(
+        uint32_t sampleIndex, uint32_t *sampleTime) {
+    if (sampleIndex >= mNumSampleSizes) {
+        return ERROR_END_OF_STREAM;
+    }
+
+    uint32_t i = findTimeToSampleEntry(sampleIndex);
+    if (i == mTimeToSampleCount) {
+        return ERROR_OUT_OF_RANGE;
+    }
+
+    const TimeToSampleEntry *entry = &mTimeToSample[i];
+    *sampleTime = entry->firstTime
+        + entry->sampleDelta * (sampleIndex - entry->firstSample)
+        + getCompositionTimeOffset(sampleIndex);
+
+    return OK;
+}
+
+uint32_t SampleTable::findTimeToSampleEntry(uint32_t sampleIndex) const {
+    if (mTimeToSampleCount == 0) {
+        return 0;
+    }
+
+    // Finds the last entry starting at or before the sample, the entries
+    // holding no samples start where the next one does.
+    uint32_t left = 0;
+    uint32_t right = mTimeToSampleCount;
+    while (right - left > 1) {
+        uint32_t center = (left + right) / 2;
+        if (mTimeToSample[center].firstSample <= sampleIndex) {
+            left = center;
+        } else {
+            right = center;
+        }
+    }
+
+    const TimeToSampleEntry *entry = &mTimeToSample[left];
+    if (sampleIndex - entry->firstSample >= entry->sampleCount) {
+        return mTimeToSampleCount;
+    }
+
+    return left;
+}
+
+uint32_t SampleTable::findSyncSampleIndex(uint32_t sampleIndex) const {
+    // The index of the first sync sample at or after the sample.
+    uint32_t left = 0;
+    uint32_t right = mNumSyncSamples;
+    while (left < right) {
+        uint32_t center = (left + right) / 2;
+        if (mSyncSamples[center] < sampleIndex) {
+            left = center + 1;
+        } else {
+            right = center;
+        }
+    }
+
+    return left;
+}
+
 status_t SampleTable::getMetaDataForSample(
         uint32_t sampleIndex,
         off64_t *offset,
@@ -791,19 +1155,11 @@ status_t SampleTable::getMetaDataForSample(
             // Every sample is a sync sample.
             *isSyncSample = true;
         } else {
-            size_t i = (mLastSyncSampleIndex < mNumSyncSamples)
-                    && (mSyncSamples[mLastSyncSampleIndex] <= sampleIndex)
-                ? mLastSyncSampleIndex : 0;
-
-            while (i < mNumSyncSamples && mSyncSamples[i] < sampleIndex) {
-                ++i;
-            }
+            uint32_t i = findSyncSampleIndex(sampleIndex);
 
             if (i < mNumSyncSamples && mSyncSamples[i] == sampleIndex) {
                 *isSyncSample = true;
             }
-
-            mLastSyncSampleIndex = i;
         }
     }
 
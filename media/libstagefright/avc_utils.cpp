@@ -26,6 +26,12 @@
 #include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/MetaData.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace android {
 
 unsigned parseUE(ABitReader *br) {
@@ -131,6 +137,61 @@ void FindAVCDimensions(
     }
 }
 
+ssize_t FindStartCode(const uint8_t *data, size_t size) {
+    size_t offset = 0;
+
+    // Tests 16 positions at a time for a 0x00 0x00 pair followed by 0x01.
+#if defined(__ARM_NEON__)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+    while (offset + 18 <= size) {
+        uint8x16_t a = vld1q_u8(&data[offset]);
+        uint8x16_t b = vld1q_u8(&data[offset + 1]);
+        uint8x16_t c = vld1q_u8(&data[offset + 2]);
+        uint8x16_t match = vandq_u8(
+                vceqq_u8(vorrq_u8(a, b), zero), vceqq_u8(c, one));
+        uint8x8_t any = vorr_u8(vget_low_u8(match), vget_high_u8(match));
+        if (vget_lane_u32(vreinterpret_u32_u8(vpmax_u8(any, any)), 0) != 0) {
+            break;
+        }
+        offset += 16;
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    while (offset + 18 <= size) {
+        __m128i a = _mm_loadu_si128((const __m128i *)&data[offset]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&data[offset + 1]);
+        __m128i c = _mm_loadu_si128((const __m128i *)&data[offset + 2]);
+        int mask = _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(_mm_or_si128(a, b), zero),
+                _mm_cmpeq_epi8(c, one)));
+        if (mask != 0) {
+            return offset + __builtin_ctz(mask);
+        }
+        offset += 16;
+    }
+#endif
+
+    // A byte greater than 0x01, or a 0x01 not preceded by two zeros, can't
+    // be part of a start code beginning at or before it.
+    while (offset + 2 < size) {
+        uint8_t x = data[offset + 2];
+        if (x > 0x01) {
+            offset += 3;
+        } else if (x == 0x01) {
+            if (data[offset] == 0x00 && data[offset + 1] == 0x00) {
+                return offset;
+            }
+            offset += 3;
+        } else {
+            ++offset;
+        }
+    }
+
+    return -1;
+}
+
 status_t getNextNALUnit(
         const uint8_t **_data, size_t *_size,
         const uint8_t **nalStart, size_t *nalSize,
@@ -166,25 +227,13 @@ status_t getNextNALUnit(
 
     size_t startOffset = offset;
 
-    for (;;) {
-        while (offset < size && data[offset] != 0x01) {
-            ++offset;
-        }
-
-        if (offset == size) {
-            if (startCodeFollows) {
-                offset = size + 2;
-                break;
-            }
-
-            return -EAGAIN;
-        }
-
-        if (data[offset - 1] == 0x00 && data[offset - 2] == 0x00) {
-            break;
-        }
-
-        ++offset;
+    ssize_t startCode = FindStartCode(&data[startOffset], size - startOffset);
+    if (startCode >= 0) {
+        offset = startOffset + startCode + 2;
+    } else if (startCodeFollows) {
+        offset = size + 2;
+    } else {
+        return -EAGAIN;
     }
 
     size_t endOffset = offset - 2;
@@ -97,6 +97,7 @@ LOCAL_SRC_FILES := \
  	pv_pow2.cpp \
  	pv_sine.cpp \
  	pv_sqrt.cpp \
+ 	pvmp4audiodecoderbatch.cpp \
  	pvmp4audiodecoderconfig.cpp \
  	pvmp4audiodecoderframe.cpp \
  	pvmp4audiodecodergetmemrequirements.cpp \
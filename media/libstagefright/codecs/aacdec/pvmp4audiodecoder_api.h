@@ -145,7 +145,8 @@ extern "C"
         MP4AUDEC_SUCCESS           =  0,
         MP4AUDEC_INVALID_FRAME     = 10,
         MP4AUDEC_INCOMPLETE_FRAME  = 20,
-        MP4AUDEC_LOST_FRAME_SYNC   = 30     /* Cannot happen since no ADTS */
+        MP4AUDEC_LOST_FRAME_SYNC   = 30,    /* ADTS only, also PVMP4AudioDecodeBatch */
+        MP4AUDEC_NO_MEMORY         = 40     /* Only from PVMP4AudioDecodeBatch */
     } tPVMP4AudioDecoderErrorCode;
 
 
@@ -328,6 +329,39 @@ extern "C"
 
     } tPVMP4AudioDecoderExternal;
 
+    /*
+     * Result of PVMP4AudioDecodeBatch(), the whole stream decoded to 16-bit
+     * interleaved PCM.
+     */
+    typedef struct
+#ifdef __cplusplus
+                tPVMP4AudioDecoderBatchOutput
+#endif
+    {
+        /*
+         * Allocated with malloc(), the caller frees it.
+         */
+        Int16  *pOutputBuffer;
+
+        /*
+         * Number of 16-bit samples in pOutputBuffer, all channels.
+         */
+        Int32   outputLength;
+
+        /*
+         * Number of raw data blocks decoded. A block that fails to decode
+         * is replaced by silence.
+         */
+        Int32   numFrames;
+
+        /*
+         * Like SoftAAC, the output is always stereo, at the sampling rate
+         * of the SBR decoder for AAC+ streams.
+         */
+        Int     desiredChannels;
+        Int32   samplingRate;
+    } tPVMP4AudioDecoderBatchOutput;
+
     /*----------------------------------------------------------------------------
     ; GLOBAL FUNCTION DEFINITIONS
     ; Function Prototype declaration
@@ -354,6 +388,16 @@ extern "C"
         tPVMP4AudioDecoderExternal  *pExt,
         void                        *pMem);
 
+    /*
+     * Decodes a whole ADTS stream held in memory for offline use, on
+     * numThreads threads, or one per online core if numThreads is 0.
+     */
+    OSCL_IMPORT_REF Int PVMP4AudioDecodeBatch(
+        const UChar                   *pInputBuffer,
+        Int32                         inputLength,
+        Int                           numThreads,
+        tPVMP4AudioDecoderBatchOutput *pOutput);
+
     Int PVMP4SetAudioConfig(
         tPVMP4AudioDecoderExternal  *pExt,
         void                        *pMem,
@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+
+ Pathname: pvmp4audiodecoderbatch.cpp
+
+------------------------------------------------------------------------------
+ INPUT AND OUTPUT DEFINITIONS
+
+ Inputs:
+    pInputBuffer = ADTS stream
+    inputLength = size of the stream in bytes
+    numThreads = number of decoding threads, 0 for one per online core
+
+ Outputs:
+    pOutput = PCM of the whole stream, see pvmp4audiodecoder_api.h
+
+ Returns:
+    MP4AUDEC_SUCCESS, MP4AUDEC_LOST_FRAME_SYNC if no ADTS frame was found,
+    MP4AUDEC_INVALID_FRAME if the first frame can not be decoded or
+    MP4AUDEC_NO_MEMORY
+
+------------------------------------------------------------------------------
+ FUNCTION DESCRIPTION
+
+ Decodes a whole ADTS stream for offline use, like extracting metadata or
+ transcoding, faster than PVMP4AudioDecodeFrame frame by frame.
+
+ The frames are located first with find_adts_syncword, a syncword is only
+ accepted if the frame it starts is followed by another one with the same
+ fixed header. The frames are then split in ranges that are decoded by a
+ pool of threads, each with its own decoder instance.
+
+ Each range starts decoding PRIME_FRAMES frames early and throws their
+ output away, so that the overlap of the filterbank and the window shape
+ carried from the previous frame are the ones of a decoder running over
+ the whole stream. For AAC-LC the output is then the same with any number
+ of threads. Long term prediction and SBR carry state further back, with
+ them the first frames of a range come close to, but are not exactly, the
+ serial output. Noise substitution draws from a random generator that
+ runs over the whole stream, so every noise substituted band of a range
+ gets different noise, of the same energy, than in the serial output.
+
+ Streams at 24 kHz and below are first tried with implicit SBR
+ signalling, as SoftAAC does. The decoder can not decode ADTS frames that
+ way when they carry no SBR data, such streams are decoded as plain AAC.
+
+------------------------------------------------------------------------------
+*/
+
+
+/*----------------------------------------------------------------------------
+; INCLUDES
+----------------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pv_audio_type_defs.h"
+#include "aac_mem_funcs.h"
+#include "s_bits.h"
+#include "find_adts_syncword.h"
+#include "pvmp4audiodecoder_api.h"
+
+/*----------------------------------------------------------------------------
+; DEFINES
+; Include all pre-processor statements here. Include conditional
+; compile variables also.
+----------------------------------------------------------------------------*/
+
+#define MAX_BATCH_THREADS       16
+
+/*
+ * Ranges are claimed by the threads as they go, a few per thread keep all
+ * of them busy until the end.
+ */
+#define RANGES_PER_THREAD       4
+#define MIN_FRAMES_PER_RANGE    64
+
+#define PRIME_FRAMES            2
+
+/* same as get_adts_header() */
+#define LENGTH_SYNCWORD         15
+#define ID_BIT_FILTER           0x7FFB
+#define SYNCWORD_15BITS         0x7FF8
+
+#define LENGTH_ADTS_HEADER      7
+
+/* first 32 bits of the header, without the variable ones */
+#define FIXED_HEADER_MASK       0xFFFFFFF0
+
+/* 1024 samples, 2 channels, SBR */
+#define MAX_OUTPUT_FRAME_SIZE   4096
+
+/*----------------------------------------------------------------------------
+; LOCAL STORE/BUFFER/POINTER DEFINITIONS
+; Variable declaration - defined here and used outside this module
+----------------------------------------------------------------------------*/
+
+typedef struct
+{
+    Int32   offset;
+    Int32   size;
+    Int32   firstBlock;
+    Int     numBlocks;
+} tBatchFrame;
+
+typedef struct
+{
+    const UChar     *pStream;
+    Int32           streamLength;
+
+    tBatchFrame     *pFrames;
+    Int32           numFrames;
+    Int32           numBlocks;
+    Int32           numRanges;
+
+    Int16           *pOutput;
+    Int32           outputFrameSize;
+    Bool            aacPlusEnabled;
+
+    pthread_mutex_t lock;
+    Int32           nextRange;
+    Int             status;
+} tBatchDecoder;
+
+/*----------------------------------------------------------------------------
+; LOCAL FUNCTION DEFINITIONS
+; Function Prototype declaration
+----------------------------------------------------------------------------*/
+
+static UInt32 read_header(const UChar *p)
+{
+    return ((UInt32)p[0] << 24) | ((UInt32)p[1] << 16) |
+           ((UInt32)p[2] << 8) | (UInt32)p[3];
+}
+
+/*
+ * Size of the ADTS frame at pos if it fits in the stream and is followed by
+ * another one with the same fixed header, or ends the stream, 0 otherwise
+ */
+static Int32 synched_frame(const UChar *pStream, Int32 length, Int32 pos,
+                           UInt32 first)
+{
+    if (pos + LENGTH_ADTS_HEADER > length)
+    {
+        return 0;
+    }
+
+    const UChar *p = pStream + pos;
+    UInt32 header = read_header(p) & FIXED_HEADER_MASK;
+    Int32 size = ((p[3] & 0x3) << 11) | (p[4] << 3) | (p[5] >> 5);
+
+    if (((header >> 17) & ID_BIT_FILTER) != SYNCWORD_15BITS ||
+            size < LENGTH_ADTS_HEADER || pos + size > length ||
+            (first != 0 && header != first))
+    {
+        return 0;
+    }
+
+    if (pos + size + 4 <= length &&
+            (read_header(p + size) & FIXED_HEADER_MASK) != header)
+    {
+        return 0;
+    }
+
+    return size;
+}
+
+/*
+ * Locates all frames of the stream, skipping data between frames that does
+ * not belong to the stream
+ */
+static Int32 index_frames(tBatchDecoder *pBatch)
+{
+    const UChar *pStream = pBatch->pStream;
+    Int32 length = pBatch->streamLength;
+    Int32 capacity = 0;
+    UInt32 first = 0;
+    BITS bits;
+
+    pv_memset(&bits, 0, sizeof(bits));
+    bits.pBuffer = (UChar *)pStream;
+    bits.availableBits = length << 3;
+    bits.inputBufferCurrentLength = length;
+
+    while ((Int32)(bits.usedBits >> 3) + LENGTH_ADTS_HEADER <= length)
+    {
+        Int32 pos = bits.usedBits >> 3;
+        Int32 size = synched_frame(pStream, length, pos, first);
+
+        if (size == 0)
+        {
+            /*
+             * Lost sync, search the next byte aligned syncword from the
+             * following byte on
+             */
+            UInt32 syncword = SYNCWORD_15BITS;
+
+            bits.usedBits = (pos + 1) << 3;
+            if (find_adts_syncword(&syncword, &bits, LENGTH_SYNCWORD,
+                                   ID_BIT_FILTER) != SUCCESS)
+            {
+                break;
+            }
+            bits.usedBits = (bits.usedBits - LENGTH_SYNCWORD) & ~7;
+            continue;
+        }
+
+        if (first == 0)
+        {
+            first = read_header(pStream + pos) & FIXED_HEADER_MASK;
+        }
+
+        if (pBatch->numFrames == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            tBatchFrame *pFrames = (tBatchFrame *)realloc(
+                                       pBatch->pFrames,
+                                       capacity * sizeof(tBatchFrame));
+            if (pFrames == NULL)
+            {
+                return -1;
+            }
+            pBatch->pFrames = pFrames;
+        }
+
+        tBatchFrame *pFrame = &pBatch->pFrames[pBatch->numFrames++];
+        pFrame->offset = pos;
+        pFrame->size = size;
+        pFrame->firstBlock = pBatch->numBlocks;
+        pFrame->numBlocks = (pStream[pos + 6] & 0x3) + 1;
+        pBatch->numBlocks += pFrame->numBlocks;
+
+        bits.usedBits = (pos + size) << 3;
+    }
+
+    return pBatch->numFrames;
+}
+
+static void init_decoder(tPVMP4AudioDecoderExternal *pExt, void *pMem,
+                         Bool aacPlusEnabled)
+{
+    pv_memset(pExt, 0, sizeof(*pExt));
+    pExt->outputFormat = OUTPUTFORMAT_16PCM_INTERLEAVED;
+    pExt->aacPlusEnabled = aacPlusEnabled;
+    pExt->desiredChannels = 2;
+
+    PVMP4AudioDecoderInitLibrary(pExt, pMem);
+}
+
+/*
+ * Decodes the raw data blocks of the frame, to pOutput if it is not NULL
+ */
+static Int decode_frame(const tBatchDecoder *pBatch, const tBatchFrame *pFrame,
+                        tPVMP4AudioDecoderExternal *pExt, void *pMem,
+                        Int16 *pScratch, Int16 *pOutput)
+{
+    Int status = MP4AUDEC_SUCCESS;
+    Int block;
+
+    pExt->inputBufferUsedLength = 0;
+
+    for (block = 0; block < pFrame->numBlocks; block++)
+    {
+        pExt->pInputBuffer = (UChar *)pBatch->pStream + pFrame->offset;
+        pExt->inputBufferCurrentLength = pFrame->size;
+        pExt->inputBufferMaxLength = 0;
+        pExt->remainderBits = 0;
+        pExt->pOutputBuffer = pScratch;
+        pExt->pOutputBuffer_plus = &pScratch[2048];
+        pExt->repositionFlag = false;
+
+        status = PVMP4AudioDecodeFrame(pExt, pMem);
+
+        Int32 size = pExt->frameLength * pExt->desiredChannels *
+                     pExt->aacPlusUpsamplingFactor;
+        if (status == MP4AUDEC_SUCCESS && size != pBatch->outputFrameSize)
+        {
+            status = MP4AUDEC_INVALID_FRAME;
+        }
+
+        if (status != MP4AUDEC_SUCCESS)
+        {
+            break;
+        }
+
+        if (pOutput != NULL)
+        {
+            pv_memcpy(pOutput + block * pBatch->outputFrameSize, pScratch,
+                      pBatch->outputFrameSize * sizeof(Int16));
+        }
+    }
+
+    if (status != MP4AUDEC_SUCCESS && pOutput != NULL)
+    {
+        pv_memset(pOutput + block * pBatch->outputFrameSize, 0,
+                  (pFrame->numBlocks - block) * pBatch->outputFrameSize *
+                  sizeof(Int16));
+    }
+
+    return status;
+}
+
+static void *batch_thread(void *arg)
+{
+    tBatchDecoder *pBatch = (tBatchDecoder *)arg;
+    tPVMP4AudioDecoderExternal ext;
+
+    void *pMem = calloc(1, PVMP4AudioDecoderGetMemRequirements());
+    Int16 *pScratch = (Int16 *)calloc(MAX_OUTPUT_FRAME_SIZE, sizeof(Int16));
+
+    if (pMem == NULL || pScratch == NULL)
+    {
+        pthread_mutex_lock(&pBatch->lock);
+        pBatch->status = MP4AUDEC_NO_MEMORY;
+        pthread_mutex_unlock(&pBatch->lock);
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pBatch->lock);
+        Int32 range = pBatch->nextRange++;
+        Bool done = range >= pBatch->numRanges ||
+                    pBatch->status != MP4AUDEC_SUCCESS;
+        pthread_mutex_unlock(&pBatch->lock);
+
+        if (done)
+        {
+            break;
+        }
+
+        Int32 first = (Int32)((int64_t)range * pBatch->numFrames /
+                              pBatch->numRanges);
+        Int32 end = (Int32)((int64_t)(range + 1) * pBatch->numFrames /
+                            pBatch->numRanges);
+        Int32 i = (first > PRIME_FRAMES) ? first - PRIME_FRAMES : 0;
+
+        /*
+         * The decoder reads back from its output buffer, start the range
+         * the way a new decoder starts
+         */
+        init_decoder(&ext, pMem, pBatch->aacPlusEnabled);
+        pv_memset(pScratch, 0, MAX_OUTPUT_FRAME_SIZE * sizeof(Int16));
+
+        for (; i < end; i++)
+        {
+            const tBatchFrame *pFrame = &pBatch->pFrames[i];
+
+            decode_frame(pBatch, pFrame, &ext, pMem, pScratch,
+                         (i < first) ? NULL : pBatch->pOutput +
+                         (int64_t)pFrame->firstBlock * pBatch->outputFrameSize);
+        }
+    }
+
+    free(pScratch);
+    free(pMem);
+
+    return NULL;
+}
+
+/*----------------------------------------------------------------------------
+; FUNCTION CODE
+----------------------------------------------------------------------------*/
+
+OSCL_EXPORT_REF Int PVMP4AudioDecodeBatch(
+    const UChar                   *pInputBuffer,
+    Int32                         inputLength,
+    Int                           numThreads,
+    tPVMP4AudioDecoderBatchOutput *pOutput)
+{
+    tBatchDecoder batch;
+    tPVMP4AudioDecoderExternal ext;
+    pthread_t threads[MAX_BATCH_THREADS];
+    Int numStarted = 0;
+
+    pv_memset(pOutput, 0, sizeof(*pOutput));
+    pv_memset(&batch, 0, sizeof(batch));
+    batch.pStream = pInputBuffer;
+    batch.streamLength = inputLength;
+    batch.status = MP4AUDEC_SUCCESS;
+
+    if (index_frames(&batch) <= 0)
+    {
+        free(batch.pFrames);
+        return (batch.numFrames < 0) ? MP4AUDEC_NO_MEMORY :
+               MP4AUDEC_LOST_FRAME_SYNC;
+    }
+
+    /*
+     * The first frame tells whether the decoder upsamples for SBR, which
+     * sets the size of the output of every frame
+     */
+    void *pMem = calloc(1, PVMP4AudioDecoderGetMemRequirements());
+    Int16 *pScratch = (Int16 *)calloc(MAX_OUTPUT_FRAME_SIZE, sizeof(Int16));
+    Int status = MP4AUDEC_NO_MEMORY;
+
+    batch.aacPlusEnabled = true;
+    while (pMem != NULL && pScratch != NULL)
+    {
+        init_decoder(&ext, pMem, batch.aacPlusEnabled);
+
+        ext.pInputBuffer = (UChar *)pInputBuffer + batch.pFrames[0].offset;
+        ext.inputBufferCurrentLength = batch.pFrames[0].size;
+        ext.pOutputBuffer = pScratch;
+        ext.pOutputBuffer_plus = &pScratch[2048];
+
+        status = PVMP4AudioDecodeFrame(&ext, pMem);
+        if (status == MP4AUDEC_SUCCESS || !batch.aacPlusEnabled)
+        {
+            break;
+        }
+        batch.aacPlusEnabled = false;
+    }
+    free(pScratch);
+    free(pMem);
+
+    if (status != MP4AUDEC_SUCCESS)
+    {
+        free(batch.pFrames);
+        return (status == MP4AUDEC_NO_MEMORY) ? status : MP4AUDEC_INVALID_FRAME;
+    }
+
+    batch.outputFrameSize = ext.frameLength * ext.desiredChannels *
+                            ext.aacPlusUpsamplingFactor;
+
+    pOutput->desiredChannels = ext.desiredChannels;
+    pOutput->samplingRate = ext.samplingRate;
+
+    batch.pOutput = (Int16 *)malloc((int64_t)batch.numBlocks *
+                                    batch.outputFrameSize * sizeof(Int16));
+    if (batch.pOutput == NULL)
+    {
+        free(batch.pFrames);
+        return MP4AUDEC_NO_MEMORY;
+    }
+
+    if (numThreads <= 0)
+    {
+        numThreads = (Int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (numThreads > MAX_BATCH_THREADS)
+    {
+        numThreads = MAX_BATCH_THREADS;
+    }
+
+    batch.numRanges = numThreads * RANGES_PER_THREAD;
+    if (batch.numRanges > batch.numFrames / MIN_FRAMES_PER_RANGE)
+    {
+        batch.numRanges = batch.numFrames / MIN_FRAMES_PER_RANGE;
+    }
+    if (numThreads <= 1 || batch.numRanges < 1)
+    {
+        batch.numRanges = 1;
+    }
+    if (numThreads > batch.numRanges)
+    {
+        numThreads = batch.numRanges;
+    }
+
+    pthread_mutex_init(&batch.lock, NULL);
+
+    /*
+     * The calling thread decodes ranges too
+     */
+    while (numStarted < numThreads - 1 &&
+            !pthread_create(&threads[numStarted], NULL, batch_thread, &batch))
+    {
+        numStarted++;
+    }
+    batch_thread(&batch);
+
+    while (numStarted > 0)
+    {
+        pthread_join(threads[--numStarted], NULL);
+    }
+
+    pthread_mutex_destroy(&batch.lock);
+    free(batch.pFrames);
+
+    if (batch.status != MP4AUDEC_SUCCESS)
+    {
+        free(batch.pOutput);
+        return batch.status;
+    }
+
+    pOutput->pOutputBuffer = batch.pOutput;
+    pOutput->outputLength = batch.numBlocks * batch.outputFrameSize;
+    pOutput->numFrames = batch.numBlocks;
+
+    return MP4AUDEC_SUCCESS;
+}
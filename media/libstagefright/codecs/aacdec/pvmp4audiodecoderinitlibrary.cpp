@@ -284,6 +284,12 @@ OSCL_EXPORT_REF Int PVMP4AudioDecoderInitLibrary(
     pVars->current_program = -1;
     pVars->mc_info.sampling_rate_idx = Fs_44; /* Fs_44 = 4, 44.1kHz */
 
+    /*
+     * ADTS streams never go through get_audio_specific_config(), which
+     * otherwise sets this. Left at zero, no output would be written.
+     */
+    pVars->mc_info.upsamplingFactor = 1;  /*  Default for regular AAC */
+
     /*
      * In the future, the frame length will change with MP4 file format.
      * Presently this variable is used to simply the unit test for
@@ -232,7 +232,7 @@ status_t AVCEncoder::initCheck(const sp<MetaData>& meta) {
     }
 
     mEncParams = new tagAVCEncParam;
-    memset(mEncParams, 0, sizeof(mEncParams));
+    memset(mEncParams, 0, sizeof(tagAVCEncParam));
     mEncParams->width = mVideoWidth;
     mEncParams->height = mVideoHeight;
     mEncParams->frame_rate = 1000 * mVideoFrameRate;  // In frames/ms!
@@ -267,6 +267,9 @@ status_t AVCEncoder::initCheck(const sp<MetaData>& meta) {
     mEncParams->data_par = AVC_OFF;
     mEncParams->fullsearch = AVC_OFF;
     mEncParams->search_range = 16;
+    mEncParams->me_search = AVC_ME_SPIRAL;
+    mEncParams->me_early_exit = 0;
+    mEncParams->screen_content = AVC_OFF;
     mEncParams->sub_pel = AVC_OFF;
     mEncParams->submb_pred = AVC_OFF;
     mEncParams->rdopt_mode = AVC_OFF;
@@ -32,4 +32,11 @@ LOCAL_CFLAGS := \
     -D__arm__ \
     -DOSCL_IMPORT_REF= -DOSCL_UNUSED_ARG= -DOSCL_EXPORT_REF=
 
+# SSE2 version of the SAD used by the motion search, every x86 target has
+# SSE2.
+ifeq ($(TARGET_ARCH),x86)
+    LOCAL_CFLAGS     += -DAVCENC_SSE2 -msse2
+    LOCAL_SRC_FILES  += src/sad_sse2.cpp
+endif
+
 include $(BUILD_STATIC_LIBRARY)
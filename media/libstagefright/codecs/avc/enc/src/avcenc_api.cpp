@@ -208,6 +208,30 @@ OSCL_EXPORT_REF AVCEnc_Status PVAVCEncInitialize(AVCHandle *avcHandle, AVCEncPar
         return AVCENC_MEMORY_FAIL;
     }
 
+    if (encvid->screen_content)
+    {
+        /* 256 luma and 2x64 chroma samples per MB */
+        encvid->prevInput = (uint8*) avcHandle->CBAVC_Malloc(userData, sizeof(uint8) * framesize * 384, DEFAULT_ATTR);
+        if (encvid->prevInput == NULL)
+        {
+            return AVCENC_MEMORY_FAIL;
+        }
+
+        encvid->staticMB = (uint8*) avcHandle->CBAVC_Malloc(userData, sizeof(uint8) * framesize, DEFAULT_ATTR);
+        if (encvid->staticMB == NULL)
+        {
+            return AVCENC_MEMORY_FAIL;
+        }
+        memset(encvid->staticMB, 0, sizeof(uint8)*framesize);
+
+        encvid->dirtyMB = (uint8*) avcHandle->CBAVC_Malloc(userData, sizeof(uint8) * framesize, DEFAULT_ATTR);
+        if (encvid->dirtyMB == NULL)
+        {
+            return AVCENC_MEMORY_FAIL;
+        }
+        memset(encvid->dirtyMB, 0, sizeof(uint8)*framesize);
+    }
+
     /* initialize motion search related memory */
     if (AVCENC_SUCCESS != InitMotionSearchModule(avcHandle))
     {
@@ -225,7 +249,11 @@ OSCL_EXPORT_REF AVCEnc_Status PVAVCEncInitialize(AVCHandle *avcHandle, AVCEncPar
     {
         return AVCENC_MEMORY_FAIL;
     }
+#ifdef AVCENC_SSE2
+    encvid->functionPointer->SAD_Macroblock = &AVCSAD_Macroblock_SSE2;
+#else
     encvid->functionPointer->SAD_Macroblock = &AVCSAD_Macroblock_C;
+#endif
     encvid->functionPointer->SAD_MB_HalfPel[0] = NULL;
     encvid->functionPointer->SAD_MB_HalfPel[1] = &AVCSAD_MB_HalfPel_Cxh;
     encvid->functionPointer->SAD_MB_HalfPel[2] = &AVCSAD_MB_HalfPel_Cyh;
@@ -495,6 +523,11 @@ OSCL_EXPORT_REF AVCEnc_Status PVAVCEncodeNAL(AVCHandle *avcHandle, unsigned char
                 /* update the original frame array */
                 encvid->prevCodedFrameNum = encvid->currInput->coding_order;
 
+                if (encvid->screen_content)
+                {
+                    AVCSavePrevInput(encvid);
+                }
+
                 /* store the encoded picture in the DPB buffer */
                 StorePictureInDPB(avcHandle, video);
 
@@ -623,6 +656,21 @@ OSCL_EXPORT_REF void    PVAVCCleanUpEncoder(AVCHandle *avcHandle)
             avcHandle->CBAVC_Free(userData, (int)encvid->intraSearch);
         }
 
+        if (encvid->prevInput)
+        {
+            avcHandle->CBAVC_Free(userData, (int)encvid->prevInput);
+        }
+
+        if (encvid->staticMB)
+        {
+            avcHandle->CBAVC_Free(userData, (int)encvid->staticMB);
+        }
+
+        if (encvid->dirtyMB)
+        {
+            avcHandle->CBAVC_Free(userData, (int)encvid->dirtyMB);
+        }
+
         if (encvid->mot16x16)
         {
             avcHandle->CBAVC_Free(userData, (int)encvid->mot16x16);
@@ -729,6 +777,51 @@ OSCL_EXPORT_REF AVCEnc_Status PVAVCEncUpdateIMBRefresh(AVCHandle *avcHandle, int
     return AVCENC_FAIL;
 }
 
+/* ======================================================================== */
+/*  Function : PVAVCEncAddDirtyRect()                                       */
+/*  Purpose  : Mark the macroblocks of the next input frame that may have   */
+/*              changed, the others are skipped with screen_content on.     */
+/*  In/out   :                                                              */
+/*  Return   : AVCENC_SUCCESS for success.                                  */
+/*  Modified :                                                              */
+/* ======================================================================== */
+OSCL_EXPORT_REF AVCEnc_Status PVAVCEncAddDirtyRect(AVCHandle *avcHandle, int left, int top, int right, int bottom)
+{
+    AVCEncObject *encvid = (AVCEncObject*)avcHandle->AVCObject;
+    AVCCommonObj *video;
+    int i, j;
+
+    if (encvid == NULL)
+    {
+        return AVCENC_UNINITIALIZED;
+    }
+
+    if (!encvid->screen_content)
+    {
+        return AVCENC_NOT_SUPPORTED;
+    }
+
+    video = encvid->common;
+
+    if (left < 0) left = 0;
+    if (top < 0) top = 0;
+    if (right > (int)video->PicWidthInSamplesL) right = video->PicWidthInSamplesL;
+    if (bottom > (int)(video->FrameHeightInMbs << 4)) bottom = video->FrameHeightInMbs << 4;
+
+    /* an empty rectangle still turns the hint on */
+    encvid->dirtyHint = TRUE;
+
+    for (j = top >> 4; j < ((bottom + 15) >> 4); j++)
+    {
+        for (i = left >> 4; i < ((right + 15) >> 4); i++)
+        {
+            encvid->dirtyMB[j * video->PicWidthInMbs + i] = 1;
+        }
+    }
+
+    return AVCENC_SUCCESS;
+}
+
 void PVAVCEncGetFrameStats(AVCHandle *avcHandle, AVCEncFrameStats *avcStats)
 {
     AVCEncObject *encvid = (AVCEncObject*) avcHandle->AVCObject;
@@ -87,6 +87,18 @@ typedef enum
 
 #define MAX_NUM_SLICE_GROUP  8      /* maximum for all the profiles */
 
+/**
+This enumeration is for the full-pel motion search pattern used to refine the
+best candidate predicted from the neighboring macroblocks.
+@publishedAll
+*/
+typedef enum
+{
+    AVC_ME_SPIRAL = 0,  /* one pixel steps to the best neighbor, the default */
+    AVC_ME_DIAMOND = 1, /* large diamond steps, then a small diamond */
+    AVC_ME_HEXAGON = 2  /* hexagon steps, then a small diamond */
+} AVCMESearch;
+
 /**
 This structure contains the encoding parameters.
 */
@@ -138,6 +150,11 @@ typedef struct tagAVCEncParam
 
     AVCFlag fullsearch; /* enable full-pel full-search mode */
     int search_range;   /* search range for motion vector in (-search_range,+search_range) pixels */
+    AVCMESearch me_search; /* full-pel search pattern when fullsearch is off */
+    int me_early_exit;  /* skip the full-pel search pattern when the best candidate has a SAD
+                        below this, in sum over the 16x16 luma block, 0 to always search */
+    AVCFlag screen_content; /* code the macroblocks that did not change since the previous input
+                            frame as skipped, without motion search or transform */
     AVCFlag sub_pel;    /* enable sub pel prediction */
     AVCFlag submb_pred; /* enable sub MB partition mode */
     AVCFlag rdopt_mode; /* RD optimal mode selection */
@@ -315,6 +332,21 @@ extern "C"
     OSCL_IMPORT_REF AVCEnc_Status PVAVCEncIDRRequest(AVCHandle *avcHandle);
     OSCL_IMPORT_REF AVCEnc_Status PVAVCEncUpdateIMBRefresh(AVCHandle *avcHandle, int numMB);
 
+    /**
+    With screen_content on, this function tells the encoder which part of the next input frame
+    may have changed since the previous one, it can be called several times per frame. The
+    macroblocks outside all the rectangles given before the next frame is encoded are coded
+    as skipped without even being compared, so a frame with no rectangle at all is compared
+    in full, and an empty rectangle marks the whole frame as unchanged.
+    \param "avcHandle"  "Handle to the AVC encoder library object."
+    \param "left"       "Left edge of the changed area in pixels."
+    \param "top"        "Top edge of the changed area in pixels."
+    \param "right"      "Right edge of the changed area in pixels, exclusive."
+    \param "bottom"     "Bottom edge of the changed area in pixels, exclusive."
+    \return "AVCENC_SUCCESS for success, AVCENC_NOT_SUPPORTED if screen_content is off."
+    */
+    OSCL_IMPORT_REF AVCEnc_Status PVAVCEncAddDirtyRect(AVCHandle *avcHandle, int left, int top, int right, int bottom);
+
 
 #ifdef __cplusplus
 }
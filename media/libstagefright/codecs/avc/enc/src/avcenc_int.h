@@ -440,6 +440,16 @@ typedef struct tagEncObject
 
     /* encoding complexity control */
     uint fullsearch_enable; /* flag to enable full-pel full-search */
+    AVCMESearch me_search;  /* full-pel search pattern */
+    int me_early_exit;      /* SAD below which the search pattern is skipped */
+
+    /* screen content, macroblocks unchanged since the previous input are skipped */
+    bool screen_content;    /* flag to enable the unchanged macroblock detection */
+    uint8 *prevInput;       /* Y, Cb and Cr of the last encoded input frame, no padding */
+    bool prevInputValid;    /* prevInput holds a frame */
+    uint8 *staticMB;        /* MBs of the current frame identical to prevInput */
+    uint8 *dirtyMB;         /* MBs inside the rectangles given by PVAVCEncAddDirtyRect */
+    bool dirtyHint;         /* dirtyMB is used for the next frame */
 
     /* misc.*/
     bool outOfBandParamSet; /* flag to enable out-of-band param set */
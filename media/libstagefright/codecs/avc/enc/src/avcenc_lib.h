@@ -504,6 +504,24 @@ extern "C"
     */
     void AVCMotionEstimation(AVCEncObject *encvid);
 
+    /**
+    This function compares each macroblock of the input frame with the previous input frame
+    and marks the ones that did not change in encvid->staticMB. With a dirty region hint,
+    the macroblocks outside of it are marked without being compared.
+    \param "encvid" "Pointer to AVCEncObject."
+    \return "void"
+    */
+    void AVCFindStaticMB(AVCEncObject *encvid);
+
+    /**
+    This function copies the macroblocks that changed in the frame just encoded into
+    encvid->prevInput and clears the dirty region hint. It is only called for the frames
+    that are kept, so that prevInput matches the reference frame.
+    \param "encvid" "Pointer to AVCEncObject."
+    \return "void"
+    */
+    void AVCSavePrevInput(AVCEncObject *encvid);
+
     /**
     This function performs repetitive edge padding to the reference picture by adding 16 pixels
     around the luma and 8 pixels around the chromas.
@@ -572,6 +590,27 @@ extern "C"
                       int *imin, int *jmin, int ilow, int ihigh, int jlow, int jhigh,
                       int cmvx, int cmvy);
 
+    /**
+    Refine the best candidate with the diamond or hexagon search pattern of
+    encvid->me_search until the center of the pattern is the best position,
+    then check the four nearest neighbors.
+    \param "encvid" "Pointer to AVCEncObject structure."
+    \param "prev"   "Pointer to the reference frame."
+    \param "cur"    "Pointer to the input macroblock."
+    \param "imin"   "Pointer to the best candidate (x), updated."
+    \param "jmin"   "Pointer to the best candidate (y), updated."
+    \param "dmin"   "Cost of the best candidate."
+    \param "min_sad"    "Pointer to the SAD of the best candidate, updated."
+    \param "i0, j0" "Position of the macroblock."
+    \param "ilow, ihigh, jlow, jhigh"   "Bounds of the search range."
+    \param "cmvx, cmvy" "Predicted MV value."
+
+    \return "The cost function of the best candidate."
+    */
+    int AVCPatternSearch(AVCEncObject *encvid, uint8 *prev, uint8 *cur,
+                         int *imin, int *jmin, int dmin, int *min_sad, int i0, int j0,
+                         int ilow, int ihigh, int jlow, int jhigh, int cmvx, int cmvy);
+
     /**
     Select candidates from neighboring blocks according to the type of the
     prediction selection.
@@ -804,6 +843,14 @@ extern "C"
     int AVCSAD_MB_HalfPel_Cyh(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info);
     int AVCSAD_MB_HalfPel_Cxh(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info);
     int AVCSAD_Macroblock_C(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info);
+    bool AVCCompareMB_C(uint8 *cur[], int cur_pitch, uint8 *prev[], int prev_pitch);
+
+#ifdef AVCENC_SSE2
+    /*------------- sad_sse2.c ----------------------*/
+
+    int AVCSAD_Macroblock_SSE2(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info);
+    bool AVCCompareMB_SSE2(uint8 *cur[], int cur_pitch, uint8 *prev[], int prev_pitch);
+#endif
 
 #ifdef HTFM /*  3/2/1, Hypothesis Testing Fast Matching */
     int AVCSAD_MB_HP_HTFM_Collectxhyh(uint8 *ref, uint8 *blk, int dmin_x, void *extra_info);
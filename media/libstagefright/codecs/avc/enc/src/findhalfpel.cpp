@@ -611,7 +611,11 @@ int SATD_MB(uint8 *cand, uint8 *cur, int dmin)
 
 
     dmin = (dmin << 16) | 24;
+#ifdef AVCENC_SSE2
+    cost = AVCSAD_Macroblock_SSE2(cand, cur, dmin, NULL);
+#else
     cost = AVCSAD_Macroblock_C(cand, cur, dmin, NULL);
+#endif
 
     return cost;
 }
@@ -55,6 +55,15 @@ AVCEnc_Status  SetEncodeParam(AVCHandle* avcHandle, AVCEncParams* encParam,
 
     encvid->fullsearch_enable = encParam->fullsearch;
 
+    if ((int)encParam->me_search < AVC_ME_SPIRAL || encParam->me_search > AVC_ME_HEXAGON ||
+            encParam->me_early_exit < 0)
+    {
+        return AVCENC_NOT_SUPPORTED;
+    }
+    encvid->me_search = encParam->me_search;
+    encvid->me_early_exit = encParam->me_early_exit;
+    encvid->screen_content = ((encParam->screen_content == AVC_ON) ? TRUE : FALSE);
+
     encvid->outOfBandParamSet = ((encParam->out_of_band_param_set == AVC_ON) ? TRUE : FALSE);
 
     /* parameters derived from the the encParam that are used in SPS */
@@ -272,6 +272,11 @@ void AVCMotionEstimation(AVCEncObject *encvid)
 
     offset = 0;
 
+    if (encvid->screen_content)
+    {
+        AVCFindStaticMB(encvid);
+    }
+
     if (slice_type == AVC_I_SLICE)
     {
         /* cannot do I16 prediction here because it needs full decoding. */
@@ -353,7 +358,29 @@ void AVCMotionEstimation(AVCEncObject *encvid)
 
                 cur = currInput->YCbCr[0] + offset;
 
-                if (currMB->mb_intra == 0) /* for INTER mode */
+                if (currMB->mb_intra == 0 && encvid->screen_content && encvid->staticMB[mbnum])
+                {
+                    /* unchanged since the previous input frame, no search, it is coded
+                       with a zero MV and without residual, see EncodeMB() */
+                    currMB->mbMode = AVC_P16;
+                    currMB->MBPartPredMode[0][0] = AVC_Pred_L0;
+                    currMB->NumMbPart = 1;
+                    currMB->SubMbPartHeight[0] = 16;
+                    currMB->SubMbPartWidth[0] = 16;
+                    currMB->NumSubMbPart[0] = 1;
+                    currMB->ref_idx_L0[0] = currMB->ref_idx_L0[1] =
+                                                currMB->ref_idx_L0[2] = currMB->ref_idx_L0[3] = DEFAULT_REF_IDX;
+                    currMB->RefIdx[0] = currMB->RefIdx[1] =
+                                            currMB->RefIdx[2] = currMB->RefIdx[3] = refPic->RefIdx;
+                    memset(currMB->mvL0, 0, sizeof(currMB->mvL0));
+
+                    mot_mb_16x16->x = mot_mb_16x16->y = 0;
+                    mot_mb_16x16->sad = 0;
+                    encvid->min_cost[mbnum] = 0;
+                    rateCtrl->MADofMB[mbnum] = 0;
+                    intraSearch[mbnum] = 0;
+                }
+                else if (currMB->mb_intra == 0) /* for INTER mode */
                 {
 #if defined(HTFM)
                     HTFMPrepareCurMB_AVC(encvid, &htfm_stat, cur, pitch);
@@ -472,6 +499,127 @@ void AVCMotionEstimation(AVCEncObject *encvid)
     return ;
 }
 
+/* pointers to the MB at (i, j) in the input frame and in encvid->prevInput */
+static void AVCGetInputMB(AVCEncObject *encvid, int i, int j, uint8 *cur[], uint8 *prev[])
+{
+    AVCCommonObj *video = encvid->common;
+    AVCFrameIO *currInput = encvid->currInput;
+    int pitch = currInput->pitch;
+    int width = video->PicWidthInSamplesL;
+    int size = width * video->PicHeightInSamplesL;
+    int offset;
+
+    offset = (j << 4) * pitch + (i << 4);
+    cur[0] = currInput->YCbCr[0] + offset;
+    offset = (j << 3) * (pitch >> 1) + (i << 3);
+    cur[1] = currInput->YCbCr[1] + offset;
+    cur[2] = currInput->YCbCr[2] + offset;
+
+    offset = (j << 4) * width + (i << 4);
+    prev[0] = encvid->prevInput + offset;
+    offset = (j << 3) * (width >> 1) + (i << 3);
+    prev[1] = encvid->prevInput + size + offset;
+    prev[2] = prev[1] + (size >> 2);
+
+    return ;
+}
+
+/*=====================================================================
+    Function:   AVCFindStaticMB
+    Purpose:    Mark the MBs identical to the previous input frame, they
+                are coded as skipped for screen content.
+=====================================================================*/
+void AVCFindStaticMB(AVCEncObject *encvid)
+{
+    AVCCommonObj *video = encvid->common;
+    int mbwidth = video->PicWidthInMbs;
+    int mbheight = video->PicHeightInMbs;
+    int pitch = encvid->currInput->pitch;
+    int width = video->PicWidthInSamplesL;
+    uint8 *staticMB = encvid->staticMB;
+    uint8 *cur[3], *prev[3];
+    int i, j, mbnum;
+
+    if (!encvid->prevInputValid)
+    {
+        memset(staticMB, 0, sizeof(uint8)*video->PicSizeInMbs);
+        return ;
+    }
+
+    mbnum = 0;
+    for (j = 0; j < mbheight; j++)
+    {
+        for (i = 0; i < mbwidth; i++)
+        {
+            if (encvid->dirtyHint && !encvid->dirtyMB[mbnum])
+            {
+                staticMB[mbnum] = 1; /* outside of the area the caller says changed */
+            }
+            else
+            {
+                AVCGetInputMB(encvid, i, j, cur, prev);
+#ifdef AVCENC_SSE2
+                staticMB[mbnum] = AVCCompareMB_SSE2(cur, pitch, prev, width);
+#else
+                staticMB[mbnum] = AVCCompareMB_C(cur, pitch, prev, width);
+#endif
+            }
+            mbnum++;
+        }
+    }
+
+    return ;
+}
+
+/*=====================================================================
+    Function:   AVCSavePrevInput
+    Purpose:    Copy the MBs of the encoded input frame that changed into
+                prevInput, for the next AVCFindStaticMB.
+=====================================================================*/
+void AVCSavePrevInput(AVCEncObject *encvid)
+{
+    AVCCommonObj *video = encvid->common;
+    int mbwidth = video->PicWidthInMbs;
+    int mbheight = video->PicHeightInMbs;
+    int pitch = encvid->currInput->pitch;
+    int width = video->PicWidthInSamplesL;
+    uint8 *staticMB = encvid->staticMB;
+    uint8 *cur[3], *prev[3];
+    int i, j, k, mbnum;
+
+    mbnum = 0;
+    for (j = 0; j < mbheight; j++)
+    {
+        for (i = 0; i < mbwidth; i++)
+        {
+            if (!staticMB[mbnum])
+            {
+                AVCGetInputMB(encvid, i, j, cur, prev);
+                for (k = 0; k < 16; k++)
+                {
+                    memcpy(prev[0] + k * width, cur[0] + k * pitch, 16);
+                }
+                for (k = 0; k < 8; k++)
+                {
+                    memcpy(prev[1] + k * (width >> 1), cur[1] + k * (pitch >> 1), 8);
+                    memcpy(prev[2] + k * (width >> 1), cur[2] + k * (pitch >> 1), 8);
+                }
+            }
+            mbnum++;
+        }
+    }
+
+    encvid->prevInputValid = TRUE;
+
+    if (encvid->dirtyHint)
+    {
+        encvid->dirtyHint = FALSE;
+        memset(encvid->dirtyMB, 0, sizeof(uint8)*video->PicSizeInMbs);
+    }
+
+    return ;
+}
+
 /*=====================================================================
     Function:   PaddingEdge
     Date:       09/16/2000
@@ -1132,73 +1280,88 @@ void AVCMBMotionSearch(AVCEncObject *encvid, uint8 *cur, uint8 *best_cand[],
             }
 
             /******************* local refinement ***************************/
-            center_again = 0;
-            last_loc = new_loc = 0;
-            //          ncand = ref + jmin*lx + imin;  /* center of the search */
-            step = 0;
-            dn[0] = dmin;
-            while (!center_again && step <= max_step)
+            if (min_sad < encvid->me_early_exit)
+            {
+                /* the prediction from the neighbors is good enough */
+                *hp_guess = 0;
+            }
+            else if (encvid->me_search != AVC_ME_SPIRAL)
             {
+                dmin = AVCPatternSearch(encvid, ref, cur, &imin, &jmin, dmin, &min_sad,
+                                        i0, j0, ilow, ihigh, jlow, jhigh, cmvx, cmvy);
+                ncand = ref + imin + jmin * lx;
+                *hp_guess = 0;
+            }
+            else
+            {
+                center_again = 0;
+                last_loc = new_loc = 0;
+                //          ncand = ref + jmin*lx + imin;  /* center of the search */
+                step = 0;
+                dn[0] = dmin;
+                while (!center_again && step <= max_step)
+                {
 
-                AVCMoveNeighborSAD(dn, last_loc);
+                    AVCMoveNeighborSAD(dn, last_loc);
 
-                center_again = 1;
-                i = imin;
-                j = jmin - 1;
-                cand = ref + i + j * lx;
+                    center_again = 1;
+                    i = imin;
+                    j = jmin - 1;
+                    cand = ref + i + j * lx;
 
-                /*  starting from [0,-1] */
-                /* spiral check one step at a time*/
-                for (k = 2; k <= 8; k += 2)
-                {
-                    if (!tab_exclude[last_loc][k]) /* exclude last step computation */
-                    {       /* not already computed */
-                        if (i >= ilow && i <= ihigh && j >= jlow && j <= jhigh)
+                    /*  starting from [0,-1] */
+                    /* spiral check one step at a time*/
+                    for (k = 2; k <= 8; k += 2)
+                    {
+                        if (!tab_exclude[last_loc][k]) /* exclude last step computation */
+                        {       /* not already computed */
+                            if (i >= ilow && i <= ihigh && j >= jlow && j <= jhigh)
+                            {
+                                d = (*SAD_Macroblock)(cand, cur, (dmin << 16) | lx, extra_info);
+                                mvcost = MV_COST(lambda_motion, mvshift, i - i0, j - j0, cmvx, cmvy);
+                                d += mvcost;
+
+                                dn[k] = d; /* keep it for half pel use */
+
+                                if (d < dmin)
+                                {
+                                    ncand = cand;
+                                    dmin = d;
+                                    imin = i;
+                                    jmin = j;
+                                    center_again = 0;
+                                    new_loc = k;
+                                    min_sad = d - mvcost; // for rate control
+                                }
+                            }
+                        }
+                        if (k == 8)  /* end side search*/
                         {
-                            d = (*SAD_Macroblock)(cand, cur, (dmin << 16) | lx, extra_info);
-                            mvcost = MV_COST(lambda_motion, mvshift, i - i0, j - j0, cmvx, cmvy);
-                            d += mvcost;
-
-                            dn[k] = d; /* keep it for half pel use */
-
-                            if (d < dmin)
+                            if (!center_again)
                             {
-                                ncand = cand;
-                                dmin = d;
-                                imin = i;
-                                jmin = j;
-                                center_again = 0;
-                                new_loc = k;
-                                min_sad = d - mvcost; // for rate control
+                                k = -1; /* start diagonal search */
+                                cand -= lx;
+                                j--;
                             }
                         }
-                    }
-                    if (k == 8)  /* end side search*/
-                    {
-                        if (!center_again)
+                        else
                         {
-                            k = -1; /* start diagonal search */
-                            cand -= lx;
-                            j--;
+                            next = refine_next[k][0];
+                            i += next;
+                            cand += next;
+                            next = refine_next[k][1];
+                            j += next;
+                            cand += lx * next;
                         }
                     }
-                    else
-                    {
-                        next = refine_next[k][0];
-                        i += next;
-                        cand += next;
-                        next = refine_next[k][1];
-                        j += next;
-                        cand += lx * next;
-                    }
+                    last_loc = new_loc;
+                    step ++;
                 }
-                last_loc = new_loc;
-                step ++;
-            }
-            if (!center_again)
-                AVCMoveNeighborSAD(dn, last_loc);
+                if (!center_again)
+                    AVCMoveNeighborSAD(dn, last_loc);
 
-            *hp_guess = AVCFindMin(dn);
+                *hp_guess = AVCFindMin(dn);
+            }
 
             encvid->rateCtrl->MADofMB[mbnum] = min_sad / 256.0;
         }
@@ -1342,6 +1505,118 @@ int AVCFullSearch(AVCEncObject *encvid, uint8 *prev, uint8 *cur,
     return dmin;
 }
 
+/*===============================================================================
+    Function:   AVCPatternSearch
+    Purpose:    Refine the best candidate with large steps of a diamond or a
+                hexagon pattern. Each step moves the center of the pattern to
+                its best point until the center is best or the number of steps
+                runs out, then the four nearest neighbors are checked. Costs
+                far fewer SADs than the spiral for large motion.
+    Input/Output:   VideoEncData, reference frame, current MB, best candidate
+                (also output) and its cost, MB position, boundaries.
+===============================================================================*/
+int AVCPatternSearch(AVCEncObject *encvid, uint8 *prev, uint8 *cur,
+                     int *imin, int *jmin, int dmin, int *min_sad, int i0, int j0,
+                     int ilow, int ihigh, int jlow, int jhigh, int cmvx, int cmvy)
+{
+    const static int large_diamond[8][2] =
+    {
+        {0, -2}, {1, -1}, {2, 0}, {1, 1}, {0, 2}, { -1, 1}, { -2, 0}, { -1, -1}
+    };
+    const static int hexagon[6][2] =
+    {
+        { -2, 0}, { -1, -2}, {1, -2}, {2, 0}, {1, 2}, { -1, 2}
+    };
+    const static int small_diamond[4][2] =
+    {
+        {0, -1}, {1, 0}, {0, 1}, { -1, 0}
+    };
+
+    AVCPictureData *currPic = encvid->common->currPic;
+    int (*SAD_Macroblock)(uint8*, uint8*, int, void*) = encvid->functionPointer->SAD_Macroblock;
+    void *extra_info = encvid->sad_extra_info;
+    int lx = currPic->pitch; /* with padding */
+    int max_step = encvid->rateCtrl->mvRange >> 1;
+
+    int lambda_motion = encvid->lambda_motion;
+    uint8 *mvbits = encvid->mvbits;
+    int mvshift = 2;
+    int mvcost;
+
+    const int (*pattern)[2];
+    int num_points;
+    int i, j, k, d, step, ic, jc;
+
+    if (encvid->me_search == AVC_ME_HEXAGON)
+    {
+        pattern = hexagon;
+        num_points = 6;
+    }
+    else
+    {
+        pattern = large_diamond;
+        num_points = 8;
+    }
+
+    for (step = 0; step <= max_step; step++)
+    {
+        ic = *imin;
+        jc = *jmin;
+
+        for (k = 0; k < num_points; k++)
+        {
+            i = ic + pattern[k][0];
+            j = jc + pattern[k][1];
+
+            if (i >= ilow && i <= ihigh && j >= jlow && j <= jhigh)
+            {
+                d = (*SAD_Macroblock)(prev + i + j * lx, cur, (dmin << 16) | lx, extra_info);
+                mvcost = MV_COST(lambda_motion, mvshift, i - i0, j - j0, cmvx, cmvy);
+                d += mvcost;
+
+                if (d < dmin)
+                {
+                    dmin = d;
+                    *imin = i;
+                    *jmin = j;
+                    *min_sad = d - mvcost;
+                }
+            }
+        }
+
+        if (*imin == ic && *jmin == jc) /* center is the best */
+        {
+            break;
+        }
+    }
+
+    ic = *imin;
+    jc = *jmin;
+
+    for (k = 0; k < 4; k++)
+    {
+        i = ic + small_diamond[k][0];
+        j = jc + small_diamond[k][1];
+
+        if (i >= ilow && i <= ihigh && j >= jlow && j <= jhigh)
+        {
+            d = (*SAD_Macroblock)(prev + i + j * lx, cur, (dmin << 16) | lx, extra_info);
+            mvcost = MV_COST(lambda_motion, mvshift, i - i0, j - j0, cmvx, cmvy);
+            d += mvcost;
+
+            if (d < dmin)
+            {
+                dmin = d;
+                *imin = i;
+                *jmin = j;
+                *min_sad = d - mvcost;
+            }
+        }
+    }
+
+    return dmin;
+}
+
 /*===============================================================================
     Function:   AVCCandidateSelection
     Date:       09/16/2000
@@ -74,6 +74,48 @@ int AVCSAD_Macroblock_C(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info)
     return x10;
 }
 
+/*==================================================================
+    Function:   AVCCompareMB_C
+    Purpose:    Check whether the 16x16 luma and the two 8x8 chroma
+                blocks of a macroblock are identical in two frames, the
+                chroma pitch is half of the luma pitch.
+==================================================================*/
+bool AVCCompareMB_C(uint8 *cur[], int cur_pitch, uint8 *prev[], int prev_pitch)
+{
+    uint8 *p1, *p2, *p3, *p4;
+    int i;
+
+    p1 = cur[0];
+    p2 = prev[0];
+    for (i = 0; i < 16; i++)
+    {
+        if (memcmp(p1, p2, 16))
+            return false;
+
+        p1 += cur_pitch;
+        p2 += prev_pitch;
+    }
+
+    cur_pitch >>= 1;
+    prev_pitch >>= 1;
+    p1 = cur[1];
+    p2 = prev[1];
+    p3 = cur[2];
+    p4 = prev[2];
+    for (i = 0; i < 8; i++)
+    {
+        if (memcmp(p1, p2, 8) || memcmp(p3, p4, 8))
+            return false;
+
+        p1 += cur_pitch;
+        p2 += prev_pitch;
+        p3 += cur_pitch;
+        p4 += prev_pitch;
+    }
+
+    return true;
+}
+
 #ifdef HTFM   /* HTFM with uniform subsampling implementation 2/28/01 */
 /*===============================================================
     Function:   AVCAVCSAD_MB_HTFM_Collect and AVCSAD_MB_HTFM
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "avcenc_lib.h"
+
+#include <emmintrin.h>
+
+/*==================================================================
+    Function:   AVCSAD_Macroblock_SSE2
+    Purpose:    SSE2 version of AVCSAD_Macroblock_C. Like the C version
+                the SAD is compared to dmin after every row and the
+                partial SAD is returned once it is larger, so both return
+                the same value for the same input.
+==================================================================*/
+int AVCSAD_Macroblock_SSE2(uint8 *ref, uint8 *blk, int dmin_lx, void *extra_info)
+{
+    (void)(extra_info);
+
+    int dmin = (uint32)dmin_lx >> 16;
+    int lx = dmin_lx & 0xFFFF;
+    __m128i sum = _mm_setzero_si128();
+    int i, sad = 0;
+
+    for (i = 0; i < 16; i++)
+    {
+        /* blk is the 16x16 current MB, ref can be at any alignment */
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128((__m128i*)ref),
+                                              _mm_loadu_si128((__m128i*)blk)));
+        sad = _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+
+        if (sad > dmin)
+            return sad;
+
+        ref += lx;
+        blk += 16;
+    }
+
+    return sad;
+}
+
+/*==================================================================
+    Function:   AVCCompareMB_SSE2
+    Purpose:    SSE2 version of AVCCompareMB_C. The rows are compared
+                16 bytes at a time, the chroma rows of both components
+                are packed into one register.
+==================================================================*/
+bool AVCCompareMB_SSE2(uint8 *cur[], int cur_pitch, uint8 *prev[], int prev_pitch)
+{
+    uint8 *p1 = cur[0], *p2 = prev[0], *p3, *p4;
+    __m128i eq = _mm_cmpeq_epi8(_mm_setzero_si128(), _mm_setzero_si128());
+    __m128i a, b;
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)p1),
+                                              _mm_loadu_si128((__m128i*)p2)));
+        p1 += cur_pitch;
+        p2 += prev_pitch;
+    }
+
+    cur_pitch >>= 1;
+    prev_pitch >>= 1;
+    p1 = cur[1];
+    p2 = prev[1];
+    p3 = cur[2];
+    p4 = prev[2];
+    for (i = 0; i < 8; i++)
+    {
+        a = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)p1), _mm_loadl_epi64((__m128i*)p3));
+        b = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)p2), _mm_loadl_epi64((__m128i*)p4));
+        eq = _mm_and_si128(eq, _mm_cmpeq_epi8(a, b));
+        p1 += cur_pitch;
+        p2 += prev_pitch;
+        p3 += cur_pitch;
+        p4 += prev_pitch;
+    }
+
+    return _mm_movemask_epi8(eq) == 0xFFFF;
+}
@@ -221,7 +221,15 @@ AVCEnc_Status EncodeMB(AVCEncObject *encvid)
 
     /* compute the prediction */
     /* output is video->pred_block */
-    if (!currMB->mb_intra)
+    if (!currMB->mb_intra && encvid->screen_content && encvid->staticMB[CurrMbAddr])
+    {
+        /* unchanged since the previous input frame, the prediction from the
+           reference frame is the reconstruction, no transform */
+        AVCMBMotionComp(encvid, video);
+        currMB->CBP = 0;
+        memset(currMB->nz_coeff, 0, sizeof(uint8)*NUM_BLKS_IN_MB);
+    }
+    else if (!currMB->mb_intra)
     {
         AVCMBMotionComp(encvid, video); /* perform prediction and residue calculation */
         /* we can do the loop here and call dct_luma */
@@ -318,9 +326,12 @@ AVCEnc_Status EncodeMB(AVCEncObject *encvid)
     /* not need to do anything, the result is in encvid->pred_ic
     chroma dct must be aware that prediction block can come from either intra or inter. */
 
-    dct_chroma(encvid, curCb, orgCb, 0);
+    if (currMB->mb_intra || !encvid->screen_content || !encvid->staticMB[CurrMbAddr])
+    {
+        dct_chroma(encvid, curCb, orgCb, 0);
 
-    dct_chroma(encvid, curCr, orgCr, 1);
+        dct_chroma(encvid, curCr, orgCr, 1);
+    }
 
 
     /* 4.1 if there's nothing in there, video->mb_skip_run++ */
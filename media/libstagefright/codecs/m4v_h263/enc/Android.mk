@@ -34,4 +34,11 @@ LOCAL_C_INCLUDES := \
     $(TOP)/frameworks/base/include/media/stagefright/openmax \
     $(TOP)/frameworks/base/media/libstagefright/include
 
+# SSE2 version of the macroblock compare used by the screen content mode,
+# every x86 target has SSE2.
+ifeq ($(TARGET_ARCH),x86)
+    LOCAL_CFLAGS     += -DM4VENC_SSE2 -msse2
+    LOCAL_SRC_FILES  += src/sad_sse2.cpp
+endif
+
 include $(BUILD_STATIC_LIBRARY)
@@ -294,6 +294,7 @@ status_t M4vH263Encoder::initCheck(const sp<MetaData>& meta) {
     mEncParams->gobHeaderInterval = 0;
     mEncParams->useACPred = PV_ON;
     mEncParams->intraDCVlcTh = 0;
+    mEncParams->screenContent = PV_OFF;
 
     mFormat = new MetaData;
     mFormat->setInt32(kKeyWidth, mVideoWidth);
@@ -234,6 +234,12 @@ typedef struct tagvideoEncOptions
     /** @brief This flag turns on the use of AC prediction */
     Bool                useACPred;
 
+    /** @brief  Turns on/off the screen content mode. If on, the macroblocks that did not change since the
+    *           previous input frame are coded as skipped without motion search or DCT, which is much faster
+    *           for mostly static content such as a user interface. The changed area may also be given with
+    *           PVAddDirtyRect(). It is only supported with one layer. The default is PV_OFF.*/
+    ParamEncMode        screenContent;
+
 } VideoEncOptions;
 
 #ifdef __cplusplus
@@ -439,6 +445,17 @@ extern "C"
 
 #endif // LIMITED_API
 
+    /**
+    *   @brief  Adds a rectangle to the region that changed in the next input frame, in screen content mode.
+    *           The macroblocks outside of the region are coded as skipped without being compared, so the
+    *           region must cover every change. Without a call the whole frame is compared. An empty rectangle
+    *           marks the whole frame as unchanged. The region is kept until a frame is encoded.
+    *   @param  encCtrl is video encoder control structure that is always passed as input in all APIs
+    *   @param  left, top, right, bottom are the pixel coordinates of the rectangle, right and bottom exclusive.
+    *   @return true for correct operation; false if error happens or screen content mode is off
+    */
+    OSCL_IMPORT_REF Bool    PVAddDirtyRect(VideoEncControls *encCtrl, Int left, Int top, Int right, Int bottom);
+
     /* finishing encoder */
     /**
     *   @brief  This function frees up all the memory allocated by the encoder library.
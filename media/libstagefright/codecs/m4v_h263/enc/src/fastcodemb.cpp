@@ -57,6 +57,7 @@ PV_STATUS CodeMB_H263(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
     UChar shortHeader = video->vol[video->currLayer]->shortVideoHeader;
     Int dc_scaler = 8;
     Int intra = (Mode == MODE_INTRA || Mode == MODE_INTRA_Q);
+    Int static_mb = (!intra && video->encParams->ScreenContent_Enabled && video->staticMB[mbnum]);
     struct QPstruct QuantParam;
     Int dctMode, DctTh1;
     Int ColTh;
@@ -174,6 +175,8 @@ PV_STATUS CodeMB_H263(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
                     }
                     DctTh1 = (Int)(dc_scaler * 3);//*1.829
                 }
+                else if (static_mb)
+                    sad = 0; /* unchanged since the previous input */
                 else
                     sad = Sad8x8(input, pred, width);
             }
@@ -186,6 +189,8 @@ PV_STATUS CodeMB_H263(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
                 {
                     sad = getBlockSum(input, width);
                 }
+                else if (static_mb)
+                    sad = 0; /* unchanged since the previous input */
                 else
                     sad = Sad8x8(input, pred, width);
             }
@@ -286,6 +291,7 @@ PV_STATUS CodeMB_MPEG(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
     Int dc_scaler = 8;
     Vol *currVol = video->vol[video->currLayer];
     Int intra = (Mode == MODE_INTRA || Mode == MODE_INTRA_Q);
+    Int static_mb = (!intra && video->encParams->ScreenContent_Enabled && video->staticMB[mbnum]);
     Int *qmat;
     Int dctMode, DctTh1, DctTh2, DctTh3, DctTh4;
     Int ColTh;
@@ -396,6 +402,8 @@ PV_STATUS CodeMB_MPEG(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
                     DctTh1 = dc_scaler * 3;
                     sad = getBlockSum(input, width);
                 }
+                else if (static_mb)
+                    sad = 0; /* unchanged since the previous input */
                 else
                     sad = Sad8x8(input, pred, width);
             }
@@ -406,6 +414,8 @@ PV_STATUS CodeMB_MPEG(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
                 if (lx != width) input -= (ind_y << 7);
                 if (intra)
                     sad = getBlockSum(input, width);
+                else if (static_mb)
+                    sad = 0; /* unchanged since the previous input */
                 else
                     sad = Sad8x8(input, pred, width);
             }
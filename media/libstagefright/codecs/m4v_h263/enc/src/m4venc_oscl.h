@@ -33,6 +33,7 @@
 
 #define M4VENC_MEMSET(ptr,val,size)     memset(ptr,val,size)
 #define M4VENC_MEMCPY(dst,src,size)     memcpy(dst,src,size)
+#define M4VENC_MEMCMP(ptr1,ptr2,size)   memcmp(ptr1,ptr2,size)
 
 #define M4VENC_LOG(x)                   log(x)
 #define M4VENC_SQRT(x)                  sqrt(x)
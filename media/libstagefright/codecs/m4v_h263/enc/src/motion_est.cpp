@@ -157,6 +157,7 @@ void MotionEstimation(VideoEncData *video)
     Int sad8 = 0, sad16 = 0;
     Int totalSAD = 0;   /* average SAD for rate control */
     Int skip_halfpel_4mv;
+    Int static_mb;
     Int f_code_p, f_code_n, max_mag = 0, min_mag = 0;
     Int type_pred;
     Int xh[5] = {0, 0, 0, 0, 0};
@@ -181,6 +182,11 @@ void MotionEstimation(VideoEncData *video)
 
     offset = 0;
 
+    if (video->encParams->ScreenContent_Enabled)
+    {
+        FindStaticMB(video);
+    }
+
     if (video->currVop->predictionType == I_VOP)
     {   /* compute the SAV */
         mbnum = 0;
@@ -273,8 +279,22 @@ void MotionEstimation(VideoEncData *video)
 
                 cur = currFrame->yChan + offset;
 
+                static_mb = (*mode_mb != MODE_INTRA && video->encParams->ScreenContent_Enabled &&
+                             video->staticMB[mbnum]);
 
-                if (*mode_mb != MODE_INTRA)
+                if (static_mb)
+                {
+                    /* unchanged since the previous input frame, no search, it is coded
+                       with a zero MV and without DCT, see CodeMB_H263() */
+                    *mode_mb = MODE_INTER;
+                    for (comp = 0; comp <= 4; comp++)
+                    {
+                        mot_mb[comp].x = 0;
+                        mot_mb[comp].y = 0;
+                        mot_mb[comp].sad = 0;
+                    }
+                }
+                else if (*mode_mb != MODE_INTRA)
                 {
 #if defined(HTFM)
                     HTFMPrepareCurMB(video, &htfm_stat, cur);
@@ -335,7 +355,7 @@ void MotionEstimation(VideoEncData *video)
                     fclose(fp_debug);
 #endif
                 }
-                else /* *mode_mb = MODE_INTER;*/
+                else if (!static_mb) /* *mode_mb = MODE_INTER;*/
                 {
                     if (video->encParams->HalfPel_Enabled)
                     {
@@ -529,6 +549,129 @@ void MotionEstimation(VideoEncData *video)
     return ;
 }
 
+/* pointers to the MB at (i, j) in the input frame and in video->prevInput */
+static void GetInputMB(VideoEncData *video, Int i, Int j, UChar *cur[], UChar *prev[])
+{
+    Vol *currVol = video->vol[video->currLayer];
+    VideoEncFrameIO *currFrame = video->input;
+    Int pitch = currFrame->pitch;
+    Int width = currVol->nMBPerRow << 4;
+    Int size = width * (currVol->nMBPerCol << 4);
+    Int offset;
+
+    offset = (j << 4) * pitch + (i << 4);
+    cur[0] = currFrame->yChan + offset;
+    offset = (j << 3) * (pitch >> 1) + (i << 3);
+    cur[1] = currFrame->uChan + offset;
+    cur[2] = currFrame->vChan + offset;
+
+    offset = (j << 4) * width + (i << 4);
+    prev[0] = video->prevInput + offset;
+    offset = (j << 3) * (width >> 1) + (i << 3);
+    prev[1] = video->prevInput + size + offset;
+    prev[2] = prev[1] + (size >> 2);
+
+    return ;
+}
+
+/*==================================================================
+    Function:   FindStaticMB
+    Purpose:    Mark the MBs identical to the previous input frame, they
+                are coded as skipped for screen content. With a dirty
+                region hint the MBs outside of it are not compared.
+====================================================================*/
+void FindStaticMB(VideoEncData *video)
+{
+    Vol *currVol = video->vol[video->currLayer];
+    Int mbwidth = currVol->nMBPerRow;
+    Int mbheight = currVol->nMBPerCol;
+    Int pitch = video->input->pitch;
+    Int width = mbwidth << 4;
+    UChar *staticMB = video->staticMB;
+    UChar *cur[3], *prev[3];
+    Int i, j, mbnum;
+
+    if (!video->prevInputValid)
+    {
+        M4VENC_MEMSET(staticMB, 0, sizeof(UChar)*currVol->nTotalMB);
+        return ;
+    }
+
+    mbnum = 0;
+    for (j = 0; j < mbheight; j++)
+    {
+        for (i = 0; i < mbwidth; i++)
+        {
+            if (video->dirtyHint && !video->dirtyMB[mbnum])
+            {
+                staticMB[mbnum] = 1; /* outside of the area the caller says changed */
+            }
+            else
+            {
+                GetInputMB(video, i, j, cur, prev);
+#ifdef M4VENC_SSE2
+                staticMB[mbnum] = CompareMB_SSE2(cur, pitch, prev, width);
+#else
+                staticMB[mbnum] = CompareMB_C(cur, pitch, prev, width);
+#endif
+            }
+            mbnum++;
+        }
+    }
+
+    return ;
+}
+
+/*==================================================================
+    Function:   SavePrevInput
+    Purpose:    Copy the MBs of the encoded input frame that changed into
+                prevInput. Only called for the frames that are kept so
+                that prevInput matches the reference VOP.
+====================================================================*/
+void SavePrevInput(VideoEncData *video)
+{
+    Vol *currVol = video->vol[video->currLayer];
+    Int mbwidth = currVol->nMBPerRow;
+    Int mbheight = currVol->nMBPerCol;
+    Int pitch = video->input->pitch;
+    Int width = mbwidth << 4;
+    UChar *staticMB = video->staticMB;
+    UChar *cur[3], *prev[3];
+    Int i, j, k, mbnum;
+
+    mbnum = 0;
+    for (j = 0; j < mbheight; j++)
+    {
+        for (i = 0; i < mbwidth; i++)
+        {
+            if (!staticMB[mbnum])
+            {
+                GetInputMB(video, i, j, cur, prev);
+                for (k = 0; k < 16; k++)
+                {
+                    M4VENC_MEMCPY(prev[0] + k * width, cur[0] + k * pitch, 16);
+                }
+                for (k = 0; k < 8; k++)
+                {
+                    M4VENC_MEMCPY(prev[1] + k * (width >> 1), cur[1] + k * (pitch >> 1), 8);
+                    M4VENC_MEMCPY(prev[2] + k * (width >> 1), cur[2] + k * (pitch >> 1), 8);
+                }
+            }
+            mbnum++;
+        }
+    }
+
+    video->prevInputValid = PV_TRUE;
+
+    if (video->dirtyHint)
+    {
+        video->dirtyHint = PV_FALSE;
+        M4VENC_MEMSET(video->dirtyMB, 0, sizeof(UChar)*currVol->nTotalMB);
+    }
+
+    return ;
+}
+
 
 #ifdef HTFM
 void InitHTFM(VideoEncData *video, HTFM_Stat *htfm_stat, double *newvar, Int *collect)
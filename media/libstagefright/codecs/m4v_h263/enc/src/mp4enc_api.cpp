@@ -158,7 +158,7 @@ OSCL_EXPORT_REF Bool PVGetDefaultEncOption(VideoEncOptions *encOption, Int encUs
 {
     VideoEncOptions defaultUseCase = {H263_MODE, profile_level_max_packet_size[SIMPLE_PROFILE_LEVEL0] >> 3,
                                       SIMPLE_PROFILE_LEVEL0, PV_OFF, 0, 1, 1000, 33, {144, 144}, {176, 176}, {15, 30}, {64000, 128000},
-                                      {10, 10}, {12, 12}, {0, 0}, CBR_1, 0.0, PV_OFF, -1, 0, PV_OFF, 16, PV_OFF, 0, PV_ON
+                                      {10, 10}, {12, 12}, {0, 0}, CBR_1, 0.0, PV_OFF, -1, 0, PV_OFF, 16, PV_OFF, 0, PV_ON, PV_OFF
                                      };
 
     OSCL_UNUSED_ARG(encUseCase); // unused for now. Later we can add more defaults setting and use this
@@ -343,6 +343,7 @@ OSCL_EXPORT_REF Bool    PVInitVideoEncoder(VideoEncControls *encoderControl, Vid
     encParams->FineFrameSkip_Enabled = 0;
     encParams->NoFrameSkip_Enabled = encOption->noFrameSkipped;
     encParams->NoPreSkip_Enabled = encOption->noFrameSkipped;
+    encParams->ScreenContent_Enabled = encOption->screenContent;
     encParams->GetVolHeader[0] = 0;
     encParams->GetVolHeader[1] = 0;
     encParams->ResyncPacketsize = encOption->packetSize << 3;
@@ -594,6 +595,10 @@ OSCL_EXPORT_REF Bool    PVInitVideoEncoder(VideoEncControls *encoderControl, Vid
 #endif
     }
 
+    /* screen content compares with the previous input of the base layer */
+    if (video->encParams->ScreenContent_Enabled == PV_ON && video->encParams->nLayers > 1)
+        goto CLEAN_UP;
+
     /******************************************/
     /******************************************/
 
@@ -669,6 +674,18 @@ OSCL_EXPORT_REF Bool    PVInitVideoEncoder(VideoEncControls *encoderControl, Vid
     video->intraArray = (UChar *)M4VENC_MALLOC(sizeof(UChar) * nTotalMB);
     if (video->intraArray == NULL) goto CLEAN_UP;
 
+    if (video->encParams->ScreenContent_Enabled)
+    {
+        video->prevInput = (UChar *)M4VENC_MALLOC(sizeof(UChar) * nTotalMB * 384); /* previous input frame, Y, U and V */
+        if (video->prevInput == NULL) goto CLEAN_UP;
+        video->staticMB = (UChar *)M4VENC_MALLOC(sizeof(UChar) * nTotalMB);
+        if (video->staticMB == NULL) goto CLEAN_UP;
+        video->dirtyMB = (UChar *)M4VENC_MALLOC(sizeof(UChar) * nTotalMB);
+        if (video->dirtyMB == NULL) goto CLEAN_UP;
+        M4VENC_MEMSET(video->staticMB, 0, sizeof(UChar) * nTotalMB);
+        M4VENC_MEMSET(video->dirtyMB, 0, sizeof(UChar) * nTotalMB);
+    }
+
     video->sliceNo = (UChar *) M4VENC_MALLOC(nTotalMB); /* Memory for Slice Numbers */
     if (video->sliceNo == NULL) goto CLEAN_UP;
     /* Allocating space for predDCAC[][8][16], Not that I intentionally  */
@@ -1135,6 +1152,9 @@ OSCL_EXPORT_REF Bool    PVCleanUpVideoEncoder(VideoEncControls *encoderControl)
         }
 
         if (video->intraArray) M4VENC_FREE(video->intraArray);
+        if (video->prevInput) M4VENC_FREE(video->prevInput);
+        if (video->staticMB) M4VENC_FREE(video->staticMB);
+        if (video->dirtyMB) M4VENC_FREE(video->dirtyMB);
 
         if (video->sliceNo)M4VENC_FREE(video->sliceNo);
         if (video->acPredFlag)M4VENC_FREE(video->acPredFlag);
@@ -1604,6 +1624,12 @@ OSCL_EXPORT_REF Bool PVEncodeVideoFrame(VideoEncControls *encCtrl, VideoEncFrame
 
     *size = currVol->stream->byteCount;
 
+    /* the frame is kept, it is the reference for the next static MB check */
+    if (encParams->ScreenContent_Enabled)
+    {
+        SavePrevInput(video);
+    }
+
     /****************************************/
     /* Swap Vop Pointers for Base Layer     */
     /****************************************/
@@ -1921,6 +1947,12 @@ OSCL_EXPORT_REF Bool PVEncodeSlice(VideoEncControls *encCtrl, UChar *bstream, In
 
         /*// End /////////////////////// */
 
+        /* the frame is kept, it is the reference for the next static MB check */
+        if (encParams->ScreenContent_Enabled)
+        {
+            SavePrevInput(video);
+        }
+
         /****************************************/
         /* Swap Vop Pointers for Base Layer     */
         /****************************************/
@@ -2272,6 +2304,49 @@ OSCL_EXPORT_REF Bool PVIFrameRequest(VideoEncControls *encCtrl)
     return PV_TRUE;
 }
 #endif
+
+/* ======================================================================== */
+/*  Function : PVAddDirtyRect()                                             */
+/*  Purpose  : adds to the changed region of the next frame, screen content */
+/*  In/out   :                                                              */
+/*  Return   : PV_TRUE if successed, PV_FALSE if failed.                    */
+/*  Modified :                                                              */
+/*                                                                          */
+/* ======================================================================== */
+
+OSCL_EXPORT_REF Bool PVAddDirtyRect(VideoEncControls *encCtrl, Int left, Int top, Int right, Int bottom)
+{
+    VideoEncData    *encData;
+    Vol *currVol;
+    Int i, j;
+
+    encData = (VideoEncData *)encCtrl->videoEncoderData;
+
+    if (encData == NULL)
+        return PV_FALSE;
+    if (encData->encParams == NULL || !encData->encParams->ScreenContent_Enabled)
+        return PV_FALSE;
+
+    currVol = encData->vol[0];
+
+    /* clip to the frame */
+    if (left < 0) left = 0;
+    if (top < 0) top = 0;
+    if (right > (currVol->nMBPerRow << 4)) right = (currVol->nMBPerRow << 4);
+    if (bottom > (currVol->nMBPerCol << 4)) bottom = (currVol->nMBPerCol << 4);
+
+    encData->dirtyHint = PV_TRUE;
+
+    for (j = (top >> 4); j < ((bottom + 15) >> 4); j++)
+    {
+        for (i = (left >> 4); i < ((right + 15) >> 4); i++)
+        {
+            encData->dirtyMB[j * currVol->nMBPerRow + i] = 1;
+        }
+    }
+
+    return PV_TRUE;
+}
 #ifndef LIMITED_API
 /* ======================================================================== */
 /*  Function : PVGetEncMemoryUsage()                                        */
@@ -115,6 +115,8 @@ extern "C"
 
     /* defined in motion_est.c */
     void MotionEstimation(VideoEncData *video);
+    void FindStaticMB(VideoEncData *video);
+    void SavePrevInput(VideoEncData *video);
 #ifdef HTFM
     void InitHTFM(VideoEncData *video, HTFM_Stat *htfm_stat, double *newvar, Int *collect);
     void UpdateHTFM(VideoEncData *video, double *newvar, double *exp_lamda, HTFM_Stat *htfm_stat);
@@ -155,6 +157,12 @@ extern "C"
     Int SAD_Block_C(UChar *ref, UChar *blk, Int dmin, Int lx, void *extra_info);
     Int SAD_Block_MMX(UChar *ref, UChar *blk, Int dmin, Int lx, void *extra_info);
     Int SAD_Block_SSE(UChar *ref, UChar *blk, Int dmin, Int lx, void *extra_info);
+    Bool CompareMB_C(UChar *cur[], Int cur_pitch, UChar *prev[], Int prev_pitch);
+
+#ifdef M4VENC_SSE2
+    /* defined in sad_sse2.c */
+    Bool CompareMB_SSE2(UChar *cur[], Int cur_pitch, UChar *prev[], Int prev_pitch);
+#endif
 
 #ifdef HTFM /* Hypothesis Testing Fast Matching */
     Int SAD_MB_HP_HTFM_Collectxhyh(UChar *ref, UChar *blk, Int dmin_x, void *extra_info);
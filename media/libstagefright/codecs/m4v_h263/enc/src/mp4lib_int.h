@@ -210,6 +210,7 @@ typedef struct tagVideoEncParams
     Bool    VBR_Enabled;            /* VBR rate control */
     Bool    NoFrameSkip_Enabled;    /* do not allow frame skip */
     Bool    NoPreSkip_Enabled;      /* do not allow pre-skip */
+    Bool    ScreenContent_Enabled;  /* code the MBs unchanged since the previous input as skipped */
 
     Bool    H263_Enabled;           /* H263 Short Header */
     Bool    GOV_Enabled;            /* GOV Header Enabled */
@@ -356,6 +357,13 @@ typedef struct tagVideoEncData
     UChar   *intraArray;            /* Intra Update Arrary */
     float   sumMAD;             /* SAD/MAD for frame */
 
+    /* screen content, MBs unchanged since the previous input are skipped */
+    UChar   *prevInput;         /* previous encoded input frame, Y followed by U and V */
+    Bool    prevInputValid;     /* prevInput holds a frame */
+    UChar   *staticMB;          /* flag for each MB, same as in prevInput */
+    UChar   *dirtyMB;           /* flag for each MB, inside the dirty region hint */
+    Bool    dirtyHint;          /* dirtyMB was given for the next frame */
+
     /* to speedup the SAD calculation */
     void *sad_extra_info;
 #ifdef HTFM
@@ -17,6 +17,7 @@
  */
 #include "mp4def.h"
 #include "mp4lib_int.h"
+#include "m4venc_oscl.h"
 
 #include "sad_inline.h"
 
@@ -45,6 +46,7 @@ ULong num_sad_Blk_call = 0;
 
 /* consist of
 Int SAD_Macroblock_C(UChar *ref,UChar *blk,Int dmin,Int lx,void *extra_info)
+Bool CompareMB_C(UChar *cur[],Int cur_pitch,UChar *prev[],Int prev_pitch)
 Int SAD_MB_HTFM_Collect(UChar *ref,UChar *blk,Int dmin,Int lx,void *extra_info)
 Int SAD_MB_HTFM(UChar *ref,UChar *blk,Int dmin,Int lx,void *extra_info)
 Int SAD_Block_C(UChar *ref,UChar *blk,Int dmin,Int lx,void *extra_info)
@@ -90,6 +92,48 @@ extern "C"
         return x10;
     }
 
+    /*==================================================================
+        Function:   CompareMB_C
+        Purpose:    Check whether the 16x16 luma and the two 8x8 chroma
+                    blocks of a macroblock are identical in two frames,
+                    the chroma pitch is half of the luma pitch.
+    ==================================================================*/
+    Bool CompareMB_C(UChar *cur[], Int cur_pitch, UChar *prev[], Int prev_pitch)
+    {
+        UChar *p1, *p2, *p3, *p4;
+        Int i;
+
+        p1 = cur[0];
+        p2 = prev[0];
+        for (i = 0; i < 16; i++)
+        {
+            if (M4VENC_MEMCMP(p1, p2, 16))
+                return PV_FALSE;
+
+            p1 += cur_pitch;
+            p2 += prev_pitch;
+        }
+
+        cur_pitch >>= 1;
+        prev_pitch >>= 1;
+        p1 = cur[1];
+        p2 = prev[1];
+        p3 = cur[2];
+        p4 = prev[2];
+        for (i = 0; i < 8; i++)
+        {
+            if (M4VENC_MEMCMP(p1, p2, 8) || M4VENC_MEMCMP(p3, p4, 8))
+                return PV_FALSE;
+
+            p1 += cur_pitch;
+            p2 += prev_pitch;
+            p3 += cur_pitch;
+            p4 += prev_pitch;
+        }
+
+        return PV_TRUE;
+    }
+
 #ifdef HTFM   /* HTFM with uniform subsampling implementation, 2/28/01 */
     /*===============================================================
         Function:   SAD_MB_HTFM_Collect and SAD_MB_HTFM
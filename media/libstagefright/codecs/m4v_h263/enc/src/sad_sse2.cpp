@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mp4def.h"
+#include "mp4lib_int.h"
+
+#include <emmintrin.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*==================================================================
+        Function:   CompareMB_SSE2
+        Purpose:    SSE2 version of CompareMB_C. The rows are compared
+                    16 bytes at a time, the chroma rows of both components
+                    are packed into one register.
+    ==================================================================*/
+    Bool CompareMB_SSE2(UChar *cur[], Int cur_pitch, UChar *prev[], Int prev_pitch)
+    {
+        UChar *p1 = cur[0], *p2 = prev[0], *p3, *p4;
+        __m128i eq = _mm_cmpeq_epi8(_mm_setzero_si128(), _mm_setzero_si128());
+        __m128i a, b;
+        Int i;
+
+        for (i = 0; i < 16; i++)
+        {
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)p1),
+                                                  _mm_loadu_si128((__m128i*)p2)));
+            p1 += cur_pitch;
+            p2 += prev_pitch;
+        }
+
+        cur_pitch >>= 1;
+        prev_pitch >>= 1;
+        p1 = cur[1];
+        p2 = prev[1];
+        p3 = cur[2];
+        p4 = prev[2];
+        for (i = 0; i < 8; i++)
+        {
+            a = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)p1), _mm_loadl_epi64((__m128i*)p3));
+            b = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)p2), _mm_loadl_epi64((__m128i*)p4));
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(a, b));
+            p1 += cur_pitch;
+            p2 += prev_pitch;
+            p3 += cur_pitch;
+            p4 += prev_pitch;
+        }
+
+        return (_mm_movemask_epi8(eq) == 0xFFFF) ? PV_TRUE : PV_FALSE;
+    }
+
+#ifdef __cplusplus
+}
+#endif
@@ -10,6 +10,7 @@ LOCAL_SRC_FILES := \
  	src/pvmp3_getbits.cpp \
  	src/pvmp3_dequantize_sample.cpp \
  	src/pvmp3_framedecoder.cpp \
+ 	src/pvmp3_batchdecoder.cpp \
  	src/pvmp3_get_main_data_size.cpp \
  	src/pvmp3_get_side_info.cpp \
  	src/pvmp3_get_scale_factors.cpp \
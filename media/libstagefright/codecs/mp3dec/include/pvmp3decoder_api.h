@@ -236,6 +236,38 @@ extern "C"
 
     } tPVMP3DecoderExternal;
 
+    /*
+     * Result of pvmp3_batchdecoder(), the whole stream decoded to 16-bit PCM.
+     */
+    typedef struct
+#ifdef __cplusplus
+                tPVMP3BatchOutput
+#endif
+    {
+        /*
+         * OUTPUT:
+         * Interleaved PCM of all frames, allocated with malloc(). The caller
+         * frees it.
+         */
+        int16       *pOutputBuffer;
+
+        /*
+         * OUTPUT:
+         * Number of 16-bit samples in pOutputBuffer, all channels.
+         */
+        int32       outputLength;
+
+        /*
+         * OUTPUT:
+         * Number of frames decoded. A frame that fails to decode is
+         * replaced by silence.
+         */
+        int32       numFrames;
+
+        int16       num_channels;
+        int32       samplingRate;
+    } tPVMP3BatchOutput;
+
 uint32 pvmp3_decoderMemRequirements(void);
 
 void pvmp3_InitDecoder(tPVMP3DecoderExternal *pExt,
@@ -246,6 +278,15 @@ void pvmp3_resetDecoder(void  *pMem);
 ERROR_CODE pvmp3_framedecoder(tPVMP3DecoderExternal *pExt,
                               void              *pMem);
 
+/*
+ * Decodes a whole layer III stream held in memory for offline use, on
+ * numThreads threads, or one per online core if numThreads is 0.
+ */
+ERROR_CODE pvmp3_batchdecoder(const uint8 *pInputBuffer,
+                              int32 inputLength,
+                              int32 numThreads,
+                              tPVMP3BatchOutput *pOutput);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+------------------------------------------------------------------------------
+
+   Filename: pvmp3_batchdecoder.cpp
+
+   Functions:
+        pvmp3_batchdecoder
+
+------------------------------------------------------------------------------
+ INPUT AND OUTPUT DEFINITIONS
+
+Input
+    pInputBuffer = layer III stream, optionally starting with an ID3v2 tag
+    inputLength = size of the stream in bytes
+    numThreads = number of decoding threads, 0 for one per online core
+
+Output
+    pOutput = PCM of the whole stream, see pvmp3decoder_api.h
+
+Returns
+    NO_DECODING_ERROR, SYNCH_LOST_ERROR if no frame was found or
+    MEMORY_ALLOCATION_ERROR
+
+------------------------------------------------------------------------------
+ FUNCTION DESCRIPTION
+
+    Decodes a whole stream for offline use, like extracting metadata or
+    transcoding, faster than pvmp3_framedecoder() frame by frame.
+
+    The frames are located first with a header search that, like
+    pvmp3_frame_synch(), only accepts a sync word if the header of the next
+    frame follows it. The frames are then split in ranges that are decoded
+    by a pool of threads, each with its own decoder instance.
+
+    A range can not start decoding at its first frame: the main data of a
+    frame may begin up to 511 bytes back in the bit reservoir, and the
+    filterbanks carry the previous granule over. Before its first frame
+    each range decodes, and throws away, the frames that fill the reservoir
+    for the last frames before the range, so that the output is the same
+    as the one of a single decoder running over the whole stream.
+
+------------------------------------------------------------------------------
+*/
+
+
+/*----------------------------------------------------------------------------
+; INCLUDES
+----------------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pvmp3decoder_api.h"
+#include "pvmp3_tables.h"
+#include "mp3_mem_funcs.h"
+
+
+/*----------------------------------------------------------------------------
+; DEFINES
+; Include all pre-processor statements here. Include conditional
+; compile variables also.
+----------------------------------------------------------------------------*/
+
+#define MAX_BATCH_THREADS      16
+
+/*
+ *  Ranges are claimed by the threads as they go, a few per thread keep all
+ *  of them busy until the end. Priming costs a few frames per range.
+ */
+#define RANGES_PER_THREAD      4
+#define MIN_FRAMES_PER_RANGE   64
+
+/*
+ *  Fixed header fields that do not change between frames of one stream:
+ *  sync word, version, layer and sampling frequency
+ */
+#define FIXED_HEADER_MASK      0xfffe0c00
+
+/*  320 kbps at 32 kHz, padded */
+#define MAX_FRAME_SIZE         1441
+
+/*  the bitstream reader loads 4 bytes at a time */
+#define FRAME_PADDING          4
+
+#define MAX_OUTPUT_FRAME_SIZE  (2 * 2 * SUBBANDS_NUMBER * FILTERBANK_BANDS)
+
+
+/*----------------------------------------------------------------------------
+; LOCAL STORE/BUFFER/POINTER DEFINITIONS
+; Variable declaration - defined here and used outside this module
+----------------------------------------------------------------------------*/
+
+typedef struct
+{
+    int32 offset;
+    int32 size;
+} tmp3batch_frame;
+
+typedef struct
+{
+    const uint8     *pStream;
+    int32           streamLength;
+
+    tmp3batch_frame *pFrames;
+    int32           numFrames;
+    int32           numRanges;
+
+    int16           *pOutput;
+    int32           outputFrameSize;
+    int32           synthFrames;
+
+    pthread_mutex_t lock;
+    int32           nextRange;
+    ERROR_CODE      status;
+} tmp3batch;
+
+
+/*----------------------------------------------------------------------------
+; LOCAL FUNCTION DEFINITIONS
+; Function Prototype declaration
+----------------------------------------------------------------------------*/
+
+static uint32 read_header(const uint8 *p)
+{
+    return ((uint32)p[0] << 24) | ((uint32)p[1] << 16) |
+           ((uint32)p[2] << 8) | (uint32)p[3];
+}
+
+static int32 header_version(uint32 header)
+{
+    switch ((header >> 19) & 3)
+    {
+        case 0:
+            return MPEG_2_5;
+        case 2:
+            return MPEG_2;
+        case 3:
+            return MPEG_1;
+        default:
+            return INVALID_VERSION;
+    }
+}
+
+static int32 header_channels(uint32 header)
+{
+    return (((header >> 6) & 3) == MPG_MD_MONO) ? 1 : 2;
+}
+
+/*
+ *  Size in bytes of the layer III frame starting with header, 0 if the
+ *  header is not a layer III one or uses the free format
+ */
+static int32 frame_size(uint32 header)
+{
+    int32 version = header_version(header);
+    int32 bitrate_index = (header >> 12) & 0xf;
+    int32 sampling_frequency = (header >> 10) & 3;
+
+    if ((header >> 21) != SYNC_WORD || version == INVALID_VERSION ||
+            ((header >> 17) & 3) != 1 || bitrate_index == 0 ||
+            bitrate_index == 15 || sampling_frequency == 3)
+    {
+        return 0;
+    }
+
+    int32 size = (version == MPEG_1) ? 144000 : 72000;
+    size = size * mp3_bitrate[version][bitrate_index] /
+           mp3_s_freq[version][sampling_frequency];
+
+    return size + ((header >> 9) & 1);
+}
+
+static bool same_stream(uint32 header, uint32 first)
+{
+    return (header & FIXED_HEADER_MASK) == (first & FIXED_HEADER_MASK) &&
+           header_channels(header) == header_channels(first);
+}
+
+/*
+ *  Frame at pos, if the next frame follows it or it ends the stream
+ */
+static int32 synched_frame(const uint8 *pStream, int32 length, int32 pos,
+                           uint32 first)
+{
+    if (pos + 4 > length)
+    {
+        return 0;
+    }
+
+    uint32 header = read_header(pStream + pos);
+    int32 size = frame_size(header);
+    if (size == 0 || pos + size > length ||
+            (first != 0 && !same_stream(header, first)))
+    {
+        return 0;
+    }
+
+    if (pos + size + 4 <= length)
+    {
+        uint32 next = read_header(pStream + pos + size);
+        if (frame_size(next) == 0 || !same_stream(next, header))
+        {
+            return 0;
+        }
+    }
+
+    return size;
+}
+
+/*
+ *  Locates all frames of the stream, skipping a leading ID3v2 tag and
+ *  any data between frames that does not belong to the stream
+ */
+static int32 index_frames(tmp3batch *pBatch)
+{
+    const uint8 *pStream = pBatch->pStream;
+    int32 length = pBatch->streamLength;
+    int32 pos = 0;
+    int32 capacity = 0;
+    uint32 first = 0;
+
+    if (length >= 10 && !memcmp(pStream, "ID3", 3))
+    {
+        pos = 10 + (((pStream[6] & 0x7f) << 21) | ((pStream[7] & 0x7f) << 14) |
+                    ((pStream[8] & 0x7f) << 7) | (pStream[9] & 0x7f));
+        if (pStream[5] & 0x10)
+        {
+            pos += 10;  /* footer */
+        }
+    }
+
+    while (pos + 4 <= length)
+    {
+        uint32 header = read_header(pStream + pos);
+        int32 size = frame_size(header);
+
+        if (first == 0 || size == 0 || pos + size > length ||
+                !same_stream(header, first))
+        {
+            /*
+             *  Lost sync, search the next frame that is followed by
+             *  another one
+             */
+            size = 0;
+            while (pos + 4 <= length &&
+                    (size = synched_frame(pStream, length, pos, first)) == 0)
+            {
+                pos++;
+            }
+            if (size == 0)
+            {
+                break;
+            }
+            if (first == 0)
+            {
+                first = read_header(pStream + pos);
+            }
+        }
+
+        if (pBatch->numFrames == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            tmp3batch_frame *pFrames = (tmp3batch_frame *)realloc(
+                                           pBatch->pFrames,
+                                           capacity * sizeof(tmp3batch_frame));
+            if (pFrames == NULL)
+            {
+                return -1;
+            }
+            pBatch->pFrames = pFrames;
+        }
+
+        pBatch->pFrames[pBatch->numFrames].offset = pos;
+        pBatch->pFrames[pBatch->numFrames].size = size;
+        pBatch->numFrames++;
+        pos += size;
+    }
+
+    return pBatch->numFrames;
+}
+
+/*
+ *  Number of main data bytes the frame adds to the bit reservoir, same as
+ *  pvmp3_get_main_data_size()
+ */
+static int32 main_data_size(const uint8 *pFrame, int32 size)
+{
+    uint32 header = read_header(pFrame);
+    int32 side_info = (header_version(header) == MPEG_1) ?
+                      ((header_channels(header) == 1) ? 17 : 32) :
+                      ((header_channels(header) == 1) ? 9 : 17);
+
+    size -= 4 + side_info + ((header & 0x10000) ? 0 : 2);
+
+    return (size > 0) ? size : 0;
+}
+
+/*
+ *  How far back in the reservoir the main data of the frame begins
+ */
+static int32 main_data_begin(const uint8 *pFrame)
+{
+    uint32 header = read_header(pFrame);
+    const uint8 *pSideInfo = pFrame + ((header & 0x10000) ? 4 : 6);
+
+    if (header_version(header) == MPEG_1)
+    {
+        return (pSideInfo[0] << 1) | (pSideInfo[1] >> 7);
+    }
+
+    return pSideInfo[0];
+}
+
+/*
+ *  First frame to decode for the range starting at frame first, so that
+ *  the frames ahead of it that the filterbanks depend on get all of their
+ *  main data
+ */
+static int32 prime_frame(const tmp3batch *pBatch, int32 first)
+{
+    const tmp3batch_frame *pFrames = pBatch->pFrames;
+    int32 synth = first - pBatch->synthFrames;
+    int32 start;
+
+    if (synth <= 0)
+    {
+        return 0;
+    }
+
+    for (start = synth; start > 0; start--)
+    {
+        int32 available = 0;
+        int32 i;
+
+        for (i = start; i < synth; i++)
+        {
+            available += main_data_size(pBatch->pStream + pFrames[i].offset,
+                                        pFrames[i].size);
+        }
+        for (; i <= first; i++)
+        {
+            const uint8 *pFrame = pBatch->pStream + pFrames[i].offset;
+            if (main_data_begin(pFrame) > available)
+            {
+                break;
+            }
+            available += main_data_size(pFrame, pFrames[i].size);
+        }
+        if (i > first)
+        {
+            break;
+        }
+    }
+
+    return start;
+}
+
+static void *batch_thread(void *arg)
+{
+    tmp3batch *pBatch = (tmp3batch *)arg;
+    tPVMP3DecoderExternal ext;
+    uint8 tail[MAX_FRAME_SIZE + FRAME_PADDING];
+
+    void *pMem = calloc(1, pvmp3_decoderMemRequirements());
+    int16 *pDiscard = (int16 *)malloc(MAX_OUTPUT_FRAME_SIZE * sizeof(int16));
+
+    if (pMem == NULL || pDiscard == NULL)
+    {
+        pthread_mutex_lock(&pBatch->lock);
+        pBatch->status = MEMORY_ALLOCATION_ERROR;
+        pthread_mutex_unlock(&pBatch->lock);
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pBatch->lock);
+        int32 range = pBatch->nextRange++;
+        bool done = range >= pBatch->numRanges ||
+                    pBatch->status != NO_DECODING_ERROR;
+        pthread_mutex_unlock(&pBatch->lock);
+
+        if (done)
+        {
+            break;
+        }
+
+        int32 first = (int32)((int64)range * pBatch->numFrames /
+                              pBatch->numRanges);
+        int32 end = (int32)((int64)(range + 1) * pBatch->numFrames /
+                            pBatch->numRanges);
+
+        pv_memset(&ext, 0, sizeof(ext));
+        ext.equalizerType = flat;
+        ext.crcEnabled = false;
+        pvmp3_InitDecoder(&ext, pMem);
+
+        for (int32 i = prime_frame(pBatch, first); i < end; i++)
+        {
+            const tmp3batch_frame *pFrame = &pBatch->pFrames[i];
+            uint8 *pInput = (uint8 *)pBatch->pStream + pFrame->offset;
+
+            if (pFrame->offset + pFrame->size + FRAME_PADDING >
+                    pBatch->streamLength)
+            {
+                pv_memcpy(tail, pInput, pFrame->size);
+                pv_memset(tail + pFrame->size, 0, FRAME_PADDING);
+                pInput = tail;
+            }
+
+            int16 *pOutput = (i < first) ? pDiscard :
+                             pBatch->pOutput + (int64)i * pBatch->outputFrameSize;
+
+            ext.pInputBuffer = pInput;
+            ext.inputBufferCurrentLength = pFrame->size;
+            ext.inputBufferMaxLength = 0;
+            ext.inputBufferUsedLength = 0;
+            ext.outputFrameSize = pBatch->outputFrameSize;
+            ext.pOutputBuffer = pOutput;
+
+            if (pvmp3_framedecoder(&ext, pMem) != NO_DECODING_ERROR ||
+                    ext.outputFrameSize != pBatch->outputFrameSize)
+            {
+                pv_memset(pOutput, 0,
+                          pBatch->outputFrameSize * sizeof(int16));
+            }
+        }
+    }
+
+    free(pDiscard);
+    free(pMem);
+
+    return NULL;
+}
+
+
+/*----------------------------------------------------------------------------
+; FUNCTION CODE
+----------------------------------------------------------------------------*/
+
+ERROR_CODE pvmp3_batchdecoder(const uint8 *pInputBuffer,
+                              int32 inputLength,
+                              int32 numThreads,
+                              tPVMP3BatchOutput *pOutput)
+{
+    tmp3batch batch;
+    pthread_t threads[MAX_BATCH_THREADS];
+    int32 numStarted = 0;
+
+    pv_memset(pOutput, 0, sizeof(*pOutput));
+    pv_memset(&batch, 0, sizeof(batch));
+    batch.pStream = pInputBuffer;
+    batch.streamLength = inputLength;
+    batch.status = NO_DECODING_ERROR;
+
+    if (index_frames(&batch) <= 0)
+    {
+        free(batch.pFrames);
+        return (batch.numFrames < 0) ? MEMORY_ALLOCATION_ERROR :
+               SYNCH_LOST_ERROR;
+    }
+
+    uint32 header = read_header(pInputBuffer + batch.pFrames[0].offset);
+    int32 version = header_version(header);
+
+    pOutput->num_channels = header_channels(header);
+    pOutput->samplingRate = mp3_s_freq[version][(header >> 10) & 3];
+
+    /*
+     *  MPEG-1 frames have two granules, the second one sets up the
+     *  filterbanks for the next frame on its own
+     */
+    batch.synthFrames = (version == MPEG_1) ? 1 : 2;
+    batch.outputFrameSize = pOutput->num_channels * SUBBANDS_NUMBER *
+                            FILTERBANK_BANDS * ((version == MPEG_1) ? 2 : 1);
+
+    batch.pOutput = (int16 *)malloc((int64)batch.numFrames *
+                                    batch.outputFrameSize * sizeof(int16));
+    if (batch.pOutput == NULL)
+    {
+        free(batch.pFrames);
+        return MEMORY_ALLOCATION_ERROR;
+    }
+
+    if (numThreads <= 0)
+    {
+        numThreads = (int32)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (numThreads > MAX_BATCH_THREADS)
+    {
+        numThreads = MAX_BATCH_THREADS;
+    }
+
+    batch.numRanges = numThreads * RANGES_PER_THREAD;
+    if (batch.numRanges > batch.numFrames / MIN_FRAMES_PER_RANGE)
+    {
+        batch.numRanges = batch.numFrames / MIN_FRAMES_PER_RANGE;
+    }
+    if (numThreads <= 1 || batch.numRanges < 1)
+    {
+        batch.numRanges = 1;
+    }
+    if (numThreads > batch.numRanges)
+    {
+        numThreads = batch.numRanges;
+    }
+
+    pthread_mutex_init(&batch.lock, NULL);
+
+    /*
+     *  The calling thread decodes ranges too
+     */
+    while (numStarted < numThreads - 1 &&
+            !pthread_create(&threads[numStarted], NULL, batch_thread, &batch))
+    {
+        numStarted++;
+    }
+    batch_thread(&batch);
+
+    while (numStarted > 0)
+    {
+        pthread_join(threads[--numStarted], NULL);
+    }
+
+    pthread_mutex_destroy(&batch.lock);
+    free(batch.pFrames);
+
+    if (batch.status != NO_DECODING_ERROR)
+    {
+        free(batch.pOutput);
+        return batch.status;
+    }
+
+    pOutput->pOutputBuffer = batch.pOutput;
+    pOutput->outputLength = batch.numFrames * batch.outputFrameSize;
+    pOutput->numFrames = batch.numFrames;
+
+    return NO_DECODING_ERROR;
+}
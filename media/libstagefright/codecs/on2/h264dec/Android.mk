@@ -30,6 +30,7 @@ LOCAL_SRC_FILES := \
 	./source/h264bsd_vui.c \
 	./source/h264bsd_pic_order_cnt.c \
 	./source/h264bsd_decoder.c \
+	./source/h264bsd_threads.c \
 	./source/H264SwDecApi.c \
 	SoftAVC.cpp \
 
@@ -96,8 +97,17 @@ ifeq ($(ARCH_ARM_HAVE_NEON),true)
                         $(LOCAL_PATH)/./omxdl/arm_neon/vc/m4p10/api
 endif
 
+# SSE2 versions of the interpolation, deblocking, transform and intra
+# prediction kernels, every x86 target has SSE2.
+ifeq ($(TARGET_ARCH),x86)
+    LOCAL_CFLAGS     += -DH264DEC_SSE2 -msse2
+    LOCAL_SRC_FILES  += ./source/x86_sse2/h264bsd_reconstruct_sse2.c
+    LOCAL_C_INCLUDES += $(LOCAL_PATH)/./source
+endif
+
 LOCAL_SHARED_LIBRARIES := \
 	libstagefright libstagefright_omx libstagefright_foundation libutils \
+	libcutils \
 
 LOCAL_MODULE := libstagefright_soft_h264dec
 
@@ -25,6 +25,9 @@
 #include <media/stagefright/MediaErrors.h>
 #include <media/IOMX.h>
 
+#include <cutils/properties.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 namespace android {
 
@@ -159,12 +162,46 @@ void SoftAVC::initPorts() {
     addPort(def);
 }
 
+static int GetCPUCoreCount() {
+    int cpuCoreCount = 1;
+#if defined(_SC_NPROCESSORS_ONLN)
+    cpuCoreCount = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    // _SC_NPROC_ONLN must be defined...
+    cpuCoreCount = sysconf(_SC_NPROC_ONLN);
+#endif
+    CHECK(cpuCoreCount >= 1);
+    ALOGV("Number of CPU cores: %d", cpuCoreCount);
+    return cpuCoreCount;
+}
+
+// Slices and deblocking are spread over one thread per core unless
+// "media.stagefright.avcdec.threads" says otherwise, 1 decodes in the
+// calling thread only.
+static int GetDecoderThreadCount() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.stagefright.avcdec.threads", value, NULL)) {
+        int numThreads = atoi(value);
+        if (numThreads >= 1) {
+            return numThreads;
+        }
+        ALOGW("Ignoring invalid media.stagefright.avcdec.threads %s", value);
+    }
+    return GetCPUCoreCount();
+}
+
 status_t SoftAVC::initDecoder() {
     // Force decoder to output buffers in display order.
-    if (H264SwDecInit(&mHandle, 0) == H264SWDEC_OK) {
-        return OK;
+    if (H264SwDecInit(&mHandle, 0) != H264SWDEC_OK) {
+        return UNKNOWN_ERROR;
+    }
+
+    int numThreads = GetDecoderThreadCount();
+    if (H264SwDecSetNumThreads(mHandle, numThreads) != H264SWDEC_OK) {
+        // Still decodes, just in this thread only.
+        ALOGW("Unable to start %d decoder threads", numThreads);
     }
-    return UNKNOWN_ERROR;
+    return OK;
 }
 
 OMX_ERRORTYPE SoftAVC::internalGetParameter(
@@ -146,6 +146,9 @@ extern "C"
     H264SwDecRet H264SwDecInit(H264SwDecInst *decInst,
                                u32            noOutputReordering);
 
+    H264SwDecRet H264SwDecSetNumThreads(H264SwDecInst decInst,
+                                        u32           numThreads);
+
     H264SwDecRet H264SwDecNextPicture(H264SwDecInst     decInst,
                                       H264SwDecPicture *pOutput,
                                       u32               endOfStream);
@@ -24,6 +24,7 @@
      4. Local function prototypes
      5. Functions
           H264SwDecInit
+          H264SwDecSetNumThreads
           H264SwDecGetInfo
           H264SwDecRelease
           H264SwDecDecode
@@ -175,6 +176,64 @@ H264SwDecRet H264SwDecInit(H264SwDecInst *decInst, u32 noOutputReordering)
 
 }
 
+/*------------------------------------------------------------------------------
+
+    Function: H264SwDecSetNumThreads()
+
+        Functional description:
+            Set the number of threads used for decoding. Slices of a picture
+            are decoded in parallel and deblocking filtering of a picture is
+            shared by the threads, decoded pictures are the same for any
+            number of threads. Decoder uses the calling thread only by
+            default. Shall not be called during H264SwDecDecode.
+
+        Inputs:
+            decInst     decoder instance
+            numThreads  number of threads including the calling thread,
+                        0 or 1 to decode in the calling thread only
+
+        Outputs:
+            none
+
+        Returns:
+            H264SWDEC_OK            success
+            H264SWDEC_PARAM_ERR     invalid parameters
+            H264SWDEC_MEMFAIL       threads could not be started, decoder
+                                    uses the calling thread only
+
+------------------------------------------------------------------------------*/
+
+H264SwDecRet H264SwDecSetNumThreads(H264SwDecInst decInst, u32 numThreads)
+{
+
+    decContainer_t *pDecCont;
+
+    DEC_API_TRC("H264SwDecSetNumThreads#");
+
+    if (decInst == NULL)
+    {
+        DEC_API_TRC("H264SwDecSetNumThreads# ERROR: decInst == NULL");
+        return(H264SWDEC_PARAM_ERR);
+    }
+
+    pDecCont = (decContainer_t*)decInst;
+
+#ifdef H264DEC_TRACE
+    sprintf(pDecCont->str, "H264SwDecSetNumThreads# decInst %p numThreads %d",
+            decInst, numThreads);
+    DEC_API_TRC(pDecCont->str);
+#endif
+
+    if (h264bsdSetNumThreads(&pDecCont->storage, numThreads) != HANTRO_OK)
+    {
+        DEC_API_TRC("H264SwDecSetNumThreads# ERROR: Thread creation failed");
+        return(H264SWDEC_MEMFAIL);
+    }
+
+    return(H264SWDEC_OK);
+
+}
+
 /*------------------------------------------------------------------------------
 
     Function: H264SwDecGetInfo()
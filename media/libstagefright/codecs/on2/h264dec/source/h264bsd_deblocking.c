@@ -24,6 +24,7 @@
      4. Local function prototypes
      5. Functions
           h264bsdFilterPicture
+          FilterMb
           FilterVerLumaEdge
           FilterHorLumaEdge
           FilterHorLuma
@@ -40,6 +41,8 @@
           GetChromaEdgeThresholds
           FilterLuma
           FilterChroma
+          h264bsdFilterPictureParallel
+          FilterRows
 
 ------------------------------------------------------------------------------*/
 
@@ -52,6 +55,7 @@
 #include "h264bsd_macroblock_layer.h"
 #include "h264bsd_deblocking.h"
 #include "h264bsd_dpb.h"
+#include "h264bsd_threads.h"
 
 #ifdef H264DEC_OMXDL
 #include "omxtypes.h"
@@ -59,6 +63,11 @@
 #include "armVC.h"
 #endif /* H264DEC_OMXDL */
 
+#ifdef H264DEC_SSE2
+#include <emmintrin.h>
+#include <string.h>
+#endif /* H264DEC_SSE2 */
+
 /*------------------------------------------------------------------------------
     2. External compiler flags
 --------------------------------------------------------------------------------
@@ -141,6 +150,16 @@ enum { TOP = 0, LEFT = 1, INNER = 2 };
 #define FILTER_TOP_EDGE     0x02
 #define FILTER_INNER_EDGE   0x01
 
+/* picture shared by the threads filtering it */
+typedef struct {
+    image_t *image;
+    mbStorage_t *mb;
+    threadPool_t *pPool;
+    u32 nextRow;
+    /* number of filtered macroblocks of each macroblock row, waited on by
+     * the thread filtering the row below */
+    threadProgress_t *rowProgress;
+} filterRows_t;
 
 /* clipping table defined in intra_prediction.c */
 extern const u8 h264bsdClip[];
@@ -166,6 +185,10 @@ static u32 IsSliceBoundaryOnTop(mbStorage_t *mb);
 
 static u32 GetMbFilteringFlags(mbStorage_t *mb);
 
+static void FilterMb(image_t *image, mbStorage_t *pMb, u32 mbRow, u32 mbCol);
+
+static void FilterRows(void *arg);
+
 #ifndef H264DEC_OMXDL
 
 static u32 GetBoundaryStrengths(mbStorage_t *mb, bS_t *bs, u32 flags);
@@ -176,6 +199,7 @@ static void FilterLuma(u8 *data, bS_t *bS, edgeThreshold_t *thresholds,
 static void FilterChroma(u8 *cb, u8 *cr, bS_t *bS, edgeThreshold_t *thresholds,
         u32 imageWidth);
 
+#ifndef H264DEC_SSE2
 static void FilterVerLumaEdge( u8 *data, u32 bS, edgeThreshold_t *thresholds,
         u32 imageWidth);
 static void FilterHorLumaEdge( u8 *data, u32 bS, edgeThreshold_t *thresholds,
@@ -189,6 +213,7 @@ static void FilterHorChromaEdge( u8 *data, u32 bS, edgeThreshold_t *thresholds,
   i32 imageWidth);
 static void FilterHorChroma( u8 *data, u32 bS, edgeThreshold_t *thresholds,
   i32 imageWidth);
+#endif /* H264DEC_SSE2 */
 
 static void GetLumaEdgeThresholds(
   edgeThreshold_t *thresholds,
@@ -578,13 +603,8 @@ void h264bsdFilterPicture(
 
 /* Variables */
 
-    u32 flags;
-    u32 picSizeInMbs, mbRow, mbCol;
-    u32 picWidthInMbs;
-    u8 *data;
+    u32 mbRow, mbCol;
     mbStorage_t *pMb;
-    bS_t bS[16];
-    edgeThreshold_t thresholds[3];
 
 /* Code */
 
@@ -594,50 +614,82 @@ void h264bsdFilterPicture(
     ASSERT(image->width);
     ASSERT(image->height);
 
-    picWidthInMbs = image->width;
-    data = image->data;
-    picSizeInMbs = picWidthInMbs * image->height;
-
     pMb = mb;
 
-    for (mbRow = 0, mbCol = 0; mbRow < image->height; pMb++)
-    {
-        flags = GetMbFilteringFlags(pMb);
+    for (mbRow = 0; mbRow < image->height; mbRow++)
+        for (mbCol = 0; mbCol < image->width; mbCol++)
+            FilterMb(image, pMb++, mbRow, mbCol);
 
-        if (flags)
-        {
-            /* GetBoundaryStrengths function returns non-zero value if any of
-             * the bS values for the macroblock being processed was non-zero */
-            if (GetBoundaryStrengths(pMb, bS, flags))
-            {
-                /* luma */
-                GetLumaEdgeThresholds(thresholds, pMb, flags);
-                data = image->data + mbRow * picWidthInMbs * 256 + mbCol * 16;
+}
 
-                FilterLuma((u8*)data, bS, thresholds, picWidthInMbs*16);
+/*------------------------------------------------------------------------------
 
-                /* chroma */
-                GetChromaEdgeThresholds(thresholds, pMb, flags,
-                    pMb->chromaQpIndexOffset);
-                data = image->data + picSizeInMbs * 256 +
-                    mbRow * picWidthInMbs * 64 + mbCol * 8;
+    Function: FilterMb
 
-                FilterChroma((u8*)data, data + 64*picSizeInMbs, bS,
-                        thresholds, picWidthInMbs*8);
+        Functional description:
+          Perform deblocking filtering for one macroblock, i.e. its left and
+          top edges and inner edges.
 
-            }
-        }
+        Inputs:
+          image         pointer to image to be filtered
+          pMb           pointer to macroblock data structure of the macroblock
+          mbRow         vertical position of the macroblock in the picture
+          mbCol         horizontal position of the macroblock in the picture
 
-        mbCol++;
-        if (mbCol == picWidthInMbs)
+        Outputs:
+          image         filtered macroblock stored here
+
+        Returns:
+          none
+
+------------------------------------------------------------------------------*/
+
+void FilterMb(image_t *image, mbStorage_t *pMb, u32 mbRow, u32 mbCol)
+{
+
+/* Variables */
+
+    u32 flags;
+    u32 picSizeInMbs;
+    u32 picWidthInMbs;
+    u8 *data;
+    bS_t bS[16];
+    edgeThreshold_t thresholds[3];
+
+/* Code */
+
+    flags = GetMbFilteringFlags(pMb);
+
+    if (flags)
+    {
+        /* GetBoundaryStrengths function returns non-zero value if any of
+         * the bS values for the macroblock being processed was non-zero */
+        if (GetBoundaryStrengths(pMb, bS, flags))
         {
-            mbCol = 0;
-            mbRow++;
+            picWidthInMbs = image->width;
+            picSizeInMbs = picWidthInMbs * image->height;
+
+            /* luma */
+            GetLumaEdgeThresholds(thresholds, pMb, flags);
+            data = image->data + mbRow * picWidthInMbs * 256 + mbCol * 16;
+
+            FilterLuma((u8*)data, bS, thresholds, picWidthInMbs*16);
+
+            /* chroma */
+            GetChromaEdgeThresholds(thresholds, pMb, flags,
+                pMb->chromaQpIndexOffset);
+            data = image->data + picSizeInMbs * 256 +
+                mbRow * picWidthInMbs * 64 + mbCol * 8;
+
+            FilterChroma((u8*)data, data + 64*picSizeInMbs, bS,
+                    thresholds, picWidthInMbs*8);
+
         }
     }
 
 }
 
+#ifndef H264DEC_SSE2
 /*------------------------------------------------------------------------------
 
     Function: FilterVerLumaEdge
@@ -1121,6 +1173,8 @@ void FilterHorChroma(
 }
 
 
+#endif /* H264DEC_SSE2 */
+
 /*------------------------------------------------------------------------------
 
     Function: GetBoundaryStrengths
@@ -1531,6 +1585,7 @@ void GetChromaEdgeThresholds(
 
 }
 
+#ifndef H264DEC_SSE2
 /*------------------------------------------------------------------------------
 
     Function: FilterLuma
@@ -1735,6 +1790,567 @@ void FilterChroma(
     }
 }
 
+#else /* H264DEC_SSE2 */
+
+/* Helpers for the SSE2 versions of FilterLuma and FilterChroma. Each 8-bit
+ * lane holds the samples across one point of an edge; vertical edges are
+ * transposed so that the same code filters both directions. The edges are
+ * filtered in the order of the standard, all vertical edges of the
+ * macroblock first, which gives the same result as the interleaved order of
+ * the C version. */
+
+/* lanes where a < b, unsigned */
+static __inline __m128i LessThan(__m128i a, __m128i b)
+{
+    return _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(b, a),
+            _mm_setzero_si128()), _mm_set1_epi8(-1));
+}
+
+static __inline __m128i AbsDiff(__m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+/* a where mask is set, b elsewhere */
+static __inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static __inline __m128i Clip3(__m128i tc, __m128i val)
+{
+    return _mm_min_epi16(_mm_max_epi16(val,
+                _mm_sub_epi16(_mm_setzero_si128(), tc)), tc);
+}
+
+/* tc0 of a bS, zero for bS 0 and 4 */
+static __inline u32 Tc0(const u8 *tc0, u32 bS)
+{
+    return (bS && bS < 4) ? tc0[bS-1] : 0;
+}
+
+/* Same bS in each group of four lanes */
+static __inline void LumaStrengths(u32 bS0, u32 bS1, u32 bS2, u32 bS3,
+    const u8 *tc0, __m128i *bS, __m128i *tc)
+{
+    *bS = _mm_set_epi32((i32)(bS3 * 0x01010101), (i32)(bS2 * 0x01010101),
+        (i32)(bS1 * 0x01010101), (i32)(bS0 * 0x01010101));
+    *tc = _mm_set_epi32((i32)(Tc0(tc0, bS3) * 0x01010101),
+        (i32)(Tc0(tc0, bS2) * 0x01010101), (i32)(Tc0(tc0, bS1) * 0x01010101),
+        (i32)(Tc0(tc0, bS0) * 0x01010101));
+}
+
+/* Same bS in each pair of lanes, Cb in the low and Cr in the high half */
+static __inline void ChromaStrengths(u32 bS0, u32 bS1, u32 bS2, u32 bS3,
+    const u8 *tc0, __m128i *bS, __m128i *tc)
+{
+    *bS = _mm_set_epi16((i16)(bS3 * 0x0101), (i16)(bS2 * 0x0101),
+        (i16)(bS1 * 0x0101), (i16)(bS0 * 0x0101), (i16)(bS3 * 0x0101),
+        (i16)(bS2 * 0x0101), (i16)(bS1 * 0x0101), (i16)(bS0 * 0x0101));
+    *tc = _mm_set_epi16((i16)(Tc0(tc0, bS3) * 0x0101),
+        (i16)(Tc0(tc0, bS2) * 0x0101), (i16)(Tc0(tc0, bS1) * 0x0101),
+        (i16)(Tc0(tc0, bS0) * 0x0101), (i16)(Tc0(tc0, bS3) * 0x0101),
+        (i16)(Tc0(tc0, bS2) * 0x0101), (i16)(Tc0(tc0, bS1) * 0x0101),
+        (i16)(Tc0(tc0, bS0) * 0x0101));
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterLumaLanes
+
+        Functional description:
+            Filter 16 points of luma edges, pel holds p3, p2, p1, p0, q0, q1,
+            q2 and q3. Returns HANTRO_FALSE if nothing was filtered.
+
+------------------------------------------------------------------------------*/
+static u32 FilterLumaLanes(
+  __m128i *pel,
+  __m128i bS,
+  __m128i tc0,
+  edgeThreshold_t *thresholds)
+{
+
+/* Variables */
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i p2, p1, p0, q0, q1, q2;
+    __m128i filter, normal, strong, ap, aq, tc, avg;
+    __m128i p2s, p1s, p0s, q0s, q1s, q2s;
+    __m128i p1n[2], p0n[2], q0n[2], q1n[2], p2v[2], p1v[2], p0v[2], q0v[2];
+    __m128i q1v[2], q2v[2], p3v[2], q3v[2], tcv[2], tc0v[2], avgv[2];
+    __m128i p0w[2], q0w[2], p[2], d;
+    u32 i;
+
+/* Code */
+
+    p2 = pel[1]; p1 = pel[2]; p0 = pel[3];
+    q0 = pel[4]; q1 = pel[5]; q2 = pel[6];
+
+    filter = _mm_andnot_si128(_mm_cmpeq_epi8(bS, zero),
+        LessThan(AbsDiff(p0, q0), _mm_set1_epi8((i8)thresholds->alpha)));
+    filter = _mm_and_si128(filter,
+        LessThan(AbsDiff(p1, p0), _mm_set1_epi8((i8)thresholds->beta)));
+    filter = _mm_and_si128(filter,
+        LessThan(AbsDiff(q1, q0), _mm_set1_epi8((i8)thresholds->beta)));
+    if (!_mm_movemask_epi8(filter))
+        return(HANTRO_FALSE);
+
+    ap = LessThan(AbsDiff(p2, p0), _mm_set1_epi8((i8)thresholds->beta));
+    aq = LessThan(AbsDiff(q2, q0), _mm_set1_epi8((i8)thresholds->beta));
+    strong = _mm_and_si128(filter, _mm_cmpeq_epi8(bS, _mm_set1_epi8(4)));
+    normal = _mm_andnot_si128(strong, filter);
+
+    /* tc is tc0 plus one for each of ap and aq, masks are -1 */
+    tc = _mm_sub_epi8(_mm_sub_epi8(tc0, ap), aq);
+    avg = _mm_avg_epu8(p0, q0);
+
+    for (i = 0; i < 2; i++)
+    {
+        if (i == 0)
+        {
+            p3v[0] = _mm_unpacklo_epi8(pel[0], zero);
+            p2v[0] = _mm_unpacklo_epi8(p2, zero);
+            p1v[0] = _mm_unpacklo_epi8(p1, zero);
+            p0v[0] = _mm_unpacklo_epi8(p0, zero);
+            q0v[0] = _mm_unpacklo_epi8(q0, zero);
+            q1v[0] = _mm_unpacklo_epi8(q1, zero);
+            q2v[0] = _mm_unpacklo_epi8(q2, zero);
+            q3v[0] = _mm_unpacklo_epi8(pel[7], zero);
+            tcv[0] = _mm_unpacklo_epi8(tc, zero);
+            tc0v[0] = _mm_unpacklo_epi8(tc0, zero);
+            avgv[0] = _mm_unpacklo_epi8(avg, zero);
+        }
+        else
+        {
+            p3v[1] = _mm_unpackhi_epi8(pel[0], zero);
+            p2v[1] = _mm_unpackhi_epi8(p2, zero);
+            p1v[1] = _mm_unpackhi_epi8(p1, zero);
+            p0v[1] = _mm_unpackhi_epi8(p0, zero);
+            q0v[1] = _mm_unpackhi_epi8(q0, zero);
+            q1v[1] = _mm_unpackhi_epi8(q1, zero);
+            q2v[1] = _mm_unpackhi_epi8(q2, zero);
+            q3v[1] = _mm_unpackhi_epi8(pel[7], zero);
+            tcv[1] = _mm_unpackhi_epi8(tc, zero);
+            tc0v[1] = _mm_unpackhi_epi8(tc0, zero);
+            avgv[1] = _mm_unpackhi_epi8(avg, zero);
+        }
+
+        /* delta = (((q0 - p0) << 2) + (p1 - q1) + 4) >> 3 */
+        d = _mm_add_epi16(_mm_slli_epi16(_mm_sub_epi16(q0v[i], p0v[i]), 2),
+                _mm_sub_epi16(p1v[i], q1v[i]));
+        d = Clip3(tcv[i], _mm_srai_epi16(
+                _mm_add_epi16(d, _mm_set1_epi16(4)), 3));
+        p0n[i] = _mm_add_epi16(p0v[i], d);
+        q0n[i] = _mm_sub_epi16(q0v[i], d);
+
+        /* p1 + CLIP3(-tc0, tc0, (p2 + ((p0 + q0 + 1) >> 1) - (p1 << 1)) >> 1) */
+        d = _mm_sub_epi16(_mm_add_epi16(p2v[i], avgv[i]),
+                _mm_slli_epi16(p1v[i], 1));
+        p1n[i] = _mm_add_epi16(p1v[i],
+                Clip3(tc0v[i], _mm_srai_epi16(d, 1)));
+        d = _mm_sub_epi16(_mm_add_epi16(q2v[i], avgv[i]),
+                _mm_slli_epi16(q1v[i], 1));
+        q1n[i] = _mm_add_epi16(q1v[i],
+                Clip3(tc0v[i], _mm_srai_epi16(d, 1)));
+    }
+
+    p1s = _mm_packus_epi16(p1n[0], p1n[1]);
+    p0s = _mm_packus_epi16(p0n[0], p0n[1]);
+    q0s = _mm_packus_epi16(q0n[0], q0n[1]);
+    q1s = _mm_packus_epi16(q1n[0], q1n[1]);
+
+    pel[2] = Select(_mm_and_si128(normal, ap), p1s, p1);
+    pel[3] = Select(normal, p0s, p0);
+    pel[4] = Select(normal, q0s, q0);
+    pel[5] = Select(_mm_and_si128(normal, aq), q1s, q1);
+
+    if (!_mm_movemask_epi8(strong))
+        return(HANTRO_TRUE);
+
+    /* bS 4, strong filtering of the samples on the side where both the small
+     * step over the edge and ap (or aq) hold, weak filtering of p0 (or q0)
+     * otherwise */
+    filter = _mm_and_si128(strong, LessThan(AbsDiff(p0, q0),
+        _mm_set1_epi8((i8)((thresholds->alpha >> 2) + 2))));
+    ap = _mm_and_si128(filter, ap);
+    aq = _mm_and_si128(filter, aq);
+
+    for (i = 0; i < 2; i++)
+    {
+        /* p1 + p0 + q0 and p0 + q0 + q1 */
+        p[0] = _mm_add_epi16(_mm_add_epi16(p1v[i], p0v[i]), q0v[i]);
+        p[1] = _mm_add_epi16(_mm_add_epi16(p0v[i], q0v[i]), q1v[i]);
+
+        p0n[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(p2v[i],
+                _mm_slli_epi16(p[0], 1)), _mm_add_epi16(q1v[i],
+                _mm_set1_epi16(4))), 3);
+        p1n[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(p2v[i], p[0]),
+                _mm_set1_epi16(2)), 2);
+        p2v[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(
+                _mm_slli_epi16(p3v[i], 1), _mm_add_epi16(p2v[i],
+                _mm_slli_epi16(p2v[i], 1))), _mm_add_epi16(p[0],
+                _mm_set1_epi16(4))), 3);
+        q0n[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(q2v[i],
+                _mm_slli_epi16(p[1], 1)), _mm_add_epi16(p1v[i],
+                _mm_set1_epi16(4))), 3);
+        q1n[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(q2v[i], p[1]),
+                _mm_set1_epi16(2)), 2);
+        q2v[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(
+                _mm_slli_epi16(q3v[i], 1), _mm_add_epi16(q2v[i],
+                _mm_slli_epi16(q2v[i], 1))), _mm_add_epi16(p[1],
+                _mm_set1_epi16(4))), 3);
+
+        /* (2 * p1 + p0 + q1 + 2) >> 2 and (2 * q1 + q0 + p1 + 2) >> 2 */
+        d = _mm_add_epi16(_mm_add_epi16(p1v[i], q1v[i]), _mm_set1_epi16(2));
+        p0w[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(d, p1v[i]),
+                p0v[i]), 2);
+        q0w[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(d, q1v[i]),
+                q0v[i]), 2);
+    }
+
+    p2s = _mm_packus_epi16(p2v[0], p2v[1]);
+    p1s = _mm_packus_epi16(p1n[0], p1n[1]);
+    p0s = Select(ap, _mm_packus_epi16(p0n[0], p0n[1]),
+        _mm_packus_epi16(p0w[0], p0w[1]));
+    q0s = Select(aq, _mm_packus_epi16(q0n[0], q0n[1]),
+        _mm_packus_epi16(q0w[0], q0w[1]));
+    q1s = _mm_packus_epi16(q1n[0], q1n[1]);
+    q2s = _mm_packus_epi16(q2v[0], q2v[1]);
+
+    pel[1] = Select(ap, p2s, p2);
+    pel[2] = Select(ap, p1s, pel[2]);
+    pel[3] = Select(strong, p0s, pel[3]);
+    pel[4] = Select(strong, q0s, pel[4]);
+    pel[5] = Select(aq, q1s, pel[5]);
+    pel[6] = Select(aq, q2s, q2);
+
+    return(HANTRO_TRUE);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterChromaLanes
+
+        Functional description:
+            Filter 16 points of chroma edges, pel holds p1, p0, q0 and q1.
+            Returns HANTRO_FALSE if nothing was filtered.
+
+------------------------------------------------------------------------------*/
+static u32 FilterChromaLanes(
+  __m128i *pel,
+  __m128i bS,
+  __m128i tc0,
+  edgeThreshold_t *thresholds)
+{
+
+/* Variables */
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i p1, p0, q0, q1;
+    __m128i filter, strong, tc;
+    __m128i p1v, p0v, q0v, q1v, tcv, d;
+    __m128i p0n[2], q0n[2], p0w[2], q0w[2];
+    u32 i;
+
+/* Code */
+
+    p1 = pel[0]; p0 = pel[1];
+    q0 = pel[2]; q1 = pel[3];
+
+    filter = _mm_andnot_si128(_mm_cmpeq_epi8(bS, zero),
+        LessThan(AbsDiff(p0, q0), _mm_set1_epi8((i8)thresholds->alpha)));
+    filter = _mm_and_si128(filter,
+        LessThan(AbsDiff(p1, p0), _mm_set1_epi8((i8)thresholds->beta)));
+    filter = _mm_and_si128(filter,
+        LessThan(AbsDiff(q1, q0), _mm_set1_epi8((i8)thresholds->beta)));
+    if (!_mm_movemask_epi8(filter))
+        return(HANTRO_FALSE);
+
+    strong = _mm_and_si128(filter, _mm_cmpeq_epi8(bS, _mm_set1_epi8(4)));
+    tc = _mm_add_epi8(tc0, _mm_set1_epi8(1));
+
+    for (i = 0; i < 2; i++)
+    {
+        if (i == 0)
+        {
+            p1v = _mm_unpacklo_epi8(p1, zero);
+            p0v = _mm_unpacklo_epi8(p0, zero);
+            q0v = _mm_unpacklo_epi8(q0, zero);
+            q1v = _mm_unpacklo_epi8(q1, zero);
+            tcv = _mm_unpacklo_epi8(tc, zero);
+        }
+        else
+        {
+            p1v = _mm_unpackhi_epi8(p1, zero);
+            p0v = _mm_unpackhi_epi8(p0, zero);
+            q0v = _mm_unpackhi_epi8(q0, zero);
+            q1v = _mm_unpackhi_epi8(q1, zero);
+            tcv = _mm_unpackhi_epi8(tc, zero);
+        }
+
+        d = _mm_add_epi16(_mm_slli_epi16(_mm_sub_epi16(q0v, p0v), 2),
+                _mm_sub_epi16(p1v, q1v));
+        d = Clip3(tcv, _mm_srai_epi16(_mm_add_epi16(d, _mm_set1_epi16(4)), 3));
+        p0n[i] = _mm_add_epi16(p0v, d);
+        q0n[i] = _mm_sub_epi16(q0v, d);
+
+        d = _mm_add_epi16(_mm_add_epi16(p1v, q1v), _mm_set1_epi16(2));
+        p0w[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(d, p1v), p0v), 2);
+        q0w[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(d, q1v), q0v), 2);
+    }
+
+    pel[1] = Select(filter, Select(strong,
+        _mm_packus_epi16(p0w[0], p0w[1]),
+        _mm_packus_epi16(p0n[0], p0n[1])), p0);
+    pel[2] = Select(filter, Select(strong,
+        _mm_packus_epi16(q0w[0], q0w[1]),
+        _mm_packus_epi16(q0n[0], q0n[1])), q0);
+
+    return(HANTRO_TRUE);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterLuma
+
+        Functional description:
+            Function to filter all luma edges of a macroblock, SSE2 version.
+            Vertical edges are filtered a whole 16-row edge at a time.
+
+------------------------------------------------------------------------------*/
+void FilterLuma(
+  u8 *data,
+  bS_t *bS,
+  edgeThreshold_t *thresholds,
+  u32 width)
+{
+
+/* Variables */
+
+    u32 edge, i;
+    bS_t *tmp;
+    u8 *ptr;
+    edgeThreshold_t *thr;
+    __m128i pel[8], r[16], a[8], b[8], c[8], bSv, tc0v;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(bS);
+    ASSERT(thresholds);
+
+    for (edge = 0; edge < 4; edge++)
+    {
+        tmp = bS + edge;
+        if (!(tmp[0].left | tmp[4].left | tmp[8].left | tmp[12].left))
+            continue;
+
+        thr = thresholds + (edge ? INNER : LEFT);
+        LumaStrengths(tmp[0].left, tmp[4].left, tmp[8].left, tmp[12].left,
+            thr->tc0, &bSv, &tc0v);
+
+        /* 16 rows of p3..q3 into eight vectors of 16 rows */
+        ptr = data + edge*4 - 4;
+        for (i = 0; i < 16; i++)
+            r[i] = _mm_loadl_epi64((const __m128i *)(ptr + i*width));
+        for (i = 0; i < 8; i++)
+            a[i] = _mm_unpacklo_epi8(r[2*i], r[2*i+1]);
+        for (i = 0; i < 4; i++)
+        {
+            b[2*i] = _mm_unpacklo_epi16(a[2*i], a[2*i+1]);
+            b[2*i+1] = _mm_unpackhi_epi16(a[2*i], a[2*i+1]);
+        }
+        for (i = 0; i < 2; i++)
+        {
+            c[4*i] = _mm_unpacklo_epi32(b[4*i], b[4*i+2]);
+            c[4*i+1] = _mm_unpackhi_epi32(b[4*i], b[4*i+2]);
+            c[4*i+2] = _mm_unpacklo_epi32(b[4*i+1], b[4*i+3]);
+            c[4*i+3] = _mm_unpackhi_epi32(b[4*i+1], b[4*i+3]);
+        }
+        for (i = 0; i < 4; i++)
+        {
+            pel[2*i] = _mm_unpacklo_epi64(c[i], c[i+4]);
+            pel[2*i+1] = _mm_unpackhi_epi64(c[i], c[i+4]);
+        }
+
+        if (!FilterLumaLanes(pel, bSv, tc0v, thr))
+            continue;
+
+        /* and back */
+        for (i = 0; i < 4; i++)
+        {
+            a[i] = _mm_unpacklo_epi8(pel[2*i], pel[2*i+1]);
+            a[i+4] = _mm_unpackhi_epi8(pel[2*i], pel[2*i+1]);
+        }
+        for (i = 0; i < 2; i++)
+        {
+            b[4*i] = _mm_unpacklo_epi16(a[4*i], a[4*i+1]);
+            b[4*i+1] = _mm_unpackhi_epi16(a[4*i], a[4*i+1]);
+            b[4*i+2] = _mm_unpacklo_epi16(a[4*i+2], a[4*i+3]);
+            b[4*i+3] = _mm_unpackhi_epi16(a[4*i+2], a[4*i+3]);
+        }
+        for (i = 0; i < 2; i++)
+        {
+            c[4*i] = _mm_unpacklo_epi32(b[4*i], b[4*i+2]);
+            c[4*i+1] = _mm_unpackhi_epi32(b[4*i], b[4*i+2]);
+            c[4*i+2] = _mm_unpacklo_epi32(b[4*i+1], b[4*i+3]);
+            c[4*i+3] = _mm_unpackhi_epi32(b[4*i+1], b[4*i+3]);
+        }
+        for (i = 0; i < 8; i++)
+        {
+            _mm_storel_epi64((__m128i *)(ptr + 2*i*width), c[i]);
+            _mm_storel_epi64((__m128i *)(ptr + (2*i+1)*width),
+                _mm_unpackhi_epi64(c[i], c[i]));
+        }
+    }
+
+    for (edge = 0; edge < 4; edge++)
+    {
+        tmp = bS + edge*4;
+        if (!(tmp[0].top | tmp[1].top | tmp[2].top | tmp[3].top))
+            continue;
+
+        thr = thresholds + (edge ? INNER : TOP);
+        LumaStrengths(tmp[0].top, tmp[1].top, tmp[2].top, tmp[3].top,
+            thr->tc0, &bSv, &tc0v);
+
+        ptr = data + edge*4*width;
+        for (i = 0; i < 8; i++)
+            pel[i] = _mm_loadu_si128(
+                (const __m128i *)(ptr + ((i32)i - 4)*(i32)width));
+
+        if (!FilterLumaLanes(pel, bSv, tc0v, thr))
+            continue;
+
+        /* p3 and q3 are never modified */
+        for (i = 1; i < 7; i++)
+            _mm_storeu_si128((__m128i *)(ptr + ((i32)i - 4)*(i32)width),
+                pel[i]);
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterChroma
+
+        Functional description:
+            Function to filter all chroma edges of a macroblock, SSE2
+            version. Cb and Cr are filtered together, Cb in the low and Cr in
+            the high half of the vectors.
+
+------------------------------------------------------------------------------*/
+void FilterChroma(
+  u8 *dataCb,
+  u8 *dataCr,
+  bS_t *bS,
+  edgeThreshold_t *thresholds,
+  u32 width)
+{
+
+/* Variables */
+
+    u32 edge, i, tmp32;
+    bS_t *tmp;
+    u8 *ptrCb, *ptrCr;
+    edgeThreshold_t *thr;
+    __m128i pel[4], r[16], a[8], b[4], c[4], bSv, tc0v;
+
+/* Code */
+
+    ASSERT(dataCb);
+    ASSERT(dataCr);
+    ASSERT(bS);
+    ASSERT(thresholds);
+
+    /* vertical edges use the bS of luma edges 0 and 2, each bS for two
+     * rows */
+    for (edge = 0; edge < 2; edge++)
+    {
+        tmp = bS + edge*2;
+        if (!(tmp[0].left | tmp[4].left | tmp[8].left | tmp[12].left))
+            continue;
+
+        thr = thresholds + (edge ? INNER : LEFT);
+        ChromaStrengths(tmp[0].left, tmp[4].left, tmp[8].left, tmp[12].left,
+            thr->tc0, &bSv, &tc0v);
+
+        ptrCb = dataCb + edge*4 - 2;
+        ptrCr = dataCr + edge*4 - 2;
+        for (i = 0; i < 8; i++)
+        {
+            memcpy(&tmp32, ptrCb + i*width, 4);
+            r[i] = _mm_cvtsi32_si128((i32)tmp32);
+            memcpy(&tmp32, ptrCr + i*width, 4);
+            r[i+8] = _mm_cvtsi32_si128((i32)tmp32);
+        }
+        for (i = 0; i < 8; i++)
+            a[i] = _mm_unpacklo_epi8(r[2*i], r[2*i+1]);
+        for (i = 0; i < 4; i++)
+            b[i] = _mm_unpacklo_epi16(a[2*i], a[2*i+1]);
+        c[0] = _mm_unpacklo_epi32(b[0], b[1]);
+        c[1] = _mm_unpackhi_epi32(b[0], b[1]);
+        c[2] = _mm_unpacklo_epi32(b[2], b[3]);
+        c[3] = _mm_unpackhi_epi32(b[2], b[3]);
+        pel[0] = _mm_unpacklo_epi64(c[0], c[2]);
+        pel[1] = _mm_unpackhi_epi64(c[0], c[2]);
+        pel[2] = _mm_unpacklo_epi64(c[1], c[3]);
+        pel[3] = _mm_unpackhi_epi64(c[1], c[3]);
+
+        if (!FilterChromaLanes(pel, bSv, tc0v, thr))
+            continue;
+
+        a[0] = _mm_unpacklo_epi8(pel[0], pel[1]);
+        a[1] = _mm_unpackhi_epi8(pel[0], pel[1]);
+        a[2] = _mm_unpacklo_epi8(pel[2], pel[3]);
+        a[3] = _mm_unpackhi_epi8(pel[2], pel[3]);
+        b[0] = _mm_unpacklo_epi16(a[0], a[2]);
+        b[1] = _mm_unpackhi_epi16(a[0], a[2]);
+        b[2] = _mm_unpacklo_epi16(a[1], a[3]);
+        b[3] = _mm_unpackhi_epi16(a[1], a[3]);
+        for (i = 0; i < 16; i++)
+        {
+            tmp32 = (u32)_mm_cvtsi128_si32(b[i >> 2]);
+            b[i >> 2] = _mm_srli_si128(b[i >> 2], 4);
+            memcpy((i < 8 ? ptrCb + i*width : ptrCr + (i-8)*width),
+                &tmp32, 4);
+        }
+    }
+
+    for (edge = 0; edge < 2; edge++)
+    {
+        tmp = bS + edge*8;
+        if (!(tmp[0].top | tmp[1].top | tmp[2].top | tmp[3].top))
+            continue;
+
+        thr = thresholds + (edge ? INNER : TOP);
+        ChromaStrengths(tmp[0].top, tmp[1].top, tmp[2].top, tmp[3].top,
+            thr->tc0, &bSv, &tc0v);
+
+        ptrCb = dataCb + edge*4*width;
+        ptrCr = dataCr + edge*4*width;
+        for (i = 0; i < 4; i++)
+            pel[i] = _mm_unpacklo_epi64(
+                _mm_loadl_epi64((const __m128i *)
+                    (ptrCb + ((i32)i - 2)*(i32)width)),
+                _mm_loadl_epi64((const __m128i *)
+                    (ptrCr + ((i32)i - 2)*(i32)width)));
+
+        if (!FilterChromaLanes(pel, bSv, tc0v, thr))
+            continue;
+
+        _mm_storel_epi64((__m128i *)(ptrCb - width), pel[1]);
+        _mm_storel_epi64((__m128i *)(ptrCr - width),
+            _mm_unpackhi_epi64(pel[1], pel[1]));
+        _mm_storel_epi64((__m128i *)ptrCb, pel[2]);
+        _mm_storel_epi64((__m128i *)ptrCr, _mm_unpackhi_epi64(pel[2], pel[2]));
+    }
+
+}
+#endif /* H264DEC_SSE2 */
+
 #else /* H264DEC_OMXDL */
 
 /*------------------------------------------------------------------------------
@@ -1762,19 +2378,64 @@ void FilterChroma(
 
 ------------------------------------------------------------------------------*/
 
-/*lint --e{550} Symbol not accessed */
 void h264bsdFilterPicture(
   image_t *image,
   mbStorage_t *mb)
 {
 
+/* Variables */
+
+    u32 mbRow, mbCol;
+    mbStorage_t *pMb;
+
+/* Code */
+
+    ASSERT(image);
+    ASSERT(mb);
+    ASSERT(image->data);
+    ASSERT(image->width);
+    ASSERT(image->height);
+
+    pMb = mb;
+
+    for (mbRow = 0; mbRow < image->height; mbRow++)
+        for (mbCol = 0; mbCol < image->width; mbCol++)
+            FilterMb(image, pMb++, mbRow, mbCol);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterMb
+
+        Functional description:
+          Perform deblocking filtering for one macroblock, i.e. its left and
+          top edges and inner edges.
+
+        Inputs:
+          image         pointer to image to be filtered
+          pMb           pointer to macroblock data structure of the macroblock
+          mbRow         vertical position of the macroblock in the picture
+          mbCol         horizontal position of the macroblock in the picture
+
+        Outputs:
+          image         filtered macroblock stored here
+
+        Returns:
+          none
+
+------------------------------------------------------------------------------*/
+
+/*lint --e{550} Symbol not accessed */
+void FilterMb(image_t *image, mbStorage_t *pMb, u32 mbRow, u32 mbCol)
+{
+
 /* Variables */
 
     u32 flags;
-    u32 picSizeInMbs, mbRow, mbCol;
+    u32 picSizeInMbs;
     u32 picWidthInMbs;
     u8 *data;
-    mbStorage_t *pMb;
     u8 bS[2][16];
     u8 thresholdLuma[2][16];
     u8 thresholdChroma[2][8];
@@ -1784,86 +2445,67 @@ void h264bsdFilterPicture(
 
 /* Code */
 
-    ASSERT(image);
-    ASSERT(mb);
-    ASSERT(image->data);
-    ASSERT(image->width);
-    ASSERT(image->height);
-
     picWidthInMbs = image->width;
-    data = image->data;
     picSizeInMbs = picWidthInMbs * image->height;
 
-    pMb = mb;
+    flags = GetMbFilteringFlags(pMb);
 
-    for (mbRow = 0, mbCol = 0; mbRow < image->height; pMb++)
+    if (flags)
     {
-        flags = GetMbFilteringFlags(pMb);
-
-        if (flags)
+        /* GetBoundaryStrengths function returns non-zero value if any of
+         * the bS values for the macroblock being processed was non-zero */
+        if (GetBoundaryStrengths(pMb, bS, flags))
         {
-            /* GetBoundaryStrengths function returns non-zero value if any of
-             * the bS values for the macroblock being processed was non-zero */
-            if (GetBoundaryStrengths(pMb, bS, flags))
-            {
-
-                /* Luma */
-                GetLumaEdgeThresholds(pMb,alpha,beta,thresholdLuma,bS,flags);
-                data = image->data + mbRow * picWidthInMbs * 256 + mbCol * 16;
-
-                res = omxVCM4P10_FilterDeblockingLuma_VerEdge_I( data,
-                                                (OMX_S32)(picWidthInMbs*16),
-                                                (const OMX_U8*)alpha,
-                                                (const OMX_U8*)beta,
-                                                (const OMX_U8*)thresholdLuma,
-                                                (const OMX_U8*)bS );
-
-                res = omxVCM4P10_FilterDeblockingLuma_HorEdge_I( data,
-                                                (OMX_S32)(picWidthInMbs*16),
-                                                (const OMX_U8*)alpha+2,
-                                                (const OMX_U8*)beta+2,
-                                                (const OMX_U8*)thresholdLuma+16,
-                                                (const OMX_U8*)bS+16 );
-                /* Cb */
-                GetChromaEdgeThresholds(pMb, alpha, beta, thresholdChroma,
-                                        bS, flags, pMb->chromaQpIndexOffset);
-                data = image->data + picSizeInMbs * 256 +
-                    mbRow * picWidthInMbs * 64 + mbCol * 8;
-
-                res = omxVCM4P10_FilterDeblockingChroma_VerEdge_I( data,
-                                              (OMX_S32)(picWidthInMbs*8),
-                                              (const OMX_U8*)alpha,
-                                              (const OMX_U8*)beta,
-                                              (const OMX_U8*)thresholdChroma,
-                                              (const OMX_U8*)bS );
-                res = omxVCM4P10_FilterDeblockingChroma_HorEdge_I( data,
-                                              (OMX_S32)(picWidthInMbs*8),
-                                              (const OMX_U8*)alpha+2,
-                                              (const OMX_U8*)beta+2,
-                                              (const OMX_U8*)thresholdChroma+8,
-                                              (const OMX_U8*)bS+16 );
-                /* Cr */
-                data += (picSizeInMbs * 64);
-                res = omxVCM4P10_FilterDeblockingChroma_VerEdge_I( data,
-                                              (OMX_S32)(picWidthInMbs*8),
-                                              (const OMX_U8*)alpha,
-                                              (const OMX_U8*)beta,
-                                              (const OMX_U8*)thresholdChroma,
-                                              (const OMX_U8*)bS );
-                res = omxVCM4P10_FilterDeblockingChroma_HorEdge_I( data,
-                                              (OMX_S32)(picWidthInMbs*8),
-                                              (const OMX_U8*)alpha+2,
-                                              (const OMX_U8*)beta+2,
-                                              (const OMX_U8*)thresholdChroma+8,
-                                              (const OMX_U8*)bS+16 );
-            }
-        }
 
-        mbCol++;
-        if (mbCol == picWidthInMbs)
-        {
-            mbCol = 0;
-            mbRow++;
+            /* Luma */
+            GetLumaEdgeThresholds(pMb,alpha,beta,thresholdLuma,bS,flags);
+            data = image->data + mbRow * picWidthInMbs * 256 + mbCol * 16;
+
+            res = omxVCM4P10_FilterDeblockingLuma_VerEdge_I( data,
+                                            (OMX_S32)(picWidthInMbs*16),
+                                            (const OMX_U8*)alpha,
+                                            (const OMX_U8*)beta,
+                                            (const OMX_U8*)thresholdLuma,
+                                            (const OMX_U8*)bS );
+
+            res = omxVCM4P10_FilterDeblockingLuma_HorEdge_I( data,
+                                            (OMX_S32)(picWidthInMbs*16),
+                                            (const OMX_U8*)alpha+2,
+                                            (const OMX_U8*)beta+2,
+                                            (const OMX_U8*)thresholdLuma+16,
+                                            (const OMX_U8*)bS+16 );
+            /* Cb */
+            GetChromaEdgeThresholds(pMb, alpha, beta, thresholdChroma,
+                                    bS, flags, pMb->chromaQpIndexOffset);
+            data = image->data + picSizeInMbs * 256 +
+                mbRow * picWidthInMbs * 64 + mbCol * 8;
+
+            res = omxVCM4P10_FilterDeblockingChroma_VerEdge_I( data,
+                                          (OMX_S32)(picWidthInMbs*8),
+                                          (const OMX_U8*)alpha,
+                                          (const OMX_U8*)beta,
+                                          (const OMX_U8*)thresholdChroma,
+                                          (const OMX_U8*)bS );
+            res = omxVCM4P10_FilterDeblockingChroma_HorEdge_I( data,
+                                          (OMX_S32)(picWidthInMbs*8),
+                                          (const OMX_U8*)alpha+2,
+                                          (const OMX_U8*)beta+2,
+                                          (const OMX_U8*)thresholdChroma+8,
+                                          (const OMX_U8*)bS+16 );
+            /* Cr */
+            data += (picSizeInMbs * 64);
+            res = omxVCM4P10_FilterDeblockingChroma_VerEdge_I( data,
+                                          (OMX_S32)(picWidthInMbs*8),
+                                          (const OMX_U8*)alpha,
+                                          (const OMX_U8*)beta,
+                                          (const OMX_U8*)thresholdChroma,
+                                          (const OMX_U8*)bS );
+            res = omxVCM4P10_FilterDeblockingChroma_HorEdge_I( data,
+                                          (OMX_S32)(picWidthInMbs*8),
+                                          (const OMX_U8*)alpha+2,
+                                          (const OMX_U8*)beta+2,
+                                          (const OMX_U8*)thresholdChroma+8,
+                                          (const OMX_U8*)bS+16 );
         }
     }
 
@@ -2413,5 +3055,122 @@ void GetChromaEdgeThresholds(
 
 #endif /* H264DEC_OMXDL */
 
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFilterPictureParallel
+
+        Functional description:
+          Perform deblocking filtering for a picture with the threads of the
+          pool, result is identical to h264bsdFilterPicture. Macroblock rows
+          are handed out to the threads in order. Filtering a macroblock
+          modifies the three bottom pixel rows of the macroblock above it and
+          reads pixels that the macroblock above right modifies, so a
+          macroblock is filtered after the macroblock above right of it.
+
+        Inputs:
+          image         pointer to image to be filtered
+          mb            pointer to macroblock data structure of the top-left
+                        macroblock of the picture
+          pPool         worker threads
+
+        Outputs:
+          image         filtered image stored here
+
+        Returns:
+          none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFilterPictureParallel(
+  image_t *image,
+  mbStorage_t *mb,
+  threadPool_t *pPool)
+{
+
+/* Variables */
+
+    u32 i, numJobs;
+    filterRows_t picture;
+    threadJob_t jobs[MAX_NUM_THREADS];
+
+/* Code */
+
+    ASSERT(image);
+    ASSERT(mb);
+    ASSERT(pPool);
+
+    picture.image = image;
+    picture.mb = mb;
+    picture.pPool = pPool;
+    picture.nextRow = 0;
+    picture.rowProgress = h264bsdCreateProgress(image->height);
+    if (picture.rowProgress == NULL)
+    {
+        h264bsdFilterPicture(image, mb);
+        return;
+    }
+
+    numJobs = MIN(h264bsdNumWorkers(pPool), image->height - 1);
+    for (i = 0; i < numJobs; i++)
+    {
+        jobs[i].run = FilterRows;
+        jobs[i].arg = &picture;
+        h264bsdSubmitJob(pPool, jobs + i);
+    }
+
+    FilterRows(&picture);
+    h264bsdWaitJobs(pPool);
+
+    h264bsdDestroyProgress(picture.rowProgress);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterRows
+
+        Functional description:
+          Filter macroblock rows of the picture until all of them have been
+          claimed by the threads.
+
+------------------------------------------------------------------------------*/
+
+void FilterRows(void *arg)
+{
+
+/* Variables */
+
+    filterRows_t *picture = (filterRows_t *)arg;
+    image_t *image = picture->image;
+    threadPool_t *pPool = picture->pPool;
+    u32 mbRow, mbCol, above;
+    mbStorage_t *pMb;
+
+/* Code */
+
+    for (;;)
+    {
+        mbRow = h264bsdClaimIndex(pPool, &picture->nextRow);
+        if (mbRow >= image->height)
+            break;
+
+        pMb = picture->mb + mbRow * image->width;
+        /* first row does not wait */
+        above = mbRow ? 0 : image->width;
+
+        for (mbCol = 0; mbCol < image->width; mbCol++)
+        {
+            if (above < MIN(mbCol + 2, image->width))
+                above = h264bsdWaitProgress(picture->rowProgress, mbRow - 1,
+                    MIN(mbCol + 2, image->width));
+
+            FilterMb(image, pMb++, mbRow, mbCol);
+
+            h264bsdSetProgress(picture->rowProgress, mbRow, mbCol + 1);
+        }
+    }
+
+}
+
 /*lint +e701 +e702 */
 
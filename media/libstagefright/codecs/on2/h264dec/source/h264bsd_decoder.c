@@ -24,8 +24,15 @@
      4. Local function prototypes
      5. Functions
           h264bsdInit
+          h264bsdSetNumThreads
           h264bsdDecode
+          DecodeNalUnit
+          FinishSlices
+          FinishPicture
+          NextNalUnitIsSlice
+          FollowsPendingSlices
           h264bsdShutdown
+          FreeThreads
           h264bsdCurrentImage
           h264bsdNextOutputPicture
           h264bsdPicWidth
@@ -67,6 +74,14 @@
     4. Local function prototypes
 ------------------------------------------------------------------------------*/
 
+static u32 DecodeNalUnit(storage_t *pStorage, u8 *byteStrm, u32 len,
+    u32 picId, u32 *readBytes, u32 *sliceQueued);
+static u32 FinishSlices(storage_t *pStorage);
+static u32 FinishPicture(storage_t *pStorage);
+static u32 NextNalUnitIsSlice(u8 *byteStrm, u32 len);
+static u32 FollowsPendingSlices(storage_t *pStorage, u32 firstMbInSlice);
+static void FreeThreads(storage_t *pStorage);
+
 /*------------------------------------------------------------------------------
 
     Function name: h264bsdInit
@@ -111,6 +126,78 @@ u32 h264bsdInit(storage_t *pStorage, u32 noOutputReordering)
     return HANTRO_OK;
 }
 
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdSetNumThreads
+
+        Functional description:
+            Set the number of threads decoding the stream. With more than one
+            thread, slices of a picture are decoded in parallel by worker
+            threads and deblocking filtering of a picture is shared between
+            the threads. Output is the same for any number of threads.
+
+        Inputs:
+            numThreads      number of threads including the calling thread,
+                            0 or 1 for decoding in the calling thread only
+
+        Outputs:
+            pStorage        worker threads started
+
+        Returns:
+            HANTRO_OK       success
+            HANTRO_NOK      memory allocation or thread creation failed,
+                            decoding continues in the calling thread only
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdSetNumThreads(storage_t *pStorage, u32 numThreads)
+{
+
+/* Variables */
+
+    u32 i, size;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    FreeThreads(pStorage);
+
+    if (numThreads <= 1)
+        return HANTRO_OK;
+
+    numThreads = MIN(numThreads, MAX_NUM_THREADS);
+
+    pStorage->threadPool = h264bsdCreateThreadPool(numThreads - 1);
+    if (!pStorage->threadPool)
+        return HANTRO_NOK;
+
+    ALLOCATE(pStorage->sliceJobs, numThreads - 1, sliceJob_t);
+    if (!pStorage->sliceJobs)
+    {
+        FreeThreads(pStorage);
+        return HANTRO_NOK;
+    }
+    H264SwDecMemset(pStorage->sliceJobs, 0,
+        (numThreads - 1) * sizeof(sliceJob_t));
+
+    /* same layout as pStorage->mbLayer */
+    size = (sizeof(macroblockLayer_t) + 63) & ~0x3F;
+
+    for (i = 0; i < numThreads - 1; i++)
+    {
+        pStorage->sliceJobs[i].mbLayer =
+            (macroblockLayer_t*)H264SwDecMalloc(size);
+        if (!pStorage->sliceJobs[i].mbLayer)
+        {
+            FreeThreads(pStorage);
+            return HANTRO_NOK;
+        }
+    }
+
+    return HANTRO_OK;
+}
+
 /*------------------------------------------------------------------------------
 
     Function: h264bsdDecode
@@ -152,10 +239,58 @@ u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u32 picId,
     u32 *readBytes)
 {
 
+/* Variables */
+
+    u32 tmp;
+    u32 sliceQueued = HANTRO_FALSE;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    tmp = DecodeNalUnit(pStorage, byteStrm, len, picId, readBytes,
+        &sliceQueued);
+
+    /* slices are only left decoding in the worker threads when the next NAL
+     * unit in the buffer is a slice. If that one could not be decoded, the
+     * pending slices are finished here, the stream buffer may go away after
+     * returning */
+    if (pStorage->numPendingSlices && !sliceQueued)
+    {
+        if (FinishSlices(pStorage))
+        {
+            pStorage->skipRedundantSlices = HANTRO_TRUE;
+            tmp = FinishPicture(pStorage);
+        }
+    }
+
+    return(tmp);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: DecodeNalUnit
+
+        Functional description:
+            Decode one NAL unit, see h264bsdDecode. Slices are queued for the
+            worker threads if possible.
+
+        Outputs:
+            readBytes       number of bytes read from the stream is stored
+                            here
+            sliceQueued     HANTRO_TRUE if the NAL unit was a slice that is
+                            decoded in a worker thread
+
+------------------------------------------------------------------------------*/
+
+u32 DecodeNalUnit(storage_t *pStorage, u8 *byteStrm, u32 len, u32 picId,
+    u32 *readBytes, u32 *sliceQueued)
+{
+
 /* Variables */
 
     u32 tmp, ppsId, spsId;
-    i32 picOrderCnt;
     nalUnit_t nalUnit;
     seqParamSet_t seqParamSet;
     picParamSet_t picParamSet;
@@ -222,7 +357,26 @@ u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u32 picId,
             return(H264BSD_ERROR);
     }
 
-    if ( accessUnitBoundaryFlag )
+    /* slices decoded in parallel are finished before any other NAL unit than
+     * the next slice of the same picture. If that completes the picture it
+     * is returned first and the current NAL unit is decoded on next
+     * activation */
+    if (pStorage->numPendingSlices &&
+        (accessUnitBoundaryFlag ||
+         (nalUnit.nalUnitType != NAL_CODED_SLICE &&
+          nalUnit.nalUnitType != NAL_CODED_SLICE_IDR)))
+    {
+        if (FinishSlices(pStorage))
+        {
+            picReady = HANTRO_TRUE;
+            pStorage->skipRedundantSlices =
+                accessUnitBoundaryFlag ? HANTRO_FALSE : HANTRO_TRUE;
+            *readBytes = 0;
+            pStorage->prevBufNotFinished = HANTRO_TRUE;
+        }
+    }
+
+    if ( accessUnitBoundaryFlag && !picReady )
     {
         DEBUG(("Access unit boundary\n"));
         /* conceal if picture started and param sets activated */
@@ -402,6 +556,27 @@ u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u32 picId,
                     EPRINT("SLICE_HEADER");
                     return(H264BSD_ERROR);
                 }
+                /* redundant slices may overlap and slice group maps of types
+                 * 3 to 5 change from slice to slice, these slices are not
+                 * decoded in parallel with others. Neither are slices out of
+                 * decoding order, they may belong to the next picture */
+                if (pStorage->numPendingSlices &&
+                    (pStorage->sliceHeader[1].redundantPicCnt ||
+                     (pStorage->activePps->numSliceGroups > 1 &&
+                      pStorage->activePps->sliceGroupMapType >= 3 &&
+                      pStorage->activePps->sliceGroupMapType <= 5) ||
+                     !FollowsPendingSlices(pStorage,
+                        pStorage->sliceHeader[1].firstMbInSlice)))
+                {
+                    if (FinishSlices(pStorage))
+                    {
+                        picReady = HANTRO_TRUE;
+                        pStorage->skipRedundantSlices = HANTRO_TRUE;
+                        *readBytes = 0;
+                        pStorage->prevBufNotFinished = HANTRO_TRUE;
+                        break;
+                    }
+                }
                 if (h264bsdIsStartOfPicture(pStorage))
                 {
                     if (!IS_IDR_NAL_UNIT(&nalUnit))
@@ -427,8 +602,11 @@ u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u32 picId,
                 pStorage->validSliceInAccessUnit = HANTRO_TRUE;
                 pStorage->prevNalUnit[0] = nalUnit;
 
-                h264bsdComputeSliceGroupMap(pStorage,
-                    pStorage->sliceHeader->sliceGroupChangeCycle);
+                /* slice group map stays the same while slices of the
+                 * picture are decoded in parallel */
+                if (!pStorage->numPendingSlices)
+                    h264bsdComputeSliceGroupMap(pStorage,
+                        pStorage->sliceHeader->sliceGroupChangeCycle);
 
                 h264bsdInitRefPicList(pStorage->dpb);
                 tmp = h264bsdReorderRefPicList(pStorage->dpb,
@@ -443,6 +621,22 @@ u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u32 picId,
 
                 DEBUG(("SLICE DATA, FIRST %d\n",
                         pStorage->sliceHeader->firstMbInSlice));
+
+                /* a worker decodes the slice if the next NAL unit is a slice
+                 * too, the last slice in the buffer is decoded here */
+                if (pStorage->threadPool &&
+                    !pStorage->sliceHeader->redundantPicCnt &&
+                    pStorage->numPendingSlices <
+                    h264bsdNumWorkers(pStorage->threadPool) &&
+                    NextNalUnitIsSlice(byteStrm + *readBytes,
+                        len - *readBytes))
+                {
+                    h264bsdQueueSliceData(&strm, pStorage,
+                        pStorage->currImage, pStorage->sliceHeader);
+                    *sliceQueued = HANTRO_TRUE;
+                    break;
+                }
+
                 tmp = h264bsdDecodeSliceData(&strm, pStorage,
                     pStorage->currImage, pStorage->sliceHeader);
                 if (tmp != HANTRO_OK)
@@ -453,6 +647,8 @@ u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u32 picId,
                     return(H264BSD_ERROR);
                 }
 
+                h264bsdFinishSliceData(pStorage);
+
                 if (h264bsdIsEndOfPicture(pStorage))
                 {
                     picReady = HANTRO_TRUE;
@@ -470,46 +666,182 @@ u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u32 picId,
     }
 
     if (picReady)
-    {
+        return(FinishPicture(pStorage));
+    else
+        return(H264BSD_RDY);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FinishSlices
+
+        Functional description:
+            Wait for the slices decoded in the worker threads.
+
+        Returns:
+            HANTRO_TRUE     the picture is complete
+            HANTRO_FALSE    otherwise
+
+------------------------------------------------------------------------------*/
+
+u32 FinishSlices(storage_t *pStorage)
+{
+
+/* Code */
+
+    h264bsdFinishSliceData(pStorage);
+
+    return(h264bsdIsEndOfPicture(pStorage));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FinishPicture
+
+        Functional description:
+            Perform deblocking filtering and reference picture marking for
+            a decoded picture.
+
+        Returns:
+            H264BSD_PIC_RDY
+
+------------------------------------------------------------------------------*/
+
+u32 FinishPicture(storage_t *pStorage)
+{
+
+/* Variables */
+
+    u32 tmp;
+    i32 picOrderCnt;
+
+/* Code */
+
+    if (pStorage->threadPool)
+        h264bsdFilterPictureParallel(pStorage->currImage, pStorage->mb,
+            pStorage->threadPool);
+    else
         h264bsdFilterPicture(pStorage->currImage, pStorage->mb);
 
-        h264bsdResetStorage(pStorage);
+    h264bsdResetStorage(pStorage);
 
-        picOrderCnt = h264bsdDecodePicOrderCnt(pStorage->poc,
-            pStorage->activeSps, pStorage->sliceHeader, pStorage->prevNalUnit);
+    picOrderCnt = h264bsdDecodePicOrderCnt(pStorage->poc,
+        pStorage->activeSps, pStorage->sliceHeader, pStorage->prevNalUnit);
 
-        if (pStorage->validSliceInAccessUnit)
+    if (pStorage->validSliceInAccessUnit)
+    {
+        if (pStorage->prevNalUnit->nalRefIdc)
         {
-            if (pStorage->prevNalUnit->nalRefIdc)
-            {
-                tmp = h264bsdMarkDecRefPic(pStorage->dpb,
-                    &pStorage->sliceHeader->decRefPicMarking,
-                    pStorage->currImage, pStorage->sliceHeader->frameNum,
-                    picOrderCnt,
-                    IS_IDR_NAL_UNIT(pStorage->prevNalUnit) ?
-                    HANTRO_TRUE : HANTRO_FALSE,
-                    pStorage->currentPicId, pStorage->numConcealedMbs);
-            }
-            /* non-reference picture, just store for possible display
-             * reordering */
-            else
-            {
-                tmp = h264bsdMarkDecRefPic(pStorage->dpb, NULL,
-                    pStorage->currImage, pStorage->sliceHeader->frameNum,
-                    picOrderCnt,
-                    IS_IDR_NAL_UNIT(pStorage->prevNalUnit) ?
-                    HANTRO_TRUE : HANTRO_FALSE,
-                    pStorage->currentPicId, pStorage->numConcealedMbs);
-            }
+            tmp = h264bsdMarkDecRefPic(pStorage->dpb,
+                &pStorage->sliceHeader->decRefPicMarking,
+                pStorage->currImage, pStorage->sliceHeader->frameNum,
+                picOrderCnt,
+                IS_IDR_NAL_UNIT(pStorage->prevNalUnit) ?
+                HANTRO_TRUE : HANTRO_FALSE,
+                pStorage->currentPicId, pStorage->numConcealedMbs);
+        }
+        /* non-reference picture, just store for possible display
+         * reordering */
+        else
+        {
+            tmp = h264bsdMarkDecRefPic(pStorage->dpb, NULL,
+                pStorage->currImage, pStorage->sliceHeader->frameNum,
+                picOrderCnt,
+                IS_IDR_NAL_UNIT(pStorage->prevNalUnit) ?
+                HANTRO_TRUE : HANTRO_FALSE,
+                pStorage->currentPicId, pStorage->numConcealedMbs);
+        }
+        /* the picture is output anyway, like in the single threaded
+         * decoder */
+        if (tmp != HANTRO_OK)
+        {
+            DEBUG(("REFERENCE PICTURE MARKING FAILED\n"));
         }
+    }
 
-        pStorage->picStarted = HANTRO_FALSE;
-        pStorage->validSliceInAccessUnit = HANTRO_FALSE;
+    pStorage->picStarted = HANTRO_FALSE;
+    pStorage->validSliceInAccessUnit = HANTRO_FALSE;
 
-        return(H264BSD_PIC_RDY);
-    }
-    else
-        return(H264BSD_RDY);
+    return(H264BSD_PIC_RDY);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: NextNalUnitIsSlice
+
+        Functional description:
+            Check if the byte stream continues with a start code prefix and
+            a coded slice NAL unit.
+
+        Inputs:
+            byteStrm        stream buffer following the current NAL unit
+            len             bytes left in the buffer
+
+        Returns:
+            HANTRO_TRUE     next NAL unit is a slice
+            HANTRO_FALSE    otherwise
+
+------------------------------------------------------------------------------*/
+
+u32 NextNalUnitIsSlice(u8 *byteStrm, u32 len)
+{
+
+/* Variables */
+
+    u32 i, nalUnitType;
+
+/* Code */
+
+    for (i = 0; i < len && !byteStrm[i]; i++)
+        ;
+
+    if (i < 2 || i + 1 >= len || byteStrm[i] != 0x01)
+        return(HANTRO_FALSE);
+
+    nalUnitType = byteStrm[i + 1] & 0x1F;
+
+    return(nalUnitType == NAL_CODED_SLICE ||
+           nalUnitType == NAL_CODED_SLICE_IDR ? HANTRO_TRUE : HANTRO_FALSE);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FollowsPendingSlices
+
+        Functional description:
+            Check if a slice starting at firstMbInSlice comes after the last
+            slice queued for the worker threads in decoding order, i.e. in a
+            later slice group or later in the same slice group. A slice that
+            does not may be the first slice of the next picture.
+
+        Returns:
+            HANTRO_TRUE     slice follows the pending slices
+            HANTRO_FALSE    otherwise
+
+------------------------------------------------------------------------------*/
+
+u32 FollowsPendingSlices(storage_t *pStorage, u32 firstMbInSlice)
+{
+
+/* Variables */
+
+    u32 lastMb, group, lastGroup;
+
+/* Code */
+
+    ASSERT(pStorage->numPendingSlices);
+
+    lastMb = pStorage->sliceJobs[pStorage->numPendingSlices - 1].
+        sliceHeader.firstMbInSlice;
+    group = pStorage->sliceGroupMap[firstMbInSlice];
+    lastGroup = pStorage->sliceGroupMap[lastMb];
+
+    return(group > lastGroup || (group == lastGroup && firstMbInSlice > lastMb) ?
+        HANTRO_TRUE : HANTRO_FALSE);
 
 }
 
@@ -563,6 +895,8 @@ void h264bsdShutdown(storage_t *pStorage)
         }
     }
 
+    FreeThreads(pStorage);
+
     FREE(pStorage->mbLayer);
     FREE(pStorage->mb);
     FREE(pStorage->sliceGroupMap);
@@ -571,6 +905,38 @@ void h264bsdShutdown(storage_t *pStorage)
 
 }
 
+/*------------------------------------------------------------------------------
+
+    Function: FreeThreads
+
+        Functional description:
+            Stop the worker threads and free the slice jobs.
+
+------------------------------------------------------------------------------*/
+
+void FreeThreads(storage_t *pStorage)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(!pStorage->numPendingSlices);
+
+    if (pStorage->sliceJobs)
+    {
+        for (i = 0; i < h264bsdNumWorkers(pStorage->threadPool); i++)
+            FREE(pStorage->sliceJobs[i].mbLayer);
+        FREE(pStorage->sliceJobs);
+    }
+
+    h264bsdDestroyThreadPool(pStorage->threadPool);
+    pStorage->threadPool = NULL;
+
+}
+
 /*------------------------------------------------------------------------------
 
     Function: h264bsdNextOutputPicture
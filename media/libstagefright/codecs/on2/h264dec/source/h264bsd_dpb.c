@@ -80,8 +80,6 @@
 /* macro to set a picture unused for reference */
 #define SET_UNUSED(a) (a).status = UNUSED;
 
-#define MAX_NUM_REF_IDX_L0_ACTIVE 16
-
 /*------------------------------------------------------------------------------
     4. Local function prototypes
 ------------------------------------------------------------------------------*/
@@ -40,6 +40,8 @@
     2. Module defines
 ------------------------------------------------------------------------------*/
 
+#define MAX_NUM_REF_IDX_L0_ACTIVE 16
+
 /*------------------------------------------------------------------------------
     3. Data types
 ------------------------------------------------------------------------------*/
@@ -36,6 +36,11 @@
 #include "h264bsd_util.h"
 #include "h264bsd_neighbour.h"
 
+#ifdef H264DEC_SSE2
+#include <emmintrin.h>
+#include <string.h>
+#endif /* H264DEC_SSE2 */
+
 /*------------------------------------------------------------------------------
     2. External compiler flags
 --------------------------------------------------------------------------------
@@ -55,6 +60,10 @@ extern const u8 h264bsdClip[];
     4. Local function prototypes
 ------------------------------------------------------------------------------*/
 
+#if defined(H264DEC_SSE2) && !defined(H264DEC_OMXDL)
+static void AddResidual4x4(u8 *imageBlock, u32 width, u8 *pred, u32 predWidth,
+    i32 *residual);
+#endif
 
 
 /*------------------------------------------------------------------------------
@@ -174,7 +183,6 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
 
 /* Variables */
 
-    u32 i;
     u32 picWidth, picSize;
     u8 *lum, *cb, *cr;
     u8 *imageBlock;
@@ -183,8 +191,12 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
     u32 block;
     u32 x, y;
     i32 *pRes;
-    i32 tmp1, tmp2, tmp3, tmp4;
+    i32 tmp1, tmp2;
+#ifndef H264DEC_SSE2
+    u32 i;
+    i32 tmp3, tmp4;
     const u8 *clp = h264bsdClip + 512;
+#endif
 
 /* Code */
 
@@ -244,6 +256,9 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
 
             /* Calculate image = prediction + residual
              * Process four pixels in a loop */
+#ifdef H264DEC_SSE2
+            AddResidual4x4(imageBlock, picWidth, tmp, 16, pRes);
+#else
             for (i = 4; i; i--)
             {
                 tmp1 = tmp[0];
@@ -265,6 +280,7 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
                 imageBlock[3] = (u8)tmp3;
                 imageBlock += picWidth;
             }
+#endif
         }
 
     }
@@ -316,6 +332,9 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
 
             RANGE_CHECK_ARRAY(pRes, -512, 511, 16);
 
+#ifdef H264DEC_SSE2
+            AddResidual4x4(imageBlock, picWidth, tmp, 8, pRes);
+#else
             for (i = 4; i; i--)
             {
                 tmp1 = tmp[0];
@@ -337,9 +356,60 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
                 imageBlock[3] = (u8)tmp3;
                 imageBlock += picWidth;
             }
+#endif
         }
     }
 
 }
+
+#ifdef H264DEC_SSE2
+/*------------------------------------------------------------------------------
+
+    Function: AddResidual4x4
+
+        Functional description:
+            Write prediction + residual of one 4x4 block into the image,
+            clipped to [0, 255]. The residual is in the range [-512, 511].
+
+------------------------------------------------------------------------------*/
+
+void AddResidual4x4(u8 *imageBlock, u32 width, u8 *pred, u32 predWidth,
+    i32 *residual)
+{
+
+/* Variables */
+
+    u32 i, tmp[4];
+    __m128i p01, p23, out;
+    const __m128i zero = _mm_setzero_si128();
+
+/* Code */
+
+    for (i = 0; i < 4; i++)
+        memcpy(tmp + i, pred + i*predWidth, 4);
+
+    p01 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(
+        _mm_cvtsi32_si128((i32)tmp[0]), _mm_cvtsi32_si128((i32)tmp[1])), zero);
+    p23 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(
+        _mm_cvtsi32_si128((i32)tmp[2]), _mm_cvtsi32_si128((i32)tmp[3])), zero);
+    p01 = _mm_add_epi16(p01, _mm_packs_epi32(
+        _mm_loadu_si128((__m128i *)residual),
+        _mm_loadu_si128((__m128i *)(residual + 4))));
+    p23 = _mm_add_epi16(p23, _mm_packs_epi32(
+        _mm_loadu_si128((__m128i *)(residual + 8)),
+        _mm_loadu_si128((__m128i *)(residual + 12))));
+    out = _mm_packus_epi16(p01, p23);
+
+    for (i = 0; i < 4; i++)
+    {
+        tmp[0] = (u32)_mm_cvtsi128_si32(out);
+        memcpy(imageBlock, tmp, 4);
+        out = _mm_srli_si128(out, 4);
+        imageBlock += width;
+    }
+
+}
+#endif /* H264DEC_SSE2 */
+
 #endif /* H264DEC_OMXDL */
 
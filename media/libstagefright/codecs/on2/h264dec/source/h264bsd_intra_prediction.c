@@ -67,6 +67,10 @@
 #include "omxVC.h"
 #endif /* H264DEC_OMXDL */
 
+#ifdef H264DEC_SSE2
+#include <emmintrin.h>
+#endif /* H264DEC_SSE2 */
+
 /*------------------------------------------------------------------------------
     2. External compiler flags
 --------------------------------------------------------------------------------
@@ -1132,6 +1136,27 @@ void Intra16x16PlanePrediction(u8 *data, u8 *above, u8 *left)
     c += ((i32)i + 1) * (left[8+i] - above[-1]);
     c = (5 * c + 32) >> 6;
 
+#ifdef H264DEC_SSE2
+    {
+        /* all intermediate values fit in 16 bits: |a| <= 8160 and
+         * |b|, |c| <= 717 */
+        __m128i lo, hi;
+        const __m128i vb = _mm_set1_epi16((i16)b);
+        const __m128i vc = _mm_set1_epi16((i16)c);
+
+        tmp = a - 7 * b - 7 * c + 16;
+        lo = _mm_add_epi16(_mm_set1_epi16((i16)tmp),
+            _mm_mullo_epi16(vb, _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7)));
+        hi = _mm_add_epi16(lo, _mm_slli_epi16(vb, 3));
+        for (j = 16; j--; data += 16)
+        {
+            _mm_storeu_si128((__m128i *)data, _mm_packus_epi16(
+                _mm_srai_epi16(lo, 5), _mm_srai_epi16(hi, 5)));
+            lo = _mm_add_epi16(lo, vc);
+            hi = _mm_add_epi16(hi, vc);
+        }
+    }
+#else
     for (i = 0; i < 16; i++)
     {
         for (j = 0; j < 16; j++)
@@ -1140,6 +1165,7 @@ void Intra16x16PlanePrediction(u8 *data, u8 *above, u8 *left)
             data[i*16+j] = (u8)CLIP1(tmp);
         }
     }
+#endif /* H264DEC_SSE2 */
 
 }
 
@@ -1328,7 +1354,9 @@ void IntraChromaPlanePrediction(u8 *data, u8 *above, u8 *left)
     u32 i;
     i32 a, b, c;
     i32 tmp;
+#ifndef H264DEC_SSE2
     const u8 *clp = h264bsdClip + 512;
+#endif
 
 /* Code */
 
@@ -1349,6 +1377,25 @@ void IntraChromaPlanePrediction(u8 *data, u8 *above, u8 *left)
 
     /*a += 16;*/
     a = a - 3 * c + 16;
+#ifdef H264DEC_SSE2
+    {
+        /* all intermediate values fit in 16 bits: |a| <= 8160 and
+         * |b|, |c| <= 1354 */
+        __m128i row;
+        const __m128i vc = _mm_set1_epi16((i16)c);
+
+        tmp = a - 3 * b;
+        row = _mm_add_epi16(_mm_set1_epi16((i16)tmp),
+            _mm_mullo_epi16(_mm_set1_epi16((i16)b),
+                _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7)));
+        for (i = 8; i--; data += 8)
+        {
+            _mm_storel_epi64((__m128i *)data,
+                _mm_packus_epi16(_mm_srai_epi16(row, 5), row));
+            row = _mm_add_epi16(row, vc);
+        }
+    }
+#else
     for (i = 8; i--; a += c)
     {
         tmp = (a - 3 * b);
@@ -1368,6 +1415,7 @@ void IntraChromaPlanePrediction(u8 *data, u8 *above, u8 *left)
         tmp += b;
         *data++ = clp[tmp>>5];
     }
+#endif /* H264DEC_SSE2 */
 
 }
 
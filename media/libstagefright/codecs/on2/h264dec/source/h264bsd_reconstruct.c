@@ -104,7 +104,7 @@ extern const u8 h264bsdClip[];
           predPartChroma    pointer where predicted part is written
 
 ------------------------------------------------------------------------------*/
-#ifndef H264DEC_ARM11
+#if !defined(H264DEC_ARM11) && !defined(H264DEC_SSE2)
 void h264bsdInterpolateChromaHor(
   u8 *pRef,
   u8 *predPartChroma,
@@ -285,6 +285,7 @@ void h264bsdInterpolateChromaVer(
 
 }
 #endif
+#ifndef H264DEC_SSE2
 /*------------------------------------------------------------------------------
 
     Function: h264bsdInterpolateChromaHorVer
@@ -401,6 +402,8 @@ void h264bsdInterpolateChromaHorVer(
 
 }
 
+#endif /* H264DEC_SSE2 */
+
 /*------------------------------------------------------------------------------
 
     Function: PredictChroma
@@ -485,7 +488,7 @@ static void PredictChroma(
           is written to macroblock array (mb)
 
 ------------------------------------------------------------------------------*/
-#ifndef H264DEC_ARM11
+#if !defined(H264DEC_ARM11) && !defined(H264DEC_SSE2)
 void h264bsdInterpolateVerHalf(
   u8 *ref,
   u8 *mb,
@@ -1193,6 +1196,7 @@ void h264bsdInterpolateHorVerQuarter(
 }
 #endif
 
+#ifndef H264DEC_SSE2
 /*------------------------------------------------------------------------------
 
     Function: h264bsdInterpolateMidHalf
@@ -1789,6 +1793,8 @@ void h264bsdInterpolateMidHorQuarter(
 }
 
 
+#endif /* H264DEC_SSE2 */
+
 /*------------------------------------------------------------------------------
 
     Function: h264bsdPredictSamples
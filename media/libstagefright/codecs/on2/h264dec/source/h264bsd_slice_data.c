@@ -24,8 +24,13 @@
      4. Local function prototypes
      5. Functions
           h264bsdDecodeSliceData
+          h264bsdQueueSliceData
+          h264bsdFinishSliceData
+          DecodeSlice
+          DecodeSliceJob
           SetMbParams
           h264bsdMarkSliceCorrupted
+          MarkSliceCorrupted
 
 ------------------------------------------------------------------------------*/
 
@@ -49,9 +54,18 @@
     4. Local function prototypes
 ------------------------------------------------------------------------------*/
 
+static u32 DecodeSlice(strmData_t *pStrmData, storage_t *pStorage,
+    image_t *currImage, sliceHeader_t *pSliceHeader, dpbStorage_t *dpb,
+    macroblockLayer_t *mbLayer, sliceStorage_t *pSlice);
+
+static void DecodeSliceJob(void *arg);
+
 static void SetMbParams(mbStorage_t *pMb, sliceHeader_t *pSlice, u32 sliceId,
     i32 chromaQpIndexOffset);
 
+static void MarkSliceCorrupted(storage_t *pStorage, sliceStorage_t *pSlice,
+    u32 firstMbInSlice);
+
 /*------------------------------------------------------------------------------
 
    5.1  Function name: h264bsdDecodeSliceData
@@ -86,6 +100,175 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
     image_t *currImage, sliceHeader_t *pSliceHeader)
 {
 
+/* Code */
+
+    ASSERT(pStorage);
+
+    /* increment slice index, will be one for decoding of the first slice of
+     * the picture */
+    pStorage->slice->sliceId++;
+
+    return(DecodeSlice(pStrmData, pStorage, currImage, pSliceHeader,
+        pStorage->dpb, pStorage->mbLayer, pStorage->slice));
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.2  Function name: h264bsdQueueSliceData
+
+        Functional description:
+            Start decoding of one slice in a worker thread. The slice gets
+            the next slice index and the current reference picture list, so
+            slice headers, reference picture lists and slice data of the
+            following slices may be processed while the worker decodes. The
+            stream buffer must stay valid until h264bsdFinishSliceData is
+            called. Caller shall check that there is a free worker, i.e.
+            numPendingSlices is less than the number of workers.
+
+        Inputs:
+            pStrmData       pointer to stream data structure
+            pStorage        pointer to storage structure
+            currImage       pointer to current processed picture
+            pSliceHeader    pointer to slice header of the current slice
+
+        Outputs:
+            pStorage        numPendingSlices incremented
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdQueueSliceData(strmData_t *pStrmData, storage_t *pStorage,
+    image_t *currImage, sliceHeader_t *pSliceHeader)
+{
+
+/* Variables */
+
+    sliceJob_t *pJob;
+
+/* Code */
+
+    ASSERT(pStrmData);
+    ASSERT(pStorage);
+    ASSERT(pStorage->threadPool);
+    ASSERT(pStorage->numPendingSlices <
+        h264bsdNumWorkers(pStorage->threadPool));
+
+    pJob = pStorage->sliceJobs + pStorage->numPendingSlices++;
+
+    pJob->pStorage = pStorage;
+    pJob->strm = *pStrmData;
+    pJob->sliceHeader = *pSliceHeader;
+    pJob->currImage = *currImage;
+    pJob->dpb = *pStorage->dpb;
+    H264SwDecMemcpy(pJob->refPicList, pStorage->dpb->list,
+        sizeof(pJob->refPicList));
+    pJob->dpb.list = pJob->refPicList;
+
+    pJob->slice.sliceId = ++pStorage->slice->sliceId;
+    pJob->slice.numDecodedMbs = 0;
+    pJob->slice.lastMbAddr = 0;
+
+    pJob->job.run = DecodeSliceJob;
+    pJob->job.arg = pJob;
+    h264bsdSubmitJob(pStorage->threadPool, &pJob->job);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.3  Function name: h264bsdFinishSliceData
+
+        Functional description:
+            Wait for the slices queued with h264bsdQueueSliceData. Decoded
+            macroblocks are counted and slices that could not be decoded are
+            marked corrupted in the order the slices were queued.
+
+        Inputs:
+            pStorage        pointer to storage structure
+
+        Outputs:
+            pStorage        numDecodedMbs updated, numPendingSlices cleared
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFinishSliceData(storage_t *pStorage)
+{
+
+/* Variables */
+
+    u32 i;
+    sliceJob_t *pJob;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    if (!pStorage->numPendingSlices)
+        return;
+
+    h264bsdWaitJobs(pStorage->threadPool);
+
+    for (i = 0; i < pStorage->numPendingSlices; i++)
+    {
+        pJob = pStorage->sliceJobs + i;
+        if (pJob->status == HANTRO_OK &&
+            (pStorage->slice->numDecodedMbs + pJob->slice.numDecodedMbs) <=
+            pStorage->picSizeInMbs)
+        {
+            pStorage->slice->numDecodedMbs += pJob->slice.numDecodedMbs;
+        }
+        else
+        {
+            EPRINT("SLICE_DATA");
+            MarkSliceCorrupted(pStorage, &pJob->slice,
+                pJob->sliceHeader.firstMbInSlice);
+        }
+    }
+
+    pStorage->numPendingSlices = 0;
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.4  Function name: DecodeSlice
+
+        Functional description:
+            Decode slice data of the slice identified by the slice storage.
+
+        Inputs:
+            pStrmData       pointer to stream data structure
+            pStorage        pointer to storage structure
+            currImage       pointer to current processed picture
+            pSliceHeader    pointer to slice header of the current slice
+            dpb             decoded picture buffer with the reference
+                            picture list of the slice
+            mbLayer         macroblock layer structure for the slice
+            pSlice          slice index of the slice
+
+        Outputs:
+            currImage       processed macroblocks are written to current image
+            pStorage        mbStorage structure of each processed macroblock
+                            is updated here
+            pSlice          lastMbAddr and numDecodedMbs updated
+
+        Returns:
+            HANTRO_OK       success
+            HANTRO_NOK      invalid stream data
+
+------------------------------------------------------------------------------*/
+
+u32 DecodeSlice(strmData_t *pStrmData, storage_t *pStorage,
+    image_t *currImage, sliceHeader_t *pSliceHeader, dpbStorage_t *dpb,
+    macroblockLayer_t *mbLayer, sliceStorage_t *pSlice)
+{
+
 /* Variables */
 
     u8 mbData[384 + 15 + 32];
@@ -97,7 +280,6 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
     u32 moreMbs;
     u32 mbCount;
     i32 qpY;
-    macroblockLayer_t *mbLayer;
 
 /* Code */
 
@@ -109,19 +291,13 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
     /* ensure 16-byte alignment */
     data = (u8*)ALIGN(mbData, 16);
 
-    mbLayer = pStorage->mbLayer;
-
     currMbAddr = pSliceHeader->firstMbInSlice;
     skipRun = 0;
     prevSkipped = HANTRO_FALSE;
 
-    /* increment slice index, will be one for decoding of the first slice of
-     * the picture */
-    pStorage->slice->sliceId++;
-
     /* lastMbAddr stores address of the macroblock that was last successfully
      * decoded, needed for error handling */
-    pStorage->slice->lastMbAddr = 0;
+    pSlice->lastMbAddr = 0;
 
     mbCount = 0;
     /* initial quantization parameter for the slice is obtained as the sum of
@@ -137,7 +313,7 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
         }
 
         SetMbParams(pStorage->mb + currMbAddr, pSliceHeader,
-            pStorage->slice->sliceId, pStorage->activePps->chromaQpIndexOffset);
+            pSlice->sliceId, pStorage->activePps->chromaQpIndexOffset);
 
         if (!IS_I_SLICE(pSliceHeader->sliceType))
         {
@@ -182,7 +358,7 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
         }
 
         tmp = h264bsdDecodeMacroblock(pStorage->mb + currMbAddr, mbLayer,
-            currImage, pStorage->dpb, &qpY, currMbAddr,
+            currImage, dpb, &qpY, currMbAddr,
             pStorage->activePps->constrainedIntraPredFlag, data);
         if (tmp != HANTRO_OK)
         {
@@ -204,7 +380,7 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
         /* lastMbAddr is only updated for intra slices (all macroblocks of
          * inter slices will be lost in case of an error) */
         if (IS_I_SLICE(pSliceHeader->sliceType))
-            pStorage->slice->lastMbAddr = currMbAddr;
+            pSlice->lastMbAddr = currMbAddr;
 
         currMbAddr = h264bsdNextMbAddress(pStorage->sliceGroupMap,
             pStorage->picSizeInMbs, currMbAddr);
@@ -218,13 +394,13 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
 
     } while (moreMbs);
 
-    if ((pStorage->slice->numDecodedMbs + mbCount) > pStorage->picSizeInMbs)
+    if ((pSlice->numDecodedMbs + mbCount) > pStorage->picSizeInMbs)
     {
         EPRINT("Num decoded mbs");
         return(HANTRO_NOK);
     }
 
-    pStorage->slice->numDecodedMbs += mbCount;
+    pSlice->numDecodedMbs += mbCount;
 
     return(HANTRO_OK);
 
@@ -232,7 +408,30 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
 
 /*------------------------------------------------------------------------------
 
-   5.2  Function: SetMbParams
+   5.5  Function name: DecodeSliceJob
+
+        Functional description:
+            Decode slice data of a queued slice, run by a worker thread.
+
+------------------------------------------------------------------------------*/
+
+void DecodeSliceJob(void *arg)
+{
+
+/* Variables */
+
+    sliceJob_t *pJob = (sliceJob_t *)arg;
+
+/* Code */
+
+    pJob->status = DecodeSlice(&pJob->strm, pJob->pStorage, &pJob->currImage,
+        &pJob->sliceHeader, &pJob->dpb, pJob->mbLayer, &pJob->slice);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.6  Function: SetMbParams
 
         Functional description:
             Set macroblock parameters that remain constant for this slice
@@ -273,7 +472,7 @@ void SetMbParams(mbStorage_t *pMb, sliceHeader_t *pSlice, u32 sliceId,
 
 /*------------------------------------------------------------------------------
 
-   5.3  Function name: h264bsdMarkSliceCorrupted
+   5.7  Function name: h264bsdMarkSliceCorrupted
 
         Functional description:
             Mark macroblocks of the slice corrupted. If lastMbAddr in the slice
@@ -297,6 +496,26 @@ void SetMbParams(mbStorage_t *pMb, sliceHeader_t *pSlice, u32 sliceId,
 void h264bsdMarkSliceCorrupted(storage_t *pStorage, u32 firstMbInSlice)
 {
 
+/* Code */
+
+    MarkSliceCorrupted(pStorage, pStorage->slice, firstMbInSlice);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.8  Function name: MarkSliceCorrupted
+
+        Functional description:
+            Mark macroblocks of the slice identified by the slice storage
+            corrupted, see h264bsdMarkSliceCorrupted.
+
+------------------------------------------------------------------------------*/
+
+void MarkSliceCorrupted(storage_t *pStorage, sliceStorage_t *pSlice,
+    u32 firstMbInSlice)
+{
+
 /* Variables */
 
     u32 tmp, i;
@@ -310,14 +529,14 @@ void h264bsdMarkSliceCorrupted(storage_t *pStorage, u32 firstMbInSlice)
 
     currMbAddr = firstMbInSlice;
 
-    sliceId = pStorage->slice->sliceId;
+    sliceId = pSlice->sliceId;
 
     /* DecodeSliceData sets lastMbAddr for I slices -> if it was set, go back
      * MAX(picWidthInMbs, 10) macroblocks and start marking from there */
-    if (pStorage->slice->lastMbAddr)
+    if (pSlice->lastMbAddr)
     {
-        ASSERT(pStorage->mb[pStorage->slice->lastMbAddr].sliceId == sliceId);
-        i = pStorage->slice->lastMbAddr - 1;
+        ASSERT(pStorage->mb[pSlice->lastMbAddr].sliceId == sliceId);
+        i = pSlice->lastMbAddr - 1;
         tmp = 0;
         while (i > currMbAddr)
         {
@@ -52,6 +52,9 @@
 
 u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
     image_t *currImage, sliceHeader_t *pSliceHeader);
+void h264bsdQueueSliceData(strmData_t *pStrmData, storage_t *pStorage,
+    image_t *currImage, sliceHeader_t *pSliceHeader);
+void h264bsdFinishSliceData(storage_t *pStorage);
 
 void h264bsdMarkSliceCorrupted(storage_t *pStorage, u32 firstMbInSlice);
 
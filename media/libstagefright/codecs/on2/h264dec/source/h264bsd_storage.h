@@ -42,6 +42,7 @@
 #include "h264bsd_seq_param_set.h"
 #include "h264bsd_dpb.h"
 #include "h264bsd_pic_order_cnt.h"
+#include "h264bsd_threads.h"
 
 /*------------------------------------------------------------------------------
     2. Module defines
@@ -146,8 +147,31 @@ typedef struct
                               HEADERS_RDY to the user */
     u32 intraConcealmentFlag; /* 0 gray picture for corrupted intra
                                  1 previous frame used if available */
+
+    /* worker threads, NULL if the decoder runs in the calling thread only */
+    threadPool_t *threadPool;
+    /* one job for each worker, numPendingSlices of them are decoding
+     * slices of the current picture */
+    struct sliceJob *sliceJobs;
+    u32 numPendingSlices;
 } storage_t;
 
+/* slice decoded by a worker thread, holds copies of everything in the
+ * storage that changes from slice to slice */
+typedef struct sliceJob
+{
+    threadJob_t job;
+    storage_t *pStorage;
+    strmData_t strm;
+    sliceHeader_t sliceHeader;
+    image_t currImage;
+    dpbStorage_t dpb;
+    dpbPicture_t *refPicList[MAX_NUM_REF_IDX_L0_ACTIVE + 1];
+    sliceStorage_t slice;
+    macroblockLayer_t *mbLayer;
+    u32 status;
+} sliceJob_t;
+
 /*------------------------------------------------------------------------------
     4. Function prototypes
 ------------------------------------------------------------------------------*/
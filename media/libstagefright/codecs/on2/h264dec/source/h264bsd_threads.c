@@ -0,0 +1,517 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          WorkerThread
+          h264bsdCreateThreadPool
+          h264bsdDestroyThreadPool
+          h264bsdNumWorkers
+          h264bsdSubmitJob
+          h264bsdWaitJobs
+          h264bsdClaimIndex
+          h264bsdCreateProgress
+          h264bsdDestroyProgress
+          h264bsdSetProgress
+          h264bsdWaitProgress
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include <pthread.h>
+
+#include "h264bsd_threads.h"
+#include "h264bsd_util.h"
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+struct threadPool
+{
+    pthread_t threads[MAX_NUM_THREADS];
+    u32 numWorkers;
+
+    /* protects the job queue and the counters of h264bsdClaimIndex */
+    pthread_mutex_t lock;
+    pthread_cond_t jobQueued;
+    pthread_cond_t jobsDone;
+
+    threadJob_t *head;
+    threadJob_t *tail;
+    /* jobs submitted and not finished yet */
+    u32 numJobs;
+    u32 exit;
+};
+
+/* one counter of h264bsdSetProgress, with its own lock so that threads
+ * working on different counters do not contend */
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t reached;
+    u32 value;
+    /* value the waiting thread needs, 0 if no thread is waiting */
+    u32 wanted;
+} progressCounter_t;
+
+struct threadProgress
+{
+    u32 numCounters;
+    progressCounter_t *counters;
+};
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+static void *WorkerThread(void *arg);
+
+/*------------------------------------------------------------------------------
+
+   5.1  Function: WorkerThread
+
+        Functional description:
+            Run jobs from the queue of the pool until the pool is destroyed.
+
+------------------------------------------------------------------------------*/
+
+void *WorkerThread(void *arg)
+{
+
+/* Variables */
+
+    threadPool_t *pPool = (threadPool_t *)arg;
+    threadJob_t *pJob;
+
+/* Code */
+
+    pthread_mutex_lock(&pPool->lock);
+    for (;;)
+    {
+        while (!pPool->exit && pPool->head == NULL)
+            pthread_cond_wait(&pPool->jobQueued, &pPool->lock);
+
+        if (pPool->exit)
+            break;
+
+        pJob = pPool->head;
+        pPool->head = pJob->next;
+        if (pPool->head == NULL)
+            pPool->tail = NULL;
+
+        pthread_mutex_unlock(&pPool->lock);
+        pJob->run(pJob->arg);
+        pthread_mutex_lock(&pPool->lock);
+
+        if (--pPool->numJobs == 0)
+            pthread_cond_broadcast(&pPool->jobsDone);
+    }
+    pthread_mutex_unlock(&pPool->lock);
+
+    return NULL;
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.2  Function: h264bsdCreateThreadPool
+
+        Functional description:
+            Start worker threads. The thread that decodes the stream works
+            on the jobs too, so a pool for N threads has N-1 workers.
+
+        Inputs:
+            numWorkers  number of worker threads, 1 to MAX_NUM_THREADS-1
+
+        Returns:
+            pointer to the pool
+            NULL if memory allocation or thread creation failed
+
+------------------------------------------------------------------------------*/
+
+threadPool_t *h264bsdCreateThreadPool(u32 numWorkers)
+{
+
+/* Variables */
+
+    u32 i;
+    threadPool_t *pPool;
+
+/* Code */
+
+    ASSERT(numWorkers && numWorkers < MAX_NUM_THREADS);
+
+    pPool = (threadPool_t *)H264SwDecMalloc(sizeof(threadPool_t));
+    if (pPool == NULL)
+        return(NULL);
+
+    H264SwDecMemset(pPool, 0, sizeof(threadPool_t));
+    pthread_mutex_init(&pPool->lock, NULL);
+    pthread_cond_init(&pPool->jobQueued, NULL);
+    pthread_cond_init(&pPool->jobsDone, NULL);
+
+    for (i = 0; i < numWorkers; i++)
+    {
+        if (pthread_create(&pPool->threads[i], NULL, WorkerThread, pPool))
+            break;
+        pPool->numWorkers++;
+    }
+
+    if (pPool->numWorkers != numWorkers)
+    {
+        h264bsdDestroyThreadPool(pPool);
+        return(NULL);
+    }
+
+    return(pPool);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.3  Function: h264bsdDestroyThreadPool
+
+        Functional description:
+            Stop the worker threads and free the pool. There shall be no
+            unfinished jobs.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdDestroyThreadPool(threadPool_t *pPool)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    if (pPool == NULL)
+        return;
+
+    ASSERT(pPool->numJobs == 0);
+
+    pthread_mutex_lock(&pPool->lock);
+    pPool->exit = HANTRO_TRUE;
+    pthread_cond_broadcast(&pPool->jobQueued);
+    pthread_mutex_unlock(&pPool->lock);
+
+    for (i = 0; i < pPool->numWorkers; i++)
+        pthread_join(pPool->threads[i], NULL);
+
+    pthread_cond_destroy(&pPool->jobsDone);
+    pthread_cond_destroy(&pPool->jobQueued);
+    pthread_mutex_destroy(&pPool->lock);
+
+    H264SwDecFree(pPool);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.4  Function: h264bsdNumWorkers
+
+        Functional description:
+            Get the number of worker threads of the pool.
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdNumWorkers(threadPool_t *pPool)
+{
+
+/* Code */
+
+    ASSERT(pPool);
+
+    return(pPool->numWorkers);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.5  Function: h264bsdSubmitJob
+
+        Functional description:
+            Queue a job for the worker threads. Jobs are started in the order
+            they were submitted.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSubmitJob(threadPool_t *pPool, threadJob_t *pJob)
+{
+
+/* Code */
+
+    ASSERT(pPool);
+    ASSERT(pJob);
+
+    pJob->next = NULL;
+
+    pthread_mutex_lock(&pPool->lock);
+    if (pPool->tail)
+        pPool->tail->next = pJob;
+    else
+        pPool->head = pJob;
+    pPool->tail = pJob;
+    pPool->numJobs++;
+    pthread_cond_signal(&pPool->jobQueued);
+    pthread_mutex_unlock(&pPool->lock);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.6  Function: h264bsdWaitJobs
+
+        Functional description:
+            Wait until all submitted jobs are finished.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdWaitJobs(threadPool_t *pPool)
+{
+
+/* Code */
+
+    ASSERT(pPool);
+
+    pthread_mutex_lock(&pPool->lock);
+    while (pPool->numJobs)
+        pthread_cond_wait(&pPool->jobsDone, &pPool->lock);
+    pthread_mutex_unlock(&pPool->lock);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.7  Function: h264bsdClaimIndex
+
+        Functional description:
+            Hand out indexes of a shared counter, each index to one caller
+            only.
+
+        Inputs:
+            pNext       counter shared by the threads
+
+        Outputs:
+            pNext       incremented
+
+        Returns:
+            value of the counter before the increment
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdClaimIndex(threadPool_t *pPool, u32 *pNext)
+{
+
+/* Variables */
+
+    u32 index;
+
+/* Code */
+
+    ASSERT(pPool);
+    ASSERT(pNext);
+
+    pthread_mutex_lock(&pPool->lock);
+    index = (*pNext)++;
+    pthread_mutex_unlock(&pPool->lock);
+
+    return(index);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.8  Function: h264bsdCreateProgress
+
+        Functional description:
+            Allocate progress counters, e.g. one per macroblock row, all
+            starting at 0.
+
+        Inputs:
+            numCounters number of counters
+
+        Returns:
+            pointer to the counters
+            NULL if memory allocation failed
+
+------------------------------------------------------------------------------*/
+
+threadProgress_t *h264bsdCreateProgress(u32 numCounters)
+{
+
+/* Variables */
+
+    u32 i;
+    threadProgress_t *pProgress;
+
+/* Code */
+
+    ASSERT(numCounters);
+
+    pProgress = (threadProgress_t *)H264SwDecMalloc(sizeof(threadProgress_t));
+    if (pProgress == NULL)
+        return(NULL);
+
+    ALLOCATE(pProgress->counters, numCounters, progressCounter_t);
+    if (pProgress->counters == NULL)
+    {
+        H264SwDecFree(pProgress);
+        return(NULL);
+    }
+
+    pProgress->numCounters = numCounters;
+    for (i = 0; i < numCounters; i++)
+    {
+        pthread_mutex_init(&pProgress->counters[i].lock, NULL);
+        pthread_cond_init(&pProgress->counters[i].reached, NULL);
+        pProgress->counters[i].value = 0;
+        pProgress->counters[i].wanted = 0;
+    }
+
+    return(pProgress);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.9  Function: h264bsdDestroyProgress
+
+        Functional description:
+            Free progress counters. No thread shall be waiting on them.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdDestroyProgress(threadProgress_t *pProgress)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    if (pProgress == NULL)
+        return;
+
+    for (i = 0; i < pProgress->numCounters; i++)
+    {
+        ASSERT(pProgress->counters[i].wanted == 0);
+        pthread_cond_destroy(&pProgress->counters[i].reached);
+        pthread_mutex_destroy(&pProgress->counters[i].lock);
+    }
+
+    FREE(pProgress->counters);
+    H264SwDecFree(pProgress);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.10 Function: h264bsdSetProgress
+
+        Functional description:
+            Publish the progress of a thread in counter index, e.g. number of
+            macroblocks processed in a row, and wake up the thread waiting
+            for it if it needs no more. Writes done before the call are
+            visible to the thread that sees the new value in
+            h264bsdWaitProgress.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSetProgress(threadProgress_t *pProgress, u32 index, u32 value)
+{
+
+/* Variables */
+
+    progressCounter_t *pCounter;
+
+/* Code */
+
+    ASSERT(pProgress);
+    ASSERT(index < pProgress->numCounters);
+
+    pCounter = pProgress->counters + index;
+
+    pthread_mutex_lock(&pCounter->lock);
+    pCounter->value = value;
+    if (pCounter->wanted && value >= pCounter->wanted)
+    {
+        pCounter->wanted = 0;
+        pthread_cond_signal(&pCounter->reached);
+    }
+    pthread_mutex_unlock(&pCounter->lock);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.11 Function: h264bsdWaitProgress
+
+        Functional description:
+            Wait until the progress published in counter index with
+            h264bsdSetProgress has reached value. Only one thread at a time
+            may wait on a counter.
+
+        Returns:
+            progress when the wait ended, at least value
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdWaitProgress(threadProgress_t *pProgress, u32 index, u32 value)
+{
+
+/* Variables */
+
+    u32 progress;
+    progressCounter_t *pCounter;
+
+/* Code */
+
+    ASSERT(pProgress);
+    ASSERT(index < pProgress->numCounters);
+    ASSERT(value);
+
+    pCounter = pProgress->counters + index;
+
+    pthread_mutex_lock(&pCounter->lock);
+    while (pCounter->value < value)
+    {
+        pCounter->wanted = value;
+        pthread_cond_wait(&pCounter->reached, &pCounter->lock);
+    }
+    progress = pCounter->value;
+    pthread_mutex_unlock(&pCounter->lock);
+
+    return(progress);
+
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+    1. Include headers
+    2. Module defines
+    3. Data types
+    4. Function prototypes
+
+------------------------------------------------------------------------------*/
+
+#ifndef H264SWDEC_THREADS_H
+#define H264SWDEC_THREADS_H
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "basetype.h"
+
+/*------------------------------------------------------------------------------
+    2. Module defines
+------------------------------------------------------------------------------*/
+
+/* maximum number of threads decoding a stream, including the caller */
+#define MAX_NUM_THREADS 16
+
+/*------------------------------------------------------------------------------
+    3. Data types
+------------------------------------------------------------------------------*/
+
+/* job run by one of the worker threads. Storage of the job is owned by the
+ * submitter and must stay valid until h264bsdWaitJobs returns */
+typedef struct threadJob
+{
+    void (*run)(void *arg);
+    void *arg;
+    struct threadJob *next;
+} threadJob_t;
+
+typedef struct threadPool threadPool_t;
+
+/* counters published by one thread and waited on by another one */
+typedef struct threadProgress threadProgress_t;
+
+/*------------------------------------------------------------------------------
+    4. Function prototypes
+------------------------------------------------------------------------------*/
+
+threadPool_t *h264bsdCreateThreadPool(u32 numWorkers);
+void h264bsdDestroyThreadPool(threadPool_t *pPool);
+u32 h264bsdNumWorkers(threadPool_t *pPool);
+
+void h264bsdSubmitJob(threadPool_t *pPool, threadJob_t *pJob);
+void h264bsdWaitJobs(threadPool_t *pPool);
+
+u32 h264bsdClaimIndex(threadPool_t *pPool, u32 *pNext);
+
+threadProgress_t *h264bsdCreateProgress(u32 numCounters);
+void h264bsdDestroyProgress(threadProgress_t *pProgress);
+void h264bsdSetProgress(threadProgress_t *pProgress, u32 index, u32 value);
+u32 h264bsdWaitProgress(threadProgress_t *pProgress, u32 index, u32 value);
+
+#endif /* #ifdef H264SWDEC_THREADS_H */
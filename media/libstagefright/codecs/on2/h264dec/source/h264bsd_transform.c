@@ -37,6 +37,10 @@
 #include "h264bsd_transform.h"
 #include "h264bsd_util.h"
 
+#ifdef H264DEC_SSE2
+#include <emmintrin.h>
+#endif /* H264DEC_SSE2 */
+
 /*------------------------------------------------------------------------------
     2. External compiler flags
 --------------------------------------------------------------------------------
@@ -67,6 +71,10 @@ static const u8 qpDiv6[52] = {0,0,0,0,0,0,1,1,1,1,1,1,2,2,2,2,2,2,3,3,3,3,3,3,
     4. Local function prototypes
 ------------------------------------------------------------------------------*/
 
+#ifdef H264DEC_SSE2
+static u32 InverseTransform(i32 *data);
+#endif
+
 /*------------------------------------------------------------------------------
 
     Function: h264bsdProcessBlock
@@ -98,9 +106,11 @@ u32 h264bsdProcessBlock(i32 *data, u32 qp, u32 skip, u32 coeffMap)
 
     i32 tmp0, tmp1, tmp2, tmp3;
     i32 d1, d2, d3;
-    u32 row,col;
     u32 qpDiv;
+#ifndef H264DEC_SSE2
+    u32 row,col;
     i32 *ptr;
+#endif
 
 /* Code */
 
@@ -152,6 +162,9 @@ u32 h264bsdProcessBlock(i32 *data, u32 qp, u32 skip, u32 coeffMap)
         data[10] = (d2 * tmp1);
         data[11] = (d3 * tmp2);
 
+#ifdef H264DEC_SSE2
+        return(InverseTransform(data));
+#else
         /* horizontal transform */
         for (row = 4, ptr = data; row--; ptr += 4)
         {
@@ -184,6 +197,7 @@ u32 h264bsdProcessBlock(i32 *data, u32 qp, u32 skip, u32 coeffMap)
                 ((u32)(data[12] + 512) > 1023) )
                 return(HANTRO_NOK);
         }
+#endif /* H264DEC_SSE2 */
     }
     else /* rows 1, 2 and 3 are zero */
     {
@@ -230,6 +244,97 @@ u32 h264bsdProcessBlock(i32 *data, u32 qp, u32 skip, u32 coeffMap)
 
 }
 
+#ifdef H264DEC_SSE2
+/*------------------------------------------------------------------------------
+
+    Function: InverseTransform
+
+        Functional description:
+            Horizontal and vertical inverse transform of a dequantized 4x4
+            block, four rows or columns at a time. Same arithmetic as the
+            transform in h264bsdProcessBlock.
+
+        Returns:
+            HANTRO_OK       success
+            HANTRO_NOK      processed data not in valid range [-512, 511]
+
+------------------------------------------------------------------------------*/
+
+#define TRANSPOSE_4X4(r0, r1, r2, r3) \
+{ \
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1); \
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3); \
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1); \
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3); \
+    r0 = _mm_unpacklo_epi64(t0, t1); \
+    r1 = _mm_unpackhi_epi64(t0, t1); \
+    r2 = _mm_unpacklo_epi64(t2, t3); \
+    r3 = _mm_unpackhi_epi64(t2, t3); \
+}
+
+#define TRANSFORM_4(r0, r1, r2, r3) \
+{ \
+    __m128i t0 = _mm_add_epi32(r0, r2); \
+    __m128i t1 = _mm_sub_epi32(r0, r2); \
+    __m128i t2 = _mm_sub_epi32(_mm_srai_epi32(r1, 1), r3); \
+    __m128i t3 = _mm_add_epi32(r1, _mm_srai_epi32(r3, 1)); \
+    r0 = _mm_add_epi32(t0, t3); \
+    r1 = _mm_add_epi32(t1, t2); \
+    r2 = _mm_sub_epi32(t1, t2); \
+    r3 = _mm_sub_epi32(t0, t3); \
+}
+
+u32 InverseTransform(i32 *data)
+{
+
+/* Variables */
+
+    __m128i r0, r1, r2, r3, bad;
+    const __m128i round = _mm_set1_epi32(32);
+    const __m128i max = _mm_set1_epi32(511);
+    const __m128i min = _mm_set1_epi32(-512);
+
+/* Code */
+
+    r0 = _mm_loadu_si128((__m128i *)data);
+    r1 = _mm_loadu_si128((__m128i *)(data + 4));
+    r2 = _mm_loadu_si128((__m128i *)(data + 8));
+    r3 = _mm_loadu_si128((__m128i *)(data + 12));
+
+    /* horizontal transform on columns of the transposed block, then
+     * vertical transform on the rows */
+    TRANSPOSE_4X4(r0, r1, r2, r3);
+    TRANSFORM_4(r0, r1, r2, r3);
+    TRANSPOSE_4X4(r0, r1, r2, r3);
+    TRANSFORM_4(r0, r1, r2, r3);
+
+    r0 = _mm_srai_epi32(_mm_add_epi32(r0, round), 6);
+    r1 = _mm_srai_epi32(_mm_add_epi32(r1, round), 6);
+    r2 = _mm_srai_epi32(_mm_add_epi32(r2, round), 6);
+    r3 = _mm_srai_epi32(_mm_add_epi32(r3, round), 6);
+
+    _mm_storeu_si128((__m128i *)data, r0);
+    _mm_storeu_si128((__m128i *)(data + 4), r1);
+    _mm_storeu_si128((__m128i *)(data + 8), r2);
+    _mm_storeu_si128((__m128i *)(data + 12), r3);
+
+    /* check that each value is in the range [-512,511] */
+    bad = _mm_or_si128(
+        _mm_or_si128(_mm_cmpgt_epi32(r0, max), _mm_cmplt_epi32(r0, min)),
+        _mm_or_si128(_mm_cmpgt_epi32(r1, max), _mm_cmplt_epi32(r1, min)));
+    bad = _mm_or_si128(bad,
+        _mm_or_si128(_mm_cmpgt_epi32(r2, max), _mm_cmplt_epi32(r2, min)));
+    bad = _mm_or_si128(bad,
+        _mm_or_si128(_mm_cmpgt_epi32(r3, max), _mm_cmplt_epi32(r3, min)));
+
+    if (_mm_movemask_epi8(bad))
+        return(HANTRO_NOK);
+
+    return(HANTRO_OK);
+
+}
+#endif /* H264DEC_SSE2 */
+
 /*------------------------------------------------------------------------------
 
     Function: h264bsdProcessLumaDc
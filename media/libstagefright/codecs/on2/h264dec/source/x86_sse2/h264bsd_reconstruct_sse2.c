@@ -0,0 +1,952 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          h264bsdInterpolateChromaHor
+          h264bsdInterpolateChromaVer
+          h264bsdInterpolateChromaHorVer
+          h264bsdInterpolateVerHalf
+          h264bsdInterpolateVerQuarter
+          h264bsdInterpolateHorHalf
+          h264bsdInterpolateHorQuarter
+          h264bsdInterpolateHorVerQuarter
+          h264bsdInterpolateMidHalf
+          h264bsdInterpolateMidVerQuarter
+          h264bsdInterpolateMidHorQuarter
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include <emmintrin.h>
+#include <string.h>
+
+#include "basetype.h"
+#include "h264bsd_reconstruct.h"
+#include "h264bsd_util.h"
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+    H264DEC_SSE2    these functions replace the C versions in
+                    h264bsd_reconstruct.c. Results are bit exact with them.
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+/* Loads and stores never touch more than 'n' bytes, the C code reads exactly
+ * the samples it needs and the reference may end at the last of them. */
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    5. Functions
+------------------------------------------------------------------------------*/
+
+/* n bytes from p (n is 2, 4, 8 or 16) into the low bytes of a vector */
+static __inline __m128i Load(const u8 *p, u32 n)
+{
+    u32 tmp = 0;
+
+    if (n == 16)
+        return _mm_loadu_si128((const __m128i *)p);
+    if (n == 8)
+        return _mm_loadl_epi64((const __m128i *)p);
+    memcpy(&tmp, p, n);
+    return _mm_cvtsi32_si128((int)tmp);
+}
+
+static __inline void Store(u8 *p, __m128i v, u32 n)
+{
+    u32 tmp;
+
+    if (n == 16)
+        _mm_storeu_si128((__m128i *)p, v);
+    else if (n == 8)
+        _mm_storel_epi64((__m128i *)p, v);
+    else
+    {
+        tmp = (u32)_mm_cvtsi128_si32(v);
+        memcpy(p, &tmp, n);
+    }
+}
+
+/* 8 (or 4) 16-bit values from p; table rows have room for the whole load */
+static __inline __m128i Load16Bit(const i16 *p, u32 n)
+{
+    if (n == 4)
+        return _mm_loadl_epi64((const __m128i *)p);
+    return _mm_loadu_si128((const __m128i *)p);
+}
+
+/* s0 - 5s1 + 20s2 + 20s3 - 5s4 + s5 on 16-bit lanes, fits for 8-bit input */
+static __inline __m128i Tap6(__m128i s0, __m128i s1, __m128i s2,
+    __m128i s3, __m128i s4, __m128i s5)
+{
+    __m128i a = _mm_add_epi16(s2, s3);
+    __m128i b = _mm_add_epi16(s1, s4);
+
+    a = _mm_mullo_epi16(a, _mm_set1_epi16(20));
+    b = _mm_mullo_epi16(b, _mm_set1_epi16(5));
+    return _mm_add_epi16(_mm_sub_epi16(a, b), _mm_add_epi16(s0, s5));
+}
+
+/* Same filter on 16-bit intermediates, 32-bit sums, (sum + 512) >> 10 */
+static __inline __m128i Tap6Mid(__m128i s0, __m128i s1, __m128i s2,
+    __m128i s3, __m128i s4, __m128i s5)
+{
+    const __m128i c01 = _mm_set_epi16(-5, 1, -5, 1, -5, 1, -5, 1);
+    const __m128i c23 = _mm_set1_epi16(20);
+    const __m128i c45 = _mm_set_epi16(1, -5, 1, -5, 1, -5, 1, -5);
+    const __m128i round = _mm_set1_epi32(512);
+    __m128i lo, hi;
+
+    lo = _mm_add_epi32(
+            _mm_madd_epi16(_mm_unpacklo_epi16(s0, s1), c01),
+            _mm_madd_epi16(_mm_unpacklo_epi16(s2, s3), c23));
+    lo = _mm_add_epi32(lo,
+            _mm_madd_epi16(_mm_unpacklo_epi16(s4, s5), c45));
+    hi = _mm_add_epi32(
+            _mm_madd_epi16(_mm_unpackhi_epi16(s0, s1), c01),
+            _mm_madd_epi16(_mm_unpackhi_epi16(s2, s3), c23));
+    hi = _mm_add_epi32(hi,
+            _mm_madd_epi16(_mm_unpackhi_epi16(s4, s5), c45));
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 10);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 10);
+    return _mm_packs_epi32(lo, hi);
+}
+
+/* (v + 16) >> 5 clipped to [0, 255], 16 results */
+static __inline __m128i Round5(__m128i lo, __m128i hi)
+{
+    const __m128i round = _mm_set1_epi16(16);
+
+    lo = _mm_srai_epi16(_mm_add_epi16(lo, round), 5);
+    hi = _mm_srai_epi16(_mm_add_epi16(hi, round), 5);
+    return _mm_packus_epi16(lo, hi);
+}
+
+/* Horizontal 6-tap of n (4 or 8) samples from p[0..n+4], unrounded */
+static __inline __m128i HorTap(const u8 *p, u32 n)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    return Tap6(
+        _mm_unpacklo_epi8(Load(p, n), zero),
+        _mm_unpacklo_epi8(Load(p + 1, n), zero),
+        _mm_unpacklo_epi8(Load(p + 2, n), zero),
+        _mm_unpacklo_epi8(Load(p + 3, n), zero),
+        _mm_unpacklo_epi8(Load(p + 4, n), zero),
+        _mm_unpacklo_epi8(Load(p + 5, n), zero));
+}
+
+/* Vertical 6-tap of n (4 or 8) samples from rows p[0..5*width], unrounded */
+static __inline __m128i VerTap(const u8 *p, u32 width, u32 n)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    return Tap6(
+        _mm_unpacklo_epi8(Load(p, n), zero),
+        _mm_unpacklo_epi8(Load(p + width, n), zero),
+        _mm_unpacklo_epi8(Load(p + width*2, n), zero),
+        _mm_unpacklo_epi8(Load(p + width*3, n), zero),
+        _mm_unpacklo_epi8(Load(p + width*4, n), zero),
+        _mm_unpacklo_epi8(Load(p + width*5, n), zero));
+}
+
+/* Half sample 'b' for n (4, 8 or 16) pixels of a row */
+static __inline __m128i HorHalf(const u8 *p, u32 n)
+{
+    __m128i lo;
+
+    if (n == 16)
+        return Round5(HorTap(p, 8), HorTap(p + 8, 8));
+    lo = HorTap(p, n);
+    return Round5(lo, lo);
+}
+
+/* Half sample 'h' for n (4, 8 or 16) pixels of a row */
+static __inline __m128i VerHalf(const u8 *p, u32 width, u32 n)
+{
+    __m128i lo;
+
+    if (n == 16)
+        return Round5(VerTap(p, width, 8), VerTap(p + 8, width, 8));
+    lo = VerTap(p, width, n);
+    return Round5(lo, lo);
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateChromaHor
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c. One row of
+          up to eight pixels per iteration.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateChromaHor(
+  u8 *pRef,
+  u8 *predPartChroma,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 xFrac,
+  u32 chromaPartWidth,
+  u32 chromaPartHeight)
+{
+
+/* Variables */
+
+    u32 y, comp;
+    u8 *ptrA, *cbr;
+    u8 block[9*8*2];
+    const __m128i zero = _mm_setzero_si128();
+    __m128i wA, wB, a, b;
+
+/* Code */
+
+    ASSERT(predPartChroma);
+    ASSERT(chromaPartWidth);
+    ASSERT(chromaPartHeight);
+    ASSERT(xFrac < 8);
+    ASSERT(pRef);
+
+    if ((x0 < 0) || ((u32)x0+chromaPartWidth+1 > width) ||
+        (y0 < 0) || ((u32)y0+chromaPartHeight > height))
+    {
+        h264bsdFillBlock(pRef, block, x0, y0, width, height,
+            chromaPartWidth + 1, chromaPartHeight, chromaPartWidth + 1);
+        pRef += width * height;
+        h264bsdFillBlock(pRef, block + (chromaPartWidth+1)*chromaPartHeight,
+            x0, y0, width, height, chromaPartWidth + 1,
+            chromaPartHeight, chromaPartWidth + 1);
+
+        pRef = block;
+        x0 = 0;
+        y0 = 0;
+        width = chromaPartWidth+1;
+        height = chromaPartHeight;
+    }
+
+    /* ((8-xFrac)*A + xFrac*B) * 8 + 32 >> 6, weights scaled by 8 */
+    wA = _mm_set1_epi16((i16)((8 - xFrac) << 3));
+    wB = _mm_set1_epi16((i16)(xFrac << 3));
+
+    for (comp = 0; comp <= 1; comp++)
+    {
+        ptrA = pRef + (comp * height + (u32)y0) * width + x0;
+        cbr = predPartChroma + comp * 8 * 8;
+
+        for (y = chromaPartHeight; y; y--)
+        {
+            a = _mm_unpacklo_epi8(Load(ptrA, chromaPartWidth), zero);
+            b = _mm_unpacklo_epi8(Load(ptrA + 1, chromaPartWidth), zero);
+            a = _mm_add_epi16(_mm_mullo_epi16(a, wA), _mm_mullo_epi16(b, wB));
+            a = _mm_srli_epi16(_mm_add_epi16(a, _mm_set1_epi16(32)), 6);
+            Store(cbr, _mm_packus_epi16(a, a), chromaPartWidth);
+            cbr += 8;
+            ptrA += width;
+        }
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateChromaVer
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c. One row of
+          up to eight pixels per iteration.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateChromaVer(
+  u8 *pRef,
+  u8 *predPartChroma,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 yFrac,
+  u32 chromaPartWidth,
+  u32 chromaPartHeight)
+{
+
+/* Variables */
+
+    u32 y, comp;
+    u8 *ptrA, *cbr;
+    u8 block[9*8*2];
+    const __m128i zero = _mm_setzero_si128();
+    __m128i wA, wB, a, b;
+
+/* Code */
+
+    ASSERT(predPartChroma);
+    ASSERT(chromaPartWidth);
+    ASSERT(chromaPartHeight);
+    ASSERT(yFrac < 8);
+    ASSERT(pRef);
+
+    if ((x0 < 0) || ((u32)x0+chromaPartWidth > width) ||
+        (y0 < 0) || ((u32)y0+chromaPartHeight+1 > height))
+    {
+        h264bsdFillBlock(pRef, block, x0, y0, width, height, chromaPartWidth,
+            chromaPartHeight + 1, chromaPartWidth);
+        pRef += width * height;
+        h264bsdFillBlock(pRef, block + chromaPartWidth*(chromaPartHeight+1),
+            x0, y0, width, height, chromaPartWidth,
+            chromaPartHeight + 1, chromaPartWidth);
+
+        pRef = block;
+        x0 = 0;
+        y0 = 0;
+        width = chromaPartWidth;
+        height = chromaPartHeight+1;
+    }
+
+    wA = _mm_set1_epi16((i16)((8 - yFrac) << 3));
+    wB = _mm_set1_epi16((i16)(yFrac << 3));
+
+    for (comp = 0; comp <= 1; comp++)
+    {
+        ptrA = pRef + (comp * height + (u32)y0) * width + x0;
+        cbr = predPartChroma + comp * 8 * 8;
+
+        b = _mm_unpacklo_epi8(Load(ptrA, chromaPartWidth), zero);
+        for (y = chromaPartHeight; y; y--)
+        {
+            ptrA += width;
+            a = b;
+            b = _mm_unpacklo_epi8(Load(ptrA, chromaPartWidth), zero);
+            a = _mm_add_epi16(_mm_mullo_epi16(a, wA), _mm_mullo_epi16(b, wB));
+            a = _mm_srli_epi16(_mm_add_epi16(a, _mm_set1_epi16(32)), 6);
+            Store(cbr, _mm_packus_epi16(a, a), chromaPartWidth);
+            cbr += 8;
+        }
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateChromaHorVer
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c. The four
+          bilinear weights sum to 64 so the weighted sum fits in 16 bits.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateChromaHorVer(
+  u8 *ref,
+  u8 *predPartChroma,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 xFrac,
+  u32 yFrac,
+  u32 chromaPartWidth,
+  u32 chromaPartHeight)
+{
+    u8 block[9*9*2];
+    u32 y, comp;
+    u8 *ptrA, *cbr;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i wA, wB, wC, wD, a, b, c, d, sum;
+
+/* Code */
+
+    ASSERT(predPartChroma);
+    ASSERT(chromaPartWidth);
+    ASSERT(chromaPartHeight);
+    ASSERT(xFrac < 8);
+    ASSERT(yFrac < 8);
+    ASSERT(ref);
+
+    if ((x0 < 0) || ((u32)x0+chromaPartWidth+1 > width) ||
+        (y0 < 0) || ((u32)y0+chromaPartHeight+1 > height))
+    {
+        h264bsdFillBlock(ref, block, x0, y0, width, height,
+            chromaPartWidth + 1, chromaPartHeight + 1, chromaPartWidth + 1);
+        ref += width * height;
+        h264bsdFillBlock(ref, block + (chromaPartWidth+1)*(chromaPartHeight+1),
+            x0, y0, width, height, chromaPartWidth + 1,
+            chromaPartHeight + 1, chromaPartWidth + 1);
+
+        ref = block;
+        x0 = 0;
+        y0 = 0;
+        width = chromaPartWidth+1;
+        height = chromaPartHeight+1;
+    }
+
+    wA = _mm_set1_epi16((i16)((8 - xFrac) * (8 - yFrac)));
+    wB = _mm_set1_epi16((i16)(xFrac * (8 - yFrac)));
+    wC = _mm_set1_epi16((i16)((8 - xFrac) * yFrac));
+    wD = _mm_set1_epi16((i16)(xFrac * yFrac));
+
+    for (comp = 0; comp <= 1; comp++)
+    {
+        ptrA = ref + (comp * height + (u32)y0) * width + x0;
+        cbr = predPartChroma + comp * 8 * 8;
+
+        c = _mm_unpacklo_epi8(Load(ptrA, chromaPartWidth), zero);
+        d = _mm_unpacklo_epi8(Load(ptrA + 1, chromaPartWidth), zero);
+        for (y = chromaPartHeight; y; y--)
+        {
+            ptrA += width;
+            a = c;
+            b = d;
+            c = _mm_unpacklo_epi8(Load(ptrA, chromaPartWidth), zero);
+            d = _mm_unpacklo_epi8(Load(ptrA + 1, chromaPartWidth), zero);
+            sum = _mm_add_epi16(
+                    _mm_add_epi16(_mm_mullo_epi16(a, wA),
+                                  _mm_mullo_epi16(b, wB)),
+                    _mm_add_epi16(_mm_mullo_epi16(c, wC),
+                                  _mm_mullo_epi16(d, wD)));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(32)), 6);
+            Store(cbr, _mm_packus_epi16(sum, sum), chromaPartWidth);
+            cbr += 8;
+        }
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateVerHalf
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateVerHalf(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight)
+{
+    u32 p1[21*21/4+1];
+    u32 y;
+
+    /* Code */
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    if ((x0 < 0) || ((u32)x0+partWidth > width) ||
+        (y0 < 0) || ((u32)y0+partHeight+5 > height))
+    {
+        h264bsdFillBlock(ref, (u8*)p1, x0, y0, width, height,
+                partWidth, partHeight+5, partWidth);
+
+        x0 = 0;
+        y0 = 0;
+        ref = (u8*)p1;
+        width = partWidth;
+    }
+
+    ref += (u32)y0 * width + (u32)x0;
+
+    for (y = partHeight; y; y--)
+    {
+        Store(mb, VerHalf(ref, width, partWidth), partWidth);
+        ref += width;
+        mb += 16;
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateVerQuarter
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateVerQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 verOffset)    /* 0 for pixel d, 1 for pixel n */
+{
+    u32 p1[21*21/4+1];
+    u32 y;
+    u8 *ptrInt;
+
+    /* Code */
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    if ((x0 < 0) || ((u32)x0+partWidth > width) ||
+        (y0 < 0) || ((u32)y0+partHeight+5 > height))
+    {
+        h264bsdFillBlock(ref, (u8*)p1, x0, y0, width, height,
+                partWidth, partHeight+5, partWidth);
+
+        x0 = 0;
+        y0 = 0;
+        ref = (u8*)p1;
+        width = partWidth;
+    }
+
+    ref += (u32)y0 * width + (u32)x0;
+
+    /* Pointer to integer sample position, either M or R */
+    ptrInt = ref + (2+verOffset)*width;
+
+    for (y = partHeight; y; y--)
+    {
+        Store(mb, _mm_avg_epu8(VerHalf(ref, width, partWidth),
+                               Load(ptrInt, partWidth)), partWidth);
+        ref += width;
+        ptrInt += width;
+        mb += 16;
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateHorHalf
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateHorHalf(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight)
+{
+    u32 p1[21*21/4+1];
+    u32 y;
+
+    /* Code */
+
+    ASSERT(ref);
+    ASSERT(mb);
+    ASSERT((partWidth&0x3) == 0);
+    ASSERT((partHeight&0x3) == 0);
+
+    if ((x0 < 0) || ((u32)x0+partWidth+5 > width) ||
+        (y0 < 0) || ((u32)y0+partHeight > height))
+    {
+        h264bsdFillBlock(ref, (u8*)p1, x0, y0, width, height,
+                partWidth+5, partHeight, partWidth+5);
+
+        x0 = 0;
+        y0 = 0;
+        ref = (u8*)p1;
+        width = partWidth + 5;
+    }
+
+    ref += (u32)y0 * width + (u32)x0;
+
+    for (y = partHeight; y; y--)
+    {
+        Store(mb, HorHalf(ref, partWidth), partWidth);
+        ref += width;
+        mb += 16;
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateHorQuarter
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateHorQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 horOffset) /* 0 for pixel a, 1 for pixel c */
+{
+    u32 p1[21*21/4+1];
+    u32 y;
+
+    /* Code */
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    if ((x0 < 0) || ((u32)x0+partWidth+5 > width) ||
+        (y0 < 0) || ((u32)y0+partHeight > height))
+    {
+        h264bsdFillBlock(ref, (u8*)p1, x0, y0, width, height,
+                partWidth+5, partHeight, partWidth+5);
+
+        x0 = 0;
+        y0 = 0;
+        ref = (u8*)p1;
+        width = partWidth + 5;
+    }
+
+    ref += (u32)y0 * width + (u32)x0;
+
+    for (y = partHeight; y; y--)
+    {
+        Store(mb, _mm_avg_epu8(HorHalf(ref, partWidth),
+                               Load(ref + 2 + horOffset, partWidth)),
+              partWidth);
+        ref += width;
+        mb += 16;
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateHorVerQuarter
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateHorVerQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 horVerOffset) /* 0 for pixel e, 1 for pixel g,
+                       2 for pixel p, 3 for pixel r */
+{
+    u32 p1[21*21/4+1];
+    u8 *ptrJ, *ptrC;
+    u32 y;
+
+    /* Code */
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    if ((x0 < 0) || ((u32)x0+partWidth+5 > width) ||
+        (y0 < 0) || ((u32)y0+partHeight+5 > height))
+    {
+        h264bsdFillBlock(ref, (u8*)p1, x0, y0, width, height,
+                partWidth+5, partHeight+5, partWidth+5);
+
+        x0 = 0;
+        y0 = 0;
+        ref = (u8*)p1;
+        width = partWidth+5;
+    }
+
+    /* Ref points to G + (-2, -2) */
+    ref += (u32)y0 * width + (u32)x0;
+
+    /* ptrJ points to the row of either b or s, depending on vertical
+     * offset, ptrC to the column of either h or m */
+    ptrJ = ref + (((horVerOffset & 0x2) >> 1) + 2) * width;
+    ptrC = ref + 2 + (horVerOffset & 0x1);
+
+    for (y = partHeight; y; y--)
+    {
+        Store(mb, _mm_avg_epu8(HorHalf(ptrJ, partWidth),
+                               VerHalf(ptrC, width, partWidth)), partWidth);
+        ptrJ += width;
+        ptrC += width;
+        mb += 16;
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateMidHalf
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c. The
+          horizontal intermediates are kept in 16 bits, the vertical pass
+          sums them in 32 bits.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateMidHalf(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight)
+{
+    u32 p1[21*21/4+1];
+    u32 x, y, n;
+    i16 table[21*16];
+    i16 *ptr;
+    __m128i res[2];
+
+    /* Code */
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    if ((x0 < 0) || ((u32)x0+partWidth+5 > width) ||
+        (y0 < 0) || ((u32)y0+partHeight+5 > height))
+    {
+        h264bsdFillBlock(ref, (u8*)p1, x0, y0, width, height,
+                partWidth+5, partHeight+5, partWidth+5);
+
+        x0 = 0;
+        y0 = 0;
+        ref = (u8*)p1;
+        width = partWidth+5;
+    }
+
+    ref += (u32)y0 * width + (u32)x0;
+
+    /* First step: horizontal intermediates for partHeight+5 rows */
+    n = partWidth < 8 ? partWidth : 8;
+    for (y = 0, ptr = table; y < partHeight + 5; y++, ptr += 16)
+    {
+        for (x = 0; x < partWidth; x += 8)
+            _mm_storeu_si128((__m128i *)(ptr + x), HorTap(ref + x, n));
+        ref += width;
+    }
+
+    /* Second step: vertical interpolation */
+    for (y = partHeight, ptr = table; y; y--, ptr += 16)
+    {
+        for (x = 0; x < partWidth; x += 8)
+            res[x >> 3] = Tap6Mid(
+                Load16Bit(ptr + x, n), Load16Bit(ptr + x + 16, n),
+                Load16Bit(ptr + x + 32, n), Load16Bit(ptr + x + 48, n),
+                Load16Bit(ptr + x + 64, n), Load16Bit(ptr + x + 80, n));
+        if (partWidth < 16)
+            res[1] = res[0];
+        Store(mb, _mm_packus_epi16(res[0], res[1]), partWidth);
+        mb += 16;
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateMidVerQuarter
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateMidVerQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 verOffset)    /* 0 for pixel f, 1 for pixel q */
+{
+    u32 p1[21*21/4+1];
+    u32 x, y, n;
+    i16 table[21*16];
+    i16 *ptr, *ptrInt;
+    __m128i res[2], half[2];
+
+    /* Code */
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    if ((x0 < 0) || ((u32)x0+partWidth+5 > width) ||
+        (y0 < 0) || ((u32)y0+partHeight+5 > height))
+    {
+        h264bsdFillBlock(ref, (u8*)p1, x0, y0, width, height,
+                partWidth+5, partHeight+5, partWidth+5);
+
+        x0 = 0;
+        y0 = 0;
+        ref = (u8*)p1;
+        width = partWidth+5;
+    }
+
+    ref += (u32)y0 * width + (u32)x0;
+
+    /* First step: horizontal intermediates for partHeight+5 rows */
+    n = partWidth < 8 ? partWidth : 8;
+    for (y = 0, ptr = table; y < partHeight + 5; y++, ptr += 16)
+    {
+        for (x = 0; x < partWidth; x += 8)
+            _mm_storeu_si128((__m128i *)(ptr + x), HorTap(ref + x, n));
+        ref += width;
+    }
+
+    /* Second step: vertical interpolation and average with the half sample
+     * of row b or s */
+    ptrInt = table + (2+verOffset)*16;
+    for (y = partHeight, ptr = table; y; y--, ptr += 16, ptrInt += 16)
+    {
+        for (x = 0; x < partWidth; x += 8)
+        {
+            res[x >> 3] = Tap6Mid(
+                Load16Bit(ptr + x, n), Load16Bit(ptr + x + 16, n),
+                Load16Bit(ptr + x + 32, n), Load16Bit(ptr + x + 48, n),
+                Load16Bit(ptr + x + 64, n), Load16Bit(ptr + x + 80, n));
+            half[x >> 3] = Load16Bit(ptrInt + x, n);
+        }
+        if (partWidth < 16)
+        {
+            res[1] = res[0];
+            half[1] = half[0];
+        }
+        Store(mb, _mm_avg_epu8(_mm_packus_epi16(res[0], res[1]),
+                               Round5(half[0], half[1])), partWidth);
+        mb += 16;
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInterpolateMidHorQuarter
+
+        Functional description:
+          SSE2 version of the function in h264bsd_reconstruct.c.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateMidHorQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 horOffset)    /* 0 for pixel i, 1 for pixel k */
+{
+    u32 p1[21*21/4+1];
+    u32 x, y, n;
+    u32 tableWidth = partWidth + 5;
+    i16 table[16*24];
+    i16 *ptr;
+    __m128i res[2], half[2];
+
+    /* Code */
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    if ((x0 < 0) || ((u32)x0+partWidth+5 > width) ||
+        (y0 < 0) || ((u32)y0+partHeight+5 > height))
+    {
+        h264bsdFillBlock(ref, (u8*)p1, x0, y0, width, height,
+                partWidth+5, partHeight+5, partWidth+5);
+
+        x0 = 0;
+        y0 = 0;
+        ref = (u8*)p1;
+        width = partWidth+5;
+    }
+
+    ref += (u32)y0 * width + (u32)x0;
+
+    /* First step: vertical intermediates for partWidth+5 columns, eight
+     * at a time, the last eight overlapping the previous ones */
+    for (y = 0, ptr = table; y < partHeight; y++, ptr += 24)
+    {
+        for (x = 0; x + 8 < tableWidth; x += 8)
+            _mm_storeu_si128((__m128i *)(ptr + x), VerTap(ref + x, width, 8));
+        x = tableWidth - 8;
+        _mm_storeu_si128((__m128i *)(ptr + x), VerTap(ref + x, width, 8));
+        ref += width;
+    }
+
+    /* Second step: horizontal interpolation and average with the half sample
+     * of column h or m */
+    n = partWidth < 8 ? partWidth : 8;
+    for (y = partHeight, ptr = table; y; y--, ptr += 24)
+    {
+        for (x = 0; x < partWidth; x += 8)
+        {
+            res[x >> 3] = Tap6Mid(
+                Load16Bit(ptr + x, n), Load16Bit(ptr + x + 1, n),
+                Load16Bit(ptr + x + 2, n), Load16Bit(ptr + x + 3, n),
+                Load16Bit(ptr + x + 4, n), Load16Bit(ptr + x + 5, n));
+            half[x >> 3] = Load16Bit(ptr + x + 2 + horOffset, n);
+        }
+        if (partWidth < 16)
+        {
+            res[1] = res[0];
+            half[1] = half[0];
+        }
+        Store(mb, _mm_avg_epu8(_mm_packus_epi16(res[0], res[1]),
+                               Round5(half[0], half[1])), partWidth);
+        mb += 16;
+    }
+
+}
+
@@ -18,27 +18,144 @@
 #define LOG_TAG "ColorConverter"
 #include <utils/Log.h>
 
+#include <sys/prctl.h>
+
+#include <cutils/atomic.h>
 #include <media/stagefright/ColorConverter.h>
 #include <media/stagefright/MediaDebug.h>
 #include <media/stagefright/MediaErrors.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace android {
 
+// Where the rows of the source crop are and where they go.
+struct ColorConverter::Layout {
+    size_t mWidth, mHeight;
+
+    // The first rows of the planes. A chroma sample covers two pixels
+    // of a row, and a chroma row (1 << mChromaShift) rows.
+    const uint8_t *mY, *mU, *mV;
+    size_t mYStride, mChromaStride;
+    size_t mYStep, mChromaStep;
+    size_t mChromaShift;
+
+    // Luma and chroma alternate in the rows, which start at mU.
+    bool mPacked;
+
+    // The red and blue values trade places.
+    bool mSwapRB;
+
+    uint8_t *mDst;
+    size_t mDstStride;
+};
+
+// Rows of luma and chroma separated for the vector code.
+struct ColorConverter::Rows {
+    Rows();
+    ~Rows();
+
+    void reserve(size_t width);
+
+    size_t mWidth;
+    uint8_t *mY, *mU, *mV, *mChroma;
+    ssize_t mChromaRow;
+};
+
+struct ColorConverter::Worker {
+    ColorConverter *mConverter;
+    pthread_t mThread;
+    int32_t mGeneration;
+    Rows mRows;
+};
+
+ColorConverter::Rows::Rows()
+    : mWidth(0),
+      mY(NULL),
+      mU(NULL),
+      mV(NULL),
+      mChroma(NULL),
+      mChromaRow(-1) {
+}
+
+ColorConverter::Rows::~Rows() {
+    delete[] mY;
+    delete[] mU;
+    delete[] mV;
+    delete[] mChroma;
+}
+
+void ColorConverter::Rows::reserve(size_t width) {
+    mChromaRow = -1;
+    if (width <= mWidth) {
+        return;
+    }
+
+    delete[] mY;
+    delete[] mU;
+    delete[] mV;
+    delete[] mChroma;
+
+    // Odd widths convert the pixel past the end, and packed rows hold
+    // as many chroma samples as pixels.
+    mWidth = width;
+    mY = new uint8_t[width + 2];
+    mU = new uint8_t[width / 2 + 1];
+    mV = new uint8_t[width / 2 + 1];
+    mChroma = new uint8_t[width + 2];
+}
+
 ColorConverter::ColorConverter(
         OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to)
     : mSrcFormat(from),
       mDstFormat(to),
-      mClip(NULL) {
+      mClip(NULL),
+      mScalarOnly(false),
+      mNumThreads(1),
+      mRows(new Rows),
+      mLayout(NULL),
+      mBandHeight(0),
+      mNumBands(0),
+      mNextBand(0),
+      mNumBusyWorkers(0),
+      mGeneration(0),
+      mExiting(false) {
 }
 
 ColorConverter::~ColorConverter() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mExiting = true;
+        mWorkCondition.broadcast();
+    }
+
+    for (size_t i = 0; i < mWorkers.size(); ++i) {
+        void *dummy;
+        pthread_join(mWorkers[i]->mThread, &dummy);
+        delete mWorkers[i];
+    }
+    mWorkers.clear();
+
+    delete mRows;
+    mRows = NULL;
+
     delete[] mClip;
     mClip = NULL;
 }
 
 bool ColorConverter::isValid() const {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
-        return false;
+    switch (mDstFormat) {
+        case OMX_COLOR_Format16bitRGB565:
+        case OMX_COLOR_Format32bitARGB8888:
+        case OMX_COLOR_Format32BitRGBA8888:
+            break;
+
+        default:
+            return false;
     }
 
     switch (mSrcFormat) {
@@ -54,6 +171,14 @@ bool ColorConverter::isValid() const {
     }
 }
 
+void ColorConverter::setNumThreads(size_t numThreads) {
+    mNumThreads = numThreads > 0 ? numThreads : 1;
+}
+
+void ColorConverter::setScalarOnly(bool scalarOnly) {
+    mScalarOnly = scalarOnly;
+}
+
 ColorConverter::BitmapParams::BitmapParams(
         void *bits,
         size_t width, size_t height,
@@ -85,7 +210,7 @@ status_t ColorConverter::convert(
         size_t dstWidth, size_t dstHeight,
         size_t dstCropLeft, size_t dstCropTop,
         size_t dstCropRight, size_t dstCropBottom) {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
+    if (!isValid()) {
         return ERROR_UNSUPPORTED;
     }
 
@@ -132,64 +257,48 @@ status_t ColorConverter::convert(
     return err;
 }
 
+static size_t bytesPerPixel(OMX_COLOR_FORMATTYPE format) {
+    return format == OMX_COLOR_Format16bitRGB565 ? 2 : 4;
+}
+
+static uint8_t *dstStart(
+        void *bits, size_t width, size_t cropLeft, size_t cropTop,
+        OMX_COLOR_FORMATTYPE format) {
+    return (uint8_t *)bits
+        + (cropTop * width + cropLeft) * bytesPerPixel(format);
+}
+
 status_t ColorConverter::convertCbYCrY(
         const BitmapParams &src, const BitmapParams &dst) {
     // XXX Untested
 
-    uint8_t *kAdjustedClip = initClip();
-
     if (!((src.mCropLeft & 1) == 0
         && src.cropWidth() == dst.cropWidth()
         && src.cropHeight() == dst.cropHeight())) {
         return ERROR_UNSUPPORTED;
     }
 
-    uint32_t *dst_ptr = (uint32_t *)dst.mBits
-        + (dst.mCropTop * dst.mWidth + dst.mCropLeft) / 2;
-
     const uint8_t *src_ptr = (const uint8_t *)src.mBits
         + (src.mCropTop * dst.mWidth + src.mCropLeft) * 2;
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_ptr[2 * x + 1] - 16;
-            signed y2 = (signed)src_ptr[2 * x + 3] - 16;
-            signed u = (signed)src_ptr[2 * x] - 128;
-            signed v = (signed)src_ptr[2 * x + 2] - 128;
-
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
-
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
-
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
-
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
-
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
-
-            dst_ptr[x / 2] = (rgb2 << 16) | rgb1;
-        }
-
-        src_ptr += src.mWidth * 2;
-        dst_ptr += dst.mWidth / 2;
-    }
-
-    return OK;
+    Layout layout;
+    layout.mWidth = src.cropWidth();
+    layout.mHeight = src.cropHeight();
+    layout.mY = src_ptr + 1;
+    layout.mU = src_ptr;
+    layout.mV = src_ptr + 2;
+    layout.mYStride = src.mWidth * 2;
+    layout.mChromaStride = src.mWidth * 2;
+    layout.mYStep = 2;
+    layout.mChromaStep = 4;
+    layout.mChromaShift = 0;
+    layout.mPacked = true;
+    layout.mSwapRB = false;
+    layout.mDst = dstStart(
+            dst.mBits, dst.mWidth, dst.mCropLeft, dst.mCropTop, mDstFormat);
+    layout.mDstStride = dst.mWidth * bytesPerPixel(mDstFormat);
+
+    return convertFrame(layout);
 }
 
 status_t ColorConverter::convertYUV420Planar(
@@ -200,11 +309,6 @@ status_t ColorConverter::convertYUV420Planar(
         return ERROR_UNSUPPORTED;
     }
 
-    uint8_t *kAdjustedClip = initClip();
-
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
-
     const uint8_t *src_y =
         (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
 
@@ -215,80 +319,65 @@ status_t ColorConverter::convertYUV420Planar(
     const uint8_t *src_v =
         src_u + (src.mWidth / 2) * (src.mHeight / 2);
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            // B = 1.164 * (Y - 16) + 2.018 * (U - 128)
-            // G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128)
-            // R = 1.164 * (Y - 16) + 1.596 * (V - 128)
-
-            // B = 298/256 * (Y - 16) + 517/256 * (U - 128)
-            // G = .................. - 208/256 * (V - 128) - 100/256 * (U - 128)
-            // R = .................. + 409/256 * (V - 128)
-
-            // min_B = (298 * (- 16) + 517 * (- 128)) / 256 = -277
-            // min_G = (298 * (- 16) - 208 * (255 - 128) - 100 * (255 - 128)) / 256 = -172
-            // min_R = (298 * (- 16) + 409 * (- 128)) / 256 = -223
-
-            // max_B = (298 * (255 - 16) + 517 * (255 - 128)) / 256 = 534
-            // max_G = (298 * (255 - 16) - 208 * (- 128) - 100 * (- 128)) / 256 = 432
-            // max_R = (298 * (255 - 16) + 409 * (255 - 128)) / 256 = 481
-
-            // clip range -278 .. 535
-
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
-
-            signed u = (signed)src_u[x / 2] - 128;
-            signed v = (signed)src_v[x / 2] - 128;
-
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
-
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
-
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
-
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
-
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
-
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+    Layout layout;
+    layout.mWidth = src.cropWidth();
+    layout.mHeight = src.cropHeight();
+    layout.mY = src_y;
+    layout.mU = src_u;
+    layout.mV = src_v;
+    layout.mYStride = src.mWidth;
+    layout.mChromaStride = src.mWidth / 2;
+    layout.mYStep = 1;
+    layout.mChromaStep = 1;
+    layout.mChromaShift = 1;
+    layout.mPacked = false;
+    layout.mSwapRB = false;
+    layout.mDst = dstStart(
+            dst.mBits, dst.mWidth, dst.mCropLeft, dst.mCropTop, mDstFormat);
+    layout.mDstStride = dst.mWidth * bytesPerPixel(mDstFormat);
+
+    return convertFrame(layout);
+}
 
-        src_y += src.mWidth;
+status_t ColorConverter::convertQCOMYUV420SemiPlanar(
+        const BitmapParams &src, const BitmapParams &dst) {
+    if (!((dst.mWidth & 3) == 0
+            && (src.mCropLeft & 1) == 0
+            && src.cropWidth() == dst.cropWidth()
+            && src.cropHeight() == dst.cropHeight())) {
+        return ERROR_UNSUPPORTED;
+    }
 
-        if (y & 1) {
-            src_u += src.mWidth / 2;
-            src_v += src.mWidth / 2;
-        }
+    const uint8_t *src_y =
+        (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
 
-        dst_ptr += dst.mWidth;
-    }
+    const uint8_t *src_u =
+        (const uint8_t *)src_y + src.mWidth * src.mHeight
+        + src.mCropTop * src.mWidth + src.mCropLeft;
 
-    return OK;
+    Layout layout;
+    layout.mWidth = src.cropWidth();
+    layout.mHeight = src.cropHeight();
+    layout.mY = src_y;
+    layout.mU = src_u;
+    layout.mV = src_u + 1;
+    layout.mYStride = src.mWidth;
+    layout.mChromaStride = src.mWidth;
+    layout.mYStep = 1;
+    layout.mChromaStep = 2;
+    layout.mChromaShift = 1;
+    layout.mPacked = false;
+    layout.mSwapRB = true;
+    layout.mDst = dstStart(
+            dst.mBits, dst.mWidth, dst.mCropLeft, dst.mCropTop, mDstFormat);
+    layout.mDstStride = dst.mWidth * bytesPerPixel(mDstFormat);
+
+    return convertFrame(layout);
 }
 
-status_t ColorConverter::convertQCOMYUV420SemiPlanar(
+status_t ColorConverter::convertYUV420SemiPlanar(
         const BitmapParams &src, const BitmapParams &dst) {
-    uint8_t *kAdjustedClip = initClip();
+    // XXX Untested
 
     if (!((dst.mWidth & 3) == 0
             && (src.mCropLeft & 1) == 0
@@ -297,9 +386,6 @@ status_t ColorConverter::convertQCOMYUV420SemiPlanar(
         return ERROR_UNSUPPORTED;
     }
 
-    uint32_t *dst_ptr = (uint32_t *)dst.mBits
-        + (dst.mCropTop * dst.mWidth + dst.mCropLeft) / 2;
-
     const uint8_t *src_y =
         (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
 
@@ -307,190 +393,585 @@ status_t ColorConverter::convertQCOMYUV420SemiPlanar(
         (const uint8_t *)src_y + src.mWidth * src.mHeight
         + src.mCropTop * src.mWidth + src.mCropLeft;
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
-
-            signed u = (signed)src_u[x & ~1] - 128;
-            signed v = (signed)src_u[(x & ~1) + 1] - 128;
+    Layout layout;
+    layout.mWidth = src.cropWidth();
+    layout.mHeight = src.cropHeight();
+    layout.mY = src_y;
+    layout.mU = src_u + 1;
+    layout.mV = src_u;
+    layout.mYStride = src.mWidth;
+    layout.mChromaStride = src.mWidth;
+    layout.mYStep = 1;
+    layout.mChromaStep = 2;
+    layout.mChromaShift = 1;
+    layout.mPacked = false;
+    layout.mSwapRB = true;
+    layout.mDst = dstStart(
+            dst.mBits, dst.mWidth, dst.mCropLeft, dst.mCropTop, mDstFormat);
+    layout.mDstStride = dst.mWidth * bytesPerPixel(mDstFormat);
+
+    return convertFrame(layout);
+}
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+status_t ColorConverter::convertTIYUV420PackedSemiPlanar(
+        const BitmapParams &src, const BitmapParams &dst) {
+    if (!((dst.mWidth & 3) == 0
+            && (src.mCropLeft & 1) == 0
+            && src.cropWidth() == dst.cropWidth()
+            && src.cropHeight() == dst.cropHeight())) {
+        return ERROR_UNSUPPORTED;
+    }
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+    const uint8_t *src_y = (const uint8_t *)src.mBits;
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+    const uint8_t *src_u =
+        (const uint8_t *)src_y + src.mWidth * (src.mHeight - src.mCropTop / 2);
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[b1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[r1] >> 3);
+    Layout layout;
+    layout.mWidth = src.cropWidth();
+    layout.mHeight = src.cropHeight();
+    layout.mY = src_y;
+    layout.mU = src_u;
+    layout.mV = src_u + 1;
+    layout.mYStride = src.mWidth;
+    layout.mChromaStride = src.mWidth;
+    layout.mYStep = 1;
+    layout.mChromaStep = 2;
+    layout.mChromaShift = 1;
+    layout.mPacked = false;
+    layout.mSwapRB = false;
+    layout.mDst = dstStart(
+            dst.mBits, dst.mWidth, dst.mCropLeft, dst.mCropTop, mDstFormat);
+    layout.mDstStride = dst.mWidth * bytesPerPixel(mDstFormat);
+
+    return convertFrame(layout);
+}
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[b2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[r2] >> 3);
+////////////////////////////////////////////////////////////////////////////////
+
+// B = 1.164 * (Y - 16) + 2.018 * (U - 128)
+// G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128)
+// R = 1.164 * (Y - 16) + 1.596 * (V - 128)
+
+// B = 298/256 * (Y - 16) + 517/256 * (U - 128)
+// G = .................. - 208/256 * (V - 128) - 100/256 * (U - 128)
+// R = .................. + 409/256 * (V - 128)
+
+// min_B = (298 * (- 16) + 517 * (- 128)) / 256 = -277
+// min_G = (298 * (- 16) - 208 * (255 - 128) - 100 * (255 - 128)) / 256 = -172
+// min_R = (298 * (- 16) + 409 * (- 128)) / 256 = -223
+
+// max_B = (298 * (255 - 16) + 517 * (255 - 128)) / 256 = 534
+// max_G = (298 * (255 - 16) - 208 * (- 128) - 100 * (- 128)) / 256 = 432
+// max_R = (298 * (255 - 16) + 409 * (255 - 128)) / 256 = 481
+
+// clip range -278 .. 535
+
+// The vector code shifts instead of dividing, which rounds negative values
+// down instead of towards 0, but they all clip to 0 anyway.
+
+template<OMX_COLOR_FORMATTYPE kDstFormat>
+static inline void writePixel(
+        uint8_t *dst, size_t x, uint8_t r, uint8_t g, uint8_t b) {
+    if (kDstFormat == OMX_COLOR_Format16bitRGB565) {
+        ((uint16_t *)dst)[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    } else if (kDstFormat == OMX_COLOR_Format32bitARGB8888) {
+        dst[4 * x] = b;
+        dst[4 * x + 1] = g;
+        dst[4 * x + 2] = r;
+        dst[4 * x + 3] = 0xff;
+    } else {
+        dst[4 * x] = r;
+        dst[4 * x + 1] = g;
+        dst[4 * x + 2] = b;
+        dst[4 * x + 3] = 0xff;
+    }
+}
 
-            dst_ptr[x / 2] = (rgb2 << 16) | rgb1;
+// Converts the pixels from x on, x is even.
+template<OMX_COLOR_FORMATTYPE kDstFormat>
+static void convertRow_C(
+        const uint8_t *kAdjustedClip,
+        const uint8_t *src_y, size_t yStep,
+        const uint8_t *src_u, const uint8_t *src_v, size_t chromaStep,
+        bool swapRB, uint8_t *dst, size_t x, size_t width) {
+    for (; x < width; x += 2) {
+        signed y1 = (signed)src_y[x * yStep] - 16;
+        signed y2 = (signed)src_y[(x + 1) * yStep] - 16;
+
+        signed u = (signed)src_u[x / 2 * chromaStep] - 128;
+        signed v = (signed)src_v[x / 2 * chromaStep] - 128;
+
+        signed u_b = u * 517;
+        signed u_g = -u * 100;
+        signed v_g = -v * 208;
+        signed v_r = v * 409;
+
+        signed tmp1 = y1 * 298;
+        signed b1 = (tmp1 + u_b) / 256;
+        signed g1 = (tmp1 + v_g + u_g) / 256;
+        signed r1 = (tmp1 + v_r) / 256;
+
+        signed tmp2 = y2 * 298;
+        signed b2 = (tmp2 + u_b) / 256;
+        signed g2 = (tmp2 + v_g + u_g) / 256;
+        signed r2 = (tmp2 + v_r) / 256;
+
+        if (swapRB) {
+            signed tmp = r1;
+            r1 = b1;
+            b1 = tmp;
+
+            tmp = r2;
+            r2 = b2;
+            b2 = tmp;
         }
 
-        src_y += src.mWidth;
+        writePixel<kDstFormat>(
+                dst, x,
+                kAdjustedClip[r1], kAdjustedClip[g1], kAdjustedClip[b1]);
 
-        if (y & 1) {
-            src_u += src.mWidth;
+        if (x + 1 < width) {
+            writePixel<kDstFormat>(
+                    dst, x + 1,
+                    kAdjustedClip[r2], kAdjustedClip[g2], kAdjustedClip[b2]);
         }
-
-        dst_ptr += dst.mWidth / 2;
     }
-
-    return OK;
 }
 
-status_t ColorConverter::convertYUV420SemiPlanar(
-        const BitmapParams &src, const BitmapParams &dst) {
-    // XXX Untested
-
-    uint8_t *kAdjustedClip = initClip();
+#if defined(__ARM_NEON__)
 
-    if (!((dst.mWidth & 3) == 0
-            && (src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
-        return ERROR_UNSUPPORTED;
+// Separates n pairs of bytes.
+static size_t deinterleave(
+        const uint8_t *src, uint8_t *even, uint8_t *odd, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t pairs = vld2q_u8(src + 2 * i);
+        vst1q_u8(even + i, pairs.val[0]);
+        vst1q_u8(odd + i, pairs.val[1]);
     }
+    return i;
+}
 
-    uint32_t *dst_ptr = (uint32_t *)dst.mBits
-        + (dst.mCropTop * dst.mWidth + dst.mCropLeft) / 2;
+// 8 pixels, with the chroma samples already doubled.
+static inline void convert8(
+        uint8x8_t y8, uint8x8_t u8, uint8x8_t v8,
+        uint8x8_t *r, uint8x8_t *g, uint8x8_t *b) {
+    int16x8_t y = vreinterpretq_s16_u16(vsubl_u8(y8, vdup_n_u8(16)));
+    int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(u8, vdup_n_u8(128)));
+    int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(v8, vdup_n_u8(128)));
 
-    const uint8_t *src_y =
-        (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
+    int32x4_t yLo = vmull_n_s16(vget_low_s16(y), 298);
+    int32x4_t yHi = vmull_n_s16(vget_high_s16(y), 298);
 
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * src.mHeight
-        + src.mCropTop * src.mWidth + src.mCropLeft;
+    int32x4_t rLo = vmlal_n_s16(yLo, vget_low_s16(v), 409);
+    int32x4_t rHi = vmlal_n_s16(yHi, vget_high_s16(v), 409);
+
+    int32x4_t gLo = vmlal_n_s16(yLo, vget_low_s16(v), -208);
+    int32x4_t gHi = vmlal_n_s16(yHi, vget_high_s16(v), -208);
+    gLo = vmlal_n_s16(gLo, vget_low_s16(u), -100);
+    gHi = vmlal_n_s16(gHi, vget_high_s16(u), -100);
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
+    int32x4_t bLo = vmlal_n_s16(yLo, vget_low_s16(u), 517);
+    int32x4_t bHi = vmlal_n_s16(yHi, vget_high_s16(u), 517);
+
+    *r = vqmovn_u16(vcombine_u16(vqshrun_n_s32(rLo, 8), vqshrun_n_s32(rHi, 8)));
+    *g = vqmovn_u16(vcombine_u16(vqshrun_n_s32(gLo, 8), vqshrun_n_s32(gHi, 8)));
+    *b = vqmovn_u16(vcombine_u16(vqshrun_n_s32(bLo, 8), vqshrun_n_s32(bHi, 8)));
+}
 
-            signed v = (signed)src_u[x & ~1] - 128;
-            signed u = (signed)src_u[(x & ~1) + 1] - 128;
+template<OMX_COLOR_FORMATTYPE kDstFormat>
+static inline void write8(uint8_t *dst, uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+    if (kDstFormat == OMX_COLOR_Format16bitRGB565) {
+        uint16x8_t rgb = vshll_n_u8(r, 8);
+        rgb = vsriq_n_u16(rgb, vshll_n_u8(g, 8), 5);
+        rgb = vsriq_n_u16(rgb, vshll_n_u8(b, 8), 11);
+        vst1q_u16((uint16_t *)dst, rgb);
+    } else {
+        uint8x8x4_t rgba;
+        if (kDstFormat == OMX_COLOR_Format32bitARGB8888) {
+            rgba.val[0] = b;
+            rgba.val[2] = r;
+        } else {
+            rgba.val[0] = r;
+            rgba.val[2] = b;
+        }
+        rgba.val[1] = g;
+        rgba.val[3] = vdup_n_u8(0xff);
+        vst4_u8(dst, rgba);
+    }
+}
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+// Converts 16 pixels at a time, returns how many pixels were converted.
+template<OMX_COLOR_FORMATTYPE kDstFormat>
+static size_t convertRow_SIMD(
+        const uint8_t *src_y, const uint8_t *src_u, const uint8_t *src_v,
+        bool swapRB, uint8_t *dst, size_t width) {
+    const size_t bpp = kDstFormat == OMX_COLOR_Format16bitRGB565 ? 2 : 4;
+
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t y = vld1q_u8(src_y + x);
+        uint8x8x2_t u = vzip_u8(vld1_u8(src_u + x / 2), vld1_u8(src_u + x / 2));
+        uint8x8x2_t v = vzip_u8(vld1_u8(src_v + x / 2), vld1_u8(src_v + x / 2));
+
+        uint8x8_t r, g, b;
+        convert8(vget_low_u8(y), u.val[0], v.val[0], &r, &g, &b);
+        if (swapRB) {
+            write8<kDstFormat>(dst + x * bpp, b, g, r);
+        } else {
+            write8<kDstFormat>(dst + x * bpp, r, g, b);
+        }
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+        convert8(vget_high_u8(y), u.val[1], v.val[1], &r, &g, &b);
+        if (swapRB) {
+            write8<kDstFormat>(dst + (x + 8) * bpp, b, g, r);
+        } else {
+            write8<kDstFormat>(dst + (x + 8) * bpp, r, g, b);
+        }
+    }
+    return x;
+}
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+#elif defined(__SSE2__)
+
+// Separates n pairs of bytes.
+static size_t deinterleave(
+        const uint8_t *src, uint8_t *even, uint8_t *odd, size_t n) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(even + i), _mm_packus_epi16(
+                _mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        _mm_storeu_si128((__m128i *)(odd + i), _mm_packus_epi16(
+                _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    return i;
+}
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[b1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[r1] >> 3);
+// (a * x + b * y) >> 8 for 8 pairs of x and y.
+static inline __m128i multiplyAdd(__m128i x, __m128i y, __m128i ab) {
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(x, y), ab);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(x, y), ab);
+    return _mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8));
+}
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[b2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[r2] >> 3);
+// 8 pixels in 16 bit lanes, with the chroma samples already doubled.
+static inline void convert8(
+        __m128i y, __m128i u, __m128i v,
+        __m128i *r, __m128i *g, __m128i *b) {
+    const __m128i kR = _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409);
+    const __m128i kB = _mm_setr_epi16(298, 517, 298, 517, 298, 517, 298, 517);
+
+    y = _mm_sub_epi16(y, _mm_set1_epi16(16));
+    u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+    v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+    *r = multiplyAdd(y, v, kR);
+    *b = multiplyAdd(y, u, kB);
+
+    // G needs all three, the chroma part first.
+    const __m128i kUV = _mm_setr_epi16(
+            -100, -208, -100, -208, -100, -208, -100, -208);
+    const __m128i kY = _mm_setr_epi16(298, 0, 298, 0, 298, 0, 298, 0);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi32(
+            _mm_madd_epi16(_mm_unpacklo_epi16(u, v), kUV),
+            _mm_madd_epi16(_mm_unpacklo_epi16(y, zero), kY));
+    __m128i hi = _mm_add_epi32(
+            _mm_madd_epi16(_mm_unpackhi_epi16(u, v), kUV),
+            _mm_madd_epi16(_mm_unpackhi_epi16(y, zero), kY));
+    *g = _mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8));
+}
 
-            dst_ptr[x / 2] = (rgb2 << 16) | rgb1;
+template<OMX_COLOR_FORMATTYPE kDstFormat>
+static inline void write16(uint8_t *dst, __m128i r, __m128i g, __m128i b) {
+    const __m128i zero = _mm_setzero_si128();
+
+    if (kDstFormat == OMX_COLOR_Format16bitRGB565) {
+        // The top 5 bits of red go to the top, and green in the middle
+        // of the 16 bits has its top 6 bits in place shifted by 3.
+        r = _mm_and_si128(r, _mm_set1_epi8(0xf8));
+        g = _mm_and_si128(g, _mm_set1_epi8(0xfc));
+
+        __m128i lo = _mm_or_si128(
+                _mm_or_si128(_mm_unpacklo_epi8(zero, r),
+                        _mm_slli_epi16(_mm_unpacklo_epi8(g, zero), 3)),
+                _mm_srli_epi16(_mm_unpacklo_epi8(b, zero), 3));
+        __m128i hi = _mm_or_si128(
+                _mm_or_si128(_mm_unpackhi_epi8(zero, r),
+                        _mm_slli_epi16(_mm_unpackhi_epi8(g, zero), 3)),
+                _mm_srli_epi16(_mm_unpackhi_epi8(b, zero), 3));
+        _mm_storeu_si128((__m128i *)dst, lo);
+        _mm_storeu_si128((__m128i *)(dst + 16), hi);
+    } else {
+        if (kDstFormat == OMX_COLOR_Format32bitARGB8888) {
+            __m128i tmp = r;
+            r = b;
+            b = tmp;
         }
 
-        src_y += src.mWidth;
+        const __m128i alpha = _mm_set1_epi8(0xff);
+        __m128i rgLo = _mm_unpacklo_epi8(r, g);
+        __m128i rgHi = _mm_unpackhi_epi8(r, g);
+        __m128i baLo = _mm_unpacklo_epi8(b, alpha);
+        __m128i baHi = _mm_unpackhi_epi8(b, alpha);
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(rgLo, baLo));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(rgLo, baLo));
+        _mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(rgHi, baHi));
+        _mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(rgHi, baHi));
+    }
+}
 
-        if (y & 1) {
-            src_u += src.mWidth;
+// Converts 16 pixels at a time, returns how many pixels were converted.
+template<OMX_COLOR_FORMATTYPE kDstFormat>
+static size_t convertRow_SIMD(
+        const uint8_t *src_y, const uint8_t *src_u, const uint8_t *src_v,
+        bool swapRB, uint8_t *dst, size_t width) {
+    const size_t bpp = kDstFormat == OMX_COLOR_Format16bitRGB565 ? 2 : 4;
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y = _mm_loadu_si128((const __m128i *)(src_y + x));
+        __m128i u = _mm_loadl_epi64((const __m128i *)(src_u + x / 2));
+        __m128i v = _mm_loadl_epi64((const __m128i *)(src_v + x / 2));
+        u = _mm_unpacklo_epi8(u, u);
+        v = _mm_unpacklo_epi8(v, v);
+
+        __m128i rLo, gLo, bLo, rHi, gHi, bHi;
+        convert8(_mm_unpacklo_epi8(y, zero), _mm_unpacklo_epi8(u, zero),
+                _mm_unpacklo_epi8(v, zero), &rLo, &gLo, &bLo);
+        convert8(_mm_unpackhi_epi8(y, zero), _mm_unpackhi_epi8(u, zero),
+                _mm_unpackhi_epi8(v, zero), &rHi, &gHi, &bHi);
+
+        __m128i r = _mm_packus_epi16(rLo, rHi);
+        __m128i g = _mm_packus_epi16(gLo, gHi);
+        __m128i b = _mm_packus_epi16(bLo, bHi);
+        if (swapRB) {
+            write16<kDstFormat>(dst + x * bpp, b, g, r);
+        } else {
+            write16<kDstFormat>(dst + x * bpp, r, g, b);
         }
+    }
+    return x;
+}
 
-        dst_ptr += dst.mWidth / 2;
+#endif
+
+template<OMX_COLOR_FORMATTYPE kDstFormat>
+static void convertRow(
+        const uint8_t *kAdjustedClip, bool scalarOnly,
+        const uint8_t *src_y, size_t yStep,
+        const uint8_t *src_u, const uint8_t *src_v, size_t chromaStep,
+        bool swapRB, uint8_t *dst, size_t width) {
+#if defined(__ARM_NEON__) || defined(__SSE2__)
+    if (!scalarOnly && yStep == 1 && chromaStep == 1) {
+        size_t x = convertRow_SIMD<kDstFormat>(
+                src_y, src_u, src_v, swapRB, dst, width);
+
+        convertRow_C<kDstFormat>(
+                kAdjustedClip, src_y, 1, src_u, src_v, 1, swapRB, dst, x,
+                width);
+        return;
     }
+#endif
 
-    return OK;
+    convertRow_C<kDstFormat>(
+            kAdjustedClip, src_y, yStep, src_u, src_v, chromaStep, swapRB, dst,
+            0, width);
 }
 
-status_t ColorConverter::convertTIYUV420PackedSemiPlanar(
-        const BitmapParams &src, const BitmapParams &dst) {
-    uint8_t *kAdjustedClip = initClip();
+void ColorConverter::convertRows(
+        const Layout &layout, size_t firstRow, size_t numRows, Rows *rows) {
+    const uint8_t *kAdjustedClip = mClip + 278;
+
+    rows->reserve(layout.mWidth);
+
+    for (size_t y = firstRow; y < firstRow + numRows; ++y) {
+        const uint8_t *src_y = layout.mY + y * layout.mYStride;
+        size_t yStep = layout.mYStep;
+
+        size_t chromaRow = y >> layout.mChromaShift;
+        const uint8_t *src_u = layout.mU + chromaRow * layout.mChromaStride;
+        const uint8_t *src_v = layout.mV + chromaRow * layout.mChromaStride;
+        size_t chromaStep = layout.mChromaStep;
+
+#if defined(__ARM_NEON__) || defined(__SSE2__)
+        // Separate the planes for the vector code.
+        if (!mScalarOnly && layout.mPacked) {
+            size_t n = (layout.mWidth + 1) & ~1;
+            size_t i = deinterleave(src_u, rows->mChroma, rows->mY, n);
+            for (; i < n; ++i) {
+                rows->mChroma[i] = src_u[2 * i];
+                rows->mY[i] = src_u[2 * i + 1];
+            }
 
-    if (!((dst.mWidth & 3) == 0
-            && (src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
-        return ERROR_UNSUPPORTED;
+            n /= 2;
+            i = deinterleave(rows->mChroma, rows->mU, rows->mV, n);
+            for (; i < n; ++i) {
+                rows->mU[i] = rows->mChroma[2 * i];
+                rows->mV[i] = rows->mChroma[2 * i + 1];
+            }
+
+            src_y = rows->mY;
+            src_u = rows->mU;
+            src_v = rows->mV;
+            yStep = 1;
+            chromaStep = 1;
+        } else if (!mScalarOnly && chromaStep == 2) {
+            bool uFirst = src_u < src_v;
+            if ((ssize_t)chromaRow != rows->mChromaRow) {
+                const uint8_t *src_uv = uFirst ? src_u : src_v;
+                uint8_t *even = uFirst ? rows->mU : rows->mV;
+                uint8_t *odd = uFirst ? rows->mV : rows->mU;
+
+                size_t n = (layout.mWidth + 1) / 2;
+                size_t i = deinterleave(src_uv, even, odd, n);
+                for (; i < n; ++i) {
+                    even[i] = src_uv[2 * i];
+                    odd[i] = src_uv[2 * i + 1];
+                }
+                rows->mChromaRow = chromaRow;
+            }
+
+            src_u = rows->mU;
+            src_v = rows->mV;
+            chromaStep = 1;
+        }
+#endif
+
+        uint8_t *dst = layout.mDst + y * layout.mDstStride;
+
+        switch (mDstFormat) {
+            case OMX_COLOR_Format16bitRGB565:
+                convertRow<OMX_COLOR_Format16bitRGB565>(
+                        kAdjustedClip, mScalarOnly, src_y, yStep,
+                        src_u, src_v, chromaStep, layout.mSwapRB, dst,
+                        layout.mWidth);
+                break;
+
+            case OMX_COLOR_Format32bitARGB8888:
+                convertRow<OMX_COLOR_Format32bitARGB8888>(
+                        kAdjustedClip, mScalarOnly, src_y, yStep,
+                        src_u, src_v, chromaStep, layout.mSwapRB, dst,
+                        layout.mWidth);
+                break;
+
+            default:
+                convertRow<OMX_COLOR_Format32BitRGBA8888>(
+                        kAdjustedClip, mScalarOnly, src_y, yStep,
+                        src_u, src_v, chromaStep, layout.mSwapRB, dst,
+                        layout.mWidth);
+                break;
+        }
     }
+}
 
-    uint32_t *dst_ptr = (uint32_t *)dst.mBits
-        + (dst.mCropTop * dst.mWidth + dst.mCropLeft) / 2;
+////////////////////////////////////////////////////////////////////////////////
 
-    const uint8_t *src_y = (const uint8_t *)src.mBits;
+status_t ColorConverter::convertFrame(const Layout &layout) {
+    initClip();
 
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * (src.mHeight - src.mCropTop / 2);
+    size_t numBands = 1;
+    if (mNumThreads > 1 && layout.mHeight >= 2 * kMinBandHeight) {
+        numBands = layout.mHeight / kMinBandHeight;
+        if (numBands > mNumThreads) {
+            numBands = mNumThreads;
+        }
+    }
+
+    if (numBands == 1) {
+        convertRows(layout, 0, layout.mHeight, mRows);
+        return OK;
+    }
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
+    {
+        Mutex::Autolock autoLock(mLock);
 
-            signed u = (signed)src_u[x & ~1] - 128;
-            signed v = (signed)src_u[(x & ~1) + 1] - 128;
+        while (mWorkers.size() + 1 < numBands) {
+            Worker *worker = new Worker;
+            worker->mConverter = this;
+            worker->mGeneration = mGeneration;
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+            pthread_create(&worker->mThread, &attr, ThreadWrapper, worker);
+            pthread_attr_destroy(&attr);
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+            mWorkers.push(worker);
+        }
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+        // Bands start on even rows, which start chroma rows.
+        mLayout = &layout;
+        mBandHeight = ((layout.mHeight + numBands - 1) / numBands + 1) & ~1;
+        mNumBands = (layout.mHeight + mBandHeight - 1) / mBandHeight;
+        mNextBand = 0;
+        mNumBusyWorkers = mWorkers.size();
+        ++mGeneration;
+        mWorkCondition.broadcast();
+    }
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
+    convertBands(layout, mRows);
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
+    Mutex::Autolock autoLock(mLock);
+    while (mNumBusyWorkers > 0) {
+        mDoneCondition.wait(mLock);
+    }
+    mLayout = NULL;
+
+    return OK;
+}
 
-            dst_ptr[x / 2] = (rgb2 << 16) | rgb1;
+void ColorConverter::convertBands(const Layout &layout, Rows *rows) {
+    for (;;) {
+        int32_t band = android_atomic_inc(&mNextBand);
+        if (band >= mNumBands) {
+            break;
         }
 
-        src_y += src.mWidth;
+        size_t firstRow = band * mBandHeight;
+        size_t numRows = layout.mHeight - firstRow;
+        if (numRows > mBandHeight) {
+            numRows = mBandHeight;
+        }
+        convertRows(layout, firstRow, numRows, rows);
+    }
+}
 
-        if (y & 1) {
-            src_u += src.mWidth;
+// static
+void *ColorConverter::ThreadWrapper(void *me) {
+    Worker *worker = static_cast<Worker *>(me);
+    worker->mConverter->threadFunc(worker);
+    return NULL;
+}
+
+void ColorConverter::threadFunc(Worker *worker) {
+    prctl(PR_SET_NAME, (unsigned long)"ColorConverter", 0, 0, 0);
+
+    Mutex::Autolock autoLock(mLock);
+    for (;;) {
+        while (!mExiting && mGeneration == worker->mGeneration) {
+            mWorkCondition.wait(mLock);
+        }
+        if (mExiting) {
+            break;
         }
+        worker->mGeneration = mGeneration;
+        const Layout *layout = mLayout;
 
-        dst_ptr += dst.mWidth / 2;
-    }
+        mLock.unlock();
+        convertBands(*layout, &worker->mRows);
+        mLock.lock();
 
-    return OK;
+        if (--mNumBusyWorkers == 0) {
+            mDoneCondition.signal();
+        }
+    }
 }
 
 uint8_t *ColorConverter::initClip() {
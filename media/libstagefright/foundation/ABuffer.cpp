@@ -40,6 +40,18 @@ ABuffer::ABuffer(void *data, size_t capacity)
       mOwnsData(false) {
 }
 
+ABuffer::ABuffer(const sp<ABuffer> &parent, size_t offset, size_t size)
+    : mParent(parent),
+      mData(parent->base() + offset),
+      mCapacity(size),
+      mRangeOffset(0),
+      mRangeLength(size),
+      mInt32Data(0),
+      mOwnsData(false) {
+    CHECK_LE(offset, parent->capacity());
+    CHECK_LE(offset + size, parent->capacity());
+}
+
 ABuffer::~ABuffer() {
     if (mOwnsData) {
         if (mData != NULL) {
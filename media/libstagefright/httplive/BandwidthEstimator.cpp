@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "BandwidthEstimator"
+#include <utils/Log.h>
+
+#include "BandwidthEstimator.h"
+
+namespace android {
+
+BandwidthEstimator::BandwidthEstimator()
+    : mNumTransfers(0),
+      mBusyStartUs(0),
+      mBusyTimeUs(0),
+      mNumBytes(0) {
+}
+
+void BandwidthEstimator::onTransferStarted(int64_t nowUs) {
+    Mutex::Autolock autoLock(mLock);
+    if (mNumTransfers++ == 0) {
+        mBusyStartUs = nowUs;
+    }
+}
+
+void BandwidthEstimator::onTransferFinished(int64_t nowUs) {
+    Mutex::Autolock autoLock(mLock);
+    if (--mNumTransfers == 0) {
+        mBusyTimeUs += nowUs - mBusyStartUs;
+    }
+}
+
+void BandwidthEstimator::addBytes(size_t numBytes) {
+    Mutex::Autolock autoLock(mLock);
+    mNumBytes += numBytes;
+}
+
+void BandwidthEstimator::addSample(int64_t nowUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    int64_t busyTimeUs = mBusyTimeUs;
+    if (mNumTransfers > 0) {
+        busyTimeUs += nowUs - mBusyStartUs;
+        mBusyStartUs = nowUs;
+    }
+
+    if (busyTimeUs <= 0 || mNumBytes == 0) {
+        return;
+    }
+
+    mSamples.push_back(mNumBytes * 8E6 / busyTimeUs);
+    if (mSamples.size() > kNumSamples) {
+        mSamples.erase(mSamples.begin());
+    }
+
+    mNumBytes = 0;
+    mBusyTimeUs = 0;
+}
+
+bool BandwidthEstimator::estimate(int32_t *bandwidthBps) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mSamples.empty()) {
+        return false;
+    }
+
+    double sum = 0;
+    for (List<double>::iterator it = mSamples.begin();
+         it != mSamples.end(); ++it) {
+        sum += 1.0 / *it;
+    }
+
+    *bandwidthBps = mSamples.size() / sum;
+
+    return true;
+}
+
+}  // namespace android
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BANDWIDTH_ESTIMATOR_H_
+
+#define BANDWIDTH_ESTIMATOR_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/List.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// Measures the throughput of the link rather than of single downloads,
+// which share it: bytes are counted against the time during which any
+// download was in progress, round trips included. The callers pass the
+// time, so that the estimate can be checked without a real link.
+struct BandwidthEstimator : public RefBase {
+    enum {
+        // Download rates the estimate is the harmonic mean of.
+        kNumSamples = 5,
+    };
+
+    BandwidthEstimator();
+
+    void onTransferStarted(int64_t nowUs);
+    void onTransferFinished(int64_t nowUs);
+    void addBytes(size_t numBytes);
+
+    // Takes a sample of the rate since the last one, once per segment.
+    void addSample(int64_t nowUs);
+
+    // The harmonic mean of the samples, a short burst can't make it jump.
+    bool estimate(int32_t *bandwidthBps);
+
+private:
+    Mutex mLock;
+    size_t mNumTransfers;
+    int64_t mBusyStartUs;
+    int64_t mBusyTimeUs;
+    size_t mNumBytes;
+    List<double> mSamples;
+
+    DISALLOW_EVIL_CONSTRUCTORS(BandwidthEstimator);
+};
+
+}  // namespace android
+
+#endif  // BANDWIDTH_ESTIMATOR_H_
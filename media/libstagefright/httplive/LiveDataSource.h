@@ -40,6 +40,7 @@ struct LiveDataSource : public DataSource {
     void reset();
 
     size_t countQueuedBuffers();
+    size_t countQueuedBytes();
 
 protected:
     virtual ~LiveDataSource();
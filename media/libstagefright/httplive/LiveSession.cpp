@@ -20,6 +20,7 @@
 
 #include "include/LiveSession.h"
 
+#include "BandwidthEstimator.h"
 #include "LiveDataSource.h"
 
 #include "include/M3UParser.h"
@@ -37,19 +38,184 @@
 #include <ctype.h>
 #include <openssl/aes.h>
 #include <openssl/md5.h>
+#include <pthread.h>
+#include <sys/prctl.h>
 
 namespace android {
 
+// Downloads a segment on its own thread, the data can be dequeued in
+// chunks as it arrives.
+struct LiveSession::SegmentDownload : public RefBase {
+    SegmentDownload(
+            const AString &uri,
+            const sp<HTTPBase> &httpSource,
+            const KeyedVector<String8, String8> &headers,
+            const sp<BandwidthEstimator> &bandwidthEstimator)
+        : mURI(uri),
+          mHTTPSource(httpSource),
+          mHeaders(headers),
+          mBandwidthEstimator(bandwidthEstimator),
+          mFinalStatus(OK),
+          mCancelled(false) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+        mThreadStarted =
+            pthread_create(&mThread, &attr, ThreadWrapper, this) == 0;
+        pthread_attr_destroy(&attr);
+
+        if (!mThreadStarted) {
+            ALOGE("failed to start the download of '%s'", uri.c_str());
+            mFinalStatus = UNKNOWN_ERROR;
+        }
+    }
+
+    const AString &uri() const {
+        return mURI;
+    }
+
+    // Blocks until there is data, returns ERROR_END_OF_STREAM once all
+    // of it has been dequeued.
+    status_t dequeueChunk(sp<ABuffer> *chunk) {
+        Mutex::Autolock autoLock(mLock);
+        while (mChunks.empty() && mFinalStatus == OK) {
+            mCondition.wait(mLock);
+        }
+
+        if (mChunks.empty()) {
+            return mFinalStatus;
+        }
+
+        *chunk = *mChunks.begin();
+        mChunks.erase(mChunks.begin());
+
+        return OK;
+    }
+
+    void cancel() {
+        Mutex::Autolock autoLock(mLock);
+        mCancelled = true;
+        if (mHTTPSource != NULL) {
+            mHTTPSource->disconnect();
+        }
+    }
+
+protected:
+    virtual ~SegmentDownload() {
+        cancel();
+
+        if (mThreadStarted) {
+            void *dummy;
+            pthread_join(mThread, &dummy);
+        }
+    }
+
+private:
+    enum {
+        kChunkSize = 32768,
+    };
+
+    AString mURI;
+    sp<HTTPBase> mHTTPSource;
+    KeyedVector<String8, String8> mHeaders;
+    sp<BandwidthEstimator> mBandwidthEstimator;
+
+    Mutex mLock;
+    Condition mCondition;
+    List<sp<ABuffer> > mChunks;
+    status_t mFinalStatus;
+    bool mCancelled;
+
+    pthread_t mThread;
+    bool mThreadStarted;
+
+    static void *ThreadWrapper(void *me) {
+        static_cast<SegmentDownload *>(me)->threadFunc();
+        return NULL;
+    }
+
+    void threadFunc();
+
+    DISALLOW_EVIL_CONSTRUCTORS(SegmentDownload);
+};
+
+void LiveSession::SegmentDownload::threadFunc() {
+    prctl(PR_SET_NAME, (unsigned long)"HLSDownload", 0, 0, 0);
+
+    mBandwidthEstimator->onTransferStarted(ALooper::GetNowUs());
+
+    sp<DataSource> source;
+    status_t err;
+    if (!strncasecmp(mURI.c_str(), "file://", 7)) {
+        source = new FileSource(mURI.c_str() + 7);
+        err = source->initCheck();
+    } else if (mHTTPSource == NULL) {
+        err = ERROR_UNSUPPORTED;
+    } else {
+        err = mHTTPSource->connect(
+                mURI.c_str(), mHeaders.isEmpty() ? NULL : &mHeaders);
+        source = mHTTPSource;
+    }
+
+    off64_t offset = 0;
+    while (err == OK) {
+        {
+            Mutex::Autolock autoLock(mLock);
+            if (mCancelled) {
+                err = ERROR_IO;
+                break;
+            }
+        }
+
+        sp<ABuffer> chunk = new ABuffer(kChunkSize);
+        ssize_t n = source->readAt(offset, chunk->data(), kChunkSize);
+
+        if (n < 0) {
+            err = n;
+        } else if (n == 0) {
+            err = ERROR_END_OF_STREAM;
+        } else {
+            chunk->setRange(0, n);
+            offset += n;
+            mBandwidthEstimator->addBytes(n);
+
+            Mutex::Autolock autoLock(mLock);
+            mChunks.push_back(chunk);
+            mCondition.signal();
+        }
+    }
+
+    mBandwidthEstimator->onTransferFinished(ALooper::GetNowUs());
+
+    Mutex::Autolock autoLock(mLock);
+    mFinalStatus = mCancelled ? ERROR_IO : err;
+    mCondition.signal();
+}
+
+// AES-128 in CBC mode is decrypted as the data arrives, the data that
+// doesn't fill a block yet and the last block, which has the padding,
+// are held back.
+struct LiveSession::DecryptionState {
+    DecryptionState()
+        : mEnabled(false) {
+    }
+
+    bool mEnabled;
+    AES_KEY mKey;
+    unsigned char mIV[16];
+    sp<ABuffer> mPending;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 LiveSession::LiveSession(uint32_t flags, bool uidValid, uid_t uid)
     : mFlags(flags),
       mUIDValid(uidValid),
       mUID(uid),
       mDataSource(new LiveDataSource),
-      mHTTPDataSource(
-              HTTPBase::Create(
-                  (mFlags & kFlagIncognito)
-                    ? HTTPBase::kFlagIncognito
-                    : 0)),
+      mBandwidthEstimator(new BandwidthEstimator),
+      mLastSegmentSize(0),
+      mLastSegmentDurationUs(0),
       mPrevBandwidthIndex(-1),
       mLastPlaylistFetchTimeUs(-1),
       mSeqNumber(-1),
@@ -60,14 +226,25 @@ LiveSession::LiveSession(uint32_t flags, bool uidValid, uid_t uid)
       mDisconnectPending(false),
       mMonitorQueueGeneration(0),
       mRefreshState(INITIAL_MINIMUM_RELOAD_DELAY) {
-    if (mUIDValid) {
-        mHTTPDataSource->setUID(mUID);
-    }
 }
 
 LiveSession::~LiveSession() {
 }
 
+sp<HTTPBase> LiveSession::createHTTPSource() {
+    sp<HTTPBase> source =
+        HTTPBase::Create(
+                (mFlags & kFlagIncognito)
+                    ? HTTPBase::kFlagIncognito
+                    : 0);
+
+    if (mUIDValid) {
+        source->setUID(mUID);
+    }
+
+    return source;
+}
+
 sp<DataSource> LiveSession::getDataSource() {
     return mDataSource;
 }
@@ -90,7 +267,14 @@ void LiveSession::disconnect() {
     Mutex::Autolock autoLock(mLock);
     mDisconnectPending = true;
 
-    mHTTPDataSource->disconnect();
+    if (mHTTPDataSource != NULL) {
+        mHTTPDataSource->disconnect();
+    }
+
+    for (List<sp<SegmentDownload> >::iterator it = mDownloads.begin();
+         it != mDownloads.end(); ++it) {
+        (*it)->cancel();
+    }
 
     (new AMessage(kWhatDisconnect, id()))->post();
 }
@@ -175,6 +359,11 @@ void LiveSession::onConnect(const sp<AMessage> &msg) {
 
     mMasterURL = url;
 
+    {
+        Mutex::Autolock autoLock(mLock);
+        mHTTPDataSource = createHTTPSource();
+    }
+
     bool dummy;
     sp<M3UParser> playlist = fetchPlaylist(url.c_str(), &dummy);
 
@@ -192,8 +381,9 @@ void LiveSession::onConnect(const sp<AMessage> &msg) {
             sp<AMessage> meta;
             playlist->itemAt(i, &item.mURI, &meta);
 
-            unsigned long bandwidth;
-            CHECK(meta->findInt32("bandwidth", (int32_t *)&item.mBandwidth));
+            int32_t bandwidth;
+            CHECK(meta->findInt32("bandwidth", &bandwidth));
+            item.mBandwidth = bandwidth;
 
             mBandwidthItems.push(item);
         }
@@ -209,6 +399,8 @@ void LiveSession::onConnect(const sp<AMessage> &msg) {
 void LiveSession::onDisconnect() {
     ALOGI("onDisconnect");
 
+    cancelDownloads();
+
     mDataSource->queueEOS(ERROR_END_OF_STREAM);
 
     Mutex::Autolock autoLock(mLock);
@@ -355,8 +547,7 @@ size_t LiveSession::getBandwidthIndex() {
 
 #if 1
     int32_t bandwidthBps;
-    if (mHTTPDataSource != NULL
-            && mHTTPDataSource->estimateBandwidth(&bandwidthBps)) {
+    if (mBandwidthEstimator->estimate(&bandwidthBps)) {
         ALOGV("bandwidth estimated at %.2f kbps", bandwidthBps / 1024.0f);
     } else {
         ALOGV("no bandwidth estimate.");
@@ -376,15 +567,34 @@ size_t LiveSession::getBandwidthIndex() {
     }
 
     // Consider only 80% of the available bandwidth usable.
-    bandwidthBps = (bandwidthBps * 8) / 10;
+    int32_t usableBandwidthBps = (bandwidthBps * 8) / 10;
 
     // Pick the highest bandwidth stream below or equal to estimated bandwidth.
 
     size_t index = mBandwidthItems.size() - 1;
     while (index > 0 && mBandwidthItems.itemAt(index).mBandwidth
-                            > (size_t)bandwidthBps) {
+                            > (size_t)usableBandwidthBps) {
         --index;
     }
+
+    // Then let the buffered data decide how far to follow the estimate.
+    // Switch up one stream at a time and only with enough buffered to
+    // ride out a wrong estimate, and stay on the current stream through
+    // a dip as long as it can still be downloaded in real time.
+    if (mPrevBandwidthIndex >= 0
+            && (size_t)mPrevBandwidthIndex < mBandwidthItems.size()) {
+        size_t prevIndex = mPrevBandwidthIndex;
+        bool buffered = getBufferedDurationUs()
+            >= kMinBufferedFragmentsToSwitchUp * mLastSegmentDurationUs;
+
+        if (index > prevIndex) {
+            index = buffered ? prevIndex + 1 : prevIndex;
+        } else if (index < prevIndex && buffered
+                && mBandwidthItems.itemAt(prevIndex).mBandwidth
+                        <= (size_t)bandwidthBps) {
+            index = prevIndex;
+        }
+    }
 #elif 0
     // Change bandwidth at random()
     size_t index = uniformRand() * mBandwidthItems.size();
@@ -419,6 +629,85 @@ size_t LiveSession::getBandwidthIndex() {
     return index;
 }
 
+int64_t LiveSession::getBufferedDurationUs() {
+    if (mLastSegmentSize == 0) {
+        return 0;
+    }
+
+    return mDataSource->countQueuedBytes() * mLastSegmentDurationUs
+        / mLastSegmentSize;
+}
+
+sp<LiveSession::SegmentDownload> LiveSession::startDownload(
+        const AString &uri) {
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        if (!mDownloads.empty() && (*mDownloads.begin())->uri() == uri) {
+            return *mDownloads.begin();
+        }
+    }
+
+    // A seek or a bandwidth change, the prefetched segments aren't needed.
+    cancelDownloads();
+
+    Mutex::Autolock autoLock(mLock);
+
+    if (mDisconnectPending) {
+        return NULL;
+    }
+
+    sp<SegmentDownload> download = new SegmentDownload(
+            uri, createHTTPSource(), mExtraHeaders, mBandwidthEstimator);
+    mDownloads.push_back(download);
+
+    return download;
+}
+
+void LiveSession::prefetchSegments(int32_t firstSeqNumberInPlaylist) {
+    // The round trips of the following segments overlap the download of
+    // this one, but they don't take bandwidth from it before there is a
+    // segment buffered.
+    if (mLastSegmentSize == 0
+            || getBufferedDurationUs() < mLastSegmentDurationUs) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    while (mDownloads.size() <= kMaxNumPrefetchedSegments) {
+        int32_t index =
+            mSeqNumber + mDownloads.size() - firstSeqNumberInPlaylist;
+        if (mDisconnectPending || index >= (int32_t)mPlaylist->size()) {
+            break;
+        }
+
+        AString uri;
+        sp<AMessage> itemMeta;
+        CHECK(mPlaylist->itemAt(index, &uri, &itemMeta));
+
+        ALOGV("prefetching segment %d", mSeqNumber + mDownloads.size());
+
+        mDownloads.push_back(new SegmentDownload(
+                uri, createHTTPSource(), mExtraHeaders, mBandwidthEstimator));
+    }
+}
+
+void LiveSession::cancelDownloads() {
+    List<sp<SegmentDownload> > downloads;
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        downloads = mDownloads;
+        mDownloads.clear();
+    }
+
+    for (List<sp<SegmentDownload> >::iterator it = downloads.begin();
+         it != downloads.end(); ++it) {
+        (*it)->cancel();
+    }
+}
+
 bool LiveSession::timeToRefreshPlaylist(int64_t nowUs) const {
     if (mPlaylist == NULL) {
         CHECK_EQ((int)mRefreshState, (int)INITIAL_MINIMUM_RELOAD_DELAY);
@@ -659,30 +948,49 @@ rinse_repeat:
         explicitDiscontinuity = true;
     }
 
-    sp<ABuffer> buffer;
-    status_t err = fetchFile(uri.c_str(), &buffer);
-    if (err != OK) {
+    sp<SegmentDownload> download = startDownload(uri);
+    if (download == NULL) {
         ALOGE("failed to fetch .ts segment at url '%s'", uri.c_str());
-        mDataSource->queueEOS(err);
+        mDataSource->queueEOS(ERROR_IO);
         return;
     }
 
-    CHECK(buffer != NULL);
+    prefetchSegments(firstSeqNumberInPlaylist);
 
-    err = decryptBuffer(mSeqNumber - firstSeqNumberInPlaylist, buffer);
+    DecryptionState decryptionState;
+    status_t err = setUpDecryption(
+            mSeqNumber - firstSeqNumberInPlaylist, &decryptionState);
 
     if (err != OK) {
-        ALOGE("decryptBuffer failed w/ error %d", err);
+        ALOGE("setUpDecryption failed w/ error %d", err);
 
+        cancelDownloads();
         mDataSource->queueEOS(err);
         return;
     }
 
+    sp<ABuffer> buffer;
+    err = readSegmentData(download, &decryptionState, &buffer);
+
+    if (err == ERROR_END_OF_STREAM) {
+        buffer = new ABuffer(0);
+    } else if (err != OK) {
+        ALOGE("failed to fetch .ts segment at url '%s'", uri.c_str());
+
+        cancelDownloads();
+        mDataSource->queueEOS(err);
+        return;
+    }
+
+    CHECK(buffer != NULL);
+
     if (buffer->size() == 0 || buffer->data()[0] != 0x47) {
         // Not a transport stream???
 
         ALOGE("This doesn't look like a transport stream...");
 
+        cancelDownloads();
+
         mBandwidthItems.removeAt(bandwidthIndex);
 
         if (mBandwidthItems.isEmpty()) {
@@ -725,7 +1033,38 @@ rinse_repeat:
         mDataSource->queueBuffer(tmp);
     }
 
-    mDataSource->queueBuffer(buffer);
+    // Queue the data as it arrives, playback can start or go on before
+    // the segment has been downloaded.
+    size_t segmentSize = 0;
+    do {
+        segmentSize += buffer->size();
+        mDataSource->queueBuffer(buffer);
+
+        err = readSegmentData(download, &decryptionState, &buffer);
+    } while (err == OK);
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (!mDownloads.empty() && *mDownloads.begin() == download) {
+            mDownloads.erase(mDownloads.begin());
+        }
+    }
+
+    if (err != ERROR_END_OF_STREAM) {
+        ALOGE("failed to fetch .ts segment at url '%s'", uri.c_str());
+
+        cancelDownloads();
+        mDataSource->queueEOS(err);
+        return;
+    }
+
+    mBandwidthEstimator->addSample(ALooper::GetNowUs());
+
+    int64_t segmentDurationUs;
+    CHECK(itemMeta->findInt64("durationUs", &segmentDurationUs));
+
+    mLastSegmentSize = segmentSize;
+    mLastSegmentDurationUs = segmentDurationUs;
 
     mPrevBandwidthIndex = bandwidthIndex;
     ++mSeqNumber;
@@ -734,16 +1073,17 @@ rinse_repeat:
 }
 
 void LiveSession::onMonitorQueue() {
-    if (mSeekTimeUs >= 0
-            || mDataSource->countQueuedBuffers() < kMaxNumQueuedFragments) {
+    if (mSeekTimeUs >= 0 || mLastSegmentSize == 0
+            || mDataSource->countQueuedBytes()
+                < kMaxNumQueuedFragments * mLastSegmentSize) {
         onDownloadNext();
     } else {
         postMonitorQueue(1000000ll);
     }
 }
 
-status_t LiveSession::decryptBuffer(
-        size_t playlistIndex, const sp<ABuffer> &buffer) {
+status_t LiveSession::setUpDecryption(
+        size_t playlistIndex, DecryptionState *state) {
     sp<AMessage> itemMeta;
     bool found = false;
     AString method;
@@ -783,15 +1123,7 @@ status_t LiveSession::decryptBuffer(
     } else {
         key = new ABuffer(16);
 
-        sp<HTTPBase> keySource =
-              HTTPBase::Create(
-                  (mFlags & kFlagIncognito)
-                    ? HTTPBase::kFlagIncognito
-                    : 0);
-
-        if (mUIDValid) {
-            keySource->setUID(mUID);
-        }
+        sp<HTTPBase> keySource = createHTTPSource();
 
         status_t err =
             keySource->connect(
@@ -820,14 +1152,11 @@ status_t LiveSession::decryptBuffer(
         mAESKeyForURI.add(keyURI, key);
     }
 
-    AES_KEY aes_key;
-    if (AES_set_decrypt_key(key->data(), 128, &aes_key) != 0) {
+    if (AES_set_decrypt_key(key->data(), 128, &state->mKey) != 0) {
         ALOGE("failed to set AES decryption key.");
         return UNKNOWN_ERROR;
     }
 
-    unsigned char aes_ivec[16];
-
     AString iv;
     if (itemMeta->findString("cipher-iv", &iv)) {
         if ((!iv.startsWith("0x") && !iv.startsWith("0X"))
@@ -836,7 +1165,7 @@ status_t LiveSession::decryptBuffer(
             return ERROR_MALFORMED;
         }
 
-        memset(aes_ivec, 0, sizeof(aes_ivec));
+        memset(state->mIV, 0, sizeof(state->mIV));
         for (size_t i = 0; i < 16; ++i) {
             char c1 = tolower(iv.c_str()[2 + 2 * i]);
             char c2 = tolower(iv.c_str()[3 + 2 * i]);
@@ -847,39 +1176,105 @@ status_t LiveSession::decryptBuffer(
             uint8_t nibble1 = isdigit(c1) ? c1 - '0' : c1 - 'a' + 10;
             uint8_t nibble2 = isdigit(c2) ? c2 - '0' : c2 - 'a' + 10;
 
-            aes_ivec[i] = nibble1 << 4 | nibble2;
+            state->mIV[i] = nibble1 << 4 | nibble2;
         }
     } else {
-        memset(aes_ivec, 0, sizeof(aes_ivec));
-        aes_ivec[15] = mSeqNumber & 0xff;
-        aes_ivec[14] = (mSeqNumber >> 8) & 0xff;
-        aes_ivec[13] = (mSeqNumber >> 16) & 0xff;
-        aes_ivec[12] = (mSeqNumber >> 24) & 0xff;
+        memset(state->mIV, 0, sizeof(state->mIV));
+        state->mIV[15] = mSeqNumber & 0xff;
+        state->mIV[14] = (mSeqNumber >> 8) & 0xff;
+        state->mIV[13] = (mSeqNumber >> 16) & 0xff;
+        state->mIV[12] = (mSeqNumber >> 24) & 0xff;
     }
 
-    AES_cbc_encrypt(
-            buffer->data(), buffer->data(), buffer->size(),
-            &aes_key, aes_ivec, AES_DECRYPT);
+    state->mEnabled = true;
 
-    // hexdump(buffer->data(), buffer->size());
+    return OK;
+}
 
-    size_t n = buffer->size();
-    CHECK_GT(n, 0u);
+status_t LiveSession::readSegmentData(
+        const sp<SegmentDownload> &download, DecryptionState *state,
+        sp<ABuffer> *out) {
+    for (;;) {
+        sp<ABuffer> buffer;
+        status_t err = download->dequeueChunk(&buffer);
 
-    size_t pad = buffer->data()[n - 1];
+        if (err != OK && err != ERROR_END_OF_STREAM) {
+            return err;
+        }
 
-    CHECK_GT(pad, 0u);
-    CHECK_LE(pad, 16u);
-    CHECK_GE((size_t)n, pad);
-    for (size_t i = 0; i < pad; ++i) {
-        CHECK_EQ((unsigned)buffer->data()[n - 1 - i], pad);
-    }
+        bool eos = (err == ERROR_END_OF_STREAM);
 
-    n -= pad;
+        if (!state->mEnabled) {
+            if (eos) {
+                return ERROR_END_OF_STREAM;
+            }
 
-    buffer->setRange(buffer->offset(), n);
+            *out = buffer;
+            return OK;
+        }
 
-    return OK;
+        if (state->mPending != NULL) {
+            size_t size = eos ? 0 : buffer->size();
+
+            sp<ABuffer> tmp = new ABuffer(state->mPending->size() + size);
+            memcpy(tmp->data(),
+                   state->mPending->data(), state->mPending->size());
+            if (size > 0) {
+                memcpy(tmp->data() + state->mPending->size(),
+                       buffer->data(), size);
+            }
+
+            buffer = tmp;
+            state->mPending.clear();
+        } else if (eos) {
+            return ERROR_END_OF_STREAM;
+        }
+
+        size_t n = buffer->size() - buffer->size() % 16;
+        if (!eos && n == buffer->size() && n > 0) {
+            // This may be the last block.
+            n -= 16;
+        }
+
+        if (n < buffer->size()) {
+            if (eos) {
+                ALOGE("encrypted segment is not a multiple of the block size");
+                return ERROR_MALFORMED;
+            }
+
+            state->mPending = new ABuffer(buffer->size() - n);
+            memcpy(state->mPending->data(),
+                   buffer->data() + n, state->mPending->size());
+        }
+
+        AES_cbc_encrypt(
+                buffer->data(), buffer->data(), n,
+                &state->mKey, state->mIV, AES_DECRYPT);
+
+        // hexdump(buffer->data(), n);
+
+        if (eos) {
+            CHECK_GT(n, 0u);
+
+            size_t pad = buffer->data()[n - 1];
+
+            CHECK_GT(pad, 0u);
+            CHECK_LE(pad, 16u);
+            CHECK_GE((size_t)n, pad);
+            for (size_t i = 0; i < pad; ++i) {
+                CHECK_EQ((unsigned)buffer->data()[n - 1 - i], pad);
+            }
+
+            n -= pad;
+        }
+
+        buffer->setRange(buffer->offset(), n);
+
+        if (n > 0) {
+            *out = buffer;
+            return OK;
+        }
+    }
 }
 
 void LiveSession::postMonitorQueue(int64_t delayUs) {
@@ -316,6 +316,7 @@ private:
         int32_t mVideoHeight;
         uint32_t mFlags;
         Vector<TrackStat> mTracks;
+        sp<NuCachedSource2> mCachedSource;
     } mStats;
 
     AwesomePlayer(const AwesomePlayer &);
@@ -20,11 +20,13 @@
 
 #include <media/stagefright/foundation/AHandler.h>
 
+#include <utils/List.h>
 #include <utils/String8.h>
 
 namespace android {
 
 struct ABuffer;
+struct BandwidthEstimator;
 struct DataSource;
 struct LiveDataSource;
 struct M3UParser;
@@ -56,10 +58,20 @@ protected:
 
     virtual void onMessageReceived(const sp<AMessage> &msg);
 
+    // Returns a new source to fetch playlists, keys and segments through.
+    virtual sp<HTTPBase> createHTTPSource();
+
 private:
     enum {
         kMaxNumQueuedFragments = 3,
         kMaxNumRetries         = 5,
+
+        // Segments downloaded while the one before them is queued.
+        kMaxNumPrefetchedSegments = 2,
+
+        // Switch to a higher bandwidth stream only with this many
+        // fragments buffered.
+        kMinBufferedFragmentsToSwitchUp = 2,
     };
 
     enum {
@@ -74,6 +86,9 @@ private:
         unsigned long mBandwidth;
     };
 
+    struct SegmentDownload;
+    struct DecryptionState;
+
     uint32_t mFlags;
     bool mUIDValid;
     uid_t mUID;
@@ -89,6 +104,14 @@ private:
 
     KeyedVector<AString, sp<ABuffer> > mAESKeyForURI;
 
+    sp<BandwidthEstimator> mBandwidthEstimator;
+
+    // The segment being queued first, then the ones prefetched after it.
+    List<sp<SegmentDownload> > mDownloads;
+
+    size_t mLastSegmentSize;
+    int64_t mLastSegmentDurationUs;
+
     ssize_t mPrevBandwidthIndex;
     int64_t mLastPlaylistFetchTimeUs;
     sp<M3UParser> mPlaylist;
@@ -123,9 +146,19 @@ private:
     status_t fetchFile(const char *url, sp<ABuffer> *out);
     sp<M3UParser> fetchPlaylist(const char *url, bool *unchanged);
     size_t getBandwidthIndex();
+    int64_t getBufferedDurationUs();
+
+    sp<SegmentDownload> startDownload(const AString &uri);
+    void prefetchSegments(int32_t firstSeqNumberInPlaylist);
+    void cancelDownloads();
+
+    status_t setUpDecryption(size_t playlistIndex, DecryptionState *state);
 
-    status_t decryptBuffer(
-            size_t playlistIndex, const sp<ABuffer> &buffer);
+    // Returns the next data of the segment, decrypted,
+    // ERROR_END_OF_STREAM once all of it has been returned.
+    status_t readSegmentData(
+            const sp<SegmentDownload> &download, DecryptionState *state,
+            sp<ABuffer> *out);
 
     void postMonitorQueue(int64_t delayUs = 0);
 
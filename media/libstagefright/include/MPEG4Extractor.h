@@ -25,6 +25,7 @@ namespace android {
 
 struct AMessage;
 class DataSource;
+struct MPEG4FragmentIndex;
 class SampleTable;
 class String8;
 
@@ -65,6 +66,12 @@ private:
 
     Vector<uint32_t> mPath;
 
+    // Set once 'mvex' is seen, i.e. for fragmented files, whose samples
+    // are found in the movie fragments following 'moov'.
+    sp<MPEG4FragmentIndex> mFragmentIndex;
+    uint32_t mMovieTimescale;
+    int64_t mFragmentedDurationUs;
+
     status_t readMetaData();
     status_t parseChunk(off64_t *offset, int depth);
     status_t parseMetaData(off64_t offset, size_t size);
@@ -89,6 +96,12 @@ private:
 
     status_t parseTrackHeader(off64_t data_offset, off64_t data_size);
 
+    status_t parseTrackExtends(off64_t data_offset, off64_t data_size);
+    status_t parseMovieExtendsHeader(off64_t data_offset, off64_t data_size);
+    status_t parseSegmentIndex(off64_t offset, off64_t data_offset,
+                               off64_t data_size);
+    void setupFragmentedTracks();
+
     Track *findTrackByMimePrefix(const char *mimePrefix);
 
     MPEG4Extractor(const MPEG4Extractor &);
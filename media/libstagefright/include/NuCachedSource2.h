@@ -21,6 +21,8 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/foundation/AHandlerReflector.h>
 #include <media/stagefright/DataSource.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -48,6 +50,11 @@ struct NuCachedSource2 : public DataSource {
 
     ////////////////////////////////////////////////////////////////////////////
 
+    // Both only cover the range being read and fetched into, which holds
+    // the data ahead of the playback position. The other ranges are kept
+    // for seeks back and are not counted. cachedSize() is the offset the
+    // current range ends at, approxDataRemaining() the bytes in it after
+    // the last read.
     size_t cachedSize();
     size_t approxDataRemaining(status_t *finalStatus);
 
@@ -59,6 +66,9 @@ struct NuCachedSource2 : public DataSource {
     status_t getEstimatedBandwidthKbps(int32_t *kbps);
     status_t setCacheStatCollectFreq(int32_t freqMs);
 
+    // Prints the cached ranges and how many reads they served.
+    status_t dump(int fd, const Vector<String16> &args);
+
     static void RemoveCacheSpecificHeaders(
             KeyedVector<String8, String8> *headers,
             String8 *cacheConfig,
@@ -70,6 +80,8 @@ protected:
 private:
     friend struct AHandlerReflector<NuCachedSource2>;
 
+    struct Range;
+
     enum {
         kPageSize                       = 65536,
         kDefaultHighWaterThreshold      = 20 * 1024 * 1024,
@@ -78,6 +90,16 @@ private:
         // Read data after a 15 sec timeout whether we're actively
         // fetching or not.
         kDefaultKeepAliveIntervalUs     = 15000000,
+
+        // Like the head, the movie box and the playhead of a file,
+        // separate ranges of the file are cached independently.
+        kMaxNumRanges                   = 4,
+
+        // A range that was read from this recently is being played,
+        // once less than kMinRunwayBytes are left to be read from it
+        // fetching switches to it.
+        kRecentAccessUs                 = 1000000,
+        kMinRunwayBytes                 = 1024 * 1024,
     };
 
     enum {
@@ -97,10 +119,12 @@ private:
     Mutex mLock;
     Condition mCondition;
 
-    PageCache *mCache;
-    off64_t mCacheOffset;
+    // The range being fetched into, it is one of mRanges.
+    Range *mCurrent;
+    List<Range *> mRanges;
+    size_t mNumEvictedRanges;
+
     status_t mFinalStatus;
-    off64_t mLastAccessPos;
     sp<AMessage> mAsyncResult;
     bool mFetching;
     int64_t mLastFetchTimeUs;
@@ -123,6 +147,12 @@ private:
     ssize_t readInternal(off64_t offset, void *data, size_t size);
     status_t seekInternal_l(off64_t offset);
 
+    Range *findRange_l(off64_t offset, size_t size) const;
+    size_t totalCachedSize_l() const;
+    void switchToRange_l(Range *range);
+    void updateFetchRange_l();
+    void trimRanges_l();
+
     size_t approxDataRemaining_l(status_t *finalStatus);
 
     void restartPrefetcherIfNecessary_l(
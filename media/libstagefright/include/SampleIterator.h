@@ -52,10 +52,6 @@ private:
     Vector<size_t> mCurrentChunkSampleSizes;
 
     uint32_t mTimeToSampleIndex;
-    uint32_t mTTSSampleIndex;
-    uint32_t mTTSSampleTime;
-    uint32_t mTTSCount;
-    uint32_t mTTSDuration;
 
     uint32_t mCurrentSampleIndex;
     off64_t mCurrentSampleOffset;
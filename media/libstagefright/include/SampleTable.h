@@ -93,12 +93,18 @@ private:
     static const uint32_t kSampleSizeType32;
     static const uint32_t kSampleSizeTypeCompact;
 
+    // Chunk offset and sample size tables of at most this size are read
+    // into memory in one go, larger ones are read as needed.
+    static const size_t kMaxCachedTableSize = 8 * 1024 * 1024;
+
     sp<DataSource> mDataSource;
     Mutex mLock;
 
     off64_t mChunkOffsetOffset;
     uint32_t mChunkOffsetType;
     uint32_t mNumChunkOffsets;
+    uint32_t *mChunkOffsets32;
+    uint64_t *mChunkOffsets64;
 
     off64_t mSampleToChunkOffset;
     uint32_t mNumSampleToChunkOffsets;
@@ -108,8 +114,26 @@ private:
     uint32_t mDefaultSampleSize;
     uint32_t mNumSampleSizes;
 
+    // Sample sizes held in 1, 2 or 4 bytes each, whichever fits all of them.
+    uint8_t *mSampleSizes;
+    uint32_t mSampleSizeBytes;
+    uint32_t mMaxSampleSize;
+
+    struct TimeToSampleEntry {
+        uint32_t sampleCount;
+        uint32_t sampleDelta;
+        // Index and decoding time of the first sample of the entry.
+        uint32_t firstSample;
+        uint32_t firstTime;
+    };
     uint32_t mTimeToSampleCount;
-    uint32_t *mTimeToSample;
+    TimeToSampleEntry *mTimeToSample;
+    uint64_t mTotalTimeToSampleCount;
+    uint64_t mTotalDuration;
+
+    // Set when the samples are in increasing time order, in which case
+    // mSampleTimeEntries isn't needed to search them by time.
+    bool mSampleTimesInOrder;
 
     struct SampleTimeEntry {
         uint32_t mSampleIndex;
@@ -124,7 +148,6 @@ private:
     off64_t mSyncSampleOffset;
     uint32_t mNumSyncSamples;
     uint32_t *mSyncSamples;
-    size_t mLastSyncSampleIndex;
 
     SampleIterator *mSampleIterator;
 
@@ -132,17 +155,30 @@ private:
         uint32_t startChunk;
         uint32_t samplesPerChunk;
         uint32_t chunkDesc;
+        // Index of the first sample of startChunk.
+        uint32_t firstSample;
     };
     SampleToChunkEntry *mSampleToChunkEntries;
 
     friend struct SampleIterator;
 
     status_t getSampleSize_l(uint32_t sample_index, size_t *sample_size);
+    status_t getSampleTime_l(uint32_t sampleIndex, uint32_t *sampleTime);
     uint32_t getCompositionTimeOffset(uint32_t sampleIndex);
 
+    // Index of the time to sample entry holding sampleIndex, or
+    // mTimeToSampleCount if there is none.
+    uint32_t findTimeToSampleEntry(uint32_t sampleIndex) const;
+    uint32_t findSyncSampleIndex(uint32_t sampleIndex) const;
+
+    status_t readSampleSizes(off64_t data_offset);
+
     static int CompareIncreasingTime(const void *, const void *);
+    static int CompareIncreasingSampleIndex(const void *, const void *);
 
     void buildSampleEntriesTable();
+    uint32_t getSortedSampleTime(uint32_t i) const;
+    uint32_t getSortedSampleIndex(uint32_t i) const;
 
     SampleTable(const SampleTable &);
     SampleTable &operator=(const SampleTable &);
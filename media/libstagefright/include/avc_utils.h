@@ -41,6 +41,10 @@ void FindAVCDimensions(
 
 unsigned parseUE(ABitReader *br);
 
+// Returns the offset of the first 0x00 0x00 0x01 start code in data,
+// or -1 if there is none.
+ssize_t FindStartCode(const uint8_t *data, size_t size);
+
 status_t getNextNALUnit(
         const uint8_t **_data, size_t *_size,
         const uint8_t **nalStart, size_t *nalSize,
@@ -67,6 +67,7 @@ struct ATSParser::Program : public RefBase {
 
     void updateProgramMapPID(unsigned programMapPID) {
         mProgramMapPID = programMapPID;
+        mParser->addPIDToFilter(programMapPID);
     }
 
 private:
@@ -89,6 +90,9 @@ struct ATSParser::Stream : public RefBase {
     unsigned pid() const { return mElementaryPID; }
     void setPID(unsigned pid) { mElementaryPID = pid; }
 
+    // Streams of unsupported types ignore their data.
+    bool isSupported() const { return mQueue != NULL; }
+
     status_t parse(
             unsigned payload_unit_start_indicator,
             ABitReader *br);
@@ -139,6 +143,7 @@ ATSParser::Program::Program(
       mFirstPTSValid(false),
       mFirstPTS(0) {
     ALOGV("new program number %u", programNumber);
+    mParser->addPIDToFilter(programMapPID);
 }
 
 bool ATSParser::Program::parsePID(
@@ -335,6 +340,13 @@ status_t ATSParser::Program::parseProgramMap(ABitReader *br) {
                 mStreams.add(s1->pid(), s1);
                 mStreams.add(s2->pid(), s2);
 
+                if (s1->isSupported()) {
+                    mParser->addPIDToFilter(s1->pid());
+                }
+                if (s2->isSupported()) {
+                    mParser->addPIDToFilter(s2->pid());
+                }
+
                 success = true;
             }
         }
@@ -353,6 +365,10 @@ status_t ATSParser::Program::parseProgramMap(ABitReader *br) {
         if (index < 0) {
             sp<Stream> stream = new Stream(this, info.mPID, info.mType);
             mStreams.add(info.mPID, stream);
+
+            if (stream->isSupported()) {
+                mParser->addPIDToFilter(info.mPID);
+            }
         }
     }
 
@@ -817,6 +833,8 @@ sp<MediaSource> ATSParser::Stream::getSource(SourceType type) {
 
 ATSParser::ATSParser(uint32_t flags)
     : mFlags(flags) {
+    memset(mPIDFilter, 0, sizeof(mPIDFilter));
+    addPIDToFilter(0);  // program association table
 }
 
 ATSParser::~ATSParser() {
@@ -825,8 +843,22 @@ ATSParser::~ATSParser() {
 status_t ATSParser::feedTSPacket(const void *data, size_t size) {
     CHECK_EQ(size, kTSPacketSize);
 
-    ABitReader br((const uint8_t *)data, kTSPacketSize);
-    return parseTS(&br);
+    return parseTS((const uint8_t *)data);
+}
+
+status_t ATSParser::feedTSPackets(const void *data, size_t size) {
+    CHECK_EQ(size % kTSPacketSize, 0u);
+
+    const uint8_t *packet = (const uint8_t *)data;
+    for (size_t offset = 0; offset < size; offset += kTSPacketSize) {
+        status_t err = parseTS(&packet[offset]);
+
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    return OK;
 }
 
 void ATSParser::signalDiscontinuity(
@@ -937,48 +969,50 @@ status_t ATSParser::parsePID(
     return OK;
 }
 
-void ATSParser::parseAdaptationField(ABitReader *br) {
-    unsigned adaptation_field_length = br->getBits(8);
-    if (adaptation_field_length > 0) {
-        br->skipBits(adaptation_field_length * 8);  // XXX
-    }
-}
-
-status_t ATSParser::parseTS(ABitReader *br) {
+status_t ATSParser::parseTS(const uint8_t *packet) {
     ALOGV("---");
 
-    unsigned sync_byte = br->getBits(8);
+    // The fixed 4 byte header is read directly, most packets only need it
+    // and the payload offset.
+    unsigned sync_byte = packet[0];
     CHECK_EQ(sync_byte, 0x47u);
 
-    MY_LOGV("transport_error_indicator = %u", br->getBits(1));
-
-    unsigned payload_unit_start_indicator = br->getBits(1);
+    unsigned payload_unit_start_indicator = (packet[1] >> 6) & 1;
     ALOGV("payload_unit_start_indicator = %u", payload_unit_start_indicator);
 
-    MY_LOGV("transport_priority = %u", br->getBits(1));
-
-    unsigned PID = br->getBits(13);
+    unsigned PID = ((packet[1] & 0x1f) << 8) | packet[2];
     ALOGV("PID = 0x%04x", PID);
 
-    MY_LOGV("transport_scrambling_control = %u", br->getBits(2));
-
-    unsigned adaptation_field_control = br->getBits(2);
+    unsigned adaptation_field_control = (packet[3] >> 4) & 3;
     ALOGV("adaptation_field_control = %u", adaptation_field_control);
 
-    unsigned continuity_counter = br->getBits(4);
-    ALOGV("continuity_counter = %u", continuity_counter);
+    ALOGV("continuity_counter = %u", packet[3] & 0x0f);
 
-    // ALOGI("PID = 0x%04x, continuity_counter = %u", PID, continuity_counter);
+    if (!isPIDFiltered(PID)) {
+        ALOGV("PID 0x%04x not handled.", PID);
+        return OK;
+    }
 
-    if (adaptation_field_control == 2 || adaptation_field_control == 3) {
-        parseAdaptationField(br);
+    if (adaptation_field_control != 1 && adaptation_field_control != 3) {
+        // No payload.
+        return OK;
     }
 
-    if (adaptation_field_control == 1 || adaptation_field_control == 3) {
-        return parsePID(br, PID, payload_unit_start_indicator);
+    size_t offset = 4;
+    if (adaptation_field_control == 3) {
+        unsigned adaptation_field_length = packet[4];
+        offset += 1 + adaptation_field_length;
+
+        if (offset > kTSPacketSize) {
+            ALOGE("adaptation_field_length %u exceeds the packet size.",
+                 adaptation_field_length);
+
+            return ERROR_MALFORMED;
+        }
     }
 
-    return OK;
+    ABitReader br(&packet[offset], kTSPacketSize - offset);
+    return parsePID(&br, PID, payload_unit_start_indicator);
 }
 
 sp<MediaSource> ATSParser::getSource(SourceType type) {
@@ -60,6 +60,10 @@ struct ATSParser : public RefBase {
 
     status_t feedTSPacket(const void *data, size_t size);
 
+    // Feeds consecutive packets, size being a multiple of the packet size.
+    // Stops at the first packet that fails to parse.
+    status_t feedTSPackets(const void *data, size_t size);
+
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
 
@@ -92,9 +96,24 @@ private:
     struct Program;
     struct Stream;
 
+    enum {
+        kNumPIDs = 8192,
+    };
+
     uint32_t mFlags;
     Vector<sp<Program> > mPrograms;
 
+    // The PAT, program map and elementary stream PIDs that are demuxed,
+    // packets of other PIDs are dropped after their header.
+    uint32_t mPIDFilter[kNumPIDs / 32];
+
+    void addPIDToFilter(unsigned PID) {
+        mPIDFilter[PID >> 5] |= 1u << (PID & 31);
+    }
+    bool isPIDFiltered(unsigned PID) const {
+        return (mPIDFilter[PID >> 5] & (1u << (PID & 31))) != 0;
+    }
+
     void parseProgramAssociationTable(ABitReader *br);
     void parseProgramMap(ABitReader *br);
     void parsePES(ABitReader *br);
@@ -103,8 +122,7 @@ private:
         ABitReader *br, unsigned PID,
         unsigned payload_unit_start_indicator);
 
-    void parseAdaptationField(ABitReader *br);
-    status_t parseTS(ABitReader *br);
+    status_t parseTS(const uint8_t *packet);
 
     DISALLOW_EVIL_CONSTRUCTORS(ATSParser);
 };
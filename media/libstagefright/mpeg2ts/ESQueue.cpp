@@ -20,6 +20,7 @@
 
 #include "ESQueue.h"
 
+#include <cutils/atomic.h>
 #include <media/stagefright/foundation/hexdump.h>
 #include <media/stagefright/foundation/ABitReader.h>
 #include <media/stagefright/foundation/ABuffer.h>
@@ -33,8 +34,55 @@
 
 namespace android {
 
+struct ElementaryStreamQueue::Segment : public ABuffer {
+    Segment(size_t capacity)
+        : ABuffer(capacity),
+          mNumSlices(0) {
+    }
+
+    // Once no slice is alive, whatever their users did with the data is
+    // visible and the segment can be written to again.
+    bool inUse() const {
+        return android_atomic_acquire_load(&mNumSlices) != 0;
+    }
+
+    volatile int32_t mNumSlices;
+
+protected:
+    virtual ~Segment() {}
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(Segment);
+};
+
+struct ElementaryStreamQueue::Slice : public ABuffer {
+    Slice(const sp<Segment> &segment, size_t offset, size_t size)
+        : ABuffer(segment, offset, size),
+          mSegment(segment.get()) {
+        android_atomic_inc(&mSegment->mNumSlices);
+    }
+
+protected:
+    // The ABuffer destructor, which drops the reference to the segment, runs
+    // after this one.
+    virtual ~Slice() {
+        android_atomic_dec(&mSegment->mNumSlices);
+    }
+
+private:
+    Segment *mSegment;
+
+    DISALLOW_EVIL_CONSTRUCTORS(Slice);
+};
+
 ElementaryStreamQueue::ElementaryStreamQueue(Mode mode)
-    : mMode(mode) {
+    : mMode(mode),
+      mNALsSize(0),
+      mScanOffset(0),
+      mFoundSlice(false) {
+}
+
+ElementaryStreamQueue::~ElementaryStreamQueue() {
 }
 
 sp<MetaData> ElementaryStreamQueue::getFormat() {
@@ -43,10 +91,20 @@ sp<MetaData> ElementaryStreamQueue::getFormat() {
 
 void ElementaryStreamQueue::clear(bool clearFormat) {
     if (mBuffer != NULL) {
-        mBuffer->setRange(0, 0);
+        if (!mBuffer->inUse()) {
+            mBuffer->setRange(0, 0);
+        } else {
+            // Access units still reference the segment.
+            mSpareSegments.push_back(mBuffer);
+            if (mSpareSegments.size() > kMaxSpareSegments) {
+                mSpareSegments.erase(mSpareSegments.begin());
+            }
+            mBuffer.clear();
+        }
     }
 
     mRangeInfos.clear();
+    resetScan();
 
     if (clearFormat) {
         mFormat.clear();
@@ -131,12 +189,18 @@ status_t ElementaryStreamQueue::appendData(
 #else
                 uint8_t *ptr = (uint8_t *)data;
 
+                // Look for 0x00 0x00 0x00 0x01.
                 ssize_t startOffset = -1;
-                for (size_t i = 0; i + 3 < size; ++i) {
-                    if (!memcmp("\x00\x00\x00\x01", &ptr[i], 4)) {
-                        startOffset = i;
+                size_t offset = 0;
+                ssize_t startCode;
+                while ((startCode = FindStartCode(
+                                &ptr[offset], size - offset)) >= 0) {
+                    offset += startCode;
+                    if (offset > 0 && ptr[offset - 1] == 0x00) {
+                        startOffset = offset - 1;
                         break;
                     }
+                    ++offset;
                 }
 
                 if (startOffset < 0) {
@@ -164,13 +228,7 @@ status_t ElementaryStreamQueue::appendData(
 #else
                 uint8_t *ptr = (uint8_t *)data;
 
-                ssize_t startOffset = -1;
-                for (size_t i = 0; i + 2 < size; ++i) {
-                    if (!memcmp("\x00\x00\x01", &ptr[i], 3)) {
-                        startOffset = i;
-                        break;
-                    }
-                }
+                ssize_t startOffset = FindStartCode(ptr, size);
 
                 if (startOffset < 0) {
                     return ERROR_MALFORMED;
@@ -253,25 +311,58 @@ status_t ElementaryStreamQueue::appendData(
         }
     }
 
-    size_t neededSize = (mBuffer == NULL ? 0 : mBuffer->size()) + size;
-    if (mBuffer == NULL || neededSize > mBuffer->capacity()) {
-        neededSize = (neededSize + 65535) & ~65535;
+    size_t pendingSize = (mBuffer == NULL ? 0 : mBuffer->size());
+    size_t neededSize = pendingSize + size;
+    if (mBuffer == NULL
+            || mBuffer->offset() + neededSize > mBuffer->capacity()) {
+        if (mBuffer != NULL && neededSize <= mBuffer->capacity()
+                && !mBuffer->inUse()) {
+            // No access unit references the consumed data anymore.
+            memmove(mBuffer->base(), mBuffer->data(), pendingSize);
+            mBuffer->setRange(0, pendingSize);
+        } else {
+            // Only the pending data, at most a partial access unit, is
+            // copied, so that it stays contiguous for the start code scans.
+            neededSize = (neededSize + 65535) & ~65535;
+            if (neededSize < kMinSegmentSize) {
+                neededSize = kMinSegmentSize;
+            }
 
-        ALOGV("resizing buffer to size %d", neededSize);
+            // Reuse a previous segment whose access units are all gone
+            // rather than having fresh memory paged in.
+            sp<Segment> buffer;
+            for (List<sp<Segment> >::iterator it = mSpareSegments.begin();
+                    it != mSpareSegments.end(); ++it) {
+                if (!(*it)->inUse()
+                        && (*it)->capacity() >= neededSize) {
+                    buffer = *it;
+                    mSpareSegments.erase(it);
+                    break;
+                }
+            }
 
-        sp<ABuffer> buffer = new ABuffer(neededSize);
-        if (mBuffer != NULL) {
-            memcpy(buffer->data(), mBuffer->data(), mBuffer->size());
-            buffer->setRange(0, mBuffer->size());
-        } else {
-            buffer->setRange(0, 0);
-        }
+            if (buffer == NULL) {
+                ALOGV("allocating segment of size %d", neededSize);
 
-        mBuffer = buffer;
+                buffer = new Segment(neededSize);
+            }
+
+            if (mBuffer != NULL) {
+                memcpy(buffer->base(), mBuffer->data(), pendingSize);
+
+                mSpareSegments.push_back(mBuffer);
+                if (mSpareSegments.size() > kMaxSpareSegments) {
+                    mSpareSegments.erase(mSpareSegments.begin());
+                }
+            }
+            buffer->setRange(0, pendingSize);
+
+            mBuffer = buffer;
+        }
     }
 
-    memcpy(mBuffer->data() + mBuffer->size(), data, size);
-    mBuffer->setRange(0, mBuffer->size() + size);
+    memcpy(mBuffer->data() + pendingSize, data, size);
+    mBuffer->setRange(mBuffer->offset(), pendingSize + size);
 
     RangeInfo info;
     info.mLength = size;
@@ -389,21 +480,25 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitAAC() {
         }
     }
 
-    sp<ABuffer> accessUnit = new ABuffer(auSize);
-    size_t dstOffset = 0;
-    for (size_t i = 0; i < frameOffsets.size(); ++i) {
-        size_t frameOffset = frameOffsets.itemAt(i);
+    sp<ABuffer> accessUnit;
+    if (frameOffsets.size() == 1) {
+        accessUnit = slice(frameOffsets.itemAt(0), frameSizes.itemAt(0));
+    } else {
+        // The ADTS headers are stripped.
+        accessUnit = new ABuffer(auSize);
+        size_t dstOffset = 0;
+        for (size_t i = 0; i < frameOffsets.size(); ++i) {
+            size_t frameOffset = frameOffsets.itemAt(i);
 
-        memcpy(accessUnit->data() + dstOffset,
-               mBuffer->data() + frameOffset,
-               frameSizes.itemAt(i));
+            memcpy(accessUnit->data() + dstOffset,
+                   mBuffer->data() + frameOffset,
+                   frameSizes.itemAt(i));
 
-        dstOffset += frameSizes.itemAt(i);
+            dstOffset += frameSizes.itemAt(i);
+        }
     }
 
-    memmove(mBuffer->data(), mBuffer->data() + offset,
-            mBuffer->size() - offset);
-    mBuffer->setRange(0, mBuffer->size() - offset);
+    consume(offset);
 
     if (timeUs >= 0) {
         accessUnit->meta()->setInt64("timeUs", timeUs);
@@ -414,6 +509,22 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitAAC() {
     return accessUnit;
 }
 
+void ElementaryStreamQueue::consume(size_t size) {
+    CHECK_LE(size, mBuffer->size());
+    mBuffer->setRange(mBuffer->offset() + size, mBuffer->size() - size);
+}
+
+sp<ABuffer> ElementaryStreamQueue::slice(size_t offset, size_t size) {
+    return new Slice(mBuffer, mBuffer->offset() + offset, size);
+}
+
+void ElementaryStreamQueue::resetScan() {
+    mNALs.clear();
+    mNALsSize = 0;
+    mScanOffset = 0;
+    mFoundSlice = false;
+}
+
 int64_t ElementaryStreamQueue::fetchTimestamp(size_t size) {
     int64_t timeUs = -1;
     bool first = true;
@@ -451,23 +562,14 @@ int64_t ElementaryStreamQueue::fetchTimestamp(size_t size) {
     return timeUs;
 }
 
-struct NALPosition {
-    size_t nalOffset;
-    size_t nalSize;
-};
-
 sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
-    const uint8_t *data = mBuffer->data();
-    size_t size = mBuffer->size();
-
-    Vector<NALPosition> nals;
-
-    size_t totalSize = 0;
+    // The scan resumes after the last NAL unit found by the previous call.
+    const uint8_t *data = mBuffer->data() + mScanOffset;
+    size_t size = mBuffer->size() - mScanOffset;
 
     status_t err;
     const uint8_t *nalStart;
     size_t nalSize;
-    bool foundSlice = false;
     while ((err = getNextNALUnit(&data, &size, &nalStart, &nalSize)) == OK) {
         CHECK_GT(nalSize, 0u);
 
@@ -475,7 +577,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
         bool flush = false;
 
         if (nalType == 1 || nalType == 5) {
-            if (foundSlice) {
+            if (mFoundSlice) {
                 ABitReader br(nalStart + 1, nalSize);
                 unsigned first_mb_in_slice = parseUE(&br);
 
@@ -486,8 +588,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
                 }
             }
 
-            foundSlice = true;
-        } else if ((nalType == 9 || nalType == 7) && foundSlice) {
+            mFoundSlice = true;
+        } else if ((nalType == 9 || nalType == 7) && mFoundSlice) {
             // Access unit delimiter and SPS will be associated with the
             // next frame.
 
@@ -498,47 +600,65 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
             // The access unit will contain all nal units up to, but excluding
             // the current one, separated by 0x00 0x00 0x00 0x01 startcodes.
 
-            size_t auSize = 4 * nals.size() + totalSize;
-            sp<ABuffer> accessUnit = new ABuffer(auSize);
+            const uint8_t *src = mBuffer->data();
 
-#if !LOG_NDEBUG
-            AString out;
-#endif
+            // If the nal units already are, the access unit is a slice of
+            // the pending data.
+            bool contiguous = mNALs.itemAt(0).nalOffset >= 4;
+            for (size_t i = 0; contiguous && i < mNALs.size(); ++i) {
+                const NALPosition &pos = mNALs.itemAt(i);
+
+                if (memcmp(src + pos.nalOffset - 4, "\x00\x00\x00\x01", 4)
+                        || (i > 0 && pos.nalOffset
+                            != mNALs.itemAt(i - 1).nalOffset
+                                + mNALs.itemAt(i - 1).nalSize + 4)) {
+                    contiguous = false;
+                }
+            }
+
+            size_t auSize = 4 * mNALs.size() + mNALsSize;
+            sp<ABuffer> accessUnit;
+
+            if (contiguous) {
+                accessUnit = slice(mNALs.itemAt(0).nalOffset - 4, auSize);
+            } else {
+                accessUnit = new ABuffer(auSize);
+
+                size_t dstOffset = 0;
+                for (size_t i = 0; i < mNALs.size(); ++i) {
+                    const NALPosition &pos = mNALs.itemAt(i);
 
-            size_t dstOffset = 0;
-            for (size_t i = 0; i < nals.size(); ++i) {
-                const NALPosition &pos = nals.itemAt(i);
+                    memcpy(accessUnit->data() + dstOffset,
+                           "\x00\x00\x00\x01", 4);
 
-                unsigned nalType = mBuffer->data()[pos.nalOffset] & 0x1f;
+                    memcpy(accessUnit->data() + dstOffset + 4,
+                           src + pos.nalOffset,
+                           pos.nalSize);
+
+                    dstOffset += pos.nalSize + 4;
+                }
+            }
 
 #if !LOG_NDEBUG
+            AString out;
+            for (size_t i = 0; i < mNALs.size(); ++i) {
                 char tmp[128];
-                sprintf(tmp, "0x%02x", nalType);
+                sprintf(tmp, "0x%02x", src[mNALs.itemAt(i).nalOffset] & 0x1f);
                 if (i > 0) {
                     out.append(", ");
                 }
                 out.append(tmp);
-#endif
-
-                memcpy(accessUnit->data() + dstOffset, "\x00\x00\x00\x01", 4);
-
-                memcpy(accessUnit->data() + dstOffset + 4,
-                       mBuffer->data() + pos.nalOffset,
-                       pos.nalSize);
-
-                dstOffset += pos.nalSize + 4;
             }
 
-            ALOGV("accessUnit contains nal types %s", out.c_str());
+            ALOGV("accessUnit contains nal types %s%s",
+                  out.c_str(), contiguous ? "" : " (copied)");
+#endif
 
-            const NALPosition &pos = nals.itemAt(nals.size() - 1);
+            const NALPosition &pos = mNALs.itemAt(mNALs.size() - 1);
             size_t nextScan = pos.nalOffset + pos.nalSize;
 
-            memmove(mBuffer->data(),
-                    mBuffer->data() + nextScan,
-                    mBuffer->size() - nextScan);
-
-            mBuffer->setRange(0, mBuffer->size() - nextScan);
+            consume(nextScan);
+            resetScan();
 
             int64_t timeUs = fetchTimestamp(nextScan);
             CHECK_GE(timeUs, 0ll);
@@ -556,9 +676,12 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
         pos.nalOffset = nalStart - mBuffer->data();
         pos.nalSize = nalSize;
 
-        nals.push(pos);
+        mNALs.push(pos);
+        mNALsSize += nalSize;
 
-        totalSize += nalSize;
+        // The trailing zeros of the nal unit are followed by the next
+        // start code.
+        mScanOffset = pos.nalOffset + pos.nalSize;
     }
     CHECK_EQ(err, (status_t)-EAGAIN);
 
@@ -587,14 +710,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGAudio() {
 
     unsigned layer = 4 - ((header >> 17) & 3);
 
-    sp<ABuffer> accessUnit = new ABuffer(frameSize);
-    memcpy(accessUnit->data(), data, frameSize);
-
-    memmove(mBuffer->data(),
-            mBuffer->data() + frameSize,
-            mBuffer->size() - frameSize);
-
-    mBuffer->setRange(0, mBuffer->size() - frameSize);
+    sp<ABuffer> accessUnit = slice(0, frameSize);
+    consume(frameSize);
 
     int64_t timeUs = fetchTimestamp(frameSize);
     CHECK_GE(timeUs, 0ll);
@@ -679,21 +796,23 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
 
     size_t offset = 0;
     while (offset + 3 < size) {
-        if (memcmp(&data[offset], "\x00\x00\x01", 3)) {
-            ++offset;
-            continue;
+        // The start code must be followed by its type.
+        ssize_t startCode = FindStartCode(&data[offset], size - offset - 1);
+        if (startCode < 0) {
+            break;
         }
+        offset += startCode;
 
         pprevStartCode = prevStartCode;
         prevStartCode = currentStartCode;
         currentStartCode = data[offset + 3];
 
         if (currentStartCode == 0xb3 && mFormat == NULL) {
-            memmove(mBuffer->data(), mBuffer->data() + offset, size - offset);
+            consume(offset);
+            data = mBuffer->data();
             size -= offset;
             (void)fetchTimestamp(offset);
             offset = 0;
-            mBuffer->setRange(0, size);
         }
 
         if ((prevStartCode == 0xb3 && currentStartCode != 0xb5)
@@ -719,11 +838,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
                 sp<ABuffer> csd = new ABuffer(offset);
                 memcpy(csd->data(), data, offset);
 
-                memmove(mBuffer->data(),
-                        mBuffer->data() + offset,
-                        mBuffer->size() - offset);
-
-                mBuffer->setRange(0, mBuffer->size() - offset);
+                consume(offset);
+                data = mBuffer->data();
                 size -= offset;
                 (void)fetchTimestamp(offset);
                 offset = 0;
@@ -744,14 +860,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
             if (!sawPictureStart) {
                 sawPictureStart = true;
             } else {
-                sp<ABuffer> accessUnit = new ABuffer(offset);
-                memcpy(accessUnit->data(), data, offset);
-
-                memmove(mBuffer->data(),
-                        mBuffer->data() + offset,
-                        mBuffer->size() - offset);
-
-                mBuffer->setRange(0, mBuffer->size() - offset);
+                sp<ABuffer> accessUnit = slice(0, offset);
+                consume(offset);
 
                 int64_t timeUs = fetchTimestamp(offset);
                 CHECK_GE(timeUs, 0ll);
@@ -787,16 +897,12 @@ static ssize_t getNextChunkSize(
         TRESPASS();
     }
 
-    size_t offset = 3;
-    while (offset + 2 < size) {
-        if (!memcmp(&data[offset], kStartCode, 3)) {
-            return offset;
-        }
-
-        ++offset;
+    ssize_t offset = FindStartCode(&data[3], size - 3);
+    if (offset < 0) {
+        return -EAGAIN;
     }
 
-    return -EAGAIN;
+    return 3 + offset;
 }
 
 sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
@@ -905,12 +1011,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
                 if (chunkType == 0xb6) {
                     offset += chunkSize;
 
-                    sp<ABuffer> accessUnit = new ABuffer(offset);
-                    memcpy(accessUnit->data(), data, offset);
-
-                    memmove(data, &data[offset], size - offset);
-                    size -= offset;
-                    mBuffer->setRange(0, size);
+                    sp<ABuffer> accessUnit = slice(0, offset);
+                    consume(offset);
 
                     int64_t timeUs = fetchTimestamp(offset);
                     CHECK_GE(timeUs, 0ll);
@@ -939,10 +1041,10 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
 
         if (discard) {
             (void)fetchTimestamp(offset);
-            memmove(data, &data[offset], size - offset);
+            consume(offset);
+            data = mBuffer->data();
             size -= offset;
             offset = 0;
-            mBuffer->setRange(0, size);
         } else {
             offset += chunkSize;
         }
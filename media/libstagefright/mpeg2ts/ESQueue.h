@@ -22,6 +22,7 @@
 #include <utils/Errors.h>
 #include <utils/List.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -37,6 +38,7 @@ struct ElementaryStreamQueue {
         MPEG4_VIDEO,
     };
     ElementaryStreamQueue(Mode mode);
+    ~ElementaryStreamQueue();
 
     status_t appendData(const void *data, size_t size, int64_t timeUs);
     void clear(bool clearFormat);
@@ -51,13 +53,43 @@ private:
         size_t mLength;
     };
 
+    struct NALPosition {
+        size_t nalOffset;
+        size_t nalSize;
+    };
+
+    // Data is appended to a segment and consumed by moving the start of its
+    // range, access units are returned as slices of it. A segment is only
+    // reused once none of its slices are alive, otherwise the pending data
+    // is copied to another one. The slices count themselves in their
+    // segment, the reference count of the segment is not used for that.
+    struct Segment;
+    struct Slice;
+
+    enum {
+        kMinSegmentSize = 512 * 1024,
+        kMaxSpareSegments = 4,
+    };
+
     Mode mMode;
 
-    sp<ABuffer> mBuffer;
+    sp<Segment> mBuffer;
+    List<sp<Segment> > mSpareSegments;
     List<RangeInfo> mRangeInfos;
 
     sp<MetaData> mFormat;
 
+    // NAL units of the next H.264 access unit found so far, at offsets from
+    // the start of the pending data, and where to resume the scan.
+    Vector<NALPosition> mNALs;
+    size_t mNALsSize;
+    size_t mScanOffset;
+    bool mFoundSlice;
+
+    void consume(size_t size);
+    sp<ABuffer> slice(size_t offset, size_t size);
+    void resetScan();
+
     sp<ABuffer> dequeueAccessUnitH264();
     sp<ABuffer> dequeueAccessUnitAAC();
     sp<ABuffer> dequeueAccessUnitMPEGAudio();
@@ -37,6 +37,9 @@ namespace android {
 
 static const size_t kTSPacketSize = 188;
 
+// Packets read from the data source and fed to the parser at once.
+static const size_t kNumPacketsPerRead = 16;
+
 struct MPEG2TSSource : public MediaSource {
     MPEG2TSSource(
             const sp<MPEG2TSExtractor> &extractor,
@@ -194,7 +197,8 @@ void MPEG2TSExtractor::init() {
             }
         }
 
-        if (++numPacketsParsed > 10000) {
+        numPacketsParsed += kNumPacketsPerRead;
+        if (numPacketsParsed > 10000) {
             break;
         }
     }
@@ -205,15 +209,18 @@ void MPEG2TSExtractor::init() {
 status_t MPEG2TSExtractor::feedMore() {
     Mutex::Autolock autoLock(mLock);
 
-    uint8_t packet[kTSPacketSize];
-    ssize_t n = mDataSource->readAt(mOffset, packet, kTSPacketSize);
+    uint8_t packets[kTSPacketSize * kNumPacketsPerRead];
+    ssize_t n = mDataSource->readAt(mOffset, packets, sizeof(packets));
 
     if (n < (ssize_t)kTSPacketSize) {
         return (n < 0) ? (status_t)n : ERROR_END_OF_STREAM;
     }
 
+    // A partial packet can only be at the end of the stream.
+    n -= n % kTSPacketSize;
+
     mOffset += n;
-    return mParser->feedTSPacket(packet, kTSPacketSize);
+    return mParser->feedTSPackets(packets, n);
 }
 
 void MPEG2TSExtractor::setLiveSession(const sp<LiveSession> &liveSession) {
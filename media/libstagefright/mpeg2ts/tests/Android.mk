@@ -0,0 +1,19 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Transport stream demux benchmark, takes a .ts file.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	ts_parser_bench.cpp
+
+LOCAL_C_INCLUDES:= \
+	$(TOP)/frameworks/base/include/media/stagefright/openmax \
+	$(TOP)/frameworks/base/media/libstagefright
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright libstagefright_foundation libutils
+
+LOCAL_MODULE:= ts_parser_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Transport stream demux throughput.
+//
+// Feeds a transport stream file, read into memory beforehand, through
+// ATSParser one packet at a time, or in batches of packets as
+// MPEG2TSExtractor does, and dequeues the access units of its
+// audio and video streams as they are produced, like NuPlayer does. Reports
+// the CPU time spent per MB of stream, which is what matters for high
+// bitrate (e.g. 40 Mbps H.264) streams, and the access units found.
+// The last few access units are kept alive, as a decoder would, so that
+// the queues can't reuse their memory right away.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/List.h>
+
+#include "mpeg2ts/ATSParser.h"
+#include "mpeg2ts/AnotherPacketSource.h"
+
+using namespace android;
+
+static const size_t kTSPacketSize = 188;
+static const size_t kMaxHeldAccessUnits = 16;
+
+static int64_t cpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct Track {
+    const char *name;
+    ATSParser::SourceType type;
+    sp<AnotherPacketSource> source;
+    uint32_t accessUnits;
+    uint64_t bytes;
+    int64_t firstTimeUs;
+    int64_t lastTimeUs;
+};
+
+static void drain(Track *track, List<sp<ABuffer> > *held) {
+    status_t finalResult;
+    while (track->source->hasBufferAvailable(&finalResult)) {
+        sp<ABuffer> accessUnit;
+        if (track->source->dequeueAccessUnit(&accessUnit) != OK) {
+            continue;
+        }
+        int64_t timeUs;
+        if (accessUnit->meta()->findInt64("timeUs", &timeUs)) {
+            if (track->accessUnits == 0) {
+                track->firstTimeUs = timeUs;
+            }
+            track->lastTimeUs = timeUs;
+        }
+        track->accessUnits++;
+        track->bytes += accessUnit->size();
+
+        held->push_back(accessUnit);
+        if (held->size() > kMaxHeldAccessUnits) {
+            held->erase(held->begin());
+        }
+    }
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n runs] [-b packets] file.ts\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -n times to demux the file (default 3)\n");
+    fprintf(stderr, "       -b packets fed to the parser at once (default 1)\n");
+}
+
+int main(int argc, char **argv) {
+    int runs = 3;
+    int batch = 1;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:b:")) >= 0) {
+        switch (res) {
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 1 != argc || runs <= 0 || batch <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "unable to open %s\n", argv[optind]);
+        return 1;
+    }
+    size_t size = (st.st_size / kTSPacketSize) * kTSPacketSize;
+    uint8_t *data = (uint8_t *)malloc(size);
+    if (data == NULL || read(fd, data, size) != (ssize_t)size) {
+        fprintf(stderr, "unable to read %s\n", argv[optind]);
+        return 1;
+    }
+    close(fd);
+
+    double mb = size / (1024.0 * 1024.0);
+    int64_t best = 0;
+    for (int run = 0; run < runs; run++) {
+        sp<ATSParser> parser = new ATSParser;
+        Track tracks[2] = {
+            { "video", ATSParser::VIDEO, NULL, 0, 0, 0, 0 },
+            { "audio", ATSParser::AUDIO, NULL, 0, 0, 0, 0 },
+        };
+        List<sp<ABuffer> > held;
+        status_t err = OK;
+
+        int64_t start = cpuTimeNs();
+        for (size_t offset = 0; offset < size; offset += batch * kTSPacketSize) {
+            if (batch == 1) {
+                err = parser->feedTSPacket(data + offset, kTSPacketSize);
+            } else {
+                size_t n = size - offset;
+                if (n > batch * kTSPacketSize) {
+                    n = batch * kTSPacketSize;
+                }
+                err = parser->feedTSPackets(data + offset, n);
+            }
+            if (err != OK) {
+                break;
+            }
+            for (int i = 0; i < 2; i++) {
+                Track *track = &tracks[i];
+                if (track->source == NULL) {
+                    sp<MediaSource> source = parser->getSource(track->type);
+                    if (source == NULL) {
+                        continue;
+                    }
+                    track->source = static_cast<AnotherPacketSource *>(source.get());
+                }
+                drain(track, &held);
+            }
+        }
+        int64_t cpu = cpuTimeNs() - start;
+        if (run == 0 || cpu < best) {
+            best = cpu;
+        }
+
+        printf("run %d: %.1f MB in %.1f ms cpu, %.2f ms/MB%s\n", run, mb, cpu * 1e-6,
+                cpu * 1e-6 / mb, err != OK ? " (stopped on malformed packet)" : "");
+        if (run == 0) {
+            for (int i = 0; i < 2; i++) {
+                const Track &t = tracks[i];
+                if (t.accessUnits == 0) {
+                    continue;
+                }
+                double seconds = (t.lastTimeUs - t.firstTimeUs) * 1e-6;
+                printf("  %s: %u access units, %.1f MB, %.2f Mbps\n", t.name, t.accessUnits,
+                        t.bytes / (1024.0 * 1024.0),
+                        seconds > 0 ? t.bytes * 8 / seconds * 1e-6 : 0.0);
+            }
+        }
+    }
+    printf("best: %.2f ms/MB, %.1f MB/s of cpu\n", best * 1e-6 / mb, mb / (best * 1e-9));
+
+    free(data);
+    return 0;
+}
@@ -44,6 +44,326 @@ include $(BUILD_EXECUTABLE)
 
 endif
 
+# Fragmented MPEG4 tests, the fixtures are generated by the test.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := FragmentedMPEG4_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	FragmentedMPEG4_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright \
+	libstagefright_foundation \
+	libstlport \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	$(TOP)/frameworks/base/include/media/stagefright/openmax \
+
+include $(BUILD_EXECUTABLE)
+
+# Cache tests, read through a throttled stand-in for the HTTP source.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := NuCachedSource2_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	NuCachedSource2_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright \
+	libstagefright_foundation \
+	libstlport \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	frameworks/base/media/libstagefright \
+	$(TOP)/frameworks/base/include/media/stagefright/openmax \
+
+include $(BUILD_EXECUTABLE)
+
+# HTTP live streaming tests, run on the device. The stream is served through
+# a throttled stand-in for the HTTP source.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := LiveSession_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	LiveSession_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libcrypto \
+	libstagefright \
+	libstagefright_foundation \
+	libstlport \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/openssl/include \
+	external/stlport/stlport \
+	frameworks/base/media/libstagefright \
+	$(TOP)/frameworks/base/include/media/stagefright/openmax \
+
+include $(BUILD_EXECUTABLE)
+
+# ColorConverter tests, the vector code and the bands against the C code.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := ColorConverter_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	ColorConverter_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright \
+	libstagefright_foundation \
+	libstlport \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	$(TOP)/frameworks/base/include/media/stagefright/openmax \
+
+include $(BUILD_EXECUTABLE)
+
+# Software H.264 decoder tests, decodes streams from the software encoder.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := H264SwDec_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	H264SwDec_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright \
+	libstagefright_avc_common \
+	libstagefright_soft_h264dec \
+	libstlport \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libstagefright_avcenc \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	frameworks/base/media/libstagefright/codecs/avc/common/include \
+	frameworks/base/media/libstagefright/codecs/avc/enc/src \
+	frameworks/base/media/libstagefright/codecs/on2/h264dec/inc \
+
+LOCAL_CFLAGS := \
+	-DOSCL_IMPORT_REF= -DOSCL_UNUSED_ARG= -DOSCL_EXPORT_REF=
+
+include $(BUILD_EXECUTABLE)
+
+# Batch MP3 decoder tests, the output against the frame by frame decoder.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := MP3BatchDecoder_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	MP3BatchDecoder_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstlport \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libstagefright_mp3dec \
+	libgtest \
+	libgtest_main \
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	frameworks/base/media/libstagefright/codecs/mp3dec/include \
+	frameworks/base/media/libstagefright/codecs/mp3dec/src \
+
+LOCAL_CFLAGS := \
+	-DOSCL_IMPORT_REF= -DOSCL_UNUSED_ARG= -DOSCL_EXPORT_REF=
+
+include $(BUILD_EXECUTABLE)
+
+# MPEG4 open and seek benchmark, takes a .mp4 file.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	mp4_seek_bench.cpp
+
+LOCAL_C_INCLUDES:= \
+	$(TOP)/frameworks/base/include/media/stagefright/openmax
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright libstagefright_foundation libutils
+
+LOCAL_MODULE:= mp4_seek_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+# MPEG4 writer memory use and crash recovery benchmark.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	mp4_writer_bench.cpp
+
+LOCAL_C_INCLUDES:= \
+	$(TOP)/frameworks/base/include/media/stagefright/openmax
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright libstagefright_foundation libutils
+
+LOCAL_MODULE:= mp4_writer_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+# MediaBufferGroup throughput with producer and consumer threads.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	media_buffer_group_bench.cpp
+
+LOCAL_C_INCLUDES:= \
+	$(TOP)/frameworks/base/include/media/stagefright/openmax
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright libcutils libutils
+
+LOCAL_MODULE:= media_buffer_group_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+# ColorConverter throughput at 1080p.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	color_converter_bench.cpp
+
+LOCAL_C_INCLUDES:= \
+	$(TOP)/frameworks/base/include/media/stagefright/openmax
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright libutils
+
+LOCAL_MODULE:= color_converter_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+# Software H.264 decoder throughput, takes a .h264 file.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	h264_decode_bench.cpp
+
+LOCAL_C_INCLUDES:= \
+	frameworks/base/media/libstagefright/codecs/on2/h264dec/inc
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright_soft_h264dec
+
+LOCAL_MODULE:= h264_decode_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+# Software AVC encoder benchmark, takes a planar YUV 4:2:0 sequence.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	avc_encode_bench.cpp
+
+LOCAL_C_INCLUDES:= \
+	frameworks/base/media/libstagefright/codecs/avc/common/include \
+	frameworks/base/media/libstagefright/codecs/avc/enc/src
+
+LOCAL_CFLAGS := \
+	-DOSCL_IMPORT_REF= -DOSCL_UNUSED_ARG= -DOSCL_EXPORT_REF=
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright_avc_common
+
+LOCAL_STATIC_LIBRARIES := \
+	libstagefright_avcenc
+
+LOCAL_MODULE:= avc_encode_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+# MP3 and AAC whole file decode time against the number of threads.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	audio_decode_bench.cpp
+
+LOCAL_C_INCLUDES:= \
+	frameworks/base/media/libstagefright/codecs/mp3dec/include \
+	frameworks/base/media/libstagefright/codecs/mp3dec/src \
+	frameworks/base/media/libstagefright/codecs/aacdec
+
+LOCAL_CFLAGS := \
+	-DOSCL_IMPORT_REF= -DOSCL_UNUSED_ARG= -DOSCL_EXPORT_REF=
+
+LOCAL_STATIC_LIBRARIES := \
+	libstagefright_mp3dec libstagefright_aacdec
+
+LOCAL_MODULE:= audio_decode_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
 # Include subdirectory makefiles
 # ============================================================
 
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "ColorConverter_test"
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <utils/Errors.h>
+#include <utils/Vector.h>
+
+#include <media/stagefright/ColorConverter.h>
+
+namespace android {
+
+static const OMX_COLOR_FORMATTYPE kSrcFormats[] = {
+    OMX_COLOR_FormatYUV420Planar,
+    OMX_COLOR_FormatCbYCrY,
+    OMX_QCOM_COLOR_FormatYVU420SemiPlanar,
+    OMX_COLOR_FormatYUV420SemiPlanar,
+    OMX_TI_COLOR_FormatYUV420PackedSemiPlanar,
+};
+
+static const OMX_COLOR_FORMATTYPE kDstFormats[] = {
+    OMX_COLOR_Format16bitRGB565,
+    OMX_COLOR_Format32bitARGB8888,
+    OMX_COLOR_Format32BitRGBA8888,
+};
+
+struct Frame {
+    size_t mWidth, mHeight;
+    size_t mCropLeft, mCropTop, mCropRight, mCropBottom;
+};
+
+class ColorConverterTest : public ::testing::Test {
+protected:
+    Vector<uint8_t> mSrc;
+    uint32_t mSeed;
+
+    virtual void SetUp() {
+        mSeed = 1;
+    }
+
+    // Noise over the whole range, which clips, and some flat areas.
+    void makeSource(const Frame &frame) {
+        size_t size = frame.mWidth * frame.mHeight * 2;
+        mSrc.clear();
+        mSrc.insertAt((uint8_t)0, 0, size);
+        for (size_t i = 0; i < size; ++i) {
+            mSeed = mSeed * 1103515245 + 12345;
+            mSrc.editItemAt(i) =
+                (i / 4096) % 3 == 0 ? (i / 4096) * 37 : mSeed >> 24;
+        }
+    }
+
+    static size_t bytesPerPixel(OMX_COLOR_FORMATTYPE format) {
+        return format == OMX_COLOR_Format16bitRGB565 ? 2 : 4;
+    }
+
+    status_t convert(
+            OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to,
+            bool scalarOnly, size_t numThreads, const Frame &frame,
+            Vector<uint8_t> *dst) {
+        ColorConverter converter(from, to);
+        EXPECT_TRUE(converter.isValid());
+        converter.setScalarOnly(scalarOnly);
+        converter.setNumThreads(numThreads);
+
+        // Stray writes outside of the crop show up in the comparisons.
+        dst->clear();
+        dst->insertAt(
+                (uint8_t)0x5a, 0,
+                frame.mWidth * frame.mHeight * bytesPerPixel(to));
+
+        return converter.convert(
+                mSrc.array(), frame.mWidth, frame.mHeight,
+                frame.mCropLeft, frame.mCropTop,
+                frame.mCropRight, frame.mCropBottom,
+                dst->editArray(), frame.mWidth, frame.mHeight,
+                frame.mCropLeft, frame.mCropTop,
+                frame.mCropRight, frame.mCropBottom);
+    }
+
+    void expectSame(
+            const Vector<uint8_t> &expected, const Vector<uint8_t> &actual,
+            const char *what) {
+        ASSERT_EQ(expected.size(), actual.size());
+        if (memcmp(expected.array(), actual.array(), expected.size())) {
+            for (size_t i = 0; i < expected.size(); ++i) {
+                if (expected[i] != actual[i]) {
+                    ADD_FAILURE() << what << " differs at byte " << i;
+                    break;
+                }
+            }
+        }
+    }
+};
+
+TEST_F(ColorConverterTest, VectorCodeMatchesScalarCode) {
+    static const Frame kFrames[] = {
+        { 176, 144, 0, 0, 175, 143 },
+        { 320, 240, 16, 8, 303, 231 },
+        { 64, 48, 2, 1, 60, 46 },      // Odd width and height.
+        { 36, 20, 0, 0, 35, 19 },      // Shorter than a vector.
+        { 1920, 1088, 0, 0, 1919, 1079 },
+    };
+
+    for (size_t f = 0; f < sizeof(kFrames) / sizeof(kFrames[0]); ++f) {
+        const Frame &frame = kFrames[f];
+        makeSource(frame);
+
+        for (size_t i = 0; i < sizeof(kSrcFormats) / sizeof(kSrcFormats[0]);
+             ++i) {
+            for (size_t j = 0;
+                 j < sizeof(kDstFormats) / sizeof(kDstFormats[0]); ++j) {
+                SCOPED_TRACE(testing::Message()
+                        << frame.mWidth << "x" << frame.mHeight
+                        << " from " << kSrcFormats[i]
+                        << " to " << kDstFormats[j]);
+
+                Vector<uint8_t> expected, actual;
+                status_t err = convert(
+                        kSrcFormats[i], kDstFormats[j], true, 1, frame,
+                        &expected);
+                EXPECT_EQ(err, convert(
+                        kSrcFormats[i], kDstFormats[j], false, 1, frame,
+                        &actual));
+                if (err == OK) {
+                    expectSame(expected, actual, "vector code");
+                }
+            }
+        }
+    }
+}
+
+TEST_F(ColorConverterTest, BandsMatchTheWholeFrame) {
+    static const Frame kFrames[] = {
+        { 1280, 720, 0, 0, 1279, 719 },
+        { 640, 362, 0, 0, 639, 361 },  // Bands of 122, 122 and 118 rows.
+        { 320, 127, 0, 0, 319, 126 },  // Too small for bands.
+    };
+
+    for (size_t f = 0; f < sizeof(kFrames) / sizeof(kFrames[0]); ++f) {
+        const Frame &frame = kFrames[f];
+        makeSource(frame);
+
+        for (size_t i = 0; i < sizeof(kSrcFormats) / sizeof(kSrcFormats[0]);
+             ++i) {
+            SCOPED_TRACE(testing::Message()
+                    << frame.mWidth << "x" << frame.mHeight
+                    << " from " << kSrcFormats[i]);
+
+            Vector<uint8_t> expected, actual;
+            ASSERT_EQ(OK, convert(
+                    kSrcFormats[i], OMX_COLOR_Format32BitRGBA8888, false, 1,
+                    frame, &expected));
+
+            for (size_t numThreads = 2; numThreads <= 4; ++numThreads) {
+                ASSERT_EQ(OK, convert(
+                        kSrcFormats[i], OMX_COLOR_Format32BitRGBA8888, false,
+                        numThreads, frame, &actual));
+                expectSame(expected, actual, "bands");
+            }
+        }
+    }
+}
+
+TEST_F(ColorConverterTest, ConvertsKnownColors) {
+    static const struct {
+        uint8_t y, u, v;
+        uint8_t r, g, b;
+        uint16_t rgb565;
+    } kColors[] = {
+        {  16, 128, 128,   0,   0,   0, 0x0000 },
+        { 235, 128, 128, 254, 254, 254, 0xffff },
+        {  81,  90, 240, 254,   0,   0, 0xf800 },
+        { 145,  54,  34,   0, 254,   0, 0x07e0 },
+        {  41, 240, 110,   0,   0, 254, 0x001f },
+    };
+
+    const Frame frame = { 32, 2, 0, 0, 31, 1 };
+    for (size_t i = 0; i < sizeof(kColors) / sizeof(kColors[0]); ++i) {
+        mSrc.clear();
+        mSrc.insertAt(kColors[i].y, 0, 64);
+        mSrc.insertAt(kColors[i].u, 64, 16);
+        mSrc.insertAt(kColors[i].v, 80, 16);
+
+        Vector<uint8_t> rgba, bgra, rgb565;
+        ASSERT_EQ(OK, convert(
+                OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format32BitRGBA8888,
+                false, 1, frame, &rgba));
+        ASSERT_EQ(OK, convert(
+                OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format32bitARGB8888,
+                false, 1, frame, &bgra));
+        ASSERT_EQ(OK, convert(
+                OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format16bitRGB565,
+                false, 1, frame, &rgb565));
+
+        for (size_t x = 0; x < 64; x += 21) {
+            EXPECT_NEAR(kColors[i].r, rgba[4 * x], 1) << i;
+            EXPECT_NEAR(kColors[i].g, rgba[4 * x + 1], 1) << i;
+            EXPECT_NEAR(kColors[i].b, rgba[4 * x + 2], 1) << i;
+            EXPECT_EQ(0xff, rgba[4 * x + 3]);
+
+            EXPECT_EQ(rgba[4 * x], bgra[4 * x + 2]);
+            EXPECT_EQ(rgba[4 * x + 1], bgra[4 * x + 1]);
+            EXPECT_EQ(rgba[4 * x + 2], bgra[4 * x]);
+            EXPECT_EQ(0xff, bgra[4 * x + 3]);
+
+            EXPECT_EQ(kColors[i].rgb565,
+                      rgb565[2 * x] | (rgb565[2 * x + 1] << 8)) << i;
+        }
+    }
+}
+
+}  // namespace android
@@ -0,0 +1,754 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "FragmentedMPEG4_test"
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <utils/Errors.h>
+#include <utils/Vector.h>
+
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/Utils.h>
+
+namespace android {
+
+// The fixtures are fragmented files written on the fly, with one second
+// fragments holding an AVC track at 30 fps, with a sync sample every 15
+// samples, and an AMR track with 20 ms samples.
+static const uint32_t kVideoTimescale = 3000;
+static const uint32_t kVideoSampleDuration = 100;
+static const uint32_t kVideoSamplesPerFragment = 30;
+static const uint32_t kVideoSyncInterval = 15;
+static const uint32_t kVideoCompositionOffset = 200;
+static const uint32_t kAudioTimescale = 8000;
+static const uint32_t kAudioSampleDuration = 160;
+static const uint32_t kAudioSamplesPerFragment = 50;
+static const uint32_t kAudioSampleSize = 32;
+
+struct FixtureOptions {
+    size_t numFragments;
+    bool hasAudio;
+    // 'sidx' after 'moov'.
+    bool hasSegmentIndex;
+    // 'mfra' at the end.
+    bool hasRandomAccess;
+    // 'tfdt' in the track fragments.
+    bool hasDecodeTime;
+    // Base offsets in 'tfhd' rather than data offsets in 'trun', leaving
+    // the audio track fragment to start where the video data ends.
+    bool explicitBaseOffsets;
+    // A sample count of 0xffffffff in the 'trun' of the audio track, which
+    // has no per sample fields.
+    bool hugeAudioSampleCount;
+};
+
+static int64_t videoSampleTimeUs(uint32_t n) {
+    return (int64_t)(n * kVideoSampleDuration + kVideoCompositionOffset)
+        * 1000000 / kVideoTimescale;
+}
+
+static int64_t audioSampleTimeUs(uint32_t n) {
+    return (int64_t)n * kAudioSampleDuration * 1000000 / kAudioTimescale;
+}
+
+class FixtureWriter {
+public:
+    FixtureWriter(const FixtureOptions &options)
+        : mOptions(options) {
+    }
+
+    void write(Vector<uint8_t> *out) {
+        mData.clear();
+
+        writeHeader();
+
+        size_t fragmentsOffset = mData.size();
+        if (mOptions.hasSegmentIndex) {
+            fragmentsOffset += 32 + 12 * mOptions.numFragments;
+        }
+
+        Vector<uint32_t> fragmentSizes;
+        Vector<uint32_t> fragmentOffsets;
+        Vector<uint8_t> header = mData;
+        mData.clear();
+        for (size_t i = 0; i < mOptions.numFragments; ++i) {
+            size_t start = mData.size();
+            fragmentOffsets.push(fragmentsOffset + start);
+            writeFragment(i, fragmentsOffset + start);
+            fragmentSizes.push(mData.size() - start);
+        }
+        Vector<uint8_t> fragments = mData;
+
+        mData = header;
+        if (mOptions.hasSegmentIndex) {
+            size_t box = beginBox("sidx");
+            put32(0);
+            put32(1);  // reference_ID
+            put32(kVideoTimescale);
+            put32(0);  // earliest_presentation_time
+            put32(0);  // first_offset
+            put16(0);
+            put16(mOptions.numFragments);
+            for (size_t i = 0; i < mOptions.numFragments; ++i) {
+                put32(fragmentSizes[i]);
+                put32(kVideoSamplesPerFragment * kVideoSampleDuration);
+                put32(0x90000000);  // starts_with_SAP, SAP type 1
+            }
+            endBox(box);
+        }
+        mData.appendVector(fragments);
+
+        if (mOptions.hasRandomAccess) {
+            size_t mfra = beginBox("mfra");
+            size_t tfra = beginBox("tfra");
+            put32(0);
+            put32(1);  // track_ID
+            put32(0);  // 1 byte traf, trun and sample numbers
+            put32(mOptions.numFragments);
+            for (size_t i = 0; i < mOptions.numFragments; ++i) {
+                put32(i * kVideoSamplesPerFragment * kVideoSampleDuration
+                        + kVideoCompositionOffset);
+                put32(fragmentOffsets[i]);
+                put8(1);
+                put8(1);
+                put8(1);
+            }
+            endBox(tfra);
+            size_t mfro = beginBox("mfro");
+            put32(0);
+            put32(mData.size() - mfra + 4);
+            endBox(mfro);
+            endBox(mfra);
+        }
+
+        *out = mData;
+    }
+
+private:
+    FixtureOptions mOptions;
+    Vector<uint8_t> mData;
+
+    void put8(uint8_t x) {
+        mData.push(x);
+    }
+
+    void put16(uint16_t x) {
+        put8(x >> 8);
+        put8(x);
+    }
+
+    void put32(uint32_t x) {
+        put16(x >> 16);
+        put16(x);
+    }
+
+    void putZeros(size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            put8(0);
+        }
+    }
+
+    size_t beginBox(const char *type) {
+        size_t offset = mData.size();
+        put32(0);
+        for (size_t i = 0; i < 4; ++i) {
+            put8(type[i]);
+        }
+        return offset;
+    }
+
+    void endBox(size_t offset) {
+        patch32(offset, mData.size() - offset);
+    }
+
+    void patch32(size_t offset, uint32_t x) {
+        mData.editItemAt(offset) = x >> 24;
+        mData.editItemAt(offset + 1) = x >> 16;
+        mData.editItemAt(offset + 2) = x >> 8;
+        mData.editItemAt(offset + 3) = x;
+    }
+
+    void writeEmptySampleTable() {
+        size_t stts = beginBox("stts");
+        put32(0);
+        put32(0);
+        endBox(stts);
+        size_t stsc = beginBox("stsc");
+        put32(0);
+        put32(0);
+        endBox(stsc);
+        size_t stsz = beginBox("stsz");
+        put32(0);
+        put32(0);
+        put32(0);
+        endBox(stsz);
+        size_t stco = beginBox("stco");
+        put32(0);
+        put32(0);
+        endBox(stco);
+    }
+
+    void writeTrack(uint32_t trackID, uint32_t timescale, const char *handler) {
+        size_t tkhd = beginBox("tkhd");
+        put32(7);
+        put32(0);
+        put32(0);
+        put32(trackID);
+        put32(0);
+        put32(0);  // duration
+        putZeros(16);
+        static const uint32_t kMatrix[] = {
+            0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000 };
+        for (size_t i = 0; i < 9; ++i) {
+            put32(kMatrix[i]);
+        }
+        put32(trackID == 1 ? 320 << 16 : 0);
+        put32(trackID == 1 ? 240 << 16 : 0);
+        endBox(tkhd);
+
+        size_t mdia = beginBox("mdia");
+        size_t mdhd = beginBox("mdhd");
+        put32(0);
+        put32(0);
+        put32(0);
+        put32(timescale);
+        put32(0);  // duration
+        put16(0x55c4);  // "und"
+        put16(0);
+        endBox(mdhd);
+        size_t hdlr = beginBox("hdlr");
+        put32(0);
+        put32(0);
+        for (size_t i = 0; i < 4; ++i) {
+            put8(handler[i]);
+        }
+        putZeros(13);
+        endBox(hdlr);
+
+        size_t minf = beginBox("minf");
+        size_t stbl = beginBox("stbl");
+        size_t stsd = beginBox("stsd");
+        put32(0);
+        put32(1);
+        if (trackID == 1) {
+            size_t avc1 = beginBox("avc1");
+            putZeros(6);
+            put16(1);  // data_reference_index
+            putZeros(16);
+            put16(320);
+            put16(240);
+            putZeros(50);
+            size_t avcC = beginBox("avcC");
+            put8(1);
+            put8(0x42);
+            put8(0xc0);
+            put8(0x1e);
+            put8(0xff);  // 4 byte NAL lengths
+            put8(0xe0);  // no SPS
+            put8(0);     // no PPS
+            endBox(avcC);
+            endBox(avc1);
+        } else {
+            size_t samr = beginBox("samr");
+            putZeros(6);
+            put16(1);  // data_reference_index
+            putZeros(8);
+            put16(1);
+            put16(16);
+            putZeros(4);
+            put32(8000 << 16);
+            endBox(samr);
+        }
+        endBox(stsd);
+        writeEmptySampleTable();
+        endBox(stbl);
+        endBox(minf);
+        endBox(mdia);
+    }
+
+    void writeHeader() {
+        size_t ftyp = beginBox("ftyp");
+        put32(FOURCC('i', 's', 'o', '5'));
+        put32(0);
+        put32(FOURCC('i', 's', 'o', '5'));
+        endBox(ftyp);
+
+        size_t moov = beginBox("moov");
+        size_t mvhd = beginBox("mvhd");
+        put32(0);
+        put32(0);
+        put32(0);
+        put32(1000);
+        put32(0);  // duration
+        put32(0x10000);
+        put16(0x100);
+        putZeros(10 + 36 + 24);
+        put32(3);
+        endBox(mvhd);
+
+        size_t trak = beginBox("trak");
+        writeTrack(1, kVideoTimescale, "vide");
+        endBox(trak);
+
+        if (mOptions.hasAudio) {
+            trak = beginBox("trak");
+            writeTrack(2, kAudioTimescale, "soun");
+            endBox(trak);
+        }
+
+        size_t mvex = beginBox("mvex");
+        size_t mehd = beginBox("mehd");
+        put32(0);
+        put32(mOptions.numFragments * 1000);
+        endBox(mehd);
+        size_t trex = beginBox("trex");
+        put32(0);
+        put32(1);
+        put32(1);
+        put32(kVideoSampleDuration);
+        put32(0);
+        put32(0x10000);  // non sync
+        endBox(trex);
+        if (mOptions.hasAudio) {
+            trex = beginBox("trex");
+            put32(0);
+            put32(2);
+            put32(1);
+            put32(kAudioSampleDuration);
+            put32(kAudioSampleSize);
+            put32(0);
+            endBox(trex);
+        }
+        endBox(mvex);
+        endBox(moov);
+    }
+
+    // Each video sample is a single NAL unit holding the sample number,
+    // each audio sample starts with it.
+    static size_t videoSampleSize() {
+        return 4 + 1 + 4;
+    }
+
+    void writeFragment(size_t index, size_t fileOffset) {
+        uint32_t firstVideoSample = index * kVideoSamplesPerFragment;
+        uint32_t firstAudioSample = index * kAudioSamplesPerFragment;
+
+        size_t moof = beginBox("moof");
+        size_t mfhd = beginBox("mfhd");
+        put32(0);
+        put32(index + 1);
+        endBox(mfhd);
+
+        // Video
+        size_t traf = beginBox("traf");
+        size_t tfhd = beginBox("tfhd");
+        size_t videoBasePatch = 0;
+        if (mOptions.explicitBaseOffsets) {
+            put32(0x01);
+            put32(1);
+            put32(0);
+            videoBasePatch = mData.size();
+            put32(0);
+        } else {
+            put32(0x20000);
+            put32(1);
+        }
+        endBox(tfhd);
+        if (mOptions.hasDecodeTime) {
+            size_t tfdt = beginBox("tfdt");
+            put8(1);
+            putZeros(3);
+            put32(0);
+            put32(firstVideoSample * kVideoSampleDuration);
+            endBox(tfdt);
+        }
+        size_t trun = beginBox("trun");
+        put32((mOptions.explicitBaseOffsets ? 0 : 0x01) | 0x04 | 0x200 | 0x400 | 0x800);
+        put32(kVideoSamplesPerFragment);
+        size_t videoDataPatch = mData.size();
+        if (!mOptions.explicitBaseOffsets) {
+            put32(0);
+        }
+        put32(0);  // first sample flags: sync
+        for (uint32_t i = 0; i < kVideoSamplesPerFragment; ++i) {
+            put32(videoSampleSize());
+            put32((i % kVideoSyncInterval) == 0 ? 0 : 0x10000);
+            put32(kVideoCompositionOffset);
+        }
+        endBox(trun);
+        endBox(traf);
+
+        size_t audioDataPatch = 0;
+        if (mOptions.hasAudio) {
+            traf = beginBox("traf");
+            tfhd = beginBox("tfhd");
+            // Without a base offset, the explicit case follows the video.
+            put32(mOptions.explicitBaseOffsets ? 0 : 0x20000);
+            put32(2);
+            endBox(tfhd);
+            if (mOptions.hasDecodeTime) {
+                size_t tfdt = beginBox("tfdt");
+                put32(0);
+                put32(firstAudioSample * kAudioSampleDuration);
+                endBox(tfdt);
+            }
+            trun = beginBox("trun");
+            put32(mOptions.explicitBaseOffsets ? 0 : 0x01);
+            put32(mOptions.hugeAudioSampleCount
+                    ? 0xffffffff : kAudioSamplesPerFragment);
+            audioDataPatch = mData.size();
+            if (!mOptions.explicitBaseOffsets) {
+                put32(0);
+            }
+            endBox(trun);
+            endBox(traf);
+        }
+        endBox(moof);
+
+        size_t mdat = beginBox("mdat");
+        size_t videoData = mData.size();
+        for (uint32_t i = 0; i < kVideoSamplesPerFragment; ++i) {
+            put32(5);
+            put8((i % kVideoSyncInterval) == 0 ? 0x65 : 0x41);
+            put32(firstVideoSample + i);
+        }
+        size_t audioData = mData.size();
+        if (mOptions.hasAudio) {
+            for (uint32_t i = 0; i < kAudioSamplesPerFragment; ++i) {
+                put32(firstAudioSample + i);
+                putZeros(kAudioSampleSize - 4);
+            }
+        }
+        endBox(mdat);
+
+        if (mOptions.explicitBaseOffsets) {
+            patch32(videoBasePatch, fileOffset + videoData - moof);
+        } else {
+            patch32(videoDataPatch, videoData - moof);
+            if (mOptions.hasAudio) {
+                patch32(audioDataPatch, audioData - moof);
+            }
+        }
+    }
+};
+
+// A file in memory, of which only the first "visibleSize" bytes have been
+// written yet.
+struct FixtureSource : public DataSource {
+    FixtureSource(const Vector<uint8_t> &data)
+        : mData(data),
+          mVisibleSize(data.size()) {
+    }
+
+    void setVisibleSize(size_t size) {
+        mVisibleSize = size;
+    }
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset >= (off64_t)mVisibleSize) {
+            return 0;
+        }
+        if (offset + size > mVisibleSize) {
+            size = mVisibleSize - offset;
+        }
+        memcpy(data, mData.array() + offset, size);
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mVisibleSize;
+        return OK;
+    }
+
+private:
+    Vector<uint8_t> mData;
+    size_t mVisibleSize;
+};
+
+class FragmentedMPEG4Test : public ::testing::Test {
+protected:
+    sp<FixtureSource> mSource;
+    sp<MediaExtractor> mExtractor;
+
+    void open(const FixtureOptions &options) {
+        Vector<uint8_t> data;
+        FixtureWriter(options).write(&data);
+        mSource = new FixtureSource(data);
+        mExtractor = MediaExtractor::Create(
+                mSource, MEDIA_MIMETYPE_CONTAINER_MPEG4);
+        ASSERT_TRUE(mExtractor != NULL);
+        ASSERT_EQ(options.hasAudio ? 2u : 1u, mExtractor->countTracks());
+    }
+
+    // Reads the next sample, returning its number.
+    static status_t readSample(
+            const sp<MediaSource> &source, uint32_t *n, int64_t *timeUs,
+            bool *isSync, MediaSource::ReadOptions *options = NULL) {
+        MediaBuffer *buffer;
+        status_t err = source->read(&buffer, options);
+        if (err != OK) {
+            return err;
+        }
+
+        const uint8_t *data =
+            (const uint8_t *)buffer->data() + buffer->range_offset();
+        if (buffer->range_length() == 4 + 1 + 4) {
+            // Video, with a start code.
+            *n = U32_AT(&data[5]);
+        } else {
+            *n = U32_AT(data);
+        }
+
+        EXPECT_TRUE(buffer->meta_data()->findInt64(kKeyTime, timeUs));
+        int32_t sync;
+        *isSync = buffer->meta_data()->findInt32(kKeyIsSyncFrame, &sync)
+            && sync != 0;
+
+        buffer->release();
+        return OK;
+    }
+
+    static void readAll(
+            const sp<MediaSource> &source, bool isVideo, uint32_t count) {
+        uint32_t n;
+        int64_t timeUs;
+        bool isSync;
+        for (uint32_t i = 0; i < count; ++i) {
+            ASSERT_EQ(OK, readSample(source, &n, &timeUs, &isSync));
+            ASSERT_EQ(i, n);
+            if (isVideo) {
+                ASSERT_EQ(videoSampleTimeUs(i), timeUs);
+                ASSERT_EQ((i % kVideoSyncInterval) == 0, isSync);
+            } else {
+                ASSERT_EQ(audioSampleTimeUs(i), timeUs);
+                ASSERT_TRUE(isSync);
+            }
+        }
+        ASSERT_EQ(ERROR_END_OF_STREAM, readSample(source, &n, &timeUs, &isSync));
+    }
+
+    // Checks the sync samples found seeking the video track around each of
+    // them in all modes.
+    void checkSeeks(size_t numFragments) {
+        sp<MediaSource> video = mExtractor->getTrack(0);
+        ASSERT_EQ(OK, video->start());
+
+        uint32_t numSamples = numFragments * kVideoSamplesPerFragment;
+        int64_t halfIntervalUs = videoSampleTimeUs(kVideoSyncInterval / 2) - videoSampleTimeUs(0);
+        for (uint32_t sync = 0; sync < numSamples; sync += kVideoSyncInterval) {
+            // Rounded up, so as not to fall just before the sample.
+            int64_t syncTimeUs = videoSampleTimeUs(sync) + 1;
+            uint32_t next = sync + kVideoSyncInterval;
+            uint32_t closestNext = next < numSamples ? next : sync;
+
+            struct {
+                int64_t timeUs;
+                MediaSource::ReadOptions::SeekMode mode;
+                uint32_t expected;
+            } seeks[] = {
+                { syncTimeUs, MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC, sync },
+                { syncTimeUs + 1000, MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC, sync },
+                { syncTimeUs, MediaSource::ReadOptions::SEEK_NEXT_SYNC, sync },
+                { syncTimeUs + 1000, MediaSource::ReadOptions::SEEK_NEXT_SYNC, next },
+                { syncTimeUs + halfIntervalUs - 1000,
+                  MediaSource::ReadOptions::SEEK_CLOSEST_SYNC, sync },
+                { syncTimeUs + halfIntervalUs + 40000,
+                  MediaSource::ReadOptions::SEEK_CLOSEST_SYNC, closestNext },
+                { videoSampleTimeUs(sync + 3) + 1000,
+                  MediaSource::ReadOptions::SEEK_CLOSEST, sync },
+            };
+
+            for (size_t i = 0; i < sizeof(seeks) / sizeof(seeks[0]); ++i) {
+                MediaSource::ReadOptions options;
+                options.setSeekTo(seeks[i].timeUs, seeks[i].mode);
+
+                uint32_t n;
+                int64_t timeUs;
+                bool isSync;
+                status_t err = readSample(video, &n, &timeUs, &isSync, &options);
+                if (seeks[i].expected >= numSamples) {
+                    EXPECT_EQ(ERROR_END_OF_STREAM, err);
+                    continue;
+                }
+
+                ASSERT_EQ(OK, err) << "seek " << i << " around sample " << sync;
+                EXPECT_EQ(seeks[i].expected, n)
+                    << "seek " << i << " around sample " << sync;
+                EXPECT_TRUE(isSync);
+
+                // Playback goes on from there.
+                ASSERT_EQ(OK, readSample(video, &n, &timeUs, &isSync));
+                EXPECT_EQ(seeks[i].expected + 1, n);
+            }
+        }
+
+        // Seeking past the end finds the last sync sample, or nothing.
+        MediaSource::ReadOptions options;
+        uint32_t n;
+        int64_t timeUs;
+        bool isSync;
+        options.setSeekTo(numFragments * 1000000ll + 500000,
+                          MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC);
+        ASSERT_EQ(OK, readSample(video, &n, &timeUs, &isSync, &options));
+        EXPECT_EQ(numSamples - kVideoSyncInterval, n);
+        options.setSeekTo(numFragments * 1000000ll + 500000,
+                          MediaSource::ReadOptions::SEEK_NEXT_SYNC);
+        EXPECT_EQ(ERROR_END_OF_STREAM,
+                  readSample(video, &n, &timeUs, &isSync, &options));
+
+        ASSERT_EQ(OK, video->stop());
+    }
+};
+
+TEST_F(FragmentedMPEG4Test, ReadsAllSamples) {
+    FixtureOptions options = { 5, true, true, false, true, false };
+    open(options);
+
+    sp<MetaData> meta = mExtractor->getTrackMetaData(0, 0);
+    const char *mime;
+    ASSERT_TRUE(meta->findCString(kKeyMIMEType, &mime));
+    EXPECT_STREQ(MEDIA_MIMETYPE_VIDEO_AVC, mime);
+    int64_t durationUs;
+    ASSERT_TRUE(meta->findInt64(kKeyDuration, &durationUs));
+    EXPECT_EQ(5000000ll, durationUs);
+    int32_t maxInputSize;
+    ASSERT_TRUE(meta->findInt32(kKeyMaxInputSize, &maxInputSize));
+    EXPECT_GE(maxInputSize, 320 * 240 * 3 / 2);
+
+    for (size_t i = 0; i < 2; ++i) {
+        sp<MediaSource> source = mExtractor->getTrack(i);
+        ASSERT_EQ(OK, source->start());
+        readAll(source, i == 0,
+                5 * (i == 0 ? kVideoSamplesPerFragment : kAudioSamplesPerFragment));
+        ASSERT_EQ(OK, source->stop());
+    }
+}
+
+TEST_F(FragmentedMPEG4Test, ReadsImplicitOffsetsWithoutDecodeTimes) {
+    FixtureOptions options = { 4, true, false, false, false, true };
+    open(options);
+
+    for (size_t i = 0; i < 2; ++i) {
+        sp<MediaSource> source = mExtractor->getTrack(i);
+        ASSERT_EQ(OK, source->start());
+        readAll(source, i == 0,
+                4 * (i == 0 ? kVideoSamplesPerFragment : kAudioSamplesPerFragment));
+        ASSERT_EQ(OK, source->stop());
+    }
+}
+
+TEST_F(FragmentedMPEG4Test, SeeksWithSegmentIndex) {
+    FixtureOptions options = { 6, true, true, false, true, false };
+    open(options);
+    checkSeeks(6);
+}
+
+TEST_F(FragmentedMPEG4Test, SeeksWithRandomAccessBox) {
+    FixtureOptions options = { 6, true, false, true, true, false };
+    open(options);
+    checkSeeks(6);
+}
+
+TEST_F(FragmentedMPEG4Test, SeeksWithoutIndex) {
+    FixtureOptions options = { 6, false, false, false, false, true };
+    open(options);
+    checkSeeks(6);
+}
+
+TEST_F(FragmentedMPEG4Test, RejectsHugeSampleCounts) {
+    FixtureOptions options = { 2, true, false, false, true, false, true };
+    open(options);
+
+    for (size_t i = 0; i < 2; ++i) {
+        sp<MediaSource> source = mExtractor->getTrack(i);
+        ASSERT_EQ(OK, source->start());
+        uint32_t n;
+        int64_t timeUs;
+        bool isSync;
+        EXPECT_EQ(ERROR_MALFORMED, readSample(source, &n, &timeUs, &isSync));
+        ASSERT_EQ(OK, source->stop());
+    }
+}
+
+TEST_F(FragmentedMPEG4Test, ReadsFragmentsAsTheyArrive) {
+    FixtureOptions options = { 4, true, false, false, true, false };
+    Vector<uint8_t> data;
+    FixtureWriter(options).write(&data);
+
+    // Only 'moov' and part of the first fragment are there to begin with.
+    size_t visibleSize = 0;
+    while (visibleSize + 4 < data.size()
+            && memcmp(data.array() + visibleSize, "moof", 4)) {
+        ++visibleSize;
+    }
+    visibleSize += 100;
+
+    sp<FixtureSource> source = new FixtureSource(data);
+    source->setVisibleSize(visibleSize);
+
+    sp<MediaExtractor> extractor =
+        MediaExtractor::Create(source, MEDIA_MIMETYPE_CONTAINER_MPEG4);
+    ASSERT_TRUE(extractor != NULL);
+    ASSERT_EQ(2u, extractor->countTracks());
+
+    sp<MediaSource> video = extractor->getTrack(0);
+    ASSERT_EQ(OK, video->start());
+
+    uint32_t expected = 0;
+    while (visibleSize < data.size()) {
+        uint32_t n;
+        int64_t timeUs;
+        bool isSync;
+        status_t err;
+        while ((err = readSample(video, &n, &timeUs, &isSync)) == OK) {
+            ASSERT_EQ(expected, n);
+            ASSERT_EQ(videoSampleTimeUs(expected), timeUs);
+            ++expected;
+        }
+        ASSERT_EQ(ERROR_END_OF_STREAM, err);
+
+        visibleSize += 700;
+        if (visibleSize > data.size()) {
+            visibleSize = data.size();
+        }
+        source->setVisibleSize(visibleSize);
+    }
+
+    uint32_t n;
+    int64_t timeUs;
+    bool isSync;
+    while (readSample(video, &n, &timeUs, &isSync) == OK) {
+        ASSERT_EQ(expected, n);
+        ++expected;
+    }
+    EXPECT_EQ(4 * kVideoSamplesPerFragment, expected);
+
+    ASSERT_EQ(OK, video->stop());
+}
+
+}  // namespace android
@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "H264SwDec_test"
+
+// The software H.264 decoder must be bit exact, whichever kernels it was
+// built with and however many threads it uses. Streams from the software
+// encoder are decoded and every picture is compared to the encoder's own
+// reconstruction.
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/Vector.h>
+
+#include "avcenc_api.h"
+#include "H264SwDecApi.h"
+
+namespace android {
+
+struct Frames {
+    Vector<uint8_t *> mBuffers;
+    size_t mSize;
+};
+
+static int32_t MallocWrapper(void *userData, int32_t size, int32_t attrs) {
+    return reinterpret_cast<int32_t>(malloc(size));
+}
+
+static void FreeWrapper(void *userData, int32_t ptr) {
+    free(reinterpret_cast<void *>(ptr));
+}
+
+static int32_t DpbAllocWrapper(
+        void *userData, unsigned int sizeInMbs, unsigned int numBuffers) {
+    Frames *frames = static_cast<Frames *>(userData);
+    frames->mSize = (sizeInMbs << 7) * 3;
+    for (unsigned int i = 0; i < numBuffers; ++i) {
+        frames->mBuffers.push((uint8_t *)malloc(frames->mSize));
+    }
+    return 1;
+}
+
+static int32_t BindFrameWrapper(void *userData, int32_t index, uint8_t **yuv) {
+    Frames *frames = static_cast<Frames *>(userData);
+    *yuv = frames->mBuffers[index];
+    return 1;
+}
+
+static void UnbindFrameWrapper(void *userData, int32_t index) {
+}
+
+class H264SwDecTest : public ::testing::Test {
+protected:
+    enum ScreenContent {
+        kCamera,            // screen_content off
+        kScreen,            // screen_content on, every macroblock compared
+        kScreenBlockHint,   // and the moving block given as dirty rectangle
+        kScreenEmptyHint,   // and an empty dirty rectangle, nothing changed
+    };
+
+    size_t mWidth, mHeight;
+    ScreenContent mScreenContent;
+    Vector<uint8_t> mStream;
+    Vector<Vector<uint8_t> > mRecon;
+
+    // Encodes frames of a panning texture with a block moving across it, so
+    // that the stream has sub-pixel motion, intra and inter blocks and
+    // residual in every block size. With more than one slice group the
+    // macroblock rows go to the groups in turn and every picture has one
+    // slice per group. Screen content does not pan, only the block moves.
+    void encode(size_t width, size_t height, size_t numFrames,
+                int32_t idrPeriod, uint32_t qp, int numSliceGroups = 1,
+                ScreenContent screenContent = kCamera) {
+        mWidth = width;
+        mHeight = height;
+        mScreenContent = screenContent;
+        mStream.clear();
+        mRecon.clear();
+
+        Frames frames;
+        tagAVCHandle handle;
+        memset(&handle, 0, sizeof(handle));
+        handle.userData = &frames;
+        handle.CBAVC_DPBAlloc = DpbAllocWrapper;
+        handle.CBAVC_FrameBind = BindFrameWrapper;
+        handle.CBAVC_FrameUnbind = UnbindFrameWrapper;
+        handle.CBAVC_Malloc = MallocWrapper;
+        handle.CBAVC_Free = FreeWrapper;
+
+        Vector<uint32_t> sliceGroup;
+        for (size_t i = 0; i < (width / 16) * (height / 16); ++i) {
+            sliceGroup.push((i / (width / 16)) % numSliceGroups);
+        }
+
+        tagAVCEncParam params;
+        memset(&params, 0, sizeof(params));
+        params.width = width;
+        params.height = height;
+        params.frame_rate = 30000;
+        params.rate_control = AVC_OFF;
+        params.bitrate = 1000000;
+        params.initQP = qp;
+        params.init_CBP_removal_delay = 1600;
+        params.CPB_size = params.bitrate >> 1;
+        params.auto_scd = AVC_ON;
+        params.out_of_band_param_set = AVC_ON;
+        params.poc_type = 2;
+        params.log2_max_poc_lsb_minus_4 = 12;
+        params.num_ref_frame = 1;
+        params.num_slice_group = numSliceGroups;
+        params.fmo_type = 6;
+        params.slice_group = sliceGroup.editArray();
+        params.db_filter = AVC_ON;
+        params.search_range = 16;
+        params.sub_pel = AVC_ON;
+        params.submb_pred = AVC_ON;
+        params.idr_period = idrPeriod;
+        params.screen_content = (screenContent == kCamera) ? AVC_OFF : AVC_ON;
+        params.profile = AVC_BASELINE;
+        params.level = AVC_LEVEL3_1;
+        ASSERT_EQ(AVCENC_SUCCESS,
+                  PVAVCEncInitialize(&handle, &params, NULL, NULL));
+
+        Vector<uint8_t> nal;
+        nal.insertAt((uint8_t)0, 0, width * height * 2);
+        uint32_t size;
+        int32_t type;
+        for (;;) {
+            size = nal.size();
+            if (PVAVCEncodeNAL(&handle, nal.editArray(), &size, &type)
+                    != AVCENC_SUCCESS) {
+                break;
+            }
+            appendNal(nal.array(), size);
+        }
+
+        Vector<uint8_t> yuv;
+        yuv.insertAt((uint8_t)0, 0, width * height * 3 / 2);
+        for (size_t i = 0; i < numFrames; ++i) {
+            makeFrame(i, yuv.editArray());
+
+            if (screenContent == kScreenBlockHint) {
+                // Where the block was and where it is now, given before
+                // the frame since the motion search runs in SetInput.
+                size_t prevX = blockX(i > 0 ? i - 1 : 0);
+                size_t currX = blockX(i);
+                size_t left = prevX < currX ? prevX : currX;
+                size_t right = (prevX > currX ? prevX : currX) + width / 8;
+                ASSERT_EQ(AVCENC_SUCCESS, PVAVCEncAddDirtyRect(
+                        &handle, left, blockTop(), right, blockBottom()));
+            } else if (screenContent == kScreenEmptyHint) {
+                ASSERT_EQ(AVCENC_SUCCESS,
+                          PVAVCEncAddDirtyRect(&handle, 0, 0, 0, 0));
+            }
+
+            AVCFrameIO in;
+            memset(&in, 0, sizeof(in));
+            in.height = height;
+            in.pitch = width;
+            in.coding_timestamp = i * 33;
+            in.disp_order = i;
+            in.YCbCr[0] = yuv.editArray();
+            in.YCbCr[1] = in.YCbCr[0] + width * height;
+            in.YCbCr[2] = in.YCbCr[1] + width * height / 4;
+            AVCEnc_Status status = PVAVCEncSetInput(&handle, &in);
+            if (status != AVCENC_SUCCESS && status != AVCENC_NEW_IDR) {
+                continue;
+            }
+
+            do {
+                size = nal.size();
+                status = PVAVCEncodeNAL(
+                        &handle, nal.editArray(), &size, &type);
+                ASSERT_TRUE(status == AVCENC_SUCCESS
+                        || status == AVCENC_PICTURE_READY);
+                appendNal(nal.array(), size);
+            } while (status != AVCENC_PICTURE_READY);
+
+            AVCFrameIO recon;
+            ASSERT_EQ(AVCENC_SUCCESS, PVAVCEncGetRecon(&handle, &recon));
+            Vector<uint8_t> picture;
+            for (size_t y = 0; y < height; ++y) {
+                picture.appendArray(recon.YCbCr[0] + y * recon.pitch, width);
+            }
+            for (size_t c = 1; c < 3; ++c) {
+                for (size_t y = 0; y < height / 2; ++y) {
+                    picture.appendArray(
+                            recon.YCbCr[c] + y * recon.pitch / 2, width / 2);
+                }
+            }
+            mRecon.push(picture);
+            PVAVCEncReleaseRecon(&handle, &recon);
+        }
+
+        PVAVCCleanUpEncoder(&handle);
+        for (size_t i = 0; i < frames.mBuffers.size(); ++i) {
+            free(frames.mBuffers[i]);
+        }
+    }
+
+    size_t blockX(size_t index) const { return (index * 5) % mWidth; }
+    size_t blockTop() const { return mHeight / 3; }
+    size_t blockBottom() const { return mHeight / 3 + mHeight / 6; }
+
+    void makeFrame(size_t index, uint8_t *yuv) {
+        size_t pan = (mScreenContent == kCamera) ? index : 0;
+        uint32_t seed = 1;
+        for (size_t y = 0; y < mHeight; ++y) {
+            for (size_t x = 0; x < mWidth; ++x) {
+                // Pans by 7/4 pixels horizontally and 3/4 vertically.
+                size_t X = x * 4 + pan * 7;
+                size_t Y = y * 4 + pan * 3;
+                int32_t value = ((X / 4) ^ (Y / 4)) & 0x3f;
+                value += (X + Y) % 160;
+                if (x >= blockX(index) && x < blockX(index) + mWidth / 8
+                        && y >= blockTop() && y < blockBottom()) {
+                    seed = seed * 1103515245 + 12345;
+                    value = 160 + (seed >> 26);
+                }
+                yuv[y * mWidth + x] = value;
+            }
+        }
+
+        uint8_t *u = yuv + mWidth * mHeight;
+        uint8_t *v = u + mWidth * mHeight / 4;
+        for (size_t y = 0; y < mHeight / 2; ++y) {
+            for (size_t x = 0; x < mWidth / 2; ++x) {
+                u[y * mWidth / 2 + x] = 64 + ((x * 2 + pan * 3) % 128);
+                v[y * mWidth / 2 + x] = 192 - ((y * 3 + pan) % 128);
+            }
+        }
+    }
+
+    // The encoder puts an emulation prevention byte after every two zero
+    // bytes, also when the next byte is above 3. That is not allowed and the
+    // decoder rejects it, so those bytes are left out.
+    void appendNal(const uint8_t *nal, size_t size) {
+        static const uint8_t kStartCode[4] = { 0, 0, 0, 1 };
+        mStream.appendArray(kStartCode, sizeof(kStartCode));
+        for (size_t i = 0; i < size; ++i) {
+            if (i >= 2 && i + 1 < size && nal[i] == 3
+                    && nal[i - 1] == 0 && nal[i - 2] == 0 && nal[i + 1] > 3) {
+                continue;
+            }
+            mStream.push(nal[i]);
+        }
+    }
+
+    void decodeAndCompare(u32 numThreads = 1) {
+        H264SwDecInst decoder;
+        ASSERT_EQ(H264SWDEC_OK, H264SwDecInit(&decoder, 0));
+        ASSERT_EQ(H264SWDEC_OK, H264SwDecSetNumThreads(decoder, numThreads));
+
+        // Emulation prevention bytes are removed in place.
+        Vector<uint8_t> stream(mStream);
+
+        H264SwDecInput input;
+        memset(&input, 0, sizeof(input));
+        input.pStream = stream.editArray();
+        input.dataLen = stream.size();
+
+        size_t numPictures = 0;
+        bool flush = false;
+        while (!flush) {
+            if (input.dataLen > 0) {
+                H264SwDecOutput output;
+                H264SwDecRet ret = H264SwDecDecode(decoder, &input, &output);
+                ASSERT_GE(ret, 0);
+                input.dataLen -= output.pStrmCurrPos - input.pStream;
+                input.pStream = output.pStrmCurrPos;
+                ++input.picId;
+            } else {
+                flush = true;
+            }
+
+            H264SwDecPicture picture;
+            while (H264SwDecNextPicture(decoder, &picture, flush)
+                    == H264SWDEC_PIC_RDY) {
+                ASSERT_LT(numPictures, mRecon.size());
+                EXPECT_EQ(0, memcmp(mRecon[numPictures].array(),
+                                    picture.pOutputPicture,
+                                    mWidth * mHeight * 3 / 2))
+                    << "picture " << numPictures;
+                ++numPictures;
+            }
+        }
+        EXPECT_EQ(mRecon.size(), numPictures);
+
+        H264SwDecRelease(decoder);
+    }
+};
+
+TEST_F(H264SwDecTest, InterPicturesMatchTheEncoder) {
+    static const uint32_t kQps[] = { 12, 28, 44 };
+    for (size_t i = 0; i < sizeof(kQps) / sizeof(kQps[0]); ++i) {
+        SCOPED_TRACE(kQps[i]);
+        encode(320, 240, 15, 30, kQps[i]);
+        decodeAndCompare();
+    }
+}
+
+TEST_F(H264SwDecTest, IntraPicturesMatchTheEncoder) {
+    static const uint32_t kQps[] = { 12, 28, 44 };
+    for (size_t i = 0; i < sizeof(kQps) / sizeof(kQps[0]); ++i) {
+        SCOPED_TRACE(kQps[i]);
+        encode(176, 144, 5, 1, kQps[i]);
+        decodeAndCompare();
+    }
+}
+
+TEST_F(H264SwDecTest, ParallelSlicesMatchTheEncoder) {
+    static const u32 kThreads[] = { 1, 2, 3, 4 };
+    encode(320, 240, 15, 30, 28, 4);
+    for (size_t i = 0; i < sizeof(kThreads) / sizeof(kThreads[0]); ++i) {
+        SCOPED_TRACE(kThreads[i]);
+        decodeAndCompare(kThreads[i]);
+    }
+}
+
+TEST_F(H264SwDecTest, ScreenContentMatchesTheEncoder) {
+    static const ScreenContent kModes[] = {
+        kScreen, kScreenBlockHint, kScreenEmptyHint
+    };
+    for (size_t i = 0; i < sizeof(kModes) / sizeof(kModes[0]); ++i) {
+        SCOPED_TRACE(kModes[i]);
+        encode(320, 240, 15, 30, 28, 1, kModes[i]);
+        decodeAndCompare();
+
+        // The luma rows a macroblock away from the block, and with an
+        // empty hint the whole picture, are skipped and stay as they were.
+        size_t top = (blockTop() / 16 - 1) * 16;
+        size_t bottom = ((blockBottom() + 15) / 16 + 1) * 16;
+        for (size_t n = 1; n < mRecon.size(); ++n) {
+            const uint8_t *prev = mRecon[n - 1].array();
+            const uint8_t *curr = mRecon[n].array();
+            if (kModes[i] == kScreenEmptyHint) {
+                EXPECT_EQ(0, memcmp(prev, curr, mWidth * mHeight * 3 / 2))
+                    << "picture " << n;
+                continue;
+            }
+            EXPECT_EQ(0, memcmp(prev, curr, top * mWidth))
+                << "picture " << n;
+            EXPECT_EQ(0, memcmp(prev + bottom * mWidth,
+                                curr + bottom * mWidth,
+                                (mHeight - bottom) * mWidth))
+                << "picture " << n;
+        }
+    }
+}
+
+TEST_F(H264SwDecTest, ParallelDeblockingMatchesTheEncoder) {
+    encode(176, 144, 5, 1, 44);
+    decodeAndCompare(4);
+}
+
+}  // namespace android
@@ -0,0 +1,539 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "LiveSession_test"
+
+// A device executable like the other tests here. The bandwidth estimator
+// is checked with given timestamps. The sessions are played in real time
+// from a throttled stand-in for the HTTP source, so their startup times
+// and rebuffers depend on the device keeping up.
+
+#include <gtest/gtest.h>
+#include <openssl/aes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/DataSource.h>
+
+#include "httplive/BandwidthEstimator.h"
+#include "include/HTTPBase.h"
+#include "include/LiveSession.h"
+
+namespace android {
+
+static const int64_t kSegmentDurationUs = 1000000ll;
+static const int32_t kNumSegments = 12;
+static const int32_t kBandwidths[] = { 200000, 400000, 800000 };
+static const size_t kNumVariants = sizeof(kBandwidths) / sizeof(kBandwidths[0]);
+static const size_t kPacketSize = 188;
+
+static const uint8_t kKey[16] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+};
+
+// One download of numBytes from startUs to endUs, then a sample.
+static void download(
+        const sp<BandwidthEstimator> &estimator,
+        int64_t startUs, int64_t endUs, size_t numBytes) {
+    estimator->onTransferStarted(startUs);
+    estimator->addBytes(numBytes);
+    estimator->onTransferFinished(endUs);
+    estimator->addSample(endUs);
+}
+
+TEST(BandwidthEstimatorTest, HasNoEstimateWithoutData) {
+    sp<BandwidthEstimator> estimator = new BandwidthEstimator;
+    int32_t bandwidthBps;
+    EXPECT_FALSE(estimator->estimate(&bandwidthBps));
+
+    estimator->onTransferStarted(0);
+    estimator->onTransferFinished(1000000ll);
+    estimator->addSample(1000000ll);
+    EXPECT_FALSE(estimator->estimate(&bandwidthBps));
+}
+
+// Downloads that overlap share the link, the time it is idle between
+// downloads doesn't count.
+TEST(BandwidthEstimatorTest, CountsTheBusyTimeOfTheLink) {
+    sp<BandwidthEstimator> estimator = new BandwidthEstimator;
+
+    estimator->onTransferStarted(0);
+    estimator->onTransferStarted(500000ll);
+    estimator->addBytes(100000);
+    estimator->onTransferFinished(1000000ll);
+    estimator->addBytes(87500);
+    estimator->onTransferFinished(1500000ll);
+
+    estimator->onTransferStarted(3000000ll);
+    estimator->addBytes(62500);
+    estimator->onTransferFinished(3500000ll);
+    estimator->addSample(5000000ll);
+
+    // 250000 bytes in 2 s.
+    int32_t bandwidthBps;
+    ASSERT_TRUE(estimator->estimate(&bandwidthBps));
+    EXPECT_EQ(1000000, bandwidthBps);
+}
+
+// A sample taken during a download takes the time up to then, the rest
+// goes to the next sample.
+TEST(BandwidthEstimatorTest, SplitsADownloadBetweenSamples) {
+    sp<BandwidthEstimator> estimator = new BandwidthEstimator;
+
+    estimator->onTransferStarted(0);
+    estimator->addBytes(100000);
+    estimator->addSample(1000000ll);
+    estimator->addBytes(25000);
+    estimator->onTransferFinished(2000000ll);
+    estimator->addSample(2000000ll);
+
+    // 800 and 200 kbps.
+    int32_t bandwidthBps;
+    ASSERT_TRUE(estimator->estimate(&bandwidthBps));
+    EXPECT_EQ(320000, bandwidthBps);
+}
+
+// The harmonic mean of the last samples, a drop pulls the estimate down
+// right away and the old samples are forgotten.
+TEST(BandwidthEstimatorTest, FollowsADrop) {
+    sp<BandwidthEstimator> estimator = new BandwidthEstimator;
+
+    int64_t timeUs = 0;
+    for (size_t i = 0; i < BandwidthEstimator::kNumSamples; ++i) {
+        download(estimator, timeUs, timeUs + 1000000ll, 125000);
+        timeUs += 1000000ll;
+    }
+    int32_t bandwidthBps;
+    ASSERT_TRUE(estimator->estimate(&bandwidthBps));
+    EXPECT_EQ(1000000, bandwidthBps);
+
+    download(estimator, timeUs, timeUs + 4000000ll, 125000);
+    timeUs += 4000000ll;
+    ASSERT_TRUE(estimator->estimate(&bandwidthBps));
+    EXPECT_EQ(625000, bandwidthBps);
+
+    for (size_t i = 1; i < BandwidthEstimator::kNumSamples; ++i) {
+        download(estimator, timeUs, timeUs + 4000000ll, 125000);
+        timeUs += 4000000ll;
+    }
+    ASSERT_TRUE(estimator->estimate(&bandwidthBps));
+    EXPECT_EQ(250000, bandwidthBps);
+}
+
+// Serves the files of the stream over a link that takes a round trip per
+// request, the data of all requests shares its bandwidth.
+struct Server : public RefBase {
+    Server(int32_t bandwidthBps, int64_t roundTripUs)
+        : mBandwidthBps(bandwidthBps),
+          mRoundTripUs(roundTripUs),
+          mLinkFreeTimeUs(0) {
+    }
+
+    void addFile(const char *name, const sp<ABuffer> &data) {
+        mFiles.add(AString(name), data);
+    }
+
+    sp<ABuffer> findFile(const char *url) {
+        static const char kPrefix[] = "http://test/";
+        if (strncmp(url, kPrefix, strlen(kPrefix))) {
+            return NULL;
+        }
+
+        ssize_t index = mFiles.indexOfKey(AString(url + strlen(kPrefix)));
+        return index < 0 ? NULL : mFiles.valueAt(index);
+    }
+
+    void setBandwidth(int32_t bandwidthBps) {
+        Mutex::Autolock autoLock(mLock);
+        mBandwidthBps = bandwidthBps;
+    }
+
+    int64_t roundTripUs() const {
+        return mRoundTripUs;
+    }
+
+    // Blocks until size bytes have come over the link.
+    void transfer(size_t size) {
+        int64_t doneTimeUs;
+        {
+            Mutex::Autolock autoLock(mLock);
+            int64_t nowUs = ALooper::GetNowUs();
+            if (mLinkFreeTimeUs < nowUs) {
+                mLinkFreeTimeUs = nowUs;
+            }
+            mLinkFreeTimeUs += size * 8000000ll / mBandwidthBps;
+            doneTimeUs = mLinkFreeTimeUs;
+        }
+
+        int64_t delayUs = doneTimeUs - ALooper::GetNowUs();
+        if (delayUs > 0) {
+            usleep(delayUs);
+        }
+    }
+
+private:
+    Mutex mLock;
+    KeyedVector<AString, sp<ABuffer> > mFiles;
+    int32_t mBandwidthBps;
+    int64_t mRoundTripUs;
+    int64_t mLinkFreeTimeUs;
+};
+
+// Stands in for the HTTP source, a read returns what a socket would have.
+struct ThrottledHTTPSource : public HTTPBase {
+    ThrottledHTTPSource(const sp<Server> &server)
+        : mServer(server),
+          mDisconnected(false) {
+    }
+
+    virtual status_t connect(
+            const char *uri,
+            const KeyedVector<String8, String8> *headers,
+            off64_t offset) {
+        usleep(mServer->roundTripUs());
+
+        Mutex::Autolock autoLock(mLock);
+        if (mDisconnected) {
+            mDisconnected = false;
+            return ERROR_IO;
+        }
+
+        mData = mServer->findFile(uri);
+        return mData == NULL ? ERROR_IO : OK;
+    }
+
+    virtual void disconnect() {
+        Mutex::Autolock autoLock(mLock);
+        mDisconnected = true;
+    }
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        static const size_t kMaxReadSize = 8192;
+
+        sp<ABuffer> file;
+        {
+            Mutex::Autolock autoLock(mLock);
+            if (mDisconnected || mData == NULL) {
+                return ERROR_IO;
+            }
+            file = mData;
+        }
+
+        if (offset >= (off64_t)file->size()) {
+            return 0;
+        }
+
+        if (size > kMaxReadSize) {
+            size = kMaxReadSize;
+        }
+        if (offset + size > file->size()) {
+            size = file->size() - offset;
+        }
+        int64_t startTimeUs = ALooper::GetNowUs();
+        mServer->transfer(size);
+        memcpy(data, file->data() + offset, size);
+        addBandwidthMeasurement(size, ALooper::GetNowUs() - startTimeUs);
+
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        Mutex::Autolock autoLock(mLock);
+        if (mData == NULL) {
+            return ERROR_IO;
+        }
+
+        *size = mData->size();
+        return OK;
+    }
+
+private:
+    sp<Server> mServer;
+
+    Mutex mLock;
+    sp<ABuffer> mData;
+    bool mDisconnected;
+};
+
+struct TestLiveSession : public LiveSession {
+    TestLiveSession(const sp<Server> &server)
+        : mServer(server) {
+    }
+
+protected:
+    virtual sp<HTTPBase> createHTTPSource() {
+        return new ThrottledHTTPSource(mServer);
+    }
+
+private:
+    sp<Server> mServer;
+};
+
+static sp<ABuffer> makeText(const AString &text) {
+    sp<ABuffer> buffer = new ABuffer(text.size());
+    memcpy(buffer->data(), text.c_str(), text.size());
+    return buffer;
+}
+
+// The packets of a segment carry the variant, the sequence number and
+// their index, so that playback can tell where it is.
+static sp<ABuffer> makeSegment(size_t variant, int32_t seqNumber) {
+    size_t numPackets =
+        kBandwidths[variant] * kSegmentDurationUs / 8000000ll / kPacketSize;
+
+    sp<ABuffer> buffer = new ABuffer(numPackets * kPacketSize);
+    for (size_t i = 0; i < numPackets; ++i) {
+        uint8_t *packet = buffer->data() + i * kPacketSize;
+        memset(packet, (seqNumber + i) & 0xff, kPacketSize);
+        packet[0] = 0x47;
+        packet[1] = variant;
+        packet[2] = seqNumber;
+        packet[3] = i >> 8;
+        packet[4] = i & 0xff;
+        packet[5] = numPackets >> 8;
+        packet[6] = numPackets & 0xff;
+    }
+    return buffer;
+}
+
+// AES-128 in CBC mode with PKCS7 padding and the sequence number as the IV.
+static sp<ABuffer> encrypt(const sp<ABuffer> &data, int32_t seqNumber) {
+    size_t pad = 16 - data->size() % 16;
+
+    sp<ABuffer> buffer = new ABuffer(data->size() + pad);
+    memcpy(buffer->data(), data->data(), data->size());
+    memset(buffer->data() + data->size(), pad, pad);
+
+    AES_KEY key;
+    AES_set_encrypt_key(kKey, 128, &key);
+
+    unsigned char iv[16];
+    memset(iv, 0, sizeof(iv));
+    iv[15] = seqNumber & 0xff;
+    iv[14] = (seqNumber >> 8) & 0xff;
+
+    AES_cbc_encrypt(
+            buffer->data(), buffer->data(), buffer->size(),
+            &key, iv, AES_ENCRYPT);
+
+    return buffer;
+}
+
+static void addStream(const sp<Server> &server, bool encrypted) {
+    AString master("#EXTM3U\n");
+    for (size_t v = 0; v < kNumVariants; ++v) {
+        master.append("#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=");
+        master.append(kBandwidths[v]);
+        master.append("\nv");
+        master.append(v);
+        master.append(".m3u8\n");
+
+        AString playlist(
+                "#EXTM3U\n#EXT-X-TARGETDURATION:1\n#EXT-X-MEDIA-SEQUENCE:0\n");
+        if (encrypted) {
+            playlist.append("#EXT-X-KEY:METHOD=AES-128,URI=\"key\"\n");
+        }
+
+        for (int32_t i = 0; i < kNumSegments; ++i) {
+            char name[32];
+            sprintf(name, "v%d-%d.ts", (int)v, i);
+            playlist.append("#EXTINF:1,\n");
+            playlist.append(name);
+            playlist.append("\n");
+
+            sp<ABuffer> segment = makeSegment(v, i);
+            server->addFile(name, encrypted ? encrypt(segment, i) : segment);
+        }
+        playlist.append("#EXT-X-ENDLIST\n");
+
+        char name[32];
+        sprintf(name, "v%d.m3u8", (int)v);
+        server->addFile(name, makeText(playlist));
+    }
+    server->addFile("master.m3u8", makeText(master));
+
+    sp<ABuffer> key = new ABuffer(sizeof(kKey));
+    memcpy(key->data(), kKey, sizeof(kKey));
+    server->addFile("key", key);
+}
+
+class LiveSessionTest : public ::testing::Test {
+protected:
+    sp<Server> mServer;
+    sp<ALooper> mLooper;
+    sp<LiveSession> mSession;
+
+    int64_t mStartupTimeUs;
+    size_t mNumRebuffers;
+    int32_t mNumSegmentsPlayed;
+    Vector<size_t> mVariants;
+
+    // Changes the bandwidth of the link once this much has been played.
+    int64_t mBandwidthChangeTimeUs;
+    int32_t mNewBandwidthBps;
+
+    LiveSessionTest()
+        : mStartupTimeUs(-1),
+          mNumRebuffers(0),
+          mNumSegmentsPlayed(0),
+          mBandwidthChangeTimeUs(-1),
+          mNewBandwidthBps(0) {
+    }
+
+    void start(int32_t bandwidthBps, int64_t roundTripUs, bool encrypted) {
+        mServer = new Server(bandwidthBps, roundTripUs);
+        addStream(mServer, encrypted);
+
+        mLooper = new ALooper;
+        mLooper->setName("LiveSession_test");
+        mLooper->start();
+
+        mSession = new TestLiveSession(mServer);
+        mLooper->registerHandler(mSession);
+        mSession->connect("http://test/master.m3u8");
+    }
+
+    virtual void TearDown() {
+        if (mSession != NULL) {
+            mSession->disconnect();
+            mLooper->unregisterHandler(mSession->id());
+            mLooper->stop();
+        }
+
+        printf("  startup %.3f s, %d rebuffers, variants",
+               mStartupTimeUs / 1E6, (int)mNumRebuffers);
+        for (size_t i = 0; i < mVariants.size(); ++i) {
+            printf(" %d", (int)mVariants[i]);
+        }
+        printf("\n");
+    }
+
+    // Plays the stream in real time, from when its first packet arrives.
+    // Playback stalls whenever a packet arrives late.
+    void play() {
+        static const int64_t kMaxLateUs = 100000ll;
+
+        sp<DataSource> source = mSession->getDataSource();
+        int64_t startTimeUs = ALooper::GetNowUs();
+        int64_t clockStartUs = -1;
+        int32_t seqNumber = -1;
+        size_t nextPacket = 0;
+
+        uint8_t packet[kPacketSize];
+        off64_t offset = 0;
+        while (source->readAt(offset, packet, kPacketSize)
+                == (ssize_t)kPacketSize) {
+            offset += kPacketSize;
+
+            if (packet[0] == 0x00) {
+                // A discontinuity.
+                continue;
+            }
+            ASSERT_EQ(0x47, packet[0]);
+
+            size_t index = (packet[3] << 8) | packet[4];
+            size_t numPackets = (packet[5] << 8) | packet[6];
+            if (index == 0) {
+                ASSERT_EQ(seqNumber + 1, packet[2]);
+                seqNumber = packet[2];
+                ++mNumSegmentsPlayed;
+                mVariants.push(packet[1]);
+            } else {
+                ASSERT_EQ(seqNumber, packet[2]);
+                ASSERT_EQ(nextPacket, index);
+            }
+            nextPacket = index + 1;
+
+            for (size_t i = 7; i < kPacketSize; ++i) {
+                ASSERT_EQ((seqNumber + index) & 0xff, packet[i]);
+            }
+
+            int64_t mediaTimeUs = seqNumber * kSegmentDurationUs
+                + index * kSegmentDurationUs / numPackets;
+            int64_t nowUs = ALooper::GetNowUs();
+
+            if (clockStartUs < 0) {
+                mStartupTimeUs = nowUs - startTimeUs;
+                clockStartUs = nowUs - mediaTimeUs;
+            } else if (nowUs > clockStartUs + mediaTimeUs + kMaxLateUs) {
+                ++mNumRebuffers;
+                clockStartUs = nowUs - mediaTimeUs;
+            } else if (nowUs < clockStartUs + mediaTimeUs) {
+                usleep(clockStartUs + mediaTimeUs - nowUs);
+            }
+
+            if (mBandwidthChangeTimeUs >= 0
+                    && mediaTimeUs >= mBandwidthChangeTimeUs) {
+                mServer->setBandwidth(mNewBandwidthBps);
+                mBandwidthChangeTimeUs = -1;
+            }
+        }
+    }
+};
+
+TEST_F(LiveSessionTest, PlaysAnEncryptedStream) {
+    start(2000000, 20000ll, true /* encrypted */);
+    play();
+
+    EXPECT_EQ(kNumSegments, mNumSegmentsPlayed);
+}
+
+TEST_F(LiveSessionTest, StartsQuicklyAndSwitchesUp) {
+    start(700000, 100000ll, false /* encrypted */);
+    play();
+
+    EXPECT_EQ(kNumSegments, mNumSegmentsPlayed);
+
+    // Two playlists and one segment round trip, and a little data.
+    EXPECT_GT(500000ll, mStartupTimeUs);
+    EXPECT_EQ(0u, mNumRebuffers);
+
+    // The highest stream that fits into 80% of the bandwidth.
+    EXPECT_EQ(1u, mVariants[mVariants.size() - 1]);
+}
+
+TEST_F(LiveSessionTest, SwitchesDownWhenTheLinkSlows) {
+    start(2000000, 50000ll, false /* encrypted */);
+    mBandwidthChangeTimeUs = 3 * kSegmentDurationUs;
+    mNewBandwidthBps = 450000;
+    play();
+
+    EXPECT_EQ(kNumSegments, mNumSegmentsPlayed);
+    EXPECT_EQ(0u, mNumRebuffers);
+
+    size_t maxVariant = 0;
+    for (size_t i = 0; i < mVariants.size(); ++i) {
+        if (mVariants[i] > maxVariant) {
+            maxVariant = mVariants[i];
+        }
+    }
+    EXPECT_EQ(2u, maxVariant);
+    EXPECT_GT(2u, mVariants[mVariants.size() - 1]);
+}
+
+}  // namespace android
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "MP3BatchDecoder_test"
+
+// The batch MP3 decoder must produce the same PCM as the frame by frame
+// decoder whatever the number of threads. There is no MP3 encoder in the
+// tree, so the streams are written here: every granule codes all of its
+// spectral lines with Huffman table 1 and no scalefactors, and the amount
+// of main data changes from frame to frame so that the bit reservoir fills
+// up and drains, and most frames start in the main data of earlier ones.
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/Vector.h>
+
+#include "pvmp3decoder_api.h"
+
+namespace android {
+
+// Huffman table 1 codes of the pairs (0, 0), (0, 1), (1, 0) and (1, 1).
+static const struct {
+    uint32_t mCode;
+    size_t mLength;
+} kTable1[4] = { { 1, 1 }, { 1, 3 }, { 1, 2 }, { 0, 3 } };
+
+static const size_t kNumPairs = 288;  // 576 spectral lines, all big values
+
+struct BitWriter {
+    Vector<uint8_t> mData;
+    size_t mNumBits;
+
+    BitWriter() : mNumBits(0) {}
+
+    void put(uint32_t value, size_t numBits) {
+        while (numBits-- > 0) {
+            if ((mNumBits & 7) == 0) {
+                mData.push(0);
+            }
+            if ((value >> numBits) & 1) {
+                mData.editItemAt(mNumBits >> 3) |= 0x80 >> (mNumBits & 7);
+            }
+            ++mNumBits;
+        }
+    }
+};
+
+class MP3BatchDecoderTest : public ::testing::Test {
+protected:
+    Vector<uint8_t> mStream;
+    size_t mNumFrames;
+
+    uint32_t mSeed;
+
+    uint32_t random() {
+        mSeed = mSeed * 1103515245 + 12345;
+        return mSeed >> 16;
+    }
+
+    // Codes the 576 lines of one granule. A line is non zero with a
+    // probability of density / 256, returns the number of bits.
+    size_t writeGranule(BitWriter *writer, uint32_t density) {
+        size_t start = writer->mNumBits;
+        for (size_t i = 0; i < kNumPairs; ++i) {
+            bool x = (random() & 0xff) < density;
+            bool y = (random() & 0xff) < density;
+            writer->put(kTable1[x * 2 + y].mCode, kTable1[x * 2 + y].mLength);
+            if (x) {
+                writer->put(random() & 1, 1);
+            }
+            if (y) {
+                writer->put(random() & 1, 1);
+            }
+        }
+        return writer->mNumBits - start;
+    }
+
+    // Writes numFrames frames of MPEG-1 (44.1 kHz would need padding, so
+    // 48 kHz at 128 kbit/s) or MPEG-2 (24 kHz at 48 kbit/s) layer III.
+    void encode(bool mpeg1, size_t numChannels, size_t numFrames) {
+        const size_t frameSize = mpeg1 ? 384 : 144;
+        const size_t sideInfoSize =
+            mpeg1 ? (numChannels == 1 ? 17 : 32) : (numChannels == 1 ? 9 : 17);
+        const size_t slotSize = frameSize - 4 - sideInfoSize;
+        const size_t maxBegin = mpeg1 ? 511 : 255;
+        const size_t numGranules = mpeg1 ? 2 : 1;
+
+        mSeed = numFrames * numChannels + mpeg1;
+        mNumFrames = numFrames;
+
+        // The main data of all frames back to back, the side info of each
+        // frame, and where the main data of each frame starts.
+        BitWriter mainData;
+        Vector<BitWriter> sideInfos;
+        size_t mainEnd = 0;
+
+        for (size_t n = 0; n < numFrames; ++n) {
+            // Start as far back as allowed, with the bytes in between
+            // left as stuffing.
+            size_t slotStart = n * slotSize;
+            size_t begin = slotStart - mainEnd;
+            if (begin > maxBegin) {
+                begin = maxBegin;
+            }
+            size_t budgetBits = (begin + slotSize) * 8;
+
+            // Between a tenth and two thirds of the lines are non zero,
+            // more than fits in a frame on average at the top.
+            uint32_t density = 26 + (n * 37) % 150;
+
+            uint32_t savedSeed;
+            size_t lengths[2][2];
+            uint32_t gains[2][2];
+            BitWriter granules;
+            for (;;) {
+                savedSeed = mSeed;
+                granules = BitWriter();
+                for (size_t gr = 0; gr < numGranules; ++gr) {
+                    for (size_t ch = 0; ch < numChannels; ++ch) {
+                        gains[gr][ch] = 170 + random() % 20;
+                        lengths[gr][ch] = writeGranule(&granules, density);
+                    }
+                }
+                if (granules.mNumBits <= budgetBits) {
+                    break;
+                }
+                mSeed = savedSeed;
+                density = density > 8 ? density - 8 : 0;
+            }
+
+            size_t start = slotStart - begin;
+            while (mainData.mNumBits < start * 8) {
+                mainData.put(0, 8);
+            }
+            for (size_t i = 0; i < granules.mNumBits; ++i) {
+                mainData.put((granules.mData[i >> 3] >> (7 - (i & 7))) & 1, 1);
+            }
+            while (mainData.mNumBits & 7) {
+                mainData.put(0, 1);
+            }
+            mainEnd = mainData.mNumBits / 8;
+
+            BitWriter side;
+            side.put(begin, mpeg1 ? 9 : 8);
+            if (mpeg1) {
+                side.put(0, numChannels == 1 ? 5 : 3);  // private bits
+                side.put(0, 4 * numChannels);           // scfsi
+            } else {
+                side.put(0, numChannels == 1 ? 1 : 2);  // private bits
+            }
+            for (size_t gr = 0; gr < numGranules; ++gr) {
+                for (size_t ch = 0; ch < numChannels; ++ch) {
+                    side.put(lengths[gr][ch], 12);  // part2_3_length
+                    side.put(kNumPairs, 9);         // big_values
+                    side.put(gains[gr][ch], 8);     // global_gain
+                    side.put(0, mpeg1 ? 4 : 9);     // scalefac_compress
+                    side.put(0, 1);                 // window_switching_flag
+                    side.put(1, 5);                 // table_select
+                    side.put(1, 5);
+                    side.put(1, 5);
+                    side.put(7, 4);                 // region0_count
+                    side.put(7, 3);                 // region1_count
+                    if (mpeg1) {
+                        side.put(0, 1);             // preflag
+                    }
+                    side.put(0, 1);                 // scalefac_scale
+                    side.put(0, 1);                 // count1table_select
+                }
+            }
+            ASSERT_EQ(sideInfoSize * 8, side.mNumBits);
+            sideInfos.push(side);
+        }
+
+        mStream.clear();
+        for (size_t n = 0; n < numFrames; ++n) {
+            // no CRC, no padding, stereo or single channel
+            mStream.push(0xff);
+            mStream.push(mpeg1 ? 0xfb : 0xf3);
+            mStream.push(mpeg1 ? 0x94 : 0x64);
+            mStream.push(numChannels == 1 ? 0xc0 : 0x00);
+            mStream.appendVector(sideInfos[n].mData);
+            for (size_t i = n * slotSize; i < (n + 1) * slotSize; ++i) {
+                mStream.push(i < mainData.mData.size() ? mainData.mData[i] : 0);
+            }
+        }
+    }
+
+    // Decodes the stream frame by frame the way SoftMP3 does.
+    void decodeSerially(Vector<int16_t> *pcm) {
+        tPVMP3DecoderExternal ext;
+        memset(&ext, 0, sizeof(ext));
+        ext.equalizerType = flat;
+        ext.crcEnabled = false;
+
+        void *mem = malloc(pvmp3_decoderMemRequirements());
+        pvmp3_InitDecoder(&ext, mem);
+
+        // the decoder may read a few bytes past the last frame
+        Vector<uint8_t> input(mStream);
+        input.insertAt((uint8_t)0, input.size(), 16);
+
+        int16_t output[4608];
+        size_t offset = 0;
+        for (size_t n = 0; n < mNumFrames; ++n) {
+            ext.pInputBuffer = input.editArray() + offset;
+            ext.inputBufferCurrentLength = mStream.size() - offset;
+            ext.inputBufferMaxLength = 0;
+            ext.inputBufferUsedLength = 0;
+            ext.outputFrameSize = sizeof(output) / sizeof(output[0]);
+            ext.pOutputBuffer = output;
+
+            ASSERT_EQ(NO_DECODING_ERROR, pvmp3_framedecoder(&ext, mem))
+                << "frame " << n;
+            pcm->appendArray(output, ext.outputFrameSize);
+            offset += ext.inputBufferUsedLength;
+        }
+        EXPECT_EQ(mStream.size(), offset);
+
+        free(mem);
+    }
+
+    void checkThreads(size_t maxThreads) {
+        Vector<int16_t> serial;
+        decodeSerially(&serial);
+        if (HasFatalFailure()) {
+            return;
+        }
+
+        size_t numNonZero = 0;
+        for (size_t i = 0; i < serial.size(); ++i) {
+            numNonZero += serial[i] != 0;
+        }
+        EXPECT_GT(numNonZero, serial.size() / 2);
+
+        for (size_t threads = 1; threads <= maxThreads; ++threads) {
+            tPVMP3BatchOutput output;
+            ASSERT_EQ(NO_DECODING_ERROR, pvmp3_batchdecoder(
+                    mStream.array(), mStream.size(), threads, &output));
+            EXPECT_EQ((int32_t)mNumFrames, output.numFrames);
+            ASSERT_EQ((int32_t)serial.size(), output.outputLength);
+
+            size_t firstDifference = serial.size();
+            for (size_t i = 0; i < serial.size(); ++i) {
+                if (output.pOutputBuffer[i] != serial[i]) {
+                    firstDifference = i;
+                    break;
+                }
+            }
+            EXPECT_EQ(serial.size(), firstDifference)
+                << threads << " threads, frame "
+                << firstDifference * mNumFrames / serial.size();
+
+            free(output.pOutputBuffer);
+        }
+    }
+};
+
+TEST_F(MP3BatchDecoderTest, MPEG1Stereo) {
+    encode(true, 2, 1500);
+    checkThreads(8);
+}
+
+TEST_F(MP3BatchDecoderTest, MPEG1Mono) {
+    encode(true, 1, 1500);
+    checkThreads(8);
+}
+
+// MPEG-2 frames have a single granule, ranges are primed further back.
+TEST_F(MP3BatchDecoderTest, MPEG2Mono) {
+    encode(false, 1, 3000);
+    checkThreads(8);
+}
+
+TEST_F(MP3BatchDecoderTest, MPEG2Stereo) {
+    encode(false, 2, 3000);
+    checkThreads(8);
+}
+
+// Data in front of the first frame that looks like a header is skipped.
+TEST_F(MP3BatchDecoderTest, SkipsJunk) {
+    encode(true, 2, 600);
+
+    tPVMP3BatchOutput clean;
+    ASSERT_EQ(NO_DECODING_ERROR, pvmp3_batchdecoder(
+            mStream.array(), mStream.size(), 4, &clean));
+
+    static const uint8_t kJunk[] = { 0xff, 0xfb, 0x12, 0x34, 0x00, 0xff };
+    mStream.insertArrayAt(kJunk, 0, sizeof(kJunk));
+
+    tPVMP3BatchOutput junk;
+    ASSERT_EQ(NO_DECODING_ERROR, pvmp3_batchdecoder(
+            mStream.array(), mStream.size(), 4, &junk));
+    EXPECT_EQ(clean.numFrames, junk.numFrames);
+    ASSERT_EQ(clean.outputLength, junk.outputLength);
+    EXPECT_EQ(0, memcmp(clean.pOutputBuffer, junk.pOutputBuffer,
+                        clean.outputLength * sizeof(int16_t)));
+
+    free(clean.pOutputBuffer);
+    free(junk.pOutputBuffer);
+}
+
+}  // namespace android
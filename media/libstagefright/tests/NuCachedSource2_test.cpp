@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "NuCachedSource2_test"
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <utils/Errors.h>
+#include <utils/Vector.h>
+
+#include <media/stagefright/DataSource.h>
+
+#include "include/NuCachedSource2.h"
+
+namespace android {
+
+static const off64_t kMB = 1024 * 1024;
+
+static int64_t getNowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_usec + tv.tv_sec * 1000000ll;
+}
+
+// Stands in for an HTTP data source. The data comes at a limited bandwidth,
+// and a request that doesn't continue the previous one costs a round trip.
+struct ThrottledSource : public DataSource {
+    ThrottledSource(off64_t size, int32_t bandwidthKbps, int64_t roundTripUs)
+        : mSize(size),
+          mBandwidthKbps(bandwidthKbps),
+          mRoundTripUs(roundTripUs),
+          mNextOffset(-1) {
+    }
+
+    static uint8_t byteAt(off64_t offset) {
+        return (offset ^ (offset >> 8) ^ (offset >> 16)) & 0xff;
+    }
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        Mutex::Autolock autoLock(mLock);
+        if (offset >= mSize) {
+            return 0;
+        }
+        if (offset + (off64_t)size > mSize) {
+            size = mSize - offset;
+        }
+
+        if (offset != mNextOffset) {
+            mRequests.push(offset);
+            usleep(mRoundTripUs);
+        }
+        usleep(size * 8000ll / mBandwidthKbps);
+
+        for (size_t i = 0; i < size; ++i) {
+            ((uint8_t *)data)[i] = byteAt(offset + i);
+        }
+        mNextOffset = offset + size;
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mSize;
+        return OK;
+    }
+
+    // Number of requests that started in [from, to).
+    size_t numRequests(off64_t from, off64_t to) {
+        Mutex::Autolock autoLock(mLock);
+        size_t n = 0;
+        for (size_t i = 0; i < mRequests.size(); ++i) {
+            if (mRequests[i] >= from && mRequests[i] < to) {
+                ++n;
+            }
+        }
+        return n;
+    }
+
+private:
+    Mutex mLock;
+    off64_t mSize;
+    int32_t mBandwidthKbps;
+    int64_t mRoundTripUs;
+    off64_t mNextOffset;
+    Vector<off64_t> mRequests;
+};
+
+class NuCachedSource2Test : public ::testing::Test {
+protected:
+    sp<ThrottledSource> mSource;
+    sp<NuCachedSource2> mCache;
+
+    void open(off64_t size, int32_t bandwidthKbps, int64_t roundTripUs) {
+        mSource = new ThrottledSource(size, bandwidthKbps, roundTripUs);
+        mCache = new NuCachedSource2(mSource);
+    }
+
+    virtual void TearDown() {
+        if (mCache != NULL) {
+            Vector<String16> args;
+            mCache->dump(STDOUT_FILENO, args);
+        }
+    }
+
+    // Reads and checks the data, returns how long the read took.
+    int64_t readAndCheck(off64_t offset, size_t size) {
+        Vector<uint8_t> data;
+        data.insertAt((uint8_t)0, 0, size);
+
+        int64_t startUs = getNowUs();
+        ssize_t n = mCache->readAt(offset, data.editArray(), size);
+        int64_t readTimeUs = getNowUs() - startUs;
+
+        off64_t fileSize;
+        EXPECT_EQ(OK, mSource->getSize(&fileSize));
+        size_t expected = size;
+        if (offset >= fileSize) {
+            expected = 0;
+        } else if (offset + (off64_t)size > fileSize) {
+            expected = fileSize - offset;
+        }
+        EXPECT_EQ((ssize_t)expected, n) << "at " << offset;
+
+        for (ssize_t i = 0; i < n; ++i) {
+            if (data[i] != ThrottledSource::byteAt(offset + i)) {
+                ADD_FAILURE() << "wrong data at " << offset + i;
+                break;
+            }
+        }
+        return readTimeUs;
+    }
+};
+
+TEST_F(NuCachedSource2Test, ReadsMatchTheSource) {
+    open(8 * kMB, 400000, 1000);
+
+    uint32_t seed = 1;
+    for (size_t i = 0; i < 200; ++i) {
+        seed = seed * 1103515245 + 12345;
+        off64_t offset = (seed >> 4) % (8 * kMB + 100000);
+        seed = seed * 1103515245 + 12345;
+        size_t size = (seed >> 4) % 100000;
+
+        readAndCheck(offset, size);
+        if (i % 4 == 0) {
+            // Playback goes on from there.
+            readAndCheck(offset + size, 4096);
+        }
+    }
+}
+
+TEST_F(NuCachedSource2Test, KeepsTheHeadWhileReadingTheEnd) {
+    // Like an MPEG4 file with the movie box at the end.
+    open(32 * kMB, 80000, 50000);
+
+    readAndCheck(0, 4096);
+    usleep(200000);
+    readAndCheck(32 * kMB - 200000, 100000);
+    usleep(200000);
+
+    // The media data after the head is still there.
+    EXPECT_GT(50000, readAndCheck(4096, 65536));
+    EXPECT_GT(50000, readAndCheck(0, 4096));
+    EXPECT_EQ(1u, mSource->numRequests(0, kMB));
+}
+
+TEST_F(NuCachedSource2Test, PrefetchesForInterleavedReads) {
+    // Two tracks at 1.6 MB/s each, far apart in a file coming at 5 MB/s.
+    open(64 * kMB, 40000, 50000);
+
+    const off64_t kTrackOffsets[2] = { 0, 32 * kMB };
+    readAndCheck(kTrackOffsets[0], 32768);
+    readAndCheck(kTrackOffsets[1], 32768);
+
+    size_t numWaits = 0;
+    for (off64_t i = 1; i < 150; ++i) {
+        for (size_t j = 0; j < 2; ++j) {
+            if (readAndCheck(kTrackOffsets[j] + i * 32768, 32768) >= 20000) {
+                ++numWaits;
+            }
+        }
+        usleep(20000);
+    }
+
+    // Each time fetching switches between the tracks is a new request,
+    // but it is ahead of the reads.
+    EXPECT_GT(40u, mSource->numRequests(0, 64 * kMB));
+    EXPECT_GT(10u, numWaits);
+}
+
+TEST_F(NuCachedSource2Test, EvictsTheLeastRecentlyUsedRange) {
+    open(64 * kMB, 80000, 20000);
+
+    for (off64_t i = 0; i < 5; ++i) {
+        readAndCheck(i * 12 * kMB, 4096);
+        usleep(100000);
+    }
+
+    // There are not enough ranges for all five.
+    readAndCheck(0, 4096);
+    EXPECT_EQ(2u, mSource->numRequests(0, kMB));
+
+    readAndCheck(48 * kMB + 4096, 4096);
+    EXPECT_EQ(1u, mSource->numRequests(47 * kMB, 49 * kMB));
+}
+
+}  // namespace android
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Whole file MP3 and AAC decode time against the number of threads.
+//
+// Decodes an MP3 (.mp3) or ADTS (.aac) file in one go with the batch
+// decoders behind SoftMP3 and SoftAAC, and reports the decode time, how
+// many times faster than real time that is and a checksum of the PCM.
+// With -s the file is decoded with 1 up to the given number of threads to
+// show how decoding scales with the cores. MP3 decodes to the same PCM with
+// any number of threads, for AAC the number of samples that differ from the
+// single threaded decode is reported, see pvmp4audiodecoderbatch.cpp.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "pvmp3decoder_api.h"
+#include "pvmp4audiodecoder_api.h"
+
+static int64_t getNowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_usec + tv.tv_sec * 1000000ll;
+}
+
+static uint32_t adler32(uint32_t adler, const uint8_t *data, size_t size) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        size_t n = size < 4096 ? size : 4096;
+        size -= n;
+        while (n-- > 0) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-i iterations] [-t threads] [-s] "
+                    "[-o out.pcm] file.mp3|file.aac\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -i decode the file this many times (default 1)\n");
+    fprintf(stderr, "       -t number of decoder threads (default 1)\n");
+    fprintf(stderr, "       -s decode with 1 up to -t threads\n");
+    fprintf(stderr, "       -o write the PCM of the first pass\n");
+}
+
+struct Result {
+    int16_t *mPCM;
+    size_t mNumSamples;
+    int mNumChannels;
+    int mSampleRate;
+    int mNumFrames;
+    uint32_t mChecksum;
+    int64_t mBestUs;
+};
+
+static bool decode(const uint8_t *data, size_t size, bool isAAC,
+                   int numThreads, int numIterations, Result *result) {
+    result->mPCM = NULL;
+    result->mBestUs = -1;
+
+    for (int i = 0; i < numIterations; ++i) {
+        int64_t startUs = getNowUs();
+        int16_t *pcm;
+        if (isAAC) {
+            tPVMP4AudioDecoderBatchOutput output;
+            Int err = PVMP4AudioDecodeBatch(
+                    data, size, numThreads, &output);
+            if (err != MP4AUDEC_SUCCESS) {
+                fprintf(stderr, "decoding failed: %d\n", err);
+                return false;
+            }
+            pcm = output.pOutputBuffer;
+            result->mNumSamples = output.outputLength;
+            result->mNumChannels = output.desiredChannels;
+            result->mSampleRate = output.samplingRate;
+            result->mNumFrames = output.numFrames;
+        } else {
+            tPVMP3BatchOutput output;
+            ERROR_CODE err = pvmp3_batchdecoder(
+                    data, size, numThreads, &output);
+            if (err != NO_DECODING_ERROR) {
+                fprintf(stderr, "decoding failed: %d\n", err);
+                return false;
+            }
+            pcm = output.pOutputBuffer;
+            result->mNumSamples = output.outputLength;
+            result->mNumChannels = output.num_channels;
+            result->mSampleRate = output.samplingRate;
+            result->mNumFrames = output.numFrames;
+        }
+        int64_t elapsedUs = getNowUs() - startUs;
+
+        if (result->mBestUs < 0 || elapsedUs < result->mBestUs) {
+            result->mBestUs = elapsedUs;
+        }
+
+        if (result->mPCM == NULL) {
+            result->mPCM = pcm;
+        } else {
+            free(pcm);
+        }
+    }
+
+    result->mChecksum = adler32(
+            1, (const uint8_t *)result->mPCM,
+            result->mNumSamples * sizeof(int16_t));
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int numIterations = 1;
+    int numThreads = 1;
+    bool scale = false;
+    const char *outPath = NULL;
+
+    int res;
+    while ((res = getopt(argc, argv, "hi:t:so:")) >= 0) {
+        switch (res) {
+            case 'i':
+                numIterations = atoi(optarg);
+                break;
+            case 't':
+                numThreads = atoi(optarg);
+                break;
+            case 's':
+                scale = true;
+                break;
+            case 'o':
+                outPath = optarg;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 1 != argc || numIterations <= 0 || numThreads <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    size_t pathLength = strlen(path);
+    bool isAAC = pathLength > 4 && !strcasecmp(path + pathLength - 4, ".aac");
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "unable to open %s\n", path);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = (uint8_t *)malloc(size);
+    if (fread(data, 1, size, file) != (size_t)size) {
+        fprintf(stderr, "unable to read %s\n", path);
+        return 1;
+    }
+    fclose(file);
+
+    Result single;
+    single.mPCM = NULL;
+    for (int threads = scale ? 1 : numThreads; threads <= numThreads;
+            ++threads) {
+        Result result;
+        if (!decode(data, size, isAAC, threads, numIterations, &result)) {
+            return 1;
+        }
+
+        if (outPath != NULL && (threads == 1 || !scale)) {
+            FILE *out = fopen(outPath, "wb");
+            if (out == NULL) {
+                fprintf(stderr, "unable to create %s\n", outPath);
+                return 1;
+            }
+            fwrite(result.mPCM, sizeof(int16_t), result.mNumSamples, out);
+            fclose(out);
+        }
+
+        double durationS = (double)result.mNumSamples / result.mNumChannels
+                / result.mSampleRate;
+        printf("%d Hz, %d channels, %d frames, %.1f s of audio, %d threads, "
+               "%.3f s, %.1fx real time, checksum %08x",
+               result.mSampleRate, result.mNumChannels, result.mNumFrames,
+               durationS, threads, result.mBestUs / 1E6,
+               durationS * 1E6 / result.mBestUs, result.mChecksum);
+
+        size_t numDiffering = 0;
+        if (scale && threads > 1) {
+            printf(", %.2fx", (double)single.mBestUs / result.mBestUs);
+
+            if (result.mNumSamples != single.mNumSamples) {
+                fprintf(stderr, "\n%d threads decoded %d samples instead "
+                        "of %d\n", threads, (int)result.mNumSamples,
+                        (int)single.mNumSamples);
+                return 1;
+            }
+            for (size_t i = 0; i < result.mNumSamples; ++i) {
+                if (result.mPCM[i] != single.mPCM[i]) {
+                    ++numDiffering;
+                }
+            }
+            if (isAAC) {
+                printf(", %d samples differ", (int)numDiffering);
+            }
+        }
+        printf("\n");
+
+        if (!isAAC && numDiffering > 0) {
+            fprintf(stderr, "%d threads decoded a different stream\n",
+                    threads);
+            return 1;
+        }
+
+        if (single.mPCM == NULL) {
+            single = result;
+        } else {
+            free(result.mPCM);
+        }
+    }
+
+    free(single.mPCM);
+    free(data);
+
+    return 0;
+}
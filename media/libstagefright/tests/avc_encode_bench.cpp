@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Software AVC encoder speed and quality.
+//
+// Encodes a planar YUV 4:2:0 sequence, e.g. one of the standard CIF test
+// sequences, with the encoder behind AVCEncoder and reports frames per
+// second, the bitrate at 30 frames per second and the average PSNR of the
+// reconstructed pictures. The motion search pattern and its early exit can
+// be chosen to compare their speed against the quality they give up, and
+// screen content mode to see what skipping the unchanged macroblocks saves on
+// recorded UI sessions.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "avcenc_api.h"
+
+static int64_t getNowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_usec + tv.tv_sec * 1000000ll;
+}
+
+static int32_t MallocWrapper(void *userData, int32_t size, int32_t attrs) {
+    return reinterpret_cast<int32_t>(malloc(size));
+}
+
+static void FreeWrapper(void *userData, int32_t ptr) {
+    free(reinterpret_cast<void *>(ptr));
+}
+
+struct Frames {
+    uint8_t *mBuffers[32];
+    unsigned int mNumBuffers;
+};
+
+static int32_t DpbAllocWrapper(
+        void *userData, unsigned int sizeInMbs, unsigned int numBuffers) {
+    Frames *frames = static_cast<Frames *>(userData);
+    if (numBuffers > sizeof(frames->mBuffers) / sizeof(frames->mBuffers[0])) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < numBuffers; ++i) {
+        frames->mBuffers[i] = (uint8_t *)malloc((sizeInMbs << 7) * 3);
+    }
+    frames->mNumBuffers = numBuffers;
+    return 1;
+}
+
+static int32_t BindFrameWrapper(void *userData, int32_t index, uint8_t **yuv) {
+    Frames *frames = static_cast<Frames *>(userData);
+    *yuv = frames->mBuffers[index];
+    return 1;
+}
+
+static void UnbindFrameWrapper(void *userData, int32_t index) {
+}
+
+static double psnr(const uint8_t *a, int aPitch, const uint8_t *b, int bPitch,
+                   int width, int height) {
+    int64_t sse = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int d = a[y * aPitch + x] - b[y * bPitch + x];
+            sse += d * d;
+        }
+    }
+    if (sse == 0) {
+        return 99.0;
+    }
+    return 10.0 * log10(255.0 * 255.0 * width * height / sse);
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-m search] [-e sad] [-S [-d dirty.txt]] "
+                    "[-q qp | -b bitrate] [-n frames] [-o out.h264] "
+                    "in.yuv width height\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -m spiral (default), diamond, hexagon or full\n");
+    fprintf(stderr, "       -e skip the search pattern below this 16x16 SAD\n");
+    fprintf(stderr, "       -S screen content, skip the unchanged macroblocks\n");
+    fprintf(stderr, "       -d changed areas, lines of "
+                    "\"frame left top right bottom\"\n");
+    fprintf(stderr, "       -q constant QP (default 28)\n");
+    fprintf(stderr, "       -b bitrate with rate control, at 30 fps\n");
+    fprintf(stderr, "       -n encode at most this many frames\n");
+    fprintf(stderr, "       -o write the stream\n");
+}
+
+int main(int argc, char **argv) {
+    AVCMESearch search = AVC_ME_SPIRAL;
+    bool fullSearch = false;
+    int earlyExit = 0;
+    bool screenContent = false;
+    const char *dirtyPath = NULL;
+    int qp = 28;
+    int bitrate = 0;
+    int maxFrames = -1;
+    const char *outPath = NULL;
+
+    int res;
+    while ((res = getopt(argc, argv, "hm:e:Sd:q:b:n:o:")) >= 0) {
+        switch (res) {
+            case 'm':
+                if (!strcmp(optarg, "spiral")) {
+                    search = AVC_ME_SPIRAL;
+                } else if (!strcmp(optarg, "diamond")) {
+                    search = AVC_ME_DIAMOND;
+                } else if (!strcmp(optarg, "hexagon")) {
+                    search = AVC_ME_HEXAGON;
+                } else if (!strcmp(optarg, "full")) {
+                    fullSearch = true;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'e':
+                earlyExit = atoi(optarg);
+                break;
+            case 'S':
+                screenContent = true;
+                break;
+            case 'd':
+                dirtyPath = optarg;
+                break;
+            case 'q':
+                qp = atoi(optarg);
+                break;
+            case 'b':
+                bitrate = atoi(optarg);
+                break;
+            case 'n':
+                maxFrames = atoi(optarg);
+                break;
+            case 'o':
+                outPath = optarg;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 3 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    int width = atoi(argv[optind + 1]);
+    int height = atoi(argv[optind + 2]);
+    if (width <= 0 || height <= 0 || (width | height) & 15) {
+        fprintf(stderr, "width and height must be multiples of 16\n");
+        return 1;
+    }
+
+    FILE *in = fopen(argv[optind], "rb");
+    if (in == NULL) {
+        fprintf(stderr, "unable to open %s\n", argv[optind]);
+        return 1;
+    }
+
+    FILE *dirty = NULL;
+    if (dirtyPath != NULL && (dirty = fopen(dirtyPath, "r")) == NULL) {
+        fprintf(stderr, "unable to open %s\n", dirtyPath);
+        return 1;
+    }
+
+    FILE *out = NULL;
+    if (outPath != NULL && (out = fopen(outPath, "wb")) == NULL) {
+        fprintf(stderr, "unable to create %s\n", outPath);
+        return 1;
+    }
+
+    Frames frames;
+    memset(&frames, 0, sizeof(frames));
+    tagAVCHandle handle;
+    memset(&handle, 0, sizeof(handle));
+    handle.userData = &frames;
+    handle.CBAVC_DPBAlloc = DpbAllocWrapper;
+    handle.CBAVC_FrameBind = BindFrameWrapper;
+    handle.CBAVC_FrameUnbind = UnbindFrameWrapper;
+    handle.CBAVC_Malloc = MallocWrapper;
+    handle.CBAVC_Free = FreeWrapper;
+
+    int numMbs = (width / 16) * (height / 16);
+    uint32_t *sliceGroup = (uint32_t *)calloc(numMbs, sizeof(uint32_t));
+
+    tagAVCEncParam params;
+    memset(&params, 0, sizeof(params));
+    params.width = width;
+    params.height = height;
+    params.frame_rate = 30000;
+    params.rate_control = bitrate > 0 ? AVC_ON : AVC_OFF;
+    params.bitrate = bitrate > 0 ? bitrate : 1000000;
+    params.initQP = bitrate > 0 ? 0 : qp;
+    params.init_CBP_removal_delay = 1600;
+    params.CPB_size = params.bitrate >> 1;
+    params.auto_scd = AVC_ON;
+    params.out_of_band_param_set = AVC_ON;
+    params.poc_type = 2;
+    params.log2_max_poc_lsb_minus_4 = 12;
+    params.num_ref_frame = 1;
+    params.num_slice_group = 1;
+    params.slice_group = sliceGroup;
+    params.db_filter = AVC_ON;
+    params.fullsearch = fullSearch ? AVC_ON : AVC_OFF;
+    params.search_range = 16;
+    params.me_search = search;
+    params.me_early_exit = earlyExit;
+    params.screen_content = screenContent ? AVC_ON : AVC_OFF;
+    params.sub_pel = AVC_ON;
+    params.submb_pred = AVC_ON;
+    params.idr_period = 30;
+    params.profile = AVC_BASELINE;
+    params.level = AVC_LEVEL_AUTO;
+    if (PVAVCEncInitialize(&handle, &params, NULL, NULL) != AVCENC_SUCCESS) {
+        fprintf(stderr, "unable to create the encoder\n");
+        return 1;
+    }
+
+    static const uint8_t kStartCode[4] = { 0, 0, 0, 1 };
+    uint32_t nalSize = width * height * 2;
+    uint8_t *nal = (uint8_t *)malloc(nalSize);
+    uint32_t size;
+    int32_t type;
+    int64_t numBytes = 0;
+    for (;;) {
+        size = nalSize;
+        if (PVAVCEncodeNAL(&handle, nal, &size, &type) != AVCENC_SUCCESS) {
+            break;
+        }
+        numBytes += size;
+        if (out != NULL) {
+            fwrite(kStartCode, 1, sizeof(kStartCode), out);
+            fwrite(nal, 1, size, out);
+        }
+    }
+
+    size_t frameSize = width * height * 3 / 2;
+    uint8_t *yuv = (uint8_t *)malloc(frameSize);
+    int numFrames = 0, numEncoded = 0;
+    double psnrSum[3] = { 0, 0, 0 };
+
+    // Only the encoder calls are timed, not reading and PSNR.
+    int64_t elapsedUs = 0;
+    int rect[5];
+    bool haveRect = dirty != NULL && fscanf(dirty, "%d %d %d %d %d", &rect[0],
+            &rect[1], &rect[2], &rect[3], &rect[4]) == 5;
+    while ((maxFrames < 0 || numFrames < maxFrames)
+            && fread(yuv, 1, frameSize, in) == frameSize) {
+        int64_t startUs = getNowUs();
+
+        if (dirty != NULL) {
+            // Every frame gets a hint, no rectangle means nothing changed.
+            PVAVCEncAddDirtyRect(&handle, 0, 0, 0, 0);
+            while (haveRect && rect[0] <= numFrames) {
+                if (rect[0] == numFrames) {
+                    PVAVCEncAddDirtyRect(
+                            &handle, rect[1], rect[2], rect[3], rect[4]);
+                }
+                haveRect = fscanf(dirty, "%d %d %d %d %d", &rect[0], &rect[1],
+                                  &rect[2], &rect[3], &rect[4]) == 5;
+            }
+        }
+
+        AVCFrameIO input;
+        memset(&input, 0, sizeof(input));
+        input.height = height;
+        input.pitch = width;
+        input.coding_timestamp = numFrames * 1000 / 30;
+        input.disp_order = numFrames;
+        input.YCbCr[0] = yuv;
+        input.YCbCr[1] = yuv + width * height;
+        input.YCbCr[2] = input.YCbCr[1] + width * height / 4;
+        ++numFrames;
+
+        AVCEnc_Status status = PVAVCEncSetInput(&handle, &input);
+        if (status != AVCENC_SUCCESS && status != AVCENC_NEW_IDR) {
+            // Skipped by the rate control.
+            elapsedUs += getNowUs() - startUs;
+            continue;
+        }
+
+        do {
+            size = nalSize;
+            status = PVAVCEncodeNAL(&handle, nal, &size, &type);
+            if (status != AVCENC_SUCCESS && status != AVCENC_PICTURE_READY) {
+                fprintf(stderr, "encoding failed: %d\n", status);
+                return 1;
+            }
+            numBytes += size;
+            if (out != NULL) {
+                fwrite(kStartCode, 1, sizeof(kStartCode), out);
+                fwrite(nal, 1, size, out);
+            }
+        } while (status != AVCENC_PICTURE_READY);
+
+        elapsedUs += getNowUs() - startUs;
+
+        AVCFrameIO recon;
+        if (PVAVCEncGetRecon(&handle, &recon) == AVCENC_SUCCESS) {
+            psnrSum[0] += psnr(input.YCbCr[0], width, recon.YCbCr[0],
+                               recon.pitch, width, height);
+            for (int c = 1; c < 3; ++c) {
+                psnrSum[c] += psnr(input.YCbCr[c], width / 2, recon.YCbCr[c],
+                                   recon.pitch / 2, width / 2, height / 2);
+            }
+            PVAVCEncReleaseRecon(&handle, &recon);
+        }
+        ++numEncoded;
+    }
+
+    PVAVCCleanUpEncoder(&handle);
+    for (unsigned int i = 0; i < frames.mNumBuffers; ++i) {
+        free(frames.mBuffers[i]);
+    }
+
+    if (numEncoded == 0) {
+        fprintf(stderr, "no frames encoded\n");
+        return 1;
+    }
+
+    printf("%dx%d, %d frames (%d encoded) in %.3f s, %.1f fps, "
+           "%.1f kbps at 30 fps, PSNR Y %.2f U %.2f V %.2f dB\n",
+           width, height, numFrames, numEncoded, elapsedUs / 1E6,
+           numFrames * 1E6 / elapsedUs, numBytes * 8 * 30.0 / numFrames / 1000,
+           psnrSum[0] / numEncoded, psnrSum[1] / numEncoded,
+           psnrSum[2] / numEncoded);
+
+    if (out != NULL) {
+        fclose(out);
+    }
+    if (dirty != NULL) {
+        fclose(dirty);
+    }
+    fclose(in);
+    free(yuv);
+    free(nal);
+    free(sliceGroup);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// ColorConverter throughput at 1080p.
+//
+// Converts a 1920x1080 frame from each source format to each output format
+// with the plain C code, with the vector code and with the vector code in
+// bands on the given numbers of threads, and reports frames per second.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <media/stagefright/ColorConverter.h>
+
+using namespace android;
+
+static const size_t kWidth = 1920;
+static const size_t kHeight = 1080;
+
+static int64_t getNowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_usec + tv.tv_sec * 1000000ll;
+}
+
+static const struct {
+    OMX_COLOR_FORMATTYPE mFormat;
+    const char *mName;
+} kSrcFormats[] = {
+    { OMX_COLOR_FormatYUV420Planar, "YUV420Planar" },
+    { OMX_COLOR_FormatCbYCrY, "CbYCrY" },
+    { OMX_QCOM_COLOR_FormatYVU420SemiPlanar, "QCOMYVU420SemiPlanar" },
+    { OMX_COLOR_FormatYUV420SemiPlanar, "YUV420SemiPlanar" },
+    { OMX_TI_COLOR_FormatYUV420PackedSemiPlanar, "TIYUV420PackedSemiPlanar" },
+}, kDstFormats[] = {
+    { OMX_COLOR_Format16bitRGB565, "RGB565" },
+    { OMX_COLOR_Format32bitARGB8888, "BGRA8888" },
+    { OMX_COLOR_Format32BitRGBA8888, "RGBA8888" },
+};
+
+static double measure(
+        OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to, bool scalarOnly,
+        size_t numThreads, const uint8_t *src, uint8_t *dst,
+        int64_t durationUs) {
+    ColorConverter converter(from, to);
+    converter.setScalarOnly(scalarOnly);
+    converter.setNumThreads(numThreads);
+
+    int64_t startUs = getNowUs();
+    int64_t nowUs = startUs;
+    size_t numFrames = 0;
+    while (nowUs - startUs < durationUs) {
+        converter.convert(
+                src, kWidth, kHeight, 0, 0, kWidth - 1, kHeight - 1,
+                dst, kWidth, kHeight, 0, 0, kWidth - 1, kHeight - 1);
+        ++numFrames;
+        nowUs = getNowUs();
+    }
+    return numFrames * 1E6 / (nowUs - startUs);
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-t threads] [-d seconds]\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -t most threads to try (default 4)\n");
+    fprintf(stderr, "       -d seconds per measurement (default 1)\n");
+}
+
+int main(int argc, char **argv) {
+    size_t maxNumThreads = 4;
+    int64_t durationUs = 1000000ll;
+
+    int res;
+    while ((res = getopt(argc, argv, "ht:d:")) >= 0) {
+        switch (res) {
+            case 't':
+                maxNumThreads = atoi(optarg);
+                break;
+            case 'd':
+                durationUs = atof(optarg) * 1E6;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc || maxNumThreads == 0 || durationUs <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint8_t *src = new uint8_t[kWidth * kHeight * 2];
+    uint8_t *dst = new uint8_t[kWidth * kHeight * 4];
+    uint32_t seed = 1;
+    for (size_t i = 0; i < kWidth * kHeight * 2; ++i) {
+        seed = seed * 1103515245 + 12345;
+        src[i] = seed >> 24;
+    }
+
+    printf("%dx%d, frames per second: C, vector", kWidth, kHeight);
+    for (size_t n = 2; n <= maxNumThreads; n *= 2) {
+        printf(", %d threads", n);
+    }
+    printf("\n");
+
+    for (size_t i = 0; i < sizeof(kSrcFormats) / sizeof(kSrcFormats[0]); ++i) {
+        for (size_t j = 0;
+             j < sizeof(kDstFormats) / sizeof(kDstFormats[0]); ++j) {
+            OMX_COLOR_FORMATTYPE from = kSrcFormats[i].mFormat;
+            OMX_COLOR_FORMATTYPE to = kDstFormats[j].mFormat;
+
+            printf("  %s to %s: %.1f, %.1f",
+                   kSrcFormats[i].mName, kDstFormats[j].mName,
+                   measure(from, to, true, 1, src, dst, durationUs),
+                   measure(from, to, false, 1, src, dst, durationUs));
+            for (size_t n = 2; n <= maxNumThreads; n *= 2) {
+                printf(", %.1f", measure(from, to, false, n, src, dst,
+                        durationUs));
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    delete[] src;
+    delete[] dst;
+
+    return 0;
+}
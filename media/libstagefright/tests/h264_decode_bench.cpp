@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Software H.264 decoder throughput.
+//
+// Decodes an H.264 byte stream (.h264, start code delimited) with the
+// decoder behind SoftAVC and reports frames per second and a checksum of
+// the decoded pictures, which is the same for every build of the decoder
+// and any number of decoder threads. Optionally writes the pictures as
+// planar YUV 4:2:0. With -s the stream is decoded with 1 up to the given
+// number of threads to show how decoding scales with the cores.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "H264SwDecApi.h"
+
+static int64_t getNowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_usec + tv.tv_sec * 1000000ll;
+}
+
+static uint32_t adler32(uint32_t adler, const uint8_t *data, size_t size) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        size_t n = size < 4096 ? size : 4096;
+        size -= n;
+        while (n-- > 0) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-i iterations] [-t threads] [-s] "
+                    "[-o out.yuv] file.h264\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -i decode the stream this many times (default 1)\n");
+    fprintf(stderr, "       -t number of decoder threads (default 1)\n");
+    fprintf(stderr, "       -s decode with 1 up to -t threads\n");
+    fprintf(stderr, "       -o write the pictures of the first pass\n");
+}
+
+struct Result {
+    size_t mWidth, mHeight;
+    int mNumPictures;
+    uint32_t mChecksum;
+    int64_t mBestUs;
+};
+
+static bool decode(const u8 *stream, size_t streamSize, int numThreads,
+                   int numIterations, FILE *out, Result *result) {
+    result->mBestUs = -1;
+    result->mWidth = result->mHeight = 0;
+
+    // The decoder removes emulation prevention bytes in place, every pass
+    // decodes a fresh copy of the stream.
+    u8 *copy = (u8 *)malloc(streamSize);
+    for (int i = 0; i < numIterations; ++i) {
+        memcpy(copy, stream, streamSize);
+
+        H264SwDecInst decoder;
+        if (H264SwDecInit(&decoder, 0) != H264SWDEC_OK
+                || H264SwDecSetNumThreads(decoder, numThreads)
+                        != H264SWDEC_OK) {
+            fprintf(stderr, "unable to create the decoder\n");
+            free(copy);
+            return false;
+        }
+
+        H264SwDecInput input;
+        memset(&input, 0, sizeof(input));
+        input.pStream = copy;
+        input.dataLen = streamSize;
+        H264SwDecOutput output;
+        H264SwDecPicture picture;
+
+        result->mNumPictures = 0;
+        result->mChecksum = 1;
+        bool flush = false;
+
+        // Only the decoder calls are timed, not the checksum and output.
+        int64_t elapsedUs = 0;
+        for (;;) {
+            int64_t startUs = getNowUs();
+            H264SwDecRet ret = H264SWDEC_STRM_PROCESSED;
+            if (input.dataLen > 0) {
+                ret = H264SwDecDecode(decoder, &input, &output);
+                if (ret < 0) {
+                    fprintf(stderr, "decoding failed: %d\n", ret);
+                    free(copy);
+                    return false;
+                }
+                input.dataLen -= (u32)(output.pStrmCurrPos - input.pStream);
+                input.pStream = output.pStrmCurrPos;
+                ++input.picId;
+            } else {
+                flush = true;
+            }
+
+            if (ret == H264SWDEC_HDRS_RDY_BUFF_NOT_EMPTY) {
+                H264SwDecInfo info;
+                H264SwDecGetInfo(decoder, &info);
+                result->mWidth = info.picWidth;
+                result->mHeight = info.picHeight;
+            }
+
+            while (H264SwDecNextPicture(decoder, &picture, flush)
+                    == H264SWDEC_PIC_RDY) {
+                elapsedUs += getNowUs() - startUs;
+
+                const uint8_t *data = (const uint8_t *)picture.pOutputPicture;
+                size_t size = result->mWidth * result->mHeight * 3 / 2;
+                result->mChecksum = adler32(result->mChecksum, data, size);
+                if (out != NULL && i == 0) {
+                    fwrite(data, 1, size, out);
+                }
+                ++result->mNumPictures;
+
+                startUs = getNowUs();
+            }
+            elapsedUs += getNowUs() - startUs;
+
+            if (flush) {
+                break;
+            }
+        }
+        if (result->mBestUs < 0 || elapsedUs < result->mBestUs) {
+            result->mBestUs = elapsedUs;
+        }
+
+        H264SwDecRelease(decoder);
+    }
+    free(copy);
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int numIterations = 1;
+    int numThreads = 1;
+    bool scale = false;
+    const char *outPath = NULL;
+
+    int res;
+    while ((res = getopt(argc, argv, "hi:t:so:")) >= 0) {
+        switch (res) {
+            case 'i':
+                numIterations = atoi(optarg);
+                break;
+            case 't':
+                numThreads = atoi(optarg);
+                break;
+            case 's':
+                scale = true;
+                break;
+            case 'o':
+                outPath = optarg;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 1 != argc || numIterations <= 0 || numThreads <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[optind], "rb");
+    if (file == NULL) {
+        fprintf(stderr, "unable to open %s\n", argv[optind]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    long streamSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    u8 *stream = (u8 *)malloc(streamSize);
+    if (fread(stream, 1, streamSize, file) != (size_t)streamSize) {
+        fprintf(stderr, "unable to read %s\n", argv[optind]);
+        return 1;
+    }
+    fclose(file);
+
+    FILE *out = NULL;
+    if (outPath != NULL && (out = fopen(outPath, "wb")) == NULL) {
+        fprintf(stderr, "unable to create %s\n", outPath);
+        return 1;
+    }
+
+    Result single;
+    for (int threads = scale ? 1 : numThreads; threads <= numThreads;
+            ++threads) {
+        Result result;
+        if (!decode(stream, streamSize, threads, numIterations,
+                    threads == 1 || !scale ? out : NULL, &result)) {
+            return 1;
+        }
+        if (threads == 1) {
+            single = result;
+        }
+
+        printf("%dx%d, %d threads, %d pictures in %.3f s, %.1f fps, "
+               "checksum %08x",
+               (int)result.mWidth, (int)result.mHeight, threads,
+               result.mNumPictures, result.mBestUs / 1E6,
+               result.mNumPictures * 1E6 / result.mBestUs, result.mChecksum);
+        if (scale && threads > 1) {
+            printf(", %.2fx", (double)single.mBestUs / result.mBestUs);
+        }
+        printf("\n");
+
+        if (scale && threads > 1 && result.mChecksum != single.mChecksum) {
+            fprintf(stderr, "%d threads decoded a different stream\n",
+                    threads);
+            return 1;
+        }
+    }
+
+    if (out != NULL) {
+        fclose(out);
+    }
+
+    free(stream);
+
+    return 0;
+}
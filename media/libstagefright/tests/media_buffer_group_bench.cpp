@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MediaBufferGroup throughput.
+//
+// Producer threads acquire buffers from one group, fill them and hand them
+// to consumer threads, which read them and release them back to the group,
+// like a decoder and its client. Without consumers the producers release
+// the buffers themselves, which is the cost of the group alone. Reports the
+// buffers passed per second.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaBufferGroup.h>
+#include <media/stagefright/MediaDebug.h>
+#include <utils/Errors.h>
+
+using namespace android;
+
+static const size_t kMaxNumThreads = 16;
+static const int32_t kQueueSize = 1024;  // More than a group can hold.
+
+static int64_t getNowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_usec + tv.tv_sec * 1000000ll;
+}
+
+// Hands buffers from one producer to one consumer.
+struct Queue {
+    MediaBuffer *mBuffers[kQueueSize];
+    volatile int32_t mFront;
+    volatile int32_t mRear;
+};
+
+struct Bench {
+    MediaBufferGroup *mGroup;
+    Queue mQueues[kMaxNumThreads];
+    size_t mNumProducers;
+    size_t mNumConsumers;
+    int32_t mNumBuffersPerProducer;
+    size_t mNumBytesTouched;
+    bool mTryAcquire;
+    volatile int32_t mNumProducersDone;
+    volatile int32_t mNumTryAcquireFailures;
+};
+
+struct Worker {
+    Bench *mBench;
+    size_t mIndex;
+    pthread_t mThread;
+};
+
+static void *producer(void *me) {
+    Worker *worker = (Worker *)me;
+    Bench *bench = worker->mBench;
+    Queue *queue = &bench->mQueues[worker->mIndex];
+
+    for (int32_t i = 0; i < bench->mNumBuffersPerProducer; ++i) {
+        MediaBuffer *buffer;
+        if (bench->mTryAcquire) {
+            while (bench->mGroup->try_acquire_buffer(&buffer) != OK) {
+                android_atomic_inc(&bench->mNumTryAcquireFailures);
+                sched_yield();
+            }
+        } else {
+            CHECK_EQ(bench->mGroup->acquire_buffer(&buffer), (status_t)OK);
+        }
+
+        memset(buffer->data(), i, bench->mNumBytesTouched);
+        buffer->set_range(0, bench->mNumBytesTouched);
+
+        if (bench->mNumConsumers == 0) {
+            buffer->release();
+            continue;
+        }
+
+        int32_t rear = queue->mRear;
+        CHECK(rear - android_atomic_acquire_load(&queue->mFront) < kQueueSize);
+        queue->mBuffers[rear % kQueueSize] = buffer;
+        android_atomic_release_store(rear + 1, &queue->mRear);
+    }
+
+    android_atomic_inc(&bench->mNumProducersDone);
+    return NULL;
+}
+
+static void *consumer(void *me) {
+    Worker *worker = (Worker *)me;
+    Bench *bench = worker->mBench;
+
+    uint32_t checksum = 0;
+    for (;;) {
+        bool done =
+            android_atomic_acquire_load(&bench->mNumProducersDone)
+                == (int32_t)bench->mNumProducers;
+
+        bool idle = true;
+        for (size_t i = worker->mIndex; i < bench->mNumProducers;
+             i += bench->mNumConsumers) {
+            Queue *queue = &bench->mQueues[i];
+            int32_t front = queue->mFront;
+            int32_t rear = android_atomic_acquire_load(&queue->mRear);
+            for (; front != rear; ++front) {
+                MediaBuffer *buffer = queue->mBuffers[front % kQueueSize];
+                const uint8_t *data = (const uint8_t *)buffer->data();
+                for (size_t j = 0; j < buffer->range_length(); j += 64) {
+                    checksum += data[j];
+                }
+                buffer->release();
+                idle = false;
+            }
+            android_atomic_release_store(front, &queue->mFront);
+        }
+
+        if (idle) {
+            if (done) {
+                break;
+            }
+            sched_yield();
+        }
+    }
+
+    return (void *)(uintptr_t)checksum;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-p producers] [-c consumers] [-n buffers] "
+                    "[-g max buffers] [-i iterations] [-b bytes] [-t]\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -p producer threads (default 4)\n");
+    fprintf(stderr, "       -c consumer threads, with 0 the producers "
+                    "release the buffers (default 4)\n");
+    fprintf(stderr, "       -n buffers added to the group (default 8)\n");
+    fprintf(stderr, "       -g buffers the group may grow to (default 0)\n");
+    fprintf(stderr, "       -i buffers per producer (default 500000)\n");
+    fprintf(stderr, "       -b bytes written per buffer (default 256)\n");
+    fprintf(stderr, "       -t use try_acquire_buffer and yield\n");
+}
+
+int main(int argc, char **argv) {
+    static Bench bench;
+    memset(&bench, 0, sizeof(bench));
+
+    bench.mNumProducers = 4;
+    bench.mNumConsumers = 4;
+    bench.mNumBuffersPerProducer = 500000;
+    bench.mNumBytesTouched = 256;
+    size_t numBuffers = 8;
+    size_t maxNumBuffers = 0;
+
+    int res;
+    while ((res = getopt(argc, argv, "hp:c:n:g:i:b:t")) >= 0) {
+        switch (res) {
+            case 'p':
+                bench.mNumProducers = atoi(optarg);
+                break;
+            case 'c':
+                bench.mNumConsumers = atoi(optarg);
+                break;
+            case 'n':
+                numBuffers = atoi(optarg);
+                break;
+            case 'g':
+                maxNumBuffers = atoi(optarg);
+                break;
+            case 'i':
+                bench.mNumBuffersPerProducer = atoi(optarg);
+                break;
+            case 'b':
+                bench.mNumBytesTouched = atoi(optarg);
+                break;
+            case 't':
+                bench.mTryAcquire = true;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (bench.mNumProducers == 0 || bench.mNumProducers > kMaxNumThreads
+            || bench.mNumConsumers > bench.mNumProducers
+            || numBuffers == 0 || numBuffers > (size_t)kQueueSize
+            || maxNumBuffers > (size_t)kQueueSize
+            || bench.mNumBuffersPerProducer <= 0
+            || bench.mNumBytesTouched == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bench.mGroup = new MediaBufferGroup(maxNumBuffers);
+    for (size_t i = 0; i < numBuffers; ++i) {
+        bench.mGroup->add_buffer(new MediaBuffer(bench.mNumBytesTouched));
+    }
+
+    printf("%d producers, %d consumers, %d buffers (up to %d)%s\n",
+           (int)bench.mNumProducers, (int)bench.mNumConsumers,
+           (int)numBuffers, (int)maxNumBuffers,
+           bench.mTryAcquire ? ", try_acquire_buffer" : "");
+
+    Worker producers[kMaxNumThreads];
+    Worker consumers[kMaxNumThreads];
+
+    int64_t startUs = getNowUs();
+    for (size_t i = 0; i < bench.mNumConsumers; ++i) {
+        consumers[i].mBench = &bench;
+        consumers[i].mIndex = i;
+        pthread_create(&consumers[i].mThread, NULL, consumer, &consumers[i]);
+    }
+    for (size_t i = 0; i < bench.mNumProducers; ++i) {
+        producers[i].mBench = &bench;
+        producers[i].mIndex = i;
+        pthread_create(&producers[i].mThread, NULL, producer, &producers[i]);
+    }
+
+    for (size_t i = 0; i < bench.mNumProducers; ++i) {
+        pthread_join(producers[i].mThread, NULL);
+    }
+    for (size_t i = 0; i < bench.mNumConsumers; ++i) {
+        void *dummy;
+        pthread_join(consumers[i].mThread, &dummy);
+    }
+    int64_t elapsedUs = getNowUs() - startUs;
+
+    int64_t numPassed =
+        (int64_t)bench.mNumProducers * bench.mNumBuffersPerProducer;
+    printf("  %lld buffers in %.2f s, %.0f buffers/s, "
+           "%d failed tries\n",
+           numPassed, elapsedUs / 1E6, numPassed * 1E6 / elapsedUs,
+           bench.mNumTryAcquireFailures);
+
+    delete bench.mGroup;
+    bench.mGroup = NULL;
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MPEG4 open and seek time.
+//
+// Opens an .mp4 file and the sources of all its tracks, reads the first
+// sample of each, then seeks the first video track (or the first track) to
+// random times and reads the sample found, like a user scrubbing through a
+// movie. Reports the wall time of both, which for long (e.g. 2 hour) movies
+// is dominated by the lookups in the sample tables or, for fragmented
+// files, by finding the fragments.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+static int64_t getNowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_usec + tv.tv_sec * 1000000ll;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n seeks] file.mp4\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -n number of random seeks (default 200)\n");
+}
+
+int main(int argc, char **argv) {
+    int numSeeks = 200;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:")) >= 0) {
+        switch (res) {
+            case 'n':
+                numSeeks = atoi(optarg);
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 1 != argc || numSeeks <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int64_t startUs = getNowUs();
+
+    sp<DataSource> dataSource = DataSource::CreateFromURI(argv[optind]);
+    if (dataSource == NULL) {
+        fprintf(stderr, "unable to open %s\n", argv[optind]);
+        return 1;
+    }
+
+    sp<MediaExtractor> extractor =
+        MediaExtractor::Create(dataSource, MEDIA_MIMETYPE_CONTAINER_MPEG4);
+    if (extractor == NULL || extractor->countTracks() == 0) {
+        fprintf(stderr, "%s is not a playable mp4 file\n", argv[optind]);
+        return 1;
+    }
+
+    Vector<sp<MediaSource> > sources;
+    size_t seekTrack = 0;
+    bool foundVideo = false;
+    int64_t durationUs = 0;
+    for (size_t i = 0; i < extractor->countTracks(); ++i) {
+        sp<MetaData> meta = extractor->getTrackMetaData(i);
+        sources.push(extractor->getTrack(i));
+
+        const char *mime;
+        if (!foundVideo && meta->findCString(kKeyMIMEType, &mime)
+                && !strncasecmp(mime, "video/", 6)) {
+            seekTrack = i;
+            foundVideo = true;
+        }
+
+        int64_t trackDurationUs;
+        if (meta->findInt64(kKeyDuration, &trackDurationUs)
+                && trackDurationUs > durationUs) {
+            durationUs = trackDurationUs;
+        }
+    }
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i]->start() != OK) {
+            fprintf(stderr, "unable to start track %d\n", i);
+            return 1;
+        }
+    }
+
+    int64_t openUs = getNowUs() - startUs;
+
+    // Playback starts once every track has its first sample.
+    for (size_t i = 0; i < sources.size(); ++i) {
+        MediaBuffer *buffer;
+        if (sources[i]->read(&buffer) != OK) {
+            fprintf(stderr, "unable to read track %d\n", i);
+            return 1;
+        }
+        buffer->release();
+    }
+
+    int64_t firstSampleUs = getNowUs() - startUs;
+    printf("open: %d tracks, %.1f min, %.2f ms, first samples after %.2f ms\n",
+           sources.size(), durationUs / 60E6, openUs / 1E3,
+           firstSampleUs / 1E3);
+
+    if (durationUs <= 0) {
+        fprintf(stderr, "unknown duration, not seeking\n");
+        return 1;
+    }
+
+    sp<MediaSource> source = sources[seekTrack];
+    int64_t maxSeekUs = 0;
+    int64_t totalSeekUs = 0;
+    int errors = 0;
+
+    srand(1);
+    for (int i = 0; i < numSeeks; ++i) {
+        int64_t seekTimeUs = (int64_t)(durationUs * (rand() / (RAND_MAX + 1.0)));
+
+        MediaSource::ReadOptions options;
+        options.setSeekTo(seekTimeUs, MediaSource::ReadOptions::SEEK_CLOSEST_SYNC);
+
+        int64_t seekStartUs = getNowUs();
+
+        MediaBuffer *buffer;
+        status_t err = source->read(&buffer, &options);
+
+        int64_t seekUs = getNowUs() - seekStartUs;
+
+        if (err != OK) {
+            ++errors;
+            continue;
+        }
+        buffer->release();
+
+        totalSeekUs += seekUs;
+        if (seekUs > maxSeekUs) {
+            maxSeekUs = seekUs;
+        }
+    }
+
+    printf("seek: %d seeks on track %d, %.3f ms average, %.3f ms max, "
+           "%d errors\n", numSeeks, seekTrack,
+           totalSeekUs / 1E3 / (numSeeks - errors > 0 ? numSeeks - errors : 1),
+           maxSeekUs / 1E3, errors);
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+        sources[i]->stop();
+    }
+
+    return 0;
+}
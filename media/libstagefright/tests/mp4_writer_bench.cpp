@@ -0,0 +1,485 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MPEG4Writer memory use and crash recovery.
+//
+// Records a synthetic AVC and AMR-NB movie of the given duration, by default
+// 100 times faster than real time, and reports the resident set size of the
+// process along the way. For plain and fast start files it grows with the
+// sample tables, for fragmented files it should not. Then records the movie
+// again in a child process that gets killed halfway through, as if the device
+// had crashed, and reports how much of it can still be played back.
+//
+// Also reports how the writer kept up with the file: its write statistics,
+// and the longest time a source was not read from, which is how long a
+// capture source would have been stalled.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDebug.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/MPEG4Writer.h>
+#include <media/stagefright/Utils.h>
+#include <utils/String8.h>
+
+using namespace android;
+
+static const int32_t kFrameRate = 30;
+static const int64_t kAudioFrameDurationUs = 20000;  // AMR-NB
+static const size_t kAudioFrameSize = 32;
+
+static int64_t getNowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_usec + tv.tv_sec * 1000000ll;
+}
+
+static long getRssKb() {
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    long rssKb = -1;
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (!strncmp(line, "VmRSS:", 6)) {
+            rssKb = atol(line + 6);
+            break;
+        }
+    }
+    fclose(file);
+    return rssKb;
+}
+
+struct SyntheticSource : public MediaSource {
+    SyntheticSource(
+            bool isVideo, size_t videoFrameSize, int64_t durationUs,
+            int32_t speed)
+        : mIsVideo(isVideo),
+          mFrameSize(isVideo? videoFrameSize: kAudioFrameSize),
+          mFrameDurationUs(isVideo? 1000000ll / kFrameRate: kAudioFrameDurationUs),
+          mDurationUs(durationUs),
+          mSpeed(speed),
+          mStartUs(0),
+          mKillAtUs(-1),
+          mReportEveryUs(-1),
+          mNumFrames(0),
+          mPeakRssKb(0),
+          mLastReadUs(-1),
+          mMaxReadIntervalUs(0) {
+        mFormat = new MetaData;
+        if (isVideo) {
+            // Baseline profile level 3.1, no parameter sets are needed
+            // to write or read the file.
+            static const uint8_t kAVCC[] = {
+                0x01, 0x42, 0xc0, 0x1f, 0xff, 0xe0, 0x00
+            };
+            mFormat->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_AVC);
+            mFormat->setInt32(kKeyWidth, 1280);
+            mFormat->setInt32(kKeyHeight, 720);
+            mFormat->setInt32(kKeyFrameRate, kFrameRate);
+            mFormat->setInt32(kKeyIFramesInterval, 1);
+            mFormat->setData(kKeyAVCC, kTypeAVCC, kAVCC, sizeof(kAVCC));
+        } else {
+            mFormat->setCString(kKeyMIMEType, MEDIA_MIMETYPE_AUDIO_AMR_NB);
+            mFormat->setInt32(kKeyChannelCount, 1);
+            mFormat->setInt32(kKeySampleRate, 8000);
+        }
+    }
+
+    // Kills the process when the movie reaches the given time.
+    void killAt(int64_t timeUs) { mKillAtUs = timeUs; }
+
+    // Prints the resident set size every so much of the movie.
+    void reportEvery(int64_t timeUs) { mReportEveryUs = timeUs; }
+
+    long peakRssKb() const { return mPeakRssKb; }
+
+    // Longest time from returning a frame to being asked for the next.
+    int64_t maxReadIntervalUs() const { return mMaxReadIntervalUs; }
+
+    virtual status_t start(MetaData *params) {
+        mNumFrames = 0;
+        mStartUs = getNowUs();
+        mLastReadUs = -1;
+        mMaxReadIntervalUs = 0;
+        return OK;
+    }
+
+    virtual status_t stop() {
+        return OK;
+    }
+
+    virtual sp<MetaData> getFormat() {
+        return mFormat;
+    }
+
+    virtual status_t read(
+            MediaBuffer **buffer, const ReadOptions *options) {
+        if (mLastReadUs >= 0) {
+            int64_t intervalUs = getNowUs() - mLastReadUs;
+            if (intervalUs > mMaxReadIntervalUs) {
+                mMaxReadIntervalUs = intervalUs;
+            }
+        }
+
+        int64_t timeUs = mNumFrames * mFrameDurationUs;
+        if (timeUs >= mDurationUs) {
+            return ERROR_END_OF_STREAM;
+        }
+
+        // Like a capture source, don't get ahead of the clock.
+        int64_t delayUs = mStartUs + timeUs / mSpeed - getNowUs();
+        if (delayUs > 0) {
+            usleep(delayUs);
+        }
+
+        if (mKillAtUs >= 0 && timeUs >= mKillAtUs) {
+            kill(getpid(), SIGKILL);
+        }
+
+        if (mReportEveryUs > 0 && timeUs % mReportEveryUs < mFrameDurationUs) {
+            long rssKb = getRssKb();
+            if (rssKb > mPeakRssKb) {
+                mPeakRssKb = rssKb;
+            }
+            printf("  at %4lld s: rss %ld KB\n", timeUs / 1000000, rssKb);
+        }
+
+        MediaBuffer *out = new MediaBuffer(mFrameSize);
+        memset(out->data(), mNumFrames & 0xff, mFrameSize);
+        out->meta_data()->setInt64(kKeyTime, timeUs);
+        out->meta_data()->setInt32(
+                kKeyIsSyncFrame, !mIsVideo || (mNumFrames % kFrameRate) == 0);
+        ++mNumFrames;
+
+        *buffer = out;
+        mLastReadUs = getNowUs();
+        return OK;
+    }
+
+protected:
+    virtual ~SyntheticSource() {}
+
+private:
+    bool mIsVideo;
+    size_t mFrameSize;
+    int64_t mFrameDurationUs;
+    int64_t mDurationUs;
+    int32_t mSpeed;
+    int64_t mStartUs;
+    int64_t mKillAtUs;
+    int64_t mReportEveryUs;
+    int64_t mNumFrames;
+    long mPeakRssKb;
+    int64_t mLastReadUs;
+    int64_t mMaxReadIntervalUs;
+    sp<MetaData> mFormat;
+
+    SyntheticSource(const SyntheticSource &);
+    SyntheticSource &operator=(const SyntheticSource &);
+};
+
+enum Mode {
+    PLAIN,
+    FAST_START,
+    FRAGMENTED,
+};
+
+static status_t record(
+        const char *filename, Mode mode, int64_t fragmentDurationUs,
+        const sp<SyntheticSource> &video, const sp<SyntheticSource> &audio,
+        int64_t durationUs, bool dump) {
+    sp<MPEG4Writer> writer = new MPEG4Writer(filename);
+    writer->addSource(video);
+    if (audio != NULL) {
+        writer->addSource(audio);
+    }
+
+    // Tells the fast start file how long it gets.
+    writer->setMaxFileDuration(durationUs + 1000000ll);
+
+    sp<MetaData> params = new MetaData;
+    params->setInt32(kKeyNotRealTime, true);
+    if (mode == FAST_START) {
+        params->setInt32(kKeyFastStart, true);
+    } else if (mode == FRAGMENTED) {
+        params->setInt64(kKeyFragmentDurationUs, fragmentDurationUs);
+    }
+
+    status_t err = writer->start(params.get());
+    if (err != OK) {
+        return err;
+    }
+
+    while (!writer->reachedEOS()) {
+        usleep(100000);
+    }
+    if (dump) {
+        fflush(stdout);
+        writer->dump(STDOUT_FILENO, Vector<String16>());
+    }
+    return writer->stop();
+}
+
+static String8 MakeFourCCString(uint32_t x) {
+    char s[5];
+    s[0] = x >> 24;
+    s[1] = (x >> 16) & 0xff;
+    s[2] = (x >> 8) & 0xff;
+    s[3] = x & 0xff;
+    s[4] = '\0';
+
+    return String8(s);
+}
+
+// Prints the top level boxes and their sizes, runs of the same pair of
+// boxes like the movie fragments once.
+static void printLayout(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return;
+    }
+
+    Vector<uint32_t> types;
+    Vector<uint64_t> sizes;
+    off64_t offset = 0;
+    uint8_t header[16];
+    while (fseeko(file, offset, SEEK_SET) == 0
+            && fread(header, 1, 8, file) == 8) {
+        uint64_t size = U32_AT(header);
+        if (size == 1 && fread(header + 8, 1, 8, file) == 8) {
+            size = U64_AT(header + 8);
+        }
+
+        types.push(U32_AT(header + 4));
+        sizes.push(size);
+        if (size < 8) {
+            break;
+        }
+        offset += size;
+    }
+    fclose(file);
+
+    printf("  layout:");
+    size_t i = 0;
+    while (i < types.size()) {
+        size_t count = 1;
+        while (i + 2 * count + 1 < types.size()
+                && types[i + 2 * count] == types[i]
+                && types[i + 2 * count + 1] == types[i + 1]) {
+            ++count;
+        }
+
+        if (count > 1) {
+            printf(" (%s %s) x%d",
+                   MakeFourCCString(types[i]).string(),
+                   MakeFourCCString(types[i + 1]).string(), count);
+            i += 2 * count;
+        } else {
+            printf(" %s %lld",
+                   MakeFourCCString(types[i]).string(), sizes[i]);
+            ++i;
+        }
+    }
+    printf("\n");
+}
+
+// Plays back all tracks of the file, reports what is there.
+static void playBack(const char *filename) {
+    sp<DataSource> dataSource = new FileSource(filename);
+    if (dataSource->initCheck() != OK) {
+        printf("  can't open %s\n", filename);
+        return;
+    }
+
+    sp<MediaExtractor> extractor =
+        MediaExtractor::Create(dataSource, MEDIA_MIMETYPE_CONTAINER_MPEG4);
+    if (extractor == NULL || extractor->countTracks() == 0) {
+        printf("  no playable tracks\n");
+        return;
+    }
+
+    for (size_t i = 0; i < extractor->countTracks(); ++i) {
+        sp<MediaSource> source = extractor->getTrack(i);
+        const char *mime;
+        CHECK(source->getFormat()->findCString(kKeyMIMEType, &mime));
+
+        int64_t durationUs = -1;
+        source->getFormat()->findInt64(kKeyDuration, &durationUs);
+
+        if (source->start() != OK) {
+            printf("  %s: can't start\n", mime);
+            continue;
+        }
+
+        size_t numSamples = 0;
+        int64_t lastTimeUs = -1;
+        MediaBuffer *buffer;
+        status_t err;
+        while ((err = source->read(&buffer)) == OK) {
+            ++numSamples;
+            buffer->meta_data()->findInt64(kKeyTime, &lastTimeUs);
+            buffer->release();
+            buffer = NULL;
+        }
+        source->stop();
+
+        printf("  %s: %d samples up to %.2f s, duration %.2f s (%s)\n",
+               mime, numSamples, lastTimeUs / 1E6, durationUs / 1E6,
+               err == ERROR_END_OF_STREAM ? "end of stream" : "error");
+    }
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-d seconds] [-b bytes] [-x speed] "
+                    "[-f seconds] [-v] [-p | -s | -F] out.mp4\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -d movie duration (default 3600)\n");
+    fprintf(stderr, "       -b video frame size (default 8192)\n");
+    fprintf(stderr, "       -x times faster than real time (default 100)\n");
+    fprintf(stderr, "       -f fragment duration (default 2)\n");
+    fprintf(stderr, "       -v video only\n");
+    fprintf(stderr, "       -p plain file (default)\n");
+    fprintf(stderr, "       -s fast start file\n");
+    fprintf(stderr, "       -F fragmented file\n");
+}
+
+int main(int argc, char **argv) {
+    int64_t durationUs = 3600 * 1000000ll;
+    int64_t fragmentDurationUs = 2000000ll;
+    size_t videoFrameSize = 8192;
+    int32_t speed = 100;
+    Mode mode = PLAIN;
+    bool videoOnly = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "hd:b:x:f:vpsF")) >= 0) {
+        switch (res) {
+            case 'd':
+                durationUs = atoll(optarg) * 1000000ll;
+                break;
+            case 'b':
+                videoFrameSize = atoi(optarg);
+                break;
+            case 'x':
+                speed = atoi(optarg);
+                break;
+            case 'f':
+                fragmentDurationUs = atoll(optarg) * 1000000ll;
+                break;
+            case 'v':
+                videoOnly = true;
+                break;
+            case 'p':
+                mode = PLAIN;
+                break;
+            case 's':
+                mode = FAST_START;
+                break;
+            case 'F':
+                mode = FRAGMENTED;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 1 != argc || durationUs <= 0 || videoFrameSize == 0
+            || speed <= 0 || fragmentDurationUs <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *filename = argv[optind];
+
+    DataSource::RegisterDefaultSniffers();
+
+    printf("recording %lld s to %s\n", durationUs / 1000000, filename);
+    long startRssKb = getRssKb();
+    int64_t startUs = getNowUs();
+    {
+        sp<SyntheticSource> video =
+            new SyntheticSource(true, videoFrameSize, durationUs, speed);
+        sp<SyntheticSource> audio;
+        if (!videoOnly) {
+            audio = new SyntheticSource(
+                    false, videoFrameSize, durationUs, speed);
+        }
+        video->reportEvery(600 * 1000000ll);
+
+        status_t err = record(
+                filename, mode, fragmentDurationUs, video, audio, durationUs,
+                true);
+        printf("  recorded in %.2f s (%d), rss %ld KB at start, "
+               "peak %ld KB, %ld KB at stop\n",
+               (getNowUs() - startUs) / 1E6, err,
+               startRssKb, video->peakRssKb(), getRssKb());
+        printf("  longest interval between reads: video %lld us",
+               video->maxReadIntervalUs());
+        if (audio != NULL) {
+            printf(", audio %lld us", audio->maxReadIntervalUs());
+        }
+        printf("\n");
+    }
+    printLayout(filename);
+    playBack(filename);
+
+    String8 crashFilename(filename);
+    crashFilename.append(".crash");
+    printf("recording to %s, killed at %lld s\n",
+           crashFilename.string(), durationUs / 2000000);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        sp<SyntheticSource> video =
+            new SyntheticSource(true, videoFrameSize, durationUs, speed);
+        sp<SyntheticSource> audio;
+        if (!videoOnly) {
+            audio = new SyntheticSource(
+                    false, videoFrameSize, durationUs, speed);
+        }
+        video->killAt(durationUs / 2);
+
+        record(crashFilename.string(), mode, fragmentDurationUs,
+               video, audio, durationUs, false);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    printLayout(crashFilename.string());
+    playBack(crashFilename.string());
+
+    return 0;
+}
@@ -5,9 +5,14 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:=               \
     AudioFlinger.cpp            \
     AudioMixer.cpp.arm          \
+    AudioMixerSimd.cpp.arm      \
     AudioResampler.cpp.arm      \
     AudioResamplerSinc.cpp.arm  \
     AudioResamplerCubic.cpp.arm \
+    AudioResamplerPolyphase.cpp.arm \
+    FanOutBuffer.cpp            \
+    FastMixer.cpp               \
+    PlaybackStatistics.cpp      \
     AudioPolicyService.cpp
 
 LOCAL_C_INCLUDES := \
@@ -30,4 +35,10 @@ LOCAL_STATIC_LIBRARIES := \
 
 LOCAL_MODULE:= libaudioflinger
 
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+    LOCAL_ARM_NEON := true
+endif
+
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
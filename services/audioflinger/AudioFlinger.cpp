@@ -48,6 +48,7 @@
 
 #include "AudioMixer.h"
 #include "AudioFlinger.h"
+#include "FastMixer.h"
 
 #include <media/EffectsFactoryApi.h>
 #include <audio_effects/effect_visualizer.h>
@@ -94,6 +95,12 @@ static const uint32_t kMinThreadSleepTimeUs = 5000;
 // maximum divider applied to the active sleep time in the mixer thread loop
 static const uint32_t kMaxThreadSleepTimeShift = 2;
 
+// minimum duration of the normal mixer buffer when a fast mixer writes to the output
+static const uint32_t kFastMixerNormalBufferMs = 20;
+// polling period and number of polls when waiting for the fast mixer to apply a new state
+static const uint32_t kFastMixerPollUs = 1000;
+static const int kFastMixerPollRetries = 100;
+
 
 // ----------------------------------------------------------------------------
 
@@ -172,6 +179,10 @@ void AudioFlinger::onFirstRef()
     /* TODO: move all this work into an Init() function */
     mHardwareStatus = AUDIO_HW_IDLE;
 
+    // Resamplers are created on the mixer threads, compute their tables
+    // before there are any.
+    AudioResampler::initTables();
+
     for (size_t i = 0; i < ARRAY_SIZE(audio_interfaces); i++) {
         const hw_module_t *mod;
         audio_hw_device_t *dev;
@@ -447,7 +458,7 @@ sp<IAudioTrack> AudioFlinger::createTrack(
         ALOGV("createTrack() lSessionId: %d", lSessionId);
 
         track = thread->createTrack_l(client, streamType, sampleRate, format,
-                channelMask, frameCount, sharedBuffer, lSessionId, &lStatus);
+                channelMask, frameCount, sharedBuffer, lSessionId, flags, &lStatus);
 
         // move effect chain to this output thread if an effect on same session was waiting
         // for a track to be created
@@ -1368,12 +1379,19 @@ AudioFlinger::PlaybackThread::PlaybackThread(const sp<AudioFlinger>& audioFlinge
                                              uint32_t device)
     :   ThreadBase(audioFlinger, id, device),
         mMixBuffer(0), mSuspended(0), mBytesWritten(0), mOutput(output),
-        mLastWriteTime(0), mNumWrites(0), mNumDelayedWrites(0), mInWrite(false)
+        mLastWriteTime(0), mNumWrites(0), mNumDelayedWrites(0), mInWrite(false),
+        mStatistics(NULL)
 {
     snprintf(mName, kNameLength, "AudioOut_%d", id);
 
     readOutputParameters();
 
+    char value[PROPERTY_VALUE_MAX];
+    property_get("af.thread_stats", value, "0");
+    if (atoi(value) != 0) {
+        mStatistics = new PlaybackStatistics();
+    }
+
     mMasterVolume = mAudioFlinger->masterVolume();
     mMasterMute = mAudioFlinger->masterMute();
 
@@ -1387,6 +1405,7 @@ AudioFlinger::PlaybackThread::PlaybackThread(const sp<AudioFlinger>& audioFlinge
 AudioFlinger::PlaybackThread::~PlaybackThread()
 {
     delete [] mMixBuffer;
+    delete mStatistics;
 }
 
 status_t AudioFlinger::PlaybackThread::dump(int fd, const Vector<String16>& args)
@@ -1405,7 +1424,7 @@ status_t AudioFlinger::PlaybackThread::dumpTracks(int fd, const Vector<String16>
 
     snprintf(buffer, SIZE, "Output thread %p tracks\n", this);
     result.append(buffer);
-    result.append("   Name  Clien Typ Fmt Chn mask   Session Buf  S M F SRate LeftV RighV  Serv       User       Main buf   Aux Buf\n");
+    result.append("   Name  Clien Typ Fmt Chn mask   Session Buf  S M F SRate LeftV RighV  Serv       User       Main buf   Aux Buf    Undrn Ready AvRdy\n");
     for (size_t i = 0; i < mTracks.size(); ++i) {
         sp<Track> track = mTracks[i];
         if (track != 0) {
@@ -1416,7 +1435,7 @@ status_t AudioFlinger::PlaybackThread::dumpTracks(int fd, const Vector<String16>
 
     snprintf(buffer, SIZE, "Output thread %p active tracks\n", this);
     result.append(buffer);
-    result.append("   Name  Clien Typ Fmt Chn mask   Session Buf  S M F SRate LeftV RighV  Serv       User       Main buf   Aux Buf\n");
+    result.append("   Name  Clien Typ Fmt Chn mask   Session Buf  S M F SRate LeftV RighV  Serv       User       Main buf   Aux Buf    Undrn Ready AvRdy\n");
     for (size_t i = 0; i < mActiveTracks.size(); ++i) {
         wp<Track> wTrack = mActiveTracks[i];
         if (wTrack != 0) {
@@ -1451,6 +1470,9 @@ status_t AudioFlinger::PlaybackThread::dumpInternals(int fd, const Vector<String
     result.append(buffer);
     snprintf(buffer, SIZE, "mix buffer : %p\n", mMixBuffer);
     result.append(buffer);
+    if (mStatistics != NULL) {
+        mStatistics->dump(result);
+    }
     write(fd, result.string(), result.size());
 
     dumpBase(fd, args);
@@ -1485,6 +1507,7 @@ sp<AudioFlinger::PlaybackThread::Track>  AudioFlinger::PlaybackThread::createTra
         int frameCount,
         const sp<IMemory>& sharedBuffer,
         int sessionId,
+        uint32_t flags,
         status_t *status)
 {
     sp<Track> track;
@@ -1534,8 +1557,26 @@ sp<AudioFlinger::PlaybackThread::Track>  AudioFlinger::PlaybackThread::createTra
             }
         }
 
+        if (flags & IAudioFlinger::TRACK_FAST) {
+            int minFrameCount = fastTrackMinFrameCount_l(sampleRate, format, channelMask,
+                    sharedBuffer, sessionId);
+            if (minFrameCount != 0) {
+                if (frameCount < minFrameCount) {
+                    frameCount = minFrameCount;
+                }
+            } else {
+                ALOGV("createTrack_l() fast track denied on thread %p", this);
+                flags &= ~IAudioFlinger::TRACK_FAST;
+                // the client did not enforce the normal minimum buffer size
+                int minFrameCount = (2 * mFrameCount * sampleRate) / mSampleRate;
+                if (sharedBuffer == 0 && frameCount < minFrameCount) {
+                    frameCount = minFrameCount;
+                }
+            }
+        }
+
         track = new Track(this, client, streamType, sampleRate, format,
-                channelMask, frameCount, sharedBuffer, sessionId);
+                channelMask, frameCount, sharedBuffer, sessionId, flags);
         if (track->getCblk() == NULL || track->name() < 0) {
             lStatus = NO_MEMORY;
             goto Exit;
@@ -1741,6 +1782,24 @@ void AudioFlinger::PlaybackThread::readOutputParameters()
     }
 }
 
+void AudioFlinger::PlaybackThread::resetStatistics()
+{
+    if (mStatistics != NULL) {
+        mStatistics->reset(seconds(mFrameCount) / mSampleRate);
+    }
+}
+
+void AudioFlinger::PlaybackThread::sleepUs(uint32_t us)
+{
+    if (mStatistics == NULL) {
+        usleep(us);
+        return;
+    }
+    nsecs_t start = systemTime();
+    usleep(us);
+    mStatistics->addSleep(systemTime() - start);
+}
+
 status_t AudioFlinger::PlaybackThread::getRenderPosition(uint32_t *halFrames, uint32_t *dspFrames)
 {
     if (halFrames == 0 || dspFrames == 0) {
@@ -1830,22 +1889,159 @@ uint32_t AudioFlinger::PlaybackThread::activeSleepTimeUs()
 
 // ----------------------------------------------------------------------------
 
-AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, AudioStreamOut* output, int id, uint32_t device)
+AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, AudioStreamOut* output,
+        int id, uint32_t device, int type)
     :   PlaybackThread(audioFlinger, output, id, device),
-        mAudioMixer(0)
+        mAudioMixer(0), mFloatMix(false), mMixBufferFloat(0), mFloatTracks(0),
+        mFastStateChanged(false)
 {
-    mType = ThreadBase::MIXER;
-    mAudioMixer = new AudioMixer(mFrameCount, mSampleRate);
+    mType = type;
 
     // FIXME - Current mixer implementation only supports stereo output
     if (mChannelCount == 1) {
         ALOGE("Invalid audio hardware channel count");
     }
+
+    char value[PROPERTY_VALUE_MAX];
+    // a duplicating thread does not own its output stream
+    property_get("af.fast_mixer", value, "0");
+    if (atoi(value) != 0 && mType == MIXER && mChannelCount == 2) {
+        createFastMixer();
+    }
+    mAudioMixer = new AudioMixer(mFrameCount, mSampleRate);
+
+    property_get("af.mixer.float", value, "0");
+    mFloatMix = atoi(value) != 0;
+    allocateFloatMixBuffer();
 }
 
 AudioFlinger::MixerThread::~MixerThread()
 {
+    destroyFastMixer();
     delete mAudioMixer;
+    delete[] mMixBufferFloat;
+}
+
+// createFastMixer() must be called with ThreadBase::mLock held, or from the constructor
+void AudioFlinger::MixerThread::createFastMixer()
+{
+    // the fast mixer writes HAL buffers to the output stream; the normal mixer
+    // writes a multiple of them to the fast mixer FIFO
+    size_t fastFrameCount = mFrameCount;
+    size_t multiple = ((kFastMixerNormalBufferMs * mSampleRate) / 1000 + fastFrameCount - 1) /
+            fastFrameCount;
+    if (multiple < 1) {
+        multiple = 1;
+    }
+    mFrameCount = fastFrameCount * multiple;
+    delete[] mMixBuffer;
+    mMixBuffer = new int16_t[mFrameCount * 2];
+    memset(mMixBuffer, 0, mFrameCount * 2 * sizeof(int16_t));
+
+    mFastMixer = new FastMixer(mOutput->stream, fastFrameCount, mSampleRate, mFrameCount);
+    mFastStateChanged = false;
+    status_t status = mFastMixer->run("FastMixer", ANDROID_PRIORITY_URGENT_AUDIO);
+    ALOGW_IF(status != NO_ERROR, "could not start fast mixer: %d", status);
+    ALOGV("fast mixer %u frames, normal mixer %u frames", fastFrameCount, mFrameCount);
+
+    // the effect chains must use the new mix buffer
+    Vector< sp<EffectChain> > effectChains = mEffectChains;
+    for (size_t i = 0; i < effectChains.size(); i ++) {
+        mAudioFlinger->moveEffectChain_l(effectChains[i]->sessionId(), this, this, false);
+    }
+}
+
+// destroyFastMixer() must be called from the mixer thread, or from the destructor
+void AudioFlinger::MixerThread::destroyFastMixer()
+{
+    if (mFastMixer == 0) {
+        return;
+    }
+    mFastMixer->editState()->mCommand = FastMixer::State::EXIT;
+    mFastMixer->pushState();
+    mFastMixer->requestExitAndWait();
+    mFastMixer.clear();
+
+    // the fast tracks have no mixer anymore: have the clients re-create them
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        sp<Track> track = mTracks[i];
+        if (track->isFastTrack()) {
+            track->mFastIndex = -1;
+            track->mFastGeneration = 0;
+            android_atomic_or(CBLK_INVALID_ON, &track->mCblk->flags);
+        }
+    }
+}
+
+// setFastMixerCommand() must be called from the mixer thread. If wait is true,
+// returns once the fast mixer has applied the state.
+void AudioFlinger::MixerThread::setFastMixerCommand(int command, bool wait)
+{
+    FastMixer::State* state = mFastMixer->editState();
+    if (state->mCommand != command || mFastStateChanged) {
+        state->mCommand = (FastMixer::State::command)command;
+        mFastMixer->pushState();
+        mFastStateChanged = false;
+    }
+    if (wait) {
+        int retries = kFastMixerPollRetries;
+        while (mFastMixer->observedGeneration() - state->mGeneration < 0) {
+            if (--retries < 0) {
+                ALOGW("fast mixer %p did not apply command %d", mFastMixer.get(), command);
+                break;
+            }
+            usleep(kFastMixerPollUs);
+        }
+    }
+}
+
+uint32_t AudioFlinger::MixerThread::latency() const
+{
+    Mutex::Autolock _l(mLock);
+    if (initCheck() != NO_ERROR) {
+        return 0;
+    }
+    uint32_t latency = mOutput->stream->get_latency(mOutput->stream);
+    if (mFastMixer != 0) {
+        // the normal mix is delayed by the fast mixer FIFO
+        latency += (mFastMixer->maxQueuedFrames() * 1000) / mSampleRate;
+    }
+    return latency;
+}
+
+int AudioFlinger::MixerThread::fastTrackMinFrameCount_l(uint32_t sampleRate, uint32_t format,
+        uint32_t channelMask, const sp<IMemory>& sharedBuffer, int sessionId)
+{
+    // fast tracks are not resampled nor processed by effects
+    if (mFastMixer == 0 || sharedBuffer != 0 || sampleRate != mSampleRate ||
+            format != AUDIO_FORMAT_PCM_16_BIT ||
+            (channelMask != AUDIO_CHANNEL_OUT_MONO && channelMask != AUDIO_CHANNEL_OUT_STEREO) ||
+            getEffectChain_l(sessionId) != 0) {
+        return 0;
+    }
+    // there is one slot in the fast mixer per fast track until it is destroyed
+    size_t fastTracks = 0;
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        if (mTracks[i]->isFastTrack()) {
+            fastTracks++;
+        }
+    }
+    if (fastTracks >= (size_t)FastMixer::kMaxFastTracks) {
+        return 0;
+    }
+    // the fast mixer reads one HAL buffer per cycle: let the client stay
+    // one buffer ahead
+    return 2 * mFastMixer->frameCount();
+}
+
+void AudioFlinger::MixerThread::allocateFloatMixBuffer()
+{
+    delete[] mMixBufferFloat;
+    mMixBufferFloat = 0;
+    if (mFloatMix) {
+        mMixBufferFloat = new float[mFrameCount * 2];
+        memset(mMixBufferFloat, 0, mFrameCount * 2 * sizeof(float));
+    }
 }
 
 bool AudioFlinger::MixerThread::threadLoop()
@@ -1865,6 +2061,7 @@ bool AudioFlinger::MixerThread::threadLoop()
     uint32_t idleSleepTime = idleSleepTimeUs();
     uint32_t sleepTime = idleSleepTime;
     uint32_t sleepTimeShift = 0;
+    nsecs_t cycleStart = 0;
     Vector< sp<EffectChain> > effectChains;
 #ifdef DEBUG_CPU_USAGE
     ThreadCpuUsage cpu;
@@ -1872,6 +2069,7 @@ bool AudioFlinger::MixerThread::threadLoop()
 #endif
 
     acquireWakeLock();
+    resetStatistics();
 
     while (!exitPending())
     {
@@ -1918,6 +2116,7 @@ bool AudioFlinger::MixerThread::threadLoop()
                 maxPeriod = seconds(mFrameCount) / mSampleRate * 15;
                 activeSleepTime = activeSleepTimeUs();
                 idleSleepTime = idleSleepTimeUs();
+                resetStatistics();
             }
 
             const SortedVector< wp<Track> >& activeTracks = mActiveTracks;
@@ -1927,6 +2126,9 @@ bool AudioFlinger::MixerThread::threadLoop()
                         mSuspended) {
                 if (!mStandby) {
                     ALOGV("Audio hardware entering standby, mixer %p, mSuspended %d\n", this, mSuspended);
+                    if (mFastMixer != 0) {
+                        setFastMixerCommand(FastMixer::State::IDLE, true);
+                    }
                     mOutput->stream->common.standby(&mOutput->stream->common);
                     mStandby = true;
                     mBytesWritten = 0;
@@ -1961,6 +2163,9 @@ bool AudioFlinger::MixerThread::threadLoop()
                 }
             }
 
+            if (mStatistics != NULL) {
+                cycleStart = systemTime();
+            }
             mixerStatus = prepareTracks_l(activeTracks, &tracksToRemove);
 
             // prevent any changes in effect chain list and in each effect chain
@@ -1972,6 +2177,9 @@ bool AudioFlinger::MixerThread::threadLoop()
         if (LIKELY(mixerStatus == MIXER_TRACKS_READY)) {
             // mix buffers...
             mAudioMixer->process();
+            if (mFloatTracks != 0) {
+                AudioMixer::convertFloatTo16(mMixBuffer, mMixBufferFloat, mFrameCount * 2);
+            }
             sleepTime = 0;
             // increase sleep time progressively when application underrun condition clears
             if (sleepTimeShift > 0) {
@@ -2018,15 +2226,28 @@ bool AudioFlinger::MixerThread::threadLoop()
              // enable changes in effect chain
              unlockEffectChains(effectChains);
             mLastWriteTime = systemTime();
+            if (mStatistics != NULL) {
+                mStatistics->addMix(mLastWriteTime - cycleStart);
+            }
             mInWrite = true;
             mBytesWritten += mixBufferSize;
 
-            int bytesWritten = (int)mOutput->stream->write(mOutput->stream, mMixBuffer, mixBufferSize);
+            int bytesWritten;
+            if (mFastMixer != 0) {
+                // the fast mixer writes to the output stream
+                setFastMixerCommand(FastMixer::State::MIX, false);
+                bytesWritten = (int)mFastMixer->write(mMixBuffer, mFrameCount) * mFrameSize;
+            } else {
+                bytesWritten = (int)mOutput->stream->write(mOutput->stream, mMixBuffer, mixBufferSize);
+            }
             if (bytesWritten < 0) mBytesWritten -= mixBufferSize;
             mNumWrites++;
             mInWrite = false;
             nsecs_t now = systemTime();
             nsecs_t delta = now - mLastWriteTime;
+            if (mStatistics != NULL) {
+                mStatistics->addWrite(mLastWriteTime, now);
+            }
             if (!mStandby && delta > maxPeriod) {
                 mNumDelayedWrites++;
                 if ((now - lastWarning) > kWarningThrottle) {
@@ -2042,7 +2263,7 @@ bool AudioFlinger::MixerThread::threadLoop()
         } else {
             // enable changes in effect chain
             unlockEffectChains(effectChains);
-            usleep(sleepTime);
+            sleepUs(sleepTime);
         }
 
         // finally let go of all our tracks, without the lock held
@@ -2055,6 +2276,11 @@ bool AudioFlinger::MixerThread::threadLoop()
         effectChains.clear();
     }
 
+    { // scope for mLock
+        Mutex::Autolock _l(mLock);
+        destroyFastMixer();
+    }
+
     if (!mStandby) {
         mOutput->stream->common.standby(&mOutput->stream->common);
     }
@@ -2074,6 +2300,8 @@ uint32_t AudioFlinger::MixerThread::prepareTracks_l(const SortedVector< wp<Track
     size_t count = activeTracks.size();
     size_t mixedTracks = 0;
     size_t tracksWithEffect = 0;
+    size_t floatTracks = 0;
+    size_t fastTracks = 0;
 
     float masterVolume = mMasterVolume;
     bool  masterMute = mMasterMute;
@@ -2081,6 +2309,8 @@ uint32_t AudioFlinger::MixerThread::prepareTracks_l(const SortedVector< wp<Track
     if (masterMute) {
         masterVolume = 0;
     }
+    // fast tracks are not processed by the output mix effects
+    const float fastMasterVolume = masterVolume;
     // Delegate master volume control to effect in output mix effect chain if needed
     sp<EffectChain> chain = getEffectChain_l(AUDIO_SESSION_OUTPUT_MIX);
     if (chain != 0) {
@@ -2097,6 +2327,15 @@ uint32_t AudioFlinger::MixerThread::prepareTracks_l(const SortedVector< wp<Track
         Track* const track = t.get();
         audio_track_cblk_t* cblk = track->cblk();
 
+        // the fast mixer reports the underruns of fast tracks, which are
+        // accounted for by prepareFastTrack_l()
+        if (track->isFastTrack()) {
+            if (prepareFastTrack_l(t, fastMasterVolume, tracksToRemove)) {
+                fastTracks++;
+            }
+            continue;
+        }
+
         // The first time a track is added we wait
         // for all its buffers to be filled before processing it
         mAudioMixer->setActiveTrack(track->name());
@@ -2114,12 +2353,16 @@ uint32_t AudioFlinger::MixerThread::prepareTracks_l(const SortedVector< wp<Track
                 minFrames = (mFrameCount * t->sampleRate()) / mSampleRate + 1;
             }
         }
-        if ((cblk->framesReady() >= minFrames) && track->isReady() &&
+        uint32_t framesReady = track->framesReady();
+        track->mFramesReady = framesReady;
+        if ((framesReady >= minFrames) && track->isReady() &&
                 !track->isPaused() && !track->isTerminated())
         {
             //ALOGV("track %d u=%08x, s=%08x [OK] on thread %p", track->name(), cblk->user, cblk->server, this);
 
             mixedTracks++;
+            track->mMixCount++;
+            track->mFramesReadySum += framesReady;
 
             // track->mainBuffer() != mMixBuffer means there is an effect chain
             // connected to the track
@@ -2212,9 +2455,23 @@ uint32_t AudioFlinger::MixerThread::prepareTracks_l(const SortedVector< wp<Track
                 AudioMixer::RESAMPLE,
                 AudioMixer::SAMPLE_RATE,
                 (void *)(cblk->sampleRate));
-            mAudioMixer->setParameter(
-                AudioMixer::TRACK,
-                AudioMixer::MAIN_BUFFER, (void *)track->mainBuffer());
+            // only the output mix bus is float: effect chain buffers stay 16 bit
+            if (mFloatMix && track->mainBuffer() == mMixBuffer) {
+                mAudioMixer->setParameter(
+                    AudioMixer::TRACK,
+                    AudioMixer::MIXER_FORMAT, (void *)AudioMixer::FORMAT_PCM_FLOAT);
+                mAudioMixer->setParameter(
+                    AudioMixer::TRACK,
+                    AudioMixer::MAIN_BUFFER, (void *)mMixBufferFloat);
+                floatTracks++;
+            } else {
+                mAudioMixer->setParameter(
+                    AudioMixer::TRACK,
+                    AudioMixer::MIXER_FORMAT, (void *)AUDIO_FORMAT_PCM_16_BIT);
+                mAudioMixer->setParameter(
+                    AudioMixer::TRACK,
+                    AudioMixer::MAIN_BUFFER, (void *)track->mainBuffer());
+            }
             mAudioMixer->setParameter(
                 AudioMixer::TRACK,
                 AudioMixer::AUX_BUFFER, (void *)track->auxBuffer());
@@ -2234,6 +2491,9 @@ uint32_t AudioFlinger::MixerThread::prepareTracks_l(const SortedVector< wp<Track
             } else {
                 // No buffers for this track. Give it a few chances to
                 // fill a buffer, then remove it from active list.
+                if (track->mFillingUpStatus == Track::FS_ACTIVE) {
+                    track->mUnderrunCount++;
+                }
                 if (--(track->mRetryCount) <= 0) {
                     ALOGV("BUFFER TIMEOUT: remove(%d) from active list on thread %p", track->name(), this);
                     tracksToRemove->add(track);
@@ -2272,10 +2532,156 @@ uint32_t AudioFlinger::MixerThread::prepareTracks_l(const SortedVector< wp<Track
     if (mixedTracks != 0 && mixedTracks == tracksWithEffect) {
         memset(mMixBuffer, 0, mFrameCount * mChannelCount * sizeof(int16_t));
     }
+    mFloatTracks = floatTracks;
+
+    if (mFastMixer != 0) {
+        if (mFastStateChanged) {
+            mFastMixer->pushState();
+            mFastStateChanged = false;
+        }
+        // keep the output running with silence from the normal mixer while
+        // only fast tracks are playing
+        if (fastTracks != 0 && mixedTracks == 0) {
+            memset(mMixBuffer, 0, mFrameCount * mChannelCount * sizeof(int16_t));
+            mixerStatus = MIXER_TRACKS_READY;
+        }
+    }
 
     return mixerStatus;
 }
 
+// prepareFastTrack_l() must be called with ThreadBase::mLock held.
+// Updates the slot of a fast track in the fast mixer state and returns true
+// if the track is mixed by the fast mixer.
+bool AudioFlinger::MixerThread::prepareFastTrack_l(const sp<Track>& t, float masterVolume,
+        Vector< sp<Track> > *tracksToRemove)
+{
+    Track* const track = t.get();
+    audio_track_cblk_t* cblk = track->cblk();
+    FastMixer::State* state = mFastMixer->editState();
+
+    if (track->mFastGeneration != 0) {
+        // the track was removed from its slot but the fast mixer can still be
+        // reading it until it applies the state that removed it
+        if (mFastMixer->observedGeneration() - track->mFastGeneration < 0) {
+            return false;
+        }
+        track->mFastGeneration = 0;
+        if (track->isPausing()) {
+            track->setPaused();
+        }
+    }
+
+    int index = track->mFastIndex;
+    uint32_t framesReady = cblk->framesReadyFast();
+    track->mFramesReady = framesReady;
+    if (index >= 0) {
+        // the fast mixer counts the underruns of the slot, they are the
+        // track's once it has observed the track in the slot
+        uint32_t underruns = mFastMixer->trackUnderruns(index);
+        if (mFastMixer->observedGeneration() - track->mFastAddGeneration >= 0 &&
+                !track->isStopped() && !track->isPausing() &&
+                track->mFillingUpStatus == Track::FS_ACTIVE) {
+            track->mUnderrunCount += underruns - track->mFastUnderruns;
+        }
+        track->mFastUnderruns = underruns;
+    }
+    bool mix = false;
+    if (track->isTerminated() || track->isPaused()) {
+        mix = false;
+    } else if (track->isStopped()) {
+        // play what was written before stop()
+        mix = index >= 0 && framesReady != 0;
+    } else if (track->isPausing()) {
+        // stay in the slot until the fast mixer has ramped the volume down
+        if (index >= 0) {
+            const FastMixer::FastTrack& fast = state->mFastTracks[index];
+            mix = fast.mVolume[0] != 0 || fast.mVolume[1] != 0 ||
+                    mFastMixer->observedGeneration() - state->mGeneration < 0;
+        } else {
+            track->setPaused();
+        }
+    } else if (framesReady != 0 && track->isReady()) {
+        mix = true;
+        track->mRetryCount = kMaxTrackRetries;
+    } else if (--(track->mRetryCount) <= 0) {
+        ALOGV("BUFFER TIMEOUT: remove(%d) from active list on thread %p", track->name(), this);
+        // indicate to client process that the track was disabled because of underrun
+        android_atomic_or(CBLK_DISABLED_ON, &cblk->flags);
+    } else {
+        // underrun: the fast mixer keeps the slot and mixes what is written
+        mix = index >= 0;
+    }
+
+    if (mix) {
+        if (index < 0) {
+            for (index = 0; index < FastMixer::kMaxFastTracks; index++) {
+                if (state->mFastTracks[index].mBufferProvider == NULL) {
+                    break;
+                }
+            }
+            if (index == FastMixer::kMaxFastTracks) {
+                // fastTrackMinFrameCount_l() limits the number of fast tracks
+                ALOGW("no fast mixer slot for track %d on thread %p", track->name(), this);
+                return false;
+            }
+            FastMixer::FastTrack& fast = state->mFastTracks[index];
+            fast.mBufferProvider = track;
+            fast.mChannelCount = track->channelCount();
+            fast.mVolume[0] = fast.mVolume[1] = 0;
+            track->mFastIndex = index;
+            track->mFastAddGeneration = state->mGeneration + 1;
+            track->mFastUnderruns = mFastMixer->trackUnderruns(index);
+            if (track->mFillingUpStatus == Track::FS_FILLED) {
+                track->mFillingUpStatus = Track::FS_ACTIVE;
+                if (track->mState == TrackBase::RESUMING) {
+                    track->mState = TrackBase::ACTIVE;
+                }
+            }
+            mFastStateChanged = true;
+        }
+
+        // volumes are already 4.12 in the control block
+        int16_t left = 0, right = 0;
+        if (!track->isMuted() && !track->isPausing() && !mStreamTypes[track->type()].mute) {
+            float v = masterVolume * mStreamTypes[track->type()].volume;
+            uint32_t vl = (uint32_t)(v * cblk->volume[0]);
+            uint32_t vr = (uint32_t)(v * cblk->volume[1]);
+            left = int16_t(vl > MAX_GAIN_INT ? MAX_GAIN_INT : vl);
+            right = int16_t(vr > MAX_GAIN_INT ? MAX_GAIN_INT : vr);
+        }
+        track->mMixCount++;
+        track->mFramesReadySum += framesReady;
+
+        FastMixer::FastTrack& fast = state->mFastTracks[index];
+        if (fast.mVolume[0] != left || fast.mVolume[1] != right) {
+            fast.mVolume[0] = left;
+            fast.mVolume[1] = right;
+            mFastStateChanged = true;
+        }
+        return true;
+    }
+
+    if (index >= 0) {
+        // the track is removed from the active list once the fast mixer
+        // has stopped using it
+        state->mFastTracks[index].mBufferProvider = NULL;
+        track->mFastIndex = -1;
+        track->mFastGeneration = state->mGeneration + 1;
+        mFastStateChanged = true;
+        return false;
+    }
+
+    if (track->isStopped()) {
+        track->reset();
+    }
+    if (track->isTerminated() || track->isStopped() || track->isPaused() ||
+            track->mRetryCount <= 0) {
+        tracksToRemove->add(track);
+    }
+    return false;
+}
+
 void AudioFlinger::MixerThread::invalidateTracks(int streamType)
 {
     ALOGV ("MixerThread::invalidateTracks() mixer %p, streamType %d, mTracks.size %d",
@@ -2287,7 +2693,7 @@ void AudioFlinger::MixerThread::invalidateTracks(int streamType)
         sp<Track> t = mTracks[i];
         if (t->type() == streamType) {
             android_atomic_or(CBLK_INVALID_ON, &t->mCblk->flags);
-            t->mCblk->cv.signal();
+            t->mCblk->wake();
         }
     }
 }
@@ -2383,6 +2789,11 @@ bool AudioFlinger::MixerThread::checkForNewParameters_l()
         }
 
         if (status == NO_ERROR) {
+            // the fast mixer must not write to the output stream while it is
+            // reconfigured; the next normal mix resumes it
+            if (mFastMixer != 0) {
+                setFastMixerCommand(FastMixer::State::IDLE, true);
+            }
             status = mOutput->stream->common.set_parameters(&mOutput->stream->common,
                                                     keyValuePair.string());
             if (!mStandby && status == INVALID_OPERATION) {
@@ -2393,9 +2804,15 @@ bool AudioFlinger::MixerThread::checkForNewParameters_l()
                                                        keyValuePair.string());
             }
             if (status == NO_ERROR && reconfig) {
+                bool fastMixer = mFastMixer != 0;
+                destroyFastMixer();
                 delete mAudioMixer;
                 readOutputParameters();
+                if (fastMixer) {
+                    createFastMixer();
+                }
                 mAudioMixer = new AudioMixer(mFrameCount, mSampleRate);
+                allocateFloatMixBuffer();
                 for (size_t i = 0; i < mTracks.size() ; i++) {
                     int name = getTrackName_l();
                     if (name < 0) break;
@@ -2430,7 +2847,12 @@ status_t AudioFlinger::MixerThread::dumpInternals(int fd, const Vector<String16>
 
     snprintf(buffer, SIZE, "AudioMixer tracks: %08x\n", mAudioMixer->trackNames());
     result.append(buffer);
+    snprintf(buffer, SIZE, "Float mix: %s (%u tracks)\n", mFloatMix ? "on" : "off", mFloatTracks);
+    result.append(buffer);
     write(fd, result.string(), result.size());
+    if (mFastMixer != 0) {
+        mFastMixer->dump(fd);
+    }
     return NO_ERROR;
 }
 
@@ -2566,8 +2988,10 @@ bool AudioFlinger::DirectOutputThread::threadLoop()
     // use shorter standby delay as on normal output to release
     // hardware resources as soon as possible
     nsecs_t standbyDelay = microseconds(activeSleepTime*2);
+    nsecs_t cycleStart = 0;
 
     acquireWakeLock();
+    resetStatistics();
 
     while (!exitPending())
     {
@@ -2589,6 +3013,7 @@ bool AudioFlinger::DirectOutputThread::threadLoop()
                 activeSleepTime = activeSleepTimeUs();
                 idleSleepTime = idleSleepTimeUs();
                 standbyDelay = microseconds(activeSleepTime*2);
+                resetStatistics();
             }
 
             // put audio hardware into standby after short delay
@@ -2629,6 +3054,9 @@ bool AudioFlinger::DirectOutputThread::threadLoop()
                 }
             }
 
+            if (mStatistics != NULL) {
+                cycleStart = systemTime();
+            }
             effectChains = mEffectChains;
 
             // find out which tracks need to be processed
@@ -2804,16 +3232,22 @@ bool AudioFlinger::DirectOutputThread::threadLoop()
             unlockEffectChains(effectChains);
 
             mLastWriteTime = systemTime();
+            if (mStatistics != NULL) {
+                mStatistics->addMix(mLastWriteTime - cycleStart);
+            }
             mInWrite = true;
             mBytesWritten += mixBufferSize;
             int bytesWritten = (int)mOutput->stream->write(mOutput->stream, mMixBuffer, mixBufferSize);
             if (bytesWritten < 0) mBytesWritten -= mixBufferSize;
             mNumWrites++;
             mInWrite = false;
+            if (mStatistics != NULL) {
+                mStatistics->addWrite(mLastWriteTime, systemTime());
+            }
             mStandby = false;
         } else {
             unlockEffectChains(effectChains);
-            usleep(sleepTime);
+            sleepUs(sleepTime);
         }
 
         // finally let go of removed track, without the lock held
@@ -2933,9 +3367,10 @@ uint32_t AudioFlinger::DirectOutputThread::suspendSleepTimeUs()
 // ----------------------------------------------------------------------------
 
 AudioFlinger::DuplicatingThread::DuplicatingThread(const sp<AudioFlinger>& audioFlinger, AudioFlinger::MixerThread* mainThread, int id)
-    :   MixerThread(audioFlinger, mainThread->getOutput(), id, mainThread->device()), mWaitTimeMs(UINT_MAX)
+    :   MixerThread(audioFlinger, mainThread->getOutput(), id, mainThread->device(), DUPLICATING),
+        mFanOut(new FanOutBuffer(mFrameSize, mFrameCount)),
+        mWaitTimeMs(UINT_MAX)
 {
-    mType = ThreadBase::DUPLICATING;
     addOutputTrack(mainThread);
 }
 
@@ -2958,9 +3393,11 @@ bool AudioFlinger::DuplicatingThread::threadLoop()
     uint32_t activeSleepTime = activeSleepTimeUs();
     uint32_t idleSleepTime = idleSleepTimeUs();
     uint32_t sleepTime = idleSleepTime;
+    nsecs_t cycleStart = 0;
     Vector< sp<EffectChain> > effectChains;
 
     acquireWakeLock();
+    resetStatistics();
 
     while (!exitPending())
     {
@@ -2976,6 +3413,7 @@ bool AudioFlinger::DuplicatingThread::threadLoop()
                 updateWaitTime();
                 activeSleepTime = activeSleepTimeUs();
                 idleSleepTime = idleSleepTimeUs();
+                resetStatistics();
             }
 
             const SortedVector< wp<Track> >& activeTracks = mActiveTracks;
@@ -3023,6 +3461,9 @@ bool AudioFlinger::DuplicatingThread::threadLoop()
                 }
             }
 
+            if (mStatistics != NULL) {
+                cycleStart = systemTime();
+            }
             mixerStatus = prepareTracks_l(activeTracks, &tracksToRemove);
 
             // prevent any changes in effect chain list and in each effect chain
@@ -3035,6 +3476,9 @@ bool AudioFlinger::DuplicatingThread::threadLoop()
             // mix buffers...
             if (outputsReady(outputTracks)) {
                 mAudioMixer->process();
+                if (mFloatTracks != 0) {
+                    AudioMixer::convertFloatTo16(mMixBuffer, mMixBufferFloat, mFrameCount * 2);
+                }
             } else {
                 memset(mMixBuffer, 0, mixBufferSize);
             }
@@ -3048,7 +3492,7 @@ bool AudioFlinger::DuplicatingThread::threadLoop()
                     sleepTime = idleSleepTime;
                 }
             } else if (mBytesWritten != 0) {
-                // flush remaining overflow buffers in output tracks
+                // stop the output tracks, which play the frames already written
                 for (size_t i = 0; i < outputTracks.size(); i++) {
                     if (outputTracks[i]->isActive()) {
                         sleepTime = 0;
@@ -3071,16 +3515,31 @@ bool AudioFlinger::DuplicatingThread::threadLoop()
             // enable changes in effect chain
             unlockEffectChains(effectChains);
 
-            standbyTime = systemTime() + kStandbyTimeInNsecs;
+            nsecs_t writeStart = systemTime();
+            if (mStatistics != NULL) {
+                mStatistics->addMix(writeStart - cycleStart);
+            }
+            standbyTime = writeStart + kStandbyTimeInNsecs;
             for (size_t i = 0; i < outputTracks.size(); i++) {
-                outputTracks[i]->write(mMixBuffer, writeFrames);
+                outputTracks[i]->write(writeFrames);
+            }
+            if (writeFrames != 0) {
+                // only the main output can hold up the mix, other outputs drop frames
+                if (mFanOut->waitForReaders(writeFrames, mWaitTimeMs) == WOULD_BLOCK) {
+                    // no output to pace the thread
+                    usleep((writeFrames * 1000000LL) / mSampleRate);
+                }
+                mFanOut->write(mMixBuffer, writeFrames);
+            }
+            if (mStatistics != NULL) {
+                mStatistics->addWrite(writeStart, systemTime());
             }
             mStandby = false;
             mBytesWritten += mixBufferSize;
         } else {
             // enable changes in effect chain
             unlockEffectChains(effectChains);
-            usleep(sleepTime);
+            sleepUs(sleepTime);
         }
 
         // finally let go of all our tracks, without the lock held
@@ -3102,8 +3561,15 @@ bool AudioFlinger::DuplicatingThread::threadLoop()
 void AudioFlinger::DuplicatingThread::addOutputTrack(MixerThread *thread)
 {
     int frameCount = (3 * mFrameCount * mSampleRate) / thread->sampleRate();
+    if (frameCount > (int)mFanOut->maxLatency()) {
+        frameCount = mFanOut->maxLatency();
+    }
+    // the first output, the one passed to the constructor, paces the thread
+    FanOutBuffer::policy_t policy = mOutputTracks.size() == 0 ?
+            FanOutBuffer::POLICY_WAIT : FanOutBuffer::POLICY_DROP;
     OutputTrack *outputTrack = new OutputTrack((ThreadBase *)thread,
-                                            this,
+                                            mFanOut,
+                                            policy,
                                             mSampleRate,
                                             mFormat,
                                             mChannelMask,
@@ -3167,6 +3633,17 @@ uint32_t AudioFlinger::DuplicatingThread::activeSleepTimeUs()
     return (mWaitTimeMs * 1000) / 2;
 }
 
+status_t AudioFlinger::DuplicatingThread::dumpInternals(int fd, const Vector<String16>& args)
+{
+    String8 result;
+
+    MixerThread::dumpInternals(fd, args);
+
+    mFanOut->dump(result);
+    write(fd, result.string(), result.size());
+    return NO_ERROR;
+}
+
 // ----------------------------------------------------------------------------
 
 // TrackBase constructor must be called with AudioFlinger::mLock held
@@ -3229,20 +3706,20 @@ AudioFlinger::ThreadBase::TrackBase::TrackBase(
             return;
         }
    } else {
-       mCblk = (audio_track_cblk_t *)(new uint8_t[size]);
+       // only an OutputTrack has no client: it reads the mix in place from
+       // its FanOutBuffer, the control block only holds the indices
+       mCblk = (audio_track_cblk_t *)(new uint8_t[sizeof(audio_track_cblk_t)]);
        if (mCblk) { // construct the shared structure in-place.
            new(mCblk) audio_track_cblk_t();
-           // clear all buffers
            mCblk->frameCount = frameCount;
            mCblk->sampleRate = sampleRate;
            mChannelCount = channelCount;
            mChannelMask = channelMask;
-           mBuffer = (char*)mCblk + sizeof(audio_track_cblk_t);
-           memset(mBuffer, 0, frameCount*channelCount*sizeof(int16_t));
+           mBuffer = NULL;
            // Force underrun condition to avoid false underrun callback until first data is
            // written to buffer (other flags are cleared)
            mCblk->flags = CBLK_UNDERRUN_ON;
-           mBufferEnd = (uint8_t *)mBuffer + bufferSize;
+           mBufferEnd = NULL;
        }
    }
 }
@@ -3340,10 +3817,13 @@ AudioFlinger::PlaybackThread::Track::Track(
             uint32_t channelMask,
             int frameCount,
             const sp<IMemory>& sharedBuffer,
-            int sessionId)
-    :   TrackBase(thread, client, sampleRate, format, channelMask, frameCount, 0, sharedBuffer, sessionId),
+            int sessionId,
+            uint32_t flags)
+    :   TrackBase(thread, client, sampleRate, format, channelMask, frameCount, flags, sharedBuffer, sessionId),
     mMute(false), mSharedBuffer(sharedBuffer), mName(-1), mMainBuffer(NULL), mAuxBuffer(NULL),
-    mAuxEffectId(0), mHasVolumeController(false)
+    mAuxEffectId(0), mHasVolumeController(false), mFastIndex(-1), mFastGeneration(0),
+    mFastAddGeneration(0), mFastUnderruns(0),
+    mUnderrunCount(0), mFramesReady(0), mMixCount(0), mFramesReadySum(0)
 {
     if (mCblk != NULL) {
         sp<ThreadBase> baseThread = thread.promote();
@@ -3409,7 +3889,7 @@ void AudioFlinger::PlaybackThread::Track::destroy()
 
 void AudioFlinger::PlaybackThread::Track::dump(char* buffer, size_t size)
 {
-    snprintf(buffer, size, "   %05d %05d %03u %03u 0x%08x %05u   %04u %1d %1d %1d %05u %05u %05u  0x%08x 0x%08x 0x%08x 0x%08x\n",
+    snprintf(buffer, size, "   %05d %05d %03u %03u 0x%08x %05u   %04u %1d %1d %1d %05u %05u %05u  0x%08x 0x%08x 0x%08x 0x%08x %05u %05u %05u\n",
             mName - AudioMixer::TRACK0,
             (mClient == NULL) ? getpid() : mClient->pid(),
             mStreamType,
@@ -3426,7 +3906,10 @@ void AudioFlinger::PlaybackThread::Track::dump(char* buffer, size_t size)
             mCblk->server,
             mCblk->user,
             (int)mMainBuffer,
-            (int)mAuxBuffer);
+            (int)mAuxBuffer,
+            mUnderrunCount,
+            mFramesReady,
+            mMixCount ? (uint32_t)(mFramesReadySum / mMixCount) : 0);
 }
 
 status_t AudioFlinger::PlaybackThread::Track::getNextBuffer(AudioBufferProvider::Buffer* buffer)
@@ -3442,13 +3925,17 @@ status_t AudioFlinger::PlaybackThread::Track::getNextBuffer(AudioBufferProvider:
          mFlags &= ~TrackBase::STEPSERVER_FAILED;
      }
 
-     framesReady = cblk->framesReady();
+     // fast tracks are read by the fast mixer, which must not wait for the
+     // cblk lock: they have no loops
+     framesReady = isFastTrack() ? cblk->framesReadyFast() : cblk->framesReady();
 
      if (LIKELY(framesReady)) {
         uint32_t s = cblk->server;
         uint32_t bufferEnd = cblk->serverBase + cblk->frameCount;
 
-        bufferEnd = (cblk->loopEnd < bufferEnd) ? cblk->loopEnd : bufferEnd;
+        if (!isFastTrack()) {
+            bufferEnd = (cblk->loopEnd < bufferEnd) ? cblk->loopEnd : bufferEnd;
+        }
         if (framesReq > framesReady) {
             framesReq = framesReady;
         }
@@ -3470,10 +3957,26 @@ getNextBuffer_exit:
      return NOT_ENOUGH_DATA;
 }
 
+void AudioFlinger::PlaybackThread::Track::releaseBuffer(AudioBufferProvider::Buffer* buffer)
+{
+    if (!isFastTrack()) {
+        TrackBase::releaseBuffer(buffer);
+        return;
+    }
+    buffer->raw = 0;
+    mFrameCount = buffer->frameCount;
+    mCblk->stepServerFast(mFrameCount);
+    buffer->frameCount = 0;
+}
+
+uint32_t AudioFlinger::PlaybackThread::Track::framesReady() const {
+    return mCblk->framesReady();
+}
+
 bool AudioFlinger::PlaybackThread::Track::isReady() const {
     if (mFillingUpStatus != FS_FILLING || isStopped() || isPausing()) return true;
 
-    if (mCblk->framesReady() >= mCblk->frameCount ||
+    if (framesReady() >= mCblk->frameCount ||
             (mCblk->flags & CBLK_FORCEREADY_MSK)) {
         mFillingUpStatus = FS_FILLED;
         android_atomic_and(~CBLK_FORCEREADY_MSK, &mCblk->flags);
@@ -3760,34 +4263,43 @@ void AudioFlinger::RecordThread::RecordTrack::dump(char* buffer, size_t size)
 
 AudioFlinger::PlaybackThread::OutputTrack::OutputTrack(
             const wp<ThreadBase>& thread,
-            DuplicatingThread *sourceThread,
+            const sp<FanOutBuffer>& fanOut,
+            FanOutBuffer::policy_t policy,
             uint32_t sampleRate,
             uint32_t format,
             uint32_t channelMask,
             int frameCount)
-    :   Track(thread, NULL, AUDIO_STREAM_CNT, sampleRate, format, channelMask, frameCount, NULL, 0),
-    mActive(false), mSourceThread(sourceThread)
+    :   Track(thread, NULL, AUDIO_STREAM_CNT, sampleRate, format, channelMask, frameCount, NULL, 0, 0),
+    mFanOut(fanOut), mReader(-1), mActive(false)
 {
 
     PlaybackThread *playbackThread = (PlaybackThread *)thread.unsafe_get();
     if (mCblk != NULL) {
+        mReader = mFanOut->addReader(policy, frameCount);
+    }
+    if (mReader >= 0) {
         mCblk->flags |= CBLK_DIRECTION_OUT;
-        mCblk->buffers = (char*)mCblk + sizeof(audio_track_cblk_t);
         mCblk->volume[0] = mCblk->volume[1] = 0x1000;
-        mOutBuffer.frameCount = 0;
         playbackThread->mTracks.add(this);
-        ALOGV("OutputTrack constructor mCblk %p, mBuffer %p, mCblk->buffers %p, " \
-                "mCblk->frameCount %d, mCblk->sampleRate %d, mChannelMask 0x%08x mBufferEnd %p",
-                mCblk, mBuffer, mCblk->buffers,
-                mCblk->frameCount, mCblk->sampleRate, mChannelMask, mBufferEnd);
+        ALOGV("OutputTrack constructor mCblk %p, reader %d, mCblk->frameCount %d, " \
+                "mCblk->sampleRate %d, mChannelMask 0x%08x",
+                mCblk, mReader, mCblk->frameCount, mCblk->sampleRate, mChannelMask);
     } else {
         ALOGW("Error creating output track on thread %p", playbackThread);
+        // not added by addOutputTrack()
+        if (mCblk != NULL) {
+            mCblk->~audio_track_cblk_t();
+            delete mCblk;
+            mCblk = NULL;
+        }
     }
 }
 
 AudioFlinger::PlaybackThread::OutputTrack::~OutputTrack()
 {
-    clearBufferQueue();
+    if (mReader >= 0) {
+        mFanOut->removeReader(mReader);
+    }
 }
 
 status_t AudioFlinger::PlaybackThread::OutputTrack::start()
@@ -3805,193 +4317,42 @@ status_t AudioFlinger::PlaybackThread::OutputTrack::start()
 void AudioFlinger::PlaybackThread::OutputTrack::stop()
 {
     Track::stop();
-    clearBufferQueue();
-    mOutBuffer.frameCount = 0;
+    mFanOut->stopReader(mReader);
     mActive = false;
 }
 
-bool AudioFlinger::PlaybackThread::OutputTrack::write(int16_t* data, uint32_t frames)
+void AudioFlinger::PlaybackThread::OutputTrack::write(uint32_t frames)
 {
-    Buffer *pInBuffer;
-    Buffer inBuffer;
-    uint32_t channelCount = mChannelCount;
-    bool outputBufferFull = false;
-    inBuffer.frameCount = frames;
-    inBuffer.i16 = data;
-
-    uint32_t waitTimeLeftMs = mSourceThread->waitTimeMs();
-
-    if (!mActive && frames != 0) {
-        start();
-        sp<ThreadBase> thread = mThread.promote();
-        if (thread != 0) {
-            MixerThread *mixerThread = (MixerThread *)thread.get();
-            if (mCblk->frameCount > frames){
-                if (mBufferQueue.size() < kMaxOverFlowBuffers) {
-                    uint32_t startFrames = (mCblk->frameCount - frames);
-                    pInBuffer = new Buffer;
-                    pInBuffer->mBuffer = new int16_t[startFrames * channelCount];
-                    pInBuffer->frameCount = startFrames;
-                    pInBuffer->i16 = pInBuffer->mBuffer;
-                    memset(pInBuffer->raw, 0, startFrames * channelCount * sizeof(int16_t));
-                    mBufferQueue.add(pInBuffer);
-                } else {
-                    ALOGW ("OutputTrack::write() %p no more buffers in queue", this);
-                }
-            }
-        }
-    }
-
-    while (waitTimeLeftMs) {
-        // First write pending buffers, then new data
-        if (mBufferQueue.size()) {
-            pInBuffer = mBufferQueue.itemAt(0);
-        } else {
-            pInBuffer = &inBuffer;
-        }
-
-        if (pInBuffer->frameCount == 0) {
-            break;
-        }
-
-        if (mOutBuffer.frameCount == 0) {
-            mOutBuffer.frameCount = pInBuffer->frameCount;
-            nsecs_t startTime = systemTime();
-            if (obtainBuffer(&mOutBuffer, waitTimeLeftMs) == (status_t)AudioTrack::NO_MORE_BUFFERS) {
-                ALOGV ("OutputTrack::write() %p thread %p no more output buffers", this, mThread.unsafe_get());
-                outputBufferFull = true;
-                break;
-            }
-            uint32_t waitTimeMs = (uint32_t)ns2ms(systemTime() - startTime);
-            if (waitTimeLeftMs >= waitTimeMs) {
-                waitTimeLeftMs -= waitTimeMs;
-            } else {
-                waitTimeLeftMs = 0;
-            }
-        }
-
-        uint32_t outFrames = pInBuffer->frameCount > mOutBuffer.frameCount ? mOutBuffer.frameCount : pInBuffer->frameCount;
-        memcpy(mOutBuffer.raw, pInBuffer->raw, outFrames * channelCount * sizeof(int16_t));
-        mCblk->stepUser(outFrames);
-        pInBuffer->frameCount -= outFrames;
-        pInBuffer->i16 += outFrames * channelCount;
-        mOutBuffer.frameCount -= outFrames;
-        mOutBuffer.i16 += outFrames * channelCount;
-
-        if (pInBuffer->frameCount == 0) {
-            if (mBufferQueue.size()) {
-                mBufferQueue.removeAt(0);
-                delete [] pInBuffer->mBuffer;
-                delete pInBuffer;
-                ALOGV("OutputTrack::write() %p thread %p released overflow buffer %d", this, mThread.unsafe_get(), mBufferQueue.size());
-            } else {
-                break;
-            }
-        }
-    }
-
-    // If we could not write all frames, allocate a buffer and queue it for next time.
-    if (inBuffer.frameCount) {
-        sp<ThreadBase> thread = mThread.promote();
-        if (thread != 0 && !thread->standby()) {
-            if (mBufferQueue.size() < kMaxOverFlowBuffers) {
-                pInBuffer = new Buffer;
-                pInBuffer->mBuffer = new int16_t[inBuffer.frameCount * channelCount];
-                pInBuffer->frameCount = inBuffer.frameCount;
-                pInBuffer->i16 = pInBuffer->mBuffer;
-                memcpy(pInBuffer->raw, inBuffer.raw, inBuffer.frameCount * channelCount * sizeof(int16_t));
-                mBufferQueue.add(pInBuffer);
-                ALOGV("OutputTrack::write() %p thread %p adding overflow buffer %d", this, mThread.unsafe_get(), mBufferQueue.size());
-            } else {
-                ALOGW("OutputTrack::write() %p thread %p no more overflow buffers", mThread.unsafe_get(), this);
-            }
-        }
-    }
-
-    // Calling write() with a 0 length buffer, means that no more data will be written:
-    // If no more buffers are pending, fill output track buffer to make sure it is started
-    // by output mixer.
-    if (frames == 0 && mBufferQueue.size() == 0) {
-        if (mCblk->user < mCblk->frameCount) {
-            frames = mCblk->frameCount - mCblk->user;
-            pInBuffer = new Buffer;
-            pInBuffer->mBuffer = new int16_t[frames * channelCount];
-            pInBuffer->frameCount = frames;
-            pInBuffer->i16 = pInBuffer->mBuffer;
-            memset(pInBuffer->raw, 0, frames * channelCount * sizeof(int16_t));
-            mBufferQueue.add(pInBuffer);
-        } else if (mActive) {
+    if (frames == 0) {
+        // the frames already written are played after stop()
+        if (mActive) {
             stop();
         }
+        return;
+    }
+    if (!mActive) {
+        // start with silence, so that the output thread finds the track ready
+        // when the first frames are written
+        uint32_t silenceFrames = mCblk->frameCount > frames ? mCblk->frameCount - frames : 0;
+        mFanOut->startReader(mReader, silenceFrames);
+        start();
     }
-
-    return outputBufferFull;
 }
 
-status_t AudioFlinger::PlaybackThread::OutputTrack::obtainBuffer(AudioBufferProvider::Buffer* buffer, uint32_t waitTimeMs)
+status_t AudioFlinger::PlaybackThread::OutputTrack::getNextBuffer(
+        AudioBufferProvider::Buffer* buffer)
 {
-    int active;
-    status_t result;
-    audio_track_cblk_t* cblk = mCblk;
-    uint32_t framesReq = buffer->frameCount;
-
-//    ALOGV("OutputTrack::obtainBuffer user %d, server %d", cblk->user, cblk->server);
-    buffer->frameCount  = 0;
-
-    uint32_t framesAvail = cblk->framesAvailable();
-
-
-    if (framesAvail == 0) {
-        Mutex::Autolock _l(cblk->lock);
-        goto start_loop_here;
-        while (framesAvail == 0) {
-            active = mActive;
-            if (UNLIKELY(!active)) {
-                ALOGV("Not active and NO_MORE_BUFFERS");
-                return AudioTrack::NO_MORE_BUFFERS;
-            }
-            result = cblk->cv.waitRelative(cblk->lock, milliseconds(waitTimeMs));
-            if (result != NO_ERROR) {
-                return AudioTrack::NO_MORE_BUFFERS;
-            }
-            // read the server count again
-        start_loop_here:
-            framesAvail = cblk->framesAvailable_l();
-        }
-    }
-
-//    if (framesAvail < framesReq) {
-//        return AudioTrack::NO_MORE_BUFFERS;
-//    }
-
-    if (framesReq > framesAvail) {
-        framesReq = framesAvail;
-    }
-
-    uint32_t u = cblk->user;
-    uint32_t bufferEnd = cblk->userBase + cblk->frameCount;
-
-    if (u + framesReq > bufferEnd) {
-        framesReq = bufferEnd - u;
-    }
-
-    buffer->frameCount  = framesReq;
-    buffer->raw         = (void *)cblk->buffer(u);
-    return NO_ERROR;
+    return mFanOut->getNextBuffer(mReader, buffer);
 }
 
-
-void AudioFlinger::PlaybackThread::OutputTrack::clearBufferQueue()
+void AudioFlinger::PlaybackThread::OutputTrack::releaseBuffer(AudioBufferProvider::Buffer* buffer)
 {
-    size_t size = mBufferQueue.size();
-    Buffer *pBuffer;
+    mFanOut->releaseBuffer(mReader, buffer);
+}
 
-    for (size_t i = 0; i < size; i++) {
-        pBuffer = mBufferQueue.itemAt(i);
-        delete [] pBuffer->mBuffer;
-        delete pBuffer;
-    }
-    mBufferQueue.clear();
+uint32_t AudioFlinger::PlaybackThread::OutputTrack::framesReady() const
+{
+    return mFanOut->framesReady(mReader);
 }
 
 // ----------------------------------------------------------------------------
@@ -5920,6 +6281,11 @@ status_t AudioFlinger::PlaybackThread::addEffectChain_l(const sp<EffectChain>& c
                 ALOGV("addEffectChain_l() track->setMainBuffer track %p buffer %p", track.get(), buffer);
                 track->setMainBuffer(buffer);
                 chain->incTrackCnt();
+                if (track->isFastTrack()) {
+                    // fast tracks bypass the effects: have the client re-create
+                    // the track, which will not be a fast track this time
+                    android_atomic_or(CBLK_INVALID_ON, &track->mCblk->flags);
+                }
             }
         }
 
@@ -42,6 +42,8 @@
 #include <hardware/audio.h>
 
 #include "AudioBufferProvider.h"
+#include "FanOutBuffer.h"
+#include "PlaybackStatistics.h"
 
 #include <powermanager/IPowerManager.h>
 
@@ -51,6 +53,7 @@ class audio_track_cblk_t;
 class effect_param_cblk_t;
 class AudioMixer;
 class AudioBuffer;
+class FastMixer;
 class AudioResampler;
 
 // ----------------------------------------------------------------------------
@@ -585,7 +588,8 @@ private:
                                         uint32_t channelMask,
                                         int frameCount,
                                         const sp<IMemory>& sharedBuffer,
-                                        int sessionId);
+                                        int sessionId,
+                                        uint32_t flags);
                                 ~Track();
 
                     void        dump(char* buffer, size_t size);
@@ -610,6 +614,9 @@ private:
                     void        setMainBuffer(int16_t *buffer) { mMainBuffer = buffer; }
                     int16_t     *mainBuffer() { return mMainBuffer; }
                     int         auxEffectId() { return mAuxEffectId; }
+                    bool        isFastTrack() const {
+                        return (mFlags & IAudioFlinger::TRACK_FAST) != 0;
+                    }
 
 
         protected:
@@ -623,6 +630,8 @@ private:
                                 Track& operator = (const Track&);
 
             virtual status_t getNextBuffer(AudioBufferProvider::Buffer* buffer);
+            virtual void releaseBuffer(AudioBufferProvider::Buffer* buffer);
+            virtual uint32_t framesReady() const;
             bool isMuted() { return mMute; }
             bool isPausing() const {
                 return mState == PAUSING;
@@ -653,20 +662,31 @@ private:
             int32_t             *mAuxBuffer;
             int                 mAuxEffectId;
             bool                mHasVolumeController;
+            // fast tracks only: slot in the fast mixer state or -1, and
+            // generation of the state that removed the track from its slot
+            // until the fast mixer has observed it, or 0
+            int                 mFastIndex;
+            int32_t             mFastGeneration;
+            // fast tracks only: generation of the state that added the track
+            // to its slot, and underruns of the slot when last checked
+            int32_t             mFastAddGeneration;
+            uint32_t            mFastUnderruns;
+            // updated by the mixer: cycles where the track was active but not ready
+            // after it started playing, and frames ready when it was last considered
+            uint32_t            mUnderrunCount;
+            uint32_t            mFramesReady;
+            uint32_t            mMixCount;
+            uint64_t            mFramesReadySum;
         };  // end of Track
 
 
-        // playback track
+        // playback track reading the mix of a DuplicatingThread from its
+        // FanOutBuffer, in place
         class OutputTrack : public Track {
         public:
-
-            class Buffer: public AudioBufferProvider::Buffer {
-            public:
-                int16_t *mBuffer;
-            };
-
                                 OutputTrack(  const wp<ThreadBase>& thread,
-                                        DuplicatingThread *sourceThread,
+                                        const sp<FanOutBuffer>& fanOut,
+                                        FanOutBuffer::policy_t policy,
                                         uint32_t sampleRate,
                                         uint32_t format,
                                         uint32_t channelMask,
@@ -675,23 +695,21 @@ private:
 
             virtual status_t    start();
             virtual void        stop();
-                    bool        write(int16_t* data, uint32_t frames);
-                    bool        bufferQueueEmpty() { return (mBufferQueue.size() == 0) ? true : false; }
+                    // Called by the DuplicatingThread before writing frames
+                    // to the FanOutBuffer, or with 0 when it stops writing.
+                    void        write(uint32_t frames);
                     bool        isActive() { return mActive; }
             wp<ThreadBase>&     thread()  { return mThread; }
 
-        private:
-
-            status_t            obtainBuffer(AudioBufferProvider::Buffer* buffer, uint32_t waitTimeMs);
-            void                clearBufferQueue();
-
-            // Maximum number of pending buffers allocated by OutputTrack::write()
-            static const uint8_t kMaxOverFlowBuffers = 10;
+        protected:
+            virtual status_t    getNextBuffer(AudioBufferProvider::Buffer* buffer);
+            virtual void        releaseBuffer(AudioBufferProvider::Buffer* buffer);
+            virtual uint32_t    framesReady() const;
 
-            Vector < Buffer* >          mBufferQueue;
-            AudioBufferProvider::Buffer mOutBuffer;
+        private:
+            sp<FanOutBuffer>            mFanOut;
+            int                         mReader;    // index in mFanOut, or -1
             bool                        mActive;
-            DuplicatingThread*          mSourceThread;
         };  // end of OutputTrack
 
         PlaybackThread (const sp<AudioFlinger>& audioFlinger, AudioStreamOut* output, int id, uint32_t device);
@@ -728,6 +746,7 @@ private:
                                     int frameCount,
                                     const sp<IMemory>& sharedBuffer,
                                     int sessionId,
+                                    uint32_t flags,
                                     status_t *status);
 
                     AudioStreamOut* getOutput();
@@ -779,6 +798,11 @@ private:
         virtual uint32_t        activeSleepTimeUs();
         virtual uint32_t        idleSleepTimeUs() = 0;
         virtual uint32_t        suspendSleepTimeUs() = 0;
+        // minimum buffer size of a track with these parameters mixed by a fast
+        // mixer, or 0 if the track cannot be a fast track
+        virtual int             fastTrackMinFrameCount_l(uint32_t sampleRate, uint32_t format,
+                                        uint32_t channelMask, const sp<IMemory>& sharedBuffer,
+                                        int sessionId) { return 0; }
 
     private:
 
@@ -798,6 +822,10 @@ private:
         void        removeTrack_l(const sp<Track>& track);
 
         void        readOutputParameters();
+        // clears the cycle statistics after the period changed
+        void        resetStatistics();
+        // usleep() accounted in the cycle statistics
+        void        sleepUs(uint32_t us);
 
         virtual status_t    dumpInternals(int fd, const Vector<String16>& args);
         status_t    dumpTracks(int fd, const Vector<String16>& args);
@@ -811,6 +839,8 @@ private:
         int                             mNumWrites;
         int                             mNumDelayedWrites;
         bool                            mInWrite;
+        // cycle statistics, only allocated if the af.thread_stats property is set
+        PlaybackStatistics*             mStatistics;
     };
 
     class MixerThread : public PlaybackThread {
@@ -818,12 +848,15 @@ private:
         MixerThread (const sp<AudioFlinger>& audioFlinger,
                      AudioStreamOut* output,
                      int id,
-                     uint32_t device);
+                     uint32_t device,
+                     int type = MIXER);
         virtual             ~MixerThread();
 
         // Thread virtuals
         virtual     bool        threadLoop();
 
+        virtual     uint32_t    latency() const;
+
                     void        invalidateTracks(int streamType);
         virtual     bool        checkForNewParameters_l();
         virtual     status_t    dumpInternals(int fd, const Vector<String16>& args);
@@ -835,8 +868,29 @@ private:
         virtual     void        deleteTrackName_l(int name);
         virtual     uint32_t    idleSleepTimeUs();
         virtual     uint32_t    suspendSleepTimeUs();
+                    void        allocateFloatMixBuffer();
+        virtual     int         fastTrackMinFrameCount_l(uint32_t sampleRate, uint32_t format,
+                                        uint32_t channelMask, const sp<IMemory>& sharedBuffer,
+                                        int sessionId);
+                    void        createFastMixer();
+                    void        destroyFastMixer();
+                    void        setFastMixerCommand(int command, bool wait);
+                    bool        prepareFastTrack_l(const sp<Track>& track, float masterVolume,
+                                                   Vector< sp<Track> > *tracksToRemove);
 
         AudioMixer*                     mAudioMixer;
+        // float mix bus, only allocated if af.mixer.float is set. Tracks
+        // mixed into mMixBuffer are accumulated here and converted to 16 bit
+        // once per cycle, before the output mix effects are applied.
+        bool                            mFloatMix;
+        float*                          mMixBufferFloat;
+        size_t                          mFloatTracks;
+        // low latency mixer owning the output stream, only created if
+        // af.fast_mixer is set. The normal mix is written to its FIFO
+        // instead of the output stream, and tracks created with
+        // IAudioFlinger::TRACK_FAST are mixed by it directly.
+        sp<FastMixer>                   mFastMixer;
+        bool                            mFastStateChanged;
     };
 
     class DirectOutputThread : public PlaybackThread {
@@ -876,6 +930,7 @@ private:
                     void        addOutputTrack(MixerThread* thread);
                     void        removeOutputTrack(MixerThread* thread);
                     uint32_t    waitTimeMs() { return mWaitTimeMs; }
+        virtual     status_t    dumpInternals(int fd, const Vector<String16>& args);
     protected:
         virtual     uint32_t    activeSleepTimeUs();
 
@@ -884,6 +939,8 @@ private:
                     void        updateWaitTime();
 
         SortedVector < sp<OutputTrack> >  mOutputTracks;
+                    // the mix is written once and read in place by all the output tracks
+                    sp<FanOutBuffer>    mFanOut;
                     uint32_t    mWaitTimeMs;
     };
 
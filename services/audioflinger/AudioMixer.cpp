@@ -21,16 +21,19 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 #include <utils/Errors.h>
 #include <utils/Log.h>
 
 #include <cutils/bitops.h>
+#include <cutils/properties.h>
 
 #include <system/audio.h>
 
 #include "AudioMixer.h"
+#include "AudioMixerSimd.h"
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -44,14 +47,42 @@ static inline int16_t clamp16(int32_t sample)
 
 // ----------------------------------------------------------------------------
 
+bool AudioMixer::sUseSimd = false;
+static pthread_once_t sSimdOnceControl = PTHREAD_ONCE_INIT;
+
+void AudioMixer::initSimd()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("af.mixer.simd", value, "1");
+    sUseSimd = (atoi(value) != 0) && AudioMixerSimd::available();
+    ALOGV("mixer kernels: %s", sUseSimd ? AUDIO_MIXER_SIMD_NAME : "scalar");
+}
+
+bool AudioMixer::setSimdEnabled(bool enable)
+{
+    pthread_once(&sSimdOnceControl, initSimd);
+    sUseSimd = enable && AudioMixerSimd::available();
+    return sUseSimd;
+}
+
+bool AudioMixer::isSimdEnabled()
+{
+    pthread_once(&sSimdOnceControl, initSimd);
+    return sUseSimd;
+}
+
+// ----------------------------------------------------------------------------
+
 AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate)
     :   mActiveTrack(0), mTrackNames(0), mSampleRate(sampleRate)
 {
+    pthread_once(&sSimdOnceControl, initSimd);
     mState.enabledTracks= 0;
     mState.needsChanged = 0;
     mState.frameCount   = frameCount;
     mState.outputTemp   = 0;
     mState.resampleTemp = 0;
+    mState.auxTemp      = 0;
     mState.hook         = process__nop;
     track_t* t = mState.tracks;
     for (int i=0 ; i<32 ; i++) {
@@ -64,12 +95,15 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate)
         t->auxInc = 0;
         t->channelCount = 2;
         t->enabled = 0;
+        t->mixerFloat = 0;
+        t->auxFloat = 0;
         t->format = 16;
         t->channelMask = AUDIO_CHANNEL_OUT_STEREO;
         t->buffer.raw = 0;
         t->bufferProvider = 0;
         t->hook = 0;
         t->resampler = 0;
+        t->floatProvider = 0;
         t->sampleRate = mSampleRate;
         t->in = 0;
         t->mainBuffer = NULL;
@@ -83,10 +117,12 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate)
      track_t* t = mState.tracks;
      for (int i=0 ; i<32 ; i++) {
          delete t->resampler;
+         delete t->floatProvider;
          t++;
      }
      delete [] mState.outputTemp;
      delete [] mState.resampleTemp;
+     delete [] mState.auxTemp;
  }
 
  int AudioMixer::getTrackName()
@@ -131,6 +167,8 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate)
             track.sampleRate = mSampleRate;
             invalidateState(1<<name);
         }
+        delete track.floatProvider;
+        track.floatProvider = 0;
         track.volumeInc[0] = 0;
         track.volumeInc[1] = 0;
         mTrackNames &= ~(1<<name);
@@ -216,6 +254,31 @@ status_t AudioMixer::setParameter(int target, int name, void *value)
             }
             return NO_ERROR;
         }
+        if (name == FORMAT || name == MIXER_FORMAT || name == AUX_FORMAT) {
+            uint32_t format = (uint32_t)value;
+            if (format != AUDIO_FORMAT_PCM_16_BIT && format != FORMAT_PCM_FLOAT) {
+                break;
+            }
+            track_t& track = mState.tracks[ mActiveTrack ];
+            bool isFloat = (format == FORMAT_PCM_FLOAT);
+            bool changed;
+            if (name == FORMAT) {
+                uint8_t bits = isFloat ? 32 : 16;
+                changed = (track.format != bits);
+                track.format = bits;
+            } else if (name == MIXER_FORMAT) {
+                changed = (track.mixerFloat != isFloat);
+                track.mixerFloat = isFloat;
+            } else {
+                changed = (track.auxFloat != isFloat);
+                track.auxFloat = isFloat;
+            }
+            if (changed) {
+                ALOGV("setParameter(TRACK, %x, %x)", name, format);
+                invalidateState(1<<mActiveTrack);
+            }
+            return NO_ERROR;
+        }
 
         break;
     case RESAMPLE:
@@ -291,8 +354,9 @@ bool AudioMixer::track_t::setResampler(uint32_t value, uint32_t devSampleRate)
         if (sampleRate != value) {
             sampleRate = value;
             if (resampler == 0) {
+                // float input is converted to 16 bits before the resampler
                 resampler = AudioResampler::create(
-                        format, channelCount, devSampleRate);
+                        16, channelCount, devSampleRate);
             }
             return true;
         }
@@ -332,6 +396,51 @@ void AudioMixer::track_t::adjustVolumeRamp(bool aux)
 }
 
 
+AudioMixer::FloatToPcm16Provider::FloatToPcm16Provider(size_t frameCount)
+    : mProvider(NULL), mBuffer(new int16_t[frameCount * MAX_NUM_CHANNELS]),
+      mFrameCount(frameCount), mChannelCount(MAX_NUM_CHANNELS)
+{
+    mSource.raw = NULL;
+    mSource.frameCount = 0;
+}
+
+AudioMixer::FloatToPcm16Provider::~FloatToPcm16Provider()
+{
+    delete [] mBuffer;
+}
+
+void AudioMixer::FloatToPcm16Provider::setSource(AudioBufferProvider* provider,
+        int channelCount)
+{
+    mProvider = provider;
+    mChannelCount = channelCount;
+}
+
+status_t AudioMixer::FloatToPcm16Provider::getNextBuffer(Buffer* buffer)
+{
+    // providers may always return less than requested, resamplers ask again
+    mSource.frameCount = buffer->frameCount < mFrameCount ? buffer->frameCount : mFrameCount;
+    status_t status = mProvider->getNextBuffer(&mSource);
+    if (mSource.raw == NULL) {
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+        return status;
+    }
+    convertFloatTo16(mBuffer, reinterpret_cast<float const*>(mSource.raw),
+            mSource.frameCount * mChannelCount);
+    buffer->i16 = mBuffer;
+    buffer->frameCount = mSource.frameCount;
+    return status;
+}
+
+void AudioMixer::FloatToPcm16Provider::releaseBuffer(Buffer* buffer)
+{
+    mSource.frameCount = buffer->frameCount;
+    mProvider->releaseBuffer(&mSource);
+    buffer->raw = NULL;
+    buffer->frameCount = 0;
+}
+
 status_t AudioMixer::setBufferProvider(AudioBufferProvider* buffer)
 {
     mState.tracks[ mActiveTrack ].bufferProvider = buffer;
@@ -372,6 +481,7 @@ void AudioMixer::process__validate(state_t* state)
     int all16BitsStereoNoResample = 1;
     int resampling = 0;
     int volumeRamp = 0;
+    int useFloat = 0;
     uint32_t en = state->enabledTracks;
     while (en) {
         const int i = 31 - __builtin_clz(en);
@@ -381,8 +491,14 @@ void AudioMixer::process__validate(state_t* state)
         track_t& t = state->tracks[i];
         uint32_t n = 0;
         n |= NEEDS_CHANNEL_1 + t.channelCount - 1;
-        n |= NEEDS_FORMAT_16;
+        n |= (t.format == 32) ? NEEDS_FORMAT_FLOAT : NEEDS_FORMAT_16;
+        if (t.format == 32 || t.mixerFloat || t.auxFloat) {
+            useFloat = 1;
+        }
         n |= t.doesResample() ? NEEDS_RESAMPLE_ENABLED : NEEDS_RESAMPLE_DISABLED;
+        if (t.format == 32 && t.doesResample() && !t.floatProvider) {
+            t.floatProvider = new FloatToPcm16Provider(state->frameCount);
+        }
         if (t.auxLevel != 0 && t.auxBuffer != NULL) {
             n |= NEEDS_AUX_ENABLED;
         }
@@ -410,7 +526,7 @@ void AudioMixer::process__validate(state_t* state)
                     all16BitsStereoNoResample = 0;
                 }
                 if ((n & NEEDS_CHANNEL_COUNT__MASK) == NEEDS_CHANNEL_2){
-                    t.hook = track__16BitsStereo;
+                    t.hook = sUseSimd ? track__16BitsStereoSimd : track__16BitsStereo;
                 }
             }
         }
@@ -418,7 +534,20 @@ void AudioMixer::process__validate(state_t* state)
 
     // select the processing hooks
     state->hook = process__nop;
-    if (countActiveTracks) {
+    if (useFloat) {
+        // a single track needing float forces the float pipeline for all of
+        // them: 16-bit main buffers are then converted at the end of the mix
+        if (!state->outputTemp) {
+            state->outputTemp = new int32_t[MAX_NUM_CHANNELS * state->frameCount];
+        }
+        if (!state->resampleTemp) {
+            state->resampleTemp = new int32_t[MAX_NUM_CHANNELS * state->frameCount];
+        }
+        if (!state->auxTemp) {
+            state->auxTemp = new float[state->frameCount];
+        }
+        state->hook = process__genericFloat;
+    } else if (countActiveTracks) {
         if (resampling) {
             if (!state->outputTemp) {
                 state->outputTemp = new int32_t[MAX_NUM_CHANNELS * state->frameCount];
@@ -446,9 +575,9 @@ void AudioMixer::process__validate(state_t* state)
     }
 
     ALOGV("mixer configuration change: %d activeTracks (%08x) "
-        "all16BitsStereoNoResample=%d, resampling=%d, volumeRamp=%d",
+        "all16BitsStereoNoResample=%d, resampling=%d, volumeRamp=%d, float=%d",
         countActiveTracks, state->enabledTracks,
-        all16BitsStereoNoResample, resampling, volumeRamp);
+        all16BitsStereoNoResample, resampling, volumeRamp, useFloat);
 
    state->hook(state);
 
@@ -471,7 +600,7 @@ void AudioMixer::process__validate(state_t* state)
        }
        if (allMuted) {
            state->hook = process__nop;
-       } else if (all16BitsStereoNoResample) {
+       } else if (all16BitsStereoNoResample && !useFloat) {
            if (countActiveTracks == 1) {
               state->hook = process__OneTrack16BitsStereoNoResampling;
            }
@@ -601,6 +730,20 @@ void AudioMixer::track__nop(track_t* t, int32_t* out, size_t outFrameCount, int3
 
 void AudioMixer::volumeRampStereo(track_t* t, int32_t* out, size_t frameCount, int32_t* temp, int32_t* aux)
 {
+    if (sUseSimd) {
+        if UNLIKELY(aux != NULL) {
+            AudioMixerSimd::volumeRampStereoAux(out, aux, temp, frameCount,
+                    &t->prevVolume[0], &t->prevVolume[1], &t->prevAuxLevel,
+                    t->volumeInc[0], t->volumeInc[1], t->auxInc);
+        } else {
+            AudioMixerSimd::volumeRampStereo(out, temp, frameCount,
+                    &t->prevVolume[0], &t->prevVolume[1],
+                    t->volumeInc[0], t->volumeInc[1]);
+        }
+        t->adjustVolumeRamp((aux != NULL));
+        return;
+    }
+
     int32_t vl = t->prevVolume[0];
     int32_t vr = t->prevVolume[1];
     const int32_t vlInc = t->volumeInc[0];
@@ -646,6 +789,16 @@ void AudioMixer::volumeStereo(track_t* t, int32_t* out, size_t frameCount, int32
     const int16_t vl = t->volume[0];
     const int16_t vr = t->volume[1];
 
+    if (sUseSimd) {
+        if UNLIKELY(aux != NULL) {
+            AudioMixerSimd::volumeStereoAux(out, aux, temp, frameCount,
+                    vl, vr, (int16_t)t->auxLevel);
+        } else {
+            AudioMixerSimd::volumeStereo(out, temp, frameCount, vl, vr);
+        }
+        return;
+    }
+
     if UNLIKELY(aux != NULL) {
         const int16_t va = (int16_t)t->auxLevel;
         do {
@@ -759,6 +912,40 @@ void AudioMixer::track__16BitsStereo(track_t* t, int32_t* out, size_t frameCount
     t->in = in;
 }
 
+// same as track__16BitsStereo(), using the vectorized kernels
+void AudioMixer::track__16BitsStereoSimd(track_t* t, int32_t* out, size_t frameCount, int32_t* temp, int32_t* aux)
+{
+    int16_t const *in = static_cast<int16_t const *>(t->in);
+
+    if UNLIKELY(aux != NULL) {
+        // ramp gain
+        if UNLIKELY(t->volumeInc[0]|t->volumeInc[1]|t->auxInc) {
+            AudioMixerSimd::ramp16StereoAux(out, aux, in, frameCount,
+                    &t->prevVolume[0], &t->prevVolume[1], &t->prevAuxLevel,
+                    t->volumeInc[0], t->volumeInc[1], t->auxInc);
+            t->adjustVolumeRamp(true);
+        }
+        // constant gain
+        else {
+            AudioMixerSimd::mix16StereoAux(out, aux, in, frameCount,
+                    t->volumeRL, (int16_t)t->auxLevel);
+        }
+    } else {
+        // ramp gain
+        if UNLIKELY(t->volumeInc[0]|t->volumeInc[1]) {
+            AudioMixerSimd::ramp16Stereo(out, in, frameCount,
+                    &t->prevVolume[0], &t->prevVolume[1],
+                    t->volumeInc[0], t->volumeInc[1]);
+            t->adjustVolumeRamp(false);
+        }
+        // constant gain
+        else {
+            AudioMixerSimd::mix16Stereo(out, in, frameCount, t->volumeRL);
+        }
+    }
+    t->in = in + frameCount * MAX_NUM_CHANNELS;
+}
+
 void AudioMixer::track__16BitsMono(track_t* t, int32_t* out, size_t frameCount, int32_t* temp, int32_t* aux)
 {
     int16_t const *in = static_cast<int16_t const *>(t->in);
@@ -845,8 +1032,43 @@ void AudioMixer::track__16BitsMono(track_t* t, int32_t* out, size_t frameCount,
     t->in = in;
 }
 
+void AudioMixer::track__float(track_t* t, float* out, float* aux, void const* in, int source,
+                              int channelCount, size_t frameCount)
+{
+    // volumes are 4.12, ramps are 16.16 of 4.12
+    static const float kGainScale = 1.0f / UNITY_GAIN;
+    static const float kRampScale = kGainScale / (1 << 16);
+
+    if ((t->volumeInc[0]|t->volumeInc[1]) || (aux != NULL && t->auxInc)) {
+        AudioMixerSimd::mixFloat(out, aux, in, source, channelCount, frameCount,
+                t->prevVolume[0] * kRampScale, t->prevVolume[1] * kRampScale,
+                t->prevAuxLevel * kRampScale,
+                t->volumeInc[0] * kRampScale, t->volumeInc[1] * kRampScale,
+                t->auxInc * kRampScale);
+        t->prevVolume[0] += t->volumeInc[0] * (int32_t)frameCount;
+        t->prevVolume[1] += t->volumeInc[1] * (int32_t)frameCount;
+        if (aux != NULL) {
+            t->prevAuxLevel += t->auxInc * (int32_t)frameCount;
+        }
+        t->adjustVolumeRamp(aux != NULL);
+    } else {
+        AudioMixerSimd::mixFloat(out, aux, in, source, channelCount, frameCount,
+                t->volume[0] * kGainScale, t->volume[1] * kGainScale,
+                t->auxLevel * kGainScale, 0, 0, 0);
+    }
+}
+
+void AudioMixer::convertFloatTo16(int16_t* out, float const *in, size_t samples)
+{
+    AudioMixerSimd::floatTo16(out, in, samples);
+}
+
 void AudioMixer::ditherAndClamp(int32_t* out, int32_t const *sums, size_t c)
 {
+    if (sUseSimd) {
+        AudioMixerSimd::ditherAndClamp(out, sums, c);
+        return;
+    }
     for (size_t i=0 ; i<c ; i++) {
         int32_t l = *sums++;
         int32_t r = *sums++;
@@ -862,7 +1084,6 @@ void AudioMixer::ditherAndClamp(int32_t* out, int32_t const *sums, size_t c)
 void AudioMixer::process__nop(state_t* state)
 {
     uint32_t e0 = state->enabledTracks;
-    size_t bufSize = state->frameCount * sizeof(int16_t) * MAX_NUM_CHANNELS;
     while (e0) {
         // process by group of tracks with same output buffer to
         // avoid multiple memset() on same buffer
@@ -880,7 +1101,8 @@ void AudioMixer::process__nop(state_t* state)
         }
         e0 &= ~(e1);
 
-        memset(t1.mainBuffer, 0, bufSize);
+        memset(t1.mainBuffer, 0, state->frameCount * MAX_NUM_CHANNELS *
+                (t1.mixerFloat ? sizeof(float) : sizeof(int16_t)));
 
         while (e1) {
             i = 31 - __builtin_clz(e1);
@@ -1059,6 +1281,104 @@ void AudioMixer::process__genericResampling(state_t* state)
     }
 }
 
+// float pipeline, with or without resampling.
+// Tracks are accumulated in float whatever their input and output formats;
+// main buffers in 16 bits are only converted once all tracks are mixed.
+void AudioMixer::process__genericFloat(state_t* state)
+{
+    float* const outTemp = reinterpret_cast<float*>(state->outputTemp);
+    float* const auxTemp = state->auxTemp;
+    const size_t numFrames = state->frameCount;
+
+    uint32_t e0 = state->enabledTracks;
+    while (e0) {
+        // process by group of tracks with same output buffer
+        // to optimize cache use
+        uint32_t e1 = e0, e2 = e0;
+        int j = 31 - __builtin_clz(e1);
+        track_t& t1 = state->tracks[j];
+        e2 &= ~(1<<j);
+        while (e2) {
+            j = 31 - __builtin_clz(e2);
+            e2 &= ~(1<<j);
+            track_t& t2 = state->tracks[j];
+            if UNLIKELY(t2.mainBuffer != t1.mainBuffer) {
+                e1 &= ~(1<<j);
+            }
+        }
+        e0 &= ~(e1);
+        memset(outTemp, 0, sizeof(float) * MAX_NUM_CHANNELS * numFrames);
+        while (e1) {
+            const int i = 31 - __builtin_clz(e1);
+            e1 &= ~(1<<i);
+            track_t& t = state->tracks[i];
+            if UNLIKELY((t.needs & NEEDS_MUTE__MASK) == NEEDS_MUTE_ENABLED) {
+                // like track__nop: the track is consumed but not mixed
+                size_t outFrames = numFrames;
+                while (outFrames) {
+                    t.buffer.frameCount = outFrames;
+                    t.bufferProvider->getNextBuffer(&t.buffer);
+                    if (t.buffer.raw == NULL) break;
+                    outFrames -= t.buffer.frameCount;
+                    t.bufferProvider->releaseBuffer(&t.buffer);
+                }
+                continue;
+            }
+            float *aux = NULL;
+            if UNLIKELY((t.needs & NEEDS_AUX__MASK) == NEEDS_AUX_ENABLED) {
+                if (t.auxFloat) {
+                    aux = reinterpret_cast<float*>(t.auxBuffer);
+                } else {
+                    memset(auxTemp, 0, sizeof(float) * numFrames);
+                    aux = auxTemp;
+                }
+            }
+
+            if ((t.needs & NEEDS_RESAMPLE__MASK) == NEEDS_RESAMPLE_ENABLED) {
+                // resample at unity gain into Q4.27 and apply volume in float
+                t.resampler->setSampleRate(t.sampleRate);
+                t.resampler->setVolume(UNITY_GAIN, UNITY_GAIN);
+                memset(state->resampleTemp, 0, sizeof(int32_t) * MAX_NUM_CHANNELS * numFrames);
+                AudioBufferProvider* provider = t.bufferProvider;
+                if ((t.needs & NEEDS_FORMAT__MASK) == NEEDS_FORMAT_FLOAT) {
+                    t.floatProvider->setSource(t.bufferProvider, t.channelCount);
+                    provider = t.floatProvider;
+                }
+                t.resampler->resample(state->resampleTemp, numFrames, provider);
+                // resampler output is always stereo
+                track__float(&t, outTemp, aux, state->resampleTemp,
+                        AudioMixerSimd::SOURCE_Q4_27, MAX_NUM_CHANNELS, numFrames);
+            } else {
+                const int source = ((t.needs & NEEDS_FORMAT__MASK) == NEEDS_FORMAT_FLOAT) ?
+                        AudioMixerSimd::SOURCE_FLOAT : AudioMixerSimd::SOURCE_PCM_16;
+                size_t outFrames = 0;
+                while (outFrames < numFrames) {
+                    t.buffer.frameCount = numFrames - outFrames;
+                    t.bufferProvider->getNextBuffer(&t.buffer);
+                    // t.buffer.raw == NULL can happen if the track was flushed just after
+                    // having been enabled for mixing.
+                    if (t.buffer.raw == NULL) break;
+                    track__float(&t, outTemp + outFrames * MAX_NUM_CHANNELS,
+                            aux != NULL ? aux + outFrames : NULL, t.buffer.raw, source,
+                            t.channelCount, t.buffer.frameCount);
+                    outFrames += t.buffer.frameCount;
+                    t.bufferProvider->releaseBuffer(&t.buffer);
+                }
+            }
+
+            if (aux != NULL && !t.auxFloat) {
+                AudioMixerSimd::accumulateFloatToQ4_27(t.auxBuffer, auxTemp, numFrames);
+            }
+        }
+        if (t1.mixerFloat) {
+            memcpy(t1.mainBuffer, outTemp, sizeof(float) * MAX_NUM_CHANNELS * numFrames);
+        } else {
+            convertFloatTo16(reinterpret_cast<int16_t*>(t1.mainBuffer), outTemp,
+                    MAX_NUM_CHANNELS * numFrames);
+        }
+    }
+}
+
 // one track, 16 bits stereo without resampling is the most common case
 void AudioMixer::process__OneTrack16BitsStereoNoResampling(state_t* state)
 {
@@ -45,6 +45,13 @@ public:
 
     static const uint16_t UNITY_GAIN = 0x1000;
 
+    // audio_format_t has no floating point PCM format yet. This value is
+    // accepted by FORMAT (track input), MIXER_FORMAT (main buffer) and
+    // AUX_FORMAT (aux buffer) for 32-bit float samples with a nominal range
+    // of [-1.0, 1.0]. The default for all three is AUDIO_FORMAT_PCM_16_BIT,
+    // which for the aux buffer means Q4.27 int32_t samples.
+    static const uint32_t FORMAT_PCM_FLOAT = 0x5;
+
     enum { // names
 
         // track units (32 units)
@@ -65,6 +72,8 @@ public:
         FORMAT          = 0x4001,
         MAIN_BUFFER     = 0x4002,
         AUX_BUFFER      = 0x4003,
+        MIXER_FORMAT    = 0x4004,
+        AUX_FORMAT      = 0x4005,
         // for TARGET RESAMPLE
         SAMPLE_RATE     = 0x4100,
         RESET           = 0x4101,
@@ -91,6 +100,21 @@ public:
 
     static void ditherAndClamp(int32_t* out, int32_t const *sums, size_t c);
 
+    // Converts float samples to 16 bits, with clamping. Used where a float
+    // main buffer feeds a 16-bit consumer: the output effect chains or the HAL.
+    static void convertFloatTo16(int16_t* out, float const *in, size_t samples);
+
+    // Select the vectorized (SSE2/NEON) mixing kernels instead of the scalar
+    // ones for all mixers of this process. The default comes from the
+    // "af.mixer.simd" property. Returns the resulting state, which is always
+    // false if the vectorized kernels are not available.
+    // The volume and clamping loops read the flag on every process() call.
+    // The resampling-free stereo track hook is chosen when a track is
+    // validated, so tracks already playing keep theirs until one of their
+    // parameters changes. Both kernels give the same output.
+    static bool setSimdEnabled(bool enable);
+    static bool isSimdEnabled();
+
 private:
 
     enum {
@@ -106,6 +130,7 @@ private:
         NEEDS_CHANNEL_2             = 0x00000001,
 
         NEEDS_FORMAT_16             = 0x00000010,
+        NEEDS_FORMAT_FLOAT          = 0x00000020,
 
         NEEDS_MUTE_DISABLED         = 0x00000000,
         NEEDS_MUTE_ENABLED          = 0x00000100,
@@ -129,6 +154,27 @@ private:
     typedef void (*hook_t)(track_t* t, int32_t* output, size_t numOutFrames, int32_t* temp, int32_t* aux);
     static const int BLOCKSIZE = 16; // 4 cache lines
 
+    // Resamplers only read 16-bit input, so a float track that needs
+    // resampling is read through this provider. It converts each buffer of
+    // the track's provider into a 16-bit buffer of at most frameCount frames.
+    class FloatToPcm16Provider : public AudioBufferProvider {
+    public:
+                            FloatToPcm16Provider(size_t frameCount);
+        virtual             ~FloatToPcm16Provider();
+
+        void                setSource(AudioBufferProvider* provider, int channelCount);
+
+        virtual status_t    getNextBuffer(Buffer* buffer);
+        virtual void        releaseBuffer(Buffer* buffer);
+
+    private:
+        AudioBufferProvider*    mProvider;
+        Buffer                  mSource;
+        int16_t*                mBuffer;
+        const size_t            mFrameCount;
+        int                     mChannelCount;
+    };
+
     struct track_t {
         uint32_t    needs;
 
@@ -148,8 +194,10 @@ private:
 
         uint8_t     channelCount : 4;
         uint8_t     enabled      : 1;
-        uint8_t     reserved0    : 3;
-        uint8_t     format;
+        uint8_t     mixerFloat   : 1;   // main buffer is float
+        uint8_t     auxFloat     : 1;   // aux buffer is float
+        uint8_t     reserved0    : 1;
+        uint8_t     format;         // input bits per sample, 32 is float
         uint32_t    channelMask;
 
         AudioBufferProvider*                bufferProvider;
@@ -159,6 +207,7 @@ private:
         void const* in;             // current location in buffer
 
         AudioResampler*     resampler;
+        FloatToPcm16Provider* floatProvider;  // only for float tracks that resample
         uint32_t            sampleRate;
         int32_t*           mainBuffer;
         int32_t*           auxBuffer;
@@ -177,7 +226,8 @@ private:
         mix_t           hook;
         int32_t         *outputTemp;
         int32_t         *resampleTemp;
-        int32_t         reserved[2];
+        float           *auxTemp;
+        int32_t         reserved[1];
         track_t         tracks[32]; __attribute__((aligned(32)));
     };
 
@@ -189,17 +239,25 @@ private:
 
     void invalidateState(uint32_t mask);
 
+    static bool     sUseSimd;
+
     static void track__genericResample(track_t* t, int32_t* out, size_t numFrames, int32_t* temp, int32_t* aux);
     static void track__nop(track_t* t, int32_t* out, size_t numFrames, int32_t* temp, int32_t* aux);
     static void track__16BitsStereo(track_t* t, int32_t* out, size_t numFrames, int32_t* temp, int32_t* aux);
+    static void track__16BitsStereoSimd(track_t* t, int32_t* out, size_t numFrames, int32_t* temp, int32_t* aux);
     static void track__16BitsMono(track_t* t, int32_t* out, size_t numFrames, int32_t* temp, int32_t* aux);
     static void volumeRampStereo(track_t* t, int32_t* out, size_t frameCount, int32_t* temp, int32_t* aux);
     static void volumeStereo(track_t* t, int32_t* out, size_t frameCount, int32_t* temp, int32_t* aux);
+    static void track__float(track_t* t, float* out, float* aux, void const* in, int source,
+                             int channelCount, size_t frameCount);
+
+    static void initSimd();
 
     static void process__validate(state_t* state);
     static void process__nop(state_t* state);
     static void process__genericNoResampling(state_t* state);
     static void process__genericResampling(state_t* state);
+    static void process__genericFloat(state_t* state);
     static void process__OneTrack16BitsStereoNoResampling(state_t* state);
     static void process__TwoTracks16BitsStereoNoResampling(state_t* state);
 };
@@ -0,0 +1,816 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "AudioMixerSimd.h"
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#endif
+
+namespace android {
+namespace AudioMixerSimd {
+
+// ----------------------------------------------------------------------------
+// Scalar tails. These mirror the loops in AudioMixer.cpp exactly.
+
+static inline int16_t clamp16(int32_t sample)
+{
+    if ((sample>>15) ^ (sample>>31))
+        sample = 0x7FFF ^ (sample>>31);
+    return sample;
+}
+
+static inline void tail16(int32_t*& out, int32_t*& aux, int16_t const*& in,
+        size_t n, int16_t vl, int16_t vr, int16_t va)
+{
+    while (n--) {
+        int16_t l = *in++;
+        int16_t r = *in++;
+        *out++ += l * int32_t(vl);
+        *out++ += r * int32_t(vr);
+        if (aux != NULL) {
+            int16_t a = (int16_t)(((int32_t)l + r) >> 1);
+            *aux++ += a * int32_t(va);
+        }
+    }
+}
+
+static inline void tailRamp(int32_t*& out, int32_t*& aux, int32_t l, int32_t r,
+        int32_t& vl, int32_t& vr, int32_t& va,
+        int32_t vlInc, int32_t vrInc, int32_t vaInc)
+{
+    *out++ += (vl >> 16) * l;
+    *out++ += (vr >> 16) * r;
+    vl += vlInc;
+    vr += vrInc;
+    if (aux != NULL) {
+        *aux++ += (va >> 17) * (l + r);
+        va += vaInc;
+    }
+}
+
+static const float kScale16 = 1.0f / (1 << 15);
+static const float kScaleQ4_27 = 1.0f / (1 << 27);
+
+static inline float sourceSample(void const* in, int source, size_t i)
+{
+    switch (source) {
+    case SOURCE_PCM_16:
+        return static_cast<int16_t const *>(in)[i] * kScale16;
+    case SOURCE_Q4_27:
+        return static_cast<int32_t const *>(in)[i] * kScaleQ4_27;
+    default:
+        return static_cast<float const *>(in)[i];
+    }
+}
+
+static inline size_t sourceSampleSize(int source)
+{
+    return source == SOURCE_PCM_16 ? sizeof(int16_t) : sizeof(int32_t);
+}
+
+static void mixFloatScalar(float*& out, float*& aux, void const*& in, int source,
+        int channelCount, size_t frameCount, float& gl, float& gr, float& ga,
+        float glInc, float grInc, float gaInc)
+{
+    for (size_t i = 0; i < frameCount; i++) {
+        float l = sourceSample(in, source, i * channelCount);
+        float r = channelCount == 1 ? l : sourceSample(in, source, i * channelCount + 1);
+        *out++ += l * gl;
+        *out++ += r * gr;
+        gl += glInc;
+        gr += grInc;
+        if (aux != NULL) {
+            *aux++ += (l + r) * 0.5f * ga;
+            ga += gaInc;
+        }
+    }
+    in = static_cast<uint8_t const *>(in) + frameCount * channelCount * sourceSampleSize(source);
+}
+
+static inline int16_t floatTo16Scalar(float f)
+{
+    f *= 32768.0f;
+    if (f >= 32767.0f) {
+        return 32767;
+    } else if (f <= -32768.0f) {
+        return -32768;
+    }
+    return (int16_t)(f + (f >= 0 ? 0.5f : -0.5f));
+}
+
+#if AUDIO_MIXER_HAVE_SIMD
+
+// ----------------------------------------------------------------------------
+// Architecture specific helpers. All of them operate on 4 stereo frames.
+
+#if defined(__ARM_NEON__)
+
+// 16-bit stereo x constant 4.12 volume, accumulated into out (and aux).
+static inline void mix4x16(int32_t* out, int32_t* aux, int16x8_t s,
+        int16x4_t vol, int16_t va)
+{
+    vst1q_s32(out, vmlal_s16(vld1q_s32(out), vget_low_s16(s), vol));
+    vst1q_s32(out + 4, vmlal_s16(vld1q_s32(out + 4), vget_high_s16(s), vol));
+    if (aux != NULL) {
+        int32x4_t a = vshrq_n_s32(vpaddlq_s16(s), 1);
+        vst1q_s32(aux, vmlaq_n_s32(vld1q_s32(aux), a, va));
+    }
+}
+
+// 32-bit stereo x ramped 16.16 volume, accumulated into out (and aux).
+static inline void ramp4x32(int32_t* out, int32_t* aux,
+        int32x4_t x0, int32x4_t x1, int32x4_t& g, int32x4_t inc2,
+        int32x4_t& ga, int32x4_t inc4)
+{
+    vst1q_s32(out, vmlaq_s32(vld1q_s32(out), vshrq_n_s32(g, 16), x0));
+    g = vaddq_s32(g, inc2);
+    vst1q_s32(out + 4, vmlaq_s32(vld1q_s32(out + 4), vshrq_n_s32(g, 16), x1));
+    g = vaddq_s32(g, inc2);
+    if (aux != NULL) {
+        int32x2_t s0 = vpadd_s32(vget_low_s32(x0), vget_high_s32(x0));
+        int32x2_t s1 = vpadd_s32(vget_low_s32(x1), vget_high_s32(x1));
+        int32x4_t sums = vcombine_s32(s0, s1);
+        vst1q_s32(aux, vmlaq_s32(vld1q_s32(aux), vshrq_n_s32(ga, 17), sums));
+        ga = vaddq_s32(ga, inc4);
+    }
+}
+
+static inline int32x4_t ramp4(int32_t v0, int32_t v1, int32_t inc0, int32_t inc1)
+{
+    int32_t v[4] = { v0, v1, int32_t(uint32_t(v0) + inc0), int32_t(uint32_t(v1) + inc1) };
+    return vld1q_s32(v);
+}
+
+static inline int32x4_t rampAux4(int32_t va, int32_t inc)
+{
+    int32_t v[4] = { va, int32_t(uint32_t(va) + inc), int32_t(uint32_t(va) + 2*uint32_t(inc)),
+            int32_t(uint32_t(va) + 3*uint32_t(inc)) };
+    return vld1q_s32(v);
+}
+
+static inline int32_t lane0(int32x4_t v) { return vgetq_lane_s32(v, 0); }
+static inline int32_t lane1(int32x4_t v) { return vgetq_lane_s32(v, 1); }
+
+#else // __SSE2__
+
+static inline __m128i mullo32(__m128i a, __m128i b)
+{
+#if defined(__SSE4_1__)
+    return _mm_mullo_epi32(a, b);
+#else
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+static inline __m128i load(void const* p)
+{
+    return _mm_loadu_si128(static_cast<__m128i const *>(p));
+}
+
+static inline void accumulate(int32_t* p, __m128i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_add_epi32(load(p), v));
+}
+
+// 16-bit stereo x constant 4.12 volume, accumulated into out (and aux).
+static inline void mix4x16(int32_t* out, int32_t* aux, __m128i s,
+        __m128i vol, __m128i va)
+{
+    __m128i lo = _mm_mullo_epi16(s, vol);
+    __m128i hi = _mm_mulhi_epi16(s, vol);
+    accumulate(out, _mm_unpacklo_epi16(lo, hi));
+    accumulate(out + 4, _mm_unpackhi_epi16(lo, hi));
+    if (aux != NULL) {
+        __m128i a = _mm_srai_epi32(_mm_madd_epi16(s, _mm_set1_epi16(1)), 1);
+        a = _mm_packs_epi32(a, a);
+        accumulate(aux, _mm_unpacklo_epi16(_mm_mullo_epi16(a, va), _mm_mulhi_epi16(a, va)));
+    }
+}
+
+// 32-bit stereo x ramped 16.16 volume, accumulated into out (and aux).
+static inline void ramp4x32(int32_t* out, int32_t* aux,
+        __m128i x0, __m128i x1, __m128i& g, __m128i inc2,
+        __m128i& ga, __m128i inc4)
+{
+    accumulate(out, mullo32(_mm_srai_epi32(g, 16), x0));
+    g = _mm_add_epi32(g, inc2);
+    accumulate(out + 4, mullo32(_mm_srai_epi32(g, 16), x1));
+    g = _mm_add_epi32(g, inc2);
+    if (aux != NULL) {
+        __m128 f0 = _mm_castsi128_ps(x0);
+        __m128 f1 = _mm_castsi128_ps(x1);
+        __m128i l = _mm_castps_si128(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i r = _mm_castps_si128(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1)));
+        accumulate(aux, mullo32(_mm_srai_epi32(ga, 17), _mm_add_epi32(l, r)));
+        ga = _mm_add_epi32(ga, inc4);
+    }
+}
+
+static inline __m128i ramp4(int32_t v0, int32_t v1, int32_t inc0, int32_t inc1)
+{
+    return _mm_setr_epi32(v0, v1, int32_t(uint32_t(v0) + inc0), int32_t(uint32_t(v1) + inc1));
+}
+
+static inline __m128i rampAux4(int32_t va, int32_t inc)
+{
+    return _mm_setr_epi32(va, int32_t(uint32_t(va) + inc), int32_t(uint32_t(va) + 2*uint32_t(inc)),
+            int32_t(uint32_t(va) + 3*uint32_t(inc)));
+}
+
+static inline int32_t lane0(__m128i v) { return _mm_cvtsi128_si32(v); }
+static inline int32_t lane1(__m128i v) { return _mm_cvtsi128_si32(_mm_srli_si128(v, 4)); }
+
+#endif
+
+// ----------------------------------------------------------------------------
+
+bool available()
+{
+    return true;
+}
+
+static inline void mix16(int32_t* out, int32_t* aux, int16_t const* in,
+        size_t frameCount, uint32_t vrl, int16_t va)
+{
+    size_t n = frameCount >> 2;
+#if defined(__ARM_NEON__)
+    int16x4_t vol = vreinterpret_s16_u32(vdup_n_u32(vrl));
+    while (n--) {
+        mix4x16(out, aux, vld1q_s16(in), vol, va);
+#else
+    __m128i vol = _mm_set1_epi32(vrl);
+    __m128i vav = _mm_set1_epi16(va);
+    while (n--) {
+        mix4x16(out, aux, load(in), vol, vav);
+#endif
+        in += 8;
+        out += 8;
+        if (aux != NULL) {
+            aux += 4;
+        }
+    }
+    tail16(out, aux, in, frameCount & 3, int16_t(vrl & 0xFFFF), int16_t(vrl >> 16), va);
+}
+
+void mix16Stereo(int32_t* out, int16_t const* in, size_t frameCount, uint32_t vrl)
+{
+    mix16(out, NULL, in, frameCount, vrl, 0);
+}
+
+void mix16StereoAux(int32_t* out, int32_t* aux, int16_t const* in,
+        size_t frameCount, uint32_t vrl, int16_t va)
+{
+    mix16(out, aux, in, frameCount, vrl, va);
+}
+
+static inline void ramp16(int32_t* out, int32_t* aux, int16_t const* in,
+        size_t frameCount, int32_t* vlp, int32_t* vrp, int32_t* vap,
+        int32_t vlInc, int32_t vrInc, int32_t vaInc)
+{
+    int32_t vl = *vlp;
+    int32_t vr = *vrp;
+    int32_t va = vap ? *vap : 0;
+    size_t n = frameCount >> 2;
+    if (n) {
+        int32_t inc2l = int32_t(2*uint32_t(vlInc));
+        int32_t inc2r = int32_t(2*uint32_t(vrInc));
+#if defined(__ARM_NEON__)
+        int32x4_t g = ramp4(vl, vr, vlInc, vrInc);
+        int32x4_t inc2 = ramp4(inc2l, inc2r, 0, 0);
+        inc2 = vcombine_s32(vget_low_s32(inc2), vget_low_s32(inc2));
+        int32x4_t ga = rampAux4(va, vaInc);
+        int32x4_t inc4 = vdupq_n_s32(int32_t(4*uint32_t(vaInc)));
+        while (n--) {
+            int16x8_t s = vld1q_s16(in);
+            ramp4x32(out, aux, vmovl_s16(vget_low_s16(s)), vmovl_s16(vget_high_s16(s)),
+                    g, inc2, ga, inc4);
+#else
+        __m128i g = ramp4(vl, vr, vlInc, vrInc);
+        __m128i inc2 = _mm_setr_epi32(inc2l, inc2r, inc2l, inc2r);
+        __m128i ga = rampAux4(va, vaInc);
+        __m128i inc4 = _mm_set1_epi32(int32_t(4*uint32_t(vaInc)));
+        while (n--) {
+            __m128i s = load(in);
+            ramp4x32(out, aux, _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16),
+                    _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16), g, inc2, ga, inc4);
+#endif
+            in += 8;
+            out += 8;
+            if (aux != NULL) {
+                aux += 4;
+            }
+        }
+        vl = lane0(g);
+        vr = lane1(g);
+        va = lane0(ga);
+    }
+    for (n = frameCount & 3; n; n--) {
+        int32_t l = *in++;
+        int32_t r = *in++;
+        tailRamp(out, aux, l, r, vl, vr, va, vlInc, vrInc, vaInc);
+    }
+    *vlp = vl;
+    *vrp = vr;
+    if (vap) {
+        *vap = va;
+    }
+}
+
+void ramp16Stereo(int32_t* out, int16_t const* in, size_t frameCount,
+        int32_t* vl, int32_t* vr, int32_t vlInc, int32_t vrInc)
+{
+    ramp16(out, NULL, in, frameCount, vl, vr, NULL, vlInc, vrInc, 0);
+}
+
+void ramp16StereoAux(int32_t* out, int32_t* aux, int16_t const* in,
+        size_t frameCount, int32_t* vl, int32_t* vr, int32_t* va,
+        int32_t vlInc, int32_t vrInc, int32_t vaInc)
+{
+    ramp16(out, aux, in, frameCount, vl, vr, va, vlInc, vrInc, vaInc);
+}
+
+// The constant volume path of volumeStereo() truncates each Q4.27 sample to
+// 16 bits, so it is equivalent to narrowing and reusing the 16-bit kernel.
+static inline void volume32(int32_t* out, int32_t* aux, int32_t const* temp,
+        size_t frameCount, int16_t vl, int16_t vr, int16_t va)
+{
+    const uint32_t vrl = (uint32_t(uint16_t(vr)) << 16) | uint16_t(vl);
+    size_t n = frameCount >> 2;
+#if defined(__ARM_NEON__)
+    int16x4_t vol = vreinterpret_s16_u32(vdup_n_u32(vrl));
+    while (n--) {
+        int16x4_t s0 = vmovn_s32(vshrq_n_s32(vld1q_s32(temp), 12));
+        int16x4_t s1 = vmovn_s32(vshrq_n_s32(vld1q_s32(temp + 4), 12));
+        mix4x16(out, aux, vcombine_s16(s0, s1), vol, va);
+#else
+    __m128i vol = _mm_set1_epi32(vrl);
+    __m128i vav = _mm_set1_epi16(va);
+    while (n--) {
+        __m128i t0 = _mm_srai_epi32(_mm_slli_epi32(_mm_srai_epi32(load(temp), 12), 16), 16);
+        __m128i t1 = _mm_srai_epi32(_mm_slli_epi32(_mm_srai_epi32(load(temp + 4), 12), 16), 16);
+        mix4x16(out, aux, _mm_packs_epi32(t0, t1), vol, vav);
+#endif
+        temp += 8;
+        out += 8;
+        if (aux != NULL) {
+            aux += 4;
+        }
+    }
+    for (n = frameCount & 3; n; n--) {
+        int16_t in[2] = { (int16_t)(temp[0] >> 12), (int16_t)(temp[1] >> 12) };
+        int16_t const *p = in;
+        tail16(out, aux, p, 1, vl, vr, va);
+        temp += 2;
+    }
+}
+
+void volumeStereo(int32_t* out, int32_t const* temp, size_t frameCount,
+        int16_t vl, int16_t vr)
+{
+    volume32(out, NULL, temp, frameCount, vl, vr, 0);
+}
+
+void volumeStereoAux(int32_t* out, int32_t* aux, int32_t const* temp,
+        size_t frameCount, int16_t vl, int16_t vr, int16_t va)
+{
+    volume32(out, aux, temp, frameCount, vl, vr, va);
+}
+
+static inline void volumeRamp32(int32_t* out, int32_t* aux, int32_t const* temp,
+        size_t frameCount, int32_t* vlp, int32_t* vrp, int32_t* vap,
+        int32_t vlInc, int32_t vrInc, int32_t vaInc)
+{
+    int32_t vl = *vlp;
+    int32_t vr = *vrp;
+    int32_t va = vap ? *vap : 0;
+    size_t n = frameCount >> 2;
+    if (n) {
+        int32_t inc2l = int32_t(2*uint32_t(vlInc));
+        int32_t inc2r = int32_t(2*uint32_t(vrInc));
+#if defined(__ARM_NEON__)
+        int32x4_t g = ramp4(vl, vr, vlInc, vrInc);
+        int32x4_t inc2 = ramp4(inc2l, inc2r, 0, 0);
+        inc2 = vcombine_s32(vget_low_s32(inc2), vget_low_s32(inc2));
+        int32x4_t ga = rampAux4(va, vaInc);
+        int32x4_t inc4 = vdupq_n_s32(int32_t(4*uint32_t(vaInc)));
+        while (n--) {
+            ramp4x32(out, aux, vshrq_n_s32(vld1q_s32(temp), 12),
+                    vshrq_n_s32(vld1q_s32(temp + 4), 12), g, inc2, ga, inc4);
+#else
+        __m128i g = ramp4(vl, vr, vlInc, vrInc);
+        __m128i inc2 = _mm_setr_epi32(inc2l, inc2r, inc2l, inc2r);
+        __m128i ga = rampAux4(va, vaInc);
+        __m128i inc4 = _mm_set1_epi32(int32_t(4*uint32_t(vaInc)));
+        while (n--) {
+            ramp4x32(out, aux, _mm_srai_epi32(load(temp), 12),
+                    _mm_srai_epi32(load(temp + 4), 12), g, inc2, ga, inc4);
+#endif
+            temp += 8;
+            out += 8;
+            if (aux != NULL) {
+                aux += 4;
+            }
+        }
+        vl = lane0(g);
+        vr = lane1(g);
+        va = lane0(ga);
+    }
+    for (n = frameCount & 3; n; n--) {
+        int32_t l = *temp++ >> 12;
+        int32_t r = *temp++ >> 12;
+        tailRamp(out, aux, l, r, vl, vr, va, vlInc, vrInc, vaInc);
+    }
+    *vlp = vl;
+    *vrp = vr;
+    if (vap) {
+        *vap = va;
+    }
+}
+
+void volumeRampStereo(int32_t* out, int32_t const* temp, size_t frameCount,
+        int32_t* vl, int32_t* vr, int32_t vlInc, int32_t vrInc)
+{
+    volumeRamp32(out, NULL, temp, frameCount, vl, vr, NULL, vlInc, vrInc, 0);
+}
+
+void volumeRampStereoAux(int32_t* out, int32_t* aux, int32_t const* temp,
+        size_t frameCount, int32_t* vl, int32_t* vr, int32_t* va,
+        int32_t vlInc, int32_t vrInc, int32_t vaInc)
+{
+    volumeRamp32(out, aux, temp, frameCount, vl, vr, va, vlInc, vrInc, vaInc);
+}
+
+void ditherAndClamp(int32_t* out, int32_t const* sums, size_t frameCount)
+{
+    size_t n = frameCount >> 2;
+    while (n--) {
+#if defined(__ARM_NEON__)
+        int16x4_t s0 = vqshrn_n_s32(vld1q_s32(sums), 12);
+        int16x4_t s1 = vqshrn_n_s32(vld1q_s32(sums + 4), 12);
+        vst1q_s16(reinterpret_cast<int16_t *>(out), vcombine_s16(s0, s1));
+#else
+        __m128i s = _mm_packs_epi32(_mm_srai_epi32(load(sums), 12),
+                _mm_srai_epi32(load(sums + 4), 12));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), s);
+#endif
+        sums += 8;
+        out += 4;
+    }
+    for (n = frameCount & 3; n; n--) {
+        int32_t l = clamp16(sums[0] >> 12);
+        int32_t r = clamp16(sums[1] >> 12);
+        *out++ = (r<<16) | (l & 0xFFFF);
+        sums += 2;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Float pipeline
+
+#if defined(__ARM_NEON__)
+
+// Loads 4 stereo frames as two vectors of [l0 r0 l1 r1] floats.
+static inline void loadFloat4(void const* in, int source, float32x4_t& x0, float32x4_t& x1)
+{
+    switch (source) {
+    case SOURCE_PCM_16: {
+        int16x8_t s = vld1q_s16(static_cast<int16_t const *>(in));
+        x0 = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), kScale16);
+        x1 = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), kScale16);
+        } break;
+    case SOURCE_Q4_27: {
+        int32_t const *p = static_cast<int32_t const *>(in);
+        x0 = vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(p)), kScaleQ4_27);
+        x1 = vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(p + 4)), kScaleQ4_27);
+        } break;
+    default: {
+        float const *p = static_cast<float const *>(in);
+        x0 = vld1q_f32(p);
+        x1 = vld1q_f32(p + 4);
+        } break;
+    }
+}
+
+static inline void mixFloat4(float* out, float* aux, float32x4_t x0, float32x4_t x1,
+        float32x4_t& g, float32x4_t inc2, float32x4_t& ga, float32x4_t inc4)
+{
+    vst1q_f32(out, vmlaq_f32(vld1q_f32(out), x0, g));
+    g = vaddq_f32(g, inc2);
+    vst1q_f32(out + 4, vmlaq_f32(vld1q_f32(out + 4), x1, g));
+    g = vaddq_f32(g, inc2);
+    if (aux != NULL) {
+        float32x2_t s0 = vpadd_f32(vget_low_f32(x0), vget_high_f32(x0));
+        float32x2_t s1 = vpadd_f32(vget_low_f32(x1), vget_high_f32(x1));
+        float32x4_t a = vmulq_n_f32(vcombine_f32(s0, s1), 0.5f);
+        vst1q_f32(aux, vmlaq_f32(vld1q_f32(aux), a, ga));
+        ga = vaddq_f32(ga, inc4);
+    }
+}
+
+static inline float32x4_t setFloat4(float a, float b, float c, float d)
+{
+    float v[4] = { a, b, c, d };
+    return vld1q_f32(v);
+}
+
+static inline float laneF(float32x4_t v, int i)
+{
+    float f[4];
+    vst1q_f32(f, v);
+    return f[i];
+}
+
+typedef float32x4_t float4;
+
+#else // __SSE2__
+
+static inline void loadFloat4(void const* in, int source, __m128& x0, __m128& x1)
+{
+    switch (source) {
+    case SOURCE_PCM_16: {
+        __m128i s = load(in);
+        __m128 scale = _mm_set1_ps(kScale16);
+        x0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)), scale);
+        x1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)), scale);
+        } break;
+    case SOURCE_Q4_27: {
+        int32_t const *p = static_cast<int32_t const *>(in);
+        __m128 scale = _mm_set1_ps(kScaleQ4_27);
+        x0 = _mm_mul_ps(_mm_cvtepi32_ps(load(p)), scale);
+        x1 = _mm_mul_ps(_mm_cvtepi32_ps(load(p + 4)), scale);
+        } break;
+    default: {
+        float const *p = static_cast<float const *>(in);
+        x0 = _mm_loadu_ps(p);
+        x1 = _mm_loadu_ps(p + 4);
+        } break;
+    }
+}
+
+static inline void mixFloat4(float* out, float* aux, __m128 x0, __m128 x1,
+        __m128& g, __m128 inc2, __m128& ga, __m128 inc4)
+{
+    _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(x0, g)));
+    g = _mm_add_ps(g, inc2);
+    _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(x1, g)));
+    g = _mm_add_ps(g, inc2);
+    if (aux != NULL) {
+        __m128 l = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 r = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 a = _mm_mul_ps(_mm_add_ps(l, r), _mm_set1_ps(0.5f));
+        _mm_storeu_ps(aux, _mm_add_ps(_mm_loadu_ps(aux), _mm_mul_ps(a, ga)));
+        ga = _mm_add_ps(ga, inc4);
+    }
+}
+
+static inline __m128 setFloat4(float a, float b, float c, float d)
+{
+    return _mm_setr_ps(a, b, c, d);
+}
+
+static inline float laneF(__m128 v, int i)
+{
+    float f[4];
+    _mm_storeu_ps(f, v);
+    return f[i];
+}
+
+typedef __m128 float4;
+
+#endif
+
+void mixFloat(float* out, float* aux, void const* in, int source, int channelCount,
+        size_t frameCount, float gl, float gr, float ga,
+        float glInc, float grInc, float gaInc)
+{
+    if (channelCount == 2 && frameCount >= 4) {
+        size_t n = frameCount >> 2;
+        float4 g = setFloat4(gl, gr, gl + glInc, gr + grInc);
+        float4 inc2 = setFloat4(2 * glInc, 2 * grInc, 2 * glInc, 2 * grInc);
+        float4 gav = setFloat4(ga, ga + gaInc, ga + 2 * gaInc, ga + 3 * gaInc);
+        float4 inc4 = setFloat4(4 * gaInc, 4 * gaInc, 4 * gaInc, 4 * gaInc);
+        const size_t stride = 8 * sourceSampleSize(source);
+        while (n--) {
+            float4 x0, x1;
+            loadFloat4(in, source, x0, x1);
+            mixFloat4(out, aux, x0, x1, g, inc2, gav, inc4);
+            in = static_cast<uint8_t const *>(in) + stride;
+            out += 8;
+            if (aux != NULL) {
+                aux += 4;
+            }
+        }
+        gl = laneF(g, 0);
+        gr = laneF(g, 1);
+        ga = laneF(gav, 0);
+        frameCount &= 3;
+    }
+    mixFloatScalar(out, aux, in, source, channelCount, frameCount,
+            gl, gr, ga, glInc, grInc, gaInc);
+}
+
+void floatTo16(int16_t* out, float const* in, size_t sampleCount)
+{
+    size_t n = sampleCount >> 3;
+    while (n--) {
+#if defined(__ARM_NEON__)
+        // round half away from zero, then saturate while narrowing
+        const uint32x4_t sign = vdupq_n_u32(0x80000000);
+        const uint32x4_t half = vreinterpretq_u32_f32(vdupq_n_f32(0.5f));
+        float32x4_t f0 = vmulq_n_f32(vld1q_f32(in), 32768.0f);
+        float32x4_t f1 = vmulq_n_f32(vld1q_f32(in + 4), 32768.0f);
+        f0 = vaddq_f32(f0, vreinterpretq_f32_u32(
+                vorrq_u32(vandq_u32(vreinterpretq_u32_f32(f0), sign), half)));
+        f1 = vaddq_f32(f1, vreinterpretq_f32_u32(
+                vorrq_u32(vandq_u32(vreinterpretq_u32_f32(f1), sign), half)));
+        vst1q_s16(out, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(f0)),
+                vqmovn_s32(vcvtq_s32_f32(f1))));
+#else
+        // clamp before converting: out of range values convert to 0x80000000,
+        // then round half away from zero like NEON and floatTo16Scalar
+        const __m128 scale = _mm_set1_ps(32768.0f);
+        const __m128 hi = _mm_set1_ps(32767.0f);
+        const __m128 lo = _mm_set1_ps(-32768.0f);
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        __m128 f0 = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in), scale), hi), lo);
+        __m128 f1 = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + 4), scale), hi), lo);
+        f0 = _mm_add_ps(f0, _mm_or_ps(_mm_and_ps(f0, sign), half));
+        f1 = _mm_add_ps(f1, _mm_or_ps(_mm_and_ps(f1, sign), half));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                _mm_packs_epi32(_mm_cvttps_epi32(f0), _mm_cvttps_epi32(f1)));
+#endif
+        in += 8;
+        out += 8;
+    }
+    for (n = sampleCount & 7; n; n--) {
+        *out++ = floatTo16Scalar(*in++);
+    }
+}
+
+void accumulateFloatToQ4_27(int32_t* out, float const* in, size_t sampleCount)
+{
+    size_t n = sampleCount >> 2;
+    while (n--) {
+#if defined(__ARM_NEON__)
+        int32x4_t v = vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(in), float(1 << 27)));
+        vst1q_s32(out, vaddq_s32(vld1q_s32(out), v));
+#else
+        accumulate(out, _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(in), _mm_set1_ps(float(1 << 27)))));
+#endif
+        in += 4;
+        out += 4;
+    }
+    for (n = sampleCount & 3; n; n--) {
+        *out++ += int32_t(*in++ * float(1 << 27));
+    }
+}
+
+#else // !AUDIO_MIXER_HAVE_SIMD
+
+// Without vector support AudioMixer never calls into this file; the entry
+// points below only exist so that callers link on every architecture.
+
+bool available()
+{
+    return false;
+}
+
+void mix16Stereo(int32_t* out, int16_t const* in, size_t frameCount, uint32_t vrl)
+{
+    int32_t* aux = NULL;
+    tail16(out, aux, in, frameCount, int16_t(vrl & 0xFFFF), int16_t(vrl >> 16), 0);
+}
+
+void mix16StereoAux(int32_t* out, int32_t* aux, int16_t const* in,
+        size_t frameCount, uint32_t vrl, int16_t va)
+{
+    tail16(out, aux, in, frameCount, int16_t(vrl & 0xFFFF), int16_t(vrl >> 16), va);
+}
+
+void ramp16Stereo(int32_t* out, int16_t const* in, size_t frameCount,
+        int32_t* vl, int32_t* vr, int32_t vlInc, int32_t vrInc)
+{
+    int32_t* aux = NULL;
+    int32_t va = 0;
+    while (frameCount--) {
+        int32_t l = *in++;
+        int32_t r = *in++;
+        tailRamp(out, aux, l, r, *vl, *vr, va, vlInc, vrInc, 0);
+    }
+}
+
+void ramp16StereoAux(int32_t* out, int32_t* aux, int16_t const* in,
+        size_t frameCount, int32_t* vl, int32_t* vr, int32_t* va,
+        int32_t vlInc, int32_t vrInc, int32_t vaInc)
+{
+    while (frameCount--) {
+        int32_t l = *in++;
+        int32_t r = *in++;
+        tailRamp(out, aux, l, r, *vl, *vr, *va, vlInc, vrInc, vaInc);
+    }
+}
+
+void volumeStereo(int32_t* out, int32_t const* temp, size_t frameCount,
+        int16_t vl, int16_t vr)
+{
+    volumeStereoAux(out, NULL, temp, frameCount, vl, vr, 0);
+}
+
+void volumeStereoAux(int32_t* out, int32_t* aux, int32_t const* temp,
+        size_t frameCount, int16_t vl, int16_t vr, int16_t va)
+{
+    while (frameCount--) {
+        int16_t in[2] = { (int16_t)(temp[0] >> 12), (int16_t)(temp[1] >> 12) };
+        int16_t const *p = in;
+        tail16(out, aux, p, 1, vl, vr, va);
+        temp += 2;
+    }
+}
+
+void volumeRampStereo(int32_t* out, int32_t const* temp, size_t frameCount,
+        int32_t* vl, int32_t* vr, int32_t vlInc, int32_t vrInc)
+{
+    int32_t* aux = NULL;
+    int32_t va = 0;
+    while (frameCount--) {
+        int32_t l = *temp++ >> 12;
+        int32_t r = *temp++ >> 12;
+        tailRamp(out, aux, l, r, *vl, *vr, va, vlInc, vrInc, 0);
+    }
+}
+
+void volumeRampStereoAux(int32_t* out, int32_t* aux, int32_t const* temp,
+        size_t frameCount, int32_t* vl, int32_t* vr, int32_t* va,
+        int32_t vlInc, int32_t vrInc, int32_t vaInc)
+{
+    while (frameCount--) {
+        int32_t l = *temp++ >> 12;
+        int32_t r = *temp++ >> 12;
+        tailRamp(out, aux, l, r, *vl, *vr, *va, vlInc, vrInc, vaInc);
+    }
+}
+
+void ditherAndClamp(int32_t* out, int32_t const* sums, size_t frameCount)
+{
+    while (frameCount--) {
+        int32_t l = clamp16(sums[0] >> 12);
+        int32_t r = clamp16(sums[1] >> 12);
+        *out++ = (r<<16) | (l & 0xFFFF);
+        sums += 2;
+    }
+}
+
+void mixFloat(float* out, float* aux, void const* in, int source, int channelCount,
+        size_t frameCount, float gl, float gr, float ga,
+        float glInc, float grInc, float gaInc)
+{
+    mixFloatScalar(out, aux, in, source, channelCount, frameCount,
+            gl, gr, ga, glInc, grInc, gaInc);
+}
+
+void floatTo16(int16_t* out, float const* in, size_t sampleCount)
+{
+    while (sampleCount--) {
+        *out++ = floatTo16Scalar(*in++);
+    }
+}
+
+void accumulateFloatToQ4_27(int32_t* out, float const* in, size_t sampleCount)
+{
+    while (sampleCount--) {
+        *out++ += int32_t(*in++ * float(1 << 27));
+    }
+}
+
+#endif // AUDIO_MIXER_HAVE_SIMD
+
+// ----------------------------------------------------------------------------
+}; // namespace AudioMixerSimd
+}; // namespace android
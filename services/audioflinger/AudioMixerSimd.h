@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_MIXER_SIMD_H
+#define ANDROID_AUDIO_MIXER_SIMD_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#if defined(__ARM_NEON__)
+#define AUDIO_MIXER_HAVE_SIMD 1
+#define AUDIO_MIXER_SIMD_NAME "neon"
+#elif defined(__SSE2__)
+#define AUDIO_MIXER_HAVE_SIMD 1
+#define AUDIO_MIXER_SIMD_NAME "sse2"
+#else
+#define AUDIO_MIXER_HAVE_SIMD 0
+#define AUDIO_MIXER_SIMD_NAME "none"
+#endif
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+// Vectorized versions of the AudioMixer stereo kernels.
+//
+// Every kernel produces bit-exact results with respect to the scalar code in
+// AudioMixer.cpp: volumes are 4.12 fixed point, ramped volumes are 16.16 and
+// accumulation is done in 32 bits with the same truncation rules.
+// Frames that do not fill a whole vector are handled by a scalar tail, so any
+// frame count is accepted. Buffers need not be aligned.
+//
+// The ramp kernels take the current ramp values by pointer and update them to
+// the value following the last frame processed.
+
+namespace AudioMixerSimd {
+
+// Returns true if the kernels below were compiled in and the CPU supports them.
+bool available();
+
+// 16-bit interleaved stereo input, constant volume (vrl = vr << 16 | vl).
+void mix16Stereo(int32_t* out, int16_t const* in, size_t frameCount,
+        uint32_t vrl);
+void mix16StereoAux(int32_t* out, int32_t* aux, int16_t const* in,
+        size_t frameCount, uint32_t vrl, int16_t va);
+
+// 16-bit interleaved stereo input, ramped volume.
+void ramp16Stereo(int32_t* out, int16_t const* in, size_t frameCount,
+        int32_t* vl, int32_t* vr, int32_t vlInc, int32_t vrInc);
+void ramp16StereoAux(int32_t* out, int32_t* aux, int16_t const* in,
+        size_t frameCount, int32_t* vl, int32_t* vr, int32_t* va,
+        int32_t vlInc, int32_t vrInc, int32_t vaInc);
+
+// Q4.27 interleaved stereo input (resampler output), constant volume.
+void volumeStereo(int32_t* out, int32_t const* temp, size_t frameCount,
+        int16_t vl, int16_t vr);
+void volumeStereoAux(int32_t* out, int32_t* aux, int32_t const* temp,
+        size_t frameCount, int16_t vl, int16_t vr, int16_t va);
+
+// Q4.27 interleaved stereo input (resampler output), ramped volume.
+void volumeRampStereo(int32_t* out, int32_t const* temp, size_t frameCount,
+        int32_t* vl, int32_t* vr, int32_t vlInc, int32_t vrInc);
+void volumeRampStereoAux(int32_t* out, int32_t* aux, int32_t const* temp,
+        size_t frameCount, int32_t* vl, int32_t* vr, int32_t* va,
+        int32_t vlInc, int32_t vrInc, int32_t vaInc);
+
+// Q4.27 stereo sums to packed 16-bit stereo. out may be equal to sums.
+void ditherAndClamp(int32_t* out, int32_t const* sums, size_t frameCount);
+
+// Float pipeline. Unlike the kernels above these are not bit-exact with a
+// scalar reference: the gain ramp is stepped per vector rather than per frame.
+
+enum {
+    SOURCE_PCM_16,      // 16-bit samples, full scale is 32768
+    SOURCE_Q4_27,       // resampler output at unity gain, full scale is 1 << 27
+    SOURCE_FLOAT,       // float samples, full scale is 1.0
+};
+
+// Accumulates frameCount frames of in (mono or stereo) into the float stereo
+// buffer out with gains ramping linearly from gl/gr by glInc/grInc per frame.
+// If aux is not NULL, the average of both channels is accumulated into it with
+// gain ga ramping by gaInc.
+void mixFloat(float* out, float* aux, void const* in, int source, int channelCount,
+        size_t frameCount, float gl, float gr, float ga,
+        float glInc, float grInc, float gaInc);
+
+// Converts float samples to 16 bits with rounding and clamping.
+void floatTo16(int16_t* out, float const* in, size_t sampleCount);
+
+// Accumulates float samples into a Q4.27 buffer.
+void accumulateFloatToQ4_27(int32_t* out, float const* in, size_t sampleCount);
+
+}; // namespace AudioMixerSimd
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_AUDIO_MIXER_SIMD_H
@@ -25,6 +25,7 @@
 #include "AudioResampler.h"
 #include "AudioResamplerSinc.h"
 #include "AudioResamplerCubic.h"
+#include "AudioResamplerPolyphase.h"
 
 #ifdef __arm__
 #include <machine/cpu-features.h>
@@ -78,20 +79,31 @@ private:
 };
 
 // ----------------------------------------------------------------------------
-AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
-        int32_t sampleRate, int quality) {
-
-    // can only create low quality resample now
-    AudioResampler* resampler;
-
+static int getQuality(int quality) {
     char value[PROPERTY_VALUE_MAX];
     if (property_get("af.resampler.quality", value, 0)) {
         quality = atoi(value);
         ALOGD("forcing AudioResampler quality to %d", quality);
     }
 
-    if (quality == DEFAULT)
-        quality = LOW_QUALITY;
+    if (quality == AudioResampler::DEFAULT)
+        quality = AudioResampler::LOW_QUALITY;
+    return quality;
+}
+
+void AudioResampler::initTables(int quality) {
+    if (getQuality(quality) == VERY_HIGH_QUALITY) {
+        AudioResamplerPolyphase::initFilterBanks();
+    }
+}
+
+AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
+        int32_t sampleRate, int quality) {
+
+    // can only create low quality resample now
+    AudioResampler* resampler;
+
+    quality = getQuality(quality);
 
     switch (quality) {
     default:
@@ -107,6 +119,10 @@ AudioResampler* AudioResampler::create(int bitDepth, int inChannelCount,
         ALOGV("Create sinc Resampler");
         resampler = new AudioResamplerSinc(bitDepth, inChannelCount, sampleRate);
         break;
+    case VERY_HIGH_QUALITY:
+        ALOGV("Create polyphase Resampler");
+        resampler = new AudioResamplerPolyphase(bitDepth, inChannelCount, sampleRate);
+        break;
     }
 
     // initialize resampler
@@ -31,6 +31,9 @@ public:
     //  LOW_QUALITY: linear interpolator (1st order)
     //  MED_QUALITY: cubic interpolator (3rd order)
     //  HIGH_QUALITY: fixed multi-tap FIR (e.g. 48KHz->44.1KHz)
+    //  VERY_HIGH_QUALITY: polyphase FIR with a filter bank per rational
+    //  ratio (e.g. 44.1KHz<->48KHz, 8/16/22.05/32KHz->44.1/48KHz), falls
+    //  back to HIGH_QUALITY for other ratios
     // NOTE: high quality SRC will only be supported for
     // certain fixed rate conversions. Sample rate cannot be
     // changed dynamically. 
@@ -38,12 +41,18 @@ public:
         DEFAULT=0,
         LOW_QUALITY=1,
         MED_QUALITY=2,
-        HIGH_QUALITY=3
+        HIGH_QUALITY=3,
+        VERY_HIGH_QUALITY=4
     };
 
     static AudioResampler* create(int bitDepth, int inChannelCount,
             int32_t sampleRate, int quality=DEFAULT);
 
+    // Computes the tables of the resamplers create() makes for this quality.
+    // Resamplers are created on the mixer threads, call this at startup so
+    // that they don't have to. create() does it too otherwise.
+    static void initTables(int quality=DEFAULT);
+
     virtual ~AudioResampler();
 
     virtual void init() = 0;
@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioResamplerPolyphase"
+//#define LOG_NDEBUG 0
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "AudioResamplerPolyphase.h"
+#include "AudioResamplerSinc.h"
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+struct AudioResamplerPolyphase::FilterBank {
+    uint32_t l;             // number of phases
+    uint32_t m;             // input frames per L output frames
+    uint32_t taps;          // taps per phase, a multiple of 8
+    float* coefs;           // l filters of taps coefficients
+};
+
+// Kaiser window parameter, for about 86 dB of stop band attenuation
+static const double kKaiserBeta = 8.6;
+
+// Conversions that have a filter bank, from the usual content rates to the
+// usual output rates. Ratios that reduce to the same L/M share a bank.
+static const int32_t kInputRates[] = { 8000, 11025, 16000, 22050, 32000, 44100, 48000 };
+static const int32_t kOutputRates[] = { 44100, 48000 };
+static const size_t kMaxFilterBanks =
+        sizeof(kInputRates) / sizeof(kInputRates[0]) *
+        sizeof(kOutputRates) / sizeof(kOutputRates[0]);
+
+// built once by initFilterBanks() and never freed, read without a lock
+static AudioResamplerPolyphase::FilterBank* sFilterBanks[kMaxFilterBanks];
+static size_t sNumFilterBanks;
+static pthread_once_t sFilterBanksOnce = PTHREAD_ONCE_INIT;
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// zeroth order modified Bessel function of the first kind
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    double y = x * x / 4;
+    for (int k = 1; k < 50; k++) {
+        term *= y / (k * k);
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static AudioResamplerPolyphase::FilterBank* createFilterBank(uint32_t l, uint32_t m,
+        int halfZeroCrossings)
+{
+    // cutoff relative to the input Nyquist frequency
+    const double ratio = m > l ? (double)l / m : 1.0;
+    uint32_t taps = (uint32_t)ceil(2 * halfZeroCrossings / ratio);
+    taps = (taps + 7) & ~7;
+
+    // place the -6 dB point so that the stop band starts at the lower Nyquist
+    // frequency: the Kaiser transition width is (A - 8) / (2.285 * 2 * pi * N)
+    const double transition = (86 - 8) / (2.285 * 2 * M_PI * 2 * halfZeroCrossings);
+    const double fc = ratio * (0.5 - transition / 2);
+    const double halfLength = taps / 2.0;
+    const double i0Beta = besselI0(kKaiserBeta);
+
+    AudioResamplerPolyphase::FilterBank* bank = new AudioResamplerPolyphase::FilterBank;
+    bank->l = l;
+    bank->m = m;
+    bank->taps = taps;
+    bank->coefs = new float[l * taps];
+
+    double* h = new double[taps];
+    for (uint32_t p = 0; p < l; p++) {
+        // the filter for phase p produces the output at p / L input frames
+        // after the middle of the history window
+        double sum = 0;
+        for (uint32_t j = 0; j < taps; j++) {
+            double t = (double)p / l - ((double)j - halfLength + 1);
+            double v = 2 * fc;
+            if (t != 0) {
+                v = sin(2 * M_PI * fc * t) / (M_PI * t);
+            }
+            double w = t / halfLength;
+            w = (w <= -1 || w >= 1) ? 0 : besselI0(kKaiserBeta * sqrt(1 - w * w)) / i0Beta;
+            h[j] = v * w;
+            sum += h[j];
+        }
+        // normalize each phase to unity DC gain
+        float* coefs = bank->coefs + p * taps;
+        for (uint32_t j = 0; j < taps; j++) {
+            coefs[j] = (float)(h[j] / sum);
+        }
+    }
+    delete[] h;
+
+    ALOGV("created %u phase filter bank with %u taps for ratio %u/%u", l, taps, l, m);
+    return bank;
+}
+
+// ----------------------------------------------------------------------------
+
+// Coefficients and history are float: with 16-bit coefficients the rounding
+// error differs from one phase to the next and, for ratios with hundreds of
+// phases, shows up as noise at about -77 dB.
+static inline float dot(float const* coefs, float const* x, uint32_t taps)
+{
+#if defined(__ARM_NEON__)
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    for (uint32_t i = 0; i < taps; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(coefs + i), vld1q_f32(x + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(coefs + i + 4), vld1q_f32(x + i + 4));
+    }
+    float32x4_t acc = vaddq_f32(acc0, acc1);
+    float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vpadd_f32(sum, sum);
+    return vget_lane_f32(sum, 0);
+#elif defined(__SSE2__)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (uint32_t i = 0; i < taps; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(coefs + i), _mm_loadu_ps(x + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(coefs + i + 4), _mm_loadu_ps(x + i + 4)));
+    }
+    __m128 acc = _mm_add_ps(acc0, acc1);
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(acc);
+#else
+    float acc = 0;
+    for (uint32_t i = 0; i < taps; i++) {
+        acc += coefs[i] * x[i];
+    }
+    return acc;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
+AudioResamplerPolyphase::AudioResamplerPolyphase(int bitDepth,
+        int inChannelCount, int32_t sampleRate)
+    : AudioResampler(bitDepth, inChannelCount, sampleRate),
+    mBank(0), mFallback(0), mHistory(0), mHistoryCount(0), mPhase(0), mPending(0)
+{
+    // already done by AudioResampler::create(), this makes the banks
+    // visible to this thread
+    initFilterBanks();
+
+    const size_t size = (kMaxTaps + kHistoryChunk) * inChannelCount;
+    mHistory = new float[size];
+    memset(mHistory, 0, sizeof(float) * size);
+    mHistoryCount = kMaxTaps;
+}
+
+AudioResamplerPolyphase::~AudioResamplerPolyphase()
+{
+    delete mFallback;
+    delete [] mHistory;
+}
+
+void AudioResamplerPolyphase::init() {
+}
+
+void AudioResamplerPolyphase::createFilterBanks()
+{
+    for (size_t i = 0; i < sizeof(kInputRates) / sizeof(kInputRates[0]); i++) {
+        for (size_t j = 0; j < sizeof(kOutputRates) / sizeof(kOutputRates[0]); j++) {
+            if (kInputRates[i] == kOutputRates[j]) {
+                continue;
+            }
+            uint32_t g = gcd(kInputRates[i], kOutputRates[j]);
+            uint32_t l = kOutputRates[j] / g;
+            uint32_t m = kInputRates[i] / g;
+            LOG_ALWAYS_FATAL_IF(l > kMaxPhases || m > 2 * l,
+                    "no filter bank for %d -> %d Hz", kInputRates[i], kOutputRates[j]);
+            if (findFilterBank(l, m) == NULL) {
+                sFilterBanks[sNumFilterBanks++] = createFilterBank(l, m, kHalfZeroCrossings);
+            }
+        }
+    }
+    ALOGV("created %u filter banks", sNumFilterBanks);
+}
+
+void AudioResamplerPolyphase::initFilterBanks()
+{
+    pthread_once(&sFilterBanksOnce, createFilterBanks);
+}
+
+AudioResamplerPolyphase::FilterBank const* AudioResamplerPolyphase::findFilterBank(
+        uint32_t l, uint32_t m)
+{
+    for (size_t i = 0; i < sNumFilterBanks; i++) {
+        if (sFilterBanks[i]->l == l && sFilterBanks[i]->m == m) {
+            return sFilterBanks[i];
+        }
+    }
+    return NULL;
+}
+
+AudioResamplerPolyphase::FilterBank const* AudioResamplerPolyphase::getFilterBank(
+        int32_t inSampleRate, int32_t outSampleRate)
+{
+    if (inSampleRate <= 0 || outSampleRate <= 0) {
+        return NULL;
+    }
+    uint32_t g = gcd(inSampleRate, outSampleRate);
+    return findFilterBank(outSampleRate / g, inSampleRate / g);
+}
+
+bool AudioResamplerPolyphase::isRatioSupported(int32_t inSampleRate, int32_t outSampleRate)
+{
+    initFilterBanks();
+    return getFilterBank(inSampleRate, outSampleRate) != NULL;
+}
+
+void AudioResamplerPolyphase::setSampleRate(int32_t inSampleRate)
+{
+    // called for every mix buffer by the mixer, keep this cheap
+    if (inSampleRate == mInSampleRate && (mBank != NULL || mFallback != NULL)) {
+        return;
+    }
+    AudioResampler::setSampleRate(inSampleRate);
+
+    // only a lookup, the banks were built by initFilterBanks()
+    mBank = getFilterBank(inSampleRate, mSampleRate);
+    if (mBank != NULL) {
+        if (mPhase >= mBank->l) {
+            mPhase = 0;
+        }
+    } else {
+        ALOGV("no filter bank for %d -> %d Hz, using sinc resampler", inSampleRate, mSampleRate);
+        if (mFallback == NULL) {
+            mFallback = new AudioResamplerSinc(mBitDepth, mChannelCount, mSampleRate);
+        }
+        mFallback->setSampleRate(inSampleRate);
+        mFallback->setVolume(mVolume[0], mVolume[1]);
+    }
+}
+
+void AudioResamplerPolyphase::setVolume(int16_t left, int16_t right)
+{
+    AudioResampler::setVolume(left, right);
+    if (mFallback != NULL) {
+        mFallback->setVolume(left, right);
+    }
+}
+
+void AudioResamplerPolyphase::reset()
+{
+    AudioResampler::reset();
+    memset(mHistory, 0, sizeof(float) * (kMaxTaps + kHistoryChunk) * mChannelCount);
+    mHistoryCount = kMaxTaps;
+    mPhase = 0;
+    mPending = 0;
+    if (mFallback != NULL) {
+        mFallback->reset();
+    }
+}
+
+void AudioResamplerPolyphase::resample(int32_t* out, size_t outFrameCount,
+        AudioBufferProvider* provider)
+{
+    if (mBank == NULL) {
+        if (mFallback == NULL) {
+            // setSampleRate() was never called
+            setSampleRate(mInSampleRate);
+        }
+        if (mFallback != NULL) {
+            mFallback->resample(out, outFrameCount, provider);
+            return;
+        }
+    }
+
+    switch (mChannelCount) {
+    case 1:
+        resample<1>(out, outFrameCount, provider);
+        break;
+    case 2:
+        resample<2>(out, outFrameCount, provider);
+        break;
+    }
+}
+
+template<int CHANNELS>
+void AudioResamplerPolyphase::push(int16_t const* frame)
+{
+    const size_t rowSize = kMaxTaps + kHistoryChunk;
+    if (mHistoryCount == rowSize) {
+        // keep the last filter length of samples
+        for (int c = 0; c < CHANNELS; c++) {
+            float* row = mHistory + c * rowSize;
+            memcpy(row, row + kHistoryChunk, sizeof(float) * kMaxTaps);
+        }
+        mHistoryCount = kMaxTaps;
+    }
+    for (int c = 0; c < CHANNELS; c++) {
+        mHistory[c * rowSize + mHistoryCount] = frame[c];
+    }
+    mHistoryCount++;
+}
+
+template<int CHANNELS>
+void AudioResamplerPolyphase::resample(int32_t* out, size_t outFrameCount,
+        AudioBufferProvider* provider)
+{
+    const size_t rowSize = kMaxTaps + kHistoryChunk;
+    const uint32_t l = mBank->l;
+    const uint32_t m = mBank->m;
+    const uint32_t taps = mBank->taps;
+    const float vl = mVolume[0];
+    const float vr = mVolume[1];
+    size_t inputIndex = mInputIndex;
+    uint32_t phase = mPhase;
+    uint32_t pending = mPending;
+    size_t inFrameCount = (outFrameCount*mInSampleRate)/mSampleRate;
+
+    AudioBufferProvider::Buffer& buffer(mBuffer);
+    for (size_t outputIndex = 0; outputIndex < outFrameCount; outputIndex++) {
+        // read the input frames needed for this output frame
+        while (pending != 0) {
+            if (buffer.frameCount == 0) {
+                buffer.frameCount = inFrameCount;
+                provider->getNextBuffer(&buffer);
+                if (buffer.raw == NULL) {
+                    goto resample_exit;
+                }
+            }
+            push<CHANNELS>(buffer.i16 + inputIndex * CHANNELS);
+            pending--;
+            if (++inputIndex >= buffer.frameCount) {
+                inputIndex = 0;
+                provider->releaseBuffer(&buffer);
+            }
+        }
+
+        // output is 16-bit samples times 4.12 volume, as for the other
+        // resamplers
+        float const* coefs = mBank->coefs + phase * taps;
+        float const* x = mHistory + mHistoryCount - taps;
+        float accL = dot(coefs, x, taps);
+        float accR = CHANNELS == 2 ? dot(coefs, x + rowSize, taps) : accL;
+        out[outputIndex * 2] += (int32_t)(accL * vl);
+        out[outputIndex * 2 + 1] += (int32_t)(accR * vr);
+
+        phase += m;
+        while (phase >= l) {
+            phase -= l;
+            pending++;
+        }
+    }
+
+resample_exit:
+    mInputIndex = inputIndex;
+    mPhase = phase;
+    mPending = pending;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_RESAMPLER_POLYPHASE_H
+#define ANDROID_AUDIO_RESAMPLER_POLYPHASE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <cutils/log.h>
+
+#include "AudioResampler.h"
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+// Rational ratio polyphase FIR resampler.
+//
+// For an input rate Fi and output rate Fo the ratio is reduced to L/M, and a
+// bank of L windowed sinc filters (one per output phase) is used. Each output
+// sample is then a single dot product of the input history with one filter of
+// the bank, with no coefficient interpolation. Coefficients and history are
+// float and the dot products are vectorized with NEON or SSE when available.
+//
+// The banks are computed once, by initFilterBanks(), for the conversions from
+// 8, 11.025, 16, 22.05, 32, 44.1 and 48 kHz to 44.1 and 48 kHz, and shared by
+// all instances. Changing the sample rate only looks a bank up, other ratios
+// are handed to AudioResamplerSinc.
+class AudioResamplerPolyphase : public AudioResampler {
+public:
+    AudioResamplerPolyphase(int bitDepth, int inChannelCount, int32_t sampleRate);
+
+    ~AudioResamplerPolyphase();
+
+    virtual void setSampleRate(int32_t inSampleRate);
+    virtual void setVolume(int16_t left, int16_t right);
+    virtual void resample(int32_t* out, size_t outFrameCount,
+            AudioBufferProvider* provider);
+    virtual void reset();
+
+    // Maximum number of phases of a filter bank, i.e. of L.
+    static const uint32_t kMaxPhases = 1024;
+
+    // Returns true if the conversion from inSampleRate to outSampleRate is
+    // done by a precomputed filter bank rather than by the fallback.
+    static bool isRatioSupported(int32_t inSampleRate, int32_t outSampleRate);
+
+    // Computes the filter banks, the first time only. This takes a while,
+    // call it before creating a resampler on an audio thread, as
+    // AudioResampler::initTables() does.
+    static void initFilterBanks();
+
+    struct FilterBank;
+
+private:
+    void init();
+
+    template<int CHANNELS>
+    void resample(int32_t* out, size_t outFrameCount,
+            AudioBufferProvider* provider);
+
+    template<int CHANNELS>
+    inline void push(int16_t const* frame);
+
+    static void createFilterBanks();
+    static FilterBank const* findFilterBank(uint32_t l, uint32_t m);
+    static FilterBank const* getFilterBank(int32_t inSampleRate, int32_t outSampleRate);
+
+    // number of zero crossings of the prototype filter on each side, at the
+    // lower of the input and output rates
+    static const int kHalfZeroCrossings = 32;
+
+    // longest filter, for a 2:1 downsampling ratio; always a multiple of 8
+    static const size_t kMaxTaps = 4 * kHalfZeroCrossings;
+
+    // input frames kept in the history in addition to one filter length,
+    // before it has to be moved back to the beginning of the buffer
+    static const size_t kHistoryChunk = 256;
+
+    FilterBank const* mBank;
+    AudioResampler* mFallback;
+
+    // planar history, one row of kMaxTaps + kHistoryChunk samples per channel
+    float* mHistory;
+    size_t mHistoryCount;   // samples currently in each row
+    uint32_t mPhase;        // current filter of the bank, in [0, L)
+    uint32_t mPending;      // input frames to read before the next output
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif /*ANDROID_AUDIO_RESAMPLER_POLYPHASE_H*/
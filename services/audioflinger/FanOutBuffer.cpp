@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FanOutBuffer"
+//#define LOG_NDEBUG 0
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "FanOutBuffer.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+FanOutBuffer::FanOutBuffer(size_t frameSize, size_t writeFrames)
+    :   mFrameSize(frameSize), mWriteFrames(writeFrames), mWritePos(0), mWaiting(0)
+{
+    mCapacity = 1;
+    while (mCapacity < kMinWrites * writeFrames) {
+        mCapacity <<= 1;
+    }
+    mBuffer = new int8_t[mCapacity * mFrameSize];
+    memset(mBuffer, 0, mCapacity * mFrameSize);
+    mSilenceBuffer = new int8_t[mWriteFrames * mFrameSize];
+    memset(mSilenceBuffer, 0, mWriteFrames * mFrameSize);
+    memset(mReaders, 0, sizeof(mReaders));
+}
+
+FanOutBuffer::~FanOutBuffer()
+{
+    delete[] mBuffer;
+    delete[] mSilenceBuffer;
+}
+
+int FanOutBuffer::addReader(policy_t policy, size_t maxLatencyFrames)
+{
+    Mutex::Autolock _l(mLock);
+    for (int i = 0; i < kMaxReaders; i++) {
+        Reader& r = mReaders[i];
+        if (!r.mUsed) {
+            memset(&r, 0, sizeof(r));
+            r.mUsed = true;
+            r.mPolicy = policy;
+            r.mMaxLatency = maxLatencyFrames < maxLatency() ? maxLatencyFrames : maxLatency();
+            r.mReadPos = mWritePos;
+            r.mStopped = 1;
+            r.mStopPos = mWritePos;
+            return i;
+        }
+    }
+    ALOGW("addReader() no more readers");
+    return -1;
+}
+
+void FanOutBuffer::removeReader(int reader)
+{
+    Mutex::Autolock _l(mLock);
+    mReaders[reader].mUsed = false;
+}
+
+void FanOutBuffer::startReader(int reader, size_t silenceFrames)
+{
+    Mutex::Autolock _l(mLock);
+    Reader& r = mReaders[reader];
+    r.mSilence = silenceFrames;
+    r.mReadPos = mWritePos;
+    android_atomic_release_store(0, &r.mStopped);
+}
+
+void FanOutBuffer::stopReader(int reader)
+{
+    Mutex::Autolock _l(mLock);
+    Reader& r = mReaders[reader];
+    r.mStopPos = mWritePos;
+    android_atomic_release_store(1, &r.mStopped);
+}
+
+status_t FanOutBuffer::waitForReaders(size_t frames, uint32_t timeoutMs)
+{
+    nsecs_t deadline = systemTime() + milliseconds(timeoutMs);
+    status_t status;
+
+    Mutex::Autolock _l(mLock);
+    // readers check mWaiting after moving their read position, see releaseBuffer()
+    android_atomic_inc(&mWaiting);
+    for (;;) {
+        bool waitReaders = false;
+        bool ready = true;
+        for (int i = 0; i < kMaxReaders; i++) {
+            const Reader& r = mReaders[i];
+            if (!r.mUsed || r.mStopped || r.mPolicy != POLICY_WAIT) {
+                continue;
+            }
+            waitReaders = true;
+            // the silence played at start counts as latency
+            uint32_t pending = (uint32_t)mWritePos -
+                    (uint32_t)android_atomic_acquire_load(&r.mReadPos) + r.mSilence;
+            if (pending + frames > r.mMaxLatency) {
+                ready = false;
+            }
+        }
+        if (!waitReaders) {
+            status = WOULD_BLOCK;
+            break;
+        }
+        if (ready) {
+            status = NO_ERROR;
+            break;
+        }
+        nsecs_t timeout = deadline - systemTime();
+        if (timeout <= 0) {
+            for (int i = 0; i < kMaxReaders; i++) {
+                Reader& r = mReaders[i];
+                if (r.mUsed && !r.mStopped && r.mPolicy == POLICY_WAIT) {
+                    r.mTimeouts++;
+                }
+            }
+            status = TIMED_OUT;
+            break;
+        }
+        mCond.waitRelative(mLock, timeout);
+    }
+    android_atomic_dec(&mWaiting);
+    return status;
+}
+
+void FanOutBuffer::write(const void* data, size_t frames)
+{
+    const int8_t* src = (const int8_t*)data;
+    if (frames > mWriteFrames) {
+        ALOGW("write() %u frames, more than the %u expected", frames, mWriteFrames);
+        frames = mWriteFrames;
+    }
+    uint32_t writePos = mWritePos;
+    size_t offset = writePos & (mCapacity - 1);
+    size_t part = mCapacity - offset;
+    if (part > frames) {
+        part = frames;
+    }
+    memcpy(mBuffer + offset * mFrameSize, src, part * mFrameSize);
+    if (part < frames) {
+        memcpy(mBuffer, src + part * mFrameSize, (frames - part) * mFrameSize);
+    }
+    android_atomic_release_store(writePos + frames, &mWritePos);
+}
+
+uint32_t FanOutBuffer::readLimit(const Reader& r) const
+{
+    if (android_atomic_acquire_load(&r.mStopped)) {
+        return r.mStopPos;
+    }
+    return android_atomic_acquire_load(&mWritePos);
+}
+
+size_t FanOutBuffer::framesReady(int reader) const
+{
+    const Reader& r = mReaders[reader];
+    uint32_t avail = readLimit(r) - (uint32_t)r.mReadPos;
+    if (avail > r.mMaxLatency) {
+        // getNextBuffer() drops the oldest frames
+        avail = r.mMaxLatency;
+    }
+    return r.mSilence + avail;
+}
+
+status_t FanOutBuffer::getNextBuffer(int reader, AudioBufferProvider::Buffer* buffer)
+{
+    Reader& r = mReaders[reader];
+    size_t framesReq = buffer->frameCount;
+
+    if (r.mSilence != 0) {
+        if (framesReq > (size_t)r.mSilence) {
+            framesReq = r.mSilence;
+        }
+        if (framesReq > mWriteFrames) {
+            framesReq = mWriteFrames;
+        }
+        buffer->raw = mSilenceBuffer;
+        buffer->frameCount = framesReq;
+        return NO_ERROR;
+    }
+
+    uint32_t readPos = r.mReadPos;
+    uint32_t avail = readLimit(r) - readPos;
+    if (avail > r.mMaxLatency) {
+        uint32_t drop = avail - r.mMaxLatency;
+        ALOGV("getNextBuffer() reader %d dropping %u frames", reader, drop);
+        r.mDroppedFrames += drop;
+        readPos += drop;
+        android_atomic_add(drop, &r.mReadPos);
+        avail = r.mMaxLatency;
+    }
+    if (avail == 0) {
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+        return NOT_ENOUGH_DATA;
+    }
+    size_t offset = readPos & (mCapacity - 1);
+    if (framesReq > avail) {
+        framesReq = avail;
+    }
+    if (framesReq > mCapacity - offset) {
+        framesReq = mCapacity - offset;
+    }
+    buffer->raw = mBuffer + offset * mFrameSize;
+    buffer->frameCount = framesReq;
+    return NO_ERROR;
+}
+
+void FanOutBuffer::releaseBuffer(int reader, AudioBufferProvider::Buffer* buffer)
+{
+    Reader& r = mReaders[reader];
+    size_t frames = buffer->frameCount;
+
+    if (buffer->raw == mSilenceBuffer) {
+        r.mSilence -= frames;
+    } else if (frames != 0) {
+        uint32_t readPos = r.mReadPos;
+        // the oldest frame read is the first one the writer overwrites
+        if ((uint32_t)android_atomic_acquire_load(&mWritePos) - readPos > mCapacity) {
+            r.mOverruns++;
+        }
+        // full barrier: the writer must see the new position, or we must see
+        // that it is waiting
+        android_atomic_add(frames, &r.mReadPos);
+        if (r.mPolicy == POLICY_WAIT && android_atomic_acquire_load(&mWaiting)) {
+            Mutex::Autolock _l(mLock);
+            mCond.signal();
+        }
+    }
+    buffer->raw = NULL;
+    buffer->frameCount = 0;
+}
+
+void FanOutBuffer::dump(String8& result) const
+{
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+
+    snprintf(buffer, SIZE, "Fan out buffer: %u frames, written %u\n", mCapacity,
+            (uint32_t)mWritePos);
+    result.append(buffer);
+    result.append("  Reader Policy Latency Pending Dropped Overruns Timeouts\n");
+    for (int i = 0; i < kMaxReaders; i++) {
+        const Reader& r = mReaders[i];
+        if (!r.mUsed) {
+            continue;
+        }
+        snprintf(buffer, SIZE, "  %6d %6s %7u %7u %7u %8u %8u%s\n",
+                i,
+                r.mPolicy == POLICY_WAIT ? "wait" : "drop",
+                r.mMaxLatency,
+                readLimit(r) - (uint32_t)r.mReadPos,
+                r.mDroppedFrames,
+                r.mOverruns,
+                r.mTimeouts,
+                r.mStopped ? " stopped" : "");
+        result.append(buffer);
+    }
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
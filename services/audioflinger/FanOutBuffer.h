@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_FAN_OUT_BUFFER_H
+#define ANDROID_AUDIO_FAN_OUT_BUFFER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+
+#include "AudioBufferProvider.h"
+
+namespace android {
+
+class String8;
+
+// ----------------------------------------------------------------------------
+
+// Ring buffer with one writer and several readers, each reading all the
+// frames at its own pace.
+//
+// The DuplicatingThread writes its mix once and the OutputTrack of every
+// output it duplicates to reads the frames in place, instead of each output
+// getting its own copy. The buffer is reference counted so that an output
+// thread can keep reading after the DuplicatingThread is gone.
+//
+// The writer never blocks on a reader with POLICY_DROP: a reader which falls
+// more than its maximum latency behind skips its oldest frames. The writer
+// waits for readers with POLICY_WAIT, which is how the DuplicatingThread is
+// paced by its main output, but only up to a timeout, after which these
+// readers drop frames too.
+//
+// Readers are added and started by the writer thread. Only the reader thread
+// calls framesReady(), getNextBuffer() and releaseBuffer() for a reader.
+class FanOutBuffer : public RefBase {
+public:
+    static const int kMaxReaders = 4;
+
+    enum policy_t {
+        POLICY_WAIT,        // the writer waits for the reader, up to a timeout
+        POLICY_DROP,        // the reader drops frames when it falls behind
+    };
+
+    // writeFrames is the largest write: the capacity is at least kMinWrites
+    // times that, rounded up to a power of two.
+                FanOutBuffer(size_t frameSize, size_t writeFrames);
+    virtual     ~FanOutBuffer();
+
+    size_t      frameSize() const { return mFrameSize; }
+    size_t      capacity() const { return mCapacity; }
+    // largest latency a reader can be given
+    size_t      maxLatency() const { return mCapacity - kGuardWrites * mWriteFrames; }
+
+    // Returns the index of the reader, or -1 if there are already kMaxReaders.
+    int         addReader(policy_t policy, size_t maxLatencyFrames);
+    void        removeReader(int reader);
+    // The reader starts at the next frame written, after silenceFrames
+    // frames of silence.
+    void        startReader(int reader, size_t silenceFrames);
+    // The reader can still read the frames written before.
+    void        stopReader(int reader);
+
+    // Called by the writer. Waits until every started POLICY_WAIT reader can
+    // take frames more frames without exceeding its latency. Returns
+    // NO_ERROR, TIMED_OUT, or WOULD_BLOCK if there is no such reader.
+    status_t    waitForReaders(size_t frames, uint32_t timeoutMs);
+    void        write(const void* data, size_t frames);
+
+    size_t      framesReady(int reader) const;
+    status_t    getNextBuffer(int reader, AudioBufferProvider::Buffer* buffer);
+    void        releaseBuffer(int reader, AudioBufferProvider::Buffer* buffer);
+
+    void        dump(String8& result) const;
+
+private:
+    static const size_t kMinWrites = 8;
+    // room left between the latency of a reader and the capacity, so that
+    // the frames being read are not overwritten
+    static const size_t kGuardWrites = 2;
+
+    struct Reader {
+        bool                mUsed;
+        policy_t            mPolicy;
+        uint32_t            mMaxLatency;
+        volatile int32_t    mReadPos;
+        volatile int32_t    mStopped;
+        uint32_t            mStopPos;       // frames written before stopReader()
+        volatile int32_t    mSilence;       // frames of silence left before mReadPos
+        // statistics
+        uint32_t            mDroppedFrames;
+        uint32_t            mOverruns;      // buffers overwritten while being read
+        uint32_t            mTimeouts;      // writer gave up waiting
+    };
+
+                FanOutBuffer(const FanOutBuffer&);
+                FanOutBuffer& operator = (const FanOutBuffer&);
+
+    uint32_t    readLimit(const Reader& r) const;
+
+    const size_t        mFrameSize;
+    const size_t        mWriteFrames;
+    size_t              mCapacity;          // in frames, power of 2
+    int8_t*             mBuffer;
+    int8_t*             mSilenceBuffer;     // mWriteFrames frames of silence
+    volatile int32_t    mWritePos;          // frames written, modulo 2^32
+    volatile int32_t    mWaiting;           // the writer is in waitForReaders()
+    mutable Mutex       mLock;
+    Condition           mCond;
+    Reader              mReaders[kMaxReaders];
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_AUDIO_FAN_OUT_BUFFER_H
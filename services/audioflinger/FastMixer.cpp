@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FastMixer"
+//#define LOG_NDEBUG 0
+
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+
+#include <system/audio.h>
+
+#include "AudioMixer.h"
+#include "FastMixer.h"
+
+namespace android {
+
+// SCHED_FIFO priority of the fast mixer; above the other audio threads, which
+// are SCHED_OTHER at ANDROID_PRIORITY_URGENT_AUDIO
+static const int kFastMixerPriority = 2;
+
+// size of the normal mix FIFO: a power of 2 above what write() lets the
+// normal mixer queue
+static size_t pipeFrameCount(size_t maxQueuedFrames)
+{
+    size_t frames = 1;
+    while (frames < maxQueuedFrames) {
+        frames <<= 1;
+    }
+    return frames;
+}
+
+// ----------------------------------------------------------------------------
+
+FastMixer::NormalSource::NormalSource(size_t frameCount)
+    :   mBuffer(0), mFrameCount(frameCount), mFront(0), mRear(0)
+{
+    ALOG_ASSERT((frameCount & (frameCount - 1)) == 0);
+    mBuffer = new int16_t[frameCount * 2];
+}
+
+FastMixer::NormalSource::~NormalSource()
+{
+    delete[] mBuffer;
+}
+
+status_t FastMixer::NormalSource::getNextBuffer(Buffer* buffer)
+{
+    int32_t front = mFront;
+    size_t avail = (size_t)(android_atomic_acquire_load(&mRear) - front);
+    size_t offset = front & (mFrameCount - 1);
+    size_t frames = buffer->frameCount;
+    if (frames > avail) {
+        frames = avail;
+    }
+    if (frames > mFrameCount - offset) {
+        frames = mFrameCount - offset;
+    }
+    if (frames == 0) {
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+        return NOT_ENOUGH_DATA;
+    }
+    buffer->raw = mBuffer + offset * 2;
+    buffer->frameCount = frames;
+    return NO_ERROR;
+}
+
+void FastMixer::NormalSource::releaseBuffer(Buffer* buffer)
+{
+    android_atomic_release_store(mFront + (int32_t)buffer->frameCount, &mFront);
+    buffer->raw = NULL;
+    buffer->frameCount = 0;
+}
+
+size_t FastMixer::NormalSource::write(const int16_t* buffer, size_t frameCount)
+{
+    int32_t rear = mRear;
+    size_t space = mFrameCount - (size_t)(rear - android_atomic_acquire_load(&mFront));
+    if (frameCount > space) {
+        frameCount = space;
+    }
+    size_t offset = rear & (mFrameCount - 1);
+    size_t part = mFrameCount - offset;
+    if (part > frameCount) {
+        part = frameCount;
+    }
+    memcpy(mBuffer + offset * 2, buffer, part * 2 * sizeof(int16_t));
+    memcpy(mBuffer, buffer + part * 2, (frameCount - part) * 2 * sizeof(int16_t));
+    android_atomic_release_store(rear + (int32_t)frameCount, &mRear);
+    return frameCount;
+}
+
+size_t FastMixer::NormalSource::framesReady() const
+{
+    return (size_t)(android_atomic_acquire_load(&mRear) - android_atomic_acquire_load(&mFront));
+}
+
+// ----------------------------------------------------------------------------
+
+status_t FastMixer::TrackSource::getNextBuffer(Buffer* buffer)
+{
+    return mProvider->getNextBuffer(buffer);
+}
+
+void FastMixer::TrackSource::releaseBuffer(Buffer* buffer)
+{
+    mFrames += buffer->frameCount;
+    mProvider->releaseBuffer(buffer);
+}
+
+// ----------------------------------------------------------------------------
+
+FastMixer::FastMixer(audio_stream_out* output, size_t frameCount, uint32_t sampleRate,
+        size_t normalFrameCount)
+    :   Thread(false),
+        mOutput(output), mFrameCount(frameCount), mSampleRate(sampleRate),
+        // one normal buffer, plus two fast periods of margin for the
+        // scheduling latency of the normal mixer
+        mMaxQueuedFrames(normalFrameCount + 2 * frameCount),
+        mAudioMixer(0), mMixBuffer(0), mNormalSource(pipeFrameCount(mMaxQueuedFrames)),
+        mMiddle(1), mBack(2), mFront(0), mObservedGeneration(0)
+{
+    mAudioMixer = new AudioMixer(frameCount, sampleRate);
+    mMixBuffer = new int16_t[frameCount * 2];
+    memset(mMixBuffer, 0, frameCount * 2 * sizeof(int16_t));
+
+    memset(&mEditState, 0, sizeof(mEditState));
+    mEditState.mCommand = State::IDLE;
+    for (int i = 0; i < 3; i++) {
+        mStates[i] = mEditState;
+    }
+    memset(mCurrentTracks, 0, sizeof(mCurrentTracks));
+    memset(&mStatistics, 0, sizeof(mStatistics));
+    memset((void *)mTrackUnderruns, 0, sizeof(mTrackUnderruns));
+
+    for (int i = 0; i <= kMaxFastTracks; i++) {
+        mNames[i] = mAudioMixer->getTrackName();
+        mAudioMixer->setActiveTrack(mNames[i]);
+        mAudioMixer->setParameter(AudioMixer::TRACK, AudioMixer::MAIN_BUFFER, (void *)mMixBuffer);
+    }
+
+    // the normal mix is always mixed, at unity gain
+    mAudioMixer->setActiveTrack(mNames[kMaxFastTracks]);
+    mAudioMixer->setBufferProvider(&mNormalSource);
+    mAudioMixer->setParameter(AudioMixer::TRACK, AudioMixer::CHANNEL_MASK,
+            (void *)AUDIO_CHANNEL_OUT_STEREO);
+    mAudioMixer->setParameter(AudioMixer::VOLUME, AudioMixer::VOLUME0,
+            (void *)AudioMixer::UNITY_GAIN);
+    mAudioMixer->setParameter(AudioMixer::VOLUME, AudioMixer::VOLUME1,
+            (void *)AudioMixer::UNITY_GAIN);
+    mAudioMixer->enable(AudioMixer::MIXING);
+}
+
+FastMixer::~FastMixer()
+{
+    delete mAudioMixer;
+    delete[] mMixBuffer;
+}
+
+int32_t FastMixer::pushState()
+{
+    mEditState.mGeneration++;
+    mStates[mBack] = mEditState;
+    int32_t old;
+    do {
+        old = mMiddle;
+    } while (android_atomic_release_cas(old, mBack | kDirty, &mMiddle) != 0);
+    mBack = old & ~kDirty;
+
+    Mutex::Autolock _l(mIdleLock);
+    mIdleCond.signal();
+    return mEditState.mGeneration;
+}
+
+int32_t FastMixer::observedGeneration() const
+{
+    return android_atomic_acquire_load(const_cast<volatile int32_t *>(&mObservedGeneration));
+}
+
+FastMixer::State const* FastMixer::pollState()
+{
+    if (android_atomic_acquire_load(&mMiddle) & kDirty) {
+        // only pushState() can change mMiddle, and it always sets kDirty
+        int32_t old;
+        do {
+            old = mMiddle;
+        } while (android_atomic_acquire_cas(old, mFront, &mMiddle) != 0);
+        mFront = old & ~kDirty;
+    }
+    return &mStates[mFront];
+}
+
+void FastMixer::applyState(State const* state)
+{
+    for (int i = 0; i < kMaxFastTracks; i++) {
+        const FastTrack& next = state->mFastTracks[i];
+        FastTrack& current = mCurrentTracks[i];
+        mAudioMixer->setActiveTrack(mNames[i]);
+        if (next.mBufferProvider != current.mBufferProvider ||
+                next.mChannelCount != current.mChannelCount) {
+            mTrackSources[i].mProvider = next.mBufferProvider;
+            if (next.mBufferProvider != NULL) {
+                mAudioMixer->setBufferProvider(&mTrackSources[i]);
+                mAudioMixer->setParameter(AudioMixer::TRACK, AudioMixer::CHANNEL_MASK,
+                        (void *)(next.mChannelCount == 1 ?
+                                AUDIO_CHANNEL_OUT_MONO : AUDIO_CHANNEL_OUT_STEREO));
+                // no ramp for the first volume setting
+                mAudioMixer->setParameter(AudioMixer::VOLUME, AudioMixer::VOLUME0,
+                        (void *)next.mVolume[0]);
+                mAudioMixer->setParameter(AudioMixer::VOLUME, AudioMixer::VOLUME1,
+                        (void *)next.mVolume[1]);
+                mAudioMixer->enable(AudioMixer::MIXING);
+            } else {
+                mAudioMixer->disable(AudioMixer::MIXING);
+            }
+        } else if (next.mBufferProvider != NULL &&
+                (next.mVolume[0] != current.mVolume[0] || next.mVolume[1] != current.mVolume[1])) {
+            mAudioMixer->setParameter(AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME0,
+                    (void *)next.mVolume[0]);
+            mAudioMixer->setParameter(AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME1,
+                    (void *)next.mVolume[1]);
+        }
+        current = next;
+    }
+}
+
+status_t FastMixer::readyToRun()
+{
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = kFastMixerPriority;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+        ALOGW("FastMixer could not switch to SCHED_FIFO: %s", strerror(errno));
+    }
+    return NO_ERROR;
+}
+
+bool FastMixer::threadLoop()
+{
+    const nsecs_t period = seconds(mFrameCount) / mSampleRate;
+    const size_t mixBufferSize = mFrameCount * 2 * sizeof(int16_t);
+    State const* state = NULL;
+    nsecs_t lastStart = 0;
+
+    while (!exitPending()) {
+        State const* next = pollState();
+        if (next != state) {
+            applyState(next);
+            state = next;
+            android_atomic_release_store(state->mGeneration, &mObservedGeneration);
+        }
+        if (state->mCommand == State::EXIT) {
+            break;
+        }
+        if (state->mCommand == State::IDLE) {
+            // pushState() signals after publishing, so checking for a new
+            // state with the lock held cannot miss a wake up
+            Mutex::Autolock _l(mIdleLock);
+            if (!(android_atomic_acquire_load(&mMiddle) & kDirty) && !exitPending()) {
+                ALOGV("FastMixer %p going to sleep", this);
+                mIdleCond.wait(mIdleLock);
+            }
+            lastStart = 0;
+            continue;
+        }
+
+        nsecs_t start = systemTime();
+        if (lastStart != 0) {
+            nsecs_t delta = start - lastStart;
+            Statistics& s = mStatistics;
+            if (s.mCycles == 0 || delta < s.mMinPeriodNs) {
+                s.mMinPeriodNs = delta;
+            }
+            if (delta > s.mMaxPeriodNs) {
+                s.mMaxPeriodNs = delta;
+            }
+            s.mSumPeriodNs += delta;
+            s.mSumSqPeriodNs += (double)delta * delta;
+            if (delta > period + period / 2) {
+                s.mLateCycles++;
+            }
+            s.mCycles++;
+        }
+        lastStart = start;
+
+        size_t ready = mNormalSource.framesReady();
+        if (ready != 0 && ready < mFrameCount) {
+            mStatistics.mUnderruns++;
+        }
+        mAudioMixer->process();
+
+        // fast tracks are not resampled: a track that is not underrunning
+        // supplies one HAL buffer per cycle
+        for (int i = 0; i < kMaxFastTracks; i++) {
+            TrackSource& source = mTrackSources[i];
+            if (mCurrentTracks[i].mBufferProvider != NULL && source.mFrames < mFrameCount) {
+                android_atomic_release_store(mTrackUnderruns[i] + 1, &mTrackUnderruns[i]);
+            }
+            source.mFrames = 0;
+        }
+
+        nsecs_t mixNs = systemTime() - start;
+        if (mixNs > mStatistics.mMaxMixNs) {
+            mStatistics.mMaxMixNs = mixNs;
+        }
+
+        // the HAL write blocks until there is room for one buffer, which sets
+        // the pace of the fast mixer
+        mOutput->write(mOutput, mMixBuffer, mixBufferSize);
+    }
+
+    ALOGV("FastMixer %p exiting", this);
+    return false;
+}
+
+ssize_t FastMixer::write(const int16_t* buffer, size_t frameCount)
+{
+    const uint32_t periodUs = (uint32_t)((mFrameCount * 1000000LL) / mSampleRate);
+    size_t written = 0;
+    while (written < frameCount) {
+        size_t queued = mNormalSource.framesReady();
+        if (queued + frameCount - written <= mMaxQueuedFrames) {
+            written += mNormalSource.write(buffer + written * 2, frameCount - written);
+            continue;
+        }
+        if (mEditState.mCommand != State::MIX) {
+            // nothing is going to drain the FIFO
+            break;
+        }
+        // the fast mixer drains one HAL buffer per period
+        usleep(periodUs / 2);
+    }
+    return written;
+}
+
+void FastMixer::getStatistics(Statistics* stats) const
+{
+    // written by the fast mixer without synchronization: values can be
+    // slightly inconsistent with each other
+    *stats = mStatistics;
+}
+
+uint32_t FastMixer::trackUnderruns(int index) const
+{
+    return (uint32_t)android_atomic_acquire_load(
+            const_cast<volatile int32_t *>(&mTrackUnderruns[index]));
+}
+
+status_t FastMixer::dump(int fd)
+{
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    String8 result;
+    Statistics s;
+    getStatistics(&s);
+
+    double periodMs = (mFrameCount * 1000.0) / mSampleRate;
+    snprintf(buffer, SIZE, "Fast mixer: %u frames (%.2f ms), %u cycles, %u underruns, "
+            "%u late cycles\n", mFrameCount, periodMs, s.mCycles, s.mUnderruns, s.mLateCycles);
+    result.append(buffer);
+    if (s.mCycles != 0) {
+        double mean = s.mSumPeriodNs / s.mCycles;
+        double variance = s.mSumSqPeriodNs / s.mCycles - mean * mean;
+        snprintf(buffer, SIZE, "  wake up period ms: min %.2f mean %.2f max %.2f stddev %.3f, "
+                "max mix %.3f ms\n", s.mMinPeriodNs * 1e-6, mean * 1e-6, s.mMaxPeriodNs * 1e-6,
+                variance > 0 ? sqrt(variance) * 1e-6 : 0.0, s.mMaxMixNs * 1e-6);
+        result.append(buffer);
+    }
+    snprintf(buffer, SIZE, "  normal mix FIFO: %u frames ready\n", mNormalSource.framesReady());
+    result.append(buffer);
+    ::write(fd, result.string(), result.size());
+    return NO_ERROR;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
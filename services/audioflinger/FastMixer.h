@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_FAST_MIXER_H
+#define ANDROID_AUDIO_FAST_MIXER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/threads.h>
+#include <hardware/audio.h>
+
+#include "AudioBufferProvider.h"
+
+namespace android {
+
+class AudioMixer;
+
+// ----------------------------------------------------------------------------
+
+// Low latency mixer thread.
+//
+// The fast mixer owns the output stream of a MixerThread. It wakes up once
+// per HAL buffer, at SCHED_FIFO priority, mixes a small number of fast tracks
+// with the output of the normal mixer and writes the result to the HAL.
+//
+// The fast mixer never takes a lock that the MixerThread or a client can
+// hold while it is mixing:
+//  - the MixerThread describes the fast tracks in a State that it publishes
+//    through a triple buffer; the fast mixer picks up the latest State at the
+//    beginning of each cycle,
+//  - the normal mix is passed through a single reader single writer FIFO,
+//  - fast tracks are read through their AudioBufferProvider, which for
+//    AudioFlinger tracks only reads the control block indices.
+//
+// A track removed from the State can still be in use until the fast mixer
+// has observed that State: see observedGeneration().
+class FastMixer : public Thread {
+public:
+    static const int kMaxFastTracks = 8;
+
+    struct FastTrack {
+        AudioBufferProvider*    mBufferProvider;    // NULL if the slot is unused
+        int                     mChannelCount;
+        int16_t                 mVolume[2];         // 4.12
+    };
+
+    struct State {
+        enum command {
+            IDLE,           // not writing to the HAL, which can be put in standby
+            MIX,            // mixing and writing to the HAL
+            EXIT
+        };
+        command                 mCommand;
+        FastTrack               mFastTracks[kMaxFastTracks];
+        int32_t                 mGeneration;        // set by pushState()
+    };
+
+    // Timing statistics for dumpsys. Written by the fast mixer only.
+    struct Statistics {
+        uint32_t                mCycles;
+        uint32_t                mUnderruns;         // normal mix only partly available
+        uint32_t                mLateCycles;        // started over half a period late
+        nsecs_t                 mMinPeriodNs;
+        nsecs_t                 mMaxPeriodNs;
+        double                  mSumPeriodNs;
+        double                  mSumSqPeriodNs;
+        nsecs_t                 mMaxMixNs;
+    };
+
+    // frameCount is the HAL buffer size; normalFrameCount is the size of the
+    // buffers written by the normal mixer.
+    FastMixer(audio_stream_out* output, size_t frameCount, uint32_t sampleRate,
+            size_t normalFrameCount);
+    virtual ~FastMixer();
+
+    // The state being edited by the MixerThread. Changes are not seen by the
+    // fast mixer until pushState() is called.
+    State*      editState() { return &mEditState; }
+    // Publishes the edited state and returns its generation.
+    int32_t     pushState();
+    // The generation of the last state applied by the fast mixer.
+    int32_t     observedGeneration() const;
+
+    // Queues frameCount frames of the normal mix, blocking while the FIFO
+    // holds more than maxQueuedFrames() - frameCount frames.
+    ssize_t     write(const int16_t* buffer, size_t frameCount);
+
+    size_t      frameCount() const { return mFrameCount; }
+    // Upper bound of the latency added to the normal mix by the FIFO.
+    size_t      maxQueuedFrames() const { return mMaxQueuedFrames; }
+    void        getStatistics(Statistics* stats) const;
+    // Cycles where the track in slot index supplied less than a full buffer,
+    // counted by the fast mixer since it was created, whichever track was in
+    // the slot.
+    uint32_t    trackUnderruns(int index) const;
+    status_t    dump(int fd);
+
+private:
+    // Thread virtuals
+    virtual     status_t    readyToRun();
+    virtual     bool        threadLoop();
+
+    // FIFO of the normal mix, mixed as one more track of the fast mixer
+    class NormalSource : public AudioBufferProvider {
+    public:
+        NormalSource(size_t frameCount);
+        virtual ~NormalSource();
+        virtual status_t getNextBuffer(Buffer* buffer);
+        virtual void releaseBuffer(Buffer* buffer);
+        size_t write(const int16_t* buffer, size_t frameCount);
+        size_t framesReady() const;
+    private:
+        int16_t*            mBuffer;
+        const size_t        mFrameCount;    // a power of 2
+        volatile int32_t    mFront;         // frames read, updated by the reader only
+        volatile int32_t    mRear;          // frames written, updated by the writer only
+    };
+
+    // Forwards to the provider of a fast track, and counts the frames it
+    // supplied during the cycle
+    class TrackSource : public AudioBufferProvider {
+    public:
+        TrackSource() : mProvider(NULL), mFrames(0) {}
+        virtual status_t getNextBuffer(Buffer* buffer);
+        virtual void releaseBuffer(Buffer* buffer);
+        AudioBufferProvider* mProvider;
+        size_t              mFrames;
+    };
+
+    State const* pollState();
+    void        applyState(State const* state);
+
+    audio_stream_out*       mOutput;
+    const size_t            mFrameCount;
+    const uint32_t          mSampleRate;
+    const size_t            mMaxQueuedFrames;
+    AudioMixer*             mAudioMixer;
+    int16_t*                mMixBuffer;
+    NormalSource            mNormalSource;
+    int                     mNames[kMaxFastTracks + 1];
+
+    // triple buffered state: mEditState is copied to mStates[mBack] and
+    // swapped with mMiddle by pushState(); pollState() swaps mFront with
+    // mMiddle if it was updated
+    static const int32_t    kDirty = 0x100;
+    State                   mEditState;
+    State                   mStates[3];
+    volatile int32_t        mMiddle;
+    int32_t                 mBack;          // writer only
+    int32_t                 mFront;         // reader only
+    FastTrack               mCurrentTracks[kMaxFastTracks];     // reader only
+    volatile int32_t        mObservedGeneration;
+
+    // only used to wake up the fast mixer when it is idle
+    Mutex                   mIdleLock;
+    Condition               mIdleCond;
+
+    Statistics              mStatistics;
+    TrackSource             mTrackSources[kMaxFastTracks];      // reader only
+    volatile int32_t        mTrackUnderruns[kMaxFastTracks];
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_AUDIO_FAST_MIXER_H
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <utils/String8.h>
+
+#include "PlaybackStatistics.h"
+
+namespace android {
+
+// <0.5, <0.75, <1.25, <1.5, <2, <3, <5, <10 and >=10 periods
+const uint32_t PlaybackStatistics::kBucketQuarters[kNumBuckets - 1] = {
+    2, 3, 5, 6, 8, 12, 20, 40
+};
+
+void PlaybackStatistics::Sample::add(nsecs_t ns)
+{
+    mCount++;
+    mSumNs += ns;
+    if (ns > mMaxNs) {
+        mMaxNs = ns;
+    }
+}
+
+void PlaybackStatistics::Sample::dump(String8& result, const char* name) const
+{
+    const size_t SIZE = 128;
+    char buffer[SIZE];
+    snprintf(buffer, SIZE, "  %-6s ms: mean %.3f max %.3f (%u)\n", name,
+            mCount ? mSumNs / mCount * 1e-6 : 0.0, mMaxNs * 1e-6, mCount);
+    result.append(buffer);
+}
+
+// ----------------------------------------------------------------------------
+
+PlaybackStatistics::PlaybackStatistics()
+{
+    reset(0);
+}
+
+void PlaybackStatistics::reset(nsecs_t periodNs)
+{
+    mPeriodNs = periodNs;
+    memset(&mMix, 0, sizeof(mMix));
+    memset(&mWrite, 0, sizeof(mWrite));
+    memset(&mSleep, 0, sizeof(mSleep));
+    mLastWriteNs = 0;
+    memset(mHistogram, 0, sizeof(mHistogram));
+}
+
+void PlaybackStatistics::addMix(nsecs_t ns)
+{
+    mMix.add(ns);
+}
+
+void PlaybackStatistics::addWrite(nsecs_t start, nsecs_t end)
+{
+    mWrite.add(end - start);
+    if (mLastWriteNs != 0 && mPeriodNs > 0) {
+        nsecs_t quarters = ((start - mLastWriteNs) * 4) / mPeriodNs;
+        int i = 0;
+        while (i < kNumBuckets - 1 && quarters >= (nsecs_t)kBucketQuarters[i]) {
+            i++;
+        }
+        mHistogram[i]++;
+    }
+    mLastWriteNs = start;
+}
+
+void PlaybackStatistics::addSleep(nsecs_t ns)
+{
+    mSleep.add(ns);
+}
+
+void PlaybackStatistics::dump(String8& result) const
+{
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+
+    snprintf(buffer, SIZE, "Cycle statistics (period %.2f ms):\n", mPeriodNs * 1e-6);
+    result.append(buffer);
+    mMix.dump(result, "mix");
+    mWrite.dump(result, "write");
+    mSleep.dump(result, "sleep");
+    result.append("  periods between writes:");
+    uint32_t lower = 0;
+    for (int i = 0; i < kNumBuckets; i++) {
+        if (i < kNumBuckets - 1) {
+            snprintf(buffer, SIZE, " [%.2f-%.2f) %u", lower / 4.0, kBucketQuarters[i] / 4.0,
+                    mHistogram[i]);
+            lower = kBucketQuarters[i];
+        } else {
+            snprintf(buffer, SIZE, " >=%.2f %u", lower / 4.0, mHistogram[i]);
+        }
+        result.append(buffer);
+    }
+    result.append("\n");
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
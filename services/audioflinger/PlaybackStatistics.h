@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_PLAYBACK_STATISTICS_H
+#define ANDROID_AUDIO_PLAYBACK_STATISTICS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Timers.h>
+
+namespace android {
+
+class String8;
+
+// ----------------------------------------------------------------------------
+
+// Cycle statistics of a playback thread: time spent mixing, writing to the
+// HAL and sleeping, and a histogram of the time between the start of two
+// consecutive writes, in units of the nominal period of the thread.
+// Only used by the playback thread itself; dump() can read torn values.
+class PlaybackStatistics {
+public:
+    PlaybackStatistics();
+
+    // Clears the statistics and sets the nominal time between writes.
+    void        reset(nsecs_t periodNs);
+
+    // time from the beginning of the cycle to the start of the write
+    void        addMix(nsecs_t ns);
+    // start and end of a write to the HAL
+    void        addWrite(nsecs_t start, nsecs_t end);
+    void        addSleep(nsecs_t ns);
+
+    void        dump(String8& result) const;
+
+private:
+    struct Sample {
+        uint32_t    mCount;
+        double      mSumNs;
+        nsecs_t     mMaxNs;
+
+        void        add(nsecs_t ns);
+        void        dump(String8& result, const char* name) const;
+    };
+
+    // upper bounds of the write interval histogram buckets in quarters of
+    // the period, the last bucket being unbounded
+    static const int kNumBuckets = 9;
+    static const uint32_t kBucketQuarters[kNumBuckets - 1];
+
+    nsecs_t     mPeriodNs;
+    Sample      mMix;
+    Sample      mWrite;
+    Sample      mSleep;
+    nsecs_t     mLastWriteNs;
+    uint32_t    mHistogram[kNumBuckets];
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_AUDIO_PLAYBACK_STATISTICS_H
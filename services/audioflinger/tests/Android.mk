@@ -0,0 +1,142 @@
+# Build the manual test programs.
+LOCAL_PATH:= $(call my-dir)
+
+# Mixer benchmark and scalar/vector bit-exactness check, run on the host.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    mixer_bench.cpp             \
+    ../AudioMixer.cpp           \
+    ../AudioMixerSimd.cpp       \
+    ../AudioResampler.cpp       \
+    ../AudioResamplerSinc.cpp   \
+    ../AudioResamplerCubic.cpp  \
+    ../AudioResamplerPolyphase.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/..
+
+LOCAL_STATIC_LIBRARIES := \
+    libutils \
+    libcutils
+
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MODULE:= audioflinger_mixer_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# THD+N comparison of the integer and float mixer pipelines, run on the host.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    mixer_thdn.cpp              \
+    ../AudioMixer.cpp           \
+    ../AudioMixerSimd.cpp       \
+    ../AudioResampler.cpp       \
+    ../AudioResamplerSinc.cpp   \
+    ../AudioResamplerCubic.cpp  \
+    ../AudioResamplerPolyphase.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/..
+
+LOCAL_STATIC_LIBRARIES := \
+    libutils \
+    libcutils
+
+LOCAL_LDLIBS := -lpthread -lrt -lm
+
+LOCAL_MODULE:= audioflinger_mixer_thdn
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Resampler benchmark and SNR comparison, run on the host.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    resampler_bench.cpp         \
+    ../AudioResampler.cpp       \
+    ../AudioResamplerSinc.cpp   \
+    ../AudioResamplerCubic.cpp  \
+    ../AudioResamplerPolyphase.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/..
+
+LOCAL_STATIC_LIBRARIES := \
+    libutils \
+    libcutils
+
+LOCAL_LDLIBS := -lpthread -lrt -lm
+
+LOCAL_MODULE:= audioflinger_resampler_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Wake up jitter and latency of the fast mixer with a null output, run on the host.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    fast_mixer_test.cpp         \
+    ../FastMixer.cpp            \
+    ../AudioMixer.cpp           \
+    ../AudioMixerSimd.cpp       \
+    ../AudioResampler.cpp       \
+    ../AudioResamplerSinc.cpp   \
+    ../AudioResamplerCubic.cpp  \
+    ../AudioResamplerPolyphase.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/..
+
+LOCAL_STATIC_LIBRARIES := \
+    libutils \
+    libcutils
+
+LOCAL_LDLIBS := -lpthread -lrt -lm
+
+LOCAL_MODULE:= audioflinger_fast_mixer_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Duplicating thread fan out to null outputs, run on the host.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    fan_out_test.cpp            \
+    ../FanOutBuffer.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/..
+
+LOCAL_STATIC_LIBRARIES := \
+    libutils \
+    libcutils
+
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MODULE:= audioflinger_fan_out_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Cross process stress test and wake up latency of the track control block.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=               \
+    cblk_test.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libmedia \
+    libutils \
+    libcutils
+
+LOCAL_MODULE:= audioflinger_cblk_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
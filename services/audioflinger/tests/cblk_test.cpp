@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Cross process stress test and wake up latency benchmark of the
+// audio_track_cblk_t protocol.
+//
+// A control block and its buffer are placed in shared memory. The parent
+// process plays the client and writes a running frame counter into the
+// buffer, in chunks of random size, waiting for the server when the buffer is
+// full. The child process plays the server: it consumes random chunks,
+// checks that the counter has no gap, and sleeps a random time between
+// steps so that the client has to block.
+// The test reports the time from a server step to the client waking up, and
+// the time spent by the server in stepServer(). With -c the client waits on
+// the shared condition, as before the futex wake up was introduced.
+// Exits with a non zero status if a frame was lost or corrupted.
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+#include <private/media/AudioTrackShared.h>
+
+using namespace android;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct Stats {
+    uint32_t n;
+    double sum;
+    int64_t max;
+    void add(int64_t v) { n++; sum += v; if (v > max) max = v; }
+    double mean() const { return n ? sum / n : 0.0; }
+};
+
+// shared between the two processes, followed by the control block and buffer
+struct Shared {
+    volatile int32_t lastStepUs;    // time of the last server step, see elapsedUs()
+    int64_t start;
+    volatile int32_t errors;
+    Stats step;                     // written by the server
+    Stats wake;                     // written by the client
+    uint32_t waits;
+
+    int32_t elapsedUs(int64_t t) const {
+        return (int32_t)((t - start) / 1000);
+    }
+};
+
+static void server(Shared* shared, audio_track_cblk_t* cblk, uint32_t totalFrames,
+        bool condition) {
+    uint32_t expected = 0;
+    srand(getpid());
+    while (expected < totalFrames) {
+        uint32_t ready = cblk->framesReady();
+        if (ready == 0) {
+            usleep(100);
+            continue;
+        }
+        uint32_t frames = 1 + rand() % cblk->frameCount;
+        if (frames > ready) {
+            frames = ready;
+        }
+        uint32_t s = cblk->server;
+        uint32_t bufferEnd = cblk->serverBase + cblk->frameCount;
+        if (s + frames > bufferEnd) {
+            frames = bufferEnd - s;
+        }
+        const uint32_t* data = (const uint32_t*)((int8_t *)cblk->buffers +
+                (s - cblk->serverBase) * cblk->frameSize);
+        for (uint32_t i = 0; i < frames; i++) {
+            if (data[i] != expected) {
+                if (android_atomic_inc(&shared->errors) < 10) {
+                    fprintf(stderr, "frame %u: got %u\n", expected, data[i]);
+                }
+                expected = data[i];
+            }
+            expected++;
+        }
+
+        android_atomic_release_store(shared->elapsedUs(nowNs()), &shared->lastStepUs);
+        int64_t start = nowNs();
+        while (!cblk->stepServer(frames)) {
+            usleep(1000);
+        }
+        if (condition) {
+            cblk->lock.lock();
+            cblk->cv.signal();
+            cblk->lock.unlock();
+        }
+        shared->step.add(nowNs() - start);
+
+        // let the buffer fill up so that the client blocks
+        if (rand() % 4 == 0) {
+            usleep(rand() % 2000);
+        }
+    }
+}
+
+static void client(Shared* shared, audio_track_cblk_t* cblk, uint32_t totalFrames,
+        bool condition) {
+    uint32_t counter = 0;
+    srand(getpid());
+    while (counter < totalFrames) {
+        uint32_t avail = cblk->framesAvailable();
+        if (avail == 0) {
+            shared->waits++;
+            if (condition) {
+                cblk->lock.lock();
+                while ((avail = cblk->framesAvailable_l()) == 0) {
+                    cblk->cv.waitRelative(cblk->lock, milliseconds(1000));
+                }
+                cblk->lock.unlock();
+            } else {
+                do {
+                    int32_t sequence = cblk->prepareWait();
+                    avail = cblk->framesAvailable();
+                    if (avail == 0) {
+                        cblk->waitServer(sequence, 1000);
+                        avail = cblk->framesAvailable();
+                    } else {
+                        cblk->cancelWait();
+                    }
+                } while (avail == 0);
+            }
+            int32_t t = android_atomic_acquire_load(&shared->lastStepUs);
+            shared->wake.add(shared->elapsedUs(nowNs()) - t);
+        }
+        uint32_t frames = 1 + rand() % cblk->frameCount;
+        if (frames > avail) {
+            frames = avail;
+        }
+        if (frames > totalFrames - counter) {
+            frames = totalFrames - counter;
+        }
+        uint32_t u = cblk->user;
+        uint32_t bufferEnd = cblk->userBase + cblk->frameCount;
+        if (u + frames > bufferEnd) {
+            frames = bufferEnd - u;
+        }
+        uint32_t* data = (uint32_t*)cblk->buffer(u);
+        for (uint32_t i = 0; i < frames; i++) {
+            data[i] = counter++;
+        }
+        cblk->stepUser(frames);
+    }
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -f frames in the buffer (default 1024)\n");
+    fprintf(stderr, "       -n frames to transfer (default 2000000)\n");
+    fprintf(stderr, "       -c wait on the shared condition instead of the futex\n");
+}
+
+int main(int argc, char **argv) {
+    uint32_t frameCount = 1024;
+    uint32_t totalFrames = 2000000;
+    bool condition = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "hf:n:c")) >= 0) {
+        switch (res) {
+            case 'f':
+                frameCount = atoi(optarg);
+                break;
+            case 'n':
+                totalFrames = atoi(optarg);
+                break;
+            case 'c':
+                condition = true;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (frameCount == 0 || totalFrames == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t size = sizeof(Shared) + sizeof(audio_track_cblk_t) + frameCount * sizeof(uint32_t);
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(mem, 0, size);
+    Shared* shared = (Shared*)mem;
+    shared->start = nowNs();
+    audio_track_cblk_t* cblk = new(shared + 1) audio_track_cblk_t();
+    cblk->frameCount = frameCount;
+    cblk->frameSize = sizeof(uint32_t);
+    cblk->buffers = (char*)cblk + sizeof(audio_track_cblk_t);
+    cblk->bufferTimeoutMs = MAX_RUN_TIMEOUT_MS;
+    android_atomic_or(CBLK_DIRECTION_OUT, &cblk->flags);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        server(shared, cblk, totalFrames, condition);
+        _exit(0);
+    }
+    int64_t start = nowNs();
+    client(shared, cblk, totalFrames, condition);
+    int status;
+    waitpid(pid, &status, 0);
+    double seconds = (nowNs() - start) * 1e-9;
+
+    printf("%u frames through a %u frame buffer in %.2f s, client wait: %s\n",
+            totalFrames, frameCount, seconds, condition ? "condition" : "futex");
+    printf("client waits %u, wake up latency us: mean %.1f max %lld\n",
+            shared->waits, shared->wake.mean(), shared->wake.max);
+    printf("stepServer ns: mean %.0f max %lld over %u steps\n",
+            shared->step.mean(), shared->step.max, shared->step.n);
+
+    int result = 0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("FAIL: server exited abnormally\n");
+        result = 1;
+    }
+    if (shared->errors != 0) {
+        printf("FAIL: %d frames lost or corrupted\n", shared->errors);
+        result = 1;
+    }
+    printf(result ? "FAILED\n" : "PASSED\n");
+    return result;
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Duplicating thread fan out with null outputs, run on the host.
+//
+// A writer thread plays the DuplicatingThread: it writes a running frame
+// counter into a FanOutBuffer, one mix buffer at a time, after waiting for
+// the readers with POLICY_WAIT. Reader threads play the output threads:
+// the main output consumes one HAL buffer per period, the second output
+// does too but stalls now and then, like a remote sink on a bad link.
+//
+// The test reports the CPU time of the writer per mix buffer, how long it
+// was held up by the readers, and the latency of each output from the write
+// of a frame to its read. With -b the stalling output has POLICY_WAIT too,
+// which shows the stalls holding up the main output, as when the mix was
+// copied into each OutputTrack.
+// Exits with a non zero status if the main output underran or lost frames,
+// or if an output read corrupted frames.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <utils/String8.h>
+
+#include "FanOutBuffer.h"
+
+using namespace android;
+
+static const uint32_t kSampleRate = 48000;
+static const uint32_t kMixFrames = 1024;        // DuplicatingThread buffer
+static const uint32_t kHalFrames = 256;         // output thread buffer
+static const uint32_t kLatencyFrames = 3 * kMixFrames;
+static const uint32_t kMaxWrites = 1 << 16;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t cpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct Stats {
+    uint32_t n;
+    double sum;
+    int64_t max;
+    void add(int64_t v) { n++; sum += v; if (v > max) max = v; }
+    double mean() const { return n ? sum / n : 0.0; }
+};
+
+struct Test {
+    sp<FanOutBuffer> fanOut;
+    uint32_t writes;
+    volatile bool done;
+    int64_t writeTimeNs[kMaxWrites];    // when each mix buffer was written
+    Stats writeCpu;
+    Stats wait;
+};
+
+struct Output {
+    Test* test;
+    const char* name;
+    int reader;
+    bool stalls;
+    Stats latency;
+    uint32_t frames;
+    uint32_t lostFrames;
+    uint32_t corruptFrames;
+    uint32_t underruns;
+    uint32_t stallCount;
+};
+
+static void* writerLoop(void* arg) {
+    Test* test = (Test*)arg;
+    uint32_t mix[kMixFrames];
+    uint32_t counter = 0;
+    for (uint32_t n = 0; n < test->writes; n++) {
+        for (uint32_t i = 0; i < kMixFrames; i++) {
+            mix[i] = counter++;
+        }
+        int64_t start = nowNs();
+        test->fanOut->waitForReaders(kMixFrames, 3 * kMixFrames * 1000 / kSampleRate);
+        test->wait.add(nowNs() - start);
+        test->writeTimeNs[n] = nowNs();
+        int64_t cpu = cpuTimeNs();
+        test->fanOut->write(mix, kMixFrames);
+        test->writeCpu.add(cpuTimeNs() - cpu);
+    }
+    test->done = true;
+    return NULL;
+}
+
+static void* outputLoop(void* arg) {
+    Output* output = (Output*)arg;
+    Test* test = output->test;
+    const int64_t periodNs = (kHalFrames * 1000000000LL) / kSampleRate;
+    int64_t next = nowNs();
+    int64_t expected = -1;
+    unsigned int seed = output->reader;
+    while (!test->done || output->test->fanOut->framesReady(output->reader) != 0) {
+        // a null output: consume one HAL buffer per period
+        uint32_t frames = kHalFrames;
+        while (frames != 0) {
+            AudioBufferProvider::Buffer buffer;
+            buffer.frameCount = frames;
+            if (test->fanOut->getNextBuffer(output->reader, &buffer) != NO_ERROR) {
+                break;
+            }
+            const uint32_t* data = (const uint32_t*)buffer.raw;
+            int64_t now = nowNs();
+            for (uint32_t i = 0; i < buffer.frameCount; i++) {
+                if (expected < 0) {
+                    // silence played at start
+                    if (data[i] == 0) {
+                        continue;
+                    }
+                    expected = data[i];
+                }
+                if (data[i] < expected) {
+                    output->corruptFrames++;
+                } else if (data[i] > expected) {
+                    output->lostFrames += data[i] - expected;
+                }
+                expected = data[i] + 1;
+            }
+            if (expected > 0 && buffer.frameCount != 0) {
+                uint32_t last = data[buffer.frameCount - 1];
+                output->latency.add(now - test->writeTimeNs[last / kMixFrames]);
+            }
+            output->frames += buffer.frameCount;
+            frames -= buffer.frameCount;
+            test->fanOut->releaseBuffer(output->reader, &buffer);
+        }
+        if (frames != 0 && !test->done) {
+            output->underruns++;
+        }
+        next += periodNs;
+        if (output->stalls && rand_r(&seed) % 200 == 0) {
+            // the output is late by up to 200 ms, then catches up
+            next += (rand_r(&seed) % 200) * 1000000LL;
+            output->stallCount++;
+        }
+        int64_t delay = next - nowNs();
+        if (delay > 0) {
+            struct timespec ts;
+            ts.tv_sec = delay / 1000000000LL;
+            ts.tv_nsec = delay % 1000000000LL;
+            nanosleep(&ts, NULL);
+        } else if (delay < -periodNs * 4) {
+            next = nowNs();
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -n mix buffers to write (default 500)\n");
+    fprintf(stderr, "       -b the stalling output blocks the writer\n");
+}
+
+int main(int argc, char **argv) {
+    uint32_t writes = 500;
+    bool block = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:b")) >= 0) {
+        switch (res) {
+            case 'n':
+                writes = atoi(optarg);
+                break;
+            case 'b':
+                block = true;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (writes == 0 || writes > kMaxWrites) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Test* test = new Test();
+    test->fanOut = new FanOutBuffer(sizeof(uint32_t), kMixFrames);
+    test->writes = writes;
+
+    Output outputs[2];
+    memset(outputs, 0, sizeof(outputs));
+    outputs[0].name = "main";
+    outputs[0].reader = test->fanOut->addReader(FanOutBuffer::POLICY_WAIT, kLatencyFrames);
+    outputs[1].name = "remote";
+    outputs[1].stalls = true;
+    outputs[1].reader = test->fanOut->addReader(
+            block ? FanOutBuffer::POLICY_WAIT : FanOutBuffer::POLICY_DROP, kLatencyFrames);
+
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++) {
+        outputs[i].test = test;
+        test->fanOut->startReader(outputs[i].reader, kLatencyFrames - kMixFrames);
+        pthread_create(&threads[i], NULL, outputLoop, &outputs[i]);
+    }
+    int64_t start = nowNs();
+    writerLoop(test);
+    for (int i = 0; i < 2; i++) {
+        test->fanOut->stopReader(outputs[i].reader);
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = (nowNs() - start) * 1e-9;
+
+    printf("%u mix buffers of %u frames in %.2f s (%.2f s of audio), remote output %s\n",
+            writes, kMixFrames, seconds, (double)writes * kMixFrames / kSampleRate,
+            block ? "blocks" : "drops");
+    printf("writer: write cpu ns mean %.0f max %lld, wait ms mean %.2f max %.2f\n",
+            test->writeCpu.mean(), test->writeCpu.max,
+            test->wait.mean() * 1e-6, test->wait.max * 1e-6);
+
+    int result = 0;
+    for (int i = 0; i < 2; i++) {
+        const Output& o = outputs[i];
+        printf("%-6s: %u frames, latency ms mean %.2f max %.2f, %u stalls, %u underruns, "
+                "%u lost, %u corrupt\n",
+                o.name, o.frames, o.latency.mean() * 1e-6, o.latency.max * 1e-6, o.stallCount,
+                o.underruns, o.lostFrames, o.corruptFrames);
+        if (o.corruptFrames != 0) {
+            printf("FAIL: %s output read corrupted frames\n", o.name);
+            result = 1;
+        }
+    }
+    if (!block && (outputs[0].lostFrames != 0 || outputs[0].underruns != 0)) {
+        printf("FAIL: main output underran or lost frames\n");
+        result = 1;
+    }
+    String8 dump;
+    test->fanOut->dump(dump);
+    printf("%s", dump.string());
+
+    test->fanOut = NULL;
+    delete test;
+    printf(result ? "FAILED\n" : "PASSED\n");
+    return result;
+}
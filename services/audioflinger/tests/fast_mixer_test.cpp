@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Wake up jitter and mixing latency of the FastMixer, run on the host.
+//
+// The fast mixer writes to a null output stream whose write() blocks until
+// the next period, like an audio HAL. The test measures:
+//  - the wake up period statistics of the fast mixer,
+//  - the time from a fast track impulse becoming available to the output
+//    write containing it,
+//  - the same for an impulse written by the normal mixer through the FIFO.
+// A second fast track never has data, and must underrun on every cycle while
+// the impulse track never does.
+// Exits with a non zero status if a fast track impulse takes more than three
+// HAL periods to reach the output, or if the fast track underruns are wrong.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+#include <hardware/audio.h>
+
+#include "AudioMixer.h"
+#include "FastMixer.h"
+
+using namespace android;
+
+static const int16_t kImpulse = 0x4000;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Output stream consuming one buffer per period, and reporting when an
+// impulse is written on either channel.
+struct NullOutput {
+    audio_stream_out stream;    // must be first
+    int64_t periodNs;
+    int64_t deadline;
+    volatile int32_t impulseTime[2];    // time of the last impulse per channel, see elapsedUs()
+    int64_t start;
+
+    NullOutput(size_t frameCount, uint32_t sampleRate) {
+        memset(&stream, 0, sizeof(stream));
+        stream.write = writeHook;
+        periodNs = (frameCount * 1000000000LL) / sampleRate;
+        deadline = 0;
+        start = nowNs();
+        impulseTime[0] = impulseTime[1] = -1;
+    }
+
+    // microseconds since the start of the test
+    int32_t elapsedUs(int64_t t) const {
+        return (int32_t)((t - start) / 1000);
+    }
+
+    static ssize_t writeHook(audio_stream_out* stream, const void* buffer, size_t bytes) {
+        NullOutput* self = (NullOutput*)stream;
+        int64_t now = nowNs();
+        const int16_t* samples = (const int16_t*)buffer;
+        for (size_t i = 0; i < bytes / sizeof(int16_t); i++) {
+            if (samples[i] == kImpulse) {
+                android_atomic_release_store(self->elapsedUs(now), &self->impulseTime[i & 1]);
+            }
+        }
+        // block until the previous buffer has been played
+        if (self->deadline == 0 || self->deadline < now - self->periodNs) {
+            self->deadline = now;
+        }
+        self->deadline += self->periodNs;
+        struct timespec ts;
+        ts.tv_sec = self->deadline / 1000000000LL;
+        ts.tv_nsec = self->deadline % 1000000000LL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        return bytes;
+    }
+};
+
+// Fast track producing silence, and a single impulse on the right channel
+// once armed.
+class ImpulseProvider : public AudioBufferProvider {
+public:
+    ImpulseProvider(size_t frameCount) : mFrameCount(frameCount), mArmed(0) {
+        mBuffer = new int16_t[frameCount * 2];
+        memset(mBuffer, 0, frameCount * 2 * sizeof(int16_t));
+    }
+    virtual ~ImpulseProvider() {
+        delete[] mBuffer;
+    }
+
+    // the impulse is available to the mixer from now on
+    void arm() {
+        android_atomic_release_store(1, &mArmed);
+    }
+
+    virtual status_t getNextBuffer(Buffer* buffer) {
+        size_t frames = buffer->frameCount;
+        if (frames > mFrameCount) {
+            frames = mFrameCount;
+        }
+        mBuffer[1] = android_atomic_acquire_cas(1, 2, &mArmed) == 0 ? kImpulse : 0;
+        buffer->raw = mBuffer;
+        buffer->frameCount = frames;
+        return NO_ERROR;
+    }
+
+    virtual void releaseBuffer(Buffer* buffer) {
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+    }
+
+private:
+    int16_t* mBuffer;
+    size_t mFrameCount;
+    volatile int32_t mArmed;
+};
+
+// Fast track whose client never writes.
+class StarvedProvider : public AudioBufferProvider {
+public:
+    virtual status_t getNextBuffer(Buffer* buffer) {
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+        return NOT_ENOUGH_DATA;
+    }
+
+    virtual void releaseBuffer(Buffer* buffer) {
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+    }
+};
+
+struct LatencyStats {
+    int n;
+    double sum;
+    double max;
+    void add(double v) { n++; sum += v; if (v > max) max = v; }
+};
+
+// Waits for an impulse to show up on the given channel and returns its
+// latency in ms, or a negative value on time out.
+static double waitImpulse(NullOutput& output, int channel, int64_t armedTime) {
+    int32_t armedUs = output.elapsedUs(armedTime);
+    for (int i = 0; i < 1000; i++) {
+        int32_t t = android_atomic_acquire_load(&output.impulseTime[channel]);
+        if (t >= armedUs) {
+            return (t - armedUs) / 1000.0;
+        }
+        usleep(500);
+    }
+    return -1;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -f frames per HAL buffer (default 240)\n");
+    fprintf(stderr, "       -n normal mixer buffers per HAL buffer (default 4)\n");
+    fprintf(stderr, "       -i impulses (default 50)\n");
+}
+
+int main(int argc, char **argv) {
+    size_t frameCount = 240;
+    size_t multiple = 4;
+    int impulses = 50;
+    const uint32_t sampleRate = 48000;
+
+    int res;
+    while ((res = getopt(argc, argv, "hf:n:i:")) >= 0) {
+        switch (res) {
+            case 'f':
+                frameCount = atoi(optarg);
+                break;
+            case 'n':
+                multiple = atoi(optarg);
+                break;
+            case 'i':
+                impulses = atoi(optarg);
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (frameCount == 0 || multiple == 0 || impulses <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const size_t normalFrameCount = frameCount * multiple;
+    const double periodMs = (frameCount * 1000.0) / sampleRate;
+    NullOutput output(frameCount, sampleRate);
+    ImpulseProvider provider(frameCount);
+    StarvedProvider starved;
+
+    sp<FastMixer> fastMixer = new FastMixer(&output.stream, frameCount, sampleRate,
+            normalFrameCount);
+    fastMixer->run("FastMixer", ANDROID_PRIORITY_URGENT_AUDIO);
+
+    FastMixer::State* state = fastMixer->editState();
+    state->mFastTracks[0].mBufferProvider = &provider;
+    state->mFastTracks[0].mChannelCount = 2;
+    state->mFastTracks[0].mVolume[0] = AudioMixer::UNITY_GAIN;
+    state->mFastTracks[0].mVolume[1] = AudioMixer::UNITY_GAIN;
+    state->mFastTracks[1].mBufferProvider = &starved;
+    state->mFastTracks[1].mChannelCount = 2;
+    state->mCommand = FastMixer::State::MIX;
+    fastMixer->pushState();
+
+    // fast track path
+    LatencyStats fast;
+    memset(&fast, 0, sizeof(fast));
+    for (int i = 0; i < impulses; i++) {
+        // do not align the impulses with the fast mixer period
+        usleep(10000 + (rand() % 1000) * 10);
+        int64_t armed = nowNs();
+        provider.arm();
+        double ms = waitImpulse(output, 1, armed);
+        if (ms >= 0) {
+            fast.add(ms);
+        }
+    }
+
+    // normal mixer path: the impulse is queued behind what is in the FIFO
+    LatencyStats normal;
+    memset(&normal, 0, sizeof(normal));
+    int16_t* buffer = new int16_t[normalFrameCount * 2];
+    for (int i = 0; i < impulses; i++) {
+        memset(buffer, 0, normalFrameCount * 2 * sizeof(int16_t));
+        for (int j = 0; j < 4; j++) {
+            fastMixer->write(buffer, normalFrameCount);
+        }
+        buffer[0] = kImpulse;
+        int64_t written = nowNs();
+        fastMixer->write(buffer, normalFrameCount);
+        // keep the FIFO fed while waiting, like the normal mixer does
+        buffer[0] = 0;
+        double ms = -1;
+        for (int j = 0; j < 8 && ms < 0; j++) {
+            fastMixer->write(buffer, normalFrameCount);
+            int32_t t = android_atomic_acquire_load(&output.impulseTime[0]);
+            if (t >= output.elapsedUs(written)) {
+                ms = (t - output.elapsedUs(written)) / 1000.0;
+            }
+        }
+        if (ms >= 0) {
+            normal.add(ms);
+        }
+    }
+    delete[] buffer;
+
+    state->mCommand = FastMixer::State::EXIT;
+    fastMixer->pushState();
+    fastMixer->requestExitAndWait();
+
+    FastMixer::Statistics s;
+    fastMixer->getStatistics(&s);
+    double mean = s.mCycles ? s.mSumPeriodNs / s.mCycles : 0;
+    double variance = s.mCycles ? s.mSumSqPeriodNs / s.mCycles - mean * mean : 0;
+
+    printf("HAL buffer %u frames (%.2f ms), normal buffer %u frames, FIFO up to %u frames\n",
+            frameCount, periodMs, normalFrameCount, fastMixer->maxQueuedFrames());
+    printf("wake up period ms: min %.3f mean %.3f max %.3f stddev %.3f, %u late of %u cycles\n",
+            s.mMinPeriodNs * 1e-6, mean * 1e-6, s.mMaxPeriodNs * 1e-6,
+            variance > 0 ? sqrt(variance) * 1e-6 : 0.0, s.mLateCycles, s.mCycles);
+    printf("max mix time %.3f ms, %u normal mix underruns\n", s.mMaxMixNs * 1e-6, s.mUnderruns);
+    uint32_t fastUnderruns = fastMixer->trackUnderruns(0);
+    uint32_t starvedUnderruns = fastMixer->trackUnderruns(1);
+    printf("fast track underruns: %u, starved fast track underruns: %u\n",
+            fastUnderruns, starvedUnderruns);
+    printf("fast track latency ms: mean %.2f max %.2f (%d/%d impulses)\n",
+            fast.n ? fast.sum / fast.n : 0.0, fast.max, fast.n, impulses);
+    printf("normal mix latency ms: mean %.2f max %.2f (%d/%d impulses)\n",
+            normal.n ? normal.sum / normal.n : 0.0, normal.max, normal.n, impulses);
+
+    int status = 0;
+    if (fast.n != impulses || fast.max > 3 * periodMs) {
+        printf("FAIL: fast track impulses lost or later than 3 periods\n");
+        status = 1;
+    }
+    // the first cycle is not counted in the statistics
+    if (fastUnderruns != 0 || starvedUnderruns < s.mCycles || starvedUnderruns > s.mCycles + 1) {
+        printf("FAIL: fast track underruns not counted per track\n");
+        status = 1;
+    }
+    printf(status ? "FAILED\n" : "PASSED\n");
+    return status;
+}
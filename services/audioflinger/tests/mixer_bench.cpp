@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Offline benchmark for AudioMixer.
+//
+// Feeds N synthetic tracks through AudioMixer::process() using fake buffer
+// providers, reports the CPU time spent per mixed buffer and checks that the
+// vectorized kernels produce exactly the same output as the scalar ones.
+// With -F the integer pipeline is instead compared with the float one,
+// including the final conversion to 16 bits, and the conversion is checked
+// to round the same way wherever a sample falls in the buffer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <system/audio.h>
+
+#include "AudioMixer.h"
+
+using namespace android;
+
+// Provides a deterministic pseudo-random 16-bit signal. The signal is
+// generated up front so that only mixing is measured. Buffers are handed out
+// in chunks of varying size so that the mixer has to deal with partial
+// buffers the same way it does with real tracks.
+class FakeBufferProvider : public AudioBufferProvider {
+public:
+    FakeBufferProvider(int channelCount, uint32_t seed)
+        : mChannelCount(channelCount), mChunk(0), mOffset(0) {
+        mData = new int16_t[kNumFrames * channelCount];
+        for (size_t i = 0; i < kNumFrames * channelCount; i++) {
+            seed = seed * 1103515245 + 12345;
+            mData[i] = int16_t(seed >> 16);
+        }
+    }
+
+    virtual ~FakeBufferProvider() {
+        delete[] mData;
+    }
+
+    virtual status_t getNextBuffer(Buffer* buffer) {
+        size_t frames = buffer->frameCount;
+        // alternate between long and short buffers
+        size_t limit = (++mChunk & 1) ? kNumFrames / 2 : 37;
+        if (frames > limit) {
+            frames = limit;
+        }
+        if (mOffset + frames > kNumFrames) {
+            mOffset = 0;
+        }
+        buffer->raw = mData + mOffset * mChannelCount;
+        buffer->frameCount = frames;
+        return NO_ERROR;
+    }
+
+    virtual void releaseBuffer(Buffer* buffer) {
+        mOffset += buffer->frameCount;
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+    }
+
+private:
+    static const size_t kNumFrames = 8192;
+
+    int mChannelCount;
+    uint32_t mChunk;
+    size_t mOffset;
+    int16_t *mData;
+};
+
+struct Config {
+    int numTracks;
+    size_t frameCount;
+    int iterations;
+    bool ramp;
+    bool aux;
+    bool resample;
+    bool mono;
+    bool floatMix;
+};
+
+static int64_t cpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Mixes config.iterations buffers. If capture is not NULL the output of
+// every buffer is appended to it. Returns the CPU time in nanoseconds.
+static int64_t run(const Config& config, int32_t* capture) {
+    static const uint32_t kSampleRate = 44100;
+
+    AudioMixer mixer(config.frameCount, kSampleRate);
+    // large enough for float stereo
+    int32_t* mainBuffer = new int32_t[config.frameCount * 2];
+    int32_t* auxBuffer = new int32_t[config.frameCount];
+    int16_t* halBuffer = new int16_t[config.frameCount * 2];
+    FakeBufferProvider* providers[AudioMixer::MAX_NUM_TRACKS];
+    int names[AudioMixer::MAX_NUM_TRACKS];
+
+    for (int i = 0; i < config.numTracks; i++) {
+        int channelCount = (config.mono && (i & 1)) ? 1 : 2;
+        providers[i] = new FakeBufferProvider(channelCount, i + 1);
+        names[i] = mixer.getTrackName();
+        mixer.setActiveTrack(names[i]);
+        mixer.setBufferProvider(providers[i]);
+        mixer.setParameter(AudioMixer::TRACK, AudioMixer::CHANNEL_MASK,
+                (void *)(channelCount == 1 ? AUDIO_CHANNEL_OUT_MONO : AUDIO_CHANNEL_OUT_STEREO));
+        mixer.setParameter(AudioMixer::TRACK, AudioMixer::MAIN_BUFFER, (void *)mainBuffer);
+        if (config.floatMix) {
+            mixer.setParameter(AudioMixer::TRACK, AudioMixer::MIXER_FORMAT,
+                    (void *)AudioMixer::FORMAT_PCM_FLOAT);
+        }
+        if (config.aux) {
+            mixer.setParameter(AudioMixer::TRACK, AudioMixer::AUX_BUFFER, (void *)auxBuffer);
+            mixer.setParameter(AudioMixer::VOLUME, AudioMixer::AUXLEVEL, (void *)0x0800);
+        }
+        if (config.resample) {
+            mixer.setParameter(AudioMixer::RESAMPLE, AudioMixer::SAMPLE_RATE,
+                    (void *)(i & 1 ? 48000 : 22050));
+        }
+        mixer.setParameter(AudioMixer::VOLUME, AudioMixer::VOLUME0,
+                (void *)(AudioMixer::UNITY_GAIN / config.numTracks));
+        mixer.setParameter(AudioMixer::VOLUME, AudioMixer::VOLUME1,
+                (void *)(AudioMixer::UNITY_GAIN / config.numTracks));
+        mixer.enable(AudioMixer::MIXING);
+    }
+
+    int64_t total = 0;
+    for (int n = 0; n < config.iterations; n++) {
+        if (config.ramp && (n % 4) == 0) {
+            // start a new ramp every few buffers, alternating up and down
+            int target = (n & 4) ? AudioMixer::UNITY_GAIN : AudioMixer::UNITY_GAIN / 4;
+            for (int i = 0; i < config.numTracks; i++) {
+                mixer.setActiveTrack(names[i]);
+                mixer.setParameter(AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME0, (void *)target);
+                mixer.setParameter(AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME1,
+                        (void *)(target / 2));
+                if (config.aux) {
+                    mixer.setParameter(AudioMixer::RAMP_VOLUME, AudioMixer::AUXLEVEL,
+                            (void *)(target / 3));
+                }
+            }
+        }
+        memset(auxBuffer, 0, config.frameCount * sizeof(int32_t));
+
+        int64_t start = cpuTimeNs();
+        mixer.process();
+        if (config.floatMix) {
+            AudioMixer::convertFloatTo16(halBuffer, (float *)mainBuffer, config.frameCount * 2);
+        } else {
+            memcpy(halBuffer, mainBuffer, config.frameCount * sizeof(int32_t));
+        }
+        total += cpuTimeNs() - start;
+
+        if (capture != NULL) {
+            memcpy(capture, halBuffer, config.frameCount * sizeof(int32_t));
+            capture += config.frameCount;
+            if (config.aux) {
+                memcpy(capture, auxBuffer, config.frameCount * sizeof(int32_t));
+                capture += config.frameCount;
+            }
+        }
+    }
+
+    for (int i = 0; i < config.numTracks; i++) {
+        mixer.deleteTrackName(names[i]);
+        delete providers[i];
+    }
+    delete[] mainBuffer;
+    delete[] auxBuffer;
+    delete[] halBuffer;
+    return total;
+}
+
+// Reference conversion, rounding half away from zero.
+static int16_t floatTo16(float f) {
+    f *= 32768.0f;
+    if (f >= 32767.0f) {
+        return 32767;
+    } else if (f <= -32768.0f) {
+        return -32768;
+    }
+    return (int16_t)(f + (f >= 0 ? 0.5f : -0.5f));
+}
+
+// Converts values halfway between two integers, as well as out of range
+// ones, starting at every offset so that each value goes through both the
+// vector loop and the tail. Returns the number of mismatches.
+static int checkFloatTo16() {
+    static const size_t kNumSamples = 1024;
+    float in[kNumSamples + 8];
+    int16_t out[kNumSamples + 8];
+    uint32_t seed = 1;
+    for (size_t i = 0; i < kNumSamples + 8; i++) {
+        seed = seed * 1103515245 + 12345;
+        int32_t k = int32_t(seed >> 15) % 34000;
+        in[i] = (k + 0.5f) / 32768.0f;
+    }
+
+    int mismatches = 0;
+    for (size_t offset = 0; offset < 8; offset++) {
+        AudioMixer::convertFloatTo16(out, in + offset, kNumSamples);
+        for (size_t i = 0; i < kNumSamples; i++) {
+            if (out[i] != floatTo16(in[offset + i])) {
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -n number of tracks (default 8)\n");
+    fprintf(stderr, "       -f frames per buffer (default 1024)\n");
+    fprintf(stderr, "       -i iterations (default 1000)\n");
+    fprintf(stderr, "       -r(amp) volume\n");
+    fprintf(stderr, "       -a(ux) send\n");
+    fprintf(stderr, "       -s(ample rate conversion)\n");
+    fprintf(stderr, "       -m(ono) every other track\n");
+    fprintf(stderr, "       -F compare integer and float pipelines\n");
+}
+
+int main(int argc, char **argv) {
+    Config config;
+    config.numTracks = 8;
+    config.frameCount = 1024;
+    config.iterations = 1000;
+    config.ramp = false;
+    config.aux = false;
+    config.resample = false;
+    config.mono = false;
+    config.floatMix = false;
+    bool compareFloat = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:f:i:rasmF")) >= 0) {
+        switch (res) {
+            case 'n':
+                config.numTracks = atoi(optarg);
+                break;
+            case 'f':
+                config.frameCount = atoi(optarg);
+                break;
+            case 'i':
+                config.iterations = atoi(optarg);
+                break;
+            case 'r':
+                config.ramp = true;
+                break;
+            case 'a':
+                config.aux = true;
+                break;
+            case 's':
+                config.resample = true;
+                break;
+            case 'm':
+                config.mono = true;
+                break;
+            case 'F':
+                compareFloat = true;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (config.numTracks < 1 || config.numTracks > (int)AudioMixer::MAX_NUM_TRACKS
+            || config.frameCount == 0 || config.iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%d tracks, %u frames, %d buffers%s%s%s%s\n",
+            config.numTracks, config.frameCount, config.iterations,
+            config.ramp ? ", ramp" : "", config.aux ? ", aux" : "",
+            config.resample ? ", resampling" : "", config.mono ? ", mono" : "");
+
+    if (compareFloat) {
+        int64_t intNs = run(config, NULL);
+        printf("int%s:  %8.2f us/buffer\n", AudioMixer::isSimdEnabled() ? " (simd)" : "",
+                intNs / 1000.0 / config.iterations);
+        config.floatMix = true;
+        int64_t floatNs = run(config, NULL);
+        printf("float:       %8.2f us/buffer (%.2fx)\n",
+                floatNs / 1000.0 / config.iterations, (double)floatNs / intNs);
+        int mismatches = checkFloatTo16();
+        if (mismatches != 0) {
+            printf("MISMATCH: %d samples converted to 16 bits differently\n", mismatches);
+            return 1;
+        }
+        printf("float to 16 bits conversion rounds consistently\n");
+        return 0;
+    }
+
+    size_t captureSize = config.frameCount * config.iterations * (config.aux ? 2 : 1);
+    int32_t* scalarOut = new int32_t[captureSize];
+    int32_t* simdOut = new int32_t[captureSize];
+
+    AudioMixer::setSimdEnabled(false);
+    int64_t scalarNs = run(config, scalarOut);
+    printf("scalar: %8.2f us/buffer\n", scalarNs / 1000.0 / config.iterations);
+
+    int status = 0;
+    if (AudioMixer::setSimdEnabled(true)) {
+        int64_t simdNs = run(config, simdOut);
+        printf("simd:   %8.2f us/buffer (%.2fx)\n",
+                simdNs / 1000.0 / config.iterations, (double)scalarNs / simdNs);
+        for (size_t i = 0; i < captureSize; i++) {
+            if (scalarOut[i] != simdOut[i]) {
+                printf("MISMATCH at sample %u: scalar %08x simd %08x\n",
+                        i, scalarOut[i], simdOut[i]);
+                status = 1;
+                break;
+            }
+        }
+        if (status == 0) {
+            printf("simd output is bit-exact\n");
+        }
+    } else {
+        printf("simd: not available\n");
+    }
+
+    delete[] scalarOut;
+    delete[] simdOut;
+    return status;
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// THD+N quality test for the AudioMixer integer and float pipelines.
+//
+// Mixes the same sine wave split over several tracks through both
+// pipelines, fits the fundamental out of the 16-bit result and reports the
+// residual (distortion plus noise) relative to the signal. Exits with a non
+// zero status if the float pipeline is worse than the integer one, or if it
+// clips an intermediate mix that exceeds full scale. Tracks are also mixed
+// from another sample rate, to check that float tracks are resampled.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <system/audio.h>
+
+#include "AudioMixer.h"
+
+using namespace android;
+
+static const uint32_t kSampleRate = 48000;
+static const size_t kFrameCount = 960;
+static const int kNumBuffers = 50;
+static const double kFrequency = 997.0;
+
+// Plays back a precomputed stereo buffer in either 16-bit or float format,
+// at the given sample rate.
+class SineProvider : public AudioBufferProvider {
+public:
+    SineProvider(double amplitude, double phase, bool isFloat, uint32_t sampleRate)
+        : mFloat(isFloat), mOffset(0) {
+        // with some margin for the resamplers' look ahead
+        mNumFrames = (kFrameCount * kNumBuffers + 2 * kFrameCount) * sampleRate / kSampleRate;
+        if (isFloat) {
+            mFloatData = new float[mNumFrames * 2];
+        } else {
+            mData = new int16_t[mNumFrames * 2];
+        }
+        for (size_t i = 0; i < mNumFrames; i++) {
+            double v = amplitude * sin(2 * M_PI * kFrequency * i / sampleRate + phase);
+            for (int c = 0; c < 2; c++) {
+                if (isFloat) {
+                    mFloatData[i * 2 + c] = (float)v;
+                } else {
+                    mData[i * 2 + c] = (int16_t)lrint(v * 32767);
+                }
+            }
+        }
+    }
+
+    virtual ~SineProvider() {
+        if (mFloat) {
+            delete[] mFloatData;
+        } else {
+            delete[] mData;
+        }
+    }
+
+    virtual status_t getNextBuffer(Buffer* buffer) {
+        size_t frames = buffer->frameCount;
+        if (mOffset + frames > mNumFrames) {
+            frames = mNumFrames - mOffset;
+        }
+        if (mFloat) {
+            buffer->raw = mFloatData + mOffset * 2;
+        } else {
+            buffer->raw = mData + mOffset * 2;
+        }
+        buffer->frameCount = frames;
+        return NO_ERROR;
+    }
+
+    virtual void releaseBuffer(Buffer* buffer) {
+        mOffset += buffer->frameCount;
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+    }
+
+private:
+    bool mFloat;
+    size_t mNumFrames;
+    size_t mOffset;
+    union {
+        int16_t *mData;
+        float *mFloatData;
+    };
+};
+
+// Returns the THD+N of the left channel of a 16-bit stereo signal in dB,
+// by least-squares fitting a sine of known frequency plus DC.
+static double thdn(const int16_t* data, size_t frames) {
+    double ss = 0, sc = 0, cc = 0, s1 = 0, c1 = 0, xs = 0, xc = 0, x1 = 0;
+    for (size_t i = 0; i < frames; i++) {
+        double w = 2 * M_PI * kFrequency * i / kSampleRate;
+        double s = sin(w), c = cos(w), x = data[i * 2];
+        ss += s * s; sc += s * c; cc += c * c; s1 += s; c1 += c;
+        xs += x * s; xc += x * c; x1 += x;
+    }
+    // solve the 3x3 normal equations by Cramer's rule
+    double n = frames;
+    double det = ss * (cc * n - c1 * c1) - sc * (sc * n - c1 * s1) + s1 * (sc * c1 - cc * s1);
+    double a = (xs * (cc * n - c1 * c1) - sc * (xc * n - c1 * x1) + s1 * (xc * c1 - cc * x1)) / det;
+    double b = (ss * (xc * n - x1 * c1) - xs * (sc * n - c1 * s1) + s1 * (sc * x1 - xc * s1)) / det;
+    double d = (ss * (cc * x1 - c1 * xc) - sc * (sc * x1 - s1 * xc) + xs * (sc * c1 - cc * s1)) / det;
+
+    double signal = 0, residual = 0;
+    for (size_t i = 0; i < frames; i++) {
+        double w = 2 * M_PI * kFrequency * i / kSampleRate;
+        double fit = a * sin(w) + b * cos(w);
+        double e = data[i * 2] - fit - d;
+        signal += fit * fit;
+        residual += e * e;
+    }
+    return 10 * log10(residual / signal);
+}
+
+// Mixes numTracks tracks of a sine of the given amplitude at the given gain,
+// played at sampleRate.
+// Each track has a different phase so that their quantization errors are not
+// correlated; their sum is still a pure sine. Returns the THD+N in dB and the
+// peak absolute value of the intermediate float mix in *peak (float pipeline
+// only).
+static double mix(int numTracks, double amplitude, int gain, bool useFloat, float* peak,
+        uint32_t sampleRate = kSampleRate) {
+    AudioMixer mixer(kFrameCount, kSampleRate);
+    int32_t* mainBuffer = new int32_t[kFrameCount * 2];
+    int16_t* output = new int16_t[kFrameCount * 2 * kNumBuffers];
+    SineProvider* providers[AudioMixer::MAX_NUM_TRACKS];
+
+    for (int i = 0; i < numTracks; i++) {
+        providers[i] = new SineProvider(amplitude, 0.05 * i, useFloat, sampleRate);
+        mixer.setActiveTrack(mixer.getTrackName());
+        mixer.setBufferProvider(providers[i]);
+        mixer.setParameter(AudioMixer::TRACK, AudioMixer::MAIN_BUFFER, (void *)mainBuffer);
+        if (useFloat) {
+            mixer.setParameter(AudioMixer::TRACK, AudioMixer::FORMAT,
+                    (void *)AudioMixer::FORMAT_PCM_FLOAT);
+            mixer.setParameter(AudioMixer::TRACK, AudioMixer::MIXER_FORMAT,
+                    (void *)AudioMixer::FORMAT_PCM_FLOAT);
+        }
+        if (sampleRate != kSampleRate) {
+            mixer.setParameter(AudioMixer::RESAMPLE, AudioMixer::SAMPLE_RATE,
+                    (void *)sampleRate);
+        }
+        mixer.setParameter(AudioMixer::VOLUME, AudioMixer::VOLUME0, (void *)gain);
+        mixer.setParameter(AudioMixer::VOLUME, AudioMixer::VOLUME1, (void *)gain);
+        mixer.enable(AudioMixer::MIXING);
+    }
+
+    *peak = 0;
+    for (int n = 0; n < kNumBuffers; n++) {
+        mixer.process();
+        int16_t* out = output + n * kFrameCount * 2;
+        if (useFloat) {
+            const float* mix = (const float*)mainBuffer;
+            for (size_t i = 0; i < kFrameCount * 2; i++) {
+                if (fabsf(mix[i]) > *peak) {
+                    *peak = fabsf(mix[i]);
+                }
+            }
+            AudioMixer::convertFloatTo16(out, mix, kFrameCount * 2);
+        } else {
+            memcpy(out, mainBuffer, kFrameCount * sizeof(int32_t));
+        }
+    }
+
+    double result = thdn(output, kFrameCount * kNumBuffers);
+    for (int i = 0; i < numTracks; i++) {
+        delete providers[i];
+    }
+    delete[] mainBuffer;
+    delete[] output;
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int status = 0;
+    float peak;
+
+    static const int kTrackCounts[] = { 1, 8, 32 };
+    for (size_t i = 0; i < sizeof(kTrackCounts) / sizeof(kTrackCounts[0]); i++) {
+        int n = kTrackCounts[i];
+        // each track at -20 dBFS, mixed at -3 dB / n
+        int gain = (int)(AudioMixer::UNITY_GAIN * 0.7 / n);
+        double intThdn = mix(n, 0.1, gain, false, &peak);
+        double floatThdn = mix(n, 0.1, gain, true, &peak);
+        printf("%2d tracks at -20 dBFS: THD+N int %6.1f dB, float %6.1f dB\n",
+                n, intThdn, floatThdn);
+        if (floatThdn > intThdn + 0.1) {
+            printf("FAIL: float pipeline is worse than integer pipeline\n");
+            status = 1;
+        }
+    }
+
+    // float tracks are converted to 16 bits for the resampler, so they
+    // should do as well as 16-bit tracks and must not be muted
+    int gain = (int)(AudioMixer::UNITY_GAIN * 0.7 / 8);
+    double intThdn = mix(8, 0.1, gain, false, &peak, 44100);
+    double floatThdn = mix(8, 0.1, gain, true, &peak, 44100);
+    printf(" 8 tracks at 44100 Hz:   THD+N int %6.1f dB, float %6.1f dB, float mix peak %.3f\n",
+            intThdn, floatThdn, peak);
+    if (peak < 0.06f) {
+        printf("FAIL: resampled float tracks were not mixed\n");
+        status = 1;
+    } else if (floatThdn > intThdn + 0.1) {
+        printf("FAIL: float pipeline is worse than integer pipeline\n");
+        status = 1;
+    }
+
+    // 8 tracks at -6 dBFS and unity gain sum to +12 dBFS: the float mix
+    // must keep that headroom instead of clipping before it is converted.
+    mix(8, 0.5, AudioMixer::UNITY_GAIN, true, &peak);
+    printf("8 tracks at -6 dBFS, unity gain: float mix peak %.2f\n", peak);
+    if (peak < 3.9f) {
+        printf("FAIL: float mix clipped\n");
+        status = 1;
+    }
+
+    printf(status ? "FAILED\n" : "PASSED\n");
+    return status;
+}
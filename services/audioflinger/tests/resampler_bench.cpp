@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Offline benchmark and quality test for the AudioResampler implementations.
+//
+// For each conversion ratio, resamples a sine wave with every resampler
+// quality and reports the CPU time per output buffer, the SNR of the output
+// (residual after least-squares fitting the expected sine) and the level of
+// an input tone above the output Nyquist frequency that aliases back into
+// the output. Exits with a non zero status if the polyphase resampler is
+// noisier than the sinc resampler for a ratio it has a filter bank for.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "AudioResampler.h"
+#include "AudioResamplerPolyphase.h"
+
+using namespace android;
+
+// Plays back a precomputed 16-bit sine, in chunks of varying size.
+class SineProvider : public AudioBufferProvider {
+public:
+    SineProvider(int channelCount, uint32_t sampleRate, double frequency,
+            double amplitude, size_t numFrames)
+        : mChannelCount(channelCount), mNumFrames(numFrames), mOffset(0), mChunk(0) {
+        mData = new int16_t[numFrames * channelCount];
+        for (size_t i = 0; i < numFrames; i++) {
+            double v = amplitude * sin(2 * M_PI * frequency * i / sampleRate);
+            for (int c = 0; c < channelCount; c++) {
+                mData[i * channelCount + c] = (int16_t)lrint(v * 32767);
+            }
+        }
+    }
+
+    virtual ~SineProvider() {
+        delete[] mData;
+    }
+
+    virtual status_t getNextBuffer(Buffer* buffer) {
+        size_t frames = buffer->frameCount;
+        size_t limit = (++mChunk & 1) ? 1024 : 67;
+        if (frames > limit) {
+            frames = limit;
+        }
+        if (mOffset + frames > mNumFrames) {
+            frames = mNumFrames - mOffset;
+        }
+        if (frames == 0) {
+            buffer->raw = NULL;
+            buffer->frameCount = 0;
+            return NOT_ENOUGH_DATA;
+        }
+        buffer->raw = mData + mOffset * mChannelCount;
+        buffer->frameCount = frames;
+        return NO_ERROR;
+    }
+
+    virtual void releaseBuffer(Buffer* buffer) {
+        mOffset += buffer->frameCount;
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+    }
+
+private:
+    int mChannelCount;
+    size_t mNumFrames;
+    size_t mOffset;
+    uint32_t mChunk;
+    int16_t *mData;
+};
+
+static int64_t cpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// unity volume, 4.12
+static const int16_t kUnityGain = 0x1000;
+
+static const char* kQualityNames[] = { "", "linear", "cubic", "sinc", "polyphase" };
+
+struct Result {
+    double usPerBuffer;
+    double snr;
+    double alias;
+};
+
+// Resamples numBuffers buffers of frameCount frames of a sine at the given
+// frequency, and returns the left channel output normalized to +/-1 in
+// output, which must hold numBuffers * frameCount samples.
+static int64_t run(int quality, int channelCount, uint32_t inRate, uint32_t outRate,
+        double frequency, size_t frameCount, int numBuffers, double* output) {
+    size_t inFrames = (size_t)((double)frameCount * numBuffers * inRate / outRate) + 4096;
+    SineProvider provider(channelCount, inRate, frequency, 0.5, inFrames);
+    AudioResampler* resampler = AudioResampler::create(16, channelCount, outRate, quality);
+    resampler->setSampleRate(inRate);
+    resampler->setVolume(kUnityGain, kUnityGain);
+
+    int32_t* temp = new int32_t[frameCount * 2];
+    int64_t total = 0;
+    for (int n = 0; n < numBuffers; n++) {
+        memset(temp, 0, frameCount * 2 * sizeof(int32_t));
+        int64_t start = cpuTimeNs();
+        resampler->resample(temp, frameCount, &provider);
+        total += cpuTimeNs() - start;
+        for (size_t i = 0; i < frameCount; i++) {
+            output[n * frameCount + i] = temp[i * 2] / (4096.0 * 32768.0);
+        }
+    }
+    delete[] temp;
+    delete resampler;
+    return total;
+}
+
+// Returns the ratio in dB of the residual after fitting a sine of the given
+// frequency to the signal, to the fitted sine.
+static double snr(const double* data, size_t frames, double frequency, uint32_t rate) {
+    double ss = 0, sc = 0, cc = 0, xs = 0, xc = 0;
+    for (size_t i = 0; i < frames; i++) {
+        double w = 2 * M_PI * frequency * i / rate;
+        double s = sin(w), c = cos(w);
+        ss += s * s; sc += s * c; cc += c * c;
+        xs += data[i] * s; xc += data[i] * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (xs * cc - xc * sc) / det;
+    double b = (xc * ss - xs * sc) / det;
+    double signal = 0, residual = 0;
+    for (size_t i = 0; i < frames; i++) {
+        double w = 2 * M_PI * frequency * i / rate;
+        double fit = a * sin(w) + b * cos(w);
+        signal += fit * fit;
+        residual += (data[i] - fit) * (data[i] - fit);
+    }
+    return 10 * log10(signal / residual);
+}
+
+static double rmsDb(const double* data, size_t frames) {
+    double sum = 0;
+    for (size_t i = 0; i < frames; i++) {
+        sum += data[i] * data[i];
+    }
+    // relative to the 0.5 amplitude input sine
+    return 10 * log10(sum / frames / 0.125);
+}
+
+static Result measure(int quality, int channelCount, uint32_t inRate, uint32_t outRate,
+        size_t frameCount, int numBuffers) {
+    Result result;
+    size_t total = frameCount * numBuffers;
+    // skip the first buffer to let the filters settle
+    size_t skip = frameCount;
+    double* output = new double[total];
+
+    int64_t ns = run(quality, channelCount, inRate, outRate, 997.0, frameCount, numBuffers,
+            output);
+    result.usPerBuffer = ns / 1000.0 / numBuffers;
+    result.snr = snr(output + skip, total - skip, 997.0, outRate);
+
+    // when downsampling, a tone half way between the output and input
+    // Nyquist frequencies must be filtered out
+    result.alias = -INFINITY;
+    if (inRate > outRate) {
+        run(quality, channelCount, inRate, outRate, (inRate + outRate) / 4.0, frameCount,
+                numBuffers, output);
+        result.alias = rmsDb(output + skip, total - skip);
+    }
+    delete[] output;
+    return result;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s\n", me);
+    fprintf(stderr, "       -h(elp)\n");
+    fprintf(stderr, "       -f frames per buffer (default 1024)\n");
+    fprintf(stderr, "       -i iterations (default 200)\n");
+    fprintf(stderr, "       -m(ono) input\n");
+}
+
+int main(int argc, char **argv) {
+    size_t frameCount = 1024;
+    int numBuffers = 200;
+    int channelCount = 2;
+
+    int res;
+    while ((res = getopt(argc, argv, "hf:i:m")) >= 0) {
+        switch (res) {
+            case 'f':
+                frameCount = atoi(optarg);
+                break;
+            case 'i':
+                numBuffers = atoi(optarg);
+                break;
+            case 'm':
+                channelCount = 1;
+                break;
+            case '?':
+            case 'h':
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (frameCount == 0 || numBuffers < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static const uint32_t kRatios[][2] = {
+        { 44100, 48000 }, { 48000, 44100 }, { 8000, 48000 }, { 16000, 48000 },
+        { 22050, 44100 }, { 22050, 48000 }, { 32000, 48000 }, { 32000, 44100 },
+        { 48000, 32000 }, { 11025, 44100 }, { 12000, 44100 }, { 44056, 48000 },
+    };
+
+    int status = 0;
+    printf("%u frames, %d buffers, %s\n", frameCount, numBuffers,
+            channelCount == 1 ? "mono" : "stereo");
+    printf("%-14s %-10s %10s %8s %8s\n", "ratio", "quality", "us/buffer", "SNR", "alias");
+    for (size_t i = 0; i < sizeof(kRatios) / sizeof(kRatios[0]); i++) {
+        uint32_t inRate = kRatios[i][0];
+        uint32_t outRate = kRatios[i][1];
+        double sincSnr = 0;
+        for (int quality = AudioResampler::LOW_QUALITY;
+                quality <= AudioResampler::VERY_HIGH_QUALITY; quality++) {
+            Result r = measure(quality, channelCount, inRate, outRate, frameCount, numBuffers);
+            bool fallback = quality == AudioResampler::VERY_HIGH_QUALITY &&
+                    !AudioResamplerPolyphase::isRatioSupported(inRate, outRate);
+            printf("%5u->%-6u  %-10s %10.2f %6.1f dB %6.1f dB%s\n", inRate, outRate,
+                    kQualityNames[quality], r.usPerBuffer, r.snr, r.alias,
+                    fallback ? " (sinc fallback)" : "");
+            if (quality == AudioResampler::HIGH_QUALITY) {
+                sincSnr = r.snr;
+            } else if (quality == AudioResampler::VERY_HIGH_QUALITY && !fallback &&
+                    r.snr < sincSnr) {
+                printf("FAIL: polyphase SNR is lower than sinc SNR\n");
+                status = 1;
+            }
+        }
+    }
+
+    printf(status ? "FAILED\n" : "PASSED\n");
+    return status;
+}